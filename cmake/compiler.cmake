@@ -154,6 +154,10 @@ if (ENABLE_BACKTRACE)
     endif()
 endif()
 
+option(ENABLE_ALLOC_STAT "Enable per-request-type allocation accounting
+(fiber region bytes, memtx tuple bytes, obuf response copies), surfaced
+as box.stat.alloc(). Costs a few counter increments per request." ON)
+
 #
 # Set flags for all include files: those maintained by us and
 # coming from third parties.
@@ -49,6 +49,7 @@ if (ENABLE_SSE2)
         message( SEND_ERROR "SSE2 is enabled, but is not supported by compiler.")
     else()
         add_compile_flags("C;CXX" "-msse2")
+        add_definitions(-DENABLE_SSE2=1)
         find_package_message(SSE2 "SSE2 is enabled - target CPU must supppot it"
             "${CC_HAS_SSE2_INTRINSICS}")
     endif()
@@ -59,6 +60,7 @@ if (ENABLE_AVX)
         message(SEND_ERROR "AVX is enabled")
     else()
         add_compile_flags("C;CXX" "-mavx")
+        add_definitions(-DENABLE_AVX=1)
         find_package_message(SSE2 "AVX is enabled - target CPU must support it"
             "${CC_HAS_AVX_INTRINSICS}")
     endif()
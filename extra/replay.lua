@@ -0,0 +1,165 @@
+#!/usr/bin/env tarantool
+--
+-- replay.lua - play a traffic capture back against an instance.
+--
+-- Usage: tarantool replay.lua <capture file> <host> <port> [speed]
+--
+-- The capture is recorded on the production instance with
+--
+--     box.internal.capture_start('/path/to/requests.capture')
+--     -- ... workload ...
+--     box.internal.capture_stop()
+--
+-- Each captured row carries the receive timestamp and the id of
+-- the session it arrived on. The replayer opens one connection
+-- per captured session, and each connection sends its requests
+-- with the captured inter-arrival delays divided by <speed>
+-- (default 1), so both the concurrency and the pacing of the
+-- original workload are reproduced. Responses are read and
+-- discarded.
+--
+-- Authentication is not replayed: every connection is opened as
+-- guest, so grant guest the necessary rights on the target
+-- instance first.
+--
+
+local xlog = require('xlog')
+local socket = require('socket')
+local fiber = require('fiber')
+local msgpack = require('msgpack')
+
+local capture_path = arg[1]
+local host = arg[2]
+local port = tonumber(arg[3])
+local speed = tonumber(arg[4]) or 1
+
+if capture_path == nil or host == nil or port == nil or speed <= 0 then
+    io.stderr:write('Usage: tarantool replay.lua <capture file> ' ..
+                    '<host> <port> [speed]\n')
+    os.exit(1)
+end
+
+-- The Lua xlog reader resolves known request type and body key
+-- codes into names; map them back to rebuild the frames.
+local type_code = {
+    SELECT = 1, INSERT = 2, REPLACE = 3, UPDATE = 4, DELETE = 5,
+    AUTH = 7, EVAL = 8, UPSERT = 9, CALL = 10,
+}
+local body_key = {
+    space_id = 0x10, index_id = 0x11, limit = 0x12, offset = 0x13,
+    iterator = 0x14, index_base = 0x15, key = 0x20, tuple = 0x21,
+    function_name = 0x22, user_name = 0x23, expression = 0x27,
+    operations = 0x28,
+}
+
+--
+-- Load the capture into per-session queues. Row order within a
+-- session is the original arrival order.
+--
+local sessions = {}
+local session_ids = {}
+local base_ts, last_ts
+local total = 0
+local skipped = 0
+
+for _, row in xlog.pairs(capture_path) do
+    local header = row.HEADER
+    local code = type(header.type) == 'number' and header.type or
+                 type_code[header.type]
+    if code == nil or code == type_code.AUTH then
+        skipped = skipped + 1
+    else
+        local body = {}
+        for k, v in pairs(row.BODY or {}) do
+            if type(k) == 'string' then
+                k = body_key[k]
+            end
+            if k ~= nil then
+                body[k] = v
+            end
+        end
+        local sid = header.replica_id or 0
+        if sessions[sid] == nil then
+            sessions[sid] = {}
+            table.insert(session_ids, sid)
+        end
+        local ts = header.timestamp or 0
+        table.insert(sessions[sid],
+                     { ts = ts, type = code, body = body })
+        if base_ts == nil or ts < base_ts then
+            base_ts = ts
+        end
+        if last_ts == nil or ts > last_ts then
+            last_ts = ts
+        end
+        total = total + 1
+    end
+end
+
+if total == 0 then
+    io.stderr:write('nothing to replay\n')
+    os.exit(1)
+end
+
+local function encode_request(code, sync, body)
+    local header = msgpack.encode(
+        setmetatable({ [0x00] = code, [0x01] = sync },
+                     { __serialize = 'map' }))
+    local payload = header ..
+        msgpack.encode(setmetatable(body, { __serialize = 'map' }))
+    return msgpack.encode(#payload) .. payload
+end
+
+local start = fiber.time()
+local sent = 0
+local done = fiber.channel(#session_ids)
+
+local function session_f(queue)
+    local s = socket.tcp_connect(host, port)
+    if s == nil then
+        io.stderr:write(string.format('connect to %s:%d failed\n',
+                                      host, port))
+        done:put(false)
+        return
+    end
+    s:read(128) -- greeting
+    -- Drain responses so the server never blocks on its obuf.
+    fiber.create(function()
+        while true do
+            local chunk = s:sysread(16384)
+            if chunk == nil or chunk == '' then
+                break
+            end
+        end
+    end)
+    local sync = 0
+    for _, req in ipairs(queue) do
+        local due = start + (req.ts - base_ts) / speed
+        local now = fiber.time()
+        if due > now then
+            fiber.sleep(due - now)
+        end
+        sync = sync + 1
+        s:write(encode_request(req.type, sync, req.body))
+        sent = sent + 1
+    end
+    -- Give the last responses a chance to arrive.
+    fiber.sleep(0.1)
+    s:close()
+    done:put(true)
+end
+
+for _, sid in ipairs(session_ids) do
+    fiber.create(session_f, sessions[sid])
+end
+for _ = 1, #session_ids do
+    done:get()
+end
+
+local elapsed = fiber.time() - start
+print(string.format(
+    'replayed %d requests over %d connections in %.3f sec ' ..
+    '(capture spans %.3f sec, speed x%g), %d rows skipped',
+    sent, #session_ids, elapsed, (last_ts or 0) - (base_ts or 0),
+    speed, skipped))
+os.exit(0)
@@ -29,6 +29,7 @@
  * SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <string.h>
 #if defined(__cplusplus)
 extern "C" {
 #endif /* defined(__cplusplus) */
@@ -37,8 +38,6 @@ extern "C" {
 #define MH_UNDEF
 #endif
 
-#include "third_party/PMurHash.h"
-
 /*
  * Map: (i32) => (void *)
  */
@@ -85,10 +84,52 @@ enum {
 static inline uint32_t
 mh_strn_hash(const char *str, size_t len)
 {
-	uint32_t h = MH_STRN_HASH_SEED;
-	uint32_t carry = 0;
-	PMurHash32_Process(&h, &carry, str, len);
-	return PMurHash32_Result(h, carry, len);
+	/*
+	 * Word-at-a-time multiply-rotate mix with a murmur-style
+	 * finalizer. The keys are schema object names, a few bytes
+	 * to a few dozen bytes long, so a short dependency chain
+	 * on 8-byte loads beats the byte-at-a-time loop the
+	 * portable PMurHash does. The hash is never persisted, so
+	 * the function is free to change between versions.
+	 */
+	uint64_t h = MH_STRN_HASH_SEED +
+		     len * UINT64_C(0x9E3779B97F4A7C15);
+	while (len >= 8) {
+		uint64_t w;
+		memcpy(&w, str, 8);
+		h ^= w * UINT64_C(0xC2B2AE3D27D4EB4F);
+		h = (h << 31 | h >> 33) * UINT64_C(0x9E3779B97F4A7C15);
+		str += 8;
+		len -= 8;
+	}
+	if (len > 0) {
+		uint64_t w = 0;
+		memcpy(&w, str, len);
+		h ^= w * UINT64_C(0xC2B2AE3D27D4EB4F);
+	}
+	h ^= h >> 33;
+	h *= UINT64_C(0xFF51AFD7ED558CCD);
+	h ^= h >> 29;
+	return (uint32_t)(h >> 32) ^ (uint32_t)h;
+}
+
+/*
+ * Equality check for length-tagged strings, returns non-zero when
+ * the strings differ (the caller has already matched the lengths).
+ * Strings up to a word long - the common case for names - are
+ * compared in registers; longer ones go through memcmp(), which
+ * unlike strncmp() does not have to watch for a terminating NUL.
+ */
+static inline int
+mh_strn_neq(const char *a, const char *b, size_t len)
+{
+	if (len <= 8) {
+		uint64_t wa = 0, wb = 0;
+		memcpy(&wa, a, len);
+		memcpy(&wb, b, len);
+		return wa != wb;
+	}
+	return memcmp(a, b, len);
 }
 
 #define mh_name _strnptr
@@ -111,7 +152,7 @@ struct mh_strnptr_node_t {
 #define mh_hash(a, arg) ((a)->hash)
 #define mh_hash_key(a, arg) ((a)->hash)
 #define mh_cmp(a, b, arg) ((a)->len != (b)->len || \
-			    strncmp((a)->str, (b)->str, (a)->len))
+			    mh_strn_neq((a)->str, (b)->str, (a)->len))
 #define mh_cmp_key(a, b, arg) mh_cmp(a, b, arg)
 #include "salad/mhash.h"
 
@@ -123,6 +164,21 @@ mh_strnptr_find_inp(struct mh_strnptr_t *h, const char *str, size_t len)
 	return mh_strnptr_find(h, &key, NULL);
 };
 
+/*
+ * Map: (i32) => (void *), Robin Hood probing.
+ * Same node layout as mh_i32ptr_t; preferred for small metadata
+ * maps with lookup-heavy access patterns (e.g. schema caches).
+ */
+#define mh_name _rh_i32ptr
+#define mh_key_t uint32_t
+#define mh_node_t struct mh_i32ptr_node_t
+#define mh_arg_t void *
+#define mh_hash(a, arg) ((a)->key)
+#define mh_hash_key(a, arg) (a)
+#define mh_cmp(a, b, arg) ((a)->key != (b)->key)
+#define mh_cmp_key(a, b, arg) ((a) != (b)->key)
+#include "salad/mhash_rh.h"
+
 
 #if defined(__cplusplus)
 } /* extern "C" */
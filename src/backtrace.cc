@@ -48,12 +48,6 @@ void *__libc_stack_end;
 #endif
 
 #ifdef HAVE_BFD
-struct symbol {
-	void *addr;
-	const char *name;
-	void *end;
-};
-
 static struct symbol *symbols;
 static ssize_t symbol_count;
 
@@ -346,6 +340,31 @@ print_backtrace()
 
 	fdprintf(STDERR_FILENO, "%s", backtrace(frame, stack_top, stack_size));
 }
+
+int
+backtrace_collect(void **frames, int max_frames)
+{
+	struct frame *frame = (struct frame *) __builtin_frame_address(0);
+	void *stack_bottom;
+	void *stack_top;
+
+	if (fiber() == NULL ||
+	    strcmp(fiber_name(fiber()), "sched") == 0) {
+		stack_bottom = frame;
+		stack_top = __libc_stack_end;
+	} else {
+		stack_bottom = fiber()->coro.stack;
+		stack_top = (char *) stack_bottom + fiber()->coro.stack_size;
+	}
+
+	int n = 0;
+	while (n < max_frames && stack_bottom <= (void *) frame &&
+	       (void *) frame < stack_top) {
+		frames[n++] = frame->ret;
+		frame = frame->rbp;
+	}
+	return n;
+}
 #endif /* ENABLE_BACKTRACE */
 
 
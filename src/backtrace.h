@@ -53,8 +53,34 @@ void
 backtrace_foreach(backtrace_cb cb, void *frame, void *stack,
 		  size_t stack_size, void *cb_ctx);
 
+/**
+ * Collect the raw return addresses of the current call chain,
+ * leaf first, into @a frames. Only walks the stack - no
+ * allocation, no symbol lookup - so it is safe to call from a
+ * signal handler; resolve the addresses later with addr2symbol().
+ * @return the number of collected frames, at most @a max_frames.
+ */
+int
+backtrace_collect(void **frames, int max_frames);
+
 #endif /* ENABLE_BACKTRACE */
 
+#ifdef HAVE_BFD
+/** An entry of the symbol table loaded from the binary. */
+struct symbol {
+	void *addr;
+	const char *name;
+	void *end;
+};
+
+/**
+ * Map a text address to the symbol table, NULL if the address
+ * falls outside all known functions.
+ */
+struct symbol *
+addr2symbol(void *addr);
+#endif /* HAVE_BFD */
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
@@ -0,0 +1,147 @@
+#ifndef TARANTOOL_BOX_ALLOC_STAT_H_INCLUDED
+#define TARANTOOL_BOX_ALLOC_STAT_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "trivia/config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iproto_constants.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * Per-request-type allocation accounting, surfaced as
+ * box.stat.alloc(). The counters live in the tx cord only, like
+ * the latency histograms: every accounted allocation happens
+ * while tx executes a request. Compiled out entirely with
+ * -DENABLE_ALLOC_STAT=OFF; when compiled in, the cost is a
+ * global load and a counter increment per accounted allocation.
+ */
+struct alloc_stat {
+	/** Bytes drawn from the fiber region during requests. */
+	uint64_t region_bytes;
+	/** Bytes of tuples allocated from the memtx arena. */
+	uint64_t smalloc_bytes;
+	/** Tuple-to-obuf response copies. */
+	uint64_t obuf_copies;
+	/** Bytes copied into response obufs. */
+	uint64_t obuf_bytes;
+};
+
+#ifdef ENABLE_ALLOC_STAT
+
+extern struct alloc_stat alloc_stats[IPROTO_TYPE_STAT_MAX];
+
+/**
+ * Type of the request currently executing in tx, UINT32_MAX when
+ * none. A single tx-wide variable: a fiber which yields
+ * mid-request (the WAL wait) briefly donates its attribution to
+ * whatever runs next. The skew is a few post-commit allocations
+ * per request - noise against capacity-planning numbers.
+ */
+extern uint32_t alloc_stat_type;
+
+static inline void
+alloc_stat_begin(uint32_t type)
+{
+	alloc_stat_type = type < IPROTO_TYPE_STAT_MAX ? type : UINT32_MAX;
+}
+
+static inline void
+alloc_stat_end(void)
+{
+	alloc_stat_type = UINT32_MAX;
+}
+
+static inline void
+alloc_stat_account_region(size_t size)
+{
+	if (alloc_stat_type != UINT32_MAX)
+		alloc_stats[alloc_stat_type].region_bytes += size;
+}
+
+static inline void
+alloc_stat_account_smalloc(size_t size)
+{
+	if (alloc_stat_type != UINT32_MAX)
+		alloc_stats[alloc_stat_type].smalloc_bytes += size;
+}
+
+static inline void
+alloc_stat_account_obuf(size_t size)
+{
+	if (alloc_stat_type != UINT32_MAX) {
+		alloc_stats[alloc_stat_type].obuf_copies++;
+		alloc_stats[alloc_stat_type].obuf_bytes += size;
+	}
+}
+
+#else /* !defined(ENABLE_ALLOC_STAT) */
+
+static inline void
+alloc_stat_begin(uint32_t type)
+{
+	(void) type;
+}
+
+static inline void
+alloc_stat_end(void)
+{
+}
+
+static inline void
+alloc_stat_account_region(size_t size)
+{
+	(void) size;
+}
+
+static inline void
+alloc_stat_account_smalloc(size_t size)
+{
+	(void) size;
+}
+
+static inline void
+alloc_stat_account_obuf(size_t size)
+{
+	(void) size;
+}
+
+#endif /* defined(ENABLE_ALLOC_STAT) */
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_BOX_ALLOC_STAT_H_INCLUDED */
@@ -342,6 +342,35 @@ index_opts_decode_distance(const char *str)
 	return RTREE_INDEX_DISTANCE_TYPE_EUCLID; /* unreachabe */
 }
 
+/**
+ * Support function for index_def_new_from_tuple(..)
+ * Decode vinyl compaction policy from a string to enum.
+ * Throws an error if the value does not correspond to any
+ * enum value.
+ */
+static enum vy_compaction_policy
+index_opts_decode_compaction_policy(const char *str)
+{
+	uint32_t len = strlen(str);
+	if (len == strlen("leveled") &&
+	    strncasecmp(str, "leveled", len) == 0) {
+		return VY_COMPACTION_LEVELED;
+	} else if (len == strlen("tiered") &&
+		   strncasecmp(str, "tiered", len) == 0) {
+		return VY_COMPACTION_TIERED;
+	} else if (len == strlen("lazy_leveling") &&
+		   strncasecmp(str, "lazy_leveling", len) == 0) {
+		return VY_COMPACTION_LAZY_LEVELING;
+	} else {
+		tnt_raise(ClientError,
+			  ER_WRONG_INDEX_OPTIONS,
+			  INDEX_OPTS,
+			  "compaction_policy must be 'leveled', 'tiered' "
+			  "or 'lazy_leveling'");
+	}
+	return VY_COMPACTION_LEVELED; /* unreachabe */
+}
+
 /**
  * Support function for index_def_new_from_tuple(..)
  * 1.6.6+
@@ -358,12 +387,18 @@ index_opts_create(struct index_opts *opts, const char *map)
 				     ER_WRONG_INDEX_OPTIONS, INDEX_OPTS);
 	if (opts->distancebuf[0] != '\0')
 		opts->distance = index_opts_decode_distance(opts->distancebuf);
+	if (opts->compaction_policybuf[0] != '\0')
+		opts->compaction_policy = index_opts_decode_compaction_policy(
+			opts->compaction_policybuf);
 	if (opts->run_count_per_level <= 0)
 		tnt_raise(ClientError, ER_WRONG_INDEX_OPTIONS, INDEX_OPTS,
 			  "run_count_per_level must be > 0");
 	if (opts->run_size_ratio <= 1)
 		tnt_raise(ClientError, ER_WRONG_SPACE_OPTIONS, INDEX_OPTS,
 			  "run_size_ratio must be > 1");
+	if (opts->cache_size < 0)
+		tnt_raise(ClientError, ER_WRONG_INDEX_OPTIONS, INDEX_OPTS,
+			  "cache_size must be >= 0");
 	return map;
 }
 
@@ -929,10 +964,32 @@ ModifySpace::prepare(struct alter_space *alter)
 	    def.exact_field_count != alter->old_space->def.exact_field_count &&
 	    space_index(alter->old_space, 0) != NULL &&
 	    space_size(alter->old_space) > 0) {
-
-		tnt_raise(ClientError, ER_ALTER_SPACE,
-			  space_name(alter->old_space),
-			  "can not change field count on a non-empty space");
+		/*
+		 * Growing the field count of a non-empty space is
+		 * an online operation when the new definition
+		 * carries a min_field_count covering the tuples
+		 * already stored: the old tuples stay valid, read
+		 * as nil in the missing trailing fields, and
+		 * acquire the new layout whenever they are next
+		 * rewritten. Everything else - shrinking, or
+		 * introducing a constraint over tuples of unknown
+		 * width - would require a full data scan, which
+		 * alter does not do.
+		 */
+		uint32_t old_exact =
+			alter->old_space->def.exact_field_count;
+		int64_t old_min = alter->old_space->def.opts.min_field_count;
+		if (old_min == 0)
+			old_min = old_exact;
+		if (old_exact == 0 ||
+		    def.exact_field_count < old_exact ||
+		    def.opts.min_field_count == 0 ||
+		    def.opts.min_field_count > old_min) {
+			tnt_raise(ClientError, ER_ALTER_SPACE,
+				  space_name(alter->old_space),
+				  "can not change field count on "
+				  "a non-empty space");
+		}
 	}
 
 	Engine *engine = alter->old_space->handler->engine;
@@ -30,8 +30,10 @@
  */
 #include "applier.h"
 
+#include <fcntl.h>
 #include <msgpuck.h>
 
+#include "coeio_file.h"
 #include "xlog.h"
 #include "fiber.h"
 #include "scoped_guard.h"
@@ -46,6 +48,8 @@
 #include "trigger.h"
 #include "xrow_io.h"
 #include "error.h"
+#include "cfg.h"
+#include "zstd.h"
 
 /* TODO: add configuration options */
 static const int RECONNECT_DELAY = 1;
@@ -190,6 +194,67 @@ done:
 	applier_set_state(applier, APPLIER_READY);
 }
 
+/**
+ * Append the payload of an IPROTO_SNAP_CHUNK packet to the
+ * snapshot file being downloaded.
+ */
+static void
+applier_write_snap_chunk(int fd, const char *path, struct xrow_header *row)
+{
+	if (row->bodycnt == 0)
+		tnt_raise(ClientError, ER_INVALID_MSGPACK, "request body");
+	const char *d = (const char *) row->body[0].iov_base;
+	if (mp_typeof(*d) != MP_MAP)
+		goto error;
+	for (uint32_t size = mp_decode_map(&d); size > 0; size--) {
+		if (mp_typeof(*d) != MP_UINT) {
+			mp_next(&d); /* key */
+			mp_next(&d); /* value */
+			continue;
+		}
+		if (mp_decode_uint(&d) == IPROTO_DATA &&
+		    mp_typeof(*d) == MP_BIN) {
+			uint32_t len;
+			const char *bin = mp_decode_bin(&d, &len);
+			if (coeio_write(fd, bin, len) != (ssize_t) len)
+				tnt_raise(SystemError,
+					  "failed to write '%s'", path);
+			return;
+		}
+		mp_next(&d);
+	}
+error:
+	tnt_raise(ClientError, ER_PROTOCOL, "Invalid snapshot chunk");
+}
+
+/**
+ * Replay a snapshot file downloaded from the master into the
+ * join stream. The xlog cursor verifies the file checksums, so
+ * a corrupted transfer fails the join instead of planting bad
+ * data.
+ */
+static void
+applier_join_snap_file(struct applier *applier, const char *path)
+{
+	struct xlog_cursor cursor;
+	if (xlog_cursor_open(&cursor, path) < 0)
+		diag_raise();
+	cursor.read_ahead = XLOG_READ_AHEAD_BULK;
+	auto cursor_guard = make_scoped_guard([&]{
+		xlog_cursor_close(&cursor, false);
+	});
+	int rc;
+	struct xrow_header row;
+	while ((rc = xlog_cursor_next(&cursor, &row, false)) == 0)
+		xstream_write_xc(applier->join_stream, &row);
+	if (rc < 0)
+		diag_raise();
+	if (cursor.state != XLOG_CURSOR_EOF) {
+		tnt_raise(XlogError, "snapshot transfer is truncated: "
+			  "'%s' has no EOF marker", path);
+	}
+}
+
 /**
  * Execute and process JOIN request (bootstrap the instance).
  */
@@ -200,7 +265,8 @@ applier_join(struct applier *applier)
 	struct ev_io *coio = &applier->io;
 	struct iobuf *iobuf = applier->iobuf;
 	struct xrow_header row;
-	xrow_encode_join(&row, &INSTANCE_UUID);
+	/* Advertise that we can take the snapshot as a raw file. */
+	xrow_encode_join(&row, &INSTANCE_UUID, 1);
 	coio_write_xrow(coio, &row);
 
 	/**
@@ -228,14 +294,42 @@ applier_join(struct applier *applier)
 	applier_set_state(applier, APPLIER_INITIAL_JOIN);
 
 	/*
-	 * Receive initial data.
+	 * Receive initial data: either a row stream or, when the
+	 * master supports IPROTO_SNAP_FILE, raw snapshot file
+	 * chunks downloaded to disk and replayed after the end of
+	 * stage marker.
 	 */
+	char snap_path[PATH_MAX];
+	snprintf(snap_path, sizeof(snap_path), "%s/bootstrap.snap.part",
+		 cfg_gets("memtx_dir"));
+	int snap_fd = -1;
+	bool snap_received = false;
+	auto snap_guard = make_scoped_guard([&]{
+		if (snap_fd >= 0)
+			coeio_close(snap_fd);
+		if (snap_received)
+			coeio_unlink(snap_path);
+	});
+
 	assert(applier->join_stream != NULL);
 	while (true) {
 		coio_read_xrow(coio, &iobuf->in, &row);
 		applier->last_row_time = ev_now(loop());
 		if (iproto_type_is_dml(row.type)) {
 			xstream_write_xc(applier->join_stream, &row);
+		} else if (row.type == IPROTO_SNAP_CHUNK) {
+			if (snap_fd < 0) {
+				snap_fd = coeio_open(snap_path,
+						     O_WRONLY | O_CREAT |
+						     O_TRUNC, 0644);
+				if (snap_fd < 0) {
+					tnt_raise(SystemError,
+						  "failed to create '%s'",
+						  snap_path);
+				}
+				snap_received = true;
+			}
+			applier_write_snap_chunk(snap_fd, snap_path, &row);
 		} else if (row.type == IPROTO_OK) {
 			if (applier->version_id < version_id(1, 7, 0)) {
 				/*
@@ -255,6 +349,16 @@ applier_join(struct applier *applier)
 				  (uint32_t) row.type);
 		}
 	}
+	if (snap_fd >= 0) {
+		if (coeio_close(snap_fd) < 0) {
+			snap_fd = -1;
+			tnt_raise(SystemError, "failed to close '%s'",
+				  snap_path);
+		}
+		snap_fd = -1;
+		say_info("replaying the downloaded snapshot file");
+		applier_join_snap_file(applier, snap_path);
+	}
 	say_info("initial data received");
 
 	applier_set_state(applier, APPLIER_FINAL_JOIN);
@@ -295,6 +399,245 @@ finish:
 	applier_set_state(applier, APPLIER_READY);
 }
 
+enum {
+	/**
+	 * Size of the row queue between the fetcher fiber and the
+	 * applier fiber. Bounds the read-ahead: once the queue is
+	 * full the fetcher stops reading the socket until the
+	 * applier catches up.
+	 */
+	APPLIER_FETCH_QUEUE_SIZE = 256,
+	/**
+	 * Max bytes the queued row copies may occupy. The channel
+	 * bounds the row count; this bounds the memory, so a burst
+	 * of huge rows cannot blow the applier up while there are
+	 * still free slots.
+	 */
+	APPLIER_FETCH_QUEUE_BYTES_MAX = 16 * 1024 * 1024,
+	/** Max rows the applier fiber takes from the queue at once. */
+	APPLIER_FETCH_BATCH_MAX = 64,
+	/** Decompression output is reserved in chunks of this size. */
+	APPLIER_ZBUF_CHUNK = 16320,
+};
+
+/**
+ * A replication row on its way from the fetcher fiber to the
+ * applier fiber. The row body is copied out of the connection
+ * input buffer right behind the struct, so the fetcher is free
+ * to reset the buffer and read the next packet while this row
+ * waits in the queue.
+ */
+struct applier_fetch_msg {
+	struct ipc_msg base;
+	struct xrow_header row;
+	/** Allocation size, counted against the queue byte budget. */
+	size_t size;
+	/* Row body bytes follow. */
+};
+
+/**
+ * The fetch queue and its memory budget, shared by the fetcher
+ * and the applier fibers.
+ */
+struct applier_fetch_queue {
+	/** The row channel, fetcher -> applier. */
+	struct ipc_channel *channel;
+	/** Bytes occupied by the queued rows. */
+	size_t used;
+	/** Signaled when @used drops, see applier_fetch_put(). */
+	struct ipc_cond drained;
+};
+
+static void
+applier_fetch_msg_destroy(struct ipc_msg *msg)
+{
+	free(msg);
+}
+
+static struct applier_fetch_msg *
+applier_fetch_msg_new(const struct xrow_header *row)
+{
+	size_t size = sizeof(struct applier_fetch_msg);
+	for (int i = 0; i < row->bodycnt; i++)
+		size += row->body[i].iov_len;
+	struct applier_fetch_msg *msg =
+		(struct applier_fetch_msg *) malloc(size);
+	if (msg == NULL)
+		tnt_raise(OutOfMemory, size, "malloc", "applier_fetch_msg");
+	msg->base.destroy = applier_fetch_msg_destroy;
+	msg->size = size;
+	msg->row = *row;
+	char *pos = (char *) (msg + 1);
+	for (int i = 0; i < row->bodycnt; i++) {
+		memcpy(pos, row->body[i].iov_base, row->body[i].iov_len);
+		msg->row.body[i].iov_base = pos;
+		pos += row->body[i].iov_len;
+	}
+	return msg;
+}
+
+/**
+ * Queue a fetched row for the applier fiber.
+ * @retval 0  queued
+ * @retval -1 the applier has closed the queue
+ */
+static int
+applier_fetch_put(struct applier_fetch_queue *queue,
+		  const struct xrow_header *row)
+{
+	/*
+	 * Respect the byte budget. Waiting here stops the socket
+	 * reads, which closes the TCP receive window and in the
+	 * end parks the master's WAL cursor on its bounded send
+	 * buffer - memory pressure becomes pacing end to end
+	 * instead of an unbounded pile-up.
+	 */
+	while (queue->used >= APPLIER_FETCH_QUEUE_BYTES_MAX) {
+		if (fiber_is_cancelled() ||
+		    ipc_channel_is_closed(queue->channel))
+			return -1;
+		ipc_cond_wait(&queue->drained);
+	}
+	struct applier_fetch_msg *msg = applier_fetch_msg_new(row);
+	queue->used += msg->size;
+	if (ipc_channel_put_msg_timeout(queue->channel, &msg->base,
+					TIMEOUT_INFINITY) != 0) {
+		queue->used -= msg->size;
+		msg->base.destroy(&msg->base);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Unwrap an IPROTO_COMPRESSION envelope: decompress the ZSTD
+ * frame from its body into @a zbuf and queue every row of the
+ * reconstructed packet stream.
+ * @retval 0  done
+ * @retval -1 the applier has closed the queue
+ */
+static int
+applier_fetch_zstd(struct applier *applier, struct applier_fetch_queue *queue,
+		   ZSTD_DStream **zdctx, struct ibuf *zbuf,
+		   const struct xrow_header *row)
+{
+	if (row->bodycnt == 0) {
+		tnt_raise(ClientError, ER_PROTOCOL,
+			  "Invalid compressed replication packet");
+	}
+	/* The body is {IPROTO_DATA: <ZSTD frame>}. */
+	const char *d = (const char *) row->body[0].iov_base;
+	const char *frame = NULL;
+	uint32_t frame_len = 0;
+	uint32_t map_size = mp_decode_map(&d);
+	for (uint32_t i = 0; i < map_size; i++) {
+		if (mp_typeof(*d) != MP_UINT) {
+			mp_next(&d); /* key */
+			mp_next(&d); /* value */
+			continue;
+		}
+		uint64_t key = mp_decode_uint(&d);
+		if (key == IPROTO_DATA && mp_typeof(*d) == MP_BIN)
+			frame = mp_decode_bin(&d, &frame_len);
+		else
+			mp_next(&d);
+	}
+	if (frame == NULL) {
+		tnt_raise(ClientError, ER_PROTOCOL,
+			  "Invalid compressed replication packet");
+	}
+	if (*zdctx == NULL && (*zdctx = ZSTD_createDStream()) == NULL)
+		tnt_raise(OutOfMemory, 0, "ZSTD_createDStream", "zdctx");
+	ibuf_reset(zbuf);
+	ZSTD_initDStream(*zdctx);
+	ZSTD_inBuffer input = {frame, frame_len, 0};
+	while (input.pos < input.size) {
+		void *dst = ibuf_reserve(zbuf, APPLIER_ZBUF_CHUNK);
+		if (dst == NULL) {
+			tnt_raise(OutOfMemory, APPLIER_ZBUF_CHUNK,
+				  "ibuf", "decompression buffer");
+		}
+		ZSTD_outBuffer output = {dst, APPLIER_ZBUF_CHUNK, 0};
+		size_t rc = ZSTD_decompressStream(*zdctx, &output, &input);
+		if (ZSTD_isError(rc)) {
+			tnt_raise(ClientError, ER_PROTOCOL,
+				  "Broken compressed replication stream");
+		}
+		ibuf_alloc(zbuf, output.pos);
+	}
+	/*
+	 * The decompressed bytes are the usual length-prefixed
+	 * packet stream, just as if they had come off the socket.
+	 */
+	const char *pos = zbuf->rpos;
+	const char *end = zbuf->wpos;
+	while (pos < end) {
+		if (mp_typeof(*pos) != MP_UINT) {
+			tnt_raise(ClientError, ER_INVALID_MSGPACK,
+				  "packet length");
+		}
+		uint32_t len = mp_decode_uint(&pos);
+		struct xrow_header sub;
+		xrow_header_decode_xc(&sub, &pos, pos + len);
+		applier->lag = ev_now(loop()) - sub.tm;
+		if (applier_fetch_put(queue, &sub) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Fetcher fiber: reads rows off the master connection and queues
+ * them for the applier fiber, so that the socket keeps draining
+ * while the applier waits on WAL. On any error the queue is
+ * closed to wake the applier, which joins this fiber and
+ * re-throws the original exception.
+ */
+static int
+applier_fetch_f(va_list ap)
+{
+	struct applier *applier = va_arg(ap, struct applier *);
+	struct applier_fetch_queue *queue =
+		va_arg(ap, struct applier_fetch_queue *);
+	struct ev_io *coio = &applier->io;
+	struct iobuf *iobuf = applier->iobuf;
+	struct xrow_header row;
+
+	/* Decompression state, created on the first envelope. */
+	ZSTD_DStream *zdctx = NULL;
+	struct ibuf zbuf;
+	ibuf_create(&zbuf, &cord()->slabc, APPLIER_ZBUF_CHUNK);
+	auto guard = make_scoped_guard([&] {
+		ipc_channel_close(queue->channel);
+		ibuf_destroy(&zbuf);
+		if (zdctx != NULL)
+			ZSTD_freeDStream(zdctx);
+	});
+	while (!fiber_is_cancelled()) {
+		coio_read_xrow(coio, &iobuf->in, &row);
+		applier->last_row_time = ev_now(loop());
+		if (row.type == IPROTO_COMPRESSION) {
+			if (applier_fetch_zstd(applier, queue, &zdctx,
+					       &zbuf, &row) != 0)
+				break;
+		} else {
+			applier->lag = ev_now(loop()) - row.tm;
+			if (applier_fetch_put(queue, &row) != 0)
+				break;
+		}
+		/*
+		 * Read-ahead usually leaves the next packets in the
+		 * input buffer; decode them all before paying for
+		 * the buffer bookkeeping and region truncation.
+		 */
+		if (ibuf_used(&iobuf->in) == 0) {
+			iobuf_reset(iobuf);
+			fiber_gc();
+		}
+	}
+	return 0;
+}
+
 /**
  * Execute and process SUBSCRIBE request (follow updates from a master).
  */
@@ -309,7 +652,8 @@ applier_subscribe(struct applier *applier)
 	struct xrow_header row;
 
 	xrow_encode_subscribe(&row, &REPLICASET_UUID, &INSTANCE_UUID,
-			      &replicaset_vclock);
+			      &replicaset_vclock,
+			      cfg_geti("replication_compression_level"));
 	coio_write_xrow(coio, &row);
 	applier_set_state(applier, APPLIER_FOLLOW);
 
@@ -345,38 +689,102 @@ applier_subscribe(struct applier *applier)
 
 	/*
 	 * Process a stream of rows from the binary log.
+	 *
+	 * Reading the socket and applying rows are pipelined: a
+	 * fetcher fiber reads and decodes packets into a queue
+	 * while this fiber drains the queue and applies the rows.
+	 * Applying a row parks this fiber on WAL commit; without
+	 * the pipeline the socket sits unread for that whole time.
+	 * Rows are still applied strictly in receive order.
 	 */
-	while (true) {
-		coio_read_xrow(coio, &iobuf->in, &row);
-		applier->lag = ev_now(loop()) - row.tm;
-		applier->last_row_time = ev_now(loop());
+	struct applier_fetch_queue queue;
+	queue.channel = ipc_channel_new_spsc(APPLIER_FETCH_QUEUE_SIZE);
+	if (queue.channel == NULL)
+		diag_raise();
+	queue.used = 0;
+	ipc_cond_create(&queue.drained);
+	struct fiber *fetcher = NULL;
+	bool fetcher_dead = true;
+	auto guard = make_scoped_guard([&] {
+		ipc_channel_close(queue.channel);
+		/* Unblock the fetcher if it waits on the budget. */
+		ipc_cond_broadcast(&queue.drained);
+		if (!fetcher_dead) {
+			fiber_cancel(fetcher);
+			fiber_join(fetcher);
+		}
+		ipc_cond_destroy(&queue.drained);
+		ipc_channel_delete(queue.channel);
+	});
+	char name[FIBER_NAME_MAX];
+	int pos = snprintf(name, sizeof(name), "applierf/");
+	uri_format(name + pos, sizeof(name) - pos, &applier->uri, false);
+	fetcher = fiber_new_xc(name, applier_fetch_f);
+	fiber_set_joinable(fetcher, true);
+	fetcher_dead = false;
+	fiber_start(fetcher, applier, &queue);
 
-		if (iproto_type_is_error(row.type))
-			xrow_decode_error(&row);  /* error */
-		/* Replication request. */
-		if (row.replica_id == REPLICA_ID_NIL ||
-		    row.replica_id >= VCLOCK_MAX) {
+	struct ipc_msg *batch[APPLIER_FETCH_BATCH_MAX];
+	while (true) {
+		int count = ipc_channel_get_msg_batch(queue.channel, batch,
+						      APPLIER_FETCH_BATCH_MAX,
+						      TIMEOUT_INFINITY);
+		if (count < 0) {
 			/*
-			 * A safety net, this can only occur
-			 * if we're fed a strangely broken xlog.
+			 * Either this fiber has been cancelled, or
+			 * the fetcher has closed the queue on its
+			 * way out - join it to re-raise whatever
+			 * stopped it.
 			 */
-			tnt_raise(ClientError, ER_UNKNOWN_REPLICA,
-				  int2str(row.replica_id),
-				  tt_uuid_str(&REPLICASET_UUID));
+			fiber_testcancel();
+			int rc = fiber_join(fetcher);
+			fetcher_dead = true;
+			if (rc != 0)
+				diag_raise();
+			tnt_raise(FiberIsCancelled);
 		}
-		if (vclock_get(&replicaset_vclock, row.replica_id) < row.lsn) {
-			/**
-			 * Promote the replica set vclock before
-			 * applying the row. If there is an
-			 * exception (conflict) applying the row,
-			 * the row is skipped when the replication
-			 * is resumed.
-			 */
-			vclock_follow(&replicaset_vclock, row.replica_id,
-				      row.lsn);
-			xstream_write_xc(applier->subscribe_stream, &row);
+		int i = 0;
+		auto batch_guard = make_scoped_guard([&] {
+			for (; i < count; i++)
+				batch[i]->destroy(batch[i]);
+		});
+		for (; i < count; i++) {
+			struct applier_fetch_msg *msg =
+				container_of(batch[i],
+					     struct applier_fetch_msg, base);
+			struct xrow_header *cur = &msg->row;
+			if (iproto_type_is_error(cur->type))
+				xrow_decode_error(cur);  /* error */
+			/* Replication request. */
+			if (cur->replica_id == REPLICA_ID_NIL ||
+			    cur->replica_id >= VCLOCK_MAX) {
+				/*
+				 * A safety net, this can only occur
+				 * if we're fed a strangely broken xlog.
+				 */
+				tnt_raise(ClientError, ER_UNKNOWN_REPLICA,
+					  int2str(cur->replica_id),
+					  tt_uuid_str(&REPLICASET_UUID));
+			}
+			if (vclock_get(&replicaset_vclock,
+				       cur->replica_id) < cur->lsn) {
+				/**
+				 * Promote the replica set vclock before
+				 * applying the row. If there is an
+				 * exception (conflict) applying the row,
+				 * the row is skipped when the replication
+				 * is resumed.
+				 */
+				vclock_follow(&replicaset_vclock,
+					      cur->replica_id, cur->lsn);
+				xstream_write_xc(applier->subscribe_stream,
+						 cur);
+			}
+			queue.used -= msg->size;
+			batch[i]->destroy(batch[i]);
 		}
-		iobuf_reset(iobuf);
+		/* Wake the fetcher if it waits on the byte budget. */
+		ipc_cond_signal(&queue.drained);
 		fiber_gc();
 	}
 }
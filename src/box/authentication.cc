@@ -28,12 +28,152 @@
  * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#include "authentication.h"
 #include "user.h"
 #include "user_def.h"
 #include "session.h"
+#include "assoc.h"
+#include "fiber.h"
+#include "random.h"
+#include "small/mempool.h"
+#include "small/rlist.h"
 
 static char zero_hash[SCRAMBLE_SIZE];
 
+/* {{{ Session resumption tokens ************************************/
+
+/**
+ * A cached session resumption token. The token bytes double as
+ * the hash key; the entry is linked into an LRU list so that a
+ * full cache evicts the client which has not reconnected for the
+ * longest time.
+ */
+struct resume_token_entry {
+	/** Random token bytes, the hash key. */
+	char token[RESUME_TOKEN_SIZE];
+	/** The user the token was issued to. */
+	uint32_t uid;
+	/** Link in resume_token_lru, most recently used first. */
+	struct rlist in_lru;
+};
+
+/** Token bytes -> struct resume_token_entry. */
+static struct mh_strnptr_t *resume_token_cache;
+/** Allocator for resume_token_entry. */
+static struct mempool resume_token_pool;
+/** Eviction order, most recently used entries at the head. */
+static RLIST_HEAD(resume_token_lru);
+
+/** Remove an entry from the cache and release it. */
+static void
+resume_token_entry_delete(struct resume_token_entry *entry)
+{
+	mh_int_t k = mh_strnptr_find_inp(resume_token_cache, entry->token,
+					 RESUME_TOKEN_SIZE);
+	assert(k != mh_end(resume_token_cache));
+	mh_strnptr_del(resume_token_cache, k, NULL);
+	rlist_del_entry(entry, in_lru);
+	mempool_free(&resume_token_pool, entry);
+}
+
+int
+resume_token_issue(uint32_t uid, char *token)
+{
+	/*
+	 * The cache is created on first use: an instance whose
+	 * clients never ask for a token pays nothing. All
+	 * authentication runs in the tx cord, so the cache and
+	 * its pool are cord-local by construction.
+	 */
+	if (resume_token_cache == NULL) {
+		resume_token_cache = mh_strnptr_new();
+		if (resume_token_cache == NULL) {
+			diag_set(OutOfMemory, sizeof(*resume_token_cache),
+				 "malloc", "resume_token_cache");
+			return -1;
+		}
+		mempool_create(&resume_token_pool, &cord()->slabc,
+			       sizeof(struct resume_token_entry));
+	}
+	if (mh_size(resume_token_cache) >= RESUME_TOKEN_CACHE_MAX) {
+		struct resume_token_entry *victim =
+			rlist_last_entry(&resume_token_lru,
+					 struct resume_token_entry, in_lru);
+		resume_token_entry_delete(victim);
+	}
+	struct resume_token_entry *entry = (struct resume_token_entry *)
+		mempool_alloc(&resume_token_pool);
+	if (entry == NULL) {
+		diag_set(OutOfMemory, sizeof(*entry), "mempool_alloc",
+			 "resume_token_entry");
+		return -1;
+	}
+	random_bytes(entry->token, RESUME_TOKEN_SIZE);
+	entry->uid = uid;
+	uint32_t hash = mh_strn_hash(entry->token, RESUME_TOKEN_SIZE);
+	const struct mh_strnptr_node_t node = {
+		entry->token, RESUME_TOKEN_SIZE, hash, entry };
+	struct mh_strnptr_node_t old_node;
+	struct mh_strnptr_node_t *old = &old_node;
+	mh_int_t k = mh_strnptr_put(resume_token_cache, &node, &old, NULL);
+	if (k == mh_end(resume_token_cache)) {
+		mempool_free(&resume_token_pool, entry);
+		diag_set(OutOfMemory, sizeof(node), "malloc",
+			 "resume_token_cache");
+		return -1;
+	}
+	if (old != NULL) {
+		/*
+		 * A 160-bit random collision - praise the RNG.
+		 * The displaced entry is already out of the hash,
+		 * so only unlink and free it.
+		 */
+		struct resume_token_entry *dup =
+			(struct resume_token_entry *)old->val;
+		rlist_del_entry(dup, in_lru);
+		mempool_free(&resume_token_pool, dup);
+	}
+	rlist_add_entry(&resume_token_lru, entry, in_lru);
+	memcpy(token, entry->token, RESUME_TOKEN_SIZE);
+	return 0;
+}
+
+int
+resume_token_check(const char *token, uint32_t *uid)
+{
+	if (resume_token_cache == NULL)
+		return -1;
+	mh_int_t k = mh_strnptr_find_inp(resume_token_cache, token,
+					 RESUME_TOKEN_SIZE);
+	if (k == mh_end(resume_token_cache))
+		return -1;
+	struct resume_token_entry *entry = (struct resume_token_entry *)
+		mh_strnptr_node(resume_token_cache, k)->val;
+	/* Refresh the entry: a returning client stays cached. */
+	rlist_del_entry(entry, in_lru);
+	rlist_add_entry(&resume_token_lru, entry, in_lru);
+	*uid = entry->uid;
+	return 0;
+}
+
+void
+resume_token_invalidate(uint32_t uid)
+{
+	if (resume_token_cache == NULL)
+		return;
+	/*
+	 * A linear scan, but user alter and drop are rare DDL
+	 * while the cache is bounded by RESUME_TOKEN_CACHE_MAX.
+	 */
+	struct resume_token_entry *entry, *tmp;
+	rlist_foreach_entry_safe(entry, &resume_token_lru, in_lru, tmp) {
+		if (entry->uid == uid)
+			resume_token_entry_delete(entry);
+	}
+}
+
+/* }}} */
+
 void
 authenticate(const char *user_name, uint32_t len,
 	     const char *tuple, const char * /* tuple_end */)
@@ -60,7 +200,13 @@ authenticate(const char *user_name, uint32_t len,
 		tnt_raise(ClientError, ER_INVALID_MSGPACK,
 			   "authentication request body");
 	}
-	mp_next(&tuple); /* Skip authentication mechanism. */
+	uint32_t mech_len;
+	const char *mech;
+	if (mp_typeof(*tuple) != MP_STR) {
+		tnt_raise(ClientError, ER_INVALID_MSGPACK,
+			   "authentication mechanism");
+	}
+	mech = mp_decode_str(&tuple, &mech_len);
 	if (mp_typeof(*tuple) == MP_STR) {
 		scramble = mp_decode_str(&tuple, &scramble_len);
 	} else if (mp_typeof(*tuple) == MP_BIN) {
@@ -73,15 +219,32 @@ authenticate(const char *user_name, uint32_t len,
 		tnt_raise(ClientError, ER_INVALID_MSGPACK,
 			   "authentication scramble");
 	}
-	if (scramble_len != SCRAMBLE_SIZE) {
-		/* Authentication mechanism, data. */
-		tnt_raise(ClientError, ER_INVALID_MSGPACK,
-			   "invalid scramble size");
+	if (mech_len == strlen("token") &&
+	    memcmp(mech, "token", mech_len) == 0) {
+		/*
+		 * Session resumption: the data is a previously
+		 * issued token, checked with a single hash
+		 * lookup instead of the SHA1 chains.
+		 */
+		uint32_t token_uid;
+		if (scramble_len != RESUME_TOKEN_SIZE ||
+		    resume_token_check(scramble, &token_uid) != 0 ||
+		    token_uid != user->def.uid) {
+			tnt_raise(ClientError, ER_PASSWORD_MISMATCH,
+				  user->def.name);
+		}
+	} else {
+		if (scramble_len != SCRAMBLE_SIZE) {
+			/* Authentication mechanism, data. */
+			tnt_raise(ClientError, ER_INVALID_MSGPACK,
+				   "invalid scramble size");
+		}
+		if (scramble_check(scramble, session->salt, user->def.hash2)) {
+			tnt_raise(ClientError, ER_PASSWORD_MISMATCH,
+				  user->def.name);
+		}
 	}
 
-	if (scramble_check(scramble, session->salt, user->def.hash2))
-		tnt_raise(ClientError, ER_PASSWORD_MISMATCH, user->def.name);
-
 	/* check and run auth triggers on success */
 	if (! rlist_empty(&session_on_auth) &&
 	    session_run_on_auth_triggers(user->def.name) != 0)
@@ -30,8 +30,58 @@
  * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#include <stdint.h>
 
 void
 authenticate(const char *user_name, uint32_t len,
 	     const char *tuple, const char *tuple_end);
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+enum {
+	/** The size of a session resumption token, bytes. */
+	RESUME_TOKEN_SIZE = 20,
+	/**
+	 * How many tokens the cache holds before the least
+	 * recently used one is evicted. A token is per-client,
+	 * so this caps the number of clients which can resume
+	 * without a full scramble exchange.
+	 */
+	RESUME_TOKEN_CACHE_MAX = 4096,
+};
+
+/**
+ * Issue a session resumption token for @a uid and write its
+ * RESUME_TOKEN_SIZE bytes to @a token. The client may present the
+ * token in place of a scramble on the next reconnect ("token"
+ * authentication mechanism) and skip the SHA1 chains entirely.
+ * Tokens live in a per-cord in-memory cache: they do not survive
+ * a restart and the oldest one is dropped when the cache is full.
+ * Returns 0 on success, -1 on memory allocation error (diag set).
+ */
+int
+resume_token_issue(uint32_t uid, char *token);
+
+/**
+ * Look up a session resumption token. On a hit the token is
+ * refreshed in the LRU and the uid it was issued for is stored
+ * in @a uid. Returns 0 on a hit, -1 on a miss.
+ */
+int
+resume_token_check(const char *token, uint32_t *uid);
+
+/**
+ * Drop all tokens issued for @a uid. Called when the user is
+ * altered or dropped: a password change must cut off resumption
+ * the same way it cuts off the old password.
+ */
+void
+resume_token_invalidate(uint32_t uid);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
 #endif /* INCLUDES_TARANTOOL_BOX_AUTHENTICATION_H */
@@ -42,10 +42,13 @@
 #include "applier.h"
 #include <rmean.h>
 #include "main.h"
+#include "watchdog.h"
+#include "errinj.h"
 #include "tuple.h"
 #include "session.h"
 #include "func.h"
 #include "schema.h"
+#include "assoc.h"
 #include "engine.h"
 #include "memtx_engine.h"
 #include "memtx_index.h"
@@ -58,6 +61,7 @@
 #include "user.h"
 #include "cfg.h"
 #include "iobuf.h"
+#include "coeio.h"
 #include "coio.h"
 #include "replication.h" /* replica */
 #include "title.h"
@@ -172,8 +176,29 @@ process_rw(struct request *request, struct space *space, struct tuple **result)
 {
 	assert(iproto_type_is_dml(request->type));
 	rmean_collect(rmean_box, request->type, 1);
+	/*
+	 * Rehearse a slow request: an injected delay scoped by
+	 * space and/or session, so a canary can slow down one
+	 * workload without touching the rest.
+	 */
+	if (unlikely(fault_inj_armed > 0)) {
+		struct session *session = fiber_get_session(fiber());
+		if (fault_inj_hit(FAULT_INJ_REQUEST_DELAY, space->def.id,
+				  session != NULL ? session->id : 0))
+			fiber_sleep(fault_inj_delay(FAULT_INJ_REQUEST_DELAY));
+	}
+	/*
+	 * The dominant case - a single-statement autocommit
+	 * request on a space without on_replace triggers - takes
+	 * the fused fast path: the txn and stmt live on this
+	 * stack frame and the journal entry is built from the
+	 * single redo row directly.
+	 */
+	struct txn_fast fast;
+	bool use_fast = in_txn() == NULL && rlist_empty(&space->on_replace);
 	try {
-		struct txn *txn = txn_begin_stmt(space);
+		struct txn *txn = use_fast ? txn_begin_stmt_fast(&fast, space) :
+				  txn_begin_stmt(space);
 		access_check_space(space, PRIV_W);
 		struct tuple *tuple;
 		switch (request->type) {
@@ -220,7 +245,10 @@ process_rw(struct request *request, struct space *space, struct tuple **result)
 		 * when WAL is written in autocommit mode.
 		 */
 		TupleRefNil ref(tuple);
-		txn_commit_stmt(txn, request);
+		if (use_fast)
+			txn_commit_stmt_fast(txn, request);
+		else
+			txn_commit_stmt(txn, request);
 		if (result) {
 			if (tuple)
 				tuple_bless_xc(tuple);
@@ -391,6 +419,85 @@ box_check_readahead(int readahead)
 	}
 }
 
+static void
+box_check_cpu_affinity(const char *spec)
+{
+	/*
+	 * A valid spec is kept: the cords consult the affinity
+	 * table when they start, see box_cfg_xc().
+	 */
+	if (cord_affinity_cfg(spec) != 0) {
+		tnt_raise(ClientError, ER_CFG, "cpu_affinity",
+			  diag_last_error(diag_get())->errmsg);
+	}
+}
+
+static void
+box_check_fiber_preempt_budget(int budget)
+{
+	if (budget < 0) {
+		tnt_raise(ClientError, ER_CFG, "fiber_preempt_budget",
+			  "the value must not be negative");
+	}
+}
+
+static void
+box_check_loop_stall_threshold(double threshold)
+{
+	if (threshold < 0) {
+		tnt_raise(ClientError, ER_CFG, "loop_stall_threshold",
+			  "the value must not be negative");
+	}
+}
+
+static void
+box_check_iobuf_cache_size(int size)
+{
+	if (size < 0 || size > 1024) {
+		tnt_raise(ClientError, ER_CFG, "iobuf_cache_size",
+			  "specified value is out of bounds");
+	}
+}
+
+static void
+box_check_iproto_threads(int threads_count)
+{
+	if (threads_count < 1 || threads_count > IPROTO_THREADS_MAX) {
+		tnt_raise(ClientError, ER_CFG, "iproto_threads",
+			  "specified value is out of bounds");
+	}
+}
+
+static void
+box_check_iproto_compression_level(int level)
+{
+	/* 22 is ZSTD_maxCLevel(). */
+	if (level < 0 || level > 22) {
+		tnt_raise(ClientError, ER_CFG, "iproto_compression_level",
+			  "specified value is out of bounds");
+	}
+}
+
+static void
+box_check_replication_compression_level(int level)
+{
+	/* 22 is ZSTD_maxCLevel(). */
+	if (level < 0 || level > 22) {
+		tnt_raise(ClientError, ER_CFG,
+			  "replication_compression_level",
+			  "specified value is out of bounds");
+	}
+}
+
+static void
+box_check_iproto_stream_chunk_size(int size)
+{
+	if (size < 1) {
+		tnt_raise(ClientError, ER_CFG, "iproto_stream_chunk_size",
+			  "specified value is out of bounds");
+	}
+}
+
 static int64_t
 box_check_wal_max_rows(int64_t wal_max_rows)
 {
@@ -418,8 +525,18 @@ box_check_config()
 {
 	box_check_log(cfg_gets("log"));
 	box_check_uri(cfg_gets("listen"), "listen");
+	box_check_uri(cfg_gets("checkpoint_sink"), "checkpoint_sink");
 	box_check_replication();
+	box_check_replication_compression_level(
+		cfg_geti("replication_compression_level"));
 	box_check_readahead(cfg_geti("readahead"));
+	box_check_cpu_affinity(cfg_gets("cpu_affinity"));
+	box_check_fiber_preempt_budget(cfg_geti("fiber_preempt_budget"));
+	box_check_loop_stall_threshold(cfg_getd("loop_stall_threshold"));
+	box_check_iobuf_cache_size(cfg_geti("iobuf_cache_size"));
+	box_check_iproto_threads(cfg_geti("iproto_threads"));
+	box_check_iproto_compression_level(cfg_geti("iproto_compression_level"));
+	box_check_iproto_stream_chunk_size(cfg_geti("iproto_stream_chunk_size"));
 	box_check_wal_max_rows(cfg_geti64("rows_per_wal"));
 	box_check_wal_max_size(cfg_geti64("wal_max_size"));
 	box_check_wal_mode(cfg_gets("wal_mode"));
@@ -544,6 +661,19 @@ box_set_snap_io_rate_limit(void)
 		memtx->setSnapIoRateLimit(cfg_getd("snap_io_rate_limit"));
 }
 
+void
+box_set_checkpoint_sink(void)
+{
+	const char *uri = cfg_gets("checkpoint_sink");
+	/* An empty string disables streaming, like nil. */
+	if (uri != NULL && *uri == '\0')
+		uri = NULL;
+	box_check_uri(uri, "checkpoint_sink");
+	MemtxEngine *memtx = (MemtxEngine *) engine_find("memtx");
+	if (memtx)
+		memtx->setCheckpointSink(uri);
+}
+
 void
 box_set_too_long_threshold(void)
 {
@@ -558,6 +688,33 @@ box_set_readahead(void)
 	iobuf_set_readahead(readahead);
 }
 
+void
+box_set_loop_stall_threshold(void)
+{
+	double threshold = cfg_getd("loop_stall_threshold");
+	box_check_loop_stall_threshold(threshold);
+	if (threshold > 0)
+		watchdog_start(threshold);
+	else
+		watchdog_stop();
+}
+
+void
+box_set_fiber_preempt_budget(void)
+{
+	int budget = cfg_geti("fiber_preempt_budget");
+	box_check_fiber_preempt_budget(budget);
+	fiber_set_preempt_budget(budget);
+}
+
+void
+box_set_iobuf_cache_size(void)
+{
+	int size = cfg_geti("iobuf_cache_size");
+	box_check_iobuf_cache_size(size);
+	iobuf_set_cache_size(size);
+}
+
 /* }}} configuration bindings */
 
 /**
@@ -923,10 +1080,54 @@ box_on_join(const tt_uuid *instance_uuid)
 	box_register_replica(replica_id, instance_uuid);
 }
 
+/**
+ * A small direct-mapped cache in front of func_by_name(): most
+ * workloads call a handful of procedures at a very high rate, so
+ * the common case becomes one hash and one compare instead of a
+ * full hash table lookup. All entries are invalidated at once by
+ * func_cache_version, which the schema module bumps whenever a
+ * function is created, updated or dropped, so a cached pointer
+ * can never outlive its struct func.
+ */
+enum { CALL_FUNC_CACHE_SIZE = 64 };
+
+struct call_func_cache_entry {
+	/** Value of func_cache_version the entry was filled at. */
+	uint32_t version;
+	/** Function name and length - the cache key. */
+	uint32_t name_len;
+	char name[BOX_NAME_MAX];
+	/** The resolved function. */
+	struct func *func;
+};
+
+static struct call_func_cache_entry call_func_cache[CALL_FUNC_CACHE_SIZE];
+
+static struct func *
+func_by_name_cached(const char *name, uint32_t name_len)
+{
+	if (name_len > BOX_NAME_MAX)
+		return func_by_name(name, name_len);
+	uint32_t hash = mh_strn_hash(name, name_len);
+	struct call_func_cache_entry *e =
+		&call_func_cache[hash & (CALL_FUNC_CACHE_SIZE - 1)];
+	if (e->version == func_cache_version && e->name_len == name_len &&
+	    memcmp(e->name, name, name_len) == 0)
+		return e->func;
+	struct func *func = func_by_name(name, name_len);
+	if (func != NULL) {
+		e->version = func_cache_version;
+		e->name_len = name_len;
+		memcpy(e->name, name, name_len);
+		e->func = func;
+	}
+	return func;
+}
+
 static inline struct func *
 access_check_func(const char *name, uint32_t name_len)
 {
-	struct func *func = func_by_name(name, name_len);
+	struct func *func = func_by_name_cached(name, name_len);
 	struct session *session = current_session();
 	struct credentials *credentials = &session->credentials;
 	/*
@@ -1172,7 +1373,8 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 
 	/* Decode JOIN request */
 	struct tt_uuid instance_uuid = uuid_nil;
-	xrow_decode_join(header, &instance_uuid);
+	int snap_file = 0;
+	xrow_decode_join(header, &instance_uuid, &snap_file);
 
 	/* Check that bootstrap has been finished */
 	if (!is_box_configured)
@@ -1202,8 +1404,13 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 	 * when someone has deleted a snapshot and tries to join
 	 * as a replica. Our best effort is to not crash in such
 	 * case: raise ER_MISSING_SNAPSHOT.
+	 *
+	 * The initial stage streams a full snapshot file, so a
+	 * delta checkpoint cannot serve as the anchor: start from
+	 * the last full one and let the final stage catch up from
+	 * its vclock over the WALs.
 	 */
-	if (gc_last_checkpoint(&start_vclock) < 0)
+	if (gc_last_full_checkpoint(&start_vclock) < 0)
 		tnt_raise(ClientError, ER_MISSING_SNAPSHOT);
 
 	/* Respond to JOIN request with start_vclock. */
@@ -1214,8 +1421,11 @@ box_process_join(struct ev_io *io, struct xrow_header *header)
 
 	/*
 	 * Initial stream: feed replica with dirty data from engines.
+	 * If the replica can take it, memtx ships its checkpoint as
+	 * a raw file instead of a row stream.
 	 */
-	relay_initial_join(io->fd, header->sync, &start_vclock);
+	relay_initial_join(io->fd, header->sync, &start_vclock,
+			   snap_file != 0);
 	say_info("initial data sent.");
 
 	/**
@@ -1261,9 +1471,10 @@ box_process_subscribe(struct ev_io *io, struct xrow_header *header)
 
 	struct tt_uuid replicaset_uuid = uuid_nil, replica_uuid = uuid_nil;
 	struct vclock replica_clock;
+	int zstd_level = 0;
 	vclock_create(&replica_clock);
 	xrow_decode_subscribe(header, &replicaset_uuid, &replica_uuid,
-			      &replica_clock);
+			      &replica_clock, &zstd_level, NULL);
 
 	/* Forbid connection to itself */
 	if (tt_uuid_is_equal(&replica_uuid, &INSTANCE_UUID))
@@ -1330,7 +1541,51 @@ box_process_subscribe(struct ev_io *io, struct xrow_header *header)
 	 * a stall in updates (in this case replica may hang
 	 * indefinitely).
 	 */
-	relay_subscribe(io->fd, header->sync, replica, &replica_clock);
+	/* 22 is ZSTD_maxCLevel(). Distrust the wire. */
+	if (zstd_level > 22)
+		zstd_level = 22;
+	relay_subscribe(io->fd, header->sync, replica, &replica_clock,
+			zstd_level);
+}
+
+/**
+ * How long a remote checkpoint request is allowed to wait for
+ * the local vclock to catch up with the one sent by the peer.
+ */
+enum { CHECKPOINT_WAIT_TIMEOUT = 60 };
+
+void
+box_process_checkpoint(struct xrow_header *header)
+{
+	assert(header->type == IPROTO_CHECKPOINT);
+
+	if (!is_box_configured)
+		tnt_raise(ClientError, ER_LOADING);
+	/* A checkpoint rewrites local files - a write op. */
+	access_check_universe(PRIV_W);
+
+	if (header->bodycnt > 0) {
+		struct vclock target;
+		vclock_create(&target);
+		xrow_decode_vclock(header, &target);
+		/*
+		 * Wait until everything the peer had applied at
+		 * the time of the request has been applied here
+		 * too, otherwise the checkpoint would not cover
+		 * the peer's state. An incomparable vclock
+		 * (VCLOCK_ORDER_UNDEFINED) also makes us wait:
+		 * the missing components may yet arrive via
+		 * replication.
+		 */
+		double deadline = fiber_time() + CHECKPOINT_WAIT_TIMEOUT;
+		while (vclock_compare(&target, &replicaset_vclock) > 0) {
+			if (fiber_time() >= deadline)
+				tnt_raise(ClientError, ER_TIMEOUT);
+			fiber_sleep(0.1);
+		}
+	}
+	if (box_snapshot() != 0)
+		diag_raise();
 }
 
 /** Insert a new cluster into _schema */
@@ -1383,7 +1638,8 @@ engine_init()
 					     cfg_getd("memtx_memory"),
 					     cfg_geti("memtx_min_tuple_size"),
 					     cfg_geti("memtx_max_tuple_size"),
-					     cfg_getd("slab_alloc_factor"));
+					     cfg_getd("slab_alloc_factor"),
+					     cfg_geti("memtx_huge_pages"));
 	engine_register(memtx);
 
 	SysviewEngine *sysview = new SysviewEngine();
@@ -1531,9 +1787,34 @@ box_is_configured(void)
 	return is_box_configured;
 }
 
+/**
+ * Return the first directory of the wal_dir list. wal_dir may
+ * name several ';'-separated stripe directories (see struct
+ * xdir); instance-wide artifacts like the directory lock live
+ * in the first one.
+ */
+static const char *
+box_wal_dir_primary(void)
+{
+	static char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s", cfg_gets("wal_dir"));
+	char *sep = strchr(path, ';');
+	if (sep != NULL)
+		*sep = '\0';
+	return path;
+}
+
 static inline void
 box_cfg_xc(void)
 {
+	/*
+	 * Pin the tx cord before the engines allocate their
+	 * memory: with the kernel's first-touch policy the memtx
+	 * arena then lands on the tx cord's NUMA node. Worker
+	 * cords pin themselves when they start.
+	 */
+	cord_affinity_apply();
+
 	tuple_init();
 
 	/* Join the cord interconnect as "tx" endpoint. */
@@ -1541,11 +1822,16 @@ box_cfg_xc(void)
 			  FIBER_POOL_IDLE_TIMEOUT);
 	/* Add an extra endpoint for WAL wake up/rollback messages. */
 	cbus_endpoint_create(&tx_prio_endpoint, "tx_prio", tx_prio_cb, &tx_prio_endpoint);
+	/*
+	 * Keep DNS resolves off the shared eio pool: a replica
+	 * reconnect must not wait behind a disk task backlog.
+	 */
+	coeio_set_resolver_lane("tx", 2);
 
 	rmean_box = rmean_new(iproto_type_strs, IPROTO_TYPE_STAT_MAX);
 	rmean_error = rmean_new(rmean_error_strings, RMEAN_ERROR_LAST);
 
-	if (gc_init(cfg_gets("memtx_dir")) < 0)
+	if (gc_init(cfg_gets("memtx_dir"), cfg_gets("wal_dir")) < 0)
 		diag_raise();
 
 	engine_init();
@@ -1554,13 +1840,16 @@ box_cfg_xc(void)
 
 	replication_init();
 	port_init();
-	iproto_init();
+	iproto_set_compression_level(cfg_geti("iproto_compression_level"));
+	iproto_set_stream_chunk_size(cfg_geti("iproto_stream_chunk_size"));
+	iproto_init(cfg_geti("iproto_threads"));
 	wal_thread_start();
 	sql_init();
 
 	title("loading");
 
 	box_set_too_long_threshold();
+	box_set_loop_stall_threshold();
 	xstream_create(&join_stream, apply_initial_join_row);
 	xstream_create(&subscribe_stream, apply_row);
 
@@ -1571,7 +1860,7 @@ box_cfg_xc(void)
 	 * Lock the write ahead log directory to avoid multiple
 	 * instances running in the same dir.
 	 */
-	if (path_lock(cfg_gets("wal_dir"), &wal_dir_lock) < 0)
+	if (path_lock(box_wal_dir_primary(), &wal_dir_lock) < 0)
 		diag_raise();
 	if (wal_dir_lock < 0) {
 		/**
@@ -1637,7 +1926,7 @@ box_cfg_xc(void)
 		if (wal_dir_lock < 0) {
 			say_info("Entering hot standby mode");
 			while (true) {
-				if (path_lock(cfg_gets("wal_dir"),
+				if (path_lock(box_wal_dir_primary(),
 					      &wal_dir_lock))
 					diag_raise();
 				if (wal_dir_lock >= 0)
@@ -139,6 +139,16 @@ box_process_join(struct ev_io *io, struct xrow_header *header);
 void
 box_process_subscribe(struct ev_io *io, struct xrow_header *header);
 
+/**
+ * Take a checkpoint on behalf of a remote peer (IPROTO_CHECKPOINT).
+ * If the request body carries a vclock, wait until the local
+ * vclock covers it before snapshotting, so that the checkpoint
+ * is guaranteed to contain everything the peer had at the time
+ * of the request.
+ */
+void
+box_process_checkpoint(struct xrow_header *header);
+
 /**
  * Check Lua configuration before initialization or
  * in case of a configuration change.
@@ -152,8 +162,12 @@ void box_set_replication(void);
 void box_set_log_level(void);
 void box_set_io_collect_interval(void);
 void box_set_snap_io_rate_limit(void);
+void box_set_checkpoint_sink(void);
 void box_set_too_long_threshold(void);
+void box_set_loop_stall_threshold(void);
 void box_set_readahead(void);
+void box_set_fiber_preempt_budget(void);
+void box_set_iobuf_cache_size(void);
 void box_set_force_recovery(void);
 
 extern "C" {
@@ -149,10 +149,11 @@ Engine::backup(struct vclock *vclock, engine_backup_cb cb, void *cb_arg)
 }
 
 void
-Engine::join(struct vclock *vclock, struct xstream *stream)
+Engine::join(struct vclock *vclock, struct xstream *stream, bool snap_file)
 {
 	(void) vclock;
 	(void) stream;
+	(void) snap_file;
 }
 
 void
@@ -374,10 +375,10 @@ engine_backup(struct vclock *vclock, engine_backup_cb cb, void *cb_arg)
 }
 
 void
-engine_join(struct vclock *vclock, struct xstream *stream)
+engine_join(struct vclock *vclock, struct xstream *stream, bool snap_file)
 {
 	Engine *engine;
 	engine_foreach(engine) {
-		engine->join(vclock, stream);
+		engine->join(vclock, stream, snap_file);
 	}
 }
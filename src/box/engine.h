@@ -92,8 +92,13 @@ public:
 				       Index *new_index);
 	/**
 	 * Write statements stored in checkpoint @vclock to @stream.
+	 * When @snap_file is set the replica has advertised raw
+	 * snapshot file transfer: an engine whose checkpoint is a
+	 * single file may ship its bytes as IPROTO_SNAP_CHUNK rows
+	 * instead of re-encoding every statement.
 	 */
-	virtual void join(struct vclock *vclock, struct xstream *stream);
+	virtual void join(struct vclock *vclock, struct xstream *stream,
+			  bool snap_file);
 	/**
 	 * Begin a new single or multi-statement transaction.
 	 * Called on first statement in a transaction, not when
@@ -306,7 +311,7 @@ engine_end_recovery();
  * (called on the master).
  */
 void
-engine_join(struct vclock *vclock, struct xstream *stream);
+engine_join(struct vclock *vclock, struct xstream *stream, bool snap_file);
 
 extern "C" {
 #endif /* defined(__cplusplus) */
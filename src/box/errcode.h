@@ -186,7 +186,9 @@ struct errcode_record {
 	/*131 */_(ER_INVALID_INDEX_FILE,	"Invalid INDEX file %s: %s") \
 	/*132 */_(ER_INVALID_RUN_FILE,		"Invalid RUN file: %s") \
 	/*133 */_(ER_INVALID_VYLOG_FILE,	"Invalid VYLOG file: %s") \
-	/*134 */_(ER_CHECKPOINT_ROLLBACK,	"Can't start a checkpoint while in cascading rollback")
+	/*134 */_(ER_CHECKPOINT_ROLLBACK,	"Can't start a checkpoint while in cascading rollback") \
+	/*135 */_(ER_SPACE_MEMORY_LIMIT,	"Space '%s' has reached its memory limit (%llu bytes)") \
+	/*136 */_(ER_DEADLINE_EXCEEDED,		"Request deadline exceeded")
 
 /*
  * !IMPORTANT! Please follow instructions at start of the file
@@ -34,28 +34,277 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <stdio.h>
+#include <unistd.h>
+
+#include <small/rlist.h>
+
 #include "coeio_file.h"
 #include "diag.h"
 #include "errcode.h"
+#include "fiber.h"
+#include "ipc.h"
 #include "say.h"
 #include "vclock.h"
 #include "xlog.h"
+#include "xrow.h"
 
 #include "engine.h"		/* engine_collect_garbage() */
 #include "replication.h"	/* INSTANCE_UUID */
 #include "wal.h"		/* wal_collect_garbage() */
 
+enum {
+	/**
+	 * ZSTD compression level used when rewriting sealed
+	 * WALs in the background. The hot append path uses a
+	 * fast level to keep commit latency low; files retained
+	 * only for replica catch-up are worth the extra CPU.
+	 */
+	GC_RECOMPRESS_ZSTD_LEVEL = 19,
+	/**
+	 * How many files the collector unlinks back to back
+	 * before pausing. Each unlink runs on the eio thread
+	 * pool; the pause keeps a big backlog - say, hundreds of
+	 * files after a long replica outage - from monopolizing
+	 * the pool and the disk.
+	 */
+	GC_UNLINK_BATCH = 32,
+};
+
+/** The pause between unlink batches, seconds. */
+static const double GC_UNLINK_BATCH_DELAY = 0.1;
+
+/**
+ * A consumer of write ahead logs, e.g. a registered replica.
+ * WALs needed by a consumer are exempt from garbage collection
+ * until the consumer advances past them or is unregistered.
+ */
+struct gc_consumer {
+	/** Link in gc_state.consumers. */
+	struct rlist in_consumers;
+	/** Consumer name, for logging. */
+	char name[64];
+	/** The vclock signature the consumer has reached. */
+	int64_t signature;
+};
+
 /** Garbage collection state. */
 struct gc_state {
 	/** Max signature garbage collection has been called for. */
 	int64_t signature;
+	/**
+	 * Signature files would have been collected up to, were
+	 * it not for consumers. Used to tell whether a consumer
+	 * advancement may unblock file collection.
+	 */
+	int64_t collect_signature;
 	/** Uncollected checkpoints, see checkpoint_info. */
 	vclockset_t checkpoints;
+	/** Registered WAL consumers, see gc_consumer. */
+	struct rlist consumers;
+	/**
+	 * Consumer pinning WALs since the latest checkpoint taken
+	 * on our behalf by a remote peer, see
+	 * gc_remote_checkpoint(). NULL until the first remote
+	 * checkpoint is reported.
+	 */
+	struct gc_consumer *remote_checkpoint;
 	/** Snapshot directory. */
 	struct xdir snap_dir;
+	/** Delta snapshot directory (same path as snap_dir). */
+	struct xdir delta_dir;
+	/** WAL directory, for background recompression. */
+	struct xdir wal_dir;
+	/** Fiber driving background WAL recompression. */
+	struct fiber *compress_fiber;
+	/** Wakes up @compress_fiber. */
+	struct ipc_cond compress_cond;
+	/** Set when new WALs may be eligible for recompression. */
+	bool compress_pending;
+	/** Signature of the most recently recompressed WAL. */
+	int64_t compress_signature;
+	/**
+	 * Fiber removing obsolete files in the background, so
+	 * that consumer advancement and checkpoint pruning only
+	 * update in-memory state and never wait on the
+	 * filesystem.
+	 */
+	struct fiber *collect_fiber;
+	/** Wakes up @collect_fiber. */
+	struct ipc_cond collect_cond;
+	/** Set when files may have become eligible for removal. */
+	bool collect_pending;
 };
 static struct gc_state gc;
 
+static void
+gc_schedule_collect(void);
+
+/** Argument passed to gc_recompress_f(). */
+struct gc_recompress_arg {
+	/** The sealed WAL to rewrite. */
+	char src_path[PATH_MAX];
+	/** Where to leave the recompressed copy. */
+	char tmp_path[PATH_MAX];
+};
+
+/**
+ * Rewrite a sealed xlog at a high compression level. Runs in
+ * its own cord, like the memtx checkpoint writer, so that
+ * compression does not eat tx thread cycles. The copy is left
+ * under @tmp_path; the caller puts it in place of the original
+ * once it has made sure the original is still wanted.
+ */
+static int
+gc_recompress_f(va_list ap)
+{
+	struct gc_recompress_arg *arg = va_arg(ap, struct gc_recompress_arg *);
+
+	struct xlog_cursor cursor;
+	if (xlog_cursor_open(&cursor, arg->src_path) < 0)
+		return -1;
+	cursor.read_ahead = XLOG_READ_AHEAD_BULK;
+
+	struct xlog xlog;
+	if (xlog_create(&xlog, arg->tmp_path, &cursor.meta) < 0) {
+		xlog_cursor_close(&cursor, false);
+		return -1;
+	}
+	xlog.zstd_level = GC_RECOMPRESS_ZSTD_LEVEL;
+	/*
+	 * The copy must be durable before it replaces the
+	 * original, so sync in this cord, synchronously.
+	 */
+	xlog.sync_is_async = false;
+
+	int rc;
+	struct xrow_header row;
+	while ((rc = xlog_cursor_next(&cursor, &row, false)) == 0) {
+		ssize_t written = xlog_write_row(&xlog, &row);
+		fiber_gc();
+		if (written < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	if (rc > 0 && xlog_flush(&xlog) < 0)
+		rc = -1;
+	if (rc > 0 && xlog_rename(&xlog) != 0)
+		rc = -1;
+	char copy_path[PATH_MAX];
+	snprintf(copy_path, sizeof(copy_path), "%s", xlog.filename);
+	if (xlog_close(&xlog, false) != 0)
+		rc = -1;
+	xlog_cursor_close(&cursor, false);
+	if (rc < 0) {
+		/* Remove the incomplete copy. */
+		unlink(copy_path);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Recompress the WAL with the given signature and atomically
+ * put the result in place of the original file.
+ */
+static int
+gc_compress_xlog(int64_t signature)
+{
+	struct gc_recompress_arg arg;
+	snprintf(arg.src_path, sizeof(arg.src_path), "%s",
+		 xdir_resolve_filename(&gc.wal_dir, signature, NONE));
+	snprintf(arg.tmp_path, sizeof(arg.tmp_path), "%s.gc", arg.src_path);
+
+	/*
+	 * Remove stale copies possibly left by a previous
+	 * instance of the server.
+	 */
+	unlink(arg.tmp_path);
+	char inprogress[PATH_MAX];
+	snprintf(inprogress, sizeof(inprogress), "%s.inprogress",
+		 arg.tmp_path);
+	unlink(inprogress);
+
+	say_info("recompressing %s", arg.src_path);
+	struct cord cord;
+	if (cord_costart(&cord, "wal_compress", gc_recompress_f, &arg) != 0)
+		return -1;
+	if (cord_cojoin(&cord) != 0) {
+		error_log(diag_last_error(diag_get()));
+		return -1;
+	}
+	/*
+	 * The original may have been collected while we were
+	 * rewriting it - do not resurrect it in that case. The
+	 * check is not atomic with the rename, but the worst
+	 * outcome of losing the race is a stale file, removed
+	 * by the next gc_run().
+	 */
+	if (access(arg.src_path, F_OK) != 0) {
+		unlink(arg.tmp_path);
+		return 0;
+	}
+	if (rename(arg.tmp_path, arg.src_path) != 0) {
+		say_syserror("error while renaming %s", arg.tmp_path);
+		unlink(arg.tmp_path);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Recompress all sealed WALs which precede the last checkpoint:
+ * they are retained for replica catch-up alone and are no longer
+ * on the hot path.
+ */
+static void
+gc_compress_wals(void)
+{
+	struct vclock checkpoint;
+	if (gc_last_checkpoint(&checkpoint) < 0)
+		return;
+	if (xdir_scan(&gc.wal_dir) < 0) {
+		error_log(diag_last_error(diag_get()));
+		return;
+	}
+	int64_t checkpoint_signature = vclock_sum(&checkpoint);
+	struct vclock *vclock = vclockset_first(&gc.wal_dir.index);
+	while (vclock != NULL) {
+		struct vclock *next = vclockset_next(&gc.wal_dir.index, vclock);
+		int64_t signature = vclock_sum(vclock);
+		/*
+		 * Only rewrite sealed files: a WAL is sealed
+		 * once a successor exists, and everything from
+		 * before the last checkpoint has left the hot
+		 * path.
+		 */
+		if (next == NULL || signature >= checkpoint_signature)
+			break;
+		if (signature > gc.compress_signature) {
+			if (gc_compress_xlog(signature) != 0)
+				break;
+			gc.compress_signature = signature;
+		}
+		vclock = next;
+	}
+}
+
+static int
+gc_compress_fiber_f(va_list ap)
+{
+	(void) ap;
+	while (!fiber_is_cancelled()) {
+		if (!gc.compress_pending) {
+			ipc_cond_wait(&gc.compress_cond);
+			continue;
+		}
+		gc.compress_pending = false;
+		gc_compress_wals();
+	}
+	return 0;
+}
+
 const struct checkpoint_info *
 checkpoint_iterator_next(struct checkpoint_iterator *it)
 {
@@ -67,21 +316,55 @@ checkpoint_iterator_next(struct checkpoint_iterator *it)
 }
 
 int
-gc_init(const char *snap_dirname)
+gc_init(const char *snap_dirname, const char *wal_dirname)
 {
 	gc.signature = -1;
+	gc.collect_signature = -1;
+	gc.compress_signature = -1;
+	gc.compress_pending = false;
+	gc.collect_pending = false;
 	vclockset_new(&gc.checkpoints);
+	rlist_create(&gc.consumers);
 	xdir_create(&gc.snap_dir, snap_dirname, SNAP, &INSTANCE_UUID);
+	xdir_create(&gc.delta_dir, snap_dirname, DSNAP, &INSTANCE_UUID);
+	xdir_create(&gc.wal_dir, wal_dirname, XLOG, &INSTANCE_UUID);
+	ipc_cond_create(&gc.compress_cond);
+	ipc_cond_create(&gc.collect_cond);
 
 	if (xdir_scan(&gc.snap_dir) < 0)
 		goto fail;
+	if (xdir_scan(&gc.delta_dir) < 0)
+		goto fail;
 
-	struct vclock *vclock;
-	for (vclock = vclockset_first(&gc.snap_dir.index); vclock != NULL;
-	     vclock = vclockset_next(&gc.snap_dir.index, vclock)) {
+	/*
+	 * Full snapshots and delta snapshots are checkpoints
+	 * alike. Merge the two directory indexes in signature
+	 * order - gc_add_checkpoint() expects ascending vclocks.
+	 */
+	struct vclock *snap = vclockset_first(&gc.snap_dir.index);
+	struct vclock *delta = vclockset_first(&gc.delta_dir.index);
+	while (snap != NULL || delta != NULL) {
+		struct vclock *vclock;
+		if (delta == NULL || (snap != NULL &&
+				      vclock_sum(snap) < vclock_sum(delta))) {
+			vclock = snap;
+			snap = vclockset_next(&gc.snap_dir.index, snap);
+		} else {
+			vclock = delta;
+			delta = vclockset_next(&gc.delta_dir.index, delta);
+		}
 		if (gc_add_checkpoint(vclock) < 0)
 			goto fail;
 	}
+
+	gc.compress_fiber = fiber_new("wal_compress", gc_compress_fiber_f);
+	if (gc.compress_fiber == NULL)
+		goto fail;
+	fiber_start(gc.compress_fiber);
+	gc.collect_fiber = fiber_new("gc_collect", gc_collect_fiber_f);
+	if (gc.collect_fiber == NULL)
+		goto fail;
+	fiber_start(gc.collect_fiber);
 	return 0;
 fail:
 	gc_free();
@@ -91,6 +374,16 @@ fail:
 void
 gc_free(void)
 {
+	if (gc.compress_fiber != NULL) {
+		fiber_cancel(gc.compress_fiber);
+		gc.compress_fiber = NULL;
+	}
+	if (gc.collect_fiber != NULL) {
+		fiber_cancel(gc.collect_fiber);
+		gc.collect_fiber = NULL;
+	}
+	ipc_cond_destroy(&gc.compress_cond);
+	ipc_cond_destroy(&gc.collect_cond);
 	struct vclock *vclock = vclockset_first(&gc.checkpoints);
 	while (vclock != NULL) {
 		struct vclock *next = vclockset_next(&gc.checkpoints, vclock);
@@ -100,7 +393,14 @@ gc_free(void)
 		free(cpt);
 		vclock = next;
 	}
+	struct gc_consumer *consumer, *tmp;
+	rlist_foreach_entry_safe(consumer, &gc.consumers, in_consumers, tmp) {
+		rlist_del_entry(consumer, in_consumers);
+		free(consumer);
+	}
 	xdir_destroy(&gc.snap_dir);
+	xdir_destroy(&gc.delta_dir);
+	xdir_destroy(&gc.wal_dir);
 }
 
 int
@@ -130,6 +430,14 @@ gc_add_checkpoint(const struct vclock *vclock)
 		assert(vclock_compare(vclock, prev) > 0);
 		gc_unref_checkpoint(prev);
 	}
+	/*
+	 * A new checkpoint seals the WALs which precede it -
+	 * wake up the background recompressor.
+	 */
+	if (gc.compress_fiber != NULL) {
+		gc.compress_pending = true;
+		ipc_cond_signal(&gc.compress_cond);
+	}
 	return 0;
 }
 
@@ -143,6 +451,20 @@ gc_last_checkpoint(struct vclock *vclock)
 	return vclock_sum(last);
 }
 
+int64_t
+gc_last_full_checkpoint(struct vclock *vclock)
+{
+	/*
+	 * The entry of the last full snapshot may have been
+	 * removed from gc.checkpoints while its file is retained
+	 * as the base of newer delta checkpoints, so consult the
+	 * directory rather than the checkpoint list.
+	 */
+	if (xdir_scan(&gc.snap_dir) < 0)
+		return -1;
+	return xdir_last_vclock(&gc.snap_dir, vclock);
+}
+
 int64_t
 gc_ref_last_checkpoint(struct vclock *vclock)
 {
@@ -173,14 +495,219 @@ gc_unref_checkpoint(struct vclock *vclock)
 
 }
 
+/**
+ * Remove the files of @dir with signatures strictly below
+ * @signature. @batch counts unlinks across calls, to rate limit
+ * the removal of a large backlog.
+ */
+static void
+gc_remove_files(struct xdir *dir, int64_t signature, int *batch)
+{
+	/*
+	 * Freeze the list of victims first: coeio_unlink() yields
+	 * and anyone may rescan the directory meanwhile, freeing
+	 * the index entries under our feet.
+	 */
+	int count = 0;
+	struct vclock *vclock;
+	for (vclock = vclockset_first(&dir->index);
+	     vclock != NULL && vclock_sum(vclock) < signature;
+	     vclock = vclockset_next(&dir->index, vclock))
+		count++;
+	if (count == 0)
+		return;
+	int64_t *signatures = malloc(count * sizeof(*signatures));
+	if (signatures == NULL) {
+		say_error("not enough memory to collect %d files of %s",
+			  count, dir->dirname);
+		return;
+	}
+	int i = 0;
+	for (vclock = vclockset_first(&dir->index);
+	     i < count;
+	     vclock = vclockset_next(&dir->index, vclock))
+		signatures[i++] = vclock_sum(vclock);
+	for (i = 0; i < count; i++) {
+		char filename[PATH_MAX];
+		snprintf(filename, sizeof(filename), "%s",
+			 xdir_resolve_filename(dir, signatures[i], NONE));
+		say_info("removing %s", filename);
+		if (coeio_unlink(filename) < 0 && errno != ENOENT) {
+			say_syserror("error while removing %s", filename);
+			break;
+		}
+		if (++*batch % GC_UNLINK_BATCH == 0)
+			fiber_sleep(GC_UNLINK_BATCH_DELAY);
+	}
+	free(signatures);
+}
+
+/**
+ * Return the signature of the slowest registered consumer,
+ * or INT64_MAX if there are none.
+ */
+static int64_t
+gc_min_consumer_signature(void)
+{
+	int64_t min = INT64_MAX;
+	struct gc_consumer *consumer;
+	rlist_foreach_entry(consumer, &gc.consumers, in_consumers) {
+		if (consumer->signature < min)
+			min = consumer->signature;
+	}
+	return min;
+}
+
+/**
+ * Remove files left from the checkpoints collected so far,
+ * except the ones still needed by registered consumers.
+ */
+static void
+gc_collect_files(void)
+{
+	struct vclock *oldest = vclockset_first(&gc.checkpoints);
+	if (oldest == NULL)
+		return;
+	/*
+	 * A delta checkpoint is useless without its base full
+	 * snapshot and every delta in between, so files are
+	 * removed up to the base of the oldest checkpoint left,
+	 * not up to the checkpoint itself. WALs are anchored at
+	 * the base as well: a joining replica is fed the last
+	 * full snapshot and catches up from its vclock.
+	 */
+	if (xdir_scan(&gc.snap_dir) < 0 || xdir_scan(&gc.delta_dir) < 0) {
+		error_log(diag_last_error(diag_get()));
+		return;
+	}
+	struct vclock *base = vclockset_match(&gc.snap_dir.index, oldest);
+	if (base == NULL || vclock_compare(base, oldest) > 0)
+		return; /* no base snapshot - do not remove anything */
+	int64_t gc_signature = vclock_sum(base);
+	gc.collect_signature = gc_signature;
+
+	/*
+	 * Never remove WALs a consumer has yet to fetch: a replica
+	 * which finds a gap in the master's logs has no choice but
+	 * to rejoin from a full snapshot. The consumer position may
+	 * fall in the middle of an xlog, so keep the whole file
+	 * containing it.
+	 */
+	int64_t consumer_signature = gc_min_consumer_signature();
+	if (consumer_signature < gc_signature) {
+		if (xdir_scan(&gc.wal_dir) < 0) {
+			error_log(diag_last_error(diag_get()));
+			return;
+		}
+		struct vclock *wal = NULL;
+		struct vclock *it = vclockset_first(&gc.wal_dir.index);
+		while (it != NULL && vclock_sum(it) <= consumer_signature) {
+			wal = it;
+			it = vclockset_next(&gc.wal_dir.index, it);
+		}
+		gc_signature = (wal != NULL ?
+				vclock_sum(wal) : consumer_signature);
+	}
+
+	int batch = 0;
+	gc_remove_files(&gc.snap_dir, gc_signature, &batch);
+	gc_remove_files(&gc.delta_dir, gc_signature, &batch);
+
+	wal_collect_garbage(gc_signature);
+	engine_collect_garbage(gc_signature);
+}
+
+static int
+gc_collect_fiber_f(va_list ap)
+{
+	(void) ap;
+	while (!fiber_is_cancelled()) {
+		if (!gc.collect_pending) {
+			ipc_cond_wait(&gc.collect_cond);
+			continue;
+		}
+		gc.collect_pending = false;
+		gc_collect_files();
+	}
+	return 0;
+}
+
+/**
+ * Ask the background collector to re-check which files may go.
+ * This is all a gc trigger ever does to the filesystem: the
+ * actual removal happens in gc.collect_fiber, so e.g. a relay
+ * reporting replica progress returns as soon as the in-memory
+ * consumer state is updated.
+ */
+static void
+gc_schedule_collect(void)
+{
+	if (gc.collect_fiber == NULL)
+		return; /* not initialized yet */
+	gc.collect_pending = true;
+	ipc_cond_signal(&gc.collect_cond);
+}
+
+struct gc_consumer *
+gc_consumer_register(const char *name, int64_t signature)
+{
+	struct gc_consumer *consumer;
+	consumer = (struct gc_consumer *)malloc(sizeof(*consumer));
+	if (consumer == NULL) {
+		diag_set(OutOfMemory, sizeof(*consumer),
+			 "malloc", "struct gc_consumer");
+		return NULL;
+	}
+	snprintf(consumer->name, sizeof(consumer->name), "%s", name);
+	consumer->signature = signature;
+	rlist_add_tail_entry(&gc.consumers, consumer, in_consumers);
+	return consumer;
+}
+
+void
+gc_consumer_unregister(struct gc_consumer *consumer)
+{
+	int64_t signature = consumer->signature;
+	rlist_del_entry(consumer, in_consumers);
+	free(consumer);
+	/* Retry gc if the consumer was holding files back. */
+	if (signature < gc.collect_signature)
+		gc_schedule_collect();
+}
+
+void
+gc_consumer_advance(struct gc_consumer *consumer, int64_t signature)
+{
+	if (signature <= consumer->signature)
+		return;
+	int64_t prev = consumer->signature;
+	consumer->signature = signature;
+	/* Retry gc if the consumer was holding files back. */
+	if (prev < gc.collect_signature)
+		gc_schedule_collect();
+}
+
+int
+gc_remote_checkpoint(int64_t signature)
+{
+	if (gc.remote_checkpoint == NULL) {
+		gc.remote_checkpoint =
+			gc_consumer_register("remote checkpoint", signature);
+		if (gc.remote_checkpoint == NULL)
+			return -1;
+		return 0;
+	}
+	gc_consumer_advance(gc.remote_checkpoint, signature);
+	return 0;
+}
+
 void
 gc_run(int64_t signature)
 {
 	if (gc.signature < signature)
 		gc.signature = signature;
 
-	int64_t gc_signature = -1;
-
+	bool removed = false;
 	struct vclock *vclock = vclockset_first(&gc.checkpoints);
 	while (vclock != NULL) {
 		if (vclock_sum(vclock) >= signature)
@@ -191,28 +718,16 @@ gc_run(int64_t signature)
 		if (cpt->refs > 0)
 			break; /* checkpoint still in use */
 
-		const char *filename = xdir_format_filename(&gc.snap_dir,
-						vclock_sum(vclock), NONE);
-		say_info("removing %s", filename);
-		if (coeio_unlink(filename) < 0 && errno != ENOENT) {
-			say_syserror("error while removing %s", filename);
-			break;
-		}
-
 		struct vclock *next = vclockset_next(&gc.checkpoints, vclock);
 		vclockset_remove(&gc.checkpoints, vclock);
 		free(cpt);
 		vclock = next;
-
-		/* Include this checkpoint to gc. */
-		gc_signature = (vclock != NULL ?
-				vclock_sum(vclock) : signature);
+		removed = true;
 	}
+	if (!removed || vclock == NULL)
+		return;
 
-	if (gc_signature >= 0) {
-		wal_collect_garbage(gc_signature);
-		engine_collect_garbage(gc_signature);
-	}
+	gc_schedule_collect();
 }
 
 int64_t
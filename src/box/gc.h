@@ -75,11 +75,13 @@ checkpoint_iterator_next(struct checkpoint_iterator *it);
 
 /**
  * Initialize the garbage collection state.
- * @snap_dirname is a path to the snapshot directory.
+ * @snap_dirname is a path to the snapshot directory,
+ * @wal_dirname is a path to the WAL directory, scanned by the
+ * background WAL recompressor.
  * Return 0 on success, -1 on failure.
  */
 int
-gc_init(const char *snap_dirname);
+gc_init(const char *snap_dirname, const char *wal_dirname);
 
 /**
  * Destroy the garbage collection state.
@@ -101,6 +103,15 @@ gc_add_checkpoint(const struct vclock *vclock);
 int64_t
 gc_last_checkpoint(struct vclock *vclock);
 
+/**
+ * Get the vclock of the last full (non-delta) snapshot and return
+ * its signature. A delta checkpoint cannot seed a replica join, so
+ * join anchors at the last full one. Returns -1 if there are no
+ * full snapshots.
+ */
+int64_t
+gc_last_full_checkpoint(struct vclock *vclock);
+
 /**
  * Pin the last checkpoint so that it cannot be removed by garbage
  * collection. The checkpoint vclock is returned in @vclock.
@@ -116,6 +127,50 @@ gc_ref_last_checkpoint(struct vclock *vclock);
 void
 gc_unref_checkpoint(struct vclock *vclock);
 
+struct gc_consumer;
+
+/**
+ * Register a consumer of write ahead logs, e.g. a replica which
+ * is going to fetch rows starting from @signature. WAL files the
+ * consumer has not reached yet are exempt from garbage collection
+ * until the consumer advances past them or is unregistered, so a
+ * lagging replica can catch up from the logs instead of rejoining
+ * from a full snapshot. Consumers are not persisted: after the
+ * server restart a consumer is re-registered when its replica
+ * resubscribes.
+ * @name is the consumer name, for logging.
+ * Returns NULL on OOM.
+ */
+struct gc_consumer *
+gc_consumer_register(const char *name, int64_t signature);
+
+/**
+ * Unregister a consumer and retry garbage collection
+ * if necessary.
+ */
+void
+gc_consumer_unregister(struct gc_consumer *consumer);
+
+/**
+ * Advance the consumer position and retry garbage collection
+ * if necessary. Stale positions are ignored.
+ */
+void
+gc_consumer_advance(struct gc_consumer *consumer, int64_t signature);
+
+/**
+ * Remember that a remote peer holds a checkpoint covering
+ * @signature, taken on our behalf (see IPROTO_CHECKPOINT).
+ * Pins local WALs from @signature onwards, like a regular
+ * consumer, so that the remote checkpoint stays usable as a
+ * recovery base: whatever happened after it can be replayed
+ * from our logs. A repeated call advances the pin; stale
+ * signatures are ignored.
+ * Returns 0 on success, -1 on OOM.
+ */
+int
+gc_remote_checkpoint(int64_t signature);
+
 /**
  * Invoke garbage collection in order to remove files left from
  * checkpoints older than @signature.
@@ -38,6 +38,7 @@
 #include "txn.h"
 #include "rmean.h"
 #include "info.h"
+#include "session.h"
 
 const char *iterator_type_strs[] = {
 	/* [ITER_EQ]  = */ "EQ",
@@ -52,6 +53,7 @@ const char *iterator_type_strs[] = {
 	/* [ITER_BITS_ALL_NOT_SET] = */ "BITS_ALL_NOT_SET",
 	/* [ITER_OVERLAPS] = */ "OVERLAPS",
 	/* [ITER_NEIGHBOR] = */ "NEIGHBOR",
+	/* [ITER_COVERS] = */ "COVERS",
 };
 
 static_assert(sizeof(iterator_type_strs) / sizeof(const char *) ==
@@ -235,6 +237,14 @@ Index::findByKey(const char *key, uint32_t part_count) const
 	return NULL;
 }
 
+void
+Index::findByKeyMulti(const char **keys, uint32_t part_count,
+		      uint32_t key_count, struct tuple **results) const
+{
+	for (uint32_t i = 0; i < key_count; i++)
+		results[i] = findByKey(keys[i], part_count);
+}
+
 struct tuple *
 Index::findByTuple(struct tuple *tuple) const
 {
@@ -399,6 +409,48 @@ box_index_get(uint32_t space_id, uint32_t index_id, const char *key,
 	}
 }
 
+int
+box_index_multiget(uint32_t space_id, uint32_t index_id, const char **keys,
+		   const char **key_ends, uint32_t key_count,
+		   box_tuple_t **results)
+{
+	assert(keys != NULL && key_ends != NULL && results != NULL);
+	try {
+		struct space *space;
+		Index *index = check_index(space_id, index_id, &space);
+		if (!index->index_def->opts.is_unique)
+			tnt_raise(ClientError, ER_MORE_THAN_ONE_TUPLE);
+		uint32_t part_count = index->index_def->key_def.part_count;
+		/* Freed implicitly with the rest of the fiber gc region. */
+		const char **parts = (const char **)
+			region_alloc_xc(&fiber()->gc,
+					key_count * sizeof(*parts));
+		for (uint32_t i = 0; i < key_count; i++) {
+			const char *key = keys[i];
+			mp_tuple_assert(key, key_ends[i]);
+			uint32_t key_part_count = mp_decode_array(&key);
+			if (primary_key_validate(index->index_def, key,
+						 key_part_count))
+				diag_raise();
+			parts[i] = key;
+		}
+		/* Start one transaction in the engine for the batch. */
+		struct txn *txn = txn_begin_ro_stmt(space);
+		index->findByKeyMulti(parts, part_count, key_count,
+				      (struct tuple **)results);
+		/* Count statistics */
+		rmean_collect(rmean_box, IPROTO_SELECT, key_count);
+
+		for (uint32_t i = 0; i < key_count; i++)
+			results[i] = tuple_bless_null_xc(results[i]);
+		txn_commit_ro_stmt(txn);
+		return 0;
+	}  catch (Exception *) {
+		txn_rollback_stmt();
+		return -1;
+	}
+}
+
 int
 box_index_min(uint32_t space_id, uint32_t index_id, const char *key,
 	      const char *key_end, box_tuple_t **result)
@@ -515,11 +567,55 @@ box_index_iterator(uint32_t space_id, uint32_t index_id, int type,
 	}
 }
 
+box_iterator_t *
+box_index_iterator_frozen(uint32_t space_id, uint32_t index_id, int type,
+			  const char *key, const char *key_end)
+{
+	assert(key != NULL && key_end != NULL);
+	mp_tuple_assert(key, key_end);
+	struct iterator *it = NULL;
+	enum iterator_type itype = (enum iterator_type) type;
+	try {
+		struct space *space;
+		Index *index = check_index(space_id, index_id, &space);
+		struct txn *txn = txn_begin_ro_stmt(space);
+		assert(mp_typeof(*key) == MP_ARRAY); /* checked by Lua */
+		uint32_t part_count = mp_decode_array(&key);
+		if (key_validate(index->index_def, itype, key, part_count))
+			diag_raise();
+		it = index->allocIterator();
+		index->initIterator(it, itype, key, part_count);
+		/*
+		 * Pin the iterator to a read view. The engine
+		 * releases the view when the iterator is freed.
+		 */
+		index->createReadViewForIterator(it);
+		it->schema_version = schema_version;
+		it->space_id = space_id;
+		it->index_id = index_id;
+		it->index = index;
+		txn_commit_ro_stmt(txn);
+		return it;
+	} catch (Exception *) {
+		if (it)
+			it->free(it);
+		/* will be hanled by box.error() in Lua */
+		return NULL;
+	}
+}
+
 int
 box_iterator_next(box_iterator_t *itr, box_tuple_t **result)
 {
 	assert(result != NULL);
 	assert(itr->next != NULL);
+	/*
+	 * Iterator steps are the natural cancellation points of a
+	 * long scan: enforce the request deadline here so runaway
+	 * queries stop without explicit checks in user code.
+	 */
+	if (session_check_deadline(fiber_get_session(fiber())) != 0)
+		return -1;
 	try {
 		if (itr->schema_version != schema_version) {
 			struct space *space;
@@ -549,6 +645,79 @@ box_iterator_next(box_iterator_t *itr, box_tuple_t **result)
 	}
 }
 
+ssize_t
+box_iterator_next_n(box_iterator_t *itr, box_tuple_t **tuples, uint32_t count)
+{
+	assert(tuples != NULL);
+	assert(itr->next != NULL);
+	/* One deadline check pays for the whole batch. */
+	if (session_check_deadline(fiber_get_session(fiber())) != 0)
+		return -1;
+	try {
+		if (itr->schema_version != schema_version) {
+			struct space *space;
+			/* no tx management */
+			Index *index = check_index(itr->space_id, itr->index_id,
+						   &space);
+			if (index != itr->index)
+				return 0;
+			if (index->schema_version > itr->schema_version)
+				return 0; /* invalidate iterator */
+			itr->schema_version = schema_version;
+		}
+	} catch (Exception *) {
+		return 0; /* invalidate iterator */
+	}
+	uint32_t n = 0;
+	try {
+		while (n < count) {
+			struct tuple *tuple = itr->next(itr);
+			if (tuple == NULL)
+				break;
+			/*
+			 * Explicit references instead of the
+			 * single-slot tuple_bless(): all tuples of
+			 * the batch must stay alive at once.
+			 */
+			tuple_ref_xc(tuple);
+			tuples[n++] = tuple;
+		}
+		return n;
+	} catch (Exception *) {
+		while (n > 0)
+			tuple_unref(tuples[--n]);
+		return -1;
+	}
+}
+
+int
+box_iterator_reset(box_iterator_t *itr, int type,
+		   const char *key, const char *key_end)
+{
+	assert(key != NULL && key_end != NULL);
+	mp_tuple_assert(key, key_end);
+	enum iterator_type itype = (enum iterator_type) type;
+	try {
+		struct space *space;
+		Index *index = check_index(itr->space_id, itr->index_id,
+					   &space);
+		if (index != itr->index ||
+		    index->schema_version > itr->schema_version)
+			return 1;
+		struct txn *txn = txn_begin_ro_stmt(space);
+		uint32_t part_count = mp_decode_array(&key);
+		if (key_validate(index->index_def, itype, key, part_count))
+			diag_raise();
+		index->initIterator(itr, itype, key, part_count);
+		itr->schema_version = schema_version;
+		txn_commit_ro_stmt(txn);
+		return 0;
+	} catch (Exception *) {
+		/* will be handled by box.error() in Lua */
+		return -1;
+	}
+}
+
 void
 box_iterator_free(box_iterator_t *it)
 {
@@ -78,7 +78,8 @@ enum iterator_type {
 	ITER_BITS_ALL_NOT_SET =  9, /* all bits are not set                */
 	ITER_OVERLAPS         = 10, /* key overlaps x                      */
 	ITER_NEIGHBOR         = 11, /* tuples in distance ascending order from specified point */
-	iterator_type_MAX     = ITER_NEIGHBOR + 1
+	ITER_COVERS           = 12, /* key is covered by x (spatial)       */
+	iterator_type_MAX     = ITER_COVERS + 1
 };
 
 /**
@@ -111,6 +112,33 @@ iterator_direction(enum iterator_type type)
 box_iterator_t *
 box_index_iterator(uint32_t space_id, uint32_t index_id, int type,
 		   const char *key, const char *key_end);
+
+/**
+ * Same as box_index_iterator(), but the iterator is pinned to a
+ * read view of the index: modifications made after this call are
+ * not visible to the iteration and do not invalidate it, even if
+ * the iterating fiber yields. Writers are not blocked - the index
+ * versions the modified blocks instead (copy-on-write). Designed
+ * for long analytical scans over hot spaces.
+ *
+ * The view is held until box_iterator_free(), so free the
+ * iterator promptly: a held view delays reclamation of replaced
+ * index blocks. Only memtx TREE and HASH indexes support read
+ * views; other indexes fail with an error.
+ *
+ * \param space_id space identifier.
+ * \param index_id index identifier.
+ * \param type \link iterator_type iterator type \endlink
+ * \param key encoded key in MsgPack Array format ([part1, part2, ...]).
+ * \param key_end the end of encoded \a key
+ * \retval NULL on error (check box_error_last())
+ * \retval iterator otherwise
+ * \sa box_index_iterator()
+ */
+box_iterator_t *
+box_index_iterator_frozen(uint32_t space_id, uint32_t index_id, int type,
+			  const char *key, const char *key_end);
+
 /**
  * Retrive the next item from the \a iterator.
  *
@@ -122,6 +150,30 @@ box_index_iterator(uint32_t space_id, uint32_t index_id, int type,
 int
 box_iterator_next(box_iterator_t *iterator, box_tuple_t **result);
 
+/**
+ * Retrieve up to \a count next items from the \a iterator in one
+ * call. A batch call amortizes the per-step fixed costs of
+ * box_iterator_next() - the schema version and deadline checks and
+ * the call itself - which dominate tight scan loops of C stored
+ * procedures.
+ *
+ * Unlike box_iterator_next(), every returned tuple is referenced:
+ * the caller owns one reference per stored tuple and must release
+ * each with box_tuple_unref() when done with it.
+ *
+ * \param iterator an iterator returned by box_index_iterator().
+ * \param[out] tuples array of at least \a count tuple pointers
+ * \param count the capacity of \a tuples
+ * \retval -1 on error (check box_error_last() for details)
+ * \retval >= 0 the number of tuples stored. A short count means
+ *         the end of data (or an iterator invalidated by DDL, the
+ *         same cases where box_iterator_next() returns NULL).
+ * \sa box_tuple_field_n()
+ */
+ssize_t
+box_iterator_next_n(box_iterator_t *iterator, box_tuple_t **tuples,
+		    uint32_t count);
+
 /**
  * Destroy and deallocate iterator.
  *
@@ -157,6 +209,24 @@ box_index_key_def(uint32_t space_id, uint32_t index_id);
 const box_key_def_t *
 box_iterator_key_def(box_iterator_t *iterator);
 
+/**
+ * Re-position an iterator in place with a new type and key,
+ * reusing its allocation. Added for the SQL cursor bridge, where
+ * every lookup used to pay an iterator free + alloc round-trip.
+ *
+ * \param iterator an iterator returned by box_index_iterator()
+ * \param type \link iterator_type iterator type \endlink
+ * \param key encoded key in MsgPack Array format
+ * \param key_end the end of encoded \a key
+ * \retval 0 on success
+ * \retval 1 the iterator is stale (DDL changed the index) -
+ *           free it and create a new one
+ * \retval -1 on error (check box_error_last())
+ */
+int
+box_iterator_reset(box_iterator_t *iterator, int type,
+		   const char *key, const char *key_end);
+
 /**
  * Return the number of element in the index.
  *
@@ -214,6 +284,31 @@ int
 box_index_get(uint32_t space_id, uint32_t index_id, const char *key,
 	      const char *key_end, box_tuple_t **result);
 
+/**
+ * Get several tuples from index by keys in one call.
+ *
+ * Works as a batch of box_index_get() calls sharing one read-only
+ * transaction, and lets the index overlap the memory accesses of
+ * independent probes, so it is noticeably faster for dozens of
+ * point reads at once.
+ *
+ * \param space_id space identifier
+ * \param index_id index identifier
+ * \param keys array of encoded keys, each in MsgPack Array format
+ *  ([part1, part2, ...])
+ * \param key_ends array of ends of encoded keys
+ * \param key_count number of keys
+ * \param[out] results array of \a key_count tuples; NULL is stored
+ *  for the keys that were not found
+ * \retval -1 on error (check box_error_last())
+ * \retval 0 on success
+ * \pre keys != NULL, key_ends != NULL, results != NULL
+ */
+int
+box_index_multiget(uint32_t space_id, uint32_t index_id, const char **keys,
+		   const char **key_ends, uint32_t key_count,
+		   box_tuple_t **results);
+
 /**
  * Return a first (minimal) tuple matched the provided key.
  *
@@ -379,6 +474,16 @@ public:
 	virtual size_t count(enum iterator_type type, const char *key,
 			     uint32_t part_count) const;
 	virtual struct tuple *findByKey(const char *key, uint32_t part_count) const;
+	/**
+	 * Look up several keys at once. Equivalent to calling
+	 * findByKey() for each key, but an engine may overlap the
+	 * memory accesses of independent probes (e.g. prefetch the
+	 * hash buckets of the whole batch before probing).
+	 * Stores one tuple (or NULL) per key into results.
+	 */
+	virtual void findByKeyMulti(const char **keys, uint32_t part_count,
+				    uint32_t key_count,
+				    struct tuple **results) const;
 	virtual struct tuple *findByTuple(struct tuple *tuple) const;
 	virtual struct tuple *replace(struct tuple *old_tuple,
 				      struct tuple *new_tuple,
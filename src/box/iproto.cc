@@ -33,6 +33,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <msgpuck.h>
 #include "third_party/base64.h"
@@ -47,6 +48,7 @@
 #include "scoped_guard.h"
 #include "memory.h"
 
+#include "alloc_stat.h"
 #include "port.h"
 #include "iproto_port.h"
 #include "iobuf.h"
@@ -54,14 +56,86 @@
 #include "tuple.h"
 #include "session.h"
 #include "xrow.h"
+#include "xlog.h"
 #include "schema.h" /* schema_version */
+#include "user.h" /* user_cache_version */
 #include "replication.h" /* instance_uuid */
 #include "iproto_constants.h"
 #include "rmean.h"
+#include "zstd.h"
+#include "clock.h"
+#include "histogram.h"
 
 /* The number of iproto messages in flight */
 enum { IPROTO_MSG_MAX = 768 };
 
+enum {
+	/**
+	 * How many free messages a net thread keeps at hand
+	 * instead of returning them to the message pool. Sized
+	 * to absorb the request burst of one readable socket
+	 * drain, so a steady message flow recycles messages
+	 * through the stash and leaves the pool alone.
+	 */
+	IPROTO_MSG_STASH_MAX = 128,
+	/** How many messages one pool refill grabs. */
+	IPROTO_MSG_STASH_REFILL = 32,
+};
+
+/*
+ * A cap on the number of bytes drained from a socket in one
+ * event loop callback: a connection pumping a bulk stream of
+ * requests must not starve the other connections of the loop.
+ */
+enum { IPROTO_INPUT_BUDGET = 128 * 1024 };
+
+/*
+ * Do not compress output batches below this size even on a
+ * connection which negotiated compression: the envelope and
+ * frame overhead eat the gain, and small responses are cheap
+ * to send as is.
+ */
+enum { IPROTO_COMPRESSION_THRESHOLD = 4096 };
+
+/**
+ * ZSTD level used for connections which negotiated response
+ * compression with an IPROTO_COMPRESSION request, 0 if the
+ * feature is disabled. Set from box.cfg.iproto_compression_level
+ * before the net threads are started.
+ */
+static int iproto_compression_level = 0;
+
+/**
+ * The target size of one IPROTO_CHUNK packet of a streamed
+ * select. Set from box.cfg.iproto_stream_chunk_size before the
+ * net threads are started.
+ */
+static size_t iproto_stream_chunk_size = 16384;
+
+/** Request admission lanes of a net thread. */
+enum iproto_lane {
+	/**
+	 * The default lane: health checks, interactive clients,
+	 * anything which did not ask otherwise.
+	 */
+	IPROTO_LANE_NORMAL = 0,
+	/** Opted-in bulk traffic, see IPROTO_LOW_PRIORITY. */
+	IPROTO_LANE_LOW = 1,
+	IPROTO_LANE_MAX = 2,
+};
+
+/**
+ * In-flight request budget of each lane. The low-priority lane
+ * is capped below the global limit, so bulk traffic alone can
+ * never consume the whole message pool: the remainder stays
+ * available to the default lane, and a batch job flood does not
+ * make the load balancer health checks queue behind it.
+ */
+static const size_t iproto_lane_msg_max[IPROTO_LANE_MAX] = {
+	IPROTO_MSG_MAX,
+	IPROTO_MSG_MAX * 2 / 3,
+};
+
 /* {{{ iproto_msg - declaration */
 
 /**
@@ -69,6 +143,48 @@ enum { IPROTO_MSG_MAX = 768 };
  * from all connections are queued into a single queue
  * and processed in FIFO order.
  */
+enum {
+	/**
+	 * Slots of the per-thread stale read cache. The cache is
+	 * direct-mapped: a colliding response simply evicts the
+	 * previous occupant, so no eviction bookkeeping is needed
+	 * and the footprint is strictly bounded.
+	 */
+	IPROTO_STALE_SLOTS = 1024,
+	/** Responses above this size are not worth caching. */
+	IPROTO_STALE_MAX_REPLY = 16384,
+};
+
+/**
+ * A cached select response of the stale read cache, see
+ * iproto_stale_serve(). Built in the tx thread from a freshly
+ * encoded reply, inserted and served by the owning net thread.
+ * Keyed by the raw request body bytes plus the connection, so a
+ * hit replays exactly the same select to the same client - the
+ * connection in the key also keeps one client from being served
+ * data another client warmed the cache with past access checks.
+ */
+struct iproto_stale_entry {
+	/** The connection the entry was built for. */
+	struct iproto_connection *connection;
+	/** Schema version the response was built under. */
+	uint32_t schema_version;
+	/**
+	 * User cache version the response was built under. A
+	 * grant or revoke bumps it, so entries whose access
+	 * checks predate a privilege change never hit.
+	 */
+	uint32_t user_cache_version;
+	/** Monotonic deadline after which the entry is dead. */
+	double expires;
+	/** Length of the request body key, bytes. */
+	uint32_t key_len;
+	/** Length of the cached reply, bytes. */
+	uint32_t data_len;
+	/** Key bytes followed by the reply bytes. */
+	char payload[];
+};
+
 struct iproto_msg: public cmsg
 {
 	struct iproto_connection *connection;
@@ -93,37 +209,61 @@ struct iproto_msg: public cmsg
 	size_t len;
 	/** End of write position in the output buffer */
 	struct obuf_svp write_end;
+	/** The admission lane the message was accounted in. */
+	enum iproto_lane lane;
+	/**
+	 * Used in "stream" msgs: the flow control window
+	 * advertised by the client, see IPROTO_STREAM.
+	 */
+	uint64_t stream_window;
 	/**
 	 * Used in "connect" msgs, true if connect trigger failed
 	 * and the connection must be closed.
 	 */
 	bool close_connection;
+	/** True if this request was sampled for tracing. */
+	bool trace;
+	/**
+	 * Decode timestamp; always stamped, feeds the latency
+	 * histograms as well as sampled traces.
+	 */
+	double trace_recv;
+	/** Stage timestamps of a sampled request. */
+	double trace_tx;
+	double trace_done;
+	/**
+	 * Fiber region usage when tx processing started; the
+	 * growth is attributed to the request type, see
+	 * alloc_stat.h.
+	 */
+	size_t alloc_region_svp;
+	/**
+	 * Staleness budget of a select on a space with
+	 * stale_read_ttl set, read from the schema view at decode
+	 * time; 0 for everything else.
+	 */
+	double stale_ttl;
+	/**
+	 * A cache entry built from the response by tx, to be
+	 * inserted into the stale read cache of the owning net
+	 * thread by net_send_msg().
+	 */
+	struct iproto_stale_entry *stale_entry;
 };
 
-static struct mempool iproto_msg_pool;
+struct iproto_thread;
 
 static struct iproto_msg *
-iproto_msg_new(struct iproto_connection *con)
-{
-	struct iproto_msg *msg =
-		(struct iproto_msg *) mempool_alloc_xc(&iproto_msg_pool);
-	msg->connection = con;
-	return msg;
-}
+iproto_msg_new(struct iproto_connection *con);
 
 /**
- * Resume stopped connections, if any.
+ * Resume stopped connections of the thread, if any.
  */
 static void
-iproto_resume();
+iproto_resume(struct iproto_thread *iproto_thread);
 
-
-static inline void
-iproto_msg_delete(struct cmsg *msg)
-{
-	mempool_free(&iproto_msg_pool, msg);
-	iproto_resume();
-}
+static void
+iproto_msg_delete(struct cmsg *msg);
 
 struct IprotoMsgGuard {
 	struct iproto_msg *msg;
@@ -149,13 +289,9 @@ struct IprotoMsgGuard {
  * - on_connect trigger must be processed before any other
  *   request on this connection.
  */
-static struct cpipe tx_pipe;
-static struct cpipe net_pipe;
 /* A pointer to the transaction processor cord. */
 struct cord *tx_cord;
 
-struct rmean *rmean_net;
-
 enum rmean_net_name {
 	IPROTO_SENT,
 	IPROTO_RECEIVED,
@@ -164,9 +300,116 @@ enum rmean_net_name {
 
 const char *rmean_net_strings[IPROTO_LAST] = { "SENT", "RECEIVED" };
 
+/**
+ * Context of a single network io thread. Connections are sharded
+ * across the threads on accept, and each thread owns everything
+ * its connections need - message and connection pools, the pipes
+ * to and from tx, statistics - so the threads never share state
+ * and network CPU scales with cores.
+ */
+struct iproto_thread {
+	/** The thread. */
+	struct cord cord;
+	/** Ordinal number of the thread. */
+	int id;
+	/** "net0", "net1", ... - the cbus endpoint of the thread. */
+	char endpoint_name[16];
+	/** A pipe from this net thread to tx. */
+	struct cpipe tx_pipe;
+	/** A pipe from tx to this net thread. */
+	struct cpipe net_pipe;
+	/**
+	 * A pipe from the acceptor thread (thread 0) to this
+	 * thread, to hand over accepted connections. Thread 0
+	 * accepts locally and has none.
+	 */
+	struct cpipe accept_pipe;
+	/** Request message pool of this thread. */
+	struct mempool iproto_msg_pool;
+	/**
+	 * Free messages kept out of the pool for quick reuse,
+	 * see IPROTO_MSG_STASH_MAX.
+	 */
+	struct iproto_msg *msg_stash[IPROTO_MSG_STASH_MAX];
+	/** The number of messages in the stash. */
+	int msg_stash_size;
+	/** Connection pool of this thread. */
+	struct mempool iproto_connection_pool;
+	/**
+	 * Connections with input stopped, one list per admission
+	 * lane so that a resumable lane is never blocked behind a
+	 * connection of a lane which is still over budget. See
+	 * iproto_resume().
+	 */
+	struct rlist stopped_connections[IPROTO_LANE_MAX];
+	/** In-flight messages per admission lane. */
+	size_t lane_msg_count[IPROTO_LANE_MAX];
+	/**
+	 * Connections with output ready to be flushed. Instead of
+	 * flushing per completed response, net_send_msg() queues
+	 * the connection here, and all queued output is written
+	 * out in flush_watcher right before the event loop goes
+	 * to sleep: the responses which complete in the same loop
+	 * iteration share one writev() per socket. Since the
+	 * watcher runs in the very same iteration, output is
+	 * never held across a poll cycle - the added latency is
+	 * capped by one loop tick.
+	 */
+	struct rlist flush_queue;
+	/** Drains flush_queue at the end of a loop iteration. */
+	struct ev_prepare flush_watcher;
+	/**
+	 * Network statistics of this thread. box.stat.net sums
+	 * them over the threads, see iproto_rmean_foreach().
+	 */
+	struct rmean *rmean_net;
+	/**
+	 * Message routes of this thread: the return hop must
+	 * point at this thread's net_pipe, so every thread owns
+	 * a copy.
+	 */
+	struct cmsg_hop disconnect_route[2];
+	struct cmsg_hop misc_route[2];
+	struct cmsg_hop select_route[2];
+	struct cmsg_hop process1_route[2];
+	struct cmsg_hop sync_route[2];
+	struct cmsg_hop connect_route[2];
+	struct cmsg_hop compression_route[2];
+	struct cmsg_hop priority_route[2];
+	struct cmsg_hop stream_route[2];
+	/**
+	 * Single-hop legs of the stream flow control handshake:
+	 * the net thread may sit on a flush request until the
+	 * window opens, which a fixed two-hop route can't express.
+	 */
+	struct cmsg_hop stream_flush_route[1];
+	struct cmsg_hop stream_ack_route[1];
+	const struct cmsg_hop *dml_route[IPROTO_TYPE_STAT_MAX];
+	/**
+	 * The stale read cache: recent select responses of spaces
+	 * with stale_read_ttl set, served straight from this net
+	 * thread without a round trip to tx, see
+	 * iproto_stale_serve().
+	 */
+	struct iproto_stale_entry *stale_cache[IPROTO_STALE_SLOTS];
+	/**
+	 * The binary protocol listener of this thread. For TCP
+	 * every thread binds its own SO_REUSEPORT socket and the
+	 * kernel shards connections between the accept queues; a
+	 * unix socket has a single accept queue, so only thread 0
+	 * binds and hands connections over, see iproto_on_accept().
+	 */
+	struct evio_service binary;
+};
+
+static struct iproto_thread *iproto_threads;
+static int iproto_threads_count;
+
 /** Context of a single client connection. */
 struct iproto_connection
 {
+	/** The net thread the connection belongs to. */
+	struct iproto_thread *iproto_thread;
 	/**
 	 * Two rotating buffers for I/O. Input is always read into
 	 * iobuf[0]. As soon as iobuf[0] input buffer becomes full,
@@ -195,46 +438,384 @@ struct iproto_connection
 	/* Pre-allocated disconnect msg. */
 	struct iproto_msg *disconnect;
 	struct rlist in_stop_list;
+	/** Link in flush_queue, empty if not queued for flush. */
+	struct rlist in_flush_list;
+	/**
+	 * The iobuf whose output was written out only partially
+	 * by the last writev(). It must be flushed up to a
+	 * response boundary before output from the other buffer
+	 * may be sent, see iproto_connection_output_iobuf().
+	 */
+	struct iobuf *partial_iobuf;
+	/**
+	 * Response compression state, negotiated with an
+	 * IPROTO_COMPRESSION request: the ZSTD level (0 - send
+	 * plain output), the compression context, created when the
+	 * feature is negotiated, and a buffer holding the part of
+	 * a compressed envelope which did not fit into the socket
+	 * buffer yet.
+	 */
+	int zstd_level;
+	ZSTD_CCtx *zctx;
+	struct ibuf zbuf;
+	/**
+	 * The admission lane of the connection, set with an
+	 * IPROTO_LOW_PRIORITY request.
+	 */
+	enum iproto_lane lane;
+	/**
+	 * The flow control window of streamed selects, set with
+	 * an IPROTO_STREAM request, 0 - streaming is off. The
+	 * server keeps at most this much of a streamed response
+	 * buffered; the producing tx fiber is paused until the
+	 * client drains the excess.
+	 */
+	size_t stream_window;
+	/**
+	 * Stream flush requests which wait for the window to
+	 * open, in arrival order.
+	 */
+	struct rlist stream_flush_list;
 };
 
-static struct mempool iproto_connection_pool;
-static RLIST_HEAD(stopped_connections);
+static struct iproto_msg *
+iproto_msg_new(struct iproto_connection *con)
+{
+	struct iproto_thread *iproto_thread = con->iproto_thread;
+	if (iproto_thread->msg_stash_size == 0) {
+		/*
+		 * Refill the stash in a batch: draining a
+		 * readable socket allocates messages in bursts,
+		 * and one refill covers many of them.
+		 */
+		while (iproto_thread->msg_stash_size <
+		       IPROTO_MSG_STASH_REFILL) {
+			struct iproto_msg *fresh = (struct iproto_msg *)
+				mempool_alloc(&iproto_thread->iproto_msg_pool);
+			if (fresh == NULL)
+				break;
+			iproto_thread->msg_stash[
+				iproto_thread->msg_stash_size++] = fresh;
+		}
+		if (iproto_thread->msg_stash_size == 0) {
+			tnt_raise(OutOfMemory,
+				  sizeof(struct iproto_msg),
+				  "mempool", "struct iproto_msg");
+		}
+	}
+	struct iproto_msg *msg =
+		iproto_thread->msg_stash[--iproto_thread->msg_stash_size];
+	msg->connection = con;
+	msg->lane = con->lane;
+	msg->trace = false;
+	msg->stale_ttl = 0;
+	msg->stale_entry = NULL;
+	iproto_thread->lane_msg_count[msg->lane]++;
+	return msg;
+}
+
+/* {{{ Request tracing */
 
 /**
- * Returns true if we have enough spare messages
- * in the message pool. Disconnect messages are
- * discounted: they are mostly reserved and idle.
+ * Sampled request tracing: every iproto_trace_rate-th decoded
+ * request records the timestamps of its pipeline stages and
+ * publishes them into a small global ring read by
+ * box.stat.trace. Slots are claimed with an atomic counter so
+ * several net threads never write the same slot concurrently;
+ * the per-slot seqlock only protects the reader from a torn copy
+ * when the ring laps it.
  */
-static inline bool
-iproto_stop_input()
+static struct iproto_trace iproto_trace_ring[IPROTO_TRACE_RING_SIZE];
+/** Next slot to claim. */
+static uint64_t iproto_trace_pos;
+/** Sample every Nth request, 0 - tracing is off. */
+static uint32_t iproto_trace_rate;
+/** Decode counter of this net thread, for sampling. */
+static __thread uint32_t iproto_trace_counter;
+
+void
+iproto_trace_set_rate(uint32_t rate)
+{
+	__atomic_store_n(&iproto_trace_rate, rate, __ATOMIC_RELAXED);
+}
+
+uint32_t
+iproto_trace_get_rate(void)
 {
-	size_t connection_count = mempool_count(&iproto_connection_pool);
-	size_t request_count = mempool_count(&iproto_msg_pool);
-	return request_count > connection_count + IPROTO_MSG_MAX;
+	return __atomic_load_n(&iproto_trace_rate, __ATOMIC_RELAXED);
 }
 
+int
+iproto_trace_read(int index, struct iproto_trace *out)
+{
+	assert(index >= 0 && index < IPROTO_TRACE_RING_SIZE);
+	struct iproto_trace *t = &iproto_trace_ring[index];
+	uint64_t seq = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE);
+	if (seq == 0 || seq % 2 == 1)
+		return -1;
+	*out = *t;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&t->seq, __ATOMIC_RELAXED) != seq)
+		return -1;
+	out->seq = 0;
+	return 0;
+}
+
+/** Publish a completed trace of @a msg, net thread. */
+static void
+iproto_trace_record(struct iproto_msg *msg)
+{
+	uint64_t pos = __atomic_fetch_add(&iproto_trace_pos, 1,
+					  __ATOMIC_RELAXED);
+	struct iproto_trace *t =
+		&iproto_trace_ring[pos & (IPROTO_TRACE_RING_SIZE - 1)];
+	__atomic_store_n(&t->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	t->type = msg->header.type;
+	t->t_recv = msg->trace_recv;
+	t->t_tx = msg->trace_tx;
+	t->t_done = msg->trace_done;
+	t->t_sent = clock_fast();
+	__atomic_store_n(&t->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+}
+
+/* }}} */
+
+/* {{{ Request latency histograms */
+
+enum {
+	/** Length of one latency accounting window, seconds. */
+	IPROTO_LATENCY_WINDOW = 10,
+	/** Smallest and largest latency bucket, microseconds. */
+	IPROTO_LATENCY_MIN_US = 1,
+	IPROTO_LATENCY_MAX_US = 10 * 1000 * 1000,
+};
+
 /**
- * Throttle the queue to the tx thread and ensure the fiber pool
- * in tx thread is not depleted by a flood of incoming requests:
- * resume a stopped connection only if there is a spare message
- * object in the message pool.
+ * Latency of every request - microseconds from decode in the net
+ * thread to response completion in tx, output flush excluded -
+ * collected into two log-bucketed histograms per request type.
+ * "cur" collects the running window, "prev" holds the last
+ * complete one; rotation is lazy, performed by the first sample
+ * after the window elapses, so no timer is needed. Touched only
+ * by the tx cord, which also serves box.stat.latency, hence no
+ * synchronization.
  */
+struct iproto_latency {
+	struct histogram *cur;
+	struct histogram *prev;
+	double window_start;
+};
+
+static struct iproto_latency iproto_latency[IPROTO_TYPE_STAT_MAX];
+
 static void
-iproto_resume()
+iproto_latency_collect(uint32_t type, double latency, double now)
+{
+	if (type >= IPROTO_TYPE_STAT_MAX)
+		return;
+	struct iproto_latency *l = &iproto_latency[type];
+	if (l->cur == NULL) {
+		l->cur = histogram_new_log(IPROTO_LATENCY_MIN_US,
+					   IPROTO_LATENCY_MAX_US);
+		l->prev = histogram_new_log(IPROTO_LATENCY_MIN_US,
+					    IPROTO_LATENCY_MAX_US);
+		if (l->cur == NULL || l->prev == NULL) {
+			/* Drop the sample, retry the allocation later. */
+			histogram_delete(l->cur);
+			histogram_delete(l->prev);
+			l->cur = l->prev = NULL;
+			return;
+		}
+		l->window_start = now;
+	}
+	if (now - l->window_start > IPROTO_LATENCY_WINDOW) {
+		struct histogram *stale = l->prev;
+		histogram_reset(stale);
+		l->prev = l->cur;
+		l->cur = stale;
+		l->window_start = now;
+	}
+	histogram_collect(l->cur, (int64_t)(latency * 1e6));
+}
+
+int
+iproto_latency_stat_get(uint32_t type, struct iproto_latency_stat *stat)
 {
+	if (type >= IPROTO_TYPE_STAT_MAX)
+		return -1;
+	struct iproto_latency *l = &iproto_latency[type];
+	if (l->cur == NULL || l->cur->total + l->prev->total == 0)
+		return -1;
 	/*
-	 * Most of the time we have nothing to do here: throttling
-	 * is not active.
+	 * Merge the running and the last complete window into a
+	 * scratch histogram: each percentile then covers between
+	 * one and two windows of history. box.stat.latency is
+	 * called rarely, the allocation does not matter.
 	 */
-	if (rlist_empty(&stopped_connections))
-		return;
-	if (iproto_stop_input())
+	struct histogram *merged =
+		histogram_new_log(IPROTO_LATENCY_MIN_US,
+				  IPROTO_LATENCY_MAX_US);
+	if (merged == NULL)
+		return -1;
+	histogram_merge(merged, l->prev);
+	histogram_merge(merged, l->cur);
+	stat->count = merged->total;
+	stat->p50 = histogram_percentile(merged, 50);
+	stat->p99 = histogram_percentile(merged, 99);
+	stat->p999 = histogram_percentile_permille(merged, 999);
+	stat->max = merged->max;
+	histogram_delete(merged);
+	return 0;
+}
+
+/* }}} */
+
+/* {{{ Request capture
+ *
+ * Opt-in traffic recording for performance regression testing:
+ * every request dispatched to tx is appended to an xlog-format
+ * file which extra/replay.lua can later play back against a
+ * candidate build. The tap sits on the tx side of the pipe, so
+ * a single file covers all net threads without locking, at the
+ * price of not seeing requests which fail to decode.
+ *
+ * A captured row is the original request header and body. The
+ * fields a client request leaves unused are reinterpreted: tm
+ * carries the receive timestamp (monotonic clock, only deltas
+ * are meaningful), replica_id the session id and lsn the row
+ * number, which is all the replayer needs to reproduce pacing
+ * and per-connection concurrency.
+ */
+
+static struct xlog iproto_capture_xlog;
+static bool iproto_capture_enabled;
+static int64_t iproto_capture_rows;
+
+int
+iproto_capture_start(const char *path)
+{
+	if (iproto_capture_enabled) {
+		diag_set(ClientError, ER_ILLEGAL_PARAMS,
+			 "capture is already running");
+		return -1;
+	}
+	struct xlog_meta meta;
+	memset(&meta, 0, sizeof(meta));
+	snprintf(meta.filetype, sizeof(meta.filetype), "%s", "CAPTURE");
+	meta.instance_uuid = INSTANCE_UUID;
+	if (xlog_create(&iproto_capture_xlog, path, &meta) != 0)
+		return -1;
+	iproto_capture_rows = 0;
+	iproto_capture_enabled = true;
+	return 0;
+}
+
+int
+iproto_capture_stop(void)
+{
+	if (!iproto_capture_enabled)
+		return 0;
+	iproto_capture_enabled = false;
+	if (xlog_flush(&iproto_capture_xlog) < 0 ||
+	    xlog_rename(&iproto_capture_xlog) != 0) {
+		xlog_close(&iproto_capture_xlog, false);
+		return -1;
+	}
+	return xlog_close(&iproto_capture_xlog, false);
+}
+
+/** Append one request to the capture file. Runs in tx. */
+static void
+iproto_capture_record(struct iproto_msg *msg)
+{
+	/*
+	 * Bodyless requests (ping) carry no load worth
+	 * replaying and would confuse the xlog reader.
+	 */
+	if (msg->header.bodycnt == 0)
 		return;
+	/*
+	 * Work on a copy: the original header is still used for
+	 * the reply and, for DML, ends up in the journal.
+	 */
+	struct xrow_header row = msg->header;
+	row.tm = msg->trace_recv;
+	row.sync = 0;
+	row.lsn = ++iproto_capture_rows;
+	row.replica_id = (uint32_t) msg->connection->session->id;
+	if (xlog_write_row(&iproto_capture_xlog, &row) < 0) {
+		say_error("request capture failed, stopping it");
+		error_log(diag_last_error(diag_get()));
+		diag_clear(diag_get());
+		iproto_capture_stop();
+	}
+}
 
-	struct iproto_connection *con;
-	con = rlist_first_entry(&stopped_connections, struct iproto_connection,
-				in_stop_list);
-	ev_feed_event(con->loop, &con->input, EV_READ);
+/* }}} */
+
+static void
+iproto_msg_delete(struct cmsg *m)
+{
+	struct iproto_msg *msg = (struct iproto_msg *) m;
+	struct iproto_thread *iproto_thread = msg->connection->iproto_thread;
+	assert(iproto_thread->lane_msg_count[msg->lane] > 0);
+	iproto_thread->lane_msg_count[msg->lane]--;
+	/* Not handed over to the cache, e.g. the route was cut short. */
+	free(msg->stale_entry);
+	if (iproto_thread->msg_stash_size < IPROTO_MSG_STASH_MAX) {
+		iproto_thread->msg_stash[
+			iproto_thread->msg_stash_size++] = msg;
+	} else {
+		mempool_free(&iproto_thread->iproto_msg_pool, msg);
+	}
+	iproto_resume(iproto_thread);
+}
+
+/**
+ * Returns true if we have enough spare messages
+ * in the message pool and the lane is within its budget.
+ * Disconnect messages are discounted from the pool count:
+ * they are mostly reserved and idle.
+ */
+static inline bool
+iproto_stop_input(struct iproto_thread *iproto_thread, enum iproto_lane lane)
+{
+	size_t connection_count =
+		mempool_count(&iproto_thread->iproto_connection_pool);
+	/* Stashed messages are free, not in flight. */
+	size_t request_count = mempool_count(&iproto_thread->iproto_msg_pool) -
+		iproto_thread->msg_stash_size;
+	if (request_count > connection_count + IPROTO_MSG_MAX)
+		return true;
+	return iproto_thread->lane_msg_count[lane] > iproto_lane_msg_max[lane];
+}
+
+/**
+ * Throttle the queue to the tx thread and ensure the fiber pool
+ * in tx thread is not depleted by a flood of incoming requests:
+ * resume a stopped connection only if its lane has a spare slot
+ * in its in-flight budget.
+ */
+static void
+iproto_resume(struct iproto_thread *iproto_thread)
+{
+	for (int lane = 0; lane < IPROTO_LANE_MAX; lane++) {
+		/*
+		 * Most of the time we have nothing to do here:
+		 * throttling is not active.
+		 */
+		if (rlist_empty(&iproto_thread->stopped_connections[lane]))
+			continue;
+		if (iproto_stop_input(iproto_thread, (enum iproto_lane) lane))
+			continue;
+
+		struct iproto_connection *con;
+		con = rlist_first_entry(
+			&iproto_thread->stopped_connections[lane],
+			struct iproto_connection, in_stop_list);
+		ev_feed_event(con->loop, &con->input, EV_READ);
+	}
 }
 
 /**
@@ -264,7 +845,8 @@ iproto_connection_stop(struct iproto_connection *con)
 {
 	assert(rlist_empty(&con->in_stop_list));
 	ev_io_stop(con->loop, &con->input);
-	rlist_add_tail(&stopped_connections, &con->in_stop_list);
+	rlist_add_tail(&con->iproto_thread->stopped_connections[con->lane],
+		       &con->in_stop_list);
 }
 
 static void
@@ -274,6 +856,133 @@ static void
 iproto_connection_on_output(ev_loop * /* loop */, struct ev_io *watcher,
 			    int /* revents */);
 
+/**
+ * Schedule a flush of the connection output. If the output
+ * watcher is active, the socket is not writable and the watcher
+ * will flush as soon as it is; otherwise put the connection in
+ * flush_queue, to be written out at the end of the current loop
+ * iteration together with the output of other connections.
+ */
+static inline void
+iproto_connection_feed_output(struct iproto_connection *con)
+{
+	assert(evio_has_fd(&con->output));
+	if (ev_is_active(&con->output))
+		return;
+	if (rlist_empty(&con->in_flush_list))
+		rlist_add_tail(&con->iproto_thread->flush_queue,
+			       &con->in_flush_list);
+}
+
+/**
+ * The flow control handshake of a streamed select: carries the
+ * boundary of a finished chunk from tx to net and, once the
+ * window has room, travels back to wake up the producing fiber.
+ * Lives on the stack of that fiber - it sleeps until the message
+ * returns, so the lifetime is covered.
+ */
+struct iproto_stream_flush: public cmsg
+{
+	struct iproto_connection *connection;
+	/** The iobuf holding the streamed response. */
+	struct iobuf *iobuf;
+	/** New response stream boundary, becomes obuf wend. */
+	struct obuf_svp write_end;
+	/** The tx fiber to wake up when the window opens. */
+	struct fiber *caller;
+	/** Link in connection->stream_flush_list. */
+	struct rlist in_stream_list;
+	/** Set by net when the window has room again. */
+	bool done;
+	/** Set by net if the client is gone. */
+	bool closed;
+};
+
+/**
+ * Acknowledge pending stream flushes whose flow control window
+ * has room again - or all of them, if the client is gone. Called
+ * on every write progress of the connection.
+ */
+static void
+iproto_stream_ack(struct iproto_connection *con)
+{
+	while (! rlist_empty(&con->stream_flush_list)) {
+		struct iproto_stream_flush *flush =
+			rlist_first_entry(&con->stream_flush_list,
+					  struct iproto_stream_flush,
+					  in_stream_list);
+		if (evio_has_fd(&con->output)) {
+			struct obuf *out = &flush->iobuf->out;
+			if (out->wend.used - out->wpos.used >
+			    con->stream_window)
+				break;
+		} else {
+			flush->closed = true;
+		}
+		rlist_del(&flush->in_stream_list);
+		cmsg_init(flush, con->iproto_thread->stream_ack_route);
+		cpipe_push(&con->iproto_thread->tx_pipe, flush);
+	}
+}
+
+/** First leg of the handshake, runs in the net thread. */
+static void
+net_flush_chunk(struct cmsg *m)
+{
+	struct iproto_stream_flush *flush = (struct iproto_stream_flush *) m;
+	struct iproto_connection *con = flush->connection;
+	struct obuf *out = &flush->iobuf->out;
+	if (evio_has_fd(&con->output)) {
+		/*
+		 * wend may only move forward: a response which
+		 * completed while the stream was producing may
+		 * have advanced it beyond this chunk already.
+		 */
+		if (flush->write_end.used > out->wend.used)
+			out->wend = flush->write_end;
+		iproto_connection_feed_output(con);
+	}
+	rlist_add_tail(&con->stream_flush_list, &flush->in_stream_list);
+	iproto_stream_ack(con);
+}
+
+/** Return leg of the handshake, runs in tx. */
+static void
+tx_stream_ack(struct cmsg *m)
+{
+	struct iproto_stream_flush *flush = (struct iproto_stream_flush *) m;
+	flush->done = true;
+	fiber_wakeup(flush->caller);
+}
+
+/**
+ * Hand a finished chunk over to the net thread and sleep until
+ * it reports that the flow control window has room for the next
+ * one.
+ * @retval  0 go on producing
+ * @retval -1 the client is gone, abandon the stream
+ */
+static int
+tx_stream_wait_flush(struct iproto_msg *msg, struct obuf_svp write_end)
+{
+	struct iproto_connection *con = msg->connection;
+	struct iproto_stream_flush flush;
+	flush.connection = con;
+	flush.iobuf = msg->iobuf;
+	flush.write_end = write_end;
+	flush.caller = fiber();
+	flush.done = false;
+	flush.closed = false;
+	cmsg_init(&flush, con->iproto_thread->stream_flush_route);
+	cpipe_push(&con->iproto_thread->net_pipe, &flush);
+	while (! flush.done)
+		fiber_yield();
+	return flush.closed ? -1 : 0;
+}
+
+static void
+iproto_stale_purge(struct iproto_connection *con);
+
 /** Recycle a connection. Never throws. */
 static inline void
 iproto_connection_delete(struct iproto_connection *con)
@@ -288,32 +997,249 @@ iproto_connection_delete(struct iproto_connection *con)
 	 */
 	iobuf_delete_mt(con->iobuf[0]);
 	iobuf_delete_mt(con->iobuf[1]);
+	ibuf_destroy(&con->zbuf);
+	if (con->zctx != NULL)
+		ZSTD_freeCCtx(con->zctx);
 	if (con->disconnect)
 		iproto_msg_delete(con->disconnect);
-	mempool_free(&iproto_connection_pool, con);
+	iproto_stale_purge(con);
+	mempool_free(&con->iproto_thread->iproto_connection_pool, con);
+}
+
+static void
+tx_process_misc(struct cmsg *msg);
+static void
+tx_process1(struct cmsg *msg);
+static void
+tx_process_select(struct cmsg *msg);
+static void
+net_send_msg(struct cmsg *msg);
+
+static void
+tx_process_join_subscribe(struct cmsg *msg);
+static void
+net_end_join_subscribe(struct cmsg *msg);
+static void
+net_end_compression(struct cmsg *msg);
+static void
+net_end_stream(struct cmsg *msg);
+
+/* {{{ Stale read cache ******************************************/
+
+/*
+ * Spaces may declare a staleness budget with the stale_read_ttl
+ * space option. Select responses from such spaces are kept in a
+ * per-net-thread direct-mapped cache, and a repeated identical
+ * select from the same connection is answered right in the net
+ * cord - no tx round trip, no tuple access - as long as the
+ * cached response is younger than the TTL and neither the schema
+ * nor any user or privilege has changed since (both versions are
+ * carried by the schema view and compared on every hit).
+ * Repeated hot-key reads thus scale with the
+ * number of net threads while the tx cord serves only the
+ * misses. Memtx data structures are never touched outside tx:
+ * what is shared is the encoded response bytes, which are
+ * immutable, and the schema views of schema.cc, which are
+ * lock-free by design.
+ */
+
+/** FNV-1a over the key bytes, seeded with the connection. */
+static uint32_t
+iproto_stale_hash(const struct iproto_connection *con, const char *key,
+		  uint32_t key_len)
+{
+	uint32_t h = 2166136261u ^ (uint32_t) (uintptr_t) con;
+	for (uint32_t i = 0; i < key_len; i++)
+		h = (h ^ (unsigned char) key[i]) * 16777619u;
+	return h;
+}
+
+/**
+ * Look up the staleness budget of the select's space in the
+ * current schema view. Runs in the net thread at decode time.
+ */
+static void
+iproto_stale_mark(struct iproto_msg *msg)
+{
+	struct schema_view *view = schema_view_get();
+	const struct schema_view_space *space =
+		schema_view_find(view, msg->request.space_id);
+	if (space != NULL && space->stale_ttl > 0)
+		msg->stale_ttl = space->stale_ttl;
+	schema_view_put(view);
+}
+
+/**
+ * Try to answer a freshly decoded select from the cache. Serving
+ * means appending to the connection's output buffer from the net
+ * thread, which is only safe while tx has no response of this
+ * connection in flight - so a hit is attempted only when the
+ * request is the sole unanswered one. Pipelined traffic falls
+ * through to tx and still warms the cache.
+ *
+ * @retval true  The response is in the output buffer and the
+ *               message is disposed of.
+ * @retval false Not served: pass the message on to tx.
+ */
+static bool
+iproto_stale_serve(struct iproto_connection *con, struct iproto_msg *msg,
+		   struct ibuf *in, const char *reqstart)
+{
+	if (msg->stale_ttl <= 0)
+		return false;
+	if (in->rpos != reqstart ||
+	    ibuf_used(&con->iobuf[1]->in) != 0 ||
+	    con->stream_window > 0)
+		return false;
+	const char *key = (const char *) msg->header.body[0].iov_base;
+	uint32_t key_len = msg->header.body[0].iov_len;
+	struct iproto_thread *iproto_thread = con->iproto_thread;
+	struct iproto_stale_entry *entry = iproto_thread->stale_cache[
+		iproto_stale_hash(con, key, key_len) % IPROTO_STALE_SLOTS];
+	if (entry == NULL || entry->connection != con ||
+	    entry->key_len != key_len ||
+	    memcmp(entry->payload, key, key_len) != 0)
+		return false;
+	if (clock_fast() > entry->expires)
+		return false;
+	struct schema_view *view = schema_view_get();
+	uint32_t version = view->version;
+	uint32_t user_version = view->user_cache_version;
+	schema_view_put(view);
+	if (entry->schema_version != version ||
+	    entry->user_cache_version != user_version)
+		return false;
+	struct obuf *out = &msg->iobuf->out;
+	char *reply = (char *) obuf_alloc(out, entry->data_len);
+	if (reply == NULL)
+		return false; /* Let tx answer and report OOM. */
+	memcpy(reply, entry->payload + entry->key_len, entry->data_len);
+	iproto_reply_reset_sync(reply, msg->header.sync);
+	msg->write_end = obuf_create_svp(out);
+	net_send_msg(msg);
+	return true;
+}
+
+/** Insert an entry built by tx. Runs in the owning net thread. */
+static void
+iproto_stale_store(struct iproto_thread *iproto_thread,
+		   struct iproto_stale_entry *entry)
+{
+	uint32_t slot = iproto_stale_hash(entry->connection, entry->payload,
+					  entry->key_len) %
+			IPROTO_STALE_SLOTS;
+	free(iproto_thread->stale_cache[slot]);
+	iproto_thread->stale_cache[slot] = entry;
+}
+
+/**
+ * Drop the entries of a connection. Called when the connection
+ * closes - the connection object is recycled through a pool, and
+ * a lookup by its next occupant must not hit responses served to
+ * the previous one - and when it re-authenticates, since the
+ * entries were built under the credentials of the old user.
+ */
+static void
+iproto_stale_purge(struct iproto_connection *con)
+{
+	struct iproto_thread *iproto_thread = con->iproto_thread;
+	for (int i = 0; i < IPROTO_STALE_SLOTS; i++) {
+		struct iproto_stale_entry *entry =
+			iproto_thread->stale_cache[i];
+		if (entry != NULL && entry->connection == con) {
+			free(entry);
+			iproto_thread->stale_cache[i] = NULL;
+		}
+	}
 }
 
+/**
+ * Copy the encoded select reply into a cache entry. Runs in tx
+ * right after the reply is written to the output buffer; the net
+ * thread inserts the entry when the message returns to it.
+ * Failure to cache is never an error.
+ */
 static void
-tx_process_misc(struct cmsg *msg);
-static void
-tx_process1(struct cmsg *msg);
-static void
-tx_process_select(struct cmsg *msg);
-static void
-net_send_msg(struct cmsg *msg);
+tx_stale_capture(struct iproto_msg *msg, struct obuf *out,
+		 struct obuf_svp *svp)
+{
+	size_t data_len = obuf_size(out) - svp->used;
+	if (data_len > IPROTO_STALE_MAX_REPLY)
+		return;
+	uint32_t key_len = msg->header.body[0].iov_len;
+	struct iproto_stale_entry *entry = (struct iproto_stale_entry *)
+		malloc(sizeof(*entry) + key_len + data_len);
+	if (entry == NULL)
+		return;
+	entry->connection = msg->connection;
+	entry->schema_version = schema_version;
+	entry->user_cache_version = user_cache_version;
+	entry->expires = clock_fast() + msg->stale_ttl;
+	entry->key_len = key_len;
+	entry->data_len = data_len;
+	memcpy(entry->payload, msg->header.body[0].iov_base, key_len);
+	/* The reply may span several output buffer chunks. */
+	char *data = entry->payload + key_len;
+	size_t copied = 0;
+	for (size_t i = svp->pos; copied < data_len; i++) {
+		size_t offset = i == svp->pos ? svp->iov_len : 0;
+		size_t size = out->iov[i].iov_len - offset;
+		if (size > data_len - copied)
+			size = data_len - copied;
+		memcpy(data + copied,
+		       (const char *) out->iov[i].iov_base + offset, size);
+		copied += size;
+	}
+	msg->stale_entry = entry;
+}
 
-static void
-tx_process_join_subscribe(struct cmsg *msg);
-static void
-net_end_join_subscribe(struct cmsg *msg);
+/* }}} */
 
 static void
 tx_fiber_init(struct session *session, uint64_t sync)
 {
 	session->sync = sync;
+	/* Arm the per-request deadline, if the session has one. */
+	session->deadline = session->request_timeout > 0 ?
+			    fiber_time() + session->request_timeout : 0;
 	fiber_set_session(fiber(), session);
 }
 
+/** Stamp the tx-processing-started stage of a sampled request. */
+static inline void
+tx_msg_trace_tx(struct iproto_msg *msg)
+{
+	if (msg->trace)
+		msg->trace_tx = clock_fast();
+	if (unlikely(iproto_capture_enabled))
+		iproto_capture_record(msg);
+	alloc_stat_begin(msg->header.type);
+	msg->alloc_region_svp = region_used(&fiber()->gc);
+}
+
+/**
+ * Stamp the tx-processing-finished stage and account the request
+ * in the latency histograms. The cost per request is one clock
+ * read and a short binary search.
+ */
+static inline void
+tx_msg_trace_done(struct iproto_msg *msg)
+{
+	double now = clock_fast();
+	if (msg->trace)
+		msg->trace_done = now;
+	iproto_latency_collect(msg->header.type, now - msg->trace_recv, now);
+	/*
+	 * Leftover region growth; what a transaction consumed was
+	 * accounted in txn_commit()/txn_rollback() right before
+	 * fiber_gc() emptied the region, hence the clamp.
+	 */
+	size_t region_now = region_used(&fiber()->gc);
+	if (region_now > msg->alloc_region_svp)
+		alloc_stat_account_region(region_now - msg->alloc_region_svp);
+	alloc_stat_end();
+}
+
 /**
  * Fire on_disconnect triggers in the tx
  * thread and destroy the session object,
@@ -352,51 +1278,14 @@ net_finish_disconnect(struct cmsg *m)
 	iproto_msg_delete(msg);
 }
 
-static const struct cmsg_hop disconnect_route[] = {
-	{ tx_process_disconnect, &net_pipe },
-	{ net_finish_disconnect, NULL },
-};
-
-static const struct cmsg_hop misc_route[] = {
-	{ tx_process_misc, &net_pipe },
-	{ net_send_msg, NULL },
-};
-
-static const struct cmsg_hop select_route[] = {
-	{ tx_process_select, &net_pipe },
-	{ net_send_msg, NULL },
-};
-
-static const struct cmsg_hop process1_route[] = {
-	{ tx_process1, &net_pipe },
-	{ net_send_msg, NULL },
-};
-
-static const struct cmsg_hop *dml_route[IPROTO_TYPE_STAT_MAX] = {
-	NULL,                                   /* IPROTO_OK */
-	select_route,                           /* IPROTO_SELECT */
-	process1_route,                         /* IPROTO_INSERT */
-	process1_route,                         /* IPROTO_REPLACE */
-	process1_route,                         /* IPROTO_UPDATE */
-	process1_route,                         /* IPROTO_DELETE */
-	misc_route,                             /* IPROTO_CALL_16 */
-	misc_route,                             /* IPROTO_AUTH */
-	misc_route,                             /* IPROTO_EVAL */
-	process1_route,                         /* IPROTO_UPSERT */
-	misc_route                              /* IPROTO_CALL */
-};
-
-static const struct cmsg_hop sync_route[] = {
-	{ tx_process_join_subscribe, &net_pipe },
-	{ net_end_join_subscribe, NULL },
-};
-
 static struct iproto_connection *
-iproto_connection_new(const char *name, int fd)
+iproto_connection_new(struct iproto_thread *iproto_thread, const char *name,
+		      int fd)
 {
 	(void) name;
 	struct iproto_connection *con = (struct iproto_connection *)
-		mempool_alloc_xc(&iproto_connection_pool);
+		mempool_alloc_xc(&iproto_thread->iproto_connection_pool);
+	con->iproto_thread = iproto_thread;
 	con->input.data = con->output.data = con;
 	con->loop = loop();
 	ev_io_init(&con->input, iproto_connection_on_input, fd, EV_READ);
@@ -405,10 +1294,19 @@ iproto_connection_new(const char *name, int fd)
 	con->iobuf[1] = iobuf_new_mt(&tx_cord->slabc);
 	con->parse_size = 0;
 	con->session = NULL;
+	con->partial_iobuf = NULL;
+	con->zstd_level = 0;
+	con->zctx = NULL;
+	/* Note: does not allocate memory upfront. */
+	ibuf_create(&con->zbuf, &cord()->slabc, 16320);
+	con->lane = IPROTO_LANE_NORMAL;
+	con->stream_window = 0;
+	rlist_create(&con->stream_flush_list);
 	rlist_create(&con->in_stop_list);
+	rlist_create(&con->in_flush_list);
 	/* It may be very awkward to allocate at close. */
 	con->disconnect = iproto_msg_new(con);
-	cmsg_init(con->disconnect, disconnect_route);
+	cmsg_init(con->disconnect, iproto_thread->disconnect_route);
 	return con;
 }
 
@@ -436,6 +1334,11 @@ iproto_connection_close(struct iproto_connection *con)
 		 * is done only once.
 		 */
 		con->iobuf[0]->in.wpos -= con->parse_size;
+		/*
+		 * Unblock the tx fibers streaming into this
+		 * connection, or their requests never finish.
+		 */
+		iproto_stream_ack(con);
 	}
 	/*
 	 * If the connection has no outstanding requests in the
@@ -453,9 +1356,10 @@ iproto_connection_close(struct iproto_connection *con)
 		assert(con->disconnect != NULL);
 		struct iproto_msg *msg = con->disconnect;
 		con->disconnect = NULL;
-		cpipe_push(&tx_pipe, msg);
+		cpipe_push(&con->iproto_thread->tx_pipe, msg);
 	}
 	rlist_del(&con->in_stop_list);
+	rlist_del(&con->in_flush_list);
 }
 
 /**
@@ -555,8 +1459,23 @@ static void
 iproto_decode_msg(struct iproto_msg *msg, const char **pos, const char *reqend,
 		  bool *stop_input)
 {
+	struct iproto_thread *iproto_thread = msg->connection->iproto_thread;
 	xrow_header_decode_xc(&msg->header, pos, reqend);
 	assert(*pos == reqend);
+	/* Always stamped: the latency histograms start here. */
+	msg->trace_recv = clock_fast();
+	uint32_t trace_rate = iproto_trace_get_rate();
+	if (trace_rate > 0 && ++iproto_trace_counter >= trace_rate) {
+		iproto_trace_counter = 0;
+		msg->trace = true;
+		/*
+		 * Pre-fill the tx stamps: a route which does not
+		 * stamp them reports zero-length stages instead
+		 * of garbage.
+		 */
+		msg->trace_tx = msg->trace_recv;
+		msg->trace_done = msg->trace_recv;
+	}
 	request_create(&msg->request, msg->header.type);
 	msg->request.header = &msg->header;
 
@@ -586,15 +1505,34 @@ iproto_decode_msg(struct iproto_msg *msg, const char **pos, const char *reqend,
 				 (const char *) msg->header.body[0].iov_base,
 				 msg->header.body[0].iov_len,
 				 request_key_map(msg->header.type));
-		assert(msg->header.type < sizeof(dml_route)/sizeof(*dml_route));
-		cmsg_init(msg, dml_route[msg->header.type]);
+		if (msg->header.type == IPROTO_SELECT)
+			iproto_stale_mark(msg);
+		assert(msg->header.type < sizeof(iproto_thread->dml_route) /
+		       sizeof(*iproto_thread->dml_route));
+		cmsg_init(msg, iproto_thread->dml_route[msg->header.type]);
 		break;
 	case IPROTO_PING:
-		cmsg_init(msg, misc_route);
+		cmsg_init(msg, iproto_thread->misc_route);
+		break;
+	case IPROTO_COMPRESSION:
+		if (iproto_compression_level == 0) {
+			tnt_raise(ClientError, ER_UNSUPPORTED,
+				  "iproto", "response compression");
+		}
+		cmsg_init(msg, iproto_thread->compression_route);
+		break;
+	case IPROTO_LOW_PRIORITY:
+		cmsg_init(msg, iproto_thread->priority_route);
+		break;
+	case IPROTO_STREAM:
+		cmsg_init(msg, iproto_thread->stream_route);
+		break;
+	case IPROTO_CHECKPOINT:
+		cmsg_init(msg, iproto_thread->misc_route);
 		break;
 	case IPROTO_JOIN:
 	case IPROTO_SUBSCRIBE:
-		cmsg_init(msg, sync_route);
+		cmsg_init(msg, iproto_thread->sync_route);
 		*stop_input = true;
 		break;
 	default:
@@ -604,8 +1542,12 @@ iproto_decode_msg(struct iproto_msg *msg, const char **pos, const char *reqend,
 	}
 }
 
-/** Enqueue all requests which were read up. */
-static inline void
+/**
+ * Enqueue all requests which were read up.
+ * @retval true input was stopped (JOIN/SUBSCRIBE), the caller
+ *              must not touch the socket anymore.
+ */
+static inline bool
 iproto_enqueue_batch(struct iproto_connection *con, struct ibuf *in)
 {
 	int n_requests = 0;
@@ -632,8 +1574,14 @@ iproto_enqueue_batch(struct iproto_connection *con, struct ibuf *in)
 
 		try {
 			iproto_decode_msg(msg, &pos, reqend, &stop_input);
-			cpipe_push_input(&tx_pipe, guard.release());
-			n_requests++;
+			if (iproto_stale_serve(con, msg, in, reqstart)) {
+				/* Answered from the net cord cache. */
+				guard.release();
+			} else {
+				cpipe_push_input(&con->iproto_thread->tx_pipe,
+						 guard.release());
+				n_requests++;
+			}
 		} catch (Exception *e) {
 			/*
 			 * Do not close connection if we failed to
@@ -643,8 +1591,7 @@ iproto_enqueue_batch(struct iproto_connection *con, struct ibuf *in)
 			struct obuf *out = &msg->iobuf->out;
 			iproto_reply_error(out, e, msg->header.sync);
 			out->wend = obuf_create_svp(out);
-			if (!ev_is_active(&con->output))
-				ev_feed_event(con->loop, &con->output, EV_WRITE);
+			iproto_connection_feed_output(con);
 			e->log();
 		}
 
@@ -669,6 +1616,7 @@ iproto_enqueue_batch(struct iproto_connection *con, struct ibuf *in)
 		 */
 		ev_io_stop(con->loop, &con->output);
 		ev_io_stop(con->loop, &con->input);
+		rlist_del(&con->in_flush_list);
 	} else if (n_requests != 1 || con->parse_size != 0) {
 		assert(rlist_empty(&con->in_stop_list));
 		/*
@@ -690,7 +1638,8 @@ iproto_enqueue_batch(struct iproto_connection *con, struct ibuf *in)
 		 */
 		ev_feed_event(con->loop, &con->input, EV_READ);
 	}
-	cpipe_flush_input(&tx_pipe);
+	cpipe_flush_input(&con->iproto_thread->tx_pipe);
+	return stop_input;
 }
 
 static void
@@ -709,7 +1658,7 @@ iproto_connection_on_input(ev_loop *loop, struct ev_io *watcher,
 		 * resume one more connection which might have
 		 * input.
 		 */
-		iproto_resume();
+		iproto_resume(con->iproto_thread);
 	}
 	/*
 	 * Throttle if there are too many pending requests,
@@ -718,38 +1667,71 @@ iproto_connection_on_input(ev_loop *loop, struct ev_io *watcher,
 	 * another fiber waiting for write to complete).
 	 * Ignore iproto_connection->disconnect messages.
 	 */
-	if (iproto_stop_input()) {
+	if (iproto_stop_input(con->iproto_thread, con->lane)) {
 		iproto_connection_stop(con);
 		return;
 	}
 
 	try {
-		/* Ensure we have sufficient space for the next round.  */
-		struct iobuf *iobuf = iproto_connection_input_iobuf(con);
-		if (iobuf == NULL) {
-			ev_io_stop(loop, &con->input);
-			return;
-		}
+		size_t budget = IPROTO_INPUT_BUDGET;
+		while (true) {
+			/* Ensure we have sufficient space for the next round. */
+			struct iobuf *iobuf = iproto_connection_input_iobuf(con);
+			if (iobuf == NULL) {
+				ev_io_stop(loop, &con->input);
+				return;
+			}
 
-		struct ibuf *in = &iobuf->in;
-		/* Read input. */
-		int nrd = sio_read(fd, in->wpos, ibuf_unused(in));
-		if (nrd < 0) {                  /* Socket is not ready. */
-			ev_io_start(loop, &con->input);
-			return;
-		}
-		if (nrd == 0) {                 /* EOF */
-			iproto_connection_close(con);
-			return;
+			struct ibuf *in = &iobuf->in;
+			/* Read input. */
+			size_t avail = ibuf_unused(in);
+			int nrd = sio_read(fd, in->wpos, avail);
+			if (nrd < 0) {          /* Socket is not ready. */
+				ev_io_start(loop, &con->input);
+				return;
+			}
+			if (nrd == 0) {         /* EOF */
+				iproto_connection_close(con);
+				return;
+			}
+			/* Count statistics */
+			rmean_collect(con->iproto_thread->rmean_net,
+				      IPROTO_RECEIVED, nrd);
+
+			/* Update the read position and connection state. */
+			in->wpos += nrd;
+			con->parse_size += nrd;
+			/* Enqueue all requests which are fully read up. */
+			if (iproto_enqueue_batch(con, in))
+				return;
+			/*
+			 * A short read has drained the socket: an extra
+			 * read() ending with EAGAIN would be wasted, the
+			 * event loop tells us when more data arrives. A
+			 * read which filled all the available space has
+			 * likely left bytes in the socket buffer - keep
+			 * draining, it is much cheaper than carrying
+			 * each readahead of a bulk stream through a
+			 * separate event loop iteration.
+			 */
+			if ((size_t) nrd < avail)
+				return;
+			if ((size_t) nrd >= budget) {
+				/*
+				 * Be fair to the other connections:
+				 * yield and take the rest via the
+				 * posted read event.
+				 */
+				ev_feed_event(loop, &con->input, EV_READ);
+				return;
+			}
+			budget -= nrd;
+			/* Re-check the throttle between the reads. */
+			if (iproto_stop_input(con->iproto_thread, con->lane)) {
+				iproto_connection_stop(con);
+				return;
+			}
 		}
-		/* Count statistics */
-		rmean_collect(rmean_net, IPROTO_RECEIVED, nrd);
-
-		/* Update the read position and connection state. */
-		in->wpos += nrd;
-		con->parse_size += nrd;
-		/* Enqueue all requests which are fully read up. */
-		iproto_enqueue_batch(con, in);
 	} catch (Exception *e) {
 		/* Best effort at sending the error message to the client. */
 		iproto_write_error(fd, e);
@@ -762,26 +1744,123 @@ iproto_connection_on_input(ev_loop *loop, struct ev_io *watcher,
 static inline struct iobuf *
 iproto_connection_output_iobuf(struct iproto_connection *con)
 {
+	/*
+	 * A partially sent response must be finished before
+	 * switching to the other buffer, or the client would
+	 * end up getting a salad of different pieces of replies
+	 * from both buffers.
+	 */
+	struct iobuf *partial = con->partial_iobuf;
+	if (partial != NULL && obuf_used(&partial->out) > 0)
+		return partial;
 	if (obuf_used(&con->iobuf[1]->out) > 0)
 		return con->iobuf[1];
 	/*
-	 * Don't try to write from a newer buffer if an older one
-	 * exists: in case of a partial write of a newer buffer,
-	 * the client may end up getting a salad of different
-	 * pieces of replies from both buffers.
+	 * Output of the newer buffer is flushed as soon as it is
+	 * ready, even while requests from the older buffer are
+	 * still being processed: the client matches responses by
+	 * sync, not by order, so a slow request does not hold
+	 * back the replies to the fast ones which came after it.
 	 */
-	if (ibuf_used(&con->iobuf[1]->in) == 0 &&
-	    obuf_used(&con->iobuf[0]->out) > 0)
+	if (obuf_used(&con->iobuf[0]->out) > 0)
 		return con->iobuf[0];
 	return NULL;
 }
 
+/**
+ * Compress the output batch gathered in iov into a single
+ * envelope in con->zbuf.
+ * @retval 0  the envelope is ready in con->zbuf
+ * @retval -1 failed - send the plain output instead, compression
+ *            is an optimization, not an obligation
+ */
+static int
+iproto_compress_output(struct iproto_connection *con, struct iovec *iov,
+		       int iovcnt)
+{
+	struct ibuf *zbuf = &con->zbuf;
+	assert(ibuf_used(zbuf) == 0);
+	if (ibuf_alloc(zbuf, sizeof(struct iproto_zstd_bin)) == NULL)
+		return -1;
+	ZSTD_compressBegin(con->zctx, con->zstd_level);
+	uint32_t frame_size = 0;
+	struct iproto_zstd_bin *fix;
+	for (int i = 0; i < iovcnt; ++i) {
+		/* Estimate max output buffer size. */
+		size_t zmax_size = ZSTD_compressBound(iov[i].iov_len);
+		/* Allocate a destination buffer. */
+		void *zdst = ibuf_reserve(zbuf, zmax_size);
+		if (zdst == NULL)
+			goto fallback;
+		size_t (*fcompress)(ZSTD_CCtx *, void *, size_t,
+				    const void *, size_t);
+		/* End the frame on the last iov. */
+		if (i == iovcnt - 1)
+			fcompress = ZSTD_compressEnd;
+		else
+			fcompress = ZSTD_compressContinue;
+		size_t zsize = fcompress(con->zctx, zdst, zmax_size,
+					 iov[i].iov_base, iov[i].iov_len);
+		if (ZSTD_isError(zsize))
+			goto fallback;
+		/* Advance the buffer to the end of compressed data. */
+		ibuf_alloc(zbuf, zsize);
+		frame_size += zsize;
+	}
+	/*
+	 * The buffer may have been reallocated while growing, so
+	 * take a fresh pointer to the envelope prefix.
+	 */
+	fix = (struct iproto_zstd_bin *) zbuf->rpos;
+	fix->m_len = 0xce;
+	fix->v_len = mp_bswap_u32(sizeof(*fix) - 5 + frame_size);
+	fix->m_header = 0x81;
+	fix->k_type = IPROTO_REQUEST_TYPE;
+	fix->v_type = IPROTO_COMPRESSION;
+	fix->m_body = 0x81;
+	fix->k_data = IPROTO_DATA;
+	fix->m_data = 0xc6;
+	fix->v_data_len = mp_bswap_u32(frame_size);
+	return 0;
+fallback:
+	ibuf_reset(zbuf);
+	return -1;
+}
+
+/**
+ * Write out the pending compressed envelope.
+ * @retval 0  the envelope is fully sent
+ * @retval -1 the socket buffer is full
+ */
+static int
+iproto_flush_zbuf(struct iproto_connection *con)
+{
+	struct ibuf *zbuf = &con->zbuf;
+	ssize_t nwr = sio_write(con->output.fd, zbuf->rpos, ibuf_used(zbuf));
+	if (nwr > 0) {
+		/* Count statistics: bytes on the wire. */
+		rmean_collect(con->iproto_thread->rmean_net, IPROTO_SENT,
+			      nwr);
+		zbuf->rpos += nwr;
+	}
+	if (ibuf_used(zbuf) > 0)
+		return -1;
+	ibuf_reset(zbuf);
+	return 0;
+}
+
 /** writev() to the socket and handle the result. */
 
 static int
 iproto_flush(struct iobuf *iobuf, struct iproto_connection *con)
 {
 	int fd = con->output.fd;
+	/*
+	 * An envelope left over from the previous flush frames the
+	 * head of the response stream and must leave first.
+	 */
+	if (ibuf_used(&con->zbuf) > 0 && iproto_flush_zbuf(con) != 0)
+		return -1;
 	struct obuf_svp *begin = &iobuf->out.wpos;
 	struct obuf_svp *end = &iobuf->out.wend;
 	assert(begin->used < end->used);
@@ -797,12 +1876,43 @@ iproto_flush(struct iobuf *iobuf, struct iproto_connection *con)
 	/* *Overwrite* iov_len of the last pos as it may be garbage. */
 	iov[iovcnt-1].iov_len = end->iov_len - begin->iov_len * (iovcnt == 1);
 
-	ssize_t nwr = sio_writev(fd, iov, iovcnt);
+	if (con->zstd_level > 0 &&
+	    end->used - begin->used >= IPROTO_COMPRESSION_THRESHOLD &&
+	    iproto_compress_output(con, iov, iovcnt) == 0) {
+		/*
+		 * The plain output now lives on in the envelope:
+		 * consume it from the buffer and send the envelope
+		 * instead.
+		 */
+		con->partial_iobuf = NULL;
+		if (ibuf_used(&iobuf->in) == 0) {
+			/* Quickly recycle the buffer if it's idle. */
+			assert(end->used == obuf_size(&iobuf->out));
+			iobuf_reset_mt(iobuf);
+		} else {
+			/* Advance write position. */
+			*begin = *end;
+		}
+		return iproto_flush_zbuf(con);
+	}
+
+	/*
+	 * If the other buffer has pending output too, another
+	 * writev() follows right away: hint the kernel to hold a
+	 * short trailing segment until it can be coalesced with
+	 * the next batch rather than push it out immediately
+	 * (TCP_NODELAY is set on the socket).
+	 */
+	struct iobuf *other = iobuf == con->iobuf[0] ?
+			      con->iobuf[1] : con->iobuf[0];
+	int flags = obuf_used(&other->out) > 0 ? SIO_FLAG_MORE : 0;
+	ssize_t nwr = sio_writev_flags(fd, iov, iovcnt, flags);
 
 	/* Count statistics */
-	rmean_collect(rmean_net, IPROTO_SENT, nwr);
+	rmean_collect(con->iproto_thread->rmean_net, IPROTO_SENT, nwr);
 	if (nwr > 0) {
 		if (begin->used + nwr == end->used) {
+			con->partial_iobuf = NULL;
 			if (ibuf_used(&iobuf->in) == 0) {
 				/* Quickly recycle the buffer if it's idle. */
 				assert(end->used == obuf_size(&iobuf->out));
@@ -822,6 +1932,8 @@ iproto_flush(struct iobuf *iobuf, struct iproto_connection *con)
 		begin->pos += advance;
 		assert(begin->pos <= end->pos);
 	}
+	/* The write position may be in the middle of a response. */
+	con->partial_iobuf = iobuf;
 	return -1;
 }
 
@@ -834,7 +1946,13 @@ iproto_connection_on_output(ev_loop *loop, struct ev_io *watcher,
 	try {
 		struct iobuf *iobuf;
 		while ((iobuf = iproto_connection_output_iobuf(con))) {
-			if (iproto_flush(iobuf, con) < 0) {
+			int rc = iproto_flush(iobuf, con);
+			/*
+			 * Even a partial write may have opened the
+			 * stream flow control window.
+			 */
+			iproto_stream_ack(con);
+			if (rc < 0) {
 				ev_io_start(loop, &con->output);
 				return;
 			}
@@ -843,6 +1961,16 @@ iproto_connection_on_output(ev_loop *loop, struct ev_io *watcher,
 				ev_feed_event(loop, &con->input, EV_READ);
 			}
 		}
+		/*
+		 * An envelope may be pending even when both output
+		 * buffers are consumed: compression eats the buffer
+		 * content before the socket accepts it.
+		 */
+		if (ibuf_used(&con->zbuf) > 0 &&
+		    iproto_flush_zbuf(con) != 0) {
+			ev_io_start(loop, &con->output);
+			return;
+		}
 		if (ev_is_active(&con->output))
 			ev_io_stop(con->loop, &con->output);
 	} catch (Exception *e) {
@@ -851,6 +1979,27 @@ iproto_connection_on_output(ev_loop *loop, struct ev_io *watcher,
 	}
 }
 
+/**
+ * Drain flush_queue: one writev() per socket covers all the
+ * responses which completed in this event loop iteration. Runs
+ * right before the loop blocks for I/O, so no response is held
+ * longer than the iteration it was produced in.
+ */
+static void
+iproto_flush_queue_cb(ev_loop *loop, struct ev_prepare *watcher,
+		      int /* revents */)
+{
+	struct iproto_thread *iproto_thread =
+		(struct iproto_thread *) watcher->data;
+	while (! rlist_empty(&iproto_thread->flush_queue)) {
+		struct iproto_connection *con =
+			rlist_shift_entry(&iproto_thread->flush_queue,
+					  struct iproto_connection,
+					  in_flush_list);
+		iproto_connection_on_output(loop, &con->output, EV_WRITE);
+	}
+}
+
 static int
 tx_check_schema(uint32_t new_schema_version)
 {
@@ -869,6 +2018,7 @@ tx_process1(struct cmsg *m)
 	struct obuf *out = &msg->iobuf->out;
 
 	tx_fiber_init(msg->connection->session, msg->header.sync);
+	tx_msg_trace_tx(msg);
 	if (tx_check_schema(msg->header.schema_version))
 		goto error;
 
@@ -882,11 +2032,54 @@ tx_process1(struct cmsg *m)
 	iproto_reply_select(out, &svp, msg->header.sync,
 			    tuple != 0);
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
 	return;
 error:
 	iproto_reply_error(out, diag_last_error(&fiber()->diag),
 			   msg->header.sync);
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
+}
+
+/**
+ * Stream the select result out in IPROTO_CHUNK packets of
+ * roughly iproto_stream_chunk_size bytes, pausing between the
+ * chunks until the net thread reports that the flow control
+ * window has room. The tuples of the last, possibly only, chunk
+ * stay in the buffer: the caller frames them into the ordinary
+ * final reply. Unlike port_dump(), does not consume the port -
+ * the caller destroys it in every outcome.
+ */
+static int
+tx_stream_dump(struct iproto_msg *msg, struct port *port,
+	       struct obuf_svp *svp, uint32_t *count)
+{
+	struct obuf *out = &msg->iobuf->out;
+	*count = 0;
+	for (struct port_entry *e = port->first; e != NULL; e = e->next) {
+		if (tuple_to_obuf(e->tuple, out) != 0) {
+			/*
+			 * Scrap the unframed tail. There was no
+			 * yield since the savepoint, so nothing
+			 * else is rolled back with it.
+			 */
+			obuf_rollback_to_svp(out, svp);
+			return -1;
+		}
+		++*count;
+		if (e->next == NULL ||
+		    obuf_size(out) - svp->used < iproto_stream_chunk_size)
+			continue;
+		iproto_reply_chunk(out, svp, msg->header.sync, *count);
+		if (tx_stream_wait_flush(msg, obuf_create_svp(out)) != 0) {
+			diag_set(ClientError, ER_NO_CONNECTION);
+			return -1;
+		}
+		if (iproto_prepare_select(out, svp) != 0)
+			return -1;
+		*count = 0;
+	}
+	return 0;
 }
 
 static void
@@ -897,9 +2090,11 @@ tx_process_select(struct cmsg *m)
 	struct obuf_svp svp;
 	struct port port;
 	int rc;
+	uint32_t count;
 	struct request *req = &msg->request;
 
 	tx_fiber_init(msg->connection->session, msg->header.sync);
+	tx_msg_trace_tx(msg);
 
 	if (tx_check_schema(msg->header.schema_version))
 		goto error;
@@ -913,14 +2108,27 @@ tx_process_select(struct cmsg *m)
 		port_destroy(&port);
 		goto error;
 	}
-	port_dump(&port, out);
-	iproto_reply_select(out, &svp, msg->header.sync, port.size);
+	if (msg->connection->stream_window > 0) {
+		if (tx_stream_dump(msg, &port, &svp, &count) != 0) {
+			port_destroy(&port);
+			goto error;
+		}
+		port_destroy(&port);
+	} else {
+		port_dump(&port, out);
+		count = port.size;
+	}
+	iproto_reply_select(out, &svp, msg->header.sync, count);
+	if (msg->stale_ttl > 0 && msg->connection->stream_window == 0)
+		tx_stale_capture(msg, out, &svp);
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
 	return;
 error:
 	iproto_reply_error(out, diag_last_error(&fiber()->diag),
 			   msg->header.sync);
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
 }
 
 static void
@@ -930,6 +2138,7 @@ tx_process_misc(struct cmsg *m)
 	struct obuf *out = &msg->iobuf->out;
 
 	tx_fiber_init(msg->connection->session, msg->header.sync);
+	tx_msg_trace_tx(msg);
 
 	if (tx_check_schema(msg->header.schema_version))
 		goto error;
@@ -949,7 +2158,47 @@ tx_process_misc(struct cmsg *m)
 			assert(msg->request.type == msg->header.type);
 			box_process_auth(&msg->request, out);
 			break;
+		case IPROTO_STREAM:
+		{
+			/* Default window: a few chunks in flight. */
+			uint64_t window = 4 * iproto_stream_chunk_size;
+			if (msg->header.bodycnt > 0) {
+				const char *d = (const char *)
+					msg->header.body[0].iov_base;
+				const char *end =
+					d + msg->header.body[0].iov_len;
+				const char *check = d;
+				if (mp_check(&check, end) != 0 ||
+				    mp_typeof(*d) != MP_MAP) {
+					tnt_raise(ClientError,
+						  ER_INVALID_MSGPACK,
+						  "packet body");
+				}
+				uint32_t map_size = mp_decode_map(&d);
+				for (uint32_t i = 0; i < map_size; i++) {
+					if (mp_typeof(*d) != MP_UINT) {
+						mp_next(&d);
+						mp_next(&d);
+						continue;
+					}
+					if (mp_decode_uint(&d) == IPROTO_DATA &&
+					    mp_typeof(*d) == MP_UINT)
+						window = mp_decode_uint(&d);
+					else
+						mp_next(&d);
+				}
+			}
+			msg->stream_window = window;
+			iproto_reply_ok(out, msg->header.sync);
+			break;
+		}
+		case IPROTO_CHECKPOINT:
+			box_process_checkpoint(&msg->header);
+			iproto_reply_ok(out, msg->header.sync);
+			break;
 		case IPROTO_PING:
+		case IPROTO_COMPRESSION:
+		case IPROTO_LOW_PRIORITY:
 			iproto_reply_ok(out, msg->header.sync);
 			break;
 		default:
@@ -960,11 +2209,13 @@ tx_process_misc(struct cmsg *m)
 				   msg->header.sync);
 	}
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
 	return;
 error:
 	iproto_reply_error(out, diag_last_error(&fiber()->diag),
 			   msg->header.sync);
 	msg->write_end = obuf_create_svp(out);
+	tx_msg_trace_done(msg);
 }
 
 static void
@@ -1012,11 +2263,30 @@ net_send_msg(struct cmsg *m)
 	struct iobuf *iobuf = msg->iobuf;
 	/* Discard request (see iproto_enqueue_batch()) */
 	iobuf->in.rpos += msg->len;
-	iobuf->out.wend = msg->write_end;
+	/*
+	 * wend may only move forward: a chunk of a streamed
+	 * select which is still in progress may have advanced it
+	 * beyond the boundary of this response already.
+	 */
+	if (msg->write_end.used > iobuf->out.wend.used)
+		iobuf->out.wend = msg->write_end;
+
+	if (msg->stale_entry != NULL) {
+		iproto_stale_store(con->iproto_thread, msg->stale_entry);
+		msg->stale_entry = NULL;
+	}
+	/*
+	 * After a re-authentication the connection may speak for
+	 * a different user: responses cached under the previous
+	 * credentials must not be replayed to it.
+	 */
+	if (msg->header.type == IPROTO_AUTH)
+		iproto_stale_purge(con);
+	if (msg->trace)
+		iproto_trace_record(msg);
 
 	if (evio_has_fd(&con->output)) {
-		if (! ev_is_active(&con->output))
-			ev_feed_event(con->loop, &con->output, EV_WRITE);
+		iproto_connection_feed_output(con);
 	} else if (iproto_connection_is_idle(con)) {
 		iproto_connection_close(con);
 	}
@@ -1041,6 +2311,52 @@ net_end_join_subscribe(struct cmsg *m)
 	iproto_enqueue_batch(con, &iobuf->in);
 }
 
+/**
+ * Demote the connection to the low-priority admission lane.
+ * Messages already in flight stay accounted in the lane they
+ * were admitted from.
+ */
+static void
+net_end_low_priority(struct cmsg *m)
+{
+	struct iproto_msg *msg = (struct iproto_msg *) m;
+	msg->connection->lane = IPROTO_LANE_LOW;
+	net_send_msg(m);
+}
+
+/**
+ * Turn on response compression once the acknowledgement is in
+ * the output buffer. Requests which were already in flight may
+ * complete after this point and still be sent plain - envelopes
+ * are self-identifying, so the client copes with the mix.
+ */
+static void
+net_end_compression(struct cmsg *m)
+{
+	struct iproto_msg *msg = (struct iproto_msg *) m;
+	struct iproto_connection *con = msg->connection;
+	if (con->zctx == NULL)
+		con->zctx = ZSTD_createCCtx();
+	/* On OOM quietly keep sending plain output. */
+	if (con->zctx != NULL)
+		con->zstd_level = iproto_compression_level;
+	net_send_msg(m);
+}
+
+/**
+ * Turn on streaming of selects once the acknowledgement is in
+ * the output buffer. Selects which were already in flight may
+ * complete after this point and still arrive in one piece -
+ * chunks are self-identifying, so the client copes with the mix.
+ */
+static void
+net_end_stream(struct cmsg *m)
+{
+	struct iproto_msg *msg = (struct iproto_msg *) m;
+	msg->connection->stream_window = msg->stream_window;
+	net_send_msg(m);
+}
+
 /**
  * Handshake a connection: invoke the on-connect trigger
  * and possibly authenticate. Try to send the client an error
@@ -1090,7 +2406,8 @@ net_send_greeting(struct cmsg *m)
 						 obuf_iovcnt(out));
 
 			/* Count statistics */
-			rmean_collect(rmean_net, IPROTO_SENT, nwr);
+			rmean_collect(con->iproto_thread->rmean_net,
+				      IPROTO_SENT, nwr);
 		} catch (Exception *e) {
 			e->log();
 		}
@@ -1107,106 +2424,272 @@ net_send_greeting(struct cmsg *m)
 	 */
 	assert(evio_has_fd(&con->output));
 	/* Handshake OK, start reading input. */
-	ev_feed_event(con->loop, &con->output, EV_WRITE);
+	iproto_connection_feed_output(con);
 	iproto_msg_delete(msg);
 }
 
-static const struct cmsg_hop connect_route[] = {
-	{ tx_process_connect, &net_pipe },
-	{ net_send_greeting, NULL },
-};
-
 /** }}} */
 
 /**
  * Create a connection and start input.
  */
 static void
-iproto_on_accept(struct evio_service * /* service */, int fd,
-		 struct sockaddr *addr, socklen_t addrlen)
+iproto_do_accept(struct iproto_thread *iproto_thread, const char *name, int fd)
 {
-	char name[SERVICE_NAME_MAXLEN];
-	snprintf(name, sizeof(name), "%s/%s", "iobuf",
-		sio_strfaddr(addr, addrlen));
-
 	struct iproto_connection *con;
 
-	con = iproto_connection_new(name, fd);
+	con = iproto_connection_new(iproto_thread, name, fd);
 	/*
 	 * Ignore msg allocation failure - the queue size is
 	 * fixed so there is a limited number of msgs in
 	 * use, all stored in just a few blocks of the memory pool.
 	 */
 	struct iproto_msg *msg = iproto_msg_new(con);
-	cmsg_init(msg, connect_route);
+	cmsg_init(msg, iproto_thread->connect_route);
 	msg->iobuf = con->iobuf[0];
 	msg->close_connection = false;
-	cpipe_push(&tx_pipe, msg);
+	cpipe_push(&iproto_thread->tx_pipe, msg);
+}
+
+/**
+ * An accepted connection handed over from the acceptor thread
+ * to the net thread which will serve it.
+ */
+struct iproto_accept_msg: public cmsg
+{
+	struct iproto_thread *iproto_thread;
+	int fd;
+	char name[SERVICE_NAME_MAXLEN];
+	struct cmsg_hop route[1];
+};
+
+static void
+iproto_accept_msg_f(struct cmsg *m)
+{
+	struct iproto_accept_msg *msg = (struct iproto_accept_msg *) m;
+	try {
+		iproto_do_accept(msg->iproto_thread, msg->name, msg->fd);
+	} catch (Exception *e) {
+		e->log();
+		close(msg->fd);
+	}
+	free(msg);
 }
 
-static struct evio_service binary; /* iproto binary listener */
+/**
+ * Shard connections across the net threads. With SO_REUSEPORT
+ * listeners (TCP) each thread accepts on its own socket and the
+ * kernel has already picked this thread - serve the connection in
+ * place. With a single listener (unix socket) thread 0 accepts
+ * everything and hands connections over to the threads in a
+ * round-robin fashion; connections landing on thread 0 itself are
+ * served in place, without a hand-over.
+ */
+static void
+iproto_on_accept(struct evio_service *service, int fd,
+		 struct sockaddr *addr, socklen_t addrlen)
+{
+	char name[SERVICE_NAME_MAXLEN];
+	snprintf(name, sizeof(name), "%s/%s", "iobuf",
+		sio_strfaddr(addr, addrlen));
+
+	if (service->reuseport) {
+		iproto_do_accept((struct iproto_thread *)
+				 service->on_accept_param, name, fd);
+		return;
+	}
+	static int shard_next;
+	struct iproto_thread *iproto_thread = &iproto_threads[shard_next];
+	shard_next = (shard_next + 1) % iproto_threads_count;
+	if (iproto_thread->id == 0) {
+		iproto_do_accept(iproto_thread, name, fd);
+		return;
+	}
+	struct iproto_accept_msg *msg =
+		(struct iproto_accept_msg *) malloc(sizeof(*msg));
+	if (msg == NULL) {
+		close(fd);
+		return;
+	}
+	msg->iproto_thread = iproto_thread;
+	msg->fd = fd;
+	snprintf(msg->name, sizeof(msg->name), "%s", name);
+	msg->route[0].f = iproto_accept_msg_f;
+	msg->route[0].pipe = NULL;
+	cmsg_init(msg, msg->route);
+	cpipe_push(&iproto_thread->accept_pipe, msg);
+}
 
 /**
  * The network io thread main function:
  * begin serving the message bus.
  */
 static int
-net_cord_f(va_list /* ap */)
+net_cord_f(va_list ap)
 {
+	struct iproto_thread *iproto_thread =
+		va_arg(ap, struct iproto_thread *);
 	/* Got to be called in every thread using iobuf */
 	iobuf_init();
-	mempool_create(&iproto_msg_pool, &cord()->slabc,
+	mempool_create(&iproto_thread->iproto_msg_pool, &cord()->slabc,
 		       sizeof(struct iproto_msg));
-	mempool_create(&iproto_connection_pool, &cord()->slabc,
+	iproto_thread->msg_stash_size = 0;
+	mempool_create(&iproto_thread->iproto_connection_pool, &cord()->slabc,
 		       sizeof(struct iproto_connection));
+	for (int lane = 0; lane < IPROTO_LANE_MAX; lane++) {
+		rlist_create(&iproto_thread->stopped_connections[lane]);
+		iproto_thread->lane_msg_count[lane] = 0;
+	}
+	rlist_create(&iproto_thread->flush_queue);
 
-	evio_service_init(loop(), &binary, "binary",
-			  iproto_on_accept, NULL);
+	/*
+	 * Every thread owns a listener. Which of them actually
+	 * bind is decided in iproto_bind(): all for TCP, only
+	 * thread 0 for a unix socket.
+	 */
+	evio_service_init(loop(), &iproto_thread->binary, "binary",
+			  iproto_on_accept, iproto_thread);
 
+	ev_prepare_init(&iproto_thread->flush_watcher, iproto_flush_queue_cb);
+	iproto_thread->flush_watcher.data = iproto_thread;
+	ev_prepare_start(loop(), &iproto_thread->flush_watcher);
 
 	/* Init statistics counter */
-	rmean_net = rmean_new(rmean_net_strings, IPROTO_LAST);
+	iproto_thread->rmean_net = rmean_new(rmean_net_strings, IPROTO_LAST);
 
-	if (rmean_net == NULL) {
+	if (iproto_thread->rmean_net == NULL) {
 		tnt_raise(OutOfMemory, sizeof(struct rmean),
 			  "rmean", "struct rmean");
 	}
 
 	struct cbus_endpoint endpoint;
-	/* Create "net" endpoint. */
-	cbus_endpoint_create(&endpoint, "net", fiber_schedule_cb, fiber());
+	/* Create "netN" endpoint. */
+	cbus_endpoint_create(&endpoint, iproto_thread->endpoint_name,
+			     fiber_schedule_cb, fiber());
 	/* Create a pipe to "tx" thread. */
-	cpipe_create(&tx_pipe, "tx");
-	cpipe_set_max_input(&tx_pipe, IPROTO_MSG_MAX/2);
+	cpipe_create(&iproto_thread->tx_pipe, "tx");
+	cpipe_set_max_input(&iproto_thread->tx_pipe, IPROTO_MSG_MAX/2);
+	/*
+	 * The acceptor thread hands connections over to its
+	 * siblings, so it needs a pipe to each of them.
+	 */
+	if (iproto_thread->id == 0) {
+		for (int i = 1; i < iproto_threads_count; i++)
+			cpipe_create(&iproto_threads[i].accept_pipe,
+				     iproto_threads[i].endpoint_name);
+	}
 	/* Process incomming messages. */
 	cbus_loop(&endpoint);
 
-	cpipe_destroy(&tx_pipe);
+	if (iproto_thread->id == 0) {
+		for (int i = 1; i < iproto_threads_count; i++)
+			cpipe_destroy(&iproto_threads[i].accept_pipe);
+	}
+	cpipe_destroy(&iproto_thread->tx_pipe);
+	ev_prepare_stop(loop(), &iproto_thread->flush_watcher);
 	/*
 	 * Nothing to do in the fiber so far, the service
 	 * will take care of creating events for incoming
 	 * connections.
 	 */
-	if (evio_service_is_active(&binary))
-		evio_service_stop(&binary);
+	if (evio_service_is_active(&iproto_thread->binary))
+		evio_service_stop(&iproto_thread->binary);
 
-	rmean_delete(rmean_net);
+	for (int i = 0; i < IPROTO_STALE_SLOTS; i++)
+		free(iproto_thread->stale_cache[i]);
+	rmean_delete(iproto_thread->rmean_net);
 	return 0;
 }
 
-/** Initialize the iproto subsystem and start network io thread */
+/** Set up the message routes of a net thread. */
+static void
+iproto_thread_init_routes(struct iproto_thread *iproto_thread)
+{
+	struct cpipe *net_pipe = &iproto_thread->net_pipe;
+	iproto_thread->disconnect_route[0] =
+		{ tx_process_disconnect, net_pipe };
+	iproto_thread->disconnect_route[1] = { net_finish_disconnect, NULL };
+	iproto_thread->misc_route[0] = { tx_process_misc, net_pipe };
+	iproto_thread->misc_route[1] = { net_send_msg, NULL };
+	iproto_thread->select_route[0] = { tx_process_select, net_pipe };
+	iproto_thread->select_route[1] = { net_send_msg, NULL };
+	iproto_thread->process1_route[0] = { tx_process1, net_pipe };
+	iproto_thread->process1_route[1] = { net_send_msg, NULL };
+	iproto_thread->sync_route[0] =
+		{ tx_process_join_subscribe, net_pipe };
+	iproto_thread->sync_route[1] = { net_end_join_subscribe, NULL };
+	iproto_thread->connect_route[0] = { tx_process_connect, net_pipe };
+	iproto_thread->connect_route[1] = { net_send_greeting, NULL };
+	iproto_thread->compression_route[0] = { tx_process_misc, net_pipe };
+	iproto_thread->compression_route[1] = { net_end_compression, NULL };
+	iproto_thread->priority_route[0] = { tx_process_misc, net_pipe };
+	iproto_thread->priority_route[1] = { net_end_low_priority, NULL };
+	iproto_thread->stream_route[0] = { tx_process_misc, net_pipe };
+	iproto_thread->stream_route[1] = { net_end_stream, NULL };
+	iproto_thread->stream_flush_route[0] = { net_flush_chunk, NULL };
+	iproto_thread->stream_ack_route[0] = { tx_stream_ack, NULL };
+
+	const struct cmsg_hop **dml_route = iproto_thread->dml_route;
+	dml_route[IPROTO_OK] = NULL;
+	dml_route[IPROTO_SELECT] = iproto_thread->select_route;
+	dml_route[IPROTO_INSERT] = iproto_thread->process1_route;
+	dml_route[IPROTO_REPLACE] = iproto_thread->process1_route;
+	dml_route[IPROTO_UPDATE] = iproto_thread->process1_route;
+	dml_route[IPROTO_DELETE] = iproto_thread->process1_route;
+	dml_route[IPROTO_CALL_16] = iproto_thread->misc_route;
+	dml_route[IPROTO_AUTH] = iproto_thread->misc_route;
+	dml_route[IPROTO_EVAL] = iproto_thread->misc_route;
+	dml_route[IPROTO_UPSERT] = iproto_thread->process1_route;
+	dml_route[IPROTO_CALL] = iproto_thread->misc_route;
+}
+
+/** Initialize the iproto subsystem and start network io threads */
 void
-iproto_init()
+iproto_init(int threads_count)
 {
 	tx_cord = cord();
 
-	static struct cord net_cord;
-	if (cord_costart(&net_cord, "iproto", net_cord_f, NULL))
-		panic("failed to initialize iproto thread");
+	assert(threads_count >= 1 && threads_count <= IPROTO_THREADS_MAX);
+	iproto_threads_count = threads_count;
+	iproto_threads = (struct iproto_thread *)
+		calloc(threads_count, sizeof(struct iproto_thread));
+	if (iproto_threads == NULL) {
+		panic("failed to allocate iproto thread contexts");
+	}
+
+	for (int i = 0; i < threads_count; i++) {
+		struct iproto_thread *iproto_thread = &iproto_threads[i];
+		iproto_thread->id = i;
+		snprintf(iproto_thread->endpoint_name,
+			 sizeof(iproto_thread->endpoint_name), "net%d", i);
+		iproto_thread_init_routes(iproto_thread);
+	}
+	for (int i = 0; i < threads_count; i++) {
+		struct iproto_thread *iproto_thread = &iproto_threads[i];
+		char name[FIBER_NAME_MAX];
+		snprintf(name, sizeof(name), "iproto%d", i);
+		if (cord_costart(&iproto_thread->cord, name, net_cord_f,
+				 iproto_thread))
+			panic("failed to initialize iproto thread");
+
+		/* Create a pipe to the net thread. */
+		cpipe_create(&iproto_thread->net_pipe,
+			     iproto_thread->endpoint_name);
+		cpipe_set_max_input(&iproto_thread->net_pipe,
+				    IPROTO_MSG_MAX/2);
+	}
+}
+
+void
+iproto_set_compression_level(int level)
+{
+	iproto_compression_level = level;
+}
 
-	/* Create a pipe to "net" thread. */
-	cpipe_create(&net_pipe, "net");
-	cpipe_set_max_input(&net_pipe, IPROTO_MSG_MAX/2);
+void
+iproto_set_stream_chunk_size(int size)
+{
+	iproto_stream_chunk_size = size;
 }
 
 /**
@@ -1218,17 +2701,22 @@ iproto_init()
 struct iproto_bind_msg: public cbus_call_msg
 {
 	const char *uri;
+	struct iproto_thread *iproto_thread;
+	bool reuseport;
 };
 
 static int
 iproto_do_bind(struct cbus_call_msg *m)
 {
-	const char *uri  = ((struct iproto_bind_msg *) m)->uri;
+	struct iproto_bind_msg *msg = (struct iproto_bind_msg *) m;
+	struct evio_service *binary = &msg->iproto_thread->binary;
 	try {
-		if (evio_service_is_active(&binary))
-			evio_service_stop(&binary);
-		if (uri != NULL)
-			evio_service_bind(&binary, uri);
+		if (evio_service_is_active(binary))
+			evio_service_stop(binary);
+		if (msg->uri != NULL) {
+			binary->reuseport = msg->reuseport;
+			evio_service_bind(binary, msg->uri);
+		}
 	} catch (Exception *e) {
 		return -1;
 	}
@@ -1238,34 +2726,92 @@ iproto_do_bind(struct cbus_call_msg *m)
 static int
 iproto_do_listen(struct cbus_call_msg *m)
 {
-	(void) m;
+	struct iproto_bind_msg *msg = (struct iproto_bind_msg *) m;
 	try {
-		if (evio_service_is_active(&binary))
-			evio_service_listen(&binary);
+		struct evio_service *binary = &msg->iproto_thread->binary;
+		if (evio_service_is_active(binary))
+			evio_service_listen(binary);
 	} catch (Exception *e) {
 		return -1;
 	}
 	return 0;
 }
 
+/** True if @a uri names a unix socket. */
+static bool
+iproto_uri_is_unix(const char *uri)
+{
+	struct uri u;
+	if (uri == NULL || uri_parse(&u, uri) != 0 || u.host == NULL)
+		return false;
+	return u.host_len == strlen(URI_HOST_UNIX) &&
+	       strncmp(u.host, URI_HOST_UNIX, u.host_len) == 0;
+}
+
 void
 iproto_bind(const char *uri)
 {
+	/* Declare static to avoid stack corruption on fiber cancel. */
 	static struct iproto_bind_msg m;
-	m.uri = uri;
-	if (cbus_call(&net_pipe, &tx_pipe, &m, iproto_do_bind,
-		      NULL, TIMEOUT_INFINITY))
-		diag_raise();
+	/*
+	 * TCP listeners are replicated across the net threads with
+	 * SO_REUSEPORT, one accept queue per thread. A unix socket
+	 * has a single accept queue no matter how many sockets
+	 * bind it, so only thread 0 binds and the rest are told to
+	 * stop whatever they listened on before (uri == NULL).
+	 */
+	int bind_count = iproto_uri_is_unix(uri) ? 1 : iproto_threads_count;
+	for (int i = 0; i < iproto_threads_count; i++) {
+		m.uri = i < bind_count ? uri : NULL;
+		m.iproto_thread = &iproto_threads[i];
+		m.reuseport = bind_count > 1;
+		if (cbus_call(&iproto_threads[i].net_pipe,
+			      &iproto_threads[i].tx_pipe,
+			      &m, iproto_do_bind, NULL, TIMEOUT_INFINITY))
+			diag_raise();
+	}
 }
 
 void
 iproto_listen()
 {
 	/* Declare static to avoid stack corruption on fiber cancel. */
-	static struct cbus_call_msg m;
-	if (cbus_call(&net_pipe, &tx_pipe, &m, iproto_do_listen,
-		      NULL, TIMEOUT_INFINITY))
-		diag_raise();
+	static struct iproto_bind_msg m;
+	for (int i = 0; i < iproto_threads_count; i++) {
+		m.iproto_thread = &iproto_threads[i];
+		if (cbus_call(&iproto_threads[i].net_pipe,
+			      &iproto_threads[i].tx_pipe,
+			      &m, iproto_do_listen, NULL, TIMEOUT_INFINITY))
+			diag_raise();
+	}
+}
+
+/**
+ * Sum the network statistics over the net threads and report
+ * them through @a cb, one call per counter, the same way
+ * rmean_foreach() does for a single rmean. The counters are
+ * updated by the net threads without any synchronization - a
+ * dirty read, which is fine for statistics.
+ */
+int
+iproto_rmean_foreach(rmean_cb cb, void *cb_ctx)
+{
+	for (size_t i = 0; i < IPROTO_LAST; i++) {
+		int rps = 0;
+		int64_t total = 0;
+		for (int t = 0; t < iproto_threads_count; t++) {
+			struct rmean *rmean_net = iproto_threads[t].rmean_net;
+			/* The thread may not have started yet. */
+			if (rmean_net == NULL)
+				continue;
+			rps += rmean_mean(rmean_net, i);
+			total += rmean_total(rmean_net, i);
+		}
+		int rc = cb(rmean_net_strings[i], rps, total, cb_ctx);
+		if (rc != 0)
+			return rc;
+	}
+	return 0;
 }
 
 /* vim: set foldmethod=marker */
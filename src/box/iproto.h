@@ -30,8 +30,34 @@
  * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#include "rmean.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+enum {
+	/** Hard limit on the number of network threads. */
+	IPROTO_THREADS_MAX = 64,
+};
+
+void
+iproto_init(int threads_count);
+
+/**
+ * Set the ZSTD level used for connections which negotiate
+ * response compression, 0 to refuse compression requests.
+ * Must be called before iproto_init().
+ */
 void
-iproto_init();
+iproto_set_compression_level(int level);
+
+/**
+ * Set the target size of one IPROTO_CHUNK packet of a streamed
+ * select. Must be called before iproto_init().
+ */
+void
+iproto_set_stream_chunk_size(int size);
 
 void
 iproto_bind(const char *uri);
@@ -39,4 +65,100 @@ iproto_bind(const char *uri);
 void
 iproto_listen();
 
+/**
+ * Report the network statistics summed over all net threads,
+ * one rmean_cb call per counter. Used by box.stat.net.
+ */
+int
+iproto_rmean_foreach(rmean_cb cb, void *cb_ctx);
+
+enum { IPROTO_TRACE_RING_SIZE = 128 };
+
+/**
+ * One sampled request trace: timestamps (clock_monotonic()
+ * seconds) of the pipeline stages a request passes through.
+ * Written by net threads, read by box.stat.trace in tx.
+ */
+struct iproto_trace {
+	/**
+	 * Seqlock: zero - never written, odd - being written.
+	 * The reader discards a slot whose seq changed while the
+	 * payload was copied.
+	 */
+	uint64_t seq;
+	/** Request type, IPROTO_*. */
+	uint32_t type;
+	/** Request decoded in the net thread. */
+	double t_recv;
+	/** Tx processing started. */
+	double t_tx;
+	/** Tx processing finished, response is in the obuf. */
+	double t_done;
+	/** Response handed to output in the net thread. */
+	double t_sent;
+};
+
+/**
+ * Set the trace sampling rate: every @a rate-th decoded request
+ * is traced, 0 disables tracing.
+ */
+void
+iproto_trace_set_rate(uint32_t rate);
+
+uint32_t
+iproto_trace_get_rate(void);
+
+/**
+ * Copy a consistent snapshot of trace ring slot @a index into
+ * @a out.
+ * @retval 0  success.
+ * @retval -1 the slot was never filled or is being overwritten.
+ */
+int
+iproto_trace_read(int index, struct iproto_trace *out);
+
+/**
+ * Request latency percentiles of one request type over the last
+ * one to two accounting windows, in microseconds. Used by
+ * box.stat.latency.
+ */
+struct iproto_latency_stat {
+	/** Number of accounted requests. */
+	size_t count;
+	int64_t p50;
+	int64_t p99;
+	int64_t p999;
+	int64_t max;
+};
+
+/**
+ * Fetch the latency statistics of request type @a type.
+ * @retval 0  success.
+ * @retval -1 no requests of this type were accounted yet.
+ */
+int
+iproto_latency_stat_get(uint32_t type, struct iproto_latency_stat *stat);
+
+/**
+ * Start recording incoming requests into an xlog-format file at
+ * @a path, for later replay with extra/replay.lua. Must be
+ * called in the tx thread.
+ * @retval -1 capture is already running or the file cannot be
+ *            created, see the diagnostics area.
+ */
+int
+iproto_capture_start(const char *path);
+
+/**
+ * Stop the capture and finalize the file. A no-op if capture is
+ * not running.
+ * @retval -1 flushing the tail of the file failed.
+ */
+int
+iproto_capture_stop(void);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
 #endif
@@ -86,6 +86,8 @@ const unsigned char iproto_key_type[IPROTO_KEY_MAX] =
 	/* 0x26 */	MP_MAP, /* IPROTO_VCLOCK */
 	/* 0x27 */	MP_STR, /* IPROTO_EXPR */
 	/* 0x28 */	MP_ARRAY, /* IPROTO_OPS */
+	/* 0x29 */	MP_UINT, /* IPROTO_COMPRESSION_LEVEL */
+	/* 0x2a */	MP_UINT, /* IPROTO_SNAP_FILE */
 	/* }}} */
 };
 
@@ -162,7 +164,8 @@ const char *iproto_key_strs[IPROTO_KEY_MAX] = {
 	"vector clock",     /* 0x26 */
 	"expression",       /* 0x27 */
 	"operations",       /* 0x28 */
-	NULL,               /* 0x29 */
+	"compression level", /* 0x29 */
+	"snap file",        /* 0x2a */
 	"data",             /* 0x30 */
 	"error"             /* 0x31 */
 };
@@ -174,7 +177,8 @@ const char *vy_page_info_key_strs[VY_PAGE_INFO_KEY_MAX] = {
 	"unpacked size",
 	"count",
 	"min",
-	"page index offset"
+	"page index offset",
+	"base lsn"
 };
 
 const char *vy_run_info_key_strs[VY_RUN_INFO_KEY_MAX] = {
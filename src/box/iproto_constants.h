@@ -75,6 +75,22 @@ enum iproto_key {
 	IPROTO_VCLOCK = 0x26,
 	IPROTO_EXPR = 0x27, /* EVAL */
 	IPROTO_OPS = 0x28, /* UPSERT but not UPDATE ops, because of legacy */
+	/**
+	 * ZSTD level of replication stream compression, requested
+	 * by a replica in the SUBSCRIBE body. A master which
+	 * supports it wraps batches of WAL rows into
+	 * IPROTO_COMPRESSION envelopes; older masters skip the
+	 * key and stream plain rows as before.
+	 */
+	IPROTO_COMPRESSION_LEVEL = 0x29,
+	/**
+	 * JOIN option: the replica is able to receive the initial
+	 * data as a raw snapshot file, see IPROTO_SNAP_CHUNK. A
+	 * master which supports it ships the checkpoint file bytes
+	 * instead of re-encoding every snapshot row; older masters
+	 * skip the key and stream rows as before.
+	 */
+	IPROTO_SNAP_FILE = 0x2a,
 	/* Leave a gap between request keys and response keys */
 	IPROTO_DATA = 0x30,
 	IPROTO_ERROR = 0x31,
@@ -150,6 +166,61 @@ enum iproto_type {
 	IPROTO_JOIN = 65,
 	/** Replication SUBSCRIBE command */
 	IPROTO_SUBSCRIBE = 66,
+	/**
+	 * Enable response compression on the connection. Once the
+	 * server has acknowledged the request, it may wrap any part
+	 * of the response stream into envelope packets of this very
+	 * type, whose body is {IPROTO_DATA: <ZSTD frame>}. The
+	 * decompressed bytes continue the response stream exactly
+	 * where the previous packet left off, so the client must
+	 * treat envelopes as transport framing: unwrap them in
+	 * arrival order and parse the reconstructed stream as usual.
+	 */
+	IPROTO_COMPRESSION = 67,
+	/**
+	 * Move the connection into the low-priority request lane.
+	 * Cooperating bulk clients (batch jobs, crawlers) send it
+	 * right after connect; requests of such connections are
+	 * admitted from a budget which cannot crowd out the
+	 * default lane, so health checks and interactive traffic
+	 * keep flowing when a batch job floods the server.
+	 */
+	IPROTO_LOW_PRIORITY = 68,
+	/**
+	 * Turn on streaming of big select responses. The body is
+	 * optional: {IPROTO_DATA: <window>} advertises the flow
+	 * control window - the most response bytes the server may
+	 * buffer for this connection before it pauses the request
+	 * which produces them. Once acknowledged, a select result
+	 * arrives as a sequence of IPROTO_CHUNK packets followed
+	 * by an ordinary final reply.
+	 */
+	IPROTO_STREAM = 69,
+	/**
+	 * A piece of a raw snapshot file shipped during the initial
+	 * JOIN stage, body is {IPROTO_DATA: <file bytes>}. Sent
+	 * instead of the snapshot row stream when the replica has
+	 * advertised IPROTO_SNAP_FILE; the OK ending the initial
+	 * stage also ends the file.
+	 */
+	IPROTO_SNAP_CHUNK = 70,
+	/**
+	 * Take a checkpoint on this instance on behalf of a peer.
+	 * The optional body {IPROTO_VCLOCK: <vclock>} names the
+	 * state the checkpoint must cover: the request waits until
+	 * the local vclock reaches it before snapshotting. Lets a
+	 * master offload checkpoint I/O to a replica and register
+	 * the result in its own garbage collection state.
+	 */
+	IPROTO_CHECKPOINT = 71,
+
+	/**
+	 * A non-final response: carries a piece of a streamed
+	 * select in {IPROTO_DATA: [tuples]} format. The client
+	 * accumulates chunks until the packet with the same sync
+	 * and code IPROTO_OK (or an error) ends the stream.
+	 */
+	IPROTO_CHUNK = 128,
 
 	/** General information about Vinyl's runs stored in .index file */
 	VY_INDEX_RUN_INFO = 100,
@@ -268,6 +339,36 @@ struct PACKED request_replace_body {
 	uint8_t k_tuple;
 };
 
+/**
+ * The delta snapshot row metadata for a deleted tuple repeats
+ * the structure of DELETE request.
+ */
+struct PACKED request_delete_body {
+	uint8_t m_body;
+	uint8_t k_space_id;
+	uint8_t m_space_id;
+	uint32_t v_space_id;
+	uint8_t k_key;
+};
+
+/**
+ * Fixed-width binary layout of a compressed stream envelope: a
+ * packet of type IPROTO_COMPRESSION whose body is {IPROTO_DATA:
+ * <ZSTD frame>}. Used both for negotiated response compression
+ * in iproto and for the compressed replication stream.
+ */
+struct PACKED iproto_zstd_bin {
+	uint8_t m_len;                     /* MP_UINT32 */
+	uint32_t v_len;
+	uint8_t m_header;                  /* MP_MAP */
+	uint8_t k_type;                    /* IPROTO_REQUEST_TYPE */
+	uint8_t v_type;                    /* IPROTO_COMPRESSION */
+	uint8_t m_body;                    /* MP_MAP */
+	uint8_t k_data;                    /* IPROTO_DATA */
+	uint8_t m_data;                    /* MP_BIN32 */
+	uint32_t v_data_len;
+};
+
 /**
  * Xrow keys for Vinyl's run information.
  * @sa struct vy_run_info.
@@ -318,8 +419,14 @@ enum vy_page_info_key {
 	VY_PAGE_INFO_MIN_KEY = 5,
 	/* Page index offset in a page */
 	VY_PAGE_INFO_PAGE_INDEX_OFFSET = 6,
+	/*
+	 * Base LSN of a page: row LSNs are stored as zigzag
+	 * deltas from it. Optional; absence means the rows store
+	 * absolute LSNs (old format).
+	 */
+	VY_PAGE_INFO_BASE_LSN = 7,
 	/** The last key in this enum + 1 */
-	VY_PAGE_INFO_KEY_MAX = VY_PAGE_INFO_PAGE_INDEX_OFFSET + 1
+	VY_PAGE_INFO_KEY_MAX = VY_PAGE_INFO_BASE_LSN + 1
 };
 
 /**
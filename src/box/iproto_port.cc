@@ -185,3 +185,31 @@ iproto_reply_select(struct obuf *buf, struct obuf_svp *svp, uint64_t sync,
 	memcpy(pos, &header, sizeof(header));
 	memcpy(pos + sizeof(header), &body, sizeof(body));
 }
+
+void
+iproto_reply_reset_sync(char *reply, uint64_t sync)
+{
+	uint64_t v_sync = mp_bswap_u64(sync);
+	memcpy(reply + offsetof(struct iproto_header_bin, v_sync),
+	       &v_sync, sizeof(v_sync));
+}
+
+void
+iproto_reply_chunk(struct obuf *buf, struct obuf_svp *svp, uint64_t sync,
+		   uint32_t count)
+{
+	uint32_t len = obuf_size(buf) - svp->used - 5;
+
+	struct iproto_header_bin header = iproto_header_bin;
+	header.v_len = mp_bswap_u32(len);
+	header.v_code = mp_bswap_u32(IPROTO_CHUNK);
+	header.v_sync = mp_bswap_u64(sync);
+	header.v_schema_version = mp_bswap_u32(schema_version);
+
+	struct iproto_body_bin body = iproto_body_bin;
+	body.v_data_len = mp_bswap_u32(count);
+
+	char *pos = (char *) obuf_svp_to_ptr(buf, svp);
+	memcpy(pos, &header, sizeof(header));
+	memcpy(pos + sizeof(header), &body, sizeof(body));
+}
@@ -49,6 +49,23 @@ iproto_prepare_select(struct obuf *buf, struct obuf_svp *svp);
 void
 iproto_reply_select(struct obuf *buf, struct obuf_svp *svp, uint64_t sync,
 		    uint32_t count);
+
+/**
+ * Patch the sync of a reply previously serialized by
+ * iproto_reply_select(). Used when replaying a stored copy of a
+ * reply on behalf of a request with a different sync.
+ */
+void
+iproto_reply_reset_sync(char *reply, uint64_t sync);
+
+/**
+ * The same, but for a non-final piece of a streamed select:
+ * the header carries IPROTO_CHUNK instead of IPROTO_OK.
+ * Doesn't throw either.
+ */
+void
+iproto_reply_chunk(struct obuf *buf, struct obuf_svp *svp, uint64_t sync,
+		   uint32_t count);
 #if defined(__cplusplus)
 } /*  extern "C" */
 
@@ -29,6 +29,7 @@
  * SUCH DAMAGE.
  */
 #include "journal.h"
+#include <stdlib.h>
 #include <small/region.h>
 #include <fiber.h>
 #include <diag.h>
@@ -48,6 +49,7 @@ dummy_journal_write(struct journal *journal, struct journal_entry *entry)
 static struct journal dummy_journal = {
 	dummy_journal_write,
 	NULL,
+	false,
 };
 
 struct journal *current_journal = &dummy_journal;
@@ -72,3 +74,22 @@ journal_entry_new(size_t n_rows)
 	return entry;
 }
 
+struct journal_entry *
+journal_entry_new_detached(size_t n_rows, size_t payload_size)
+{
+	struct journal_entry *entry;
+
+	size_t size = (sizeof(struct journal_entry) +
+		       sizeof(entry->rows[0]) * n_rows + payload_size);
+
+	entry = malloc(size);
+	if (entry == NULL) {
+		diag_set(OutOfMemory, size, "malloc", "struct journal_entry");
+		return NULL;
+	}
+	entry->n_rows = n_rows;
+	entry->res = -1;
+	entry->fiber = NULL;
+	return entry;
+}
+
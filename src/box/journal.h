@@ -55,7 +55,9 @@ struct journal_entry {
 	 */
 	int64_t res;
 	/**
-	 * The fiber issuing the request.
+	 * The fiber issuing the request. NULL for a detached
+	 * entry: nobody waits for its completion, see
+	 * journal_entry_new_detached().
 	 */
 	struct fiber *fiber;
 	/**
@@ -76,6 +78,20 @@ struct journal_entry {
 struct journal_entry *
 journal_entry_new(size_t n_rows);
 
+/**
+ * Create a detached journal entry: a single malloc()ed block
+ * with room for @a payload_size bytes of row data right after
+ * the row pointer array. Unlike a regular entry it survives the
+ * submitting fiber: entry->fiber is NULL and the WAL completion
+ * path accounts and frees the entry instead of waking anybody
+ * up. Used by the per-space asynchronous commit mode, see
+ * space_opts::async_commit.
+ *
+ * @return NULL if out of memory, diagnostics area is set
+ */
+struct journal_entry *
+journal_entry_new_detached(size_t n_rows, size_t payload_size);
+
 /**
  * An API for an abstract journal for all transactions of this
  * instance, as well as for multiple instances in case of
@@ -85,6 +101,15 @@ struct journal {
 	int64_t (*write)(struct journal *journal,
 			 struct journal_entry *req);
 	void (*destroy)(struct journal *journal);
+	/**
+	 * True if the implementation completes detached entries
+	 * asynchronously: write() only queues them and returns,
+	 * the entry is accounted and freed once the write lands.
+	 * Only the real WAL writer can do that; with any other
+	 * implementation transactions commit synchronously
+	 * whatever the space options say.
+	 */
+	bool async_capable;
 };
 
 /**
@@ -141,6 +166,7 @@ journal_create(struct journal *journal,
 {
 	journal->write = write;
 	journal->destroy = destroy;
+	journal->async_capable = false;
 }
 
 static inline bool
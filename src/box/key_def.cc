@@ -41,6 +41,7 @@
 #include "space.h"
 #include "schema.h"
 #include "tuple_compare.h"
+#include "tuple_format.h"
 
 const char *field_type_strs[] = {
 	/* [FIELD_TYPE_ANY]      = */ "any",
@@ -89,6 +90,9 @@ const char *index_type_strs[] = { "HASH", "TREE", "BITSET", "RTREE" };
 
 const char *rtree_index_distance_type_strs[] = { "EUCLID", "MANHATTAN" };
 
+const char *vy_compaction_policy_strs[] = { "LEVELED", "TIERED",
+					    "LAZY_LEVELING" };
+
 const char *func_language_strs[] = {"LUA", "C"};
 
 const uint32_t key_mp_type[] = {
@@ -120,6 +124,9 @@ const struct index_opts index_opts_default = {
 	/* .page_size           = */ 0,
 	/* .run_count_per_level = */ 2,
 	/* .run_size_ratio      = */ 3.5,
+	/* .cache_size          = */ 0,
+	/* .compaction_policybuf= */ { '\0' },
+	/* .compaction_policy   = */ VY_COMPACTION_LEVELED,
 	/* .lsn                 = */ 0,
 	/* .sql                 = */ NULL,
 };
@@ -132,6 +139,9 @@ const struct opt_def index_opts_reg[] = {
 	OPT_DEF("page_size", OPT_INT, struct index_opts, page_size),
 	OPT_DEF("run_count_per_level", OPT_INT, struct index_opts, run_count_per_level),
 	OPT_DEF("run_size_ratio", OPT_FLOAT, struct index_opts, run_size_ratio),
+	OPT_DEF("cache_size", OPT_INT, struct index_opts, cache_size),
+	OPT_DEF("compaction_policy", OPT_STR, struct index_opts,
+		compaction_policybuf),
 	OPT_DEF("lsn", OPT_INT, struct index_opts, lsn),
 	OPT_DEF("sql", OPT_STRPTR, struct index_opts, sql),
 	{ NULL, opt_type_MAX, 0, 0 },
@@ -198,8 +208,10 @@ box_key_def_new(uint32_t *fields, uint32_t *types, uint32_t part_count)
 	for (uint32_t item = 0; item < part_count; ++item) {
 		key_def->parts[item].fieldno = fields[item];
 		key_def->parts[item].type = (enum field_type)types[item];
+		key_def->parts[item].offset_slot = TUPLE_OFFSET_SLOT_NIL;
 	}
 	key_def->part_count = part_count;
+	key_def->plan_format_id = FORMAT_ID_NIL;
 	key_def_set_cmp(key_def);
 	return key_def;
 }
@@ -244,6 +256,8 @@ index_def_new(uint32_t space_id, uint32_t iid, const char *name,
 	def->iid = iid;
 	def->opts = *opts;
 	def->key_def.part_count = part_count;
+	/* calloc() above zeroed it; 0 is a valid format id. */
+	def->key_def.plan_format_id = FORMAT_ID_NIL;
 	return def;
 }
 
@@ -379,6 +393,7 @@ key_def_set_part(struct key_def *def, uint32_t part_no,
 	assert(type > FIELD_TYPE_ANY && type < field_type_MAX);
 	def->parts[part_no].fieldno = fieldno;
 	def->parts[part_no].type = type;
+	def->parts[part_no].offset_slot = TUPLE_OFFSET_SLOT_NIL;
 	/**
 	 * When all parts are set, initialize the tuple
 	 * comparator function.
@@ -575,12 +590,22 @@ key_validate_parts(struct index_def *index_def, const char *key,
 }
 
 const struct space_opts space_opts_default = {
-	/* .temporary  = */ false,
-	/* .sql        = */ NULL,
+	/* .temporary     = */ false,
+	/* .memory_limit  = */ 0,
+	/* .async_commit  = */ false,
+	/* .ttl_field     = */ 0,
+	/* .min_field_count = */ 0,
+	/* .stale_read_ttl = */ 0,
+	/* .sql           = */ NULL,
 };
 
 const struct opt_def space_opts_reg[] = {
 	OPT_DEF("temporary", OPT_BOOL, struct space_opts, temporary),
+	OPT_DEF("memory_limit", OPT_INT, struct space_opts, memory_limit),
+	OPT_DEF("async_commit", OPT_BOOL, struct space_opts, async_commit),
+	OPT_DEF("ttl_field", OPT_INT, struct space_opts, ttl_field),
+	OPT_DEF("min_field_count", OPT_INT, struct space_opts, min_field_count),
+	OPT_DEF("stale_read_ttl", OPT_FLOAT, struct space_opts, stale_read_ttl),
 	OPT_DEF("sql", OPT_STRPTR, struct space_opts, sql),
 	{ NULL, opt_type_MAX, 0, 0 }
 };
@@ -614,6 +639,12 @@ space_def_check(struct space_def *def, uint32_t namelen, uint32_t engine_namelen
 				  def->name,
 			         "space does not support temporary flag");
 	}
+	if (def->opts.min_field_count < 0 ||
+	    (def->exact_field_count > 0 &&
+	     def->opts.min_field_count > def->exact_field_count)) {
+		tnt_raise(ClientError, errcode, def->name,
+			  "min_field_count must not exceed field_count");
+	}
 }
 
 bool
@@ -168,10 +168,45 @@ enum rtree_index_distance_type {
 };
 extern const char *rtree_index_distance_type_strs[];
 
+enum vy_compaction_policy {
+	/*
+	 * Compact an overflowed level together with all upper
+	 * levels. Keeps few runs per level at the cost of
+	 * rewriting data on every merge.
+	 */
+	VY_COMPACTION_LEVELED,
+	/*
+	 * Merge a run only with runs of a comparable size.
+	 * Minimal write amplification, but reads have to go
+	 * through more runs.
+	 */
+	VY_COMPACTION_TIERED,
+	/*
+	 * Tiered for all levels except the last one, which is
+	 * kept compacted down to a single run.
+	 */
+	VY_COMPACTION_LAZY_LEVELING,
+	vy_compaction_policy_MAX
+};
+extern const char *vy_compaction_policy_strs[];
+
 /** Descriptor of a single part in a multipart key. */
 struct key_part {
 	uint32_t fieldno;
 	enum field_type type;
+	/**
+	 * Compiled comparison plan: the offset slot of this
+	 * part's field in the tuple format the owning key_def
+	 * was used to create, TUPLE_OFFSET_SLOT_NIL when the
+	 * field needs no slot or the plan is not built. Kept
+	 * interleaved with fieldno and type so the comparator
+	 * loop reads everything about a part from one cache
+	 * line instead of chasing format->fields[] per part.
+	 * Filled by tuple_format_create(), consumed by
+	 * tuple_compare.cc; only valid for tuples of the format
+	 * recorded in key_def::plan_format_id.
+	 */
+	int32_t offset_slot;
 };
 
 /** Index options */
@@ -206,6 +241,16 @@ struct index_opts {
 	 * previous one.
 	 */
 	double run_size_ratio;
+	/**
+	 * Memory limit for the tuple cache of the index.
+	 * 0 means no individual limit, only the common one.
+	 */
+	int64_t cache_size;
+	/**
+	 * Compaction policy of the LSM tree.
+	 */
+	char compaction_policybuf[16];
+	enum vy_compaction_policy compaction_policy;
 	/**
 	 * LSN from the time of index creation.
 	 */
@@ -250,6 +295,15 @@ struct key_def {
 	tuple_compare_with_key_t tuple_compare_with_key;
 	/** The size of the 'parts' array. */
 	uint32_t part_count;
+	/**
+	 * Id of the tuple format the comparison plan in parts[]
+	 * was built for, FORMAT_ID_NIL if no plan is built. The
+	 * comparator consults the per-part offset slots only
+	 * for tuples of exactly this format. The format is kept
+	 * alive by the space owning this key_def, so the id
+	 * cannot be recycled while the plan is in use.
+	 */
+	uint16_t plan_format_id;
 	/** Description of parts of a multipart index. */
 	struct key_part parts[];
 };
@@ -393,6 +447,58 @@ struct space_opts {
 	 * - changes are not part of a snapshot
 	 */
 	bool temporary;
+	/**
+	 * Maximal size of tuple data the space may hold, in
+	 * bytes, 0 - unlimited. Checked against space bsize, so
+	 * allocator overhead and index memory do not count.
+	 * Writes over the limit are rejected before the shared
+	 * memtx quota is touched, protecting other spaces from a
+	 * single runaway one.
+	 */
+	int64_t memory_limit;
+	/**
+	 * Relaxed durability: a transaction touching only
+	 * async_commit spaces is acknowledged as soon as its
+	 * journal entry is queued to the WAL thread, without
+	 * waiting for the write and fsync. A crash may lose the
+	 * last moments of such data. Honored for memtx spaces
+	 * only: vinyl needs the real LSN at commit, so there the
+	 * flag is ignored and commits stay synchronous.
+	 */
+	bool async_commit;
+	/**
+	 * Native expiration: 1-based number of the tuple field
+	 * holding the expiration deadline, Unix time in seconds
+	 * (MP_UINT or MP_DOUBLE). A background fiber evicts
+	 * expired tuples in deadline order, in batches, through
+	 * the regular transaction path. 0 - expiration disabled.
+	 * Honored for memtx spaces only. Tuples whose deadline
+	 * field is missing or is not a number never expire.
+	 */
+	int64_t ttl_field;
+	/**
+	 * Online field count growth: the smallest field count a
+	 * tuple already stored in the space may have. Normally 0,
+	 * meaning every tuple has exactly exact_field_count
+	 * fields. Set when the field count of a non-empty space
+	 * is raised: old tuples keep their short layout, read as
+	 * nil in the missing trailing fields, and any field count
+	 * between min_field_count and exact_field_count stays
+	 * valid, so updates of old tuples which do not touch the
+	 * new fields go through. This is what makes adding a
+	 * field to a huge space an O(1) metadata change instead
+	 * of a full rewrite.
+	 */
+	int64_t min_field_count;
+	/**
+	 * Staleness budget for the net-thread select cache, in
+	 * seconds, 0 - disabled. When set, identical repeated
+	 * selects from one connection may be answered with a
+	 * cached response up to this old, straight from the net
+	 * thread, without visiting the tx thread. For read-mostly
+	 * reference data which tolerates bounded staleness.
+	 */
+	double stale_read_ttl;
 	/**
 	 * SQL statement that produced this space.
 	 */
@@ -109,6 +109,28 @@ lbox_cfg_set_readahead(struct lua_State *L)
 	return 0;
 }
 
+static int
+lbox_cfg_set_fiber_preempt_budget(struct lua_State *L)
+{
+	try {
+		box_set_fiber_preempt_budget();
+	} catch (Exception *) {
+		luaT_error(L);
+	}
+	return 0;
+}
+
+static int
+lbox_cfg_set_iobuf_cache_size(struct lua_State *L)
+{
+	try {
+		box_set_iobuf_cache_size();
+	} catch (Exception *) {
+		luaT_error(L);
+	}
+	return 0;
+}
+
 static int
 lbox_cfg_set_io_collect_interval(struct lua_State *L)
 {
@@ -131,6 +153,17 @@ lbox_cfg_set_too_long_threshold(struct lua_State *L)
 	return 0;
 }
 
+static int
+lbox_cfg_set_loop_stall_threshold(struct lua_State *L)
+{
+	try {
+		box_set_loop_stall_threshold();
+	} catch (Exception *) {
+		luaT_error(L);
+	}
+	return 0;
+}
+
 static int
 lbox_cfg_set_snap_io_rate_limit(struct lua_State *L)
 {
@@ -142,6 +175,17 @@ lbox_cfg_set_snap_io_rate_limit(struct lua_State *L)
 	return 0;
 }
 
+static int
+lbox_cfg_set_checkpoint_sink(struct lua_State *L)
+{
+	try {
+		box_set_checkpoint_sink();
+	} catch (Exception *) {
+		luaT_error(L);
+	}
+	return 0;
+}
+
 static int
 lbox_cfg_set_read_only(struct lua_State *L)
 {
@@ -165,9 +209,13 @@ box_lua_cfg_init(struct lua_State *L)
 		{"cfg_set_replication", lbox_cfg_set_replication},
 		{"cfg_set_log_level", lbox_cfg_set_log_level},
 		{"cfg_set_readahead", lbox_cfg_set_readahead},
+		{"cfg_set_fiber_preempt_budget", lbox_cfg_set_fiber_preempt_budget},
+		{"cfg_set_iobuf_cache_size", lbox_cfg_set_iobuf_cache_size},
 		{"cfg_set_io_collect_interval", lbox_cfg_set_io_collect_interval},
 		{"cfg_set_too_long_threshold", lbox_cfg_set_too_long_threshold},
+		{"cfg_set_loop_stall_threshold", lbox_cfg_set_loop_stall_threshold},
 		{"cfg_set_snap_io_rate_limit", lbox_cfg_set_snap_io_rate_limit},
+		{"cfg_set_checkpoint_sink", lbox_cfg_set_checkpoint_sink},
 		{"cfg_set_read_only", lbox_cfg_set_read_only},
 		{NULL, NULL}
 	};
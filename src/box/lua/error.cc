@@ -197,6 +197,75 @@ lbox_errinj_info(struct lua_State *L)
 	return 1;
 }
 
+/**
+ * box.error.injection.fault(name[, opts]) - arm a fault
+ * injection, present in release builds unlike set() above.
+ * opts.period fires the point on every period-th pass (default 1,
+ * 0 or nil opts disarm), opts.delay is the injected delay in
+ * seconds, opts.space_id/opts.session_id restrict the scope where
+ * the point supports it.
+ */
+static int
+lbox_faultinj_set(struct lua_State *L)
+{
+	const char *name = luaL_checkstring(L, 1);
+	struct fault_inj *inj = fault_inj_by_name(name);
+	if (inj == NULL)
+		return luaL_error(L, "can't find fault injection '%s'", name);
+	uint64_t period = 0;
+	double delay = 0;
+	uint32_t space_id = 0;
+	uint64_t session_id = 0;
+	if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		lua_getfield(L, 2, "period");
+		period = lua_isnil(L, -1) ? 1 : luaL_checkuint64(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "delay");
+		delay = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "space_id");
+		space_id = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "session_id");
+		session_id = lua_isnil(L, -1) ? 0 : luaL_checkuint64(L, -1);
+		lua_pop(L, 1);
+	}
+	fault_inj_set(inj, period, delay, space_id, session_id);
+	lua_pushstring(L, "ok");
+	return 1;
+}
+
+static int
+lbox_faultinj_cb(struct fault_inj *inj, void *cb_ctx)
+{
+	struct lua_State *L = (struct lua_State *) cb_ctx;
+	lua_pushstring(L, inj->name);
+	lua_newtable(L);
+	luaL_pushuint64(L, inj->period);
+	lua_setfield(L, -2, "period");
+	lua_pushnumber(L, inj->delay);
+	lua_setfield(L, -2, "delay");
+	lua_pushnumber(L, inj->space_id);
+	lua_setfield(L, -2, "space_id");
+	luaL_pushuint64(L, inj->session_id);
+	lua_setfield(L, -2, "session_id");
+	luaL_pushuint64(L, inj->count);
+	lua_setfield(L, -2, "count");
+	luaL_pushuint64(L, inj->hits);
+	lua_setfield(L, -2, "hits");
+	lua_settable(L, -3);
+	return 0;
+}
+
+static int
+lbox_faultinj_info(struct lua_State *L)
+{
+	lua_newtable(L);
+	fault_inj_foreach(lbox_faultinj_cb, L);
+	return 1;
+}
+
 void
 box_lua_error_init(struct lua_State *L) {
 	static const struct luaL_Reg errorlib[] = {
@@ -239,6 +308,8 @@ box_lua_error_init(struct lua_State *L) {
 	static const struct luaL_Reg errinjlib[] = {
 		{"info", lbox_errinj_info},
 		{"set", lbox_errinj_set},
+		{"fault", lbox_faultinj_set},
+		{"fault_info", lbox_faultinj_info},
 		{NULL, NULL}
 	};
 	/* box.error.injection is not set by register_module */
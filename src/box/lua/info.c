@@ -45,6 +45,7 @@
 #include "box/wal.h"
 #include "box/replication.h"
 #include "box/info.h"
+#include "box/tuple_format.h"
 #include "main.h"
 #include "box/box.h"
 #include "lua/utils.h"
@@ -102,10 +103,44 @@ lbox_pushapplier(lua_State *L, struct applier *applier)
 static void
 lbox_pushrelay(lua_State *L, struct relay *relay)
 {
+	const struct relay_stat *stat = relay_stat(relay);
+
 	lua_newtable(L);
 	lua_pushstring(L, "vclock");
 	lbox_pushvclock(L, relay_vclock(relay));
 	lua_settable(L, -3);
+
+	/* How far the relay WAL cursor is behind the WAL head. */
+	lua_pushstring(L, "rows_behind");
+	luaL_pushint64(L, vclock_sum(&replicaset_vclock) -
+		       vclock_sum(relay_vclock(relay)));
+	lua_settable(L, -3);
+
+	/* Bytes staged ahead of the replica socket. */
+	lua_pushstring(L, "queued_bytes");
+	luaL_pushuint64(L, stat->send_queued);
+	lua_settable(L, -3);
+
+	/* Time spent stalled on a full send buffer. */
+	lua_pushstring(L, "stall_time");
+	lua_pushnumber(L, stat->stall_time);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "stall_p50");
+	lua_pushnumber(L, stat->stall_p50);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "stall_p90");
+	lua_pushnumber(L, stat->stall_p90);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "stall_p99");
+	lua_pushnumber(L, stat->stall_p99);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "stall_max");
+	lua_pushnumber(L, stat->stall_max);
+	lua_settable(L, -3);
 }
 
 static void
@@ -334,6 +369,40 @@ luaT_info_handler_create(struct info_handler *h, struct lua_State *L)
 extern struct vy_env *
 vinyl_engine_get_env();
 
+/* Declared in memtx_engine.cc */
+extern int
+memtx_checkpoint_progress(uint64_t *total_rows, uint64_t *written_rows,
+			  double *elapsed);
+
+static int
+lbox_info_snapshot(struct lua_State *L)
+{
+	uint64_t total_rows, written_rows;
+	double elapsed;
+	if (!box_is_configured() ||
+	    memtx_checkpoint_progress(&total_rows, &written_rows,
+				      &elapsed) != 0) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_createtable(L, 0, 4);
+	lua_pushstring(L, "rows_total");
+	luaL_pushuint64(L, total_rows);
+	lua_settable(L, -3);
+	lua_pushstring(L, "rows_done");
+	luaL_pushuint64(L, written_rows);
+	lua_settable(L, -3);
+	lua_pushstring(L, "elapsed");
+	lua_pushnumber(L, elapsed);
+	lua_settable(L, -3);
+	lua_pushstring(L, "eta");
+	lua_pushnumber(L, written_rows > 0 && total_rows > written_rows ?
+		       elapsed * (total_rows - written_rows) / written_rows :
+		       0);
+	lua_settable(L, -3);
+	return 1;
+}
+
 static int
 lbox_info_vinyl_call(struct lua_State *L)
 {
@@ -359,6 +428,58 @@ lbox_info_vinyl(struct lua_State *L)
 	return 1;
 }
 
+static int
+lbox_info_cpu_affinity_cb(const char *name, const char *cpus, void *cb_ctx)
+{
+	struct lua_State *L = (struct lua_State *) cb_ctx;
+	lua_pushstring(L, name);
+	lua_pushstring(L, cpus);
+	lua_settable(L, -3);
+	return 0;
+}
+
+static int
+lbox_info_cpu_affinity(struct lua_State *L)
+{
+	lua_newtable(L);
+	cord_affinity_foreach(lbox_info_cpu_affinity_cb, L);
+	return 1;
+}
+
+static int
+lbox_info_formats(struct lua_State *L)
+{
+	uint32_t n_formats;
+	uint64_t n_reused;
+	tuple_format_stats(&n_formats, &n_reused);
+	lua_createtable(L, 0, 2);
+	lua_pushnumber(L, n_formats);
+	lua_setfield(L, -2, "count");
+	lua_pushnumber(L, n_reused);
+	lua_setfield(L, -2, "reused");
+	return 1;
+}
+
+/**
+ * box.info.wal_async - accounting of rows committed to spaces
+ * with the async_commit option. 'pending' is the current
+ * unsynced gap: rows acked to clients but not yet on disk.
+ */
+static int
+lbox_info_wal_async(struct lua_State *L)
+{
+	struct wal_async_stat stat;
+	wal_async_stat(&stat);
+	lua_createtable(L, 0, 3);
+	luaL_pushint64(L, stat.submitted - stat.written - stat.lost);
+	lua_setfield(L, -2, "pending");
+	luaL_pushint64(L, stat.written);
+	lua_setfield(L, -2, "written");
+	luaL_pushint64(L, stat.lost);
+	lua_setfield(L, -2, "lost");
+	return 1;
+}
+
 static const struct luaL_Reg lbox_info_dynamic_meta[] = {
 	{"id", lbox_info_id},
 	{"uuid", lbox_info_uuid},
@@ -371,7 +492,11 @@ static const struct luaL_Reg lbox_info_dynamic_meta[] = {
 	{"uptime", lbox_info_uptime},
 	{"pid", lbox_info_pid},
 	{"cluster", lbox_info_cluster},
+	{"cpu_affinity", lbox_info_cpu_affinity},
+	{"formats", lbox_info_formats},
+	{"snapshot", lbox_info_snapshot},
 	{"vinyl", lbox_info_vinyl},
+	{"wal_async", lbox_info_wal_async},
 	{NULL, NULL}
 };
 
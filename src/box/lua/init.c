@@ -63,7 +63,8 @@ extern char session_lua[],
 	snapshot_daemon_lua[],
 	net_box_lua[],
 	upgrade_lua[],
-	console_lua[];
+	console_lua[],
+	router_lua[];
 
 static const char *lua_sources[] = {
 	"box/session", session_lua,
@@ -72,6 +73,7 @@ static const char *lua_sources[] = {
 	"box/snapshot_daemon", snapshot_daemon_lua,
 	"box/upgrade", upgrade_lua,
 	"box/net_box", net_box_lua,
+	"box/router", router_lua,
 	"box/console", console_lua,
 	"box/load_cfg", load_cfg_lua,
 	NULL
@@ -12,6 +12,7 @@ local default_cfg = {
     memtx_memory        = 256 * 1024 *1024,
     memtx_min_tuple_size = 16,
     memtx_max_tuple_size = 1024 * 1024,
+    memtx_huge_pages    = false,
     slab_alloc_factor   = 1.1,
     work_dir            = nil,
     memtx_dir           = ".",
@@ -29,16 +30,26 @@ local default_cfg = {
     log                 = nil,
     log_nonblock        = true,
     log_level           = 5,
+    log_async           = false,
+    log_rate_limit      = 0, -- msgs/sec per call site, 0 = unlimited
     io_collect_interval = nil,
     readahead           = 16320,
+    cpu_affinity        = nil,
+    fiber_preempt_budget = 10000,
+    iobuf_cache_size    = 16,
+    iproto_threads      = 1,
+    iproto_compression_level = 1,
+    iproto_stream_chunk_size = 16384,
     snap_io_rate_limit  = nil, -- no limit
     too_long_threshold  = 0.5,
+    loop_stall_threshold = 0, -- 0 = watchdog disabled
     wal_mode            = "write",
     rows_per_wal        = 500000,
     wal_max_size        = 1024 * 1024 * 1024 * 256,
     wal_dir_rescan_delay= 2,
     force_recovery      = false,
     replication         = nil,
+    replication_compression_level = 0,
     custom_proc_title   = nil,
     pid_file            = nil,
     background          = false,
@@ -50,6 +61,7 @@ local default_cfg = {
     -- snapshot_daemon
     checkpoint_interval = 0,        -- 0 = disabled
     checkpoint_count    = 6,
+    checkpoint_sink     = nil,      -- no checkpoint streaming
 }
 
 -- types of available options
@@ -59,6 +71,7 @@ local template_cfg = {
     memtx_memory        = 'number',
     memtx_min_tuple_size  = 'number',
     memtx_max_tuple_size  = 'number',
+    memtx_huge_pages    = 'boolean',
     slab_alloc_factor   = 'number',
     work_dir            = 'string',
     memtx_dir            = 'string',
@@ -76,16 +89,26 @@ local template_cfg = {
     log              = 'string',
     log_nonblock     = 'boolean',
     log_level           = 'number',
+    log_async           = 'boolean',
+    log_rate_limit      = 'number',
     io_collect_interval = 'number',
     readahead           = 'number',
+    cpu_affinity        = 'string',
+    fiber_preempt_budget = 'number',
+    iobuf_cache_size    = 'number',
+    iproto_threads      = 'number',
+    iproto_compression_level = 'number',
+    iproto_stream_chunk_size = 'number',
     snap_io_rate_limit  = 'number',
     too_long_threshold  = 'number',
+    loop_stall_threshold = 'number',
     wal_mode            = 'string',
     rows_per_wal        = 'number',
     wal_max_size        = 'number',
     wal_dir_rescan_delay= 'number',
     force_recovery      = 'boolean',
     replication         = 'string, number, table',
+    replication_compression_level = 'number',
     custom_proc_title   = 'string',
     pid_file            = 'string',
     background          = 'boolean',
@@ -93,6 +116,7 @@ local template_cfg = {
     coredump            = 'boolean',
     checkpoint_interval = 'number',
     checkpoint_count    = 'number',
+    checkpoint_sink     = 'string',
     read_only           = 'boolean',
     hot_standby         = 'boolean'
 }
@@ -136,8 +160,12 @@ local dynamic_cfg = {
     log_level               = private.cfg_set_log_level,
     io_collect_interval     = private.cfg_set_io_collect_interval,
     readahead               = private.cfg_set_readahead,
+    fiber_preempt_budget    = private.cfg_set_fiber_preempt_budget,
+    iobuf_cache_size        = private.cfg_set_iobuf_cache_size,
     too_long_threshold      = private.cfg_set_too_long_threshold,
+    loop_stall_threshold    = private.cfg_set_loop_stall_threshold,
     snap_io_rate_limit      = private.cfg_set_snap_io_rate_limit,
+    checkpoint_sink         = private.cfg_set_checkpoint_sink,
     read_only               = private.cfg_set_read_only,
     -- snapshot_daemon
     checkpoint_interval     = box.internal.snapshot_daemon.set_checkpoint_interval,
@@ -36,8 +36,12 @@
 #include "lua/msgpack.h"
 
 #include "box/box.h"
+#include "box/gc.h"
 #include "box/port.h"
+#include "box/iproto.h"
 #include "box/lua/tuple.h"
+#include "salad/guava.h"
+#include "third_party/PMurHash.h"
 
 /** {{{ Miscellaneous utils **/
 
@@ -113,11 +117,93 @@ lbox_select(lua_State *L)
 
 /* }}} */
 
+/** {{{ Traffic capture control, see iproto_capture_start() **/
+
+static int
+lbox_capture_start(lua_State *L)
+{
+	const char *path = luaL_checkstring(L, 1);
+	if (iproto_capture_start(path) != 0)
+		return luaT_error(L);
+	return 0;
+}
+
+static int
+lbox_capture_stop(lua_State *L)
+{
+	if (iproto_capture_stop() != 0)
+		return luaT_error(L);
+	return 0;
+}
+
+/* }}} */
+
+/** {{{ Remote checkpoint registration, see gc_remote_checkpoint() **/
+
+static int
+lbox_gc_remote_checkpoint(lua_State *L)
+{
+	if (lua_gettop(L) != 1) {
+		return luaL_error(L, "Usage "
+				  "box.internal.gc_remote_checkpoint(signature)");
+	}
+	/* luaL_checkint64() also takes cdata, e.g. vclock_sum() output. */
+	int64_t signature = luaL_checkint64(L, 1);
+	if (gc_remote_checkpoint(signature) != 0)
+		return luaT_error(L);
+	return 0;
+}
+
+/* }}} */
+
+/** {{{ Consistent-hash routing, see box/lua/router.lua **/
+
+enum {
+	/**
+	 * Seed of the key hash. Must never change: the bucket of
+	 * a key has to come out the same on every instance of a
+	 * cluster, whatever its version or architecture.
+	 */
+	ROUTER_HASH_SEED = 13U
+};
+
+/**
+ * router_bucket(key, bucket_count) -> bucket id in [1, bucket_count].
+ *
+ * The key (a Lua table with the key parts) is encoded to msgpack
+ * on the fiber region, hashed with PMurHash32 and mapped to a
+ * bucket with the jump consistent hash. Everything happens in C:
+ * resolving a destination costs one hash and no Lua allocations.
+ */
+static int
+lbox_router_bucket(lua_State *L)
+{
+	if (lua_gettop(L) != 2 || lua_type(L, 1) != LUA_TTABLE ||
+	    !lua_isnumber(L, 2)) {
+		return luaL_error(L, "Usage "
+				  "box.internal.router_bucket(key, bucket_count)");
+	}
+	int32_t bucket_count = lua_tointeger(L, 2);
+	if (bucket_count <= 0)
+		return luaL_error(L, "bucket_count must be positive");
+	size_t key_len;
+	const char *key = lbox_encode_tuple_on_gc(L, 1, &key_len);
+	uint32_t h = PMurHash32(ROUTER_HASH_SEED, key, key_len);
+	lua_pushinteger(L, guava(h, bucket_count) + 1);
+	return 1;
+}
+
+/* }}} */
+
 void
 box_lua_misc_init(struct lua_State *L)
 {
 	static const struct luaL_Reg boxlib_internal[] = {
 		{"select", lbox_select},
+		{"capture_start", lbox_capture_start},
+		{"capture_stop", lbox_capture_stop},
+		{"gc_remote_checkpoint", lbox_gc_remote_checkpoint},
+		{"router_bucket", lbox_router_bucket},
 		{NULL, NULL}
 	};
 
@@ -121,6 +121,41 @@ netbox_encode_ping(lua_State *L)
 	return 0;
 }
 
+static int
+netbox_encode_checkpoint(lua_State *L)
+{
+	if (lua_gettop(L) < 3)
+		return luaL_error(L, "Usage: netbox.encode_checkpoint(ibuf, "
+				"sync, schema_version[, vclock])");
+
+	struct mpstream stream;
+	size_t svp = netbox_prepare_request(L, &stream, IPROTO_CHECKPOINT);
+
+	if (lua_istable(L, 4)) {
+		/* Count the vclock components first. */
+		uint32_t size = 0;
+		lua_pushnil(L);
+		while (lua_next(L, 4) != 0) {
+			size++;
+			lua_pop(L, 1);
+		}
+		luamp_encode_map(cfg, &stream, 1);
+		luamp_encode_uint(cfg, &stream, IPROTO_VCLOCK);
+		luamp_encode_map(cfg, &stream, size);
+		lua_pushnil(L);
+		while (lua_next(L, 4) != 0) {
+			luamp_encode_uint(cfg, &stream, lua_tonumber(L, -2));
+			/* An lsn may come in as a cdata. */
+			luamp_encode_uint(cfg, &stream,
+					  luaL_touint64(L, -1));
+			lua_pop(L, 1);
+		}
+	}
+
+	netbox_encode_request(&stream, svp);
+	return 0;
+}
+
 static int
 netbox_encode_auth(lua_State *L)
 {
@@ -569,6 +604,7 @@ luaopen_net_box(struct lua_State *L)
 		{ "encode_update",  netbox_encode_update },
 		{ "encode_upsert",  netbox_encode_upsert },
 		{ "encode_auth",    netbox_encode_auth },
+		{ "encode_checkpoint", netbox_encode_checkpoint },
 		{ "decode_greeting",netbox_decode_greeting },
 		{ "communicate",    netbox_communicate },
 		{ NULL, NULL}
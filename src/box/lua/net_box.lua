@@ -60,6 +60,7 @@ local method_codec           = {
     update  = internal.encode_update,
     upsert  = internal.encode_upsert,
     select  = internal.encode_select,
+    checkpoint = internal.encode_checkpoint,
     -- inject raw data into connection, used by console and tests
     inject = function(buf, id, schema_version, bytes)
         local ptr = buf:reserve(#bytes)
@@ -147,6 +148,13 @@ local function create_transport(host, port, user, password, callback)
     local connection
     local send_buf         = buffer.ibuf(buffer.READAHEAD)
     local recv_buf         = buffer.ibuf(buffer.READAHEAD)
+    -- Batching: how long the worker may hold a non-empty send
+    -- buffer before flushing, so that requests submitted by
+    -- concurrent fibers coalesce into a single write; 0 flushes
+    -- as soon as the event loop permits. Delivered via the
+    -- 'fetch_flush_delay' callback, see the flush_delay connect
+    -- option.
+    local flush_delay      = 0
 
     -- STATE SWITCHING --
     local function set_state(new_state, new_errno, new_error, schema_version)
@@ -300,6 +308,14 @@ local function create_transport(host, port, user, password, callback)
 
     -- IO (WORKER FIBER) --
     local function send_and_recv(limit_or_boundary, timeout)
+        if flush_delay > 0 and state == 'active' and
+           send_buf:size() > 0 then
+            -- Requests queued while the buffer is non-empty do
+            -- not wake the worker up, so the sleep runs its full
+            -- course and everything submitted meanwhile goes out
+            -- in one write below.
+            fiber.sleep(flush_delay)
+        end
         return communicate(connection:fd(), send_buf, recv_buf,
                            limit_or_boundary, timeout)
     end
@@ -351,6 +367,7 @@ local function create_transport(host, port, user, password, callback)
 
     protocol_sm = function ()
         local tm_begin, tm = fiber.time(), callback('fetch_connect_timeout')
+        flush_delay = tonumber(callback('fetch_flush_delay')) or 0
         connection = socket.tcp_connect(host, port, tm)
         if connection == nil then
             return error_sm(E_NO_CONNECTION, errno.strerror(errno()))
@@ -616,6 +633,8 @@ local function connect(...)
             return not opts.console
         elseif what == 'fetch_connect_timeout' then
             return opts.connect_timeout or 10
+        elseif what == 'fetch_flush_delay' then
+            return opts.flush_delay
         elseif what == 'did_fetch_schema' then
             remote:_install_schema(...)
         elseif what == 'will_reconnect' then
@@ -746,6 +765,25 @@ function remote_methods:ping(opts)
     return not err or err == E_WRONG_SCHEMA_VERSION
 end
 
+-- Ask the peer to take a checkpoint, optionally waiting until it
+-- has applied everything up to the given vclock first, e.g.
+-- conn:checkpoint(box.info.vclock). Returns true when the remote
+-- snapshot is durable. Can't go via _request(): a plain OK reply
+-- carries no body[DATA] to decorate.
+function remote_methods:checkpoint(vclock, opts)
+    check_remote_arg(self, 'checkpoint')
+    local err, res
+    repeat
+        err, res = self._transport.perform_request(opts and opts.timeout,
+                                                   nil, 'checkpoint',
+                                                   self.schema_version, vclock)
+        if err == nil then
+            return true
+        end
+    until err ~= E_WRONG_SCHEMA_VERSION
+    box.error({code = err, reason = res})
+end
+
 function remote_methods:reload_schema()
     check_remote_arg(self, 'reload_schema')
     self:_request('select', nil, VSPACE_ID, 0, box.index.GE, 0, 0xFFFFFFFF,
@@ -0,0 +1,124 @@
+-- router.lua (internal file)
+--
+-- Consistent-hash shard router on top of the jump consistent hash
+-- (lib/salad/guava.c). A key is mapped to a virtual bucket by
+-- box.internal.router_bucket() - msgpack encoding, hashing and the
+-- jump hash all happen in C - and the bucket is mapped to a
+-- replica set through a flat FFI array, so resolving a destination
+-- is one C call and one array load.
+
+local ffi = require('ffi')
+local internal = require('box.internal')
+
+-- digest.lua declares guava too; whoever loads first wins.
+pcall(ffi.cdef, [[
+    extern int32_t guava(int64_t state, int32_t buckets);
+]])
+local builtin = ffi.C
+
+local DEFAULT_BUCKET_COUNT = 16384
+
+--
+-- Fill the bucket -> replica set id map. The jump hash guarantees
+-- that when a replica set is appended only ~1/N of the buckets
+-- change hands, and all of them move to the new member.
+--
+local function router_rebuild_map(router)
+    local count = #router.replicasets
+    local map = router._map
+    for bucket = 0, router.bucket_count - 1 do
+        map[bucket] = builtin.guava(bucket, count) + 1
+    end
+end
+
+local function replicaset_connect(replicaset)
+    if replicaset.conn == nil then
+        replicaset.conn = require('net.box').connect(replicaset.uri)
+    end
+    return replicaset.conn
+end
+
+local router_methods = {}
+
+-- Bucket of a key, in [1, bucket_count]. A scalar key is treated
+-- as a one-part key.
+function router_methods:bucket(key)
+    if type(key) ~= 'table' then
+        key = { key }
+    end
+    return internal.router_bucket(key, self.bucket_count)
+end
+
+-- Replica set owning the given bucket.
+function router_methods:replicaset(bucket)
+    if type(bucket) ~= 'number' or bucket < 1 or
+       bucket > self.bucket_count then
+        box.error(box.error.ILLEGAL_PARAMS, 'bucket is out of range')
+    end
+    return self.replicasets[self._map[bucket - 1]]
+end
+
+-- Replica set owning the given key.
+function router_methods:route(key)
+    return self:replicaset(self:bucket(key))
+end
+
+-- Forward a call to the replica set owning the key. Connections
+-- are established lazily and reused.
+function router_methods:call(key, func, args, opts)
+    local conn = replicaset_connect(self:route(key))
+    return conn:call(func, args, opts)
+end
+
+function router_methods:add_replicaset(uri)
+    table.insert(self.replicasets, { uri = uri })
+    router_rebuild_map(self)
+end
+
+function router_methods:info()
+    local replicasets = {}
+    for id, replicaset in ipairs(self.replicasets) do
+        replicasets[id] = { uri = replicaset.uri, buckets = 0 }
+    end
+    for bucket = 0, self.bucket_count - 1 do
+        local stat = replicasets[self._map[bucket]]
+        stat.buckets = stat.buckets + 1
+    end
+    return { bucket_count = self.bucket_count, replicasets = replicasets }
+end
+
+function router_methods:close()
+    for _, replicaset in ipairs(self.replicasets) do
+        if replicaset.conn ~= nil then
+            replicaset.conn:close()
+            replicaset.conn = nil
+        end
+    end
+end
+
+local router_mt = { __index = router_methods }
+
+local function router_new(cfg)
+    if type(cfg) ~= 'table' or type(cfg.replicasets) ~= 'table' or
+       #cfg.replicasets == 0 then
+        box.error(box.error.ILLEGAL_PARAMS,
+                  'router.new() expects a non-empty array of replica set URIs')
+    end
+    local bucket_count = cfg.bucket_count or DEFAULT_BUCKET_COUNT
+    if type(bucket_count) ~= 'number' or bucket_count < 1 then
+        box.error(box.error.ILLEGAL_PARAMS, 'bucket_count must be positive')
+    end
+    local replicasets = {}
+    for id, uri in ipairs(cfg.replicasets) do
+        replicasets[id] = { uri = uri }
+    end
+    local router = setmetatable({
+        bucket_count = bucket_count,
+        replicasets = replicasets,
+        _map = ffi.new('uint32_t[?]', bucket_count),
+    }, router_mt)
+    router_rebuild_map(router)
+    return router
+end
+
+box.router = { new = router_new }
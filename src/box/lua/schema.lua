@@ -242,6 +242,11 @@ box.schema.space.create = function(name, options)
         user = 'string, number',
         format = 'table',
         temporary = 'boolean',
+        memory_limit = 'number',
+        async_commit = 'boolean',
+        ttl_field = 'number',
+        min_field_count = 'number',
+        stale_read_ttl = 'number',
     }
     local options_defaults = {
         engine = 'memtx',
@@ -283,6 +288,11 @@ box.schema.space.create = function(name, options)
     -- filter out global parameters from the options array
     local space_options = setmetatable({
         temporary = options.temporary and true or nil,
+        memory_limit = options.memory_limit,
+        async_commit = options.async_commit and true or nil,
+        ttl_field = options.ttl_field,
+        min_field_count = options.min_field_count,
+        stale_read_ttl = options.stale_read_ttl,
     }, { __serialize = 'map' })
     _space:insert{id, uid, name, options.engine, options.field_count,
         space_options, format}
@@ -304,6 +314,13 @@ end
 
 box.schema.create_space = box.schema.space.create
 
+-- Cached next id per space for space:auto_increment(). Seeded from
+-- the primary key max on first use, then advanced locally, so id
+-- assignment does not pay a tree descent per insert. Dropped with
+-- the space; recovery re-seeds from the data, so the counter needs
+-- no record of its own in the WAL.
+local auto_increment_next = {}
+
 box.schema.space.drop = function(space_id, space_name, opts)
     check_param(space_id, 'space_id', 'number')
     opts = opts or {}
@@ -328,6 +345,7 @@ box.schema.space.drop = function(space_id, space_name, opts)
             box.error(box.error.NO_SUCH_SPACE, space_name)
         end
     end
+    auto_increment_next[space_id] = nil
 end
 
 box.schema.space.rename = function(space_id, space_name)
@@ -395,6 +413,8 @@ box.schema.index.create = function(space_id, name, options)
         range_size = 'number',
         run_count_per_level = 'number',
         run_size_ratio = 'number',
+        cache_size = 'number',
+        compaction_policy = 'string',
     }
     check_param_table(options, options_template)
     local options_defaults = {
@@ -462,6 +482,8 @@ box.schema.index.create = function(space_id, name, options)
             range_size = options.range_size,
             run_count_per_level = options.run_count_per_level,
             run_size_ratio = options.run_size_ratio,
+            cache_size = options.cache_size,
+            compaction_policy = options.compaction_policy,
             lsn = box.info.signature,
     }
     local field_type_aliases = {
@@ -961,6 +983,16 @@ function box.schema.space.bless(space)
             index_mt[op] = index_mt[op .. "_ffi"]
         end
     end
+    -- Columnar projection: decode only the given fields of every
+    -- tuple into dense per-field arrays, for aggregations over a
+    -- few fields of wide tuples.
+    index_mt.project = function(index, fields)
+        check_index_arg(index, 'project')
+        if type(fields) ~= 'table' then
+            fields = { fields }
+        end
+        return internal.project(index.space_id, index.id, fields)
+    end
     index_mt.__pairs = index_mt.pairs -- Lua 5.2 compatibility
     index_mt.__ipairs = index_mt.pairs -- Lua 5.2 compatibility
     --
@@ -1031,13 +1063,29 @@ function box.schema.space.bless(space)
 -- primary key and returns it back to the user
     space_mt.auto_increment = function(space, tuple)
         check_space_arg(space, 'auto_increment')
-        local max_tuple = check_primary_index(space):max()
-        local max = 0
-        if max_tuple ~= nil then
-            max = max_tuple[1]
+        local id = auto_increment_next[space.id]
+        if id == nil then
+            local max_tuple = check_primary_index(space):max()
+            local max = 0
+            if max_tuple ~= nil then
+                max = max_tuple[1]
+            end
+            id = max + 1
+        end
+        -- Claim the id before the insert: the insert may yield on
+        -- the WAL and another fiber must not hand out the same id
+        -- meanwhile. A failed insert leaves a gap, like any
+        -- sequence would.
+        auto_increment_next[space.id] = id + 1
+        table.insert(tuple, 1, id)
+        local ok, res = pcall(space.insert, space, tuple)
+        if not ok then
+            -- An out-of-band insert may have overtaken the
+            -- counter; re-seed from the data on the next call.
+            auto_increment_next[space.id] = nil
+            error(res)
         end
-        table.insert(tuple, 1, max + 1)
-        return space:insert(tuple)
+        return res
     end
 
     space_mt.pairs = function(space, key, opts)
@@ -1053,6 +1101,7 @@ function box.schema.space.bless(space)
     space_mt.__ipairs = space_mt.pairs -- Lua 5.2 compatibility
     space_mt.truncate = function(space)
         check_space_arg(space, 'truncate')
+        auto_increment_next[space.id] = nil
         return internal.truncate(space.id)
     end
     space_mt.format = function(space, format)
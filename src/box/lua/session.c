@@ -37,6 +37,7 @@
 #include <lualib.h>
 #include <sio.h>
 
+#include "box/authentication.h"
 #include "box/box.h"
 #include "box/session.h"
 #include "box/user.h"
@@ -119,6 +120,61 @@ lbox_session_user(struct lua_State *L)
 	return 1;
 }
 
+/**
+ * Issue a session resumption token for the session user. The
+ * returned binary string may be presented on the next reconnect
+ * as the data of the "token" authentication mechanism, skipping
+ * the scramble exchange.
+ */
+static int
+lbox_session_token(struct lua_State *L)
+{
+	char token[RESUME_TOKEN_SIZE];
+	if (resume_token_issue(current_session()->credentials.uid,
+			       token) != 0)
+		return luaT_error(L);
+	lua_pushlstring(L, token, RESUME_TOKEN_SIZE);
+	return 1;
+}
+
+/**
+ * Set the deadline of the current request timeout seconds from
+ * now. Once it expires, iterator steps of this request fail with
+ * ER_DEADLINE_EXCEEDED. A nil or zero timeout disarms the
+ * deadline. Returns the previous deadline (absolute event loop
+ * time) or 0.
+ */
+static int
+lbox_session_set_deadline(struct lua_State *L)
+{
+	double timeout = luaL_optnumber(L, 1, 0);
+	if (timeout < 0)
+		return luaL_error(L, "Usage: box.session.set_deadline([timeout])");
+	struct session *session = current_session();
+	lua_pushnumber(L, session->deadline);
+	session->deadline = timeout > 0 ? fiber_time() + timeout : 0;
+	return 1;
+}
+
+/**
+ * Set the default per-request timeout of the session, in
+ * seconds. Every subsequent iproto request starts with
+ * deadline = now + timeout, so worst-case request cost is capped
+ * without explicit checks in stored procedures. A nil or zero
+ * timeout disables the cap. Returns the previous value.
+ */
+static int
+lbox_session_set_request_timeout(struct lua_State *L)
+{
+	double timeout = luaL_optnumber(L, 1, 0);
+	if (timeout < 0)
+		return luaL_error(L, "Usage: box.session.set_request_timeout([timeout])");
+	struct session *session = current_session();
+	lua_pushnumber(L, session->request_timeout);
+	session->request_timeout = timeout;
+	return 1;
+}
+
 /** Session user id. */
 static int
 lbox_session_su(struct lua_State *L)
@@ -339,9 +395,12 @@ box_lua_session_init(struct lua_State *L)
 		{"fd", lbox_session_fd},
 		{"exists", lbox_session_exists},
 		{"peer", lbox_session_peer},
+		{"token", lbox_session_token},
 		{"on_connect", lbox_session_on_connect},
 		{"on_disconnect", lbox_session_on_disconnect},
 		{"on_auth", lbox_session_on_auth},
+		{"set_deadline", lbox_session_set_deadline},
+		{"set_request_timeout", lbox_session_set_request_timeout},
 		{NULL, NULL}
 	};
 	luaL_register_module(L, sessionlib_name, sessionlib);
@@ -41,10 +41,22 @@
 #include "small/small.h"
 #include "small/quota.h"
 #include "memory.h"
+#include "iobuf.h"
+#include "box/tuple_format.h"
+#include "box/memtx_tuple.h"
 
 extern struct small_alloc memtx_alloc;
 extern struct mempool memtx_index_extent_pool;
 
+/* Online compaction controls, defined in memtx_engine.cc. */
+int
+memtx_compact_start(uint32_t tuples_per_batch);
+void
+memtx_compact_stop(void);
+void
+memtx_compact_progress(uint64_t *tuples_moved, uint64_t *bytes_moved,
+		       bool *is_running);
+
 static int
 small_stats_noop_cb(const struct mempool_stats *stats, void *cb_ctx)
 {
@@ -99,10 +111,61 @@ small_stats_lua_cb(const struct mempool_stats *stats, void *cb_ctx)
 	luaL_pushuint64(L, stats->objcount);
 	lua_settable(L, -3);
 
+	/*
+	 * Share of the memory reserved by the class which holds
+	 * actual items: the per-class fragmentation gauge.
+	 */
+	char ratio_buf[32];
+	double ratio = 100 * ((double) stats->totals.used /
+			      ((double) stats->totals.total + 0.0001));
+	snprintf(ratio_buf, sizeof(ratio_buf), "%0.1lf%%", ratio);
+	lua_pushstring(L, "mem_used_ratio");
+	lua_pushstring(L, ratio_buf);
+	lua_settable(L, -3);
+
+	lua_settable(L, -3);
+	return 0;
+}
+
+/**
+ * Add a row of box.slab.tuples() for one tuple format: the live
+ * tuple count and bytes of the format, readable per space through
+ * box.space.<name>.format_id. Spaces with identical definitions
+ * share one interned format and thus one row.
+ */
+static int
+tuple_format_stats_lua_cb(const struct tuple_format *format, void *cb_ctx)
+{
+	struct lua_State *L = (struct lua_State *) cb_ctx;
+
+	lua_pushnumber(L, lua_objlen(L, -1) + 1);
+	lua_newtable(L);
+	luaL_setmaphint(L, -1);
+
+	lua_pushstring(L, "format_id");
+	luaL_pushuint64(L, format->id);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "tuple_count");
+	luaL_pushuint64(L, format->tuple_count);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "mem_used");
+	luaL_pushuint64(L, format->tuple_mem_used);
+	lua_settable(L, -3);
+
 	lua_settable(L, -3);
 	return 0;
 }
 
+static int
+lbox_slab_tuples(struct lua_State *L)
+{
+	lua_newtable(L);
+	tuple_format_mem_stats_foreach(tuple_format_stats_lua_cb, L);
+	return 1;
+}
+
 static int
 lbox_slab_stats(struct lua_State *L)
 {
@@ -185,6 +248,15 @@ lbox_slab_info(struct lua_State *L)
 	lua_pushstring(L, ratio_buf);
 	lua_settable(L, -3);
 
+	/*
+	 * Page size backing the arena mapping: the system page
+	 * size, or the huge page size when box.cfg.memtx_huge_pages
+	 * reserved huge pages successfully.
+	 */
+	lua_pushstring(L, "arena_page_size");
+	luaL_pushuint64(L, memtx_tuple_arena_page_size());
+	lua_settable(L, -3);
+
 	/*
 	 * This is pretty much the same as
 	 * box.cfg.slab_alloc_arena, but in bytes
@@ -215,9 +287,92 @@ lbox_slab_info(struct lua_State *L)
 	lua_pushstring(L, ratio_buf);
 	lua_settable(L, -3);
 
+	/*
+	 * Share of the booked quota which holds no data: the
+	 * slack inside slab classes plus slabs not formatted for
+	 * any class yet. This is the memory which counts against
+	 * the quota but cannot be seen in items_used/arena_used,
+	 * i.e. what people call fragmentation when OOM arrives
+	 * earlier than the data size promises.
+	 */
+	ratio = 100 * (1 - ((double) (totals.used +
+				      index_stats.totals.used) /
+			    ((double) quota_used(memtx_quota) + 0.0001)));
+	if (ratio < 0)
+		ratio = 0;
+	snprintf(ratio_buf, sizeof(ratio_buf), "%0.1lf%%", ratio);
+
+	lua_pushstring(L, "fragmentation_ratio");
+	lua_pushstring(L, ratio_buf);
+	lua_settable(L, -3);
+
+	/*
+	 * The tx cord's cache of idle iobufs, see
+	 * box.cfg.iobuf_cache_size. The hit/miss counters tell
+	 * whether the cache is sized right for the connection
+	 * churn.
+	 */
+	struct iobuf_cache_stats iobuf_stats;
+	iobuf_cache_stats_get(&iobuf_stats);
+
+	lua_pushstring(L, "iobuf_cache_count");
+	luaL_pushuint64(L, iobuf_stats.count);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "iobuf_cache_used");
+	luaL_pushuint64(L, iobuf_stats.used);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "iobuf_cache_hits");
+	luaL_pushuint64(L, iobuf_stats.hits);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "iobuf_cache_misses");
+	luaL_pushuint64(L, iobuf_stats.misses);
+	lua_settable(L, -3);
+
+	/* Online compaction progress, see box.slab.compact(). */
+	uint64_t tuples_moved, bytes_moved;
+	bool is_running;
+	memtx_compact_progress(&tuples_moved, &bytes_moved, &is_running);
+
+	lua_pushstring(L, "compaction_running");
+	lua_pushboolean(L, is_running);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "compaction_tuples_moved");
+	luaL_pushuint64(L, tuples_moved);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "compaction_bytes_moved");
+	luaL_pushuint64(L, bytes_moved);
+	lua_settable(L, -3);
+
 	return 1;
 }
 
+/**
+ * Start the online memtx compaction fiber: box.slab.compact(),
+ * with the number of tuples relocated per scheduling slot as an
+ * optional pace argument. box.slab.compact(false) stops a
+ * running compaction.
+ */
+static int
+lbox_slab_compact(struct lua_State *L)
+{
+	if (lua_gettop(L) >= 1 && lua_isboolean(L, 1) &&
+	    !lua_toboolean(L, 1)) {
+		memtx_compact_stop();
+		return 0;
+	}
+	uint32_t batch = 0;
+	if (lua_gettop(L) >= 1)
+		batch = (uint32_t) lua_tonumber(L, 1);
+	if (memtx_compact_start(batch) != 0)
+		return luaL_error(L, "compaction is already running");
+	return 0;
+}
+
 static int
 lbox_runtime_info(struct lua_State *L)
 {
@@ -264,6 +419,14 @@ box_lua_slab_init(struct lua_State *L)
 	lua_pushcfunction(L, lbox_slab_stats);
 	lua_settable(L, -3);
 
+	lua_pushstring(L, "tuples");
+	lua_pushcfunction(L, lbox_slab_tuples);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "compact");
+	lua_pushcfunction(L, lbox_slab_compact);
+	lua_settable(L, -3);
+
 	lua_pushstring(L, "check");
 	lua_pushcfunction(L, lbox_slab_check);
 	lua_settable(L, -3);
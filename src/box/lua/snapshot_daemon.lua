@@ -10,13 +10,48 @@ local pickle = require 'pickle'
 
 local PREFIX = 'snapshot_daemon'
 
+-- Load-aware scheduling: when the timer fires the snapshot is
+-- deferred while the instance is busy, so that it lands in a
+-- low-traffic window instead of peak hours. Traffic is the total
+-- request rate from box.stat() (rmean-backed moving averages);
+-- the daemon keeps an exponential average of it as the baseline
+-- and considers the window low-traffic when the current rate
+-- drops below LOAD_LOW_WATERMARK of that baseline. A snapshot is
+-- deferred for at most SNAPSHOT_DEFER_MAX_FACTOR of the
+-- checkpoint interval, then it is taken regardless of load.
+local LOAD_EMA_ALPHA            = 0.1
+local LOAD_LOW_WATERMARK        = 0.5
+local SNAPSHOT_DEFER_MAX_FACTOR = 0.25
+local SNAPSHOT_DEFER_RETRY      = 60
+
 local daemon = {
     checkpoint_interval = 0;
     checkpoint_count = 6;
     fiber = nil;
     control = nil;
+    load_avg = nil;
 }
 
+local function total_rps()
+    local total = 0
+    for _, stat in pairs(box.stat()) do
+        if type(stat) == 'table' and stat.rps ~= nil then
+            total = total + stat.rps
+        end
+    end
+    return total
+end
+
+local function update_load_avg(rps)
+    if daemon.load_avg == nil then
+        daemon.load_avg = rps
+    else
+        daemon.load_avg = daemon.load_avg +
+            LOAD_EMA_ALPHA * (rps - daemon.load_avg)
+    end
+    return daemon.load_avg
+end
+
 -- create snapshot, return true if no errors
 local function snapshot()
     log.info("making snapshot...")
@@ -86,6 +121,34 @@ local function process(self)
     end
 end
 
+-- Wait for a low-traffic window, checking the control channel
+-- while waiting. Returns a control message if one arrives, nil
+-- when it is time to snapshot.
+local function wait_low_traffic(self)
+    local deadline = fiber.time() +
+        SNAPSHOT_DEFER_MAX_FACTOR * self.checkpoint_interval
+    while true do
+        local rps = total_rps()
+        local avg = update_load_avg(rps)
+        if rps <= LOAD_LOW_WATERMARK * avg then
+            return nil
+        end
+        local timeout = deadline - fiber.time()
+        if timeout <= 0 then
+            log.info("deferred snapshot reached its deadline, " ..
+                     "proceeding at %d rps", rps)
+            return nil
+        end
+        log.info("snapshot deferred for up to %d seconds: " ..
+                 "request rate %d rps is above %d%% of the average %d rps",
+                 timeout, rps, LOAD_LOW_WATERMARK * 100, avg)
+        local msg = self.control:get(math.min(SNAPSHOT_DEFER_RETRY, timeout))
+        if msg ~= nil then
+            return msg
+        end
+    end
+end
+
 local function daemon_fiber(self)
     fiber.name(PREFIX)
     log.info("started")
@@ -110,11 +173,18 @@ local function daemon_fiber(self)
         elseif msg == 'reload' then
             log.info("reloaded") -- continue
         elseif msg == nil and box.info.status == 'running' then
-            local s, e = pcall(process, self)
-            if not s then
-                log.error(e)
+            msg = wait_low_traffic(self)
+            if msg == 'shutdown' then
+                break
+            elseif msg == 'reload' then
+                log.info("reloaded") -- continue
+            else
+                local s, e = pcall(process, self)
+                if not s then
+                    log.error(e)
+                end
+                offset = 0
             end
-            offset = 0
         end
     end
     self.next_snapshot_time = nil
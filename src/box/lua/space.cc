@@ -41,6 +41,7 @@ extern "C" {
 
 #include "box/space.h"
 #include "box/schema.h"
+#include "box/tuple_format.h"
 #include "box/user_def.h"
 #include "box/tuple.h"
 #include "box/txn.h"
@@ -125,6 +126,16 @@ lbox_fillspace(struct lua_State *L, struct space *space, int i)
 	lua_pushstring(L, space->def.engine_name);
 	lua_settable(L, i);
 
+	/*
+	 * space.format_id: the key into box.slab.tuples(), which
+	 * attributes tuple memory to formats.
+	 */
+	if (space->format != NULL) {
+		lua_pushstring(L, "format_id");
+		lua_pushnumber(L, tuple_format_id(space->format));
+		lua_settable(L, i);
+	}
+
 	lua_pushstring(L, "enabled");
 	lua_pushboolean(L, space_index(space, 0) != 0);
 	lua_settable(L, i);
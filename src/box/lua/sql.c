@@ -10,6 +10,15 @@
 struct prep_stmt
 {
 	sqlite3_stmt *stmt;
+	/*
+	 * Cache key of the statement: the unconsumed input text
+	 * at prepare time and how much of it this statement
+	 * covers. Points into the Lua string, which stays on the
+	 * stack for the duration of the call.
+	 */
+	const char *sql;
+	int sql_len;
+	int consumed;
 };
 
 struct prep_stmt_list
@@ -39,8 +48,19 @@ prep_stmt_list_free(struct prep_stmt_list *l)
 {
 	if (l == NULL)
 		return;
-	for (size_t i = 0, n = l->stmt_count; i < n; i++)
-		sqlite3_finalize(l->stmt[i].stmt);
+	for (size_t i = 0, n = l->stmt_count; i < n; i++) {
+		struct prep_stmt *ps = &l->stmt[i];
+		/* A failed prepare leaves a NULL statement behind. */
+		if (ps->stmt == NULL)
+			continue;
+		/*
+		 * Hand finished statements over to the cache
+		 * instead of finalizing, so a repeated text skips
+		 * the parser and planner next time.
+		 */
+		sql_stmt_cache_put(ps->sql, ps->sql_len, ps->consumed,
+				   ps->stmt);
+	}
 	if (prep_stmt_list_needs_free(l))
 		free(l);
 }
@@ -162,7 +182,14 @@ lua_push_row(struct lua_State *L, struct prep_stmt_list *l)
 			lua_pushnumber(L, sqlite3_column_double(stmt, i));
 			break;
 		case SQLITE_TEXT: {
-			const void *text = sqlite3_column_text(stmt, i);
+			/*
+			 * Result strings may be unterminated references
+			 * into the cursor row (see OPFLAG_EPHEM in
+			 * OP_Column); fetching them as a blob avoids the
+			 * copy sqlite3_column_text() would make just to
+			 * NUL-terminate, which Lua does not need.
+			 */
+			const void *text = sqlite3_column_blob(stmt, i);
 			typestr[i] = 's';
 			lua_pushlstring(L, text,
 					sqlite3_column_bytes(stmt, i));
@@ -215,10 +242,20 @@ lua_sql_execute(struct lua_State *L)
 		struct prep_stmt *ps = prep_stmt_list_push(&l);
 		if (ps == NULL)
 			goto outofmem;
-		rc = sqlite3_prepare_v2(db, sql, (int)(sql_end - sql),
-					&ps->stmt, &sql);
-		if (rc != SQLITE_OK)
-			goto sqlerror;
+		ps->sql = sql;
+		ps->sql_len = (int)(sql_end - sql);
+		ps->stmt = sql_stmt_cache_get(sql, ps->sql_len,
+					      &ps->consumed);
+		if (ps->stmt != NULL) {
+			sql += ps->consumed;
+		} else {
+			rc = sqlite3_prepare_v2(db, sql,
+						(int)(sql_end - sql),
+						&ps->stmt, &sql);
+			if (rc != SQLITE_OK)
+				goto sqlerror;
+			ps->consumed = (int)(sql - ps->sql);
+		}
 
 		if (ps->stmt == NULL) {
 			/* only whitespace */
@@ -275,11 +312,49 @@ outofmem:
 	return luaL_error(L, "out of memory");
 }
 
+/*
+ * box.sql.debug([enable]) - runtime introspection.
+ *
+ * With a boolean argument switches the vdbe profiler on or off
+ * (switching it on resets the counters). Always returns a table:
+ *
+ *   vdbe_profiler - whether the profiler is currently on;
+ *   vdbe          - per-opcode {count, cycles} of every opcode
+ *                   executed since the profiler was enabled.
+ */
+static int
+lua_sql_debug(struct lua_State *L)
+{
+	if (lua_gettop(L) >= 1)
+		sql_vdbe_profiler_enable(lua_toboolean(L, 1));
+
+	lua_createtable(L, 0, 2);
+	lua_pushboolean(L, sql_vdbe_profiler_is_enabled());
+	lua_setfield(L, -2, "vdbe_profiler");
+	lua_newtable(L);
+	for (int opcode = 0; opcode < 256; opcode++) {
+		const char *name;
+		uint64_t count, cycles;
+		if (sql_vdbe_profiler_stat(opcode, &name, &count,
+					   &cycles) != 0 || count == 0)
+			continue;
+		lua_createtable(L, 0, 2);
+		luaL_pushuint64(L, count);
+		lua_setfield(L, -2, "count");
+		luaL_pushuint64(L, cycles);
+		lua_setfield(L, -2, "cycles");
+		lua_setfield(L, -2, name);
+	}
+	lua_setfield(L, -2, "vdbe");
+	return 1;
+}
+
 void
 box_lua_sqlite_init(struct lua_State *L)
 {
 	static const struct luaL_Reg module_funcs [] = {
 		{"execute", lua_sql_execute},
+		{"debug", lua_sql_debug},
 		{NULL, NULL}
 	};
 
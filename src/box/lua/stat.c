@@ -34,6 +34,15 @@
 #include <string.h>
 #include <rmean.h>
 
+#include "backtrace.h"
+#include "box/alloc_stat.h"
+#include "fiber.h"
+#include "iobuf.h"
+#include "profiler.h"
+#include "box/iproto.h"
+#include "box/iproto_constants.h"
+#include "box/wal.h"
+
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
@@ -42,8 +51,6 @@
 
 extern struct rmean *rmean_box;
 extern struct rmean *rmean_error;
-/** network statistics (iproto & cbus) */
-extern struct rmean *rmean_net;
 extern struct rmean *rmean_tx_wal_bus;
 
 static void
@@ -109,18 +116,388 @@ lbox_stat_call(struct lua_State *L)
 	return 1;
 }
 
+/**
+ * Requests are served by tx pool fibers, so the reuse ratio of
+ * the fiber cache shows how often a request had to pay for a
+ * cold fiber stack. These are plain counters, not averages,
+ * hence no "rps" field.
+ */
+static void
+fill_plain_stat_item(struct lua_State *L, const char *name, int64_t total)
+{
+	lua_pushstring(L, name);
+	lua_newtable(L);
+
+	lua_pushstring(L, "total");
+	lua_pushnumber(L, total);
+	lua_settable(L, -3);
+
+	lua_settable(L, -3);
+}
+
+static int
+seek_fiber_cache_item(struct lua_State *L)
+{
+	int64_t hits, misses;
+	fiber_cache_stat(&hits, &misses);
+
+	int64_t total;
+	if (strcmp(lua_tostring(L, -1), "FIBERS_REUSED") == 0)
+		total = hits;
+	else if (strcmp(lua_tostring(L, -1), "FIBERS_CREATED") == 0)
+		total = misses;
+	else
+		return 0;
+
+	lua_newtable(L);
+	lua_pushstring(L, "total");
+	lua_pushnumber(L, total);
+	lua_settable(L, -3);
+
+	return 1;
+}
+
+/**
+ * Occupancy of the per-cord idle iobuf caches, summed over all
+ * cords - with several net threads a connection may be served by
+ * any of them. Plain counters, like the fiber cache above.
+ */
+static int
+seek_iobuf_cache_item(struct lua_State *L)
+{
+	struct iobuf_cache_stats stats;
+	iobuf_cache_stats_get_all(&stats);
+
+	int64_t total;
+	if (strcmp(lua_tostring(L, -1), "IOBUFS_PARKED") == 0)
+		total = stats.count;
+	else if (strcmp(lua_tostring(L, -1), "IOBUFS_REUSED") == 0)
+		total = stats.hits;
+	else if (strcmp(lua_tostring(L, -1), "IOBUFS_CREATED") == 0)
+		total = stats.misses;
+	else
+		return 0;
+
+	lua_newtable(L);
+	lua_pushstring(L, "total");
+	lua_pushnumber(L, total);
+	lua_settable(L, -3);
+
+	return 1;
+}
+
 static int
 lbox_stat_net_index(struct lua_State *L)
 {
 	luaL_checkstring(L, -1);
-	return rmean_foreach(rmean_net, seek_stat_item, L);
+	int res = iproto_rmean_foreach(seek_stat_item, L);
+	if (res)
+		return res;
+	res = seek_fiber_cache_item(L);
+	if (res)
+		return res;
+	return seek_iobuf_cache_item(L);
 }
 
 static int
 lbox_stat_net_call(struct lua_State *L)
 {
 	lua_newtable(L);
-	rmean_foreach(rmean_net, set_stat_item, L);
+	iproto_rmean_foreach(set_stat_item, L);
+
+	int64_t hits, misses;
+	fiber_cache_stat(&hits, &misses);
+	fill_plain_stat_item(L, "FIBERS_REUSED", hits);
+	fill_plain_stat_item(L, "FIBERS_CREATED", misses);
+
+	struct iobuf_cache_stats iobuf_stats;
+	iobuf_cache_stats_get_all(&iobuf_stats);
+	fill_plain_stat_item(L, "IOBUFS_PARKED", iobuf_stats.count);
+	fill_plain_stat_item(L, "IOBUFS_REUSED", iobuf_stats.hits);
+	fill_plain_stat_item(L, "IOBUFS_CREATED", iobuf_stats.misses);
+	return 1;
+}
+
+static void
+fill_stat_histogram(struct lua_State *L, const char *name,
+		    int64_t p50, int64_t p90, int64_t p99, int64_t max)
+{
+	lua_pushstring(L, name);
+	lua_newtable(L);
+
+	lua_pushstring(L, "p50");
+	lua_pushnumber(L, p50);
+	lua_settable(L, -3);
+
+	if (p90 >= 0) {
+		lua_pushstring(L, "p90");
+		lua_pushnumber(L, p90);
+		lua_settable(L, -3);
+	}
+
+	lua_pushstring(L, "p99");
+	lua_pushnumber(L, p99);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "max");
+	lua_pushnumber(L, max);
+	lua_settable(L, -3);
+
+	lua_settable(L, -3);
+}
+
+/**
+ * box.stat.wal() - how well journal entries coalesce into WAL
+ * write batches, what write() and fsync() cost and how long
+ * batches wait in the writer queue. Empty table if the WAL
+ * keeps no statistics (wal_mode = 'none').
+ */
+static int
+lbox_stat_wal(struct lua_State *L)
+{
+	struct wal_stat stat;
+	lua_newtable(L);
+	if (wal_stat(&stat) != 0)
+		return 1;
+
+	lua_pushstring(L, "batches");
+	lua_pushnumber(L, stat.batches);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "rows");
+	lua_pushnumber(L, stat.rows);
+	lua_settable(L, -3);
+
+	fill_stat_histogram(L, "rows_per_batch", stat.rows_per_batch_p50,
+			    stat.rows_per_batch_p90, stat.rows_per_batch_p99,
+			    stat.rows_per_batch_max);
+
+	lua_pushstring(L, "fsyncs");
+	lua_pushnumber(L, stat.fsyncs);
+	lua_settable(L, -3);
+
+	fill_stat_histogram(L, "fsync_delay_us", stat.fsync_delay_p50,
+			    -1, stat.fsync_delay_p99, stat.fsync_delay_max);
+
+	lua_pushstring(L, "bytes_written");
+	lua_pushnumber(L, stat.bytes_written);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "write_time");
+	lua_pushnumber(L, stat.write_time);
+	lua_settable(L, -3);
+
+	lua_pushstring(L, "fsync_time");
+	lua_pushnumber(L, stat.fsync_time);
+	lua_settable(L, -3);
+
+	fill_stat_histogram(L, "queue_wait_us", stat.queue_wait_p50,
+			    -1, stat.queue_wait_p99, stat.queue_wait_max);
+
+	return 1;
+}
+
+/**
+ * box.stat.preempt() - how often fibers of the tx cord ran out
+ * of their preemption budget and how long the cord had been
+ * stalled by the time the forced yield cut the stall short.
+ */
+static int
+lbox_stat_preempt(struct lua_State *L)
+{
+	struct fiber_preempt_stat stat;
+	fiber_preempt_stat(&stat);
+	lua_newtable(L);
+
+	lua_pushstring(L, "yields");
+	lua_pushnumber(L, stat.yields);
+	lua_settable(L, -3);
+
+	if (stat.yields > 0)
+		fill_stat_histogram(L, "stall_us", stat.stall_p50, -1,
+				    stat.stall_p99, stat.stall_max);
+
+	return 1;
+}
+
+/**
+ * box.stat.trace([rate]) - sampled request traces. With a
+ * numeric argument, sets the sampling rate: every rate-th iproto
+ * request is traced, 0 turns tracing off. Without arguments,
+ * returns the ring of recently completed traces; each entry
+ * carries the request type, the absolute receive timestamp and
+ * the time spent in every pipeline stage, in seconds:
+ * queue   - waiting between the net and tx threads,
+ * execute - tx processing, including the journal write,
+ * flush   - from response completion to output scheduling.
+ */
+static int
+lbox_stat_trace(struct lua_State *L)
+{
+	if (lua_gettop(L) > 0) {
+		int rate = luaL_checkinteger(L, 1);
+		if (rate < 0)
+			return luaL_error(L, "Usage: box.stat.trace([rate])");
+		iproto_trace_set_rate(rate);
+		return 0;
+	}
+	lua_newtable(L);
+	int n = 0;
+	for (int i = 0; i < IPROTO_TRACE_RING_SIZE; i++) {
+		struct iproto_trace t;
+		if (iproto_trace_read(i, &t) != 0)
+			continue;
+		const char *name = iproto_type_name(t.type);
+		lua_newtable(L);
+		lua_pushstring(L, name != NULL ? name : "UNKNOWN");
+		lua_setfield(L, -2, "type");
+		lua_pushnumber(L, t.t_recv);
+		lua_setfield(L, -2, "recv");
+		lua_pushnumber(L, t.t_tx - t.t_recv);
+		lua_setfield(L, -2, "queue");
+		lua_pushnumber(L, t.t_done - t.t_tx);
+		lua_setfield(L, -2, "execute");
+		lua_pushnumber(L, t.t_sent - t.t_done);
+		lua_setfield(L, -2, "flush");
+		lua_rawseti(L, -2, ++n);
+	}
+	return 1;
+}
+
+/**
+ * box.stat.latency() - request latency percentiles per request
+ * type, in microseconds, measured from decode in the net thread
+ * to response completion in tx. Each entry covers the last one to
+ * two 10-second windows; types with no recent requests are
+ * omitted.
+ */
+static int
+lbox_stat_latency(struct lua_State *L)
+{
+	lua_newtable(L);
+	for (uint32_t type = 0; type < IPROTO_TYPE_STAT_MAX; type++) {
+		struct iproto_latency_stat stat;
+		if (iproto_latency_stat_get(type, &stat) != 0)
+			continue;
+		const char *name = iproto_type_name(type);
+		if (name == NULL)
+			continue;
+		lua_newtable(L);
+		lua_pushnumber(L, stat.count);
+		lua_setfield(L, -2, "count");
+		lua_pushnumber(L, stat.p50);
+		lua_setfield(L, -2, "p50");
+		lua_pushnumber(L, stat.p99);
+		lua_setfield(L, -2, "p99");
+		lua_pushnumber(L, stat.p999);
+		lua_setfield(L, -2, "p999");
+		lua_pushnumber(L, stat.max);
+		lua_setfield(L, -2, "max");
+		lua_setfield(L, -2, name);
+	}
+	return 1;
+}
+
+/**
+ * box.stat.alloc() - allocation accounting per request type:
+ * fiber region bytes, memtx tuple (smalloc) bytes and
+ * tuple-to-obuf response copies, accumulated since start. Types
+ * with no allocations are omitted; an empty table if the server
+ * was built with -DENABLE_ALLOC_STAT=OFF.
+ */
+static int
+lbox_stat_alloc(struct lua_State *L)
+{
+	lua_newtable(L);
+#ifdef ENABLE_ALLOC_STAT
+	for (uint32_t type = 0; type < IPROTO_TYPE_STAT_MAX; type++) {
+		struct alloc_stat *stat = &alloc_stats[type];
+		if (stat->region_bytes == 0 && stat->smalloc_bytes == 0 &&
+		    stat->obuf_copies == 0)
+			continue;
+		const char *name = iproto_type_name(type);
+		if (name == NULL)
+			continue;
+		lua_newtable(L);
+		lua_pushnumber(L, stat->region_bytes);
+		lua_setfield(L, -2, "region_bytes");
+		lua_pushnumber(L, stat->smalloc_bytes);
+		lua_setfield(L, -2, "smalloc_bytes");
+		lua_pushnumber(L, stat->obuf_copies);
+		lua_setfield(L, -2, "obuf_copies");
+		lua_pushnumber(L, stat->obuf_bytes);
+		lua_setfield(L, -2, "obuf_bytes");
+		lua_setfield(L, -2, name);
+	}
+#endif /* defined(ENABLE_ALLOC_STAT) */
+	return 1;
+}
+
+/**
+ * Format one profiler sample as a flame graph collapsed-stack
+ * line: the fiber name followed by the call chain root to leaf,
+ * semicolon-separated.
+ */
+static void
+fill_profile_line(char *buf, int size, const struct profiler_sample *sample)
+{
+	int n = snprintf(buf, size, "%s", sample->fiber_name);
+	for (int i = sample->n_frames - 1; i >= 0 && n < size; i--) {
+		const char *name = "?";
+#ifdef HAVE_BFD
+		struct symbol *sym = addr2symbol(sample->frames[i]);
+		if (sym != NULL)
+			name = sym->name;
+#endif /* HAVE_BFD */
+		n += snprintf(buf + n, size - n, ";%s", name);
+	}
+}
+
+/**
+ * box.stat.profile([freq]) - sampling CPU profiler. With a
+ * numeric argument, starts sampling at freq Hz of consumed CPU
+ * time, 0 stops the profiler keeping the collected samples.
+ * Without arguments, returns the profile: sample and dropped tick
+ * counters and a flame table mapping collapsed stacks - fiber
+ * name, then the call chain root to leaf, semicolon-separated -
+ * to sample counts, ready to be fed to flamegraph.pl.
+ */
+static int
+lbox_stat_profile(struct lua_State *L)
+{
+	if (lua_gettop(L) > 0) {
+		int freq = luaL_checkinteger(L, 1);
+		if (freq < 0 || freq > 1000)
+			return luaL_error(L, "Usage: box.stat.profile([freq])");
+		if (freq > 0) {
+			if (profiler_start(freq) != 0)
+				return luaL_error(L, "failed to start "
+						  "the profiler");
+		} else {
+			profiler_stop();
+		}
+		return 0;
+	}
+	lua_newtable(L);
+	lua_pushboolean(L, profiler_is_running());
+	lua_setfield(L, -2, "running");
+	int count = profiler_sample_count();
+	lua_pushnumber(L, count);
+	lua_setfield(L, -2, "samples");
+	lua_pushnumber(L, profiler_dropped());
+	lua_setfield(L, -2, "dropped");
+
+	lua_newtable(L);
+	for (int i = 0; i < count; i++) {
+		char line[4096];
+		fill_profile_line(line, sizeof(line), profiler_sample(i));
+		lua_getfield(L, -1, line);
+		double hits = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		lua_pushnumber(L, hits + 1);
+		lua_setfield(L, -2, line);
+	}
+	lua_setfield(L, -2, "flame");
 	return 1;
 }
 
@@ -141,6 +518,12 @@ void
 box_lua_stat_init(struct lua_State *L)
 {
 	static const struct luaL_Reg statlib [] = {
+		{"wal", lbox_stat_wal},
+		{"trace", lbox_stat_trace},
+		{"latency", lbox_stat_latency},
+		{"profile", lbox_stat_profile},
+		{"alloc", lbox_stat_alloc},
+		{"preempt", lbox_stat_preempt},
 		{NULL, NULL}
 	};
 
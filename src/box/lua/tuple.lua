@@ -67,6 +67,25 @@ box_tuple_update(box_tuple_t *tuple, const char *expr, const char *expr_end);
 
 box_tuple_t *
 box_tuple_upsert(box_tuple_t *tuple, const char *expr, const char *expr_end);
+
+/*
+ * The tuple header; completes the forward declaration made in
+ * box_lua_tuple_init() so that jitted code can read the data
+ * offset and the format id without calling into C. Must match
+ * struct tuple in src/box/tuple.h.
+ */
+struct tuple {
+    uint16_t refs;
+    uint16_t format_id;
+    uint32_t bsize;
+    uint16_t data_offset;
+} __attribute__((packed));
+
+int32_t
+box_tuple_field_slot(const box_tuple_t *tuple, uint32_t fieldno);
+
+uint32_t
+box_schema_version();
 ]]
 
 local builtin = ffi.C
@@ -295,7 +314,59 @@ local methods = {
     ["__serialize"] = tuple_totable; -- encode hook for msgpack/yaml/json
 }
 
+--
+-- Zero-copy FFI field access: compute the field pointer from the
+-- tuple header and the in-tuple field map, so jitted code reads
+-- fields straight from tuple memory without crossing into C.
+-- Offset slots are cached per format id; DDL may recycle format
+-- ids, so the cache is dropped whenever the schema version
+-- changes.
+--
+local OFFSET_SLOT_NIL = 2147483647
+local const_char_ptr_t = ffi.typeof('const char *')
+local uint8_ptr_t = ffi.typeof('const uint8_t *')
+local uint32_ptr_t = ffi.typeof('const uint32_t *')
+local slot_cache = {}
+local slot_cache_version = 0
+
 local tuple_field = function(tuple, field_n)
+    local data = ffi.cast(const_char_ptr_t, tuple) + tuple.data_offset
+    if field_n == 1 then
+        -- The first field follows the array header; handle the
+        -- fixarray header of a non-empty tuple inline.
+        local c = ffi.cast(uint8_ptr_t, data)[0]
+        if c > 0x90 and c <= 0x9f then
+            return (msgpackffi.decode_unchecked(data + 1))
+        end
+    elseif field_n > 1 then
+        local version = builtin.box_schema_version()
+        if version ~= slot_cache_version then
+            slot_cache = {}
+            slot_cache_version = version
+        end
+        local format_id = tuple.format_id
+        local slots = slot_cache[format_id]
+        if slots == nil then
+            slots = {}
+            slot_cache[format_id] = slots
+        end
+        local slot = slots[field_n]
+        if slot == nil then
+            slot = builtin.box_tuple_field_slot(tuple, field_n - 1)
+            slots[field_n] = slot
+        end
+        if slot ~= OFFSET_SLOT_NIL then
+            -- The field map is indexed by negative slots from the
+            -- data start; a zero offset means the field is not
+            -- materialized in this tuple.
+            local offset = ffi.cast(uint32_ptr_t, data)[slot]
+            if offset ~= 0 then
+                return (msgpackffi.decode_unchecked(data + offset))
+            end
+        end
+    end
+    -- Big array headers, unmapped fields, out of range: let C
+    -- find the field the usual way.
     local field = builtin.box_tuple_field(tuple, field_n - 1)
     if field == nil then
         return nil
@@ -333,7 +404,35 @@ ffi.metatype(tuple_iterator_t, {
     __tostring = function(it) return "<tuple iterator>" end;
 })
 
+--
+-- Compile a tuple builder for a fixed-shape record. The shape is
+-- an array of field type names or a space format, see
+-- msgpackffi.shape_encoder(). The returned function encodes
+-- record[1..#shape] with the per-field encoders baked in at
+-- compile time and builds a tuple from the result, so write-path
+-- stored procedures with stable field sets skip the dynamic
+-- table walk of box.tuple.new():
+--
+--     local enc = box.tuple.encoder(box.space.docs:format())
+--     box.space.docs:replace(enc(record))
+--
+local function tuple_encoder(shape)
+    local encode_shape = msgpackffi.shape_encoder(shape)
+    return function(record)
+        local tmpbuf = buffer.IBUF_SHARED
+        tmpbuf:reset()
+        encode_shape(tmpbuf, record)
+        local tuple = builtin.box_tuple_new(builtin.box_tuple_format_default(),
+                                            tmpbuf.rpos, tmpbuf.wpos)
+        if tuple == nil then
+            return box.error()
+        end
+        return tuple_bless(tuple)
+    end
+end
+
 -- internal api for box.select and iterators
 box.tuple.bless = tuple_bless
 box.tuple.encode = tuple_encode
+box.tuple.encoder = tuple_encoder
 box.tuple.is = is_tuple
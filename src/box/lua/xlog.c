@@ -31,6 +31,14 @@
 
 #include "xlog.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fiber.h>
 #include <say.h>
 #include <diag.h>
 #include <msgpuck/msgpuck.h>
@@ -38,6 +46,7 @@
 #include <box/xlog.h>
 #include <box/xrow.h>
 #include <box/iproto_constants.h>
+#include <box/schema.h>
 #include <box/tuple.h>
 #include <box/lua/tuple.h>
 #include <lua/msgpack.h>
@@ -272,7 +281,8 @@ lbox_xlog_parser_open_pairs(struct lua_State *L)
 	    strncmp(cur->meta.filetype, "RUN", 3) != 0 &&
 	    strncmp(cur->meta.filetype, "INDEX", 5) != 0 &&
 	    strncmp(cur->meta.filetype, "DATA", 4) != 0 &&
-	    strncmp(cur->meta.filetype, "VYLOG", 4) != 0) {
+	    strncmp(cur->meta.filetype, "VYLOG", 4) != 0 &&
+	    strncmp(cur->meta.filetype, "CAPTURE", 7) != 0) {
 		char buf[1024];
 		snprintf(buf, sizeof(buf), "'%.*s' file type",
 			 (int) strlen(cur->meta.filetype),
@@ -293,8 +303,818 @@ lbox_xlog_parser_open_pairs(struct lua_State *L)
 	return 3;
 }
 
+/* {{{ Snapshot attach */
+
+/**
+ * Read-only attach of a checkpoint file: query the rows of a
+ * .snap directly from an mmap-ed file, without populating the
+ * memtx arena. A single indexing pass over the file records, for
+ * every row, the offset of its tx and its ordinal within it,
+ * plus a hash of its primary key fields, so that full scans only
+ * decompress each tx once and pk lookups decompress exactly one.
+ * The index costs sizeof(struct snap_attach_row) (24 bytes) per
+ * row plus the key hash table - a tiny fraction of the arena a
+ * real recovery would need.
+ */
+
+enum {
+	/** Upper bound on the meta header we scan for "\n\n". */
+	SNAP_ATTACH_META_MAX = 4096,
+	/** Maximal number of primary key parts we index. */
+	SNAP_ATTACH_PART_MAX = 16,
+};
+
+/** One indexed row of an attached snapshot. */
+struct snap_attach_row {
+	/** Space the row belongs to. */
+	uint32_t space_id;
+	/** Ordinal of the row within its tx. */
+	uint32_t row_no;
+	/** File offset of the tx containing the row. */
+	uint64_t tx_offset;
+	/**
+	 * Hash of the primary key fields, or 0 if the key was
+	 * not hashed (no pk definition seen yet, or a key field
+	 * of an unhashed type). Unhashed rows are found by a
+	 * linear scan over the entries of their space.
+	 */
+	uint64_t key_hash;
+};
+
+/** A primary key definition recovered from an _index row. */
+struct snap_attach_pk {
+	uint32_t space_id;
+	uint32_t part_count;
+	/** True if the rows of the space are in the hash table. */
+	bool hashed;
+	/** Zero-based field numbers of the key parts. */
+	uint32_t parts[SNAP_ATTACH_PART_MAX];
+};
+
+struct snap_attach {
+	char name[PATH_MAX];
+	/** Read-only mapping of the whole file, NULL if closed. */
+	char *map;
+	size_t map_size;
+	/** Offset of the first tx, right past the meta header. */
+	uint64_t data_offset;
+	/** Decompression context for zstd-compressed txs. */
+	ZSTD_DStream *zdctx;
+	/** Index of all rows, in file order. */
+	struct snap_attach_row *rows;
+	uint32_t row_count;
+	uint32_t row_capacity;
+	/**
+	 * Open addressing key hash table. A slot holds a row
+	 * index + 1; 0 is an empty slot.
+	 */
+	uint64_t *hash;
+	uint64_t hash_mask;
+	/** Primary keys found in _index rows, linear search. */
+	struct snap_attach_pk *pks;
+	uint32_t pk_count;
+	uint32_t pk_capacity;
+	/** The last decompressed tx, cached to speed up scans. */
+	struct xlog_tx_cursor tx;
+	bool tx_valid;
+	uint64_t tx_offset;
+};
+
+static uint32_t CTID_STRUCT_SNAP_ATTACH_REF = 0;
+
+static int
+lbox_pushsnap(struct lua_State *L, struct snap_attach *snap)
+{
+	struct snap_attach **psnap = (struct snap_attach **)
+		luaL_pushcdata(L, CTID_STRUCT_SNAP_ATTACH_REF);
+	*psnap = snap;
+	return 1;
+}
+
+static struct snap_attach *
+lbox_checksnap(struct lua_State *L, int narg, const char *src)
+{
+	uint32_t ctypeid;
+	void *data = luaL_checkcdata(L, narg, &ctypeid);
+	if (ctypeid != CTID_STRUCT_SNAP_ATTACH_REF)
+		luaL_error(L, "%s: expecting snap_attach object", src);
+	struct snap_attach *snap = *(struct snap_attach **)data;
+	if (snap->map == NULL)
+		luaL_error(L, "%s: attached snapshot is closed", src);
+	return snap;
+}
+
+/** FNV-1a, the seed is the canonical offset basis. */
+static inline uint64_t
+snap_attach_hash_step(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static const struct snap_attach_pk *
+snap_attach_pk_find(const struct snap_attach *snap, uint32_t space_id)
+{
+	for (uint32_t i = 0; i < snap->pk_count; i++) {
+		if (snap->pks[i].space_id == space_id)
+			return &snap->pks[i];
+	}
+	return NULL;
+}
+
+/**
+ * Hash the primary key fields of a tuple. Only unsigned ints and
+ * strings are hashed: they cover the overwhelming majority of
+ * primary keys and have a canonical representation both in
+ * msgpack and in Lua.
+ * @retval 0 hashed, *hash is set and is never 0.
+ * @retval -1 the key has a field we do not hash.
+ */
+static int
+snap_attach_tuple_key_hash(const struct snap_attach_pk *pk,
+			   const char *tuple, uint64_t *hash)
+{
+	const char *part_field[SNAP_ATTACH_PART_MAX];
+	uint32_t found = 0;
+	uint32_t field_count = mp_decode_array(&tuple);
+	for (uint32_t i = 0; i < field_count && found < pk->part_count; i++) {
+		for (uint32_t j = 0; j < pk->part_count; j++) {
+			if (pk->parts[j] == i) {
+				part_field[j] = tuple;
+				found++;
+			}
+		}
+		mp_next(&tuple);
+	}
+	if (found < pk->part_count)
+		return -1;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (uint32_t j = 0; j < pk->part_count; j++) {
+		const char *f = part_field[j];
+		if (mp_typeof(*f) == MP_UINT) {
+			uint64_t num = mp_decode_uint(&f);
+			h = snap_attach_hash_step(h, &num, sizeof(num));
+		} else if (mp_typeof(*f) == MP_STR) {
+			uint32_t len;
+			const char *str = mp_decode_str(&f, &len);
+			h = snap_attach_hash_step(h, str, len);
+		} else {
+			return -1;
+		}
+	}
+	*hash = h != 0 ? h : 1;
+	return 0;
+}
+
+/**
+ * Pull the space id and the tuple out of an INSERT row body.
+ * @retval -1 the row is not a plain single-body insert.
+ */
+static int
+snap_attach_decode_row(const struct xrow_header *row, uint32_t *space_id,
+		       const char **tuple)
+{
+	if (row->type != IPROTO_INSERT || row->bodycnt != 1)
+		return -1;
+	const char *data = (const char *)row->body[0].iov_base;
+	if (mp_typeof(*data) != MP_MAP)
+		return -1;
+	*tuple = NULL;
+	bool has_space = false;
+	uint32_t map_size = mp_decode_map(&data);
+	for (uint32_t i = 0; i < map_size; i++) {
+		if (mp_typeof(*data) != MP_UINT)
+			return -1;
+		uint64_t key = mp_decode_uint(&data);
+		if (key == IPROTO_SPACE_ID && mp_typeof(*data) == MP_UINT) {
+			*space_id = mp_decode_uint(&data);
+			has_space = true;
+			continue;
+		}
+		if (key == IPROTO_TUPLE && mp_typeof(*data) == MP_ARRAY)
+			*tuple = data;
+		mp_next(&data);
+	}
+	return has_space && *tuple != NULL ? 0 : -1;
+}
+
+/**
+ * Recover a primary key definition from an _index row tuple.
+ * Understands both the 1.7 format, where key parts are an array
+ * of [fieldno, type] pairs after an options map, and the legacy
+ * flat format with is_unique/part_count counters followed by
+ * fieldno, type, fieldno, type, ... A tuple this does not
+ * understand is skipped: the space falls back to linear scans.
+ */
+static int
+snap_attach_parse_pk(struct snap_attach *snap, const char *tuple)
+{
+	uint32_t field_count = mp_decode_array(&tuple);
+	if (field_count < 6 || mp_typeof(*tuple) != MP_UINT)
+		return 0;
+	uint32_t space_id = mp_decode_uint(&tuple);
+	if (mp_typeof(*tuple) != MP_UINT || mp_decode_uint(&tuple) != 0)
+		return 0; /* not a primary key */
+	mp_next(&tuple); /* name */
+	mp_next(&tuple); /* type */
+	struct snap_attach_pk pk;
+	memset(&pk, 0, sizeof(pk));
+	pk.space_id = space_id;
+	if (mp_typeof(*tuple) == MP_MAP) {
+		mp_next(&tuple); /* options */
+		if (mp_typeof(*tuple) != MP_ARRAY)
+			return 0;
+		uint32_t part_count = mp_decode_array(&tuple);
+		if (part_count == 0 || part_count > SNAP_ATTACH_PART_MAX)
+			return 0;
+		for (uint32_t i = 0; i < part_count; i++) {
+			const char *part = tuple;
+			mp_next(&tuple);
+			if (mp_typeof(*part) != MP_ARRAY ||
+			    mp_decode_array(&part) < 2 ||
+			    mp_typeof(*part) != MP_UINT)
+				return 0;
+			pk.parts[i] = mp_decode_uint(&part);
+		}
+		pk.part_count = part_count;
+	} else if (mp_typeof(*tuple) == MP_UINT) {
+		mp_next(&tuple); /* is_unique */
+		if (mp_typeof(*tuple) != MP_UINT)
+			return 0;
+		uint32_t part_count = mp_decode_uint(&tuple);
+		if (part_count == 0 || part_count > SNAP_ATTACH_PART_MAX ||
+		    field_count < 6 + 2 * part_count)
+			return 0;
+		for (uint32_t i = 0; i < part_count; i++) {
+			if (mp_typeof(*tuple) != MP_UINT)
+				return 0;
+			pk.parts[i] = mp_decode_uint(&tuple);
+			mp_next(&tuple); /* part type */
+		}
+		pk.part_count = part_count;
+	} else {
+		return 0;
+	}
+	/*
+	 * Snapshot rows are ordered by space id, so any space
+	 * created after _index has all its rows behind this
+	 * definition and can be hashed on the fly. System spaces
+	 * preceding _index are tiny, a linear scan serves them.
+	 */
+	pk.hashed = space_id > BOX_INDEX_ID;
+	if (snap->pk_count == snap->pk_capacity) {
+		uint32_t capacity = snap->pk_capacity == 0 ? 16 :
+				    snap->pk_capacity * 2;
+		struct snap_attach_pk *pks = (struct snap_attach_pk *)
+			realloc(snap->pks, capacity * sizeof(*pks));
+		if (pks == NULL) {
+			diag_set(OutOfMemory, capacity * sizeof(*pks),
+				 "realloc", "snap attach pks");
+			return -1;
+		}
+		snap->pks = pks;
+		snap->pk_capacity = capacity;
+	}
+	snap->pks[snap->pk_count++] = pk;
+	return 0;
+}
+
+/**
+ * Scan the whole file once, building the row index and
+ * recovering primary key definitions from _index rows as they
+ * stream by.
+ */
+static int
+snap_attach_index(struct snap_attach *snap)
+{
+	const char *pos = snap->map + snap->data_offset;
+	const char *end = snap->map + snap->map_size;
+	/* The eof marker is 4 bytes. */
+	while (end - pos > 4) {
+		uint64_t tx_offset = pos - snap->map;
+		struct xlog_tx_cursor tc;
+		ssize_t rc = xlog_tx_cursor_create(&tc, &pos, end,
+						   snap->zdctx);
+		if (rc > 0) {
+			diag_set(ClientError, ER_UNSUPPORTED,
+				 "snapshot attach", "a truncated file");
+			return -1;
+		}
+		if (rc < 0)
+			return -1;
+		uint32_t row_no = 0;
+		struct xrow_header row;
+		int rrc;
+		while ((rrc = xlog_tx_cursor_next_row(&tc, &row)) == 0) {
+			uint32_t space_id;
+			const char *tuple;
+			if (snap_attach_decode_row(&row, &space_id,
+						   &tuple) != 0) {
+				row_no++;
+				continue;
+			}
+			if (space_id == BOX_INDEX_ID &&
+			    snap_attach_parse_pk(snap, tuple) != 0)
+				goto tx_error;
+			uint64_t key_hash = 0;
+			const struct snap_attach_pk *pk =
+				snap_attach_pk_find(snap, space_id);
+			if (pk != NULL && pk->hashed &&
+			    snap_attach_tuple_key_hash(pk, tuple,
+						       &key_hash) != 0)
+				key_hash = 0;
+			if (snap->row_count == snap->row_capacity) {
+				uint32_t capacity =
+					snap->row_capacity == 0 ? 128 :
+					snap->row_capacity * 2;
+				struct snap_attach_row *rows =
+					(struct snap_attach_row *)
+					realloc(snap->rows,
+						capacity * sizeof(*rows));
+				if (rows == NULL) {
+					diag_set(OutOfMemory,
+						 capacity * sizeof(*rows),
+						 "realloc",
+						 "snap attach rows");
+					goto tx_error;
+				}
+				snap->rows = rows;
+				snap->row_capacity = capacity;
+			}
+			struct snap_attach_row *r =
+				&snap->rows[snap->row_count++];
+			r->space_id = space_id;
+			r->row_no = row_no;
+			r->tx_offset = tx_offset;
+			r->key_hash = key_hash;
+			row_no++;
+		}
+		xlog_tx_cursor_destroy(&tc);
+		if (rrc < 0)
+			return -1;
+		fiber_preempt_point();
+		continue;
+tx_error:
+		xlog_tx_cursor_destroy(&tc);
+		return -1;
+	}
+	if (end - pos != 4)
+		say_warn("%s: ignoring a garbage tail", snap->name);
+	return 0;
+}
+
+static int
+snap_attach_build_hash(struct snap_attach *snap)
+{
+	uint64_t count = 0;
+	for (uint32_t i = 0; i < snap->row_count; i++) {
+		if (snap->rows[i].key_hash != 0)
+			count++;
+	}
+	uint64_t size = 16;
+	while (size < 2 * count)
+		size *= 2;
+	snap->hash = (uint64_t *)calloc(size, sizeof(*snap->hash));
+	if (snap->hash == NULL) {
+		diag_set(OutOfMemory, size * sizeof(*snap->hash),
+			 "calloc", "snap attach hash");
+		return -1;
+	}
+	snap->hash_mask = size - 1;
+	for (uint32_t i = 0; i < snap->row_count; i++) {
+		uint64_t h = snap->rows[i].key_hash;
+		if (h == 0)
+			continue;
+		uint64_t slot = h & snap->hash_mask;
+		while (snap->hash[slot] != 0)
+			slot = (slot + 1) & snap->hash_mask;
+		snap->hash[slot] = i + 1;
+	}
+	return 0;
+}
+
+/** Release the file and the index; the struct stays until gc. */
+static void
+snap_attach_close(struct snap_attach *snap)
+{
+	if (snap->tx_valid) {
+		xlog_tx_cursor_destroy(&snap->tx);
+		snap->tx_valid = false;
+	}
+	if (snap->map != NULL) {
+		munmap(snap->map, snap->map_size);
+		snap->map = NULL;
+	}
+	free(snap->rows);
+	snap->rows = NULL;
+	free(snap->hash);
+	snap->hash = NULL;
+	free(snap->pks);
+	snap->pks = NULL;
+	if (snap->zdctx != NULL) {
+		ZSTD_freeDStream(snap->zdctx);
+		snap->zdctx = NULL;
+	}
+}
+
+/**
+ * Decompress the tx of @a r, or rewind the cached one, and
+ * position @a row on row r->row_no within it. The row body
+ * points into the tx buffer and is valid until the next fetch.
+ */
+static int
+snap_attach_fetch(struct snap_attach *snap, const struct snap_attach_row *r,
+		  struct xrow_header *row)
+{
+	if (!snap->tx_valid || snap->tx_offset != r->tx_offset) {
+		if (snap->tx_valid) {
+			xlog_tx_cursor_destroy(&snap->tx);
+			snap->tx_valid = false;
+		}
+		const char *pos = snap->map + r->tx_offset;
+		ssize_t rc = xlog_tx_cursor_create(&snap->tx, &pos,
+						   snap->map + snap->map_size,
+						   snap->zdctx);
+		if (rc != 0) {
+			if (rc > 0)
+				diag_set(ClientError, ER_UNSUPPORTED,
+					 "snapshot attach", "a file truncated"
+					 " under an attached reader");
+			return -1;
+		}
+		snap->tx_valid = true;
+		snap->tx_offset = r->tx_offset;
+	} else {
+		/* Rewind the cached tx to its first row. */
+		snap->tx.rows.rpos = snap->tx.rows.buf;
+	}
+	for (uint32_t i = 0; i <= r->row_no; i++) {
+		if (xlog_tx_cursor_next_row(&snap->tx, row) != 0) {
+			xlog_tx_cursor_destroy(&snap->tx);
+			snap->tx_valid = false;
+			diag_set(ClientError, ER_UNSUPPORTED,
+				 "snapshot attach", "a file modified under"
+				 " an attached reader");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/** Fetch the tuple of an indexed row, raising a Lua error on failure. */
+static const char *
+lbox_snap_attach_row_tuple(struct lua_State *L, struct snap_attach *snap,
+			   const struct snap_attach_row *r)
+{
+	struct xrow_header row;
+	if (snap_attach_fetch(snap, r, &row) != 0)
+		luaT_error(L);
+	uint32_t space_id;
+	const char *tuple;
+	if (snap_attach_decode_row(&row, &space_id, &tuple) != 0)
+		luaL_error(L, "snapshot attach: a file modified under"
+			   " an attached reader");
+	return tuple;
+}
+
+static void
+lbox_snap_attach_pushtuple(struct lua_State *L, const char *tuple)
+{
+	box_tuple_format_t *fmt = box_tuple_format_default();
+	if (fmt != NULL) {
+		/*
+		 * Sic: box_tuple_format_default() != NULL is used
+		 * to check that box is initialized.
+		 */
+		const char *tuple_end = tuple;
+		mp_next(&tuple_end);
+		struct tuple *t = box_tuple_new(fmt, tuple, tuple_end);
+		if (t == NULL)
+			luaT_error(L);
+		luaT_pushtuple(L, t);
+	} else {
+		luamp_decode(L, luaL_msgpack_default, &tuple);
+	}
+}
+
+/** Compare a msgpack key field to a Lua key part for equality. */
+static bool
+snap_attach_key_eq(struct lua_State *L, int idx, const char *field)
+{
+	if (lua_type(L, idx) == LUA_TSTRING) {
+		if (mp_typeof(*field) != MP_STR)
+			return false;
+		size_t llen;
+		const char *lstr = lua_tolstring(L, idx, &llen);
+		uint32_t mlen;
+		const char *mstr = mp_decode_str(&field, &mlen);
+		return mlen == llen && memcmp(mstr, lstr, llen) == 0;
+	}
+	if (lua_type(L, idx) == LUA_TNUMBER) {
+		double num = lua_tonumber(L, idx);
+		if (mp_typeof(*field) == MP_UINT)
+			return num >= 0 &&
+			       (double)mp_decode_uint(&field) == num;
+		if (mp_typeof(*field) == MP_INT)
+			return (double)mp_decode_int(&field) == num;
+		return false;
+	}
+	return false;
+}
+
+/**
+ * Check that the primary key fields of a tuple equal the Lua key
+ * parts in the table at @a key_idx.
+ */
+static bool
+snap_attach_tuple_eq(struct lua_State *L, int key_idx,
+		     const struct snap_attach_pk *pk, const char *tuple)
+{
+	const char *part_field[SNAP_ATTACH_PART_MAX];
+	uint32_t found = 0;
+	uint32_t field_count = mp_decode_array(&tuple);
+	for (uint32_t i = 0; i < field_count && found < pk->part_count; i++) {
+		for (uint32_t j = 0; j < pk->part_count; j++) {
+			if (pk->parts[j] == i) {
+				part_field[j] = tuple;
+				found++;
+			}
+		}
+		mp_next(&tuple);
+	}
+	if (found < pk->part_count)
+		return false;
+	for (uint32_t j = 0; j < pk->part_count; j++) {
+		lua_rawgeti(L, key_idx, j + 1);
+		bool eq = snap_attach_key_eq(L, -1, part_field[j]);
+		lua_pop(L, 1);
+		if (!eq)
+			return false;
+	}
+	return true;
+}
+
+/** snap:get(space_id, key) - a point lookup by full primary key. */
+static int
+lbox_snap_attach_get(struct lua_State *L)
+{
+	struct snap_attach *snap = lbox_checksnap(L, lua_upvalueindex(1),
+						  "snap:get()");
+	uint32_t space_id = luaL_checkinteger(L, 2);
+	if (lua_type(L, 3) == LUA_TNUMBER || lua_type(L, 3) == LUA_TSTRING) {
+		/* Normalize a scalar key to a one-part table. */
+		lua_createtable(L, 1, 0);
+		lua_pushvalue(L, 3);
+		lua_rawseti(L, -2, 1);
+		lua_replace(L, 3);
+	} else if (lua_type(L, 3) != LUA_TTABLE) {
+		luaL_error(L, "snap:get(): a key must be a scalar or"
+			   " a table of scalars");
+	}
+	const struct snap_attach_pk *pk = snap_attach_pk_find(snap, space_id);
+	if (pk == NULL)
+		luaL_error(L, "snap:get(): no primary key for space %u",
+			   (unsigned)space_id);
+	if (lua_objlen(L, 3) != pk->part_count)
+		luaL_error(L, "snap:get(): invalid key part count"
+			   " (expected %u)", (unsigned)pk->part_count);
+	/*
+	 * Hash the Lua key the way the indexing pass hashed the
+	 * tuples. A key with a part we do not hash, or a space
+	 * outside the hash table, falls back to a linear scan.
+	 */
+	uint64_t h = 0xcbf29ce484222325ULL;
+	bool hashable = pk->hashed;
+	for (uint32_t j = 1; j <= pk->part_count && hashable; j++) {
+		lua_rawgeti(L, 3, j);
+		if (lua_type(L, -1) == LUA_TSTRING) {
+			size_t len;
+			const char *str = lua_tolstring(L, -1, &len);
+			h = snap_attach_hash_step(h, str, len);
+		} else if (lua_type(L, -1) == LUA_TNUMBER) {
+			double num = lua_tonumber(L, -1);
+			uint64_t unum = (uint64_t)num;
+			if (num < 0 || (double)unum != num)
+				hashable = false;
+			else
+				h = snap_attach_hash_step(h, &unum,
+							  sizeof(unum));
+		} else {
+			hashable = false;
+		}
+		lua_pop(L, 1);
+	}
+	if (hashable) {
+		if (h == 0)
+			h = 1;
+		uint64_t slot = h & snap->hash_mask;
+		while (snap->hash[slot] != 0) {
+			const struct snap_attach_row *r =
+				&snap->rows[snap->hash[slot] - 1];
+			if (r->key_hash == h && r->space_id == space_id) {
+				const char *tuple =
+					lbox_snap_attach_row_tuple(L, snap, r);
+				if (snap_attach_tuple_eq(L, 3, pk, tuple)) {
+					lbox_snap_attach_pushtuple(L, tuple);
+					return 1;
+				}
+			}
+			slot = (slot + 1) & snap->hash_mask;
+		}
+		lua_pushnil(L);
+		return 1;
+	}
+	for (uint32_t i = 0; i < snap->row_count; i++) {
+		const struct snap_attach_row *r = &snap->rows[i];
+		if (r->space_id != space_id)
+			continue;
+		const char *tuple = lbox_snap_attach_row_tuple(L, snap, r);
+		if (snap_attach_tuple_eq(L, 3, pk, tuple)) {
+			lbox_snap_attach_pushtuple(L, tuple);
+			return 1;
+		}
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+static int
+lbox_snap_attach_pairs_next(struct lua_State *L)
+{
+	struct snap_attach *snap = lbox_checksnap(L, lua_upvalueindex(1),
+						  "snap:pairs()");
+	uint32_t space_id = lua_tointeger(L, lua_upvalueindex(2));
+	uint32_t i = lua_tointeger(L, 2);
+	while (i < snap->row_count && snap->rows[i].space_id != space_id)
+		i++;
+	if (i >= snap->row_count)
+		return 0;
+	const char *tuple = lbox_snap_attach_row_tuple(L, snap,
+						       &snap->rows[i]);
+	lua_pushinteger(L, i + 1);
+	lbox_snap_attach_pushtuple(L, tuple);
+	return 2;
+}
+
+/** snap:pairs(space_id) - a full scan over one space, in file order. */
+static int
+lbox_snap_attach_pairs(struct lua_State *L)
+{
+	lbox_checksnap(L, lua_upvalueindex(1), "snap:pairs()");
+	luaL_checkinteger(L, 2);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_pushvalue(L, 2);
+	lua_pushcclosure(L, lbox_snap_attach_pairs_next, 2);
+	lua_pushnil(L);
+	lua_pushinteger(L, 0);
+	return 3;
+}
+
+/** snap:spaces() - a map of space id to its row count. */
+static int
+lbox_snap_attach_spaces(struct lua_State *L)
+{
+	struct snap_attach *snap = lbox_checksnap(L, lua_upvalueindex(1),
+						  "snap:spaces()");
+	lua_newtable(L);
+	for (uint32_t i = 0; i < snap->row_count; i++) {
+		lua_pushinteger(L, snap->rows[i].space_id);
+		lua_rawget(L, -2);
+		int count = lua_isnil(L, -1) ? 0 : lua_tointeger(L, -1);
+		lua_pop(L, 1);
+		lua_pushinteger(L, snap->rows[i].space_id);
+		lua_pushinteger(L, count + 1);
+		lua_rawset(L, -3);
+	}
+	return 1;
+}
+
+static int
+lbox_snap_attach_close(struct lua_State *L)
+{
+	uint32_t ctypeid;
+	void *data = luaL_checkcdata(L, lua_upvalueindex(1), &ctypeid);
+	if (ctypeid != CTID_STRUCT_SNAP_ATTACH_REF)
+		luaL_error(L, "snap:close(): expecting snap_attach object");
+	snap_attach_close(*(struct snap_attach **)data);
+	return 0;
+}
+
+static int
+lbox_snap_attach_gc(struct lua_State *L)
+{
+	uint32_t ctypeid;
+	void *data = luaL_checkcdata(L, 1, &ctypeid);
+	struct snap_attach *snap = *(struct snap_attach **)data;
+	snap_attach_close(snap);
+	free(snap);
+	return 0;
+}
+
+static int
+lbox_snap_attach(struct lua_State *L)
+{
+	if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+		luaL_error(L, "Usage: xlog.attach(snap_filename)");
+	const char *filename = luaL_checkstring(L, 1);
+
+	struct snap_attach *snap = (struct snap_attach *)
+		calloc(1, sizeof(*snap));
+	if (snap == NULL) {
+		diag_set(OutOfMemory, sizeof(*snap), "calloc",
+			 "struct snap_attach");
+		return luaT_error(L);
+	}
+	snprintf(snap->name, sizeof(snap->name), "%s", filename);
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		diag_set(SystemError, "failed to open '%s'", filename);
+		goto error;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		diag_set(SystemError, "failed to stat '%s'", filename);
+		close(fd);
+		goto error;
+	}
+	snap->map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				 fd, 0);
+	close(fd);
+	if (snap->map == MAP_FAILED) {
+		snap->map = NULL;
+		diag_set(SystemError, "failed to map '%s'", filename);
+		goto error;
+	}
+	snap->map_size = st.st_size;
+	/*
+	 * The meta header ends with an empty line; the payload
+	 * starts right past it.
+	 */
+	size_t scan = snap->map_size < SNAP_ATTACH_META_MAX ?
+		      snap->map_size : SNAP_ATTACH_META_MAX;
+	const char *meta_end = (const char *)
+		memmem(snap->map, scan, "\n\n", 2);
+	if (snap->map_size < 4 || memcmp(snap->map, "SNAP", 4) != 0 ||
+	    meta_end == NULL) {
+		diag_set(ClientError, ER_UNSUPPORTED, "snapshot attach",
+			 "this file type");
+		goto error;
+	}
+	snap->data_offset = meta_end + 2 - snap->map;
+	snap->zdctx = ZSTD_createDStream();
+	if (snap->zdctx == NULL) {
+		diag_set(OutOfMemory, sizeof(ZSTD_DStream), "malloc",
+			 "zstd context");
+		goto error;
+	}
+	/* The indexing pass is sequential, lookups are not. */
+	madvise(snap->map, snap->map_size, MADV_SEQUENTIAL);
+	if (snap_attach_index(snap) != 0 ||
+	    snap_attach_build_hash(snap) != 0)
+		goto error;
+	madvise(snap->map, snap->map_size, MADV_RANDOM);
+	say_info("attached snapshot %s: %u rows, %u primary keys",
+		 snap->name, (unsigned)snap->row_count,
+		 (unsigned)snap->pk_count);
+
+	/*
+	 * The handle: a table of methods closed over a single
+	 * gc-armed cdata, so the struct lives as long as any of
+	 * them does.
+	 */
+	lua_createtable(L, 0, 5);
+	lbox_pushsnap(L, snap);
+	lua_pushcfunction(L, lbox_snap_attach_gc);
+	luaL_setcdatagc(L, -2);
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, lbox_snap_attach_get, 1);
+	lua_setfield(L, -3, "get");
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, lbox_snap_attach_pairs, 1);
+	lua_setfield(L, -3, "pairs");
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, lbox_snap_attach_spaces, 1);
+	lua_setfield(L, -3, "spaces");
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, lbox_snap_attach_close, 1);
+	lua_setfield(L, -3, "close");
+	lua_setfield(L, -2, "_snap");
+	return 1;
+error:
+	snap_attach_close(snap);
+	free(snap);
+	return luaT_error(L);
+}
+
+/* }}} */
+
 static const struct luaL_Reg lbox_xlog_parser_lib [] = {
 	{ "pairs",	lbox_xlog_parser_open_pairs },
+	{ "attach",	lbox_snap_attach            },
 	{ NULL,		NULL                        }
 };
 
@@ -306,6 +1126,9 @@ box_lua_xlog_init(struct lua_State *L)
 	rc = luaL_cdef(L, "struct xlog_cursor;"); assert(rc == 0); (void) rc;
 	CTID_STRUCT_XLOG_CURSOR_REF = luaL_ctypeid(L, "struct xlog_cursor&");
 	assert(CTID_STRUCT_XLOG_CURSOR_REF != 0);
+	rc = luaL_cdef(L, "struct snap_attach;"); assert(rc == 0); (void) rc;
+	CTID_STRUCT_SNAP_ATTACH_REF = luaL_ctypeid(L, "struct snap_attach&");
+	assert(CTID_STRUCT_SNAP_ATTACH_REF != 0);
 
 	luaL_register_module(L, xloglib_name, lbox_xlog_parser_lib);
 
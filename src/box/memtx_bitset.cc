@@ -450,6 +450,54 @@ MemtxBitset::count(enum iterator_type type, const char *key,
 			return bitset_index_size(&m_index) - bitset_index_count(&m_index, bit);
 	}
 
+	if (type == ITER_BITS_ALL_SET || type == ITER_BITS_ANY_SET ||
+	    type == ITER_BITS_ALL_NOT_SET) {
+		/*
+		 * Multi-bit key: evaluate the expression page by page
+		 * and sum popcounts of the result pages instead of
+		 * iterating over the matching tuples one by one.
+		 */
+		struct bitset_expr expr;
+		bitset_expr_create(&expr, realloc);
+		int rc = 0;
+		switch (type) {
+		case ITER_BITS_ALL_SET:
+			rc = bitset_index_expr_all_set(&expr, bitset_key,
+						       bitset_key_size);
+			break;
+		case ITER_BITS_ANY_SET:
+			rc = bitset_index_expr_any_set(&expr, bitset_key,
+						       bitset_key_size);
+			break;
+		case ITER_BITS_ALL_NOT_SET:
+			rc = bitset_index_expr_all_not_set(&expr, bitset_key,
+							   bitset_key_size);
+			break;
+		default:
+			unreachable();
+		}
+		if (rc != 0) {
+			bitset_expr_destroy(&expr);
+			tnt_raise(OutOfMemory, 0, "MemtxBitset",
+				  "count expression");
+		}
+
+		struct bitset_iterator bitset_it;
+		bitset_iterator_create(&bitset_it, realloc);
+		rc = bitset_index_init_iterator((bitset_index *) &m_index,
+						&bitset_it, &expr);
+		bitset_expr_destroy(&expr);
+		if (rc != 0) {
+			bitset_iterator_destroy(&bitset_it);
+			tnt_raise(OutOfMemory, 0, "MemtxBitset",
+				  "count iterator");
+		}
+
+		size_t result = bitset_iterator_count(&bitset_it);
+		bitset_iterator_destroy(&bitset_it);
+		return result;
+	}
+
 	/* Call generic method */
 	return MemtxIndex::count(type, key, part_count);
 }
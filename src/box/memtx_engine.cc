@@ -32,8 +32,20 @@
 #include "memtx_space.h"
 #include "memtx_tuple.h"
 
+#include "small/small.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "uri.h"
+
+#include "coeio.h"
 #include "coeio_file.h"
+#include "ipc.h"
 #include "scoped_guard.h"
+#include "clock.h"
 
 #include "tuple.h"
 #include "txn.h"
@@ -109,8 +121,13 @@ memtx_build_secondary_keys(struct space *space, void *param)
 				 space_name(space));
 		}
 
+		/*
+		 * Recovery is the only caller, so there is no
+		 * concurrent DML and the build may offload its
+		 * sort phase to worker threads.
+		 */
 		for (uint32_t j = 1; j < space->index_count; j++)
-			index_build((MemtxIndex *) space->index[j], pk);
+			index_build((MemtxIndex *) space->index[j], pk, true);
 
 		if (n_tuples > 0) {
 			say_info("Space '%s': done", space_name(space));
@@ -119,73 +136,389 @@ memtx_build_secondary_keys(struct space *space, void *param)
 	handler->replace = memtx_replace_all_keys;
 }
 
+enum {
+	/**
+	 * A delta checkpoint only pays off while the dirty log
+	 * is a small share of the data set: write a full
+	 * snapshot once dirty rows * MEMTX_DELTA_MAX_SHARE
+	 * reaches the total tuple count.
+	 */
+	MEMTX_DELTA_MAX_SHARE = 4,
+	/**
+	 * Cap on the number of delta checkpoints between two
+	 * full snapshots, to bound the chain recovery has to
+	 * replay.
+	 */
+	MEMTX_DELTA_CHAIN_MAX = 8,
+	/**
+	 * Cap on the dirty log length. The log pins tuples and
+	 * costs memory per record, so unbounded churn is better
+	 * served by a full snapshot.
+	 */
+	MEMTX_DELTA_LOG_MAX = 1 << 24,
+};
+
+/**
+ * A dirty log record: a single committed statement. Either an
+ * insert/replace of @tuple, or a deletion by primary @key.
+ */
+struct memtx_dirty_record {
+	/** Link in MemtxEngine::m_dirty_log. */
+	struct stailq_entry link;
+	/** Id of the modified space. */
+	uint32_t space_id;
+	/** The inserted tuple, referenced. NULL for a deletion. */
+	struct tuple *tuple;
+	/** For a deletion: the primary key, malloced. */
+	char *key;
+	/** Size of @key, in bytes. */
+	uint32_t key_size;
+};
+
 MemtxEngine::MemtxEngine(const char *snap_dirname, bool force_recovery,
 			 uint64_t tuple_arena_max_size, uint32_t objsize_min,
-			 uint32_t objsize_max, float alloc_factor)
+			 uint32_t objsize_max, float alloc_factor,
+			 bool huge_pages)
 	:Engine("memtx", &memtx_tuple_format_vtab),
 	m_checkpoint(0),
 	m_state(MEMTX_INITIALIZED),
 	m_snap_io_rate_limit(0),
-	m_force_recovery(force_recovery)
+	m_checkpoint_sink(NULL),
+	m_force_recovery(force_recovery),
+	m_dirty_rows(0),
+	m_dirty_valid(false),
+	m_delta_chain_len(0)
 {
 	memtx_tuple_init(tuple_arena_max_size, objsize_min, objsize_max,
-			 alloc_factor);
+			 alloc_factor, huge_pages);
 
 	flags = ENGINE_CAN_BE_TEMPORARY;
 	xdir_create(&m_snap_dir, snap_dirname, SNAP, &INSTANCE_UUID);
+	xdir_create(&m_delta_dir, snap_dirname, DSNAP, &INSTANCE_UUID);
+	stailq_create(&m_dirty_log);
+	mempool_create(&m_dirty_pool, cord_slab_cache(),
+		       sizeof(struct memtx_dirty_record));
 }
 
 MemtxEngine::~MemtxEngine()
 {
+	free(m_checkpoint_sink);
+	dirtyLogFree(&m_dirty_log);
+	mempool_destroy(&m_dirty_pool);
+	xdir_destroy(&m_delta_dir);
 	xdir_destroy(&m_snap_dir);
 
 	memtx_tuple_free();
 }
 
+void
+MemtxEngine::setCheckpointSink(const char *uri)
+{
+	char *copy = NULL;
+	if (uri != NULL && *uri != '\0') {
+		copy = strdup(uri);
+		if (copy == NULL)
+			tnt_raise(OutOfMemory, strlen(uri) + 1,
+				  "malloc", "checkpoint sink uri");
+	}
+	free(m_checkpoint_sink);
+	m_checkpoint_sink = copy;
+}
+
+/* {{{ Pipelined snapshot reading **************************************/
+
+/**
+ * State shared between the fiber applying snapshot rows and the
+ * fiber reading the next tx ahead of it, see
+ * recoverSnapshotPipelined().
+ *
+ * Snapshot rows must be applied by the tx cord: tuples live in
+ * the single-threaded memtx arena, which is also what rules out
+ * applying rows of different spaces in parallel. What can leave
+ * the cord is the expensive half of reading - the payload crc32
+ * and zstd decompression of a tx - so a helper fiber extracts
+ * the raw tx bytes from the cursor and ships the decode to a
+ * coio thread while the previous tx is being applied here.
+ */
+struct snap_read_ahead {
+	/** The cursor to read from, owned by the caller. */
+	struct xlog_cursor *cursor;
+	/** Decompression context used on the coio thread. */
+	ZSTD_DStream *zdctx;
+	/** Decoded rows of the prefetched tx, malloced. */
+	char *rows;
+	/** Size of @rows, bytes. */
+	size_t size;
+	/** Result of fetching the tx: 0, 1 for eof, -1 for error. */
+	int rc;
+	/** On error, the reader parks its diag here. */
+	struct diag diag;
+	/** True while @rows and @rc describe an unconsumed tx. */
+	bool ready;
+	/** The consumer asks the reader to quit. */
+	bool stop;
+	/** Signalled on both the ready and consumed transitions. */
+	struct ipc_cond cond;
+};
+
+/** A coio_call() worker: decode one raw tx off the tx cord. */
+static ssize_t
+snap_read_ahead_decode_cb(va_list ap)
+{
+	struct xlog_tx_raw *tx = va_arg(ap, struct xlog_tx_raw *);
+	char **rows = va_arg(ap, char **);
+	ZSTD_DStream *zdctx = va_arg(ap, ZSTD_DStream *);
+	return xlog_tx_raw_decode(tx, rows, zdctx);
+}
+
+static int
+snap_read_ahead_f(va_list ap)
+{
+	struct snap_read_ahead *ra = va_arg(ap, struct snap_read_ahead *);
+	while (!ra->stop) {
+		struct xlog_tx_raw tx;
+		char *rows = NULL;
+		ssize_t size = 0;
+		int rc = xlog_cursor_next_tx_raw(ra->cursor, &tx);
+		if (rc == 0) {
+			/*
+			 * The consumer applies the previous tx
+			 * while the coio thread works on this one.
+			 */
+			size = coio_call(snap_read_ahead_decode_cb,
+					 &tx, &rows, ra->zdctx);
+			free(tx.data);
+			if (size < 0) {
+				rc = -1;
+				if (diag_is_empty(diag_get()))
+					diag_set(OutOfMemory,
+						 sizeof(struct coio_task),
+						 "malloc", "coio task");
+			}
+		}
+		if (rc < 0)
+			diag_move(diag_get(), &ra->diag);
+		/* Wait until the previous tx is consumed. */
+		while (ra->ready && !ra->stop)
+			ipc_cond_wait(&ra->cond);
+		if (ra->stop) {
+			free(rows);
+			break;
+		}
+		ra->rows = rows;
+		ra->size = size;
+		ra->rc = rc;
+		ra->ready = true;
+		ipc_cond_signal(&ra->cond);
+		if (rc != 0)
+			break;
+	}
+	return 0;
+}
+
+void
+MemtxEngine::recoverSnapshotPipelined(struct xlog_cursor *cursor)
+{
+	struct snap_read_ahead ra;
+	memset(&ra, 0, sizeof(ra));
+	ra.cursor = cursor;
+	ra.zdctx = ZSTD_createDStream();
+	if (ra.zdctx == NULL)
+		tnt_raise(OutOfMemory, sizeof(ZSTD_DStream),
+			  "malloc", "zdctx");
+	diag_create(&ra.diag);
+	ipc_cond_create(&ra.cond);
+	struct fiber *reader = fiber_new_xc("snap_read_ahead",
+					    snap_read_ahead_f);
+	fiber_set_joinable(reader, true);
+	fiber_start(reader, &ra);
+	auto ra_guard = make_scoped_guard([&]{
+		ra.stop = true;
+		ipc_cond_signal(&ra.cond);
+		fiber_join(reader);
+		free(ra.rows);
+		ipc_cond_destroy(&ra.cond);
+		diag_destroy(&ra.diag);
+		ZSTD_freeDStream(ra.zdctx);
+	});
+
+	uint64_t row_count = 0;
+	while (true) {
+		while (!ra.ready)
+			ipc_cond_wait(&ra.cond);
+		int rc = ra.rc;
+		char *rows = ra.rows;
+		size_t size = ra.size;
+		ra.rows = NULL;
+		ra.ready = false;
+		ipc_cond_signal(&ra.cond);
+		if (rc != 0) {
+			if (rc < 0) {
+				diag_move(&ra.diag, diag_get());
+				diag_raise();
+			}
+			break; /* eof */
+		}
+		auto rows_guard = make_scoped_guard([=]{ free(rows); });
+		const char *pos = rows;
+		const char *end = rows + size;
+		while (pos < end) {
+			struct xrow_header row;
+			if (xrow_header_decode(&row, &pos, end) != 0)
+				tnt_raise(XlogError, "can't parse row");
+			recoverSnapshotRow(&row);
+			++row_count;
+			if (row_count % 100000 == 0)
+				say_info("%.1fM rows processed",
+					 row_count / 1000000.);
+			/*
+			 * A yield between the rows is what lets
+			 * the reader fiber and the coio thread
+			 * work ahead of the apply loop.
+			 */
+			fiber_preempt_point();
+		}
+	}
+}
+
+/* }}} */
+
 void
 MemtxEngine::recoverSnapshot(const struct vclock *vclock)
 {
 	/* Process existing snapshot */
 	say_info("recovery start");
-	int64_t signature = vclock_sum(vclock);
+	/*
+	 * The checkpoint may be a delta: find the newest full
+	 * snapshot it is based on, recover that first and then
+	 * replay the delta chain on top of it.
+	 */
+	xdir_scan_xc(&m_snap_dir);
+	struct vclock key;
+	vclock_copy(&key, vclock);
+	struct vclock *base_vclock = vclockset_match(&m_snap_dir.index, &key);
+	if (base_vclock == NULL || vclock_compare(base_vclock, &key) > 0)
+		tnt_raise(ClientError, ER_MISSING_SNAPSHOT);
+	int64_t signature = vclock_sum(base_vclock);
 	const char *filename = xdir_format_filename(&m_snap_dir, signature,
 						    NONE);
 
 	say_info("recovering from `%s'", filename);
-	struct xlog_cursor cursor;
-	xlog_cursor_open_xc(&cursor, filename);
-	INSTANCE_UUID = cursor.meta.instance_uuid;
-	auto reader_guard = make_scoped_guard([&]{
-		xlog_cursor_close(&cursor, false);
-	});
-
-	struct xrow_header row;
-	uint64_t row_count = 0;
-	while (xlog_cursor_next_xc(&cursor, &row, m_force_recovery) == 0) {
-		try {
-			recoverSnapshotRow(&row);
-		} catch (ClientError *e) {
-			if (!m_force_recovery)
-				throw;
-			say_error("can't apply row: ");
-			e->log();
-		}
-		++row_count;
-		if (row_count % 100000 == 0) {
-			say_info("%.1fM rows processed",
-				 row_count / 1000000.);
-			fiber_yield_timeout(0);
+	{
+		struct xlog_cursor cursor;
+		xlog_cursor_open_xc(&cursor, filename);
+		cursor.read_ahead = XLOG_READ_AHEAD_BULK;
+		INSTANCE_UUID = cursor.meta.instance_uuid;
+		auto reader_guard = make_scoped_guard([&]{
+			xlog_cursor_close(&cursor, false);
+		});
+
+		if (!m_force_recovery) {
+			recoverSnapshotPipelined(&cursor);
+		} else {
+			/*
+			 * Force recovery tolerates errors per row
+			 * and resyncs on the tx magic after a
+			 * corrupted region, which the raw tx path
+			 * of the pipeline can not do. Stay on the
+			 * plain serial loop.
+			 */
+			struct xrow_header row;
+			uint64_t row_count = 0;
+			while (xlog_cursor_next_xc(&cursor, &row,
+						   m_force_recovery) == 0) {
+				try {
+					recoverSnapshotRow(&row);
+				} catch (ClientError *e) {
+					say_error("can't apply row: ");
+					e->log();
+				}
+				++row_count;
+				if (row_count % 100000 == 0)
+					say_info("%.1fM rows processed",
+						 row_count / 1000000.);
+				/*
+				 * A yield between the rows is safe;
+				 * the budget replaces the old ad-hoc
+				 * yield once per 100k rows.
+				 */
+				fiber_preempt_point();
+			}
 		}
+
+		/**
+		 * We should never try to read snapshots with no EOF
+		 * marker - such snapshots are very likely corrupted and
+		 * should not be trusted.
+		 */
+		if (cursor.state != XLOG_CURSOR_EOF)
+			panic("snapshot `%s' has no EOF marker", filename);
 	}
 
-	/**
-	 * We should never try to read snapshots with no EOF
-	 * marker - such snapshots are very likely corrupted and
-	 * should not be trusted.
+	if (vclock_compare(base_vclock, &key) == 0)
+		return; /* a plain full snapshot, no deltas */
+
+	/*
+	 * Delta rows arrive in commit order and contain
+	 * deletions, so finish the bulk build of the primary
+	 * keys before replaying the chain: enter the final
+	 * recovery state early. beginFinalRecovery() is a no-op
+	 * when the caller invokes it for the second time.
 	 */
-	if (cursor.state != XLOG_CURSOR_EOF)
-		panic("snapshot `%s' has no EOF marker", filename);
+	beginFinalRecovery();
+
+	xdir_scan_xc(&m_delta_dir);
+	struct vclock prev;
+	vclock_copy(&prev, base_vclock);
+	int chain_len = 0;
+	struct vclock *delta_vclock;
+	for (delta_vclock = vclockset_first(&m_delta_dir.index);
+	     delta_vclock != NULL;
+	     delta_vclock = vclockset_next(&m_delta_dir.index, delta_vclock)) {
+		if (vclock_sum(delta_vclock) <= signature)
+			continue;
+		if (vclock_compare(delta_vclock, &key) > 0)
+			break;
+		filename = xdir_format_filename(&m_delta_dir,
+						vclock_sum(delta_vclock),
+						NONE);
+		say_info("recovering from `%s'", filename);
+		struct xlog_cursor cursor;
+		xlog_cursor_open_xc(&cursor, filename);
+		cursor.read_ahead = XLOG_READ_AHEAD_BULK;
+		auto reader_guard = make_scoped_guard([&]{
+			xlog_cursor_close(&cursor, false);
+		});
+		/*
+		 * A hole in the chain would silently lose the
+		 * rows of the missing delta, so insist that each
+		 * file names the checkpoint we have recovered to.
+		 */
+		if (!cursor.meta.has_prev_vclock ||
+		    vclock_compare(&cursor.meta.prev_vclock, &prev) != 0)
+			tnt_raise(XlogGapError, &prev, delta_vclock);
+
+		struct xrow_header row;
+		while (xlog_cursor_next_xc(&cursor, &row,
+					   m_force_recovery) == 0) {
+			try {
+				recoverDeltaRow(&row);
+			} catch (ClientError *e) {
+				if (!m_force_recovery)
+					throw;
+				say_error("can't apply row: ");
+				e->log();
+			}
+		}
+		if (cursor.state != XLOG_CURSOR_EOF)
+			panic("snapshot `%s' has no EOF marker", filename);
 
+		vclock_copy(&prev, delta_vclock);
+		chain_len++;
+	}
+	if (vclock_compare(&prev, &key) != 0)
+		tnt_raise(XlogGapError, &prev, &key);
+	m_delta_chain_len = chain_len;
 }
 
 void
@@ -212,6 +545,19 @@ MemtxEngine::recoverSnapshotRow(struct xrow_header *row)
 	fiber_gc();
 }
 
+void
+MemtxEngine::recoverDeltaRow(struct xrow_header *row)
+{
+	assert(row->bodycnt == 1); /* always 1 for read */
+	struct request *request = xrow_decode_request(row);
+	struct space *space = space_cache_find(request->space_id);
+	/* memtx delta snapshots must contain only memtx spaces */
+	if (space->handler->engine != this)
+		tnt_raise(ClientError, ER_CROSS_ENGINE_TRANSACTION);
+	((MemtxSpace *) space->handler)->applyDeltaRow(space, request);
+	fiber_gc();
+}
+
 /** Called at start to tell memtx to recover to a given LSN. */
 void
 MemtxEngine::beginInitialRecovery(const struct vclock *)
@@ -227,6 +573,12 @@ MemtxEngine::beginInitialRecovery(const struct vclock *)
 	 * discard duplicates in the snapshot.
 	 */
 	m_state = (m_force_recovery ? MEMTX_OK : MEMTX_INITIAL_RECOVERY);
+	/*
+	 * Snapshot load and WAL replay insert tuples in bulk:
+	 * carve them from batch reservations instead of going to
+	 * the allocator for each one.
+	 */
+	memtx_tuple_batch_begin(0);
 }
 
 void
@@ -234,6 +586,9 @@ MemtxEngine::beginFinalRecovery()
 {
 	if (m_state == MEMTX_OK)
 		return;
+	/* Entered early by recoverSnapshot() to replay deltas. */
+	if (m_state == MEMTX_FINAL_RECOVERY)
+		return;
 
 	assert(m_state == MEMTX_INITIAL_RECOVERY);
 	/* End of the fast path: loaded the primary key. */
@@ -259,9 +614,63 @@ MemtxEngine::beginFinalRecovery()
 	}
 }
 
+/** Fibers building secondary keys of spaces, to be joined. */
+struct memtx_build_fibers {
+	struct fiber **fibers;
+	uint32_t count;
+	uint32_t capacity;
+	MemtxEngine *engine;
+};
+
+static int
+memtx_build_secondary_keys_f(va_list ap)
+{
+	struct space *space = va_arg(ap, struct space *);
+	MemtxEngine *engine = va_arg(ap, MemtxEngine *);
+	try {
+		memtx_build_secondary_keys(space, engine);
+	} catch (Exception *e) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Start building secondary keys of a space in a separate fiber.
+ * The fibers interleave at the points where a TREE index build
+ * offloads its sort phase to an eio thread, so the sorts of
+ * different indexes run in parallel. If a fiber can not be
+ * created, fall back to an inline build.
+ */
+static void
+memtx_start_build_secondary_keys(struct space *space, void *param)
+{
+	struct memtx_build_fibers *ctx = (struct memtx_build_fibers *) param;
+	if (ctx->count == ctx->capacity) {
+		uint32_t capacity = ctx->capacity ? ctx->capacity * 2 : 16;
+		struct fiber **fibers = (struct fiber **)
+			realloc(ctx->fibers, capacity * sizeof(*fibers));
+		if (fibers != NULL) {
+			ctx->fibers = fibers;
+			ctx->capacity = capacity;
+		}
+	}
+	struct fiber *f = NULL;
+	if (ctx->count < ctx->capacity)
+		f = fiber_new("build_sk", memtx_build_secondary_keys_f);
+	if (f == NULL) {
+		memtx_build_secondary_keys(space, ctx->engine);
+		return;
+	}
+	fiber_set_joinable(f, true);
+	fiber_start(f, space, ctx->engine);
+	ctx->fibers[ctx->count++] = f;
+}
+
 void
 MemtxEngine::endRecovery()
 {
+	memtx_tuple_batch_end();
 	/*
 	 * Recovery is started with enabled keys when:
 	 * - either of force_recovery
@@ -271,7 +680,18 @@ MemtxEngine::endRecovery()
 	if (m_state != MEMTX_OK) {
 		assert(m_state == MEMTX_FINAL_RECOVERY);
 		m_state = MEMTX_OK;
-		space_foreach(memtx_build_secondary_keys, this);
+		struct memtx_build_fibers ctx = { NULL, 0, 0, this };
+		auto fibers_guard = make_scoped_guard([&]{
+			free(ctx.fibers);
+		});
+		space_foreach(memtx_start_build_secondary_keys, &ctx);
+		int rc = 0;
+		for (uint32_t i = 0; i < ctx.count; i++) {
+			if (fiber_join(ctx.fibers[i]) != 0)
+				rc = -1;
+		}
+		if (rc != 0)
+			diag_raise();
 	}
 }
 
@@ -541,12 +961,92 @@ MemtxEngine::rollback(struct txn *txn)
 		rollbackStatement(txn, stmt);
 }
 
+void
+MemtxEngine::dirtyLogAdd(struct txn_stmt *stmt)
+{
+	if (space_is_system(stmt->space)) {
+		/*
+		 * DDL swaps space objects under our feet; rather
+		 * than chase the statements it produces, give up
+		 * and let the next checkpoint be a full snapshot.
+		 */
+		dirtyLogInvalidate();
+		return;
+	}
+	if (m_dirty_rows >= MEMTX_DELTA_LOG_MAX) {
+		dirtyLogInvalidate();
+		return;
+	}
+	struct memtx_dirty_record *rec = (struct memtx_dirty_record *)
+		mempool_alloc(&m_dirty_pool);
+	if (rec == NULL) {
+		dirtyLogInvalidate();
+		return;
+	}
+	rec->space_id = space_id(stmt->space);
+	rec->tuple = NULL;
+	rec->key = NULL;
+	rec->key_size = 0;
+	if (stmt->new_tuple != NULL) {
+		rec->tuple = stmt->new_tuple;
+		tuple_ref(rec->tuple);
+	} else {
+		/*
+		 * A deletion: the old tuple dies with the
+		 * transaction, so remember its primary key
+		 * instead of pinning the whole tuple.
+		 */
+		struct key_def *key_def =
+			&stmt->space->index[0]->index_def->key_def;
+		uint32_t key_size;
+		char *key = tuple_extract_key(stmt->old_tuple, key_def,
+					      &key_size);
+		if (key != NULL)
+			rec->key = (char *)malloc(key_size);
+		if (rec->key == NULL) {
+			mempool_free(&m_dirty_pool, rec);
+			dirtyLogInvalidate();
+			return;
+		}
+		memcpy(rec->key, key, key_size);
+		rec->key_size = key_size;
+	}
+	stailq_add_tail_entry(&m_dirty_log, rec, link);
+	m_dirty_rows++;
+}
+
+void
+MemtxEngine::dirtyLogFree(struct stailq *log)
+{
+	struct memtx_dirty_record *rec, *next;
+	stailq_foreach_entry_safe(rec, next, log, link) {
+		if (rec->tuple != NULL)
+			tuple_unref(rec->tuple);
+		free(rec->key);
+		mempool_free(&m_dirty_pool, rec);
+	}
+	stailq_create(log);
+}
+
+void
+MemtxEngine::dirtyLogInvalidate()
+{
+	dirtyLogFree(&m_dirty_log);
+	m_dirty_rows = 0;
+	m_dirty_valid = false;
+}
+
 void
 MemtxEngine::commit(struct txn *txn, int64_t signature)
 {
 	(void) signature;
 	struct txn_stmt *stmt;
 	stailq_foreach_entry(stmt, &txn->stmts, next) {
+		if (m_dirty_valid && stmt->space != NULL &&
+		    space_is_memtx(stmt->space) &&
+		    !space_is_temporary(stmt->space) &&
+		    (stmt->old_tuple || stmt->new_tuple))
+			dirtyLogAdd(stmt);
 		if (stmt->old_tuple)
 			tuple_unref(stmt->old_tuple);
 	}
@@ -632,6 +1132,29 @@ checkpoint_write_tuple(struct xlog *l, uint32_t n, struct tuple *tuple)
 	checkpoint_write_row(l, &row);
 }
 
+static void
+checkpoint_write_delete(struct xlog *l, uint32_t n, const char *key,
+			uint32_t key_size)
+{
+	struct request_delete_body body;
+	body.m_body = 0x82; /* map of two elements. */
+	body.k_space_id = IPROTO_SPACE_ID;
+	body.m_space_id = 0xce; /* uint32 */
+	body.v_space_id = mp_bswap_u32(n);
+	body.k_key = IPROTO_KEY;
+
+	struct xrow_header row;
+	memset(&row, 0, sizeof(struct xrow_header));
+	row.type = IPROTO_DELETE;
+
+	row.bodycnt = 2;
+	row.body[0].iov_base = &body;
+	row.body[0].iov_len = sizeof(body);
+	row.body[1].iov_base = (char *) key;
+	row.body[1].iov_len = key_size;
+	checkpoint_write_row(l, &row);
+}
+
 struct checkpoint_entry {
 	struct space *space;
 	struct iterator *iterator;
@@ -647,27 +1170,82 @@ struct checkpoint {
 	uint64_t snap_io_rate_limit;
 	struct cord cord;
 	bool waiting_for_snap_thread;
+	/** The number of tuples to snapshot, for box.info. */
+	uint64_t total_rows;
+	/**
+	 * The number of tuples written so far. Updated by the
+	 * snapshot thread and read by tx without synchronization:
+	 * it is only used for progress reporting, an occasional
+	 * stale value is harmless.
+	 */
+	uint64_t written_rows;
+	/** When the snapshot thread was started. */
+	double start_time;
 	/** The vclock of the snapshot file. */
 	struct vclock vclock;
 	struct xdir dir;
+	/** The directory where to store delta snapshots. */
+	struct xdir delta_dir;
+	/**
+	 * The dirty log frozen at the moment the checkpoint
+	 * vclock was taken: the contents of a delta snapshot.
+	 */
+	struct stailq dirty_log;
+	/** The number of records in dirty_log. */
+	uint64_t dirty_rows;
+	/** The vclock of the checkpoint the delta chains to. */
+	struct vclock prev_vclock;
+	/**
+	 * Write a delta snapshot chained to prev_vclock instead
+	 * of a full snapshot.
+	 */
+	bool is_delta;
+	/** Set once the dirty log has been frozen. */
+	bool frozen;
+	/** m_dirty_valid at freeze time, to restore on abort. */
+	bool dirty_was_valid;
 	/**
 	 * Do nothing, just touch the snapshot file - the
 	 * checkpoint already exists.
 	 */
 	bool touch;
+	/**
+	 * URI to stream the checkpoint to, malloced, or NULL.
+	 * A copy of MemtxEngine::m_checkpoint_sink frozen at
+	 * checkpoint start: the box.cfg value may change while
+	 * the snapshot thread runs.
+	 */
+	char *sink_uri;
 };
 
 static void
 checkpoint_init(struct checkpoint *ckpt, const char *snap_dirname,
-		uint64_t snap_io_rate_limit)
+		uint64_t snap_io_rate_limit, const char *sink_uri)
 {
 	ckpt->entries = RLIST_HEAD_INITIALIZER(ckpt->entries);
 	ckpt->waiting_for_snap_thread = false;
 	xdir_create(&ckpt->dir, snap_dirname, SNAP, &INSTANCE_UUID);
+	xdir_create(&ckpt->delta_dir, snap_dirname, DSNAP, &INSTANCE_UUID);
 	ckpt->snap_io_rate_limit = snap_io_rate_limit;
+	ckpt->total_rows = 0;
+	ckpt->written_rows = 0;
+	ckpt->start_time = 0.;
 	/* May be used in abortCheckpoint() */
 	vclock_create(&ckpt->vclock);
+	stailq_create(&ckpt->dirty_log);
+	ckpt->dirty_rows = 0;
+	vclock_create(&ckpt->prev_vclock);
+	ckpt->is_delta = false;
+	ckpt->frozen = false;
+	ckpt->dirty_was_valid = false;
 	ckpt->touch = false;
+	ckpt->sink_uri = NULL;
+	if (sink_uri != NULL) {
+		ckpt->sink_uri = strdup(sink_uri);
+		if (ckpt->sink_uri == NULL)
+			tnt_raise(OutOfMemory, strlen(sink_uri) + 1,
+				  "malloc", "checkpoint sink uri");
+	}
 }
 
 static void
@@ -680,6 +1258,11 @@ checkpoint_destroy(struct checkpoint *ckpt)
 		entry->iterator->free(entry->iterator);
 	}
 	ckpt->entries = RLIST_HEAD_INITIALIZER(ckpt->entries);
+	/* The dirty log must have been freed or merged back. */
+	assert(stailq_empty(&ckpt->dirty_log));
+	free(ckpt->sink_uri);
+	ckpt->sink_uri = NULL;
+	xdir_destroy(&ckpt->delta_dir);
 	xdir_destroy(&ckpt->dir);
 }
 
@@ -704,16 +1287,74 @@ checkpoint_add_space(struct space *sp, void *data)
 
 	pk->initIterator(entry->iterator, ITER_ALL, NULL, 0);
 	pk->createReadViewForIterator(entry->iterator);
+	ckpt->total_rows += pk->size();
 };
 
+/**
+ * Connect to the checkpoint sink with plain blocking sockets:
+ * called from the snapshot thread, never from tx, so blocking
+ * resolve and connect are fine here.
+ *
+ * @retval >=0 connected socket
+ * @retval  -1 error, check diag
+ */
+static int
+checkpoint_sink_connect(const char *uri_str)
+{
+	struct uri uri;
+	if (uri_parse(&uri, uri_str) != 0 || uri.service == NULL) {
+		diag_set(ClientError, ER_CFG, "checkpoint_sink",
+			 "expected host:port");
+		return -1;
+	}
+	char host[NI_MAXHOST] = { '\0' };
+	char service[NI_MAXSERV];
+	if (uri.host != NULL)
+		snprintf(host, sizeof(host), "%.*s",
+			 (int)uri.host_len, uri.host);
+	snprintf(service, sizeof(service), "%.*s",
+		 (int)uri.service_len, uri.service);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *res = NULL;
+	if (getaddrinfo(uri.host != NULL ? host : "localhost",
+			service, &hints, &res) != 0) {
+		diag_set(SystemError, "can't resolve checkpoint sink "
+			 "uri '%s'", uri_str);
+		return -1;
+	}
+	int fd = -1;
+	for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		diag_set(SystemError, "failed to connect to checkpoint "
+			 "sink '%s'", uri_str);
+		return -1;
+	}
+	return fd;
+}
+
 int
 checkpoint_f(va_list ap)
 {
 	struct checkpoint *ckpt = va_arg(ap, struct checkpoint *);
 
 	if (ckpt->touch) {
+		/* The existing checkpoint may be full or delta. */
 		if (xdir_touch_xlog(&ckpt->dir, &ckpt->vclock) == 0)
 			return 0;
+		if (xdir_touch_xlog(&ckpt->delta_dir, &ckpt->vclock) == 0)
+			return 0;
 		/*
 		 * Failed to touch an existing snapshot, create
 		 * a new one.
@@ -722,23 +1363,74 @@ checkpoint_f(va_list ap)
 	}
 
 	struct xlog snap;
-	if (xdir_create_xlog(&ckpt->dir, &snap, &ckpt->vclock) != 0)
+	struct xdir *dir = ckpt->is_delta ? &ckpt->delta_dir : &ckpt->dir;
+	if (xdir_create_xlog(dir, &snap, &ckpt->vclock,
+			     ckpt->is_delta ? &ckpt->prev_vclock : NULL) != 0)
 		diag_raise();
 
 	auto guard = make_scoped_guard([&]{ xlog_close(&snap, false); });
 	snap.rate_limit = ckpt->snap_io_rate_limit;
 
+	if (ckpt->sink_uri != NULL) {
+		int sink_fd = checkpoint_sink_connect(ckpt->sink_uri);
+		if (sink_fd < 0)
+			diag_raise();
+		if (xlog_sink_attach(&snap, sink_fd) != 0) {
+			close(sink_fd);
+			diag_raise();
+		}
+		say_info("streaming snapshot to `%s'", ckpt->sink_uri);
+	}
+
 	say_info("saving snapshot `%s'", snap.filename);
-	struct checkpoint_entry *entry;
-	rlist_foreach_entry(entry, &ckpt->entries, link) {
-		struct tuple *tuple;
-		struct iterator *it = entry->iterator;
-		for (tuple = it->next(it); tuple; tuple = it->next(it)) {
-			checkpoint_write_tuple(&snap, space_id(entry->space),
-					       tuple);
+	if (ckpt->is_delta) {
+		/*
+		 * Replaying the log in commit order on top of
+		 * the previous checkpoint reproduces the state
+		 * at the checkpoint vclock.
+		 */
+		struct memtx_dirty_record *rec;
+		stailq_foreach_entry(rec, &ckpt->dirty_log, link) {
+			/* The dirty log is frozen, a yield is safe. */
+			fiber_preempt_point();
+			if (rec->tuple != NULL)
+				checkpoint_write_tuple(&snap, rec->space_id,
+						       rec->tuple);
+			else
+				checkpoint_write_delete(&snap, rec->space_id,
+							rec->key,
+							rec->key_size);
+			ckpt->written_rows++;
+		}
+	} else {
+		struct checkpoint_entry *entry;
+		rlist_foreach_entry(entry, &ckpt->entries, link) {
+			struct tuple *tuple;
+			struct iterator *it = entry->iterator;
+			for (tuple = it->next(it); tuple;
+			     tuple = it->next(it)) {
+				/*
+				 * The snapshot iterator reads a
+				 * frozen view, a yield is safe.
+				 */
+				fiber_preempt_point();
+				checkpoint_write_tuple(&snap,
+						       space_id(entry->space),
+						       tuple);
+				ckpt->written_rows++;
+			}
 		}
 	}
 	xlog_flush(&snap);
+	/*
+	 * Commit the sink copy: the snapshot contents are
+	 * complete, only the EOF marker and the local rename
+	 * remain. Should the checkpoint be aborted later in tx,
+	 * the peer keeps a valid, consistent snapshot - merely
+	 * one the local instance does not list.
+	 */
+	if (snap.sink_fd >= 0 && xlog_sink_detach(&snap, true) != 0)
+		diag_raise();
 	say_info("done");
 	return 0;
 }
@@ -750,7 +1442,8 @@ MemtxEngine::beginCheckpoint()
 
 	m_checkpoint = region_alloc_object_xc(&fiber()->gc, struct checkpoint);
 
-	checkpoint_init(m_checkpoint, m_snap_dir.dirname, m_snap_io_rate_limit);
+	checkpoint_init(m_checkpoint, m_snap_dir.dirname, m_snap_io_rate_limit,
+			m_checkpoint_sink);
 	space_foreach(checkpoint_add_space, m_checkpoint);
 
 	/* increment snapshot version; set tuple deletion to delayed mode */
@@ -770,6 +1463,30 @@ MemtxEngine::waitCheckpoint(struct vclock *vclock)
 			      (vclock_compare(&last_vclock, vclock) == 0);
 	vclock_copy(&m_checkpoint->vclock, vclock);
 
+	/*
+	 * Freeze the dirty log and decide between a delta and a
+	 * full snapshot. There are no yields between the WAL
+	 * rotation in wal_checkpoint() and this point, and the
+	 * commits of all rows up to the rotation vclock have
+	 * completed before wal_checkpoint() returned, so the
+	 * log cut matches @vclock exactly.
+	 */
+	m_checkpoint->dirty_was_valid = m_dirty_valid;
+	bool has_prev = gc_last_checkpoint(&m_checkpoint->prev_vclock) >= 0;
+	m_checkpoint->is_delta = !m_checkpoint->touch && m_dirty_valid &&
+		has_prev && m_delta_chain_len < MEMTX_DELTA_CHAIN_MAX &&
+		m_dirty_rows * MEMTX_DELTA_MAX_SHARE <
+		m_checkpoint->total_rows;
+	stailq_concat(&m_checkpoint->dirty_log, &m_dirty_log);
+	m_checkpoint->dirty_rows = m_dirty_rows;
+	m_checkpoint->frozen = true;
+	m_dirty_rows = 0;
+	/* A fresh log is anchored at this checkpoint's cut. */
+	m_dirty_valid = true;
+	if (m_checkpoint->is_delta)
+		m_checkpoint->total_rows = m_checkpoint->dirty_rows;
+
+	m_checkpoint->start_time = clock_monotonic();
 	if (cord_costart(&m_checkpoint->cord, "snapshot",
 			 checkpoint_f, m_checkpoint)) {
 		return -1;
@@ -785,6 +1502,27 @@ MemtxEngine::waitCheckpoint(struct vclock *vclock)
 	return result;
 }
 
+int
+MemtxEngine::checkpointProgress(uint64_t *total_rows, uint64_t *written_rows,
+				double *elapsed)
+{
+	if (m_checkpoint == NULL || !m_checkpoint->waiting_for_snap_thread)
+		return -1;
+	*total_rows = m_checkpoint->total_rows;
+	*written_rows = m_checkpoint->written_rows;
+	*elapsed = clock_monotonic() - m_checkpoint->start_time;
+	return 0;
+}
+
+/* Used by lua/info.c */
+extern "C" int
+memtx_checkpoint_progress(uint64_t *total_rows, uint64_t *written_rows,
+			  double *elapsed)
+{
+	MemtxEngine *memtx = (MemtxEngine *) engine_find("memtx");
+	return memtx->checkpointProgress(total_rows, written_rows, elapsed);
+}
+
 void
 MemtxEngine::commitCheckpoint(struct vclock *vclock)
 {
@@ -798,7 +1536,8 @@ MemtxEngine::commitCheckpoint(struct vclock *vclock)
 
 	if (!m_checkpoint->touch) {
 		int64_t lsn = vclock_sum(&m_checkpoint->vclock);
-		struct xdir *dir = &m_checkpoint->dir;
+		struct xdir *dir = m_checkpoint->is_delta ?
+			&m_checkpoint->delta_dir : &m_checkpoint->dir;
 		/* rename snapshot on completion */
 		char to[PATH_MAX];
 		snprintf(to, sizeof(to), "%s",
@@ -809,6 +1548,12 @@ MemtxEngine::commitCheckpoint(struct vclock *vclock)
 			panic("can't rename .snap.inprogress");
 	}
 
+	/* The checkpoint has consumed the frozen dirty log. */
+	dirtyLogFree(&m_checkpoint->dirty_log);
+	if (!m_checkpoint->touch)
+		m_delta_chain_len = m_checkpoint->is_delta ?
+				    m_delta_chain_len + 1 : 0;
+
 	checkpoint_destroy(m_checkpoint);
 	m_checkpoint = 0;
 }
@@ -829,12 +1574,30 @@ MemtxEngine::abortCheckpoint()
 	memtx_tuple_end_snapshot();
 
 	/** Remove garbage .inprogress file. */
+	struct xdir *dir = m_checkpoint->is_delta ?
+		&m_checkpoint->delta_dir : &m_checkpoint->dir;
 	char *filename =
-		xdir_format_filename(&m_checkpoint->dir,
+		xdir_format_filename(dir,
 				     vclock_sum(&m_checkpoint->vclock),
 				     INPROGRESS);
 	(void) coeio_unlink(filename);
 
+	if (m_checkpoint->frozen) {
+		if (m_checkpoint->dirty_was_valid) {
+			/* Put the frozen records back in front. */
+			stailq_concat(&m_checkpoint->dirty_log, &m_dirty_log);
+			stailq_concat(&m_dirty_log, &m_checkpoint->dirty_log);
+			m_dirty_rows += m_checkpoint->dirty_rows;
+		} else {
+			/*
+			 * The log was anchored at the cut of a
+			 * checkpoint which never materialized.
+			 */
+			dirtyLogFree(&m_checkpoint->dirty_log);
+			dirtyLogInvalidate();
+		}
+	}
+
 	checkpoint_destroy(m_checkpoint);
 	m_checkpoint = 0;
 }
@@ -844,7 +1607,43 @@ MemtxEngine::backup(struct vclock *vclock, engine_backup_cb cb, void *cb_arg)
 {
 	char *filename = xdir_format_filename(&m_snap_dir,
 					      vclock_sum(vclock), NONE);
-	return cb(filename, cb_arg);
+	if (access(filename, F_OK) == 0)
+		return cb(filename, cb_arg);
+	/*
+	 * A delta checkpoint: hand over the base full snapshot
+	 * and every delta in the chain.
+	 */
+	if (xdir_scan(&m_snap_dir) < 0 || xdir_scan(&m_delta_dir) < 0)
+		return -1;
+	struct vclock *base = vclockset_match(&m_snap_dir.index, vclock);
+	if (base == NULL || vclock_compare(base, vclock) > 0) {
+		diag_set(ClientError, ER_MISSING_SNAPSHOT);
+		return -1;
+	}
+	filename = xdir_format_filename(&m_snap_dir, vclock_sum(base), NONE);
+	if (cb(filename, cb_arg) != 0)
+		return -1;
+	struct vclock *last = base;
+	struct vclock *delta_vclock;
+	for (delta_vclock = vclockset_first(&m_delta_dir.index);
+	     delta_vclock != NULL;
+	     delta_vclock = vclockset_next(&m_delta_dir.index, delta_vclock)) {
+		if (vclock_sum(delta_vclock) <= vclock_sum(base))
+			continue;
+		if (vclock_compare(delta_vclock, vclock) > 0)
+			break;
+		filename = xdir_format_filename(&m_delta_dir,
+						vclock_sum(delta_vclock),
+						NONE);
+		if (cb(filename, cb_arg) != 0)
+			return -1;
+		last = delta_vclock;
+	}
+	if (vclock_compare(last, vclock) != 0) {
+		diag_set(ClientError, ER_MISSING_SNAPSHOT);
+		return -1;
+	}
+	return 0;
 }
 
 /** Used to pass arguments to memtx_initial_join_f */
@@ -876,6 +1675,7 @@ memtx_initial_join_f(va_list ap)
 	});
 	struct xlog_cursor cursor;
 	xdir_open_cursor_xc(&dir, checkpoint_lsn, &cursor);
+	cursor.read_ahead = XLOG_READ_AHEAD_BULK;
 	auto reader_guard = make_scoped_guard([&]{
 		xlog_cursor_close(&cursor, false);
 	});
@@ -897,8 +1697,71 @@ memtx_initial_join_f(va_list ap)
 	return 0;
 }
 
+/**
+ * Invoked from a thread to ship the snapshot as a raw file: the
+ * replica has advertised IPROTO_SNAP_FILE, so there is no need
+ * to decode and re-encode every snapshot row. The replica
+ * verifies the bytes with the usual xlog checksum machinery when
+ * it replays the file locally.
+ */
+static int
+memtx_join_file_f(va_list ap)
+{
+	struct memtx_join_arg *arg = va_arg(ap, struct memtx_join_arg *);
+
+	struct xdir dir;
+	xdir_create(&dir, arg->snap_dirname, SNAP, &INSTANCE_UUID);
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s",
+		 xdir_format_filename(&dir, arg->checkpoint_lsn, NONE));
+	xdir_destroy(&dir);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		diag_set(SystemError, "failed to open '%s'", path);
+		return -1;
+	}
+	auto fd_guard = make_scoped_guard([=]{ close(fd); });
+
+	enum { MEMTX_JOIN_CHUNK = 256 * 1024 };
+	char *buf = (char *) malloc(MEMTX_JOIN_CHUNK);
+	if (buf == NULL) {
+		diag_set(OutOfMemory, MEMTX_JOIN_CHUNK, "malloc", "join chunk");
+		return -1;
+	}
+	auto buf_guard = make_scoped_guard([=]{ free(buf); });
+
+	while (true) {
+		ssize_t len = read(fd, buf, MEMTX_JOIN_CHUNK);
+		if (len < 0) {
+			diag_set(SystemError, "failed to read '%s'", path);
+			return -1;
+		}
+		if (len == 0)
+			break;
+		/* Wrap the bytes into {IPROTO_DATA: <chunk>}. */
+		char fix[16];
+		char *data = fix;
+		data = mp_encode_map(data, 1);
+		data = mp_encode_uint(data, IPROTO_DATA);
+		data = mp_encode_binl(data, len);
+		assert(data <= fix + sizeof(fix));
+		struct xrow_header row;
+		memset(&row, 0, sizeof(row));
+		row.type = IPROTO_SNAP_CHUNK;
+		row.body[0].iov_base = fix;
+		row.body[0].iov_len = data - fix;
+		row.body[1].iov_base = buf;
+		row.body[1].iov_len = len;
+		row.bodycnt = 2;
+		xstream_write_xc(arg->stream, &row);
+	}
+	return 0;
+}
+
 void
-MemtxEngine::join(struct vclock *vclock, struct xstream *stream)
+MemtxEngine::join(struct vclock *vclock, struct xstream *stream,
+		  bool snap_file)
 {
 	/*
 	 * cord_costart() passes only void * pointer as an argument.
@@ -911,7 +1774,9 @@ MemtxEngine::join(struct vclock *vclock, struct xstream *stream)
 
 	/* Send snapshot using a thread */
 	struct cord cord;
-	cord_costart(&cord, "initial_join", memtx_initial_join_f, &arg);
+	cord_costart(&cord, "initial_join",
+		     snap_file ? memtx_join_file_f : memtx_initial_join_f,
+		     &arg);
 	if (cord_cojoin(&cord) != 0)
 		diag_raise();
 }
@@ -994,3 +1859,214 @@ memtx_index_extent_reserve(int num)
 		memtx_index_num_reserved_extents++;
 	}
 }
+
+/* {{{ Online tuple compaction **********************************/
+
+/**
+ * The compaction fiber relocates live tuples into fresh
+ * allocations through memtx_space_relocate_tuple(), batch by
+ * batch, so that half-empty slabs left behind by bulk deletions
+ * drain out and return to the slab cache for reuse. Started on
+ * demand from box.slab.compact(); progress is published in
+ * box.slab.info().
+ */
+static struct fiber *memtx_compaction_fiber = NULL;
+/** Tuples relocated per scheduling slot - the pace knob. */
+static uint32_t memtx_compaction_batch_size = 0;
+/** Stop flag, checked between batches. */
+static bool memtx_compaction_stop_requested = false;
+/** Running totals for box.slab.info(). */
+static uint64_t memtx_compaction_tuples_moved = 0;
+static uint64_t memtx_compaction_bytes_moved = 0;
+
+extern struct small_alloc memtx_alloc;
+
+/** The set of spaces the compaction fiber is going to visit. */
+struct memtx_compaction_plan {
+	uint32_t *ids;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/** Collect ids of all memtx spaces (@sa space_foreach). */
+static void
+memtx_compaction_collect(struct space *sp, void *udata)
+{
+	struct memtx_compaction_plan *plan =
+		(struct memtx_compaction_plan *) udata;
+	if (sp->index_count == 0 ||
+	    strcmp(sp->handler->engine->name, "memtx") != 0)
+		return;
+	/*
+	 * The scan is re-anchored by the primary key after every
+	 * yield, which needs a stable iteration order: a HASH
+	 * primary key rehashes relocated tuples to arbitrary
+	 * positions, so the same tuple could be visited over and
+	 * over. Trees only.
+	 */
+	if (sp->index[0]->index_def->type != TREE)
+		return;
+	if (plan->count == plan->capacity) {
+		uint32_t capacity = plan->capacity ? plan->capacity * 2 : 256;
+		uint32_t *ids = (uint32_t *)
+			realloc(plan->ids, capacity * sizeof(*ids));
+		if (ids == NULL)
+			return; /* Compaction is best effort: skip. */
+		plan->ids = ids;
+		plan->capacity = capacity;
+	}
+	plan->ids[plan->count++] = space_id(sp);
+}
+
+/**
+ * Relocate one batch of tuples of a space, continuing after
+ * *last_key (NULL for the first batch). *last_key is replaced
+ * with a malloc'ed copy of the primary key of the last visited
+ * tuple, so the scan can be re-anchored after the yield even if
+ * the space is modified meanwhile. Does not yield itself.
+ *
+ * Returns the number of tuples visited; less than the batch size
+ * means the space is done (end of index or allocation failure).
+ */
+static uint32_t
+memtx_compaction_batch(struct space *space, char **last_key)
+{
+	Index *pk = space_index(space, 0);
+	/* The space may have been altered since it was planned. */
+	if (pk == NULL || pk->index_def->type != TREE)
+		return 0;
+	uint32_t batch_size = memtx_compaction_batch_size;
+	struct tuple **tuples = region_alloc_array(&fiber()->gc,
+						   struct tuple *, batch_size);
+	if (tuples == NULL)
+		return 0;
+	struct iterator *it = pk->allocIterator();
+	auto it_guard = make_scoped_guard([=] { it->free(it); });
+	if (*last_key != NULL) {
+		const char *key = *last_key;
+		uint32_t part_count = mp_decode_array(&key);
+		pk->initIterator(it, ITER_GT, key, part_count);
+	} else {
+		pk->initIterator(it, ITER_ALL, NULL, 0);
+	}
+	uint32_t count = 0;
+	struct tuple *tuple;
+	while (count < batch_size && (tuple = it->next(it)) != NULL)
+		tuples[count++] = tuple;
+	if (count == 0)
+		return 0;
+	/* Remember where to continue before the originals die. */
+	uint32_t key_size;
+	char *key = tuple_extract_key(tuples[count - 1],
+				      &pk->index_def->key_def, &key_size);
+	if (key == NULL)
+		return 0;
+	char *anchor = (char *) malloc(key_size);
+	if (anchor == NULL)
+		return 0;
+	memcpy(anchor, key, key_size);
+	free(*last_key);
+	*last_key = anchor;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t bsize = tuples[i]->bsize;
+		if (memtx_space_relocate_tuple(space, tuples[i]) != 0) {
+			/* Out of memory - wind down quietly. */
+			return i;
+		}
+		memtx_compaction_tuples_moved++;
+		memtx_compaction_bytes_moved += bsize;
+	}
+	return count;
+}
+
+static int
+memtx_compaction_f(va_list ap)
+{
+	(void) ap;
+	struct memtx_compaction_plan plan;
+	memset(&plan, 0, sizeof(plan));
+	try {
+		space_foreach(memtx_compaction_collect, &plan);
+	} catch (Exception *e) {
+		plan.count = 0;
+	}
+	char *last_key = NULL;
+	for (uint32_t i = 0; i < plan.count; i++) {
+		free(last_key);
+		last_key = NULL;
+		while (!memtx_compaction_stop_requested) {
+			/*
+			 * While a snapshot is in progress freed
+			 * blocks are not returned to the slab
+			 * cache, so relocation would only grow
+			 * the arena. Wait it out.
+			 */
+			if (memtx_alloc.is_delayed_free_mode) {
+				fiber_sleep(0.1);
+				continue;
+			}
+			/*
+			 * Re-resolve the space after each yield:
+			 * it may have been dropped or altered.
+			 */
+			struct space *space = space_by_id(plan.ids[i]);
+			if (space == NULL)
+				break;
+			struct region_svp svp;
+			region_svp_create(&svp, &fiber()->gc);
+			uint32_t moved;
+			try {
+				moved = memtx_compaction_batch(space,
+							       &last_key);
+			} catch (Exception *e) {
+				moved = 0;
+			}
+			region_svp_restore(&svp, &fiber()->gc);
+			if (moved < memtx_compaction_batch_size)
+				break;
+			fiber_sleep(0);
+		}
+		if (memtx_compaction_stop_requested)
+			break;
+	}
+	free(last_key);
+	free(plan.ids);
+	memtx_compaction_fiber = NULL;
+	memtx_compaction_batch_size = 0;
+	return 0;
+}
+
+extern "C" int
+memtx_compact_start(uint32_t tuples_per_batch)
+{
+	if (memtx_compaction_fiber != NULL)
+		return -1;
+	if (tuples_per_batch == 0)
+		tuples_per_batch = 1000;
+	struct fiber *f = fiber_new("memtx_compaction", memtx_compaction_f);
+	if (f == NULL)
+		return -1;
+	memtx_compaction_batch_size = tuples_per_batch;
+	memtx_compaction_stop_requested = false;
+	memtx_compaction_fiber = f;
+	fiber_start(f);
+	return 0;
+}
+
+extern "C" void
+memtx_compact_stop(void)
+{
+	memtx_compaction_stop_requested = true;
+}
+
+extern "C" void
+memtx_compact_progress(uint64_t *tuples_moved, uint64_t *bytes_moved,
+		       bool *is_running)
+{
+	*tuples_moved = memtx_compaction_tuples_moved;
+	*bytes_moved = memtx_compaction_bytes_moved;
+	*is_running = memtx_compaction_fiber != NULL;
+}
+
+/* }}} */
@@ -32,6 +32,8 @@
  */
 #include "engine.h"
 #include "xlog.h"
+#include "salad/stailq.h"
+#include "small/mempool.h"
 
 /**
  * The state of memtx recovery process.
@@ -74,7 +76,7 @@ struct MemtxEngine: public Engine {
 	MemtxEngine(const char *snap_dirname, bool force_recovery,
 		    uint64_t tuple_arena_max_size,
 		    uint32_t objsize_min, uint32_t objsize_max,
-		    float alloc_factor);
+		    float alloc_factor, bool huge_pages);
 	~MemtxEngine();
 	virtual Handler *open() override;
 	virtual void addPrimaryKey(struct space *space) override;
@@ -93,8 +95,8 @@ struct MemtxEngine: public Engine {
 	virtual void beginInitialRecovery(const struct vclock *) override;
 	virtual void beginFinalRecovery() override;
 	virtual void endRecovery() override;
-	virtual void join(struct vclock *vclock,
-			  struct xstream *stream) override;
+	virtual void join(struct vclock *vclock, struct xstream *stream,
+			  bool snap_file) override;
 	virtual int beginCheckpoint() override;
 	virtual int waitCheckpoint(struct vclock *vclock) override;
 	virtual void commitCheckpoint(struct vclock *vclock) override;
@@ -107,18 +109,90 @@ struct MemtxEngine: public Engine {
 	{
 		m_snap_io_rate_limit = new_limit * 1024 * 1024;
 	}
+	/**
+	 * Set the URI checkpoints are streamed to, in addition
+	 * to local persistence. NULL disables streaming.
+	 * Applies from the next checkpoint on.
+	 */
+	void setCheckpointSink(const char *uri);
+	/**
+	 * Progress of the snapshot being written, for box.info.
+	 * Returns -1 if no snapshot is in progress.
+	 */
+	int checkpointProgress(uint64_t *total_rows, uint64_t *written_rows,
+			       double *elapsed);
 	void recoverSnapshot(const struct vclock *vclock);
 private:
 	void
 	recoverSnapshotRow(struct xrow_header *row);
+	/**
+	 * Apply all rows of a full snapshot, overlapping the
+	 * checksum and decompression of the next tx with the
+	 * application of the current one.
+	 */
+	void
+	recoverSnapshotPipelined(struct xlog_cursor *cursor);
+	void
+	recoverDeltaRow(struct xrow_header *row);
+	/**
+	 * Append a committed statement to the dirty log, the
+	 * raw material of the next delta checkpoint. Any
+	 * failure to record a statement simply invalidates the
+	 * log and falls back to a full snapshot.
+	 */
+	void
+	dirtyLogAdd(struct txn_stmt *stmt);
+	/**
+	 * Unref the tuples of @log records and release the
+	 * records themselves.
+	 */
+	void
+	dirtyLogFree(struct stailq *log);
+	/** Drop the dirty log and stop recording until the next
+	 * full checkpoint. */
+	void
+	dirtyLogInvalidate();
 	/** Non-zero if there is a checkpoint (snapshot) in progress. */
 	struct checkpoint *m_checkpoint;
 	enum memtx_recovery_state m_state;
 	/** The directory where to store snapshots. */
 	struct xdir m_snap_dir;
+	/** The directory where to store delta snapshots. */
+	struct xdir m_delta_dir;
 	/** Limit disk usage of checkpointing (bytes per second). */
 	uint64_t m_snap_io_rate_limit;
+	/**
+	 * URI of the checkpoint sink, malloced, or NULL when
+	 * checkpoint streaming is disabled.
+	 */
+	char *m_checkpoint_sink;
 	bool m_force_recovery;
+	/**
+	 * Statements committed since the last checkpoint, in
+	 * commit order. Replaying the log on top of the last
+	 * checkpoint reproduces the current state, which is
+	 * what a delta checkpoint writes to disk instead of
+	 * the whole data set.
+	 */
+	struct stailq m_dirty_log;
+	/** Allocator for dirty log records. */
+	struct mempool m_dirty_pool;
+	/** The number of records in the dirty log. */
+	uint64_t m_dirty_rows;
+	/**
+	 * True if the dirty log is complete with respect to the
+	 * last checkpoint and the next checkpoint may be written
+	 * as a delta. Cleared on DDL, on log overflow and at
+	 * server start; set again once a checkpoint anchors a
+	 * new log.
+	 */
+	bool m_dirty_valid;
+	/**
+	 * The number of delta checkpoints since the last full
+	 * snapshot, to cap the length of the chain recovery
+	 * has to replay.
+	 */
+	int m_delta_chain_len;
 };
 
 enum {
@@ -76,6 +76,10 @@ void
 hash_iterator_free(struct iterator *iterator)
 {
 	assert(iterator->free == hash_iterator_free);
+	struct hash_iterator *it = (struct hash_iterator *) iterator;
+	/* Release the read view of a frozen iterator, if any. */
+	if (matras_is_read_view_created(&it->iterator.view))
+		light_index_iterator_destroy(it->hash_table, &it->iterator);
 	free(iterator);
 }
 
@@ -144,7 +148,17 @@ MemtxHash::~MemtxHash()
 void
 MemtxHash::reserve(uint32_t size_hint)
 {
-	(void)size_hint;
+	/*
+	 * Grow the table to its final size upfront: the build that
+	 * follows (see index_build()) then inserts without ever
+	 * splitting chains, and the first writes after it do not
+	 * pay the growth latency either.
+	 */
+	if (light_index_reserve(hash_table, size_hint) != 0) {
+		tnt_raise(OutOfMemory, (size_t)size_hint *
+			  sizeof(struct light_index_record),
+			  "MemtxHash", "reserve");
+	}
 }
 
 size_t
@@ -179,13 +193,48 @@ MemtxHash::findByKey(const char *key, uint32_t part_count) const
 	(void) part_count;
 
 	struct tuple *ret = NULL;
-	uint32_t h = key_hash(key, &index_def->key_def);
+	uint32_t h = key_hash_calc(key, &index_def->key_def);
 	uint32_t k = light_index_find_key(hash_table, h, key);
 	if (k != light_index_end)
 		ret = light_index_get(hash_table, k);
 	return ret;
 }
 
+void
+MemtxHash::findByKeyMulti(const char **keys, uint32_t part_count,
+			  uint32_t key_count, struct tuple **results) const
+{
+	assert(index_def->opts.is_unique &&
+	       part_count == index_def->key_def.part_count);
+	(void) part_count;
+	/*
+	 * Process the batch in chunks: hash all keys of a chunk and
+	 * prefetch their buckets first, then probe. Each probe is
+	 * an independent cache miss, so prefetching the whole chunk
+	 * upfront overlaps the misses instead of paying for them
+	 * one by one.
+	 */
+	enum { FIND_MULTI_CHUNK = 16 };
+	uint32_t hashes[FIND_MULTI_CHUNK];
+	for (uint32_t base = 0; base < key_count; base += FIND_MULTI_CHUNK) {
+		uint32_t chunk = key_count - base;
+		if (chunk > FIND_MULTI_CHUNK)
+			chunk = FIND_MULTI_CHUNK;
+		for (uint32_t i = 0; i < chunk; i++) {
+			hashes[i] = key_hash_calc(keys[base + i],
+						  &index_def->key_def);
+			light_index_prefetch(hash_table, hashes[i]);
+		}
+		for (uint32_t i = 0; i < chunk; i++) {
+			uint32_t k = light_index_find_key(hash_table,
+							  hashes[i],
+							  keys[base + i]);
+			results[base + i] = k != light_index_end ?
+				light_index_get(hash_table, k) : NULL;
+		}
+	}
+}
+
 struct tuple *
 MemtxHash::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 		   enum dup_replace_mode mode)
@@ -193,7 +242,7 @@ MemtxHash::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 	uint32_t errcode;
 
 	if (new_tuple) {
-		uint32_t h = tuple_hash(new_tuple, &index_def->key_def);
+		uint32_t h = tuple_hash_calc(new_tuple, &index_def->key_def);
 		struct tuple *dup_tuple = NULL;
 		hash_t pos = light_index_replace(hash_table, h, new_tuple, &dup_tuple);
 		if (pos == light_index_end)
@@ -230,7 +279,7 @@ MemtxHash::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 	}
 
 	if (old_tuple) {
-		uint32_t h = tuple_hash(old_tuple, &index_def->key_def);
+		uint32_t h = tuple_hash_calc(old_tuple, &index_def->key_def);
 		int res = light_index_delete_value(hash_table, h, old_tuple);
 		assert(res == 0); (void) res;
 	}
@@ -268,7 +317,7 @@ MemtxHash::initIterator(struct iterator *ptr, enum iterator_type type,
 	case ITER_GT:
 		if (part_count != 0) {
 			light_index_iterator_key(it->hash_table, &it->iterator,
-					key_hash(key, &index_def->key_def), key);
+					key_hash_calc(key, &index_def->key_def), key);
 			it->base.next = hash_iterator_gt;
 		} else {
 			light_index_iterator_begin(it->hash_table, &it->iterator);
@@ -282,7 +331,7 @@ MemtxHash::initIterator(struct iterator *ptr, enum iterator_type type,
 	case ITER_EQ:
 		assert(part_count > 0);
 		light_index_iterator_key(it->hash_table, &it->iterator,
-				key_hash(key, &index_def->key_def), key);
+				key_hash_calc(key, &index_def->key_def), key);
 		it->base.next = hash_iterator_eq;
 		break;
 	default:
@@ -45,6 +45,9 @@ public:
 	virtual struct tuple *random(uint32_t rnd) const override;
 	virtual struct tuple *findByKey(const char *key,
 					uint32_t part_count) const override;
+	virtual void findByKeyMulti(const char **keys, uint32_t part_count,
+				    uint32_t key_count,
+				    struct tuple **results) const override;
 	virtual struct tuple *replace(struct tuple *old_tuple,
 				      struct tuple *new_tuple,
 				      enum dup_replace_mode mode) override;
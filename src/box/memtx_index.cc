@@ -87,11 +87,12 @@ MemtxIndex::count(enum iterator_type type, const char *key,
 }
 
 void
-index_build(MemtxIndex *index, MemtxIndex *pk)
+index_build(MemtxIndex *index, MemtxIndex *pk, bool offload)
 {
 	uint32_t n_tuples = pk->size();
 	uint32_t estimated_tuples = n_tuples * 1.2;
 
+	index->build_offload = offload;
 	index->beginBuild();
 	index->reserve(estimated_tuples);
 
@@ -108,4 +109,5 @@ index_build(MemtxIndex *index, MemtxIndex *pk)
 		index->buildNext(tuple);
 
 	index->endBuild();
+	index->build_offload = false;
 }
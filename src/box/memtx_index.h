@@ -35,7 +35,7 @@
 class MemtxIndex: public Index {
 public:
 	MemtxIndex(struct index_def *index_def_arg)
-		:Index(index_def_arg), m_position(NULL)
+		:Index(index_def_arg), build_offload(false), m_position(NULL)
 	{}
 	virtual ~MemtxIndex() override {
 		if (m_position != NULL)
@@ -59,6 +59,14 @@ public:
 	 * Two-phase index creation: begin building, add tuples, finish.
 	 */
 	virtual void beginBuild();
+	/**
+	 * When set, endBuild() is allowed to yield and offload
+	 * CPU-heavy phases of the build (e.g. sorting) to worker
+	 * threads. Only safe when the space can not be modified
+	 * concurrently, i.e. during recovery. Set by
+	 * index_build().
+	 */
+	bool build_offload;
 	/**
 	 * Optional hint, given to the index, about
 	 * the total size of the index. If given,
@@ -77,6 +85,6 @@ protected:
 
 /** Build this index based on the contents of another index. */
 void
-index_build(MemtxIndex *index, MemtxIndex *pk);
+index_build(MemtxIndex *index, MemtxIndex *pk, bool offload = false);
 
 #endif /* TARANTOOL_BOX_MEMTX_INDEX_H_INCLUDED */
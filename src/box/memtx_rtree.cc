@@ -160,11 +160,13 @@ MemtxRTree::~MemtxRTree()
 		index_rtree_iterator_free(m_position);
 		m_position = NULL;
 	}
+	free(m_build_array);
 	rtree_destroy(&m_tree);
 }
 
 MemtxRTree::MemtxRTree(struct index_def *index_def_arg)
-	: MemtxIndex(index_def_arg)
+	: MemtxIndex(index_def_arg), m_build_array(NULL),
+	  m_build_array_size(0), m_build_array_alloc_size(0)
 {
 	assert(index_def->key_def.part_count == 1);
 	assert(index_def->key_def.parts[0].type == FIELD_TYPE_ARRAY);
@@ -291,6 +293,14 @@ MemtxRTree::initIterator(struct iterator *iterator, enum iterator_type type,
 	case ITER_OVERLAPS:
 		op = SOP_OVERLAPS;
 		break;
+	case ITER_COVERS:
+		/*
+		 * Records whose box covers the key, same as
+		 * ITER_GE but readable: with dimension = 1 this is
+		 * the "interval covers the point/range" query.
+		 */
+		op = SOP_CONTAINS;
+		break;
 	case ITER_NEIGHBOR:
 		op = SOP_NEIGHBOR;
 		break;
@@ -306,3 +316,62 @@ MemtxRTree::beginBuild()
 	rtree_purge(&m_tree);
 }
 
+void
+MemtxRTree::reserve(uint32_t size_hint)
+{
+	if (size_hint < m_build_array_alloc_size)
+		return;
+	size_t entry_size = rtree_build_entry_size(&m_tree);
+	char *tmp = (char *)realloc(m_build_array, size_hint * entry_size);
+	if (tmp == NULL)
+		tnt_raise(OutOfMemory, size_hint * entry_size,
+			  "MemtxRTree", "reserve");
+	m_build_array = tmp;
+	m_build_array_alloc_size = size_hint;
+}
+
+void
+MemtxRTree::buildNext(struct tuple *tuple)
+{
+	size_t entry_size = rtree_build_entry_size(&m_tree);
+	if (m_build_array == NULL) {
+		m_build_array = (char *)malloc(MEMTX_EXTENT_SIZE);
+		if (m_build_array == NULL) {
+			tnt_raise(OutOfMemory, MEMTX_EXTENT_SIZE,
+				  "MemtxRTree", "buildNext");
+		}
+		m_build_array_alloc_size = MEMTX_EXTENT_SIZE / entry_size;
+	}
+	assert(m_build_array_size <= m_build_array_alloc_size);
+	if (m_build_array_size == m_build_array_alloc_size) {
+		m_build_array_alloc_size = m_build_array_alloc_size +
+					   m_build_array_alloc_size / 2;
+		char *tmp = (char *)realloc(m_build_array,
+					    m_build_array_alloc_size *
+					    entry_size);
+		if (tmp == NULL) {
+			tnt_raise(OutOfMemory, m_build_array_alloc_size *
+				  entry_size, "MemtxRTree", "buildNext");
+		}
+		m_build_array = tmp;
+	}
+	struct rtree_rect rect;
+	extract_rectangle(&rect, tuple, index_def);
+	rtree_build_entry_set(&m_tree, m_build_array,
+			      m_build_array_size++, &rect, tuple);
+}
+
+void
+MemtxRTree::endBuild()
+{
+	if (rtree_bulk_load(&m_tree, m_build_array,
+			    m_build_array_size) != 0) {
+		tnt_raise(OutOfMemory, MEMTX_EXTENT_SIZE,
+			  "MemtxRTree", "endBuild");
+	}
+	free(m_build_array);
+	m_build_array = NULL;
+	m_build_array_size = 0;
+	m_build_array_alloc_size = 0;
+}
+
@@ -30,6 +30,8 @@
  */
 #include "memtx_space.h"
 #include "space.h"
+#include "schema.h"
+#include "box.h"
 #include "iproto_constants.h"
 #include "txn.h"
 #include "tuple_compare.h"
@@ -66,6 +68,251 @@ enum {
 	RESERVE_EXTENTS_BEFORE_REPLACE = 16
 };
 
+/* {{{ TTL eviction ********************************************/
+
+/**
+ * Native expiration, space_opts.ttl_field. Every tuple written
+ * to a space with the option is also recorded in a single
+ * deadline-ordered tree shared by all such spaces, so the
+ * eviction fiber always works on the oldest tuples and never
+ * scans anything: the per-wakeup cost is proportional to the
+ * number of expired tuples, not to the space size.
+ *
+ * Tuples are referenced while in the tree, so an entry may
+ * safely outlive its tuple's presence in the space: eviction
+ * deletes by primary key and simply finds nothing. The one
+ * known inaccuracy is a tuple restored by a cascading WAL
+ * rollback: its tree entry is gone and it will not expire until
+ * it is next updated.
+ */
+struct memtx_ttl_entry {
+	/** Expiration deadline, Unix time in seconds. */
+	double deadline;
+	/** The tuple, referenced while the entry exists. */
+	struct tuple *tuple;
+	/** Owner space id, resolved again at eviction time. */
+	uint32_t space_id;
+};
+
+static inline int
+memtx_ttl_compare(struct memtx_ttl_entry a, struct memtx_ttl_entry b)
+{
+	if (a.deadline != b.deadline)
+		return a.deadline < b.deadline ? -1 : 1;
+	if (a.tuple != b.tuple)
+		return a.tuple < b.tuple ? -1 : 1;
+	if (a.space_id != b.space_id)
+		return a.space_id < b.space_id ? -1 : 1;
+	return 0;
+}
+
+static inline int
+memtx_ttl_compare_key(struct memtx_ttl_entry a, double deadline)
+{
+	if (a.deadline != deadline)
+		return a.deadline < deadline ? -1 : 1;
+	return 0;
+}
+
+/* memtx_tree.h leaves its instantiation macros defined. */
+#undef BPS_TREE_NAME
+#undef BPS_TREE_EXTENT_SIZE
+#undef BPS_TREE_COMPARE
+#undef BPS_TREE_COMPARE_KEY
+#undef bps_tree_elem_t
+#undef bps_tree_key_t
+#undef bps_tree_arg_t
+
+#define BPS_TREE_NAME memtx_ttl_tree
+#define BPS_TREE_EXTENT_SIZE MEMTX_EXTENT_SIZE
+#define BPS_TREE_COMPARE(a, b, arg) memtx_ttl_compare(a, b)
+#define BPS_TREE_COMPARE_KEY(a, b, arg) memtx_ttl_compare_key(a, b)
+#define bps_tree_elem_t struct memtx_ttl_entry
+#define bps_tree_key_t double
+#define bps_tree_arg_t void *
+
+#include "salad/bps_tree.h"
+
+#undef BPS_TREE_NAME
+#undef BPS_TREE_EXTENT_SIZE
+#undef BPS_TREE_COMPARE
+#undef BPS_TREE_COMPARE_KEY
+#undef bps_tree_elem_t
+#undef bps_tree_key_t
+#undef bps_tree_arg_t
+
+static struct memtx_ttl_tree memtx_ttl;
+static bool memtx_ttl_created;
+static struct fiber *memtx_ttl_fiber;
+
+enum {
+	/** Expired tuples deleted per WAL transaction. */
+	MEMTX_TTL_BATCH = 100,
+};
+
+/** How often the eviction fiber wakes up, seconds. */
+static const double MEMTX_TTL_INTERVAL = 1.0;
+
+/**
+ * Read the expiration deadline from the tuple field declared in
+ * space_opts.ttl_field (1-based). False if the field is missing
+ * or is not a number: such tuples never expire.
+ */
+static bool
+memtx_ttl_deadline(struct space *space, struct tuple *tuple, double *deadline)
+{
+	const char *field = tuple_field(tuple,
+					space->def.opts.ttl_field - 1);
+	if (field == NULL)
+		return false;
+	if (mp_typeof(*field) == MP_UINT)
+		*deadline = mp_decode_uint(&field);
+	else if (mp_typeof(*field) == MP_DOUBLE)
+		*deadline = mp_decode_double(&field);
+	else
+		return false;
+	return true;
+}
+
+static int
+memtx_ttl_evict_f(va_list ap);
+
+/**
+ * Keep the TTL tree in sync with a space change. Called after
+ * the indexes have been successfully updated, so it must not
+ * throw: a tuple it fails to track simply never expires.
+ */
+static void
+memtx_ttl_update(struct space *space, struct tuple *old_tuple,
+		 struct tuple *new_tuple)
+{
+	if (! memtx_ttl_created) {
+		memtx_index_arena_init();
+		memtx_ttl_tree_create(&memtx_ttl, NULL,
+				      memtx_index_extent_alloc,
+				      memtx_index_extent_free, NULL);
+		memtx_ttl_created = true;
+	}
+	double deadline;
+	if (old_tuple != NULL &&
+	    memtx_ttl_deadline(space, old_tuple, &deadline)) {
+		struct memtx_ttl_entry entry;
+		entry.deadline = deadline;
+		entry.tuple = old_tuple;
+		entry.space_id = space->def.id;
+		/*
+		 * The eviction fiber may have popped the entry
+		 * already: unref only what we found.
+		 */
+		if (memtx_ttl_tree_delete(&memtx_ttl, entry) == 0)
+			tuple_unref(old_tuple);
+	}
+	if (new_tuple != NULL &&
+	    memtx_ttl_deadline(space, new_tuple, &deadline)) {
+		struct memtx_ttl_entry entry;
+		entry.deadline = deadline;
+		entry.tuple = new_tuple;
+		entry.space_id = space->def.id;
+		if (tuple_ref(new_tuple) != 0) {
+			diag_clear(diag_get());
+			return;
+		}
+		if (memtx_ttl_tree_insert(&memtx_ttl, entry, NULL) != 0) {
+			tuple_unref(new_tuple);
+			say_warn("out of memory for a TTL entry, "
+				 "tuple will not expire");
+			return;
+		}
+		if (memtx_ttl_fiber == NULL) {
+			memtx_ttl_fiber = fiber_new("memtx_ttl",
+						    memtx_ttl_evict_f);
+			if (memtx_ttl_fiber != NULL)
+				fiber_start(memtx_ttl_fiber);
+		}
+	}
+}
+
+/**
+ * Delete up to MEMTX_TTL_BATCH expired tuples in one WAL
+ * transaction. Returns the number of tree entries consumed, 0
+ * when nothing has expired yet.
+ */
+static int
+memtx_ttl_evict_batch(double now)
+{
+	if (box_txn_begin() != 0)
+		return 0;
+	int evicted = 0;
+	while (evicted < MEMTX_TTL_BATCH) {
+		struct memtx_ttl_tree_iterator it =
+			memtx_ttl_tree_iterator_first(&memtx_ttl);
+		struct memtx_ttl_entry *min =
+			memtx_ttl_tree_iterator_get_elem(&memtx_ttl, &it);
+		if (min == NULL || min->deadline > now)
+			break;
+		struct memtx_ttl_entry entry = *min;
+		memtx_ttl_tree_delete(&memtx_ttl, entry);
+		evicted++;
+		/*
+		 * Re-resolve the space: it may have been dropped
+		 * or have lost the option since the entry was
+		 * created.
+		 */
+		struct space *space = space_by_id(entry.space_id);
+		if (space != NULL && space->def.opts.ttl_field != 0 &&
+		    space->index_count > 0) {
+			Index *pk = space->index[0];
+			uint32_t key_size;
+			const char *key =
+				tuple_extract_key(entry.tuple,
+						  &pk->index_def->key_def,
+						  &key_size);
+			if (key == NULL ||
+			    box_delete(entry.space_id, 0, key,
+				       key + key_size, NULL) != 0) {
+				/*
+				 * The delete failed; log, drop
+				 * the rest of the batch and retry
+				 * on the next wakeup.
+				 */
+				error_log(diag_last_error(diag_get()));
+				diag_clear(diag_get());
+				tuple_unref(entry.tuple);
+				box_txn_rollback();
+				return evicted;
+			}
+		}
+		tuple_unref(entry.tuple);
+	}
+	if (box_txn_commit() != 0) {
+		error_log(diag_last_error(diag_get()));
+		diag_clear(diag_get());
+	}
+	return evicted;
+}
+
+static int
+memtx_ttl_evict_f(va_list ap)
+{
+	(void) ap;
+	while (! fiber_is_cancelled()) {
+		fiber_sleep(MEMTX_TTL_INTERVAL);
+		/*
+		 * Only the master evicts: replicas receive the
+		 * deletes through replication. Also covers
+		 * recovery, when the WAL is not yet writable.
+		 */
+		if (box_is_ro())
+			continue;
+		double now = ev_now(loop());
+		while (memtx_ttl_evict_batch(now) == MEMTX_TTL_BATCH)
+			fiber_sleep(0);
+	}
+	return 0;
+}
+
+/* }}} */
+
 /**
  * A short-cut version of replace() used during bulk load
  * from snapshot.
@@ -89,6 +336,8 @@ memtx_replace_build_next(struct txn_stmt *stmt, struct space *space,
 	((MemtxIndex *) space->index[0])->buildNext(stmt->new_tuple);
 	stmt->engine_savepoint = stmt;
 	stmt->bsize_change = space_bsize_update(space, NULL, stmt->new_tuple);
+	if (space->def.opts.ttl_field != 0)
+		memtx_ttl_update(space, NULL, stmt->new_tuple);
 }
 
 /**
@@ -103,6 +352,8 @@ memtx_replace_primary_key(struct txn_stmt *stmt, struct space *space,
 						   stmt->new_tuple, mode);
 	stmt->engine_savepoint = stmt;
 	stmt->bsize_change = space_bsize_update(space, stmt->old_tuple, stmt->new_tuple);
+	if (space->def.opts.ttl_field != 0)
+		memtx_ttl_update(space, stmt->old_tuple, stmt->new_tuple);
 }
 
 /**
@@ -189,12 +440,56 @@ memtx_replace_primary_key(struct txn_stmt *stmt, struct space *space,
  * Otherwise, it's taken into account only for the
  * primary key.
  */
+/**
+ * Enforce the per-space memory budget, space_opts.memory_limit,
+ * before any index is touched: rejecting a write here costs
+ * nothing to roll back and fires before the shared memtx quota
+ * is drained by a single runaway space. Counts the same bytes as
+ * space->bsize, i.e. tuple data only.
+ *
+ * Only the runtime replace path checks the limit: what has made
+ * it into the WAL or a snapshot must be applied on recovery even
+ * if the limit was lowered meanwhile.
+ */
+static void
+memtx_space_check_memory_limit(struct txn_stmt *stmt, struct space *space,
+			       enum dup_replace_mode mode)
+{
+	int64_t limit = space->def.opts.memory_limit;
+	struct tuple *new_tuple = stmt->new_tuple;
+	if (limit <= 0 || new_tuple == NULL)
+		return;
+	struct tuple *old_tuple = stmt->old_tuple;
+	if (old_tuple == NULL && mode != DUP_INSERT) {
+		/*
+		 * The write may displace a tuple: credit its
+		 * size, otherwise a space sitting at the limit
+		 * could never replace anything.
+		 */
+		Index *pk = index_find_xc(space, 0);
+		uint32_t key_size;
+		const char *key = tuple_extract_key(new_tuple,
+						    &pk->index_def->key_def,
+						    &key_size);
+		if (key != NULL) {
+			uint32_t part_count = mp_decode_array(&key);
+			old_tuple = pk->findByKey(key, part_count);
+		}
+	}
+	int64_t change = (int64_t) box_tuple_bsize(new_tuple) -
+		(old_tuple != NULL ? (int64_t) box_tuple_bsize(old_tuple) : 0);
+	if ((int64_t) space->bsize + change > limit)
+		tnt_raise(ClientError, ER_SPACE_MEMORY_LIMIT,
+			  space_name(space), (unsigned long long) limit);
+}
+
 void
 memtx_replace_all_keys(struct txn_stmt *stmt, struct space *space,
 		       enum dup_replace_mode mode)
 {
 	struct tuple *old_tuple = stmt->old_tuple;
 	struct tuple *new_tuple = stmt->new_tuple;
+	memtx_space_check_memory_limit(stmt, space, mode);
 	/*
 	 * Ensure we have enough slack memory to guarantee
 	 * successful statement-level rollback.
@@ -202,6 +497,14 @@ memtx_replace_all_keys(struct txn_stmt *stmt, struct space *space,
 	memtx_index_extent_reserve(new_tuple ?
 				   RESERVE_EXTENTS_BEFORE_REPLACE :
 				   RESERVE_EXTENTS_BEFORE_DELETE);
+	/*
+	 * With more than one index every index write decodes key
+	 * fields of the same tuple from msgpack again; share one
+	 * decode between them for the duration of the statement.
+	 */
+	struct tuple *hot_tuple = new_tuple ? new_tuple : old_tuple;
+	if (hot_tuple != NULL && space->index_count > 1)
+		tuple_field_cache_publish(&stmt->field_cache, hot_tuple);
 	uint32_t i = 0;
 	try {
 		/* Update the primary key */
@@ -226,14 +529,58 @@ memtx_replace_all_keys(struct txn_stmt *stmt, struct space *space,
 			Index *index = space->index[i-1];
 			index->replace(new_tuple, old_tuple, DUP_INSERT);
 		}
+		tuple_field_cache_withdraw();
 		throw;
 	}
+	tuple_field_cache_withdraw();
 	stmt->old_tuple = old_tuple;
 	stmt->engine_savepoint = stmt;
 	stmt->bsize_change = space_bsize_update(space, old_tuple, new_tuple);
+	if (space->def.opts.ttl_field != 0)
+		memtx_ttl_update(space, old_tuple, new_tuple);
 }
 
 
+int
+memtx_space_relocate_tuple(struct space *space, struct tuple *old_tuple)
+{
+	uint32_t bsize;
+	const char *data = tuple_data_range(old_tuple, &bsize);
+	struct tuple *new_tuple = memtx_tuple_new(tuple_format(old_tuple),
+						  data, data + bsize);
+	if (new_tuple == NULL)
+		return -1;
+	if (tuple_ref(new_tuple) != 0) {
+		memtx_tuple_delete(tuple_format(new_tuple), new_tuple);
+		return -1;
+	}
+	/*
+	 * Switch every index of the space from the original to
+	 * the copy, the same order and rollback discipline as in
+	 * memtx_replace_all_keys().
+	 */
+	uint32_t i = 0;
+	try {
+		memtx_index_extent_reserve(RESERVE_EXTENTS_BEFORE_REPLACE);
+		Index *pk = index_find_xc(space, 0);
+		pk->replace(old_tuple, new_tuple, DUP_REPLACE);
+		for (i++; i < space->index_count; i++) {
+			Index *index = space->index[i];
+			index->replace(old_tuple, new_tuple, DUP_INSERT);
+		}
+	} catch (Exception *e) {
+		for (; i > 0; i--) {
+			Index *index = space->index[i - 1];
+			index->replace(new_tuple, old_tuple, DUP_INSERT);
+		}
+		tuple_unref(new_tuple);
+		return -1;
+	}
+	/* Drop the space reference of the original. */
+	tuple_unref(old_tuple);
+	return 0;
+}
+
 MemtxSpace::MemtxSpace(Engine *e)
 	: Handler(e)
 {
@@ -268,6 +615,41 @@ MemtxSpace::applyInitialJoinRow(struct space *space, struct request *request)
 	/** The new tuple is referenced by the primary key. */
 }
 
+void
+MemtxSpace::applyDeltaRow(struct space *space, struct request *request)
+{
+	if (request->type != IPROTO_INSERT &&
+	    request->type != IPROTO_DELETE) {
+		tnt_raise(ClientError, ER_UNKNOWN_REQUEST_TYPE,
+				(uint32_t) request->type);
+	}
+	request->header->replica_id = 0;
+	struct txn *txn = txn_begin_stmt(space);
+	try {
+		struct txn_stmt *stmt = txn_current_stmt(txn);
+		if (request->type == IPROTO_INSERT) {
+			/*
+			 * The delta may record several versions
+			 * of the same tuple, so an insert must
+			 * overwrite what the base checkpoint or
+			 * an earlier delta row has loaded.
+			 */
+			prepareReplace(stmt, space, request);
+			this->replace(stmt, space, DUP_REPLACE_OR_INSERT);
+		} else {
+			prepareDelete(stmt, space, request);
+			if (stmt->old_tuple)
+				this->replace(stmt, space,
+					      DUP_REPLACE_OR_INSERT);
+		}
+		txn_commit_stmt(txn, request);
+	} catch (Exception *e) {
+		say_error("rollback: %s", e->errmsg);
+		txn_rollback_stmt();
+		throw;
+	}
+}
+
 void
 MemtxSpace::prepareReplace(struct txn_stmt *stmt, struct space *space,
 			   struct request *request)
@@ -488,8 +870,23 @@ MemtxSpace::dropIndex(Index *index)
 		return; /* nothing to do for secondary keys */
 	/*
 	 * Delete all tuples in the old space if dropping the
-	 * primary key.
+	 * primary key. For a TREE index the walk is handed over
+	 * to a background fiber: this runs in a commit trigger,
+	 * where yields are forbidden, and unreferencing every
+	 * tuple of a huge space one by one would stall the event
+	 * loop for the whole scan. Truncate (which is an index
+	 * drop + recreate) then returns as soon as the few
+	 * _index rows are written, independent of space size.
 	 */
+	if (index->index_def->type == TREE) {
+		struct memtx_tree *detached =
+			((MemtxTree *) index)->detachTree();
+		if (detached != NULL) {
+			memtx_tree_sweep(detached);
+			return;
+		}
+		/* Can not detach - fall through to the inline walk. */
+	}
 	struct iterator *it = ((MemtxIndex*) index)->position();
 	index->initIterator(it, ITER_ALL, NULL, 0);
 	struct tuple *tuple;
@@ -48,6 +48,18 @@ void
 memtx_replace_all_keys(struct txn_stmt *, struct space *space,
 		       enum dup_replace_mode /* mode */);
 
+/**
+ * Physically move a tuple into a freshly allocated copy and
+ * switch all indexes of the space to it, for the online
+ * compaction fiber. The logical content of the space does not
+ * change: no WAL record, no triggers, no transaction.
+ *
+ * @retval  0 the tuple was relocated, the original is freed
+ * @retval -1 allocation failure, the space is left untouched
+ */
+int
+memtx_space_relocate_tuple(struct space *space, struct tuple *old_tuple);
+
 struct MemtxSpace: public Handler {
 	MemtxSpace(Engine *e);
 	virtual ~MemtxSpace()
@@ -58,6 +70,15 @@ struct MemtxSpace: public Handler {
 	virtual void
 	applyInitialJoinRow(struct space *space,
 			    struct request *request) override;
+	/**
+	 * Apply a row of a delta snapshot: a REPLACE or a DELETE
+	 * recorded since the base checkpoint. Unlike the initial
+	 * join path, rows arrive in commit order rather than in
+	 * primary key order, so the primary key must be fully
+	 * built by the time this is called.
+	 */
+	void
+	applyDeltaRow(struct space *space, struct request *request);
 	virtual struct tuple *
 	executeReplace(struct txn *txn, struct space *space,
 		       struct request *request) override;
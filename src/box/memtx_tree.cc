@@ -29,12 +29,14 @@
  * SUCH DAMAGE.
  */
 #include "memtx_tree.h"
+#include "tuple.h"
 #include "tuple_compare.h"
 #include "space.h"
 #include "schema.h" /* space_cache_find() */
 #include "errinj.h"
 #include "memory.h"
 #include "fiber.h"
+#include "coeio.h"
 #include <third_party/qsort_arg.h>
 
 /* {{{ Utilities. *************************************************/
@@ -43,30 +45,147 @@ struct key_data
 {
 	const char *key;
 	uint32_t part_count;
+	/** Comparison hint of the first key part, see field_hint(). */
+	uint64_t hint;
 };
 
+/**
+ * A hint value that never orders against anything: either of the
+ * two hints being NONE forces the full comparison. Produced for
+ * field types the hint encoding does not cover. Real hints can
+ * not collide with it - they carry at most a 3-bit class tag and
+ * a 61-bit payload.
+ */
+enum { MEMTX_TREE_HINT_NONE = UINT64_MAX };
+
+/**
+ * Class tags ordering hints of differently typed values within a
+ * scalar field, mirroring enum mp_class in tuple_compare.cc. For
+ * a typed field the tag is the same on every row and cancels out.
+ */
+enum {
+	HINT_CLASS_NIL = 0,
+	HINT_CLASS_BOOL = 1,
+	HINT_CLASS_NUMBER = 2,
+	HINT_CLASS_STR = 3,
+	HINT_CLASS_BIN = 4,
+};
+
+/**
+ * Map a double onto an unsigned integer that compares the same
+ * way. Integers are converted through double first: rounding to
+ * nearest is monotone, so an order inversion against an exact
+ * int-vs-double comparison is impossible - close values can only
+ * collide, which the equal-hint fallback resolves.
+ */
+static uint64_t
+number_hint(double d)
+{
+	if (d != d)
+		return MEMTX_TREE_HINT_NONE; /* NaN orders with nothing. */
+	if (d == 0)
+		d = 0; /* Collapse -0 onto +0, they compare equal. */
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	/* Flip negatives entirely, set the sign bit on positives. */
+	bits = (bits & (UINT64_C(1) << 63)) ? ~bits : bits | (UINT64_C(1) << 63);
+	return ((uint64_t)HINT_CLASS_NUMBER << 61) | (bits >> 3);
+}
+
+/** The first 7 bytes, big-endian and zero-padded: memcmp order. */
+static uint64_t
+bytes_hint(const char *s, uint32_t len, uint64_t hint_class)
+{
+	uint64_t h = 0;
+	uint32_t i;
+	for (i = 0; i < 7 && i < len; i++)
+		h = (h << 8) | (unsigned char)s[i];
+	h <<= 8 * (7 - i);
+	return (hint_class << 61) | (h << 5);
+}
+
+/**
+ * Comparison hint of a MsgPack field: a 64-bit value ordering
+ * exactly like tuple_compare_field() on the first key part, with
+ * collisions allowed - equal hints mean "compare for real", while
+ * different hints decide the comparison without touching the
+ * tuples at all.
+ */
+static uint64_t
+field_hint(const char *field)
+{
+	switch (mp_typeof(*field)) {
+	case MP_NIL:
+		return (uint64_t)HINT_CLASS_NIL << 61;
+	case MP_BOOL:
+		return ((uint64_t)HINT_CLASS_BOOL << 61) |
+		       (uint64_t)mp_decode_bool(&field);
+	case MP_UINT:
+		return number_hint((double)mp_decode_uint(&field));
+	case MP_INT:
+		return number_hint((double)mp_decode_int(&field));
+	case MP_FLOAT:
+		return number_hint(mp_decode_float(&field));
+	case MP_DOUBLE:
+		return number_hint(mp_decode_double(&field));
+	case MP_STR: {
+		uint32_t len;
+		const char *s = mp_decode_str(&field, &len);
+		return bytes_hint(s, len, HINT_CLASS_STR);
+	}
+	case MP_BIN: {
+		uint32_t len;
+		const char *s = mp_decode_bin(&field, &len);
+		return bytes_hint(s, len, HINT_CLASS_BIN);
+	}
+	default:
+		return MEMTX_TREE_HINT_NONE;
+	}
+}
+
+/** Build a tree element: the tuple and its first key part hint. */
+static struct memtx_tree_elem
+memtx_tree_elem_build(struct tuple *tuple, struct index_def *index_def)
+{
+	struct memtx_tree_elem elem;
+	elem.tuple = tuple;
+	const char *field =
+		tuple_field(tuple, index_def->key_def.parts[0].fieldno);
+	elem.hint = field != NULL ? field_hint(field) : MEMTX_TREE_HINT_NONE;
+	return elem;
+}
+
 int
-memtx_tree_compare(const tuple *a, const tuple *b, struct index_def *index_def)
+memtx_tree_compare(struct memtx_tree_elem a, struct memtx_tree_elem b,
+		   struct index_def *index_def)
 {
-	int r = tuple_compare(a, b, &index_def->key_def);
+	if (a.hint != b.hint && a.hint != MEMTX_TREE_HINT_NONE &&
+	    b.hint != MEMTX_TREE_HINT_NONE)
+		return a.hint < b.hint ? -1 : 1;
+	int r = tuple_compare(a.tuple, b.tuple, &index_def->key_def);
 	if (r == 0 && !index_def->opts.is_unique)
-		r = a < b ? -1 : a > b;
+		r = a.tuple < b.tuple ? -1 : a.tuple > b.tuple;
 	return r;
 }
 
 int
-memtx_tree_compare_key(const tuple *a, const struct key_data *key_data,
+memtx_tree_compare_key(struct memtx_tree_elem a,
+		       const struct key_data *key_data,
 		       struct index_def *index_def)
 {
-	return tuple_compare_with_key(a, key_data->key,
+	if (key_data->part_count > 0 && a.hint != key_data->hint &&
+	    a.hint != MEMTX_TREE_HINT_NONE &&
+	    key_data->hint != MEMTX_TREE_HINT_NONE)
+		return a.hint < key_data->hint ? -1 : 1;
+	return tuple_compare_with_key(a.tuple, key_data->key,
 				      key_data->part_count, &index_def->key_def);
 }
 
 int
 memtx_tree_qcompare(const void* a, const void *b, void *c)
 {
-	return memtx_tree_compare(*(struct tuple **)a,
-		*(struct tuple **)b, (struct index_def *)c);
+	return memtx_tree_compare(*(struct memtx_tree_elem *)a,
+		*(struct memtx_tree_elem *)b, (struct index_def *)c);
 }
 
 /* {{{ MemtxTree Iterators ****************************************/
@@ -76,6 +195,14 @@ struct tree_iterator {
 	struct index_def *index_def;
 	struct memtx_tree_iterator tree_iterator;
 	struct key_data key_data;
+	/**
+	 * Position token of the last lower bound search. The
+	 * iterator object is cached per index (see position()),
+	 * so re-seeks of a pagination workload land near the
+	 * previous leaf and skip the root descent while the tree
+	 * is unchanged.
+	 */
+	struct memtx_tree_leaf_hint leaf_hint;
 };
 
 static void
@@ -91,6 +218,12 @@ tree_iterator(struct iterator *it)
 static void
 tree_iterator_free(struct iterator *iterator)
 {
+	struct tree_iterator *it = tree_iterator(iterator);
+	/* Release the read view of a frozen iterator, if any. */
+	if (matras_is_read_view_created(&it->tree_iterator.view)) {
+		memtx_tree_iterator_destroy((struct memtx_tree *)it->tree,
+					    &it->tree_iterator);
+	}
 	free(iterator);
 }
 
@@ -105,29 +238,32 @@ static struct tuple *
 tree_iterator_fwd(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_elem *res =
+		memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_bwd(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_elem *res =
+		memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_prev(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_fwd_check_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_elem *res =
+		memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	if (memtx_tree_compare_key(*res, &it->key_data, it->index_def) != 0) {
@@ -135,19 +271,20 @@ tree_iterator_fwd_check_equality(struct iterator *iterator)
 		return 0;
 	}
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
 tree_iterator_fwd_check_next_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_elem *res =
+		memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	memtx_tree_iterator_next(it->tree, &it->tree_iterator);
 	iterator->next = tree_iterator_fwd_check_equality;
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
@@ -163,7 +300,8 @@ static struct tuple *
 tree_iterator_bwd_check_equality(struct iterator *iterator)
 {
 	struct tree_iterator *it = tree_iterator(iterator);
-	tuple **res = memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
+	struct memtx_tree_elem *res =
+		memtx_tree_iterator_get_elem(it->tree, &it->tree_iterator);
 	if (!res)
 		return 0;
 	if (memtx_tree_compare_key(*res, &it->key_data, it->index_def) != 0) {
@@ -171,7 +309,7 @@ tree_iterator_bwd_check_equality(struct iterator *iterator)
 		return 0;
 	}
 	memtx_tree_iterator_prev(it->tree, &it->tree_iterator);
-	return *res;
+	return res->tuple;
 }
 
 static struct tuple *
@@ -188,37 +326,61 @@ tree_iterator_bwd_skip_one_check_next_equality(struct iterator *iterator)
 
 MemtxTree::MemtxTree(struct index_def *index_def_arg)
 	: MemtxIndex(index_def_arg), build_array(0), build_array_size(0),
-	  build_array_alloc_size(0)
+	  build_array_alloc_size(0), build_array_sorted(true)
 {
 	memtx_index_arena_init();
-	memtx_tree_create(&tree, index_def,
+	/*
+	 * The tree lives on the heap, not inside the object, so
+	 * that detachTree() can hand it over to a background
+	 * sweep fiber when the index is dropped.
+	 */
+	tree = (struct memtx_tree *)malloc(sizeof(*tree));
+	if (tree == NULL)
+		tnt_raise(OutOfMemory, sizeof(*tree),
+			  "malloc", "struct memtx_tree");
+	memtx_tree_create(tree, index_def,
 			      memtx_index_extent_alloc,
 			      memtx_index_extent_free, NULL);
 }
 
 MemtxTree::~MemtxTree()
 {
-	memtx_tree_destroy(&tree);
+	memtx_tree_destroy(tree);
+	free(tree);
 	free(build_array);
 }
 
+struct memtx_tree *
+MemtxTree::detachTree()
+{
+	struct memtx_tree *fresh = (struct memtx_tree *)malloc(sizeof(*fresh));
+	if (fresh == NULL)
+		return NULL;
+	memtx_tree_create(fresh, index_def,
+			  memtx_index_extent_alloc,
+			  memtx_index_extent_free, NULL);
+	struct memtx_tree *detached = tree;
+	tree = fresh;
+	return detached;
+}
+
 size_t
 MemtxTree::size() const
 {
-	return memtx_tree_size(&tree);
+	return memtx_tree_size(tree);
 }
 
 size_t
 MemtxTree::bsize() const
 {
-	return memtx_tree_mem_used(&tree);
+	return memtx_tree_mem_used(tree);
 }
 
 struct tuple *
 MemtxTree::random(uint32_t rnd) const
 {
-	struct tuple **res = memtx_tree_random(&tree, rnd);
-	return res ? *res : 0;
+	struct memtx_tree_elem *res = memtx_tree_random(tree, rnd);
+	return res ? res->tuple : 0;
 }
 
 struct tuple *
@@ -229,8 +391,9 @@ MemtxTree::findByKey(const char *key, uint32_t part_count) const
 	struct key_data key_data;
 	key_data.key = key;
 	key_data.part_count = part_count;
-	struct tuple **res = memtx_tree_find(&tree, &key_data);
-	return res ? *res : 0;
+	key_data.hint = part_count > 0 ? field_hint(key) : MEMTX_TREE_HINT_NONE;
+	struct memtx_tree_elem *res = memtx_tree_find(tree, &key_data);
+	return res ? res->tuple : 0;
 }
 
 struct tuple *
@@ -240,31 +403,35 @@ MemtxTree::replace(struct tuple *old_tuple, struct tuple *new_tuple,
 	uint32_t errcode;
 
 	if (new_tuple) {
-		struct tuple *dup_tuple = NULL;
+		struct memtx_tree_elem new_elem =
+			memtx_tree_elem_build(new_tuple, index_def);
+		struct memtx_tree_elem dup_elem;
+		dup_elem.tuple = NULL;
 
 		/* Try to optimistically replace the new_tuple. */
 		int tree_res =
-		memtx_tree_insert(&tree, new_tuple, &dup_tuple);
+		memtx_tree_insert(tree, new_elem, &dup_elem);
 		if (tree_res) {
 			tnt_raise(OutOfMemory, BPS_TREE_EXTENT_SIZE,
 				  "MemtxTree", "replace");
 		}
 
-		errcode = replace_check_dup(old_tuple, dup_tuple, mode);
+		errcode = replace_check_dup(old_tuple, dup_elem.tuple, mode);
 
 		if (errcode) {
-			memtx_tree_delete(&tree, new_tuple);
-			if (dup_tuple)
-				memtx_tree_insert(&tree, dup_tuple, 0);
+			memtx_tree_delete(tree, new_elem);
+			if (dup_elem.tuple)
+				memtx_tree_insert(tree, dup_elem, 0);
 			struct space *sp = space_cache_find(index_def->space_id);
 			tnt_raise(ClientError, errcode, index_name(this),
 				  space_name(sp));
 		}
-		if (dup_tuple)
-			return dup_tuple;
+		if (dup_elem.tuple)
+			return dup_elem.tuple;
 	}
 	if (old_tuple) {
-		memtx_tree_delete(&tree, old_tuple);
+		memtx_tree_delete(tree,
+				  memtx_tree_elem_build(old_tuple, index_def));
 	}
 	return old_tuple;
 }
@@ -280,9 +447,10 @@ MemtxTree::allocIterator() const
 	}
 
 	it->index_def = index_def;
-	it->tree = &tree;
+	it->tree = tree;
 	it->base.free = tree_iterator_free;
 	it->tree_iterator = memtx_tree_invalid_iterator();
+	it->leaf_hint = memtx_tree_invalid_leaf_hint();
 	return (struct iterator *) it;
 }
 
@@ -307,22 +475,25 @@ MemtxTree::initIterator(struct iterator *iterator, enum iterator_type type,
 	}
 	it->key_data.key = key;
 	it->key_data.part_count = part_count;
+	it->key_data.hint = part_count > 0 ?
+			    field_hint(key) : MEMTX_TREE_HINT_NONE;
 
 	bool exact = false;
 	if (key == 0) {
 		if (iterator_type_is_reverse(type))
 			it->tree_iterator = memtx_tree_invalid_iterator();
 		else
-			it->tree_iterator = memtx_tree_iterator_first(&tree);
+			it->tree_iterator = memtx_tree_iterator_first(tree);
 	} else {
 		if (type == ITER_ALL || type == ITER_EQ || type == ITER_GE || type == ITER_LT) {
-			it->tree_iterator = memtx_tree_lower_bound(&tree, &it->key_data, &exact);
+			it->tree_iterator = memtx_tree_lower_bound_hinted(tree,
+				&it->key_data, &exact, &it->leaf_hint);
 			if (type == ITER_EQ && !exact) {
 				it->base.next = tree_iterator_dummie;
 				return;
 			}
 		} else { // ITER_GT, ITER_REQ, ITER_LE
-			it->tree_iterator = memtx_tree_upper_bound(&tree, &it->key_data, &exact);
+			it->tree_iterator = memtx_tree_upper_bound(tree, &it->key_data, &exact);
 			if (type == ITER_REQ && !exact) {
 				it->base.next = tree_iterator_dummie;
 				return;
@@ -358,7 +529,8 @@ MemtxTree::initIterator(struct iterator *iterator, enum iterator_type type,
 void
 MemtxTree::beginBuild()
 {
-	assert(memtx_tree_size(&tree) == 0);
+	assert(memtx_tree_size(tree) == 0);
+	build_array_sorted = true;
 }
 
 void
@@ -366,7 +538,7 @@ MemtxTree::reserve(uint32_t size_hint)
 {
 	if (size_hint < build_array_alloc_size)
 		return;
-	struct tuple **tmp = (struct tuple**)
+	struct memtx_tree_elem *tmp = (struct memtx_tree_elem *)
 		realloc(build_array, size_hint * sizeof(*tmp));
 	if (tmp == NULL)
 		tnt_raise(OutOfMemory, size_hint * sizeof(*tmp),
@@ -379,19 +551,20 @@ void
 MemtxTree::buildNext(struct tuple *tuple)
 {
 	if (build_array == NULL) {
-		build_array = (struct tuple**) malloc(BPS_TREE_EXTENT_SIZE);
+		build_array = (struct memtx_tree_elem *)
+			malloc(BPS_TREE_EXTENT_SIZE);
 		if (build_array == NULL) {
 			tnt_raise(OutOfMemory, BPS_TREE_EXTENT_SIZE,
 				"MemtxTree", "buildNext");
 		}
 		build_array_alloc_size =
-			BPS_TREE_EXTENT_SIZE / sizeof(struct tuple*);
+			BPS_TREE_EXTENT_SIZE / sizeof(*build_array);
 	}
 	assert(build_array_size <= build_array_alloc_size);
 	if (build_array_size == build_array_alloc_size) {
 		build_array_alloc_size = build_array_alloc_size +
 					 build_array_alloc_size / 2;
-		struct tuple **tmp = (struct tuple **)
+		struct memtx_tree_elem *tmp = (struct memtx_tree_elem *)
 			realloc(build_array, build_array_alloc_size *
 				sizeof(*tmp));
 		if (tmp == NULL) {
@@ -400,14 +573,59 @@ MemtxTree::buildNext(struct tuple *tuple)
 		}
 		build_array = tmp;
 	}
-	build_array[build_array_size++] = tuple;
+	struct memtx_tree_elem elem = memtx_tree_elem_build(tuple, index_def);
+	/*
+	 * Track whether the input is already sorted: one extra
+	 * comparison per tuple is much cheaper than the qsort it
+	 * saves in endBuild(). Recovery feeds the primary index
+	 * in exactly this order.
+	 */
+	if (build_array_sorted && build_array_size > 0 &&
+	    memtx_tree_compare(build_array[build_array_size - 1], elem,
+			       index_def) >= 0)
+		build_array_sorted = false;
+	build_array[build_array_size++] = elem;
+}
+
+/**
+ * A coio_call() worker: sort the build array of a TREE index in
+ * an eio thread. Tuple comparison only reads immutable tuple data
+ * and the key_def, so it is safe off the tx thread as long as the
+ * space is not modified concurrently, which the caller guarantees.
+ */
+static ssize_t
+memtx_tree_sort_build_array_cb(va_list ap)
+{
+	struct memtx_tree_elem *array = va_arg(ap, struct memtx_tree_elem *);
+	size_t size = va_arg(ap, size_t);
+	struct index_def *index_def = va_arg(ap, struct index_def *);
+	qsort_arg(array, size, sizeof(*array), memtx_tree_qcompare,
+		  index_def);
+	return 0;
 }
 
+/**
+ * Sorts shorter than this are cheaper than a round trip to the
+ * eio thread pool.
+ */
+enum { BUILD_SORT_OFFLOAD_MIN = 16384 };
+
 void
 MemtxTree::endBuild()
 {
-	qsort_arg(build_array, build_array_size, sizeof(struct tuple *), memtx_tree_qcompare, index_def);
-	memtx_tree_build(&tree, build_array, build_array_size);
+	if (!build_array_sorted) {
+		if (build_offload &&
+		    build_array_size >= BUILD_SORT_OFFLOAD_MIN &&
+		    coio_call(memtx_tree_sort_build_array_cb, build_array,
+			      build_array_size, index_def) == 0) {
+			/* Sorted in a worker thread. */
+		} else {
+			qsort_arg(build_array, build_array_size,
+				  sizeof(*build_array),
+				  memtx_tree_qcompare, index_def);
+		}
+	}
+	memtx_tree_build(tree, build_array, build_array_size);
 
 	free(build_array);
 	build_array = 0;
@@ -438,3 +656,56 @@ MemtxTree::destroyReadViewForIterator(struct iterator *iterator)
 	struct memtx_tree *tree = (struct memtx_tree *)it->tree;
 	memtx_tree_iterator_destroy(tree, &it->tree_iterator);
 }
+
+/* }}} */
+
+/* {{{ Background sweep of a detached tree ***********************/
+
+/** Tuples unreferenced between two yields of the sweep fiber. */
+enum { MEMTX_TREE_SWEEP_BATCH = 10000 };
+
+/**
+ * Unref every tuple of a detached tree and destroy it. Nobody
+ * else holds a pointer to the tree, so the iterator stays valid
+ * across yields, and the tree's index_def argument is never
+ * dereferenced: plain iteration does no comparisons, which is
+ * what lets the sweep outlive the index the tree was stolen from.
+ */
+static void
+memtx_tree_sweep_do(struct memtx_tree *tree, bool in_fiber)
+{
+	struct memtx_tree_iterator itr = memtx_tree_iterator_first(tree);
+	struct memtx_tree_elem *elem;
+	uint32_t loops = 0;
+	while ((elem = memtx_tree_iterator_get_elem(tree, &itr)) != NULL) {
+		tuple_unref(elem->tuple);
+		memtx_tree_iterator_next(tree, &itr);
+		if (in_fiber && ++loops % MEMTX_TREE_SWEEP_BATCH == 0)
+			fiber_sleep(0);
+	}
+	memtx_tree_destroy(tree);
+	free(tree);
+}
+
+static int
+memtx_tree_sweep_f(va_list ap)
+{
+	struct memtx_tree *tree = va_arg(ap, struct memtx_tree *);
+	memtx_tree_sweep_do(tree, true);
+	return 0;
+}
+
+void
+memtx_tree_sweep(struct memtx_tree *tree)
+{
+	struct fiber *sweeper = fiber_new("memtx_sweep", memtx_tree_sweep_f);
+	if (sweeper != NULL) {
+		fiber_start(sweeper, tree);
+		return;
+	}
+	/* No memory even for a fiber - sweep right here. */
+	diag_clear(diag_get());
+	memtx_tree_sweep_do(tree, false);
+}
+
+/* }}} */
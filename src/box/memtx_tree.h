@@ -31,24 +31,79 @@
  * SUCH DAMAGE.
  */
 
+#include <stdint.h>
+
 #include "memtx_index.h"
 #include "memtx_engine.h"
 
 struct tuple;
 struct key_data;
 
+/**
+ * A tree element: the tuple and a comparison hint derived from
+ * the first key part. The hint orders the same way the part
+ * does, so when two hints differ the comparison is decided by
+ * one integer compare, without dereferencing either tuple.
+ * Long string keys with common prefixes benefit the most: the
+ * hint packs the first bytes of the string, so a search only
+ * touches the tuples whose keys share those bytes with the
+ * search key. Equal hints fall back to the full comparator.
+ */
+struct memtx_tree_elem {
+	struct tuple *tuple;
+	uint64_t hint;
+};
+
+/**
+ * Identity, not key equality: the hint is a pure function of the
+ * tuple, so comparing pointers is enough. Used by the tree
+ * internals to track element copies.
+ */
+static inline bool
+operator ==(const struct memtx_tree_elem &a, const struct memtx_tree_elem &b)
+{
+	return a.tuple == b.tuple;
+}
+
+static inline bool
+operator !=(const struct memtx_tree_elem &a, const struct memtx_tree_elem &b)
+{
+	return a.tuple != b.tuple;
+}
+
 int
-memtx_tree_compare(const struct tuple *a, const struct tuple *b, struct index_def *index_def);
+memtx_tree_compare(struct memtx_tree_elem a, struct memtx_tree_elem b,
+		   struct index_def *index_def);
 
 int
-memtx_tree_compare_key(const tuple *a, const key_data *b, struct index_def *index_def);
+memtx_tree_compare_key(struct memtx_tree_elem a, const key_data *b,
+		       struct index_def *index_def);
 
+/*
+ * TODO: functional indexes (a key_def referencing an extraction
+ * function, with the extracted key stored next to the tuple
+ * pointer in the tree so comparisons never re-run the function)
+ * would replace the common workaround of materializing a derived
+ * field in every tuple. The storage side would extend struct
+ * memtx_tree_elem from a (tuple, hint) pair to carry the
+ * extracted key, which ripples through every template
+ * instantiation below and the iterators. The bigger half is not
+ * here at all: _index DDL for attaching a function, invoking
+ * user code (func.cc or Lua) inside the replace path with its
+ * failure modes, and ordering function definitions before index
+ * builds during recovery. Needs its own project, not an
+ * index-local patch.
+ */
 #define BPS_TREE_NAME memtx_tree
-#define BPS_TREE_BLOCK_SIZE (512)
+/*
+ * No BPS_TREE_BLOCK_SIZE: let the tree derive the block geometry
+ * from sizeof(struct memtx_tree_elem), so the (tuple, hint) pair
+ * keeps the leaf fanout a bare tuple pointer used to have.
+ */
 #define BPS_TREE_EXTENT_SIZE MEMTX_EXTENT_SIZE
 #define BPS_TREE_COMPARE(a, b, arg) memtx_tree_compare(a, b, arg)
 #define BPS_TREE_COMPARE_KEY(a, b, arg) memtx_tree_compare_key(a, b, arg)
-#define bps_tree_elem_t struct tuple *
+#define bps_tree_elem_t struct memtx_tree_elem
 #define bps_tree_key_t struct key_data *
 #define bps_tree_arg_t struct index_def *
 
@@ -89,10 +144,38 @@ public:
 	 */
 	virtual void destroyReadViewForIterator(struct iterator *iterator) override;
 
+	/**
+	 * Steal the tree and replace it with a fresh empty one.
+	 * Used when the index is dropped: the caller hands the
+	 * stolen tree to memtx_tree_sweep() so the per-tuple
+	 * unref walk happens in a background fiber instead of
+	 * stalling the event loop for the duration of a full
+	 * scan. Returns NULL if the replacement tree can not be
+	 * allocated; the index is left intact in that case and
+	 * the caller has to fall back to an inline walk.
+	 */
+	struct memtx_tree *detachTree();
+
 // protected:
-	struct memtx_tree tree;
-	struct tuple **build_array;
+	struct memtx_tree *tree;
+	struct memtx_tree_elem *build_array;
 	size_t build_array_size, build_array_alloc_size;
+	/**
+	 * True while the tuples accumulated by buildNext() are
+	 * sorted in index order. Snapshot rows arrive in primary
+	 * key order, so for a primary index this stays true and
+	 * endBuild() can skip the sort before the bulk build.
+	 */
+	bool build_array_sorted;
 };
 
+/**
+ * Dispose of a tree detached by MemtxTree::detachTree(): unref
+ * every tuple and destroy the tree in a background fiber, yielding
+ * between batches. Falls back to a synchronous walk if the fiber
+ * can not be created. Takes ownership of @a tree either way.
+ */
+void
+memtx_tree_sweep(struct memtx_tree *tree);
+
 #endif /* TARANTOOL_BOX_MEMTX_TREE_H_INCLUDED */
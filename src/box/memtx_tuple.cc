@@ -31,10 +31,15 @@
 
 #include "memtx_tuple.h"
 
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "small/small.h"
 #include "small/region.h"
 #include "small/quota.h"
 #include "fiber.h"
+#include "alloc_stat.h"
 #include "box.h"
 
 struct memtx_tuple {
@@ -60,6 +65,42 @@ struct small_alloc memtx_alloc; /* used box box.slab.info() */
 
 uint32_t snapshot_version;
 
+enum {
+	/**
+	 * Flag in memtx_tuple->version: the tuple was carved from
+	 * a batch reservation, not allocated with smalloc(). The
+	 * snapshot version counter grows once per checkpoint, so
+	 * the top bit is never reached by it.
+	 */
+	MEMTX_TUPLE_BATCHED = 0x80000000,
+	/** Default batch reservation size. */
+	MEMTX_TUPLE_BATCH_DEFAULT = 16 * 1024,
+};
+
+/**
+ * Header of a batch reservation: a single smalloc() block from
+ * which tuples are carved sequentially while batch mode is on.
+ * Each carved tuple is preceded by a 4-byte offset back to this
+ * header, so memtx_tuple_delete() can find it. The block is
+ * returned to the allocator when the last live tuple carved from
+ * it is deleted.
+ */
+struct memtx_tuple_batch {
+	/** Total size of the block, to pass to smfree(). */
+	uint32_t total;
+	/** Snapshot version the block was allocated at. */
+	uint32_t version;
+	/** Number of live tuples carved from the block. */
+	uint32_t live;
+	/** Offset of the first unused byte. */
+	uint32_t used;
+};
+
+/** The open batch reservation, if any. */
+static struct memtx_tuple_batch *memtx_tuple_batch;
+/** Reservation size of the current batch mode, 0 if mode is off. */
+static uint32_t memtx_tuple_batch_size;
+
 enum {
 	/** Lowest allowed slab_alloc_minimal */
 	OBJSIZE_MIN = 16,
@@ -69,9 +110,35 @@ enum {
 	SLAB_SIZE_MIN = 1024 * 1024
 };
 
+/** Page size of the arena mapping, see box.slab.info(). */
+static size_t memtx_arena_page_size;
+
+/**
+ * The kernel default huge page size, for reporting. Read from
+ * /proc/meminfo; 2M when the kernel does not tell.
+ */
+static size_t
+memtx_huge_page_size(void)
+{
+	size_t size = 2U << 20;
+	FILE *f = fopen("/proc/meminfo", "r");
+	if (f == NULL)
+		return size;
+	char line[128];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		size_t kb;
+		if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+			size = kb << 10;
+			break;
+		}
+	}
+	fclose(f);
+	return size;
+}
+
 void
 memtx_tuple_init(uint64_t tuple_arena_max_size, uint32_t objsize_min,
-		 uint32_t objsize_max, float alloc_factor)
+		 uint32_t objsize_max, float alloc_factor, bool huge_pages)
 {
 	/* Apply lowest allowed objsize bounds */
 	if (objsize_min < OBJSIZE_MIN)
@@ -94,7 +161,30 @@ memtx_tuple_init(uint64_t tuple_arena_max_size, uint32_t objsize_min,
 
 	say_info("mapping %zu bytes for tuple arena...", prealloc);
 
-	if (slab_arena_create(&memtx_arena, &memtx_quota,
+	memtx_arena_page_size = sysconf(_SC_PAGESIZE);
+	bool mapped = false;
+#if defined(MAP_HUGETLB)
+	if (huge_pages) {
+		/*
+		 * Reserved huge pages must be provisioned by the
+		 * administrator (vm.nr_hugepages), so a failed
+		 * reservation is an expected outcome, not an
+		 * error: fall back to regular pages below.
+		 */
+		if (slab_arena_create(&memtx_arena, &memtx_quota, prealloc,
+				      slab_size,
+				      MAP_PRIVATE | MAP_HUGETLB) == 0) {
+			memtx_arena_page_size = memtx_huge_page_size();
+			mapped = true;
+		} else {
+			say_warn("failed to reserve %zu bytes of huge pages "
+				 "for tuple arena, falling back to regular "
+				 "pages", prealloc);
+		}
+	}
+#endif
+	if (!mapped &&
+	    slab_arena_create(&memtx_arena, &memtx_quota,
 			      prealloc, slab_size, MAP_PRIVATE)) {
 		if (ENOMEM == errno) {
 			panic("failed to preallocate %zu bytes: "
@@ -106,6 +196,15 @@ memtx_tuple_init(uint64_t tuple_arena_max_size, uint32_t objsize_min,
 				       prealloc);
 		}
 	}
+#if defined(MADV_HUGEPAGE)
+	/*
+	 * No reserved huge pages - at least ask the kernel to
+	 * back the arena with transparent huge pages.
+	 */
+	if (huge_pages && !mapped)
+		(void) madvise(memtx_arena.arena, memtx_arena.prealloc,
+			       MADV_HUGEPAGE);
+#endif
 	slab_cache_create(&memtx_slab_cache, &memtx_arena);
 	small_alloc_create(&memtx_alloc, &memtx_slab_cache,
 			   objsize_min, alloc_factor);
@@ -116,10 +215,122 @@ memtx_tuple_free(void)
 {
 }
 
+size_t
+memtx_tuple_arena_page_size(void)
+{
+	return memtx_arena_page_size;
+}
+
+/** Return a fully dead batch reservation to the allocator. */
+static void
+memtx_tuple_batch_free_block(struct memtx_tuple_batch *batch)
+{
+	assert(batch->live == 0);
+	if (!memtx_alloc.is_delayed_free_mode ||
+	    batch->version == snapshot_version)
+		smfree(&memtx_alloc, batch, batch->total);
+	else
+		smfree_delayed(&memtx_alloc, batch, batch->total);
+}
+
+void
+memtx_tuple_batch_begin(uint32_t size_hint)
+{
+	assert(memtx_tuple_batch_size == 0);
+	if (size_hint == 0)
+		size_hint = MEMTX_TUPLE_BATCH_DEFAULT;
+	if (size_hint > memtx_alloc.objsize_max)
+		size_hint = memtx_alloc.objsize_max;
+	memtx_tuple_batch_size = size_hint;
+	/* The block itself is taken lazily, on first allocation. */
+}
+
+void
+memtx_tuple_batch_end(void)
+{
+	struct memtx_tuple_batch *batch = memtx_tuple_batch;
+	memtx_tuple_batch = NULL;
+	memtx_tuple_batch_size = 0;
+	/*
+	 * If the batch produced no surviving tuples, the block is
+	 * returned right away. Otherwise it lives on until the
+	 * last carved tuple is deleted; the unused tail is the
+	 * price for not being able to split a small block.
+	 */
+	if (batch != NULL && batch->live == 0)
+		memtx_tuple_batch_free_block(batch);
+}
+
+/**
+ * Carve a tuple of the given size from the open batch
+ * reservation, taking a new block if the current one is
+ * exhausted. Returns NULL if batch mode is off, the tuple is too
+ * big for a reservation or the allocator is out of memory (the
+ * caller then falls back to plain smalloc()).
+ */
+static struct memtx_tuple *
+memtx_tuple_batch_carve(size_t total)
+{
+	if (memtx_tuple_batch_size == 0)
+		return NULL;
+	if (small_align(sizeof(struct memtx_tuple_batch) + sizeof(uint32_t),
+			sizeof(intptr_t)) + total > memtx_tuple_batch_size)
+		return NULL;
+	struct memtx_tuple_batch *batch = memtx_tuple_batch;
+	if (batch != NULL) {
+		uint32_t offset = small_align(batch->used + sizeof(uint32_t),
+					      sizeof(intptr_t));
+		/*
+		 * Retire the block if it is exhausted or a
+		 * snapshot has begun since it was taken: all
+		 * tuples of one block must share its version.
+		 */
+		if (offset + total > batch->total ||
+		    batch->version != snapshot_version) {
+			if (batch->live == 0)
+				memtx_tuple_batch_free_block(batch);
+			batch = memtx_tuple_batch = NULL;
+		}
+	}
+	if (batch == NULL) {
+		batch = (struct memtx_tuple_batch *)
+			smalloc(&memtx_alloc, memtx_tuple_batch_size);
+		if (batch == NULL)
+			return NULL;
+		batch->total = memtx_tuple_batch_size;
+		batch->version = snapshot_version;
+		batch->live = 0;
+		batch->used = sizeof(*batch);
+		memtx_tuple_batch = batch;
+	}
+	uint32_t offset = small_align(batch->used + sizeof(uint32_t),
+				      sizeof(intptr_t));
+	struct memtx_tuple *memtx_tuple =
+		(struct memtx_tuple *)((char *)batch + offset);
+	((uint32_t *)memtx_tuple)[-1] = offset;
+	batch->used = offset + total;
+	batch->live++;
+	return memtx_tuple;
+}
+
 struct tuple_format_vtab memtx_tuple_format_vtab = {
 	memtx_tuple_delete,
 };
 
+/*
+ * TODO: spaces with a few thousand distinct values repeated in a
+ * string field (country, status) would shrink a lot if such
+ * strings were interned into a per-space dictionary and stored
+ * as a reference. This cannot be done below tuple_new() alone:
+ * everything in the system - comparators, tuple_field(), iproto
+ * output, snapshots - takes raw pointers into the inline MsgPack
+ * and assumes tuple bytes are self-contained. A reference
+ * encoding needs a dictionary-aware ext type threaded through
+ * all of those readers plus a replicated dictionary lifecycle,
+ * so it has to land as a format-level feature, not an allocator
+ * trick here.
+ */
+
 struct tuple *
 memtx_tuple_new(struct tuple_format *format, const char *data, const char *end)
 {
@@ -132,8 +343,11 @@ memtx_tuple_new(struct tuple_format *format, const char *data, const char *end)
 		     do { diag_set(OutOfMemory, (unsigned) total,
 				   "slab allocator", "memtx_tuple"); return NULL; }
 		     while(false); );
-	struct memtx_tuple *memtx_tuple =
-		(struct memtx_tuple *) smalloc(&memtx_alloc, total);
+	struct memtx_tuple *memtx_tuple = memtx_tuple_batch_carve(total);
+	bool batched = memtx_tuple != NULL;
+	if (!batched)
+		memtx_tuple = (struct memtx_tuple *)
+			smalloc(&memtx_alloc, total);
 	/**
 	 * Use a nothrow version and throw an exception here,
 	 * to throw an instance of ClientError. Apart from being
@@ -153,9 +367,14 @@ memtx_tuple_new(struct tuple_format *format, const char *data, const char *end)
 		}
 		return NULL;
 	}
+	/* Attribute the allocation to the format for box.slab.tuples(). */
+	format->tuple_count++;
+	format->tuple_mem_used += total;
+	alloc_stat_account_smalloc(total);
 	struct tuple *tuple = &memtx_tuple->base;
 	tuple->refs = 0;
-	memtx_tuple->version = snapshot_version;
+	memtx_tuple->version = snapshot_version |
+			       (batched ? MEMTX_TUPLE_BATCHED : 0);
 	assert(tuple_len <= UINT32_MAX); /* bsize is UINT32_MAX */
 	tuple->bsize = tuple_len;
 	tuple->format_id = tuple_format_id(format);
@@ -184,9 +403,27 @@ memtx_tuple_delete(struct tuple_format *format, struct tuple *tuple)
 	assert(tuple->refs == 0);
 	size_t total = sizeof(struct memtx_tuple) +
 		       tuple_format_meta_size(format) + tuple->bsize;
+	assert(format->tuple_count > 0 && format->tuple_mem_used >= total);
+	format->tuple_count--;
+	format->tuple_mem_used -= total;
 	tuple_format_ref(format, -1);
 	struct memtx_tuple *memtx_tuple =
 		container_of(tuple, struct memtx_tuple, base);
+	if (memtx_tuple->version & MEMTX_TUPLE_BATCHED) {
+		/*
+		 * The tuple is a slice of a batch reservation;
+		 * the whole block is freed when its last tuple
+		 * dies. A still open block is kept for carving.
+		 */
+		uint32_t offset = ((uint32_t *)memtx_tuple)[-1];
+		struct memtx_tuple_batch *batch =
+			(struct memtx_tuple_batch *)
+			((char *)memtx_tuple - offset);
+		assert(batch->live > 0);
+		if (--batch->live == 0 && batch != memtx_tuple_batch)
+			memtx_tuple_batch_free_block(batch);
+		return;
+	}
 	if (!memtx_alloc.is_delayed_free_mode ||
 	    memtx_tuple->version == snapshot_version)
 		smfree(&memtx_alloc, memtx_tuple, total);
@@ -214,19 +451,20 @@ box_tuple_update(const box_tuple_t *tuple, const char *expr,
 	uint32_t new_size = 0, bsize;
 	const char *old_data = tuple_data_range(tuple, &bsize);
 	struct region *region = &fiber()->gc;
-	size_t used = region_used(region);
+	struct region_svp svp;
+	region_svp_create(&svp, region);
 	const char *new_data =
 		tuple_update_execute(region_aligned_alloc_cb, region, expr,
 				     expr_end, old_data, old_data + bsize,
 				     &new_size, 1, NULL);
 	if (new_data == NULL) {
-		region_truncate(region, used);
+		region_svp_restore(&svp, region);
 		return NULL;
 	}
 
 	struct tuple *ret = memtx_tuple_new(tuple_format_default, new_data,
 					    new_data + new_size);
-	region_truncate(region, used);
+	region_svp_restore(&svp, region);
 	if (ret != NULL)
 		return tuple_bless_xc(ret);
 	return NULL;
@@ -239,19 +477,20 @@ box_tuple_upsert(const box_tuple_t *tuple, const char *expr,
 	uint32_t new_size = 0, bsize;
 	const char *old_data = tuple_data_range(tuple, &bsize);
 	struct region *region = &fiber()->gc;
-	size_t used = region_used(region);
+	struct region_svp svp;
+	region_svp_create(&svp, region);
 	const char *new_data =
 		tuple_upsert_execute(region_aligned_alloc_cb, region, expr,
 				     expr_end, old_data, old_data + bsize,
 				     &new_size, 1, false, NULL);
 	if (new_data == NULL) {
-		region_truncate(region, used);
+		region_svp_restore(&svp, region);
 		return NULL;
 	}
 
 	struct tuple *ret = memtx_tuple_new(tuple_format_default, new_data,
 					    new_data + new_size);
-	region_truncate(region, used);
+	region_svp_restore(&svp, region);
 	if (ret != NULL)
 		return tuple_bless_xc(ret);
 	return NULL;
@@ -40,11 +40,24 @@ extern "C" {
 #endif /* defined(__cplusplus) */
 
 /**
- * Initialize memtx_tuple library
+ * Initialize memtx_tuple library.
+ *
+ * When @a huge_pages is set the tuple arena is backed by huge
+ * pages: reserved huge pages when the kernel grants them,
+ * transparent huge page advice otherwise. The setting is a hint,
+ * initialization never fails because of it.
  */
 void
 memtx_tuple_init(uint64_t tuple_arena_max_size, uint32_t objsize_min,
-		 uint32_t objsize_max, float alloc_factor);
+		 uint32_t objsize_max, float alloc_factor, bool huge_pages);
+
+/**
+ * Page size backing the tuple arena mapping, in bytes, for
+ * box.slab.info(). Bigger than the system page size when huge
+ * page reservation succeeded.
+ */
+size_t
+memtx_tuple_arena_page_size(void);
 
 /**
  * Cleanup memtx_tuple library
@@ -72,6 +85,27 @@ memtx_tuple_begin_snapshot();
 void
 memtx_tuple_end_snapshot();
 
+/**
+ * Begin batch allocation mode: take one reservation from the
+ * allocator and carve the following memtx_tuple_new() calls from
+ * it, instead of a smalloc() round trip per tuple. Designed for
+ * bulk ingest (snapshot recovery, WAL replay, request batches).
+ * Tuples carved from a reservation are deleted as usual; the
+ * reservation itself is returned to the allocator when the last
+ * tuple carved from it is deleted.
+ *
+ * @param size_hint reservation size in bytes, 0 for a default.
+ */
+void
+memtx_tuple_batch_begin(uint32_t size_hint);
+
+/**
+ * End batch allocation mode. Further memtx_tuple_new() calls go
+ * straight to the allocator again.
+ */
+void
+memtx_tuple_batch_end(void);
+
 /** \cond public */
 
 /**
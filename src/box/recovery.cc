@@ -32,6 +32,7 @@
 
 #include "scoped_guard.h"
 #include "fiber.h"
+#include "cbus.h"
 #include "xlog.h"
 #include "xrow.h"
 #include "xstream.h"
@@ -174,6 +175,44 @@ recovery_exit(struct recovery *r)
 	recovery_delete(r);
 }
 
+/**
+ * Apply a single row read from a WAL, skipping it if it is
+ * already reflected in the recovery vclock.
+ */
+static void
+recover_row(struct recovery *r, struct xstream *stream,
+	    struct xrow_header *row, uint64_t *row_count)
+{
+	int64_t current_lsn = vclock_get(&r->vclock, row->replica_id);
+	if (row->lsn <= current_lsn)
+		return; /* already applied, skip */
+
+	try {
+		/*
+		 * All rows in xlog files have an assigned
+		 * replica id.
+		 */
+		assert(row->replica_id != 0);
+		/*
+		 * We can promote the vclock either before
+		 * or after xstream_write(): it only makes
+		 * any impact in case of forced recovery,
+		 * when we skip the failed row anyway.
+		 */
+		vclock_follow(&r->vclock, row->replica_id, row->lsn);
+		xstream_write_xc(stream, row);
+		++*row_count;
+		if (*row_count % 100000 == 0)
+			say_info("%.1fM rows processed",
+				 *row_count / 1000000.);
+	} catch (ClientError *e) {
+		say_error("can't apply row: ");
+		e->log();
+		if (!r->wal_dir.force_recovery)
+			throw;
+	}
+}
+
 /**
  * Read all rows in a file starting from the last position.
  * Advance the position. If end of file is reached,
@@ -189,6 +228,12 @@ recover_xlog(struct recovery *r, struct xstream *stream,
 	uint64_t row_count = 0;
 	while (xlog_cursor_next_xc(&r->cursor, &row,
 				   r->wal_dir.force_recovery) == 0) {
+		/*
+		 * A yield is safe between the rows, and without one
+		 * a long xlog scan freezes the cord - in the relay
+		 * that means no status updates to tx.
+		 */
+		fiber_preempt_point();
 		/*
 		 * Read the next row from xlog file.
 		 *
@@ -200,37 +245,347 @@ recover_xlog(struct recovery *r, struct xstream *stream,
 		if (stop_vclock != NULL &&
 		    r->vclock.signature >= stop_vclock->signature)
 			return;
-		int64_t current_lsn = vclock_get(&r->vclock, row.replica_id);
-		if (row.lsn <= current_lsn)
-			continue; /* already applied, skip */
+		recover_row(r, stream, &row, &row_count);
+	}
+}
 
-		try {
-			/*
-			 * All rows in xlog files have an assigned
-			 * replica id.
-			 */
-			assert(row.replica_id != 0);
-			/*
-			 * We can promote the vclock either before
-			 * or after xstream_write(): it only makes
-			 * any impact in case of forced recovery,
-			 * when we skip the failed row anyway.
-			 */
-			vclock_follow(&r->vclock,  row.replica_id, row.lsn);
-			xstream_write_xc(stream, &row);
-			++row_count;
-			if (row_count % 100000 == 0)
-				say_info("%.1fM rows processed",
-					 row_count / 1000000.);
-		} catch (ClientError *e) {
-			say_error("can't apply row: ");
-			e->log();
-			if (!r->wal_dir.force_recovery)
+/* {{{ Pipelined xlog recovery */
+
+/*
+ * Replaying a large WAL backlog is CPU bound on reading:
+ * decompression, crc checking and row decoding together cost
+ * more than the apply. To overlap the two, a complete xlog file
+ * is recovered with a pipeline: a reader cord runs the xlog
+ * cursor and ships decoded rows to tx in batches, while the
+ * recovery fiber only applies them. The cords talk via cbus,
+ * the same way as the WAL writer does: batches are delivered
+ * to the "tx_prio" endpoint, where a callback queues them for
+ * the recovery fiber, and are sent back to the reader for
+ * reuse once applied.
+ */
+
+enum {
+	/** Max rows per batch shipped from the reader to tx. */
+	RECOVERY_BATCH_ROWS = 1024,
+	/**
+	 * Target size of row bodies per batch. A batch is
+	 * sealed when it overflows either of the limits.
+	 */
+	RECOVERY_BATCH_BYTES = 1 << 19,
+	/**
+	 * The number of batches circulating between the reader
+	 * and tx. Bounds the memory used by the pipeline and
+	 * throttles the reader if the apply can't keep up.
+	 */
+	RECOVERY_BATCH_COUNT = 4,
+};
+
+struct recovery_pipeline {
+	/** The recovery state the reader runs the cursor of. */
+	struct recovery *r;
+	/** The reader cord. */
+	struct cord cord;
+	/** tx -> reader pipe, carries consumed batches back. */
+	struct cpipe reader_pipe;
+	/** reader -> tx pipe, created in the reader cord. */
+	struct cpipe tx_pipe;
+	/** Free batches. Accessed by the reader cord only. */
+	struct stailq free;
+	/** Batches decoded but not yet applied, in file order. */
+	struct stailq ready;
+	/** The fiber applying the rows, woken up on a new batch. */
+	struct fiber *consumer;
+	/** Set in tx when the reader has sent the last batch. */
+	bool eof;
+	/** Sent by the reader when the file has been read up. */
+	struct cmsg eof_msg;
+	/** The reader error, if any, to be raised in tx. */
+	struct diag diag;
+};
+
+struct recovery_batch {
+	struct cmsg base;
+	/** The pipeline the batch belongs to. */
+	struct recovery_pipeline *pipeline;
+	/** The number of rows in the batch. */
+	int count;
+	/** Decoded row headers. Bodies point into @ibuf. */
+	struct xrow_header rows[RECOVERY_BATCH_ROWS];
+	/** Copies of the row bodies. */
+	struct ibuf ibuf;
+};
+
+static void
+tx_recovery_batch_cb(struct cmsg *msg)
+{
+	struct recovery_batch *batch = (struct recovery_batch *)msg;
+	struct recovery_pipeline *pipeline = batch->pipeline;
+	stailq_add_tail(&pipeline->ready, &batch->base.fifo);
+	fiber_wakeup(pipeline->consumer);
+}
+
+static void
+tx_recovery_eof_cb(struct cmsg *msg)
+{
+	struct recovery_pipeline *pipeline = container_of(
+		msg, struct recovery_pipeline, eof_msg);
+	pipeline->eof = true;
+	fiber_wakeup(pipeline->consumer);
+}
+
+static void
+recovery_reader_recycle_cb(struct cmsg *msg)
+{
+	struct recovery_batch *batch = (struct recovery_batch *)msg;
+	batch->count = 0;
+	ibuf_reset(&batch->ibuf);
+	stailq_add_tail(&batch->pipeline->free, &batch->base.fifo);
+}
+
+static struct cmsg_hop recovery_batch_route[] = {
+	{tx_recovery_batch_cb, NULL},
+};
+
+static struct cmsg_hop recovery_eof_route[] = {
+	{tx_recovery_eof_cb, NULL},
+};
+
+static struct cmsg_hop recovery_recycle_route[] = {
+	{recovery_reader_recycle_cb, NULL},
+};
+
+/** Return a consumed batch to the reader for reuse. */
+static void
+recovery_batch_recycle(struct recovery_pipeline *pipeline,
+		       struct recovery_batch *batch)
+{
+	cmsg_init(&batch->base, recovery_recycle_route);
+	cpipe_push(&pipeline->reader_pipe, &batch->base);
+}
+
+/** Append a copy of a row to a batch. */
+static int
+recovery_batch_add(struct recovery_batch *batch, struct xrow_header *row)
+{
+	struct xrow_header *copy = &batch->rows[batch->count];
+	*copy = *row;
+	for (int i = 0; i < row->bodycnt; i++) {
+		size_t len = row->body[i].iov_len;
+		void *ptr = ibuf_alloc(&batch->ibuf, len);
+		if (ptr == NULL) {
+			diag_set(OutOfMemory, len, "ibuf", "xrow body");
+			return -1;
+		}
+		memcpy(ptr, row->body[i].iov_base, len);
+		/*
+		 * The buffer may be reallocated while the batch
+		 * is being filled, so remember an offset and turn
+		 * it into a pointer when the batch is sealed, see
+		 * recovery_batch_send().
+		 */
+		copy->body[i].iov_base = (void *)
+			((char *)ptr - batch->ibuf.rpos);
+	}
+	batch->count++;
+	return 0;
+}
+
+/** Seal a batch and ship it to tx. */
+static void
+recovery_batch_send(struct recovery_pipeline *pipeline,
+		    struct recovery_batch *batch)
+{
+	/* Turn body offsets into pointers, see recovery_batch_add(). */
+	for (int i = 0; i < batch->count; i++) {
+		struct xrow_header *row = &batch->rows[i];
+		for (int j = 0; j < row->bodycnt; j++)
+			row->body[j].iov_base = batch->ibuf.rpos +
+				(intptr_t)row->body[j].iov_base;
+	}
+	cmsg_init(&batch->base, recovery_batch_route);
+	cpipe_push(&pipeline->tx_pipe, &batch->base);
+}
+
+/**
+ * Take a free batch, waiting for tx to return one if
+ * all of them are in flight.
+ */
+static struct recovery_batch *
+recovery_reader_next_batch(struct recovery_pipeline *pipeline,
+			   struct cbus_endpoint *endpoint)
+{
+	while (true) {
+		cbus_process(endpoint);
+		if (!stailq_empty(&pipeline->free))
+			break;
+		fiber_yield();
+	}
+	return stailq_shift_entry(&pipeline->free, struct recovery_batch,
+				  base.fifo);
+}
+
+/** Reader cord function. */
+static int
+recovery_reader_f(va_list ap)
+{
+	struct recovery_pipeline *pipeline =
+		va_arg(ap, struct recovery_pipeline *);
+	struct recovery *r = pipeline->r;
+
+	struct cbus_endpoint endpoint;
+	cbus_endpoint_create(&endpoint, cord_name(cord()),
+			     fiber_schedule_cb, fiber());
+	cpipe_create(&pipeline->tx_pipe, "tx_prio");
+	/* Ship each batch as soon as it has been sealed. */
+	cpipe_set_max_input(&pipeline->tx_pipe, 1);
+
+	struct recovery_batch *batches[RECOVERY_BATCH_COUNT];
+	int batch_count = 0;
+	stailq_create(&pipeline->free);
+	for (int i = 0; i < RECOVERY_BATCH_COUNT; i++) {
+		struct recovery_batch *batch = (struct recovery_batch *)
+			calloc(1, sizeof(*batch));
+		if (batch == NULL) {
+			diag_set(OutOfMemory, sizeof(*batch), "malloc",
+				 "struct recovery_batch");
+			diag_move(diag_get(), &pipeline->diag);
+			break;
+		}
+		batch->pipeline = pipeline;
+		ibuf_create(&batch->ibuf, &cord()->slabc, 16384);
+		batches[batch_count++] = batch;
+		stailq_add_tail(&pipeline->free, &batch->base.fifo);
+	}
+
+	if (batch_count == RECOVERY_BATCH_COUNT) {
+		struct recovery_batch *batch =
+			recovery_reader_next_batch(pipeline, &endpoint);
+		while (true) {
+			struct xrow_header row;
+			int rc = xlog_cursor_next(&r->cursor, &row,
+						  r->wal_dir.force_recovery);
+			if (rc != 0) {
+				if (rc < 0)
+					diag_move(diag_get(), &pipeline->diag);
+				break;
+			}
+			if (recovery_batch_add(batch, &row) != 0) {
+				diag_move(diag_get(), &pipeline->diag);
+				break;
+			}
+			if (batch->count == RECOVERY_BATCH_ROWS ||
+			    ibuf_used(&batch->ibuf) >= RECOVERY_BATCH_BYTES) {
+				recovery_batch_send(pipeline, batch);
+				batch = recovery_reader_next_batch(pipeline,
+								   &endpoint);
+			}
+		}
+		if (batch->count > 0)
+			recovery_batch_send(pipeline, batch);
+		else
+			stailq_add_tail(&pipeline->free, &batch->base.fifo);
+	}
+	cmsg_init(&pipeline->eof_msg, recovery_eof_route);
+	cpipe_push(&pipeline->tx_pipe, &pipeline->eof_msg);
+
+	/* Wait for tx to consume everything and stop the loop. */
+	cbus_loop(&endpoint);
+
+	/*
+	 * tx returns all batches before stopping the loop, see
+	 * recover_xlog_pipelined(), so they are all home now.
+	 */
+	for (int i = 0; i < batch_count; i++) {
+		ibuf_destroy(&batches[i]->ibuf);
+		free(batches[i]);
+	}
+	cpipe_destroy(&pipeline->tx_pipe);
+	cbus_endpoint_destroy(&endpoint, cbus_process);
+	return 0;
+}
+
+/**
+ * Same as recover_xlog(), but the file is read and decoded by
+ * a background cord while this fiber only applies the rows.
+ */
+static void
+recover_xlog_pipelined(struct recovery *r, struct xstream *stream,
+		       struct vclock *stop_vclock)
+{
+	struct recovery_pipeline pipeline;
+	pipeline.r = r;
+	stailq_create(&pipeline.ready);
+	pipeline.consumer = fiber();
+	pipeline.eof = false;
+	diag_create(&pipeline.diag);
+
+	char name[FIBER_NAME_MAX];
+	snprintf(name, sizeof(name), "wal_reader_%p", (void *)r);
+	if (cord_costart(&pipeline.cord, name, recovery_reader_f,
+			 &pipeline) != 0)
+		diag_raise();
+	cpipe_create(&pipeline.reader_pipe, name);
+
+	auto guard = make_scoped_guard([&]{
+		/*
+		 * Return the batches which haven't been applied,
+		 * e.g. if the apply threw an exception, and stop
+		 * the reader. The reader exits its loop only
+		 * after all recycle messages have been processed,
+		 * so no batch can be lost in flight.
+		 */
+		while (!pipeline.eof || !stailq_empty(&pipeline.ready)) {
+			if (stailq_empty(&pipeline.ready)) {
+				fiber_yield();
+				continue;
+			}
+			struct recovery_batch *batch =
+				stailq_shift_entry(&pipeline.ready,
+						   struct recovery_batch,
+						   base.fifo);
+			recovery_batch_recycle(&pipeline, batch);
+		}
+		cbus_stop_loop(&pipeline.reader_pipe);
+		cpipe_destroy(&pipeline.reader_pipe);
+		cord_cojoin(&pipeline.cord);
+		diag_destroy(&pipeline.diag);
+	});
+
+	uint64_t row_count = 0;
+	bool stopped = false;
+	while (!stopped && (!pipeline.eof || !stailq_empty(&pipeline.ready))) {
+		if (stailq_empty(&pipeline.ready)) {
+			fiber_yield();
+			continue;
+		}
+		struct recovery_batch *batch =
+			stailq_shift_entry(&pipeline.ready,
+					   struct recovery_batch, base.fifo);
+		for (int i = 0; i < batch->count; i++) {
+			if (stop_vclock != NULL &&
+			    r->vclock.signature >= stop_vclock->signature) {
+				stopped = true;
+				break;
+			}
+			try {
+				recover_row(r, stream, &batch->rows[i],
+					    &row_count);
+			} catch (Exception *e) {
+				recovery_batch_recycle(&pipeline, batch);
 				throw;
+			}
 		}
+		recovery_batch_recycle(&pipeline, batch);
+	}
+
+	if (!diag_is_empty(&pipeline.diag)) {
+		diag_move(&pipeline.diag, diag_get());
+		diag_raise();
 	}
 }
 
+/* }}} */
+
 /**
  * Find out if there are new .xlog files since the current
  * LSN, and read them all up.
@@ -307,12 +662,32 @@ recover_remaining_wals(struct recovery *r, struct xstream *stream,
 		recovery_close_log(r);
 
 		xdir_open_cursor_xc(&r->wal_dir, vclock_sum(clock), &r->cursor);
+		r->cursor.shared_cache = r->shared_cache;
+		/*
+		 * Initial recovery replays whole files, so read
+		 * far ahead. Tail followers poll for small
+		 * increments and keep the default.
+		 */
+		if (cord_is_main() && r->watcher == NULL)
+			r->cursor.read_ahead = XLOG_READ_AHEAD_BULK;
 
 		say_info("recover from `%s'", r->cursor.name);
 
 recover_current_wal:
-		if (r->cursor.state != XLOG_CURSOR_EOF)
-			recover_xlog(r, stream, stop_vclock);
+		if (r->cursor.state != XLOG_CURSOR_EOF) {
+			/*
+			 * At initial recovery replay the file
+			 * through the reader pipeline. In hot
+			 * standby and relay modes files are read
+			 * incrementally in small portions, which
+			 * isn't worth a reader cord per wakeup,
+			 * so stick to the serial path there.
+			 */
+			if (cord_is_main() && r->watcher == NULL)
+				recover_xlog_pipelined(r, stream, stop_vclock);
+			else
+				recover_xlog(r, stream, stop_vclock);
+		}
 		/**
 		 * Keep the last log open to remember recovery
 		 * position. This speeds up recovery in local hot
@@ -346,9 +721,9 @@ recovery_finalize(struct recovery *r, struct xstream *stream)
 		/*
 		 * Delete the last empty xlog file.
 		 */
-		char *name = xdir_format_filename(&r->wal_dir,
-						  vclock_sum(&r->vclock),
-						  NONE);
+		char *name = xdir_resolve_filename(&r->wal_dir,
+						   vclock_sum(&r->vclock),
+						   NONE);
 		if (unlink(name) != 0) {
 			tnt_raise(SystemError, "%s: failed to unlink file",
 				  name);
@@ -373,6 +748,12 @@ public:
 	struct fiber *f;
 	bool signaled;
 	struct ev_stat dir_stat;
+	/**
+	 * Watchers of the extra stripe directories of a striped
+	 * WAL dir: a new segment may appear in any stripe.
+	 */
+	struct ev_stat stripe_stat[XDIR_STRIPE_MAX - 1];
+	int stripe_count;
 	struct ev_stat file_stat;
 	struct ev_async async;
 	struct wal_watcher watcher;
@@ -396,15 +777,16 @@ public:
 			fiber_wakeup(f);
 	}
 
-	WalSubscription(const char *wal_dir)
+	WalSubscription(const struct xdir *wal_dir)
 	{
 		f = fiber();
 		signaled = false;
-		if ((size_t)snprintf(dir_path, sizeof(dir_path), "%s", wal_dir) >=
-				sizeof(dir_path)) {
+		if ((size_t)snprintf(dir_path, sizeof(dir_path), "%s",
+				     wal_dir->dirname) >= sizeof(dir_path)) {
 
-			panic("path too long: %s", wal_dir);
+			panic("path too long: %s", wal_dir->dirname);
 		}
+		stripe_count = wal_dir->stripe_count;
 
 		ev_stat_init(&dir_stat, stat_cb, "", 0.0);
 		ev_stat_init(&file_stat, stat_cb, "", 0.0);
@@ -412,6 +794,10 @@ public:
 		dir_stat.data = this;
 		file_stat.data = this;
 		async.data = this;
+		for (int i = 0; i < stripe_count; i++) {
+			ev_stat_init(&stripe_stat[i], stat_cb, "", 0.0);
+			stripe_stat[i].data = this;
+		}
 
 		ev_async_start(loop(), &async);
 		if (wal_set_watcher(&watcher, &async) == -1) {
@@ -419,6 +805,15 @@ public:
 			ev_async_stop(loop(), &async);
 			ev_stat_set(&dir_stat, dir_path, 0.0);
 			ev_stat_start(loop(), &dir_stat);
+			for (int i = 0; i < stripe_count; i++) {
+				/*
+				 * The paths live in the recovery's
+				 * xdir, which outlives this fiber.
+				 */
+				ev_stat_set(&stripe_stat[i],
+					    wal_dir->stripes[i], 0.0);
+				ev_stat_start(loop(), &stripe_stat[i]);
+			}
 			watcher.loop = NULL;
 			watcher.async = NULL;
 		}
@@ -427,6 +822,8 @@ public:
 	~WalSubscription()
 	{
 		ev_stat_stop(loop(), &file_stat);
+		for (int i = 0; i < stripe_count; i++)
+			ev_stat_stop(loop(), &stripe_stat[i]);
 		ev_stat_stop(loop(), &dir_stat);
 		wal_clear_watcher(&watcher);
 		ev_async_stop(loop(), &async);
@@ -474,7 +871,7 @@ recovery_follow_f(va_list ap)
 	struct xstream *stream = va_arg(ap, struct xstream *);
 	ev_tstamp wal_dir_rescan_delay = va_arg(ap, ev_tstamp);
 
-	WalSubscription subscription(r->wal_dir.dirname);
+	WalSubscription subscription(&r->wal_dir);
 
 	while (! fiber_is_cancelled()) {
 
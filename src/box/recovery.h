@@ -54,6 +54,12 @@ struct recovery {
 	 * locally or send to the replica.
 	 */
 	struct fiber *watcher;
+	/**
+	 * Read WALs through the shared xlog tx cache. Set by the
+	 * relay, so that many followers of the same WAL read and
+	 * decode each tx once instead of once per follower.
+	 */
+	bool shared_cache;
 };
 
 struct recovery *
@@ -34,14 +34,20 @@
 #include "trivia/util.h"
 #include "cbus.h"
 #include "cfg.h"
+#include "clock.h"
 #include "errinj.h"
 #include "fiber.h"
+#include "histogram.h"
 #include "say.h"
 #include "scoped_guard.h"
+#include "small/ibuf.h"
+#include "small/obuf.h"
+#include "zstd.h"
 
 #include "coeio.h"
 #include "coio.h"
 #include "engine.h"
+#include "gc.h"
 #include "iproto_constants.h"
 #include "recovery.h"
 #include "replication.h"
@@ -54,6 +60,16 @@
 /** Report relay status to tx thread at least once per this interval */
 static const int RELAY_REPORT_INTERVAL = 1;
 
+enum {
+	/**
+	 * Stop staging rows and wait for the writer fiber to
+	 * flush once this many bytes are buffered.
+	 */
+	RELAY_SEND_BUF_MAX = 256 * 1024,
+	/** Initial capacity of a staging buffer. */
+	RELAY_SEND_BUF_SIZE = 16320,
+};
+
 /**
  * Cbus message to send status updates from relay to tx thread.
  */
@@ -64,6 +80,8 @@ struct relay_status_msg {
 	struct relay *relay;
 	/** New vclock */
 	struct vclock vclock;
+	/** Send statistics as of this status update. */
+	struct relay_stat stat;
 };
 
 /**
@@ -94,6 +112,12 @@ struct relay {
 	ev_tstamp wal_dir_rescan_delay;
 	/** Remote replica id */
 	uint32_t replica_id;
+	/**
+	 * The subscribed replica, or NULL for JOIN stages.
+	 * Used by the tx thread to advance the replica's gc
+	 * consumer as the replica reports progress.
+	 */
+	struct replica *replica;
 
 	/** Relay endpoint */
 	struct cbus_endpoint endpoint;
@@ -108,11 +132,47 @@ struct relay {
 	/** Relay exit orchestration message */
 	struct relay_exit_msg exit_msg;
 
+	/**
+	 * Writer fiber which flushes staged rows to the socket,
+	 * or NULL when rows are written directly (JOIN stages).
+	 */
+	struct fiber *writer;
+	/**
+	 * Double output buffer: rows are staged into one half
+	 * while the writer flushes the other, so consecutive
+	 * rows coalesce into single writev() calls.
+	 */
+	struct obuf send_buf[2];
+	/** Index of the buffer currently staging rows. */
+	int send_cur;
+	/** Signaled when rows are staged for the writer. */
+	struct ipc_cond send_cond;
+	/** Signaled after the writer flushes a buffer. */
+	struct ipc_cond send_flushed;
+	/**
+	 * ZSTD level negotiated in SUBSCRIBE, 0 - send the
+	 * stream uncompressed.
+	 */
+	int zstd_level;
+	/** Compression context, if compression is on. */
+	ZSTD_CCtx *zctx;
+	/** Staging area for a compressed envelope. */
+	struct ibuf zbuf;
+	/**
+	 * Histogram of send stall durations in microseconds,
+	 * or NULL if allocation failed. Relay cord only.
+	 */
+	struct histogram *stall_hist;
+	/** Total time spent stalled on a full send buffer. */
+	double stall_time;
+
 	struct {
 		/* Align to prevent false-sharing with tx thread */
 		alignas(CACHELINE_SIZE)
 		/** Current vclock sent by relay */
 		struct vclock vclock;
+		/** Send statistics from the last status update. */
+		struct relay_stat stat;
 		/** The condition is signaled at relay exit. */
 		struct ipc_cond exit_cond;
 	} tx;
@@ -124,6 +184,34 @@ relay_vclock(const struct relay *relay)
 	return &relay->tx.vclock;
 }
 
+const struct relay_stat *
+relay_stat(const struct relay *relay)
+{
+	return &relay->tx.stat;
+}
+
+/**
+ * Snapshot the send statistics. Runs in the relay cord; the
+ * result travels to tx in a status message.
+ */
+static void
+relay_stat_fill(struct relay *relay, struct relay_stat *stat)
+{
+	memset(stat, 0, sizeof(*stat));
+	stat->send_queued = obuf_size(&relay->send_buf[0]) +
+			    obuf_size(&relay->send_buf[1]);
+	if (relay->zctx != NULL)
+		stat->send_queued += ibuf_used(&relay->zbuf);
+	stat->stall_time = relay->stall_time;
+	struct histogram *hist = relay->stall_hist;
+	if (hist != NULL && hist->total > 0) {
+		stat->stall_p50 = histogram_percentile(hist, 50) * 1e-6;
+		stat->stall_p90 = histogram_percentile(hist, 90) * 1e-6;
+		stat->stall_p99 = histogram_percentile(hist, 99) * 1e-6;
+		stat->stall_max = hist->max * 1e-6;
+	}
+}
+
 static void
 relay_send_initial_join_row(struct xstream *stream, struct xrow_header *row);
 static void
@@ -161,7 +249,8 @@ relay_set_cord_name(int fd)
 }
 
 void
-relay_initial_join(int fd, uint64_t sync, struct vclock *vclock)
+relay_initial_join(int fd, uint64_t sync, struct vclock *vclock,
+		   bool snap_file)
 {
 	struct relay relay;
 	relay_create(&relay, fd, sync, relay_send_initial_join_row);
@@ -170,7 +259,7 @@ relay_initial_join(int fd, uint64_t sync, struct vclock *vclock)
 	});
 
 	assert(relay.stream.write != NULL);
-	engine_join(vclock, &relay.stream);
+	engine_join(vclock, &relay.stream, snap_file);
 }
 
 int
@@ -238,6 +327,14 @@ tx_status_update(struct cmsg *msg)
 {
 	struct relay_status_msg *status = (struct relay_status_msg *)msg;
 	vclock_copy(&status->relay->tx.vclock, &status->vclock);
+	status->relay->tx.stat = status->stat;
+	/*
+	 * The rows the replica has confirmed are no longer needed
+	 * for its catch-up - let gc collect the WALs behind them.
+	 */
+	struct replica *replica = status->relay->replica;
+	if (replica != NULL && replica->gc != NULL)
+		gc_consumer_advance(replica->gc, vclock_sum(&status->vclock));
 	static const struct cmsg_hop route[] = {
 		{relay_status_update, NULL}
 	};
@@ -304,6 +401,57 @@ relay_subscribe_f(va_list ap)
 		relay_cbus_detach(relay);
 	});
 	relay_set_cord_name(relay->io.fd);
+
+	/*
+	 * Start the writer fiber before the WAL sender: the
+	 * latter begins staging rows the moment it is up.
+	 */
+	obuf_create(&relay->send_buf[0], &cord()->slabc, RELAY_SEND_BUF_SIZE);
+	obuf_create(&relay->send_buf[1], &cord()->slabc, RELAY_SEND_BUF_SIZE);
+	relay->send_cur = 0;
+	if (relay->zstd_level > 0) {
+		/* On failure fall back to the plain stream. */
+		relay->zctx = ZSTD_createCCtx();
+		if (relay->zctx != NULL) {
+			ibuf_create(&relay->zbuf, &cord()->slabc,
+				    RELAY_SEND_BUF_SIZE);
+			say_info("compressing replication stream, level %d",
+				 relay->zstd_level);
+		}
+	}
+	enum { US = 1, MS = 1000 * US };
+	static int64_t stall_buckets[] = {
+		100 * US, 250 * US, 500 * US,
+		1 * MS, 2 * MS, 5 * MS, 10 * MS, 25 * MS, 50 * MS,
+		100 * MS, 250 * MS, 500 * MS, 1000 * MS,
+	};
+	/* If we are out of memory, simply live without the stats. */
+	relay->stall_hist = histogram_new(stall_buckets,
+					  lengthof(stall_buckets));
+	ipc_cond_create(&relay->send_cond);
+	ipc_cond_create(&relay->send_flushed);
+	relay->writer = fiber_new_xc("relay_writer", relay_writer_f);
+	fiber_set_joinable(relay->writer, true);
+	fiber_start(relay->writer, relay);
+	auto writer_guard = make_scoped_guard([&]{
+		fiber_cancel(relay->writer);
+		fiber_join(relay->writer);
+		relay->writer = NULL;
+		ipc_cond_destroy(&relay->send_cond);
+		ipc_cond_destroy(&relay->send_flushed);
+		obuf_destroy(&relay->send_buf[0]);
+		obuf_destroy(&relay->send_buf[1]);
+		if (relay->zctx != NULL) {
+			ZSTD_freeCCtx(relay->zctx);
+			relay->zctx = NULL;
+			ibuf_destroy(&relay->zbuf);
+		}
+		if (relay->stall_hist != NULL) {
+			histogram_delete(relay->stall_hist);
+			relay->stall_hist = NULL;
+		}
+	});
+
 	recovery_follow_local(r, &relay->stream, fiber_name(fiber()),
 			      relay->wal_dir_rescan_delay);
 
@@ -356,18 +504,26 @@ relay_subscribe_f(va_list ap)
 			say_syserror("recv");
 
 		/*
-		 * Check that the vclock has been updated and the previous
-		 * status message is delivered
+		 * Check that the vclock or the send statistics have
+		 * been updated and the previous status message is
+		 * delivered. The statistics matter on their own: a
+		 * stalled relay keeps its vclock put, which is
+		 * exactly when the queue depth is worth looking at.
 		 */
+		struct relay_stat stat;
+		relay_stat_fill(relay, &stat);
 		if (relay->status_msg.msg.route != NULL ||
-		    vclock_compare(&relay->status_msg.vclock,
-				   &r->vclock) == 0)
+		    (vclock_compare(&relay->status_msg.vclock,
+				    &r->vclock) == 0 &&
+		     memcmp(&stat, &relay->status_msg.stat,
+			    sizeof(stat)) == 0))
 			continue;
 		static const struct cmsg_hop route[] = {
 			{tx_status_update, NULL}
 		};
 		cmsg_init(&relay->status_msg.msg, route);
 		vclock_copy(&relay->status_msg.vclock, &r->vclock);
+		relay->status_msg.stat = stat;
 		relay->status_msg.relay = relay;
 		cpipe_push(&relay->tx_pipe, &relay->status_msg.msg);
 	}
@@ -383,7 +539,7 @@ relay_subscribe_f(va_list ap)
 /** Replication acceptor fiber handler. */
 void
 relay_subscribe(int fd, uint64_t sync, struct replica *replica,
-		struct vclock *replica_clock)
+		struct vclock *replica_clock, int zstd_level)
 {
 	assert(replica->id != REPLICA_ID_NIL);
 	/* Don't allow multiple relays for the same replica */
@@ -392,13 +548,36 @@ relay_subscribe(int fd, uint64_t sync, struct replica *replica,
 			  "duplicate connection with the same replica UUID");
 	}
 
+	/*
+	 * Register the garbage collection consumer: the WALs the
+	 * replica has not fetched yet must survive until it does,
+	 * or the next reconnect will find a gap in the logs and
+	 * the replica will have to rejoin from a full snapshot.
+	 */
+	if (replica->gc == NULL) {
+		replica->gc = gc_consumer_register(tt_uuid_str(&replica->uuid),
+						   vclock_sum(replica_clock));
+		if (replica->gc == NULL)
+			diag_raise();
+	} else {
+		gc_consumer_advance(replica->gc, vclock_sum(replica_clock));
+	}
+
 	struct relay relay;
 	relay_create(&relay, fd, sync, relay_send_row);
 	relay.r = recovery_new(cfg_gets("wal_dir"),
 			       cfg_geti("force_recovery"),
 			       replica_clock);
+	/*
+	 * With many followers of the same WAL, let the relays
+	 * share decoded txs instead of each reading the file
+	 * privately.
+	 */
+	relay.r->shared_cache = true;
 	vclock_copy(&relay.tx.vclock, replica_clock);
 	relay.replica_id = replica->id;
+	relay.replica = replica;
+	relay.zstd_level = zstd_level;
 	relay.wal_dir_rescan_delay = cfg_getd("wal_dir_rescan_delay");
 	replica_set_relay(replica, &relay);
 
@@ -430,11 +609,162 @@ relay_subscribe(int fd, uint64_t sync, struct replica *replica,
 	}
 }
 
+/**
+ * Compress the rows staged in @a buf into a single
+ * IPROTO_COMPRESSION envelope in relay->zbuf.
+ * @retval 0  the envelope is ready in relay->zbuf
+ * @retval -1 failed - send the plain rows instead, compression
+ *            is an optimization, not an obligation
+ */
+static int
+relay_compress_buf(struct relay *relay, struct obuf *buf)
+{
+	struct ibuf *zbuf = &relay->zbuf;
+	assert(ibuf_used(zbuf) == 0);
+	if (ibuf_alloc(zbuf, sizeof(struct iproto_zstd_bin)) == NULL)
+		return -1;
+	ZSTD_compressBegin(relay->zctx, relay->zstd_level);
+	uint32_t frame_size = 0;
+	struct iproto_zstd_bin *fix;
+	int iovcnt = buf->pos + 1;
+	for (int i = 0; i < iovcnt; ++i) {
+		/* Estimate max output buffer size. */
+		size_t zmax_size = ZSTD_compressBound(buf->iov[i].iov_len);
+		void *zdst = ibuf_reserve(zbuf, zmax_size);
+		if (zdst == NULL)
+			goto fallback;
+		size_t (*fcompress)(ZSTD_CCtx *, void *, size_t,
+				    const void *, size_t);
+		/* End the frame on the last iov. */
+		if (i == iovcnt - 1)
+			fcompress = ZSTD_compressEnd;
+		else
+			fcompress = ZSTD_compressContinue;
+		size_t zsize = fcompress(relay->zctx, zdst, zmax_size,
+					 buf->iov[i].iov_base,
+					 buf->iov[i].iov_len);
+		if (ZSTD_isError(zsize))
+			goto fallback;
+		ibuf_alloc(zbuf, zsize);
+		frame_size += zsize;
+	}
+	/*
+	 * The buffer may have been reallocated while growing, so
+	 * take a fresh pointer to the envelope prefix.
+	 */
+	fix = (struct iproto_zstd_bin *) zbuf->rpos;
+	fix->m_len = 0xce;
+	fix->v_len = mp_bswap_u32(sizeof(*fix) - 5 + frame_size);
+	fix->m_header = 0x81;
+	fix->k_type = IPROTO_REQUEST_TYPE;
+	fix->v_type = IPROTO_COMPRESSION;
+	fix->m_body = 0x81;
+	fix->k_data = IPROTO_DATA;
+	fix->m_data = 0xc6;
+	fix->v_data_len = mp_bswap_u32(frame_size);
+	return 0;
+fallback:
+	ibuf_reset(zbuf);
+	return -1;
+}
+
+/**
+ * Writer fiber: flushes rows staged by relay_send() to the
+ * replica socket. While one staging buffer is being written out
+ * (possibly across several yields on a slow socket), new rows
+ * accumulate in the other, so a burst of WAL rows goes out in a
+ * single writev() instead of one syscall per row.
+ */
+static int
+relay_writer_f(va_list ap)
+{
+	struct relay *relay = va_arg(ap, struct relay *);
+	/*
+	 * Wake up a fiber blocked on backpressure when exiting,
+	 * whatever the reason: it checks our liveness itself.
+	 */
+	auto guard = make_scoped_guard([=]{
+		ipc_cond_broadcast(&relay->send_flushed);
+	});
+	while (!fiber_is_cancelled()) {
+		struct obuf *buf = &relay->send_buf[relay->send_cur];
+		if (obuf_size(buf) == 0) {
+			ipc_cond_wait(&relay->send_cond);
+			continue;
+		}
+		/* Flip the buffers and flush the filled one. */
+		relay->send_cur ^= 1;
+		assert(obuf_size(&relay->send_buf[relay->send_cur]) == 0);
+		if (relay->zctx != NULL &&
+		    relay_compress_buf(relay, buf) == 0) {
+			coio_write(&relay->io, relay->zbuf.rpos,
+				   ibuf_used(&relay->zbuf));
+			ibuf_reset(&relay->zbuf);
+		} else {
+			/*
+			 * coio_writev() advances the vector on
+			 * partial writes - feed it a copy to keep
+			 * the obuf intact.
+			 */
+			struct iovec iov[SMALL_OBUF_IOV_MAX + 1];
+			int iovcnt = buf->pos + 1;
+			memcpy(iov, buf->iov, iovcnt * sizeof(struct iovec));
+			coio_writev(&relay->io, iov, iovcnt, obuf_size(buf));
+		}
+		obuf_reset(buf);
+		ipc_cond_broadcast(&relay->send_flushed);
+	}
+	return 0;
+}
+
+/**
+ * Re-raise the error which killed the writer fiber, so that it
+ * takes the usual path out of the relay: the sender fiber dies,
+ * recovery_stop_local() picks the error up and rethrows it in
+ * the relay cord main fiber.
+ */
+static inline void
+relay_check_writer(struct relay *relay)
+{
+	if (fiber_is_dead(relay->writer)) {
+		diag_move(&relay->writer->diag, &fiber()->diag);
+		diag_raise();
+	}
+}
+
 static void
 relay_send(struct relay *relay, struct xrow_header *packet)
 {
 	packet->sync = relay->sync;
-	coio_write_xrow(&relay->io, packet);
+	if (relay->writer == NULL) {
+		/* JOIN stages write rows directly. */
+		coio_write_xrow(&relay->io, packet);
+		fiber_gc();
+		return;
+	}
+	relay_check_writer(relay);
+	/* Backpressure: cap the bytes staged ahead of the socket. */
+	if (obuf_size(&relay->send_buf[relay->send_cur]) >=
+	    RELAY_SEND_BUF_MAX) {
+		double start = clock_fast();
+		do {
+			ipc_cond_wait(&relay->send_flushed);
+			fiber_testcancel();
+			relay_check_writer(relay);
+		} while (obuf_size(&relay->send_buf[relay->send_cur]) >=
+			 RELAY_SEND_BUF_MAX);
+		double stall = clock_fast() - start;
+		relay->stall_time += stall;
+		if (relay->stall_hist != NULL)
+			histogram_collect(relay->stall_hist,
+					  (int64_t)(stall * 1e6));
+	}
+	struct iovec iov[XROW_IOVMAX];
+	int iovcnt = xrow_to_iovec(packet, iov);
+	struct obuf *buf = &relay->send_buf[relay->send_cur];
+	for (int i = 0; i < iovcnt; i++)
+		obuf_dup_xc(buf, iov[i].iov_base, iov[i].iov_len);
+	ipc_cond_signal(&relay->send_cond);
 	fiber_gc();
 }
 
@@ -449,6 +779,17 @@ relay_send_initial_join_row(struct xstream *stream, struct xrow_header *row)
 	});
 }
 
+/*
+ * TODO: per-replica space filters (a space id set sent in
+ * SUBSCRIBE and checked here against IPROTO_SPACE_ID peeked from
+ * the row body) would cut traffic for replicas interested in a
+ * few spaces. Simply dropping rows is not enough though: the
+ * replica never sees their LSNs, its vclock stops short of the
+ * master's, and every reconnect rescans the whole filtered tail.
+ * The filter needs a WAL-able no-op row type to ship the LSN of
+ * each suppressed row, and the applier/WAL side must learn to
+ * consume it. Do that first.
+ */
 /** Send a single row to the client. */
 static void
 relay_send_row(struct xstream *stream, struct xrow_header *packet)
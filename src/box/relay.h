@@ -31,6 +31,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(__cplusplus)
@@ -42,6 +43,26 @@ struct replica;
 struct tt_uuid;
 struct vclock;
 
+/**
+ * Relay send statistics, as of the last status update the relay
+ * thread sent to tx. Tells socket backpressure apart from a slow
+ * WAL read: a lagging replica with an empty queue and no stalls
+ * is applier-bound, a full queue means the network or the replica
+ * socket is the bottleneck.
+ */
+struct relay_stat {
+	/** Bytes staged for sending but not yet written out. */
+	size_t send_queued;
+	/** Total time spent stalled on a full send buffer. */
+	double stall_time;
+	/** Stall duration percentiles, in seconds. */
+	double stall_p50;
+	double stall_p90;
+	double stall_p99;
+	/** The longest stall observed, in seconds. */
+	double stall_max;
+};
+
 /**
  * Returns relay's vclock
  * @param relay relay
@@ -50,6 +71,14 @@ struct vclock;
 const struct vclock *
 relay_vclock(const struct relay *relay);
 
+/**
+ * Returns relay's send statistics
+ * @param relay relay
+ * @returns relay's send statistics
+ */
+const struct relay_stat *
+relay_stat(const struct relay *relay);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
@@ -60,9 +89,11 @@ relay_vclock(const struct relay *relay);
  * @param fd        client connection
  * @param sync      sync from incoming JOIN request
  * @param vclock    vclock of the last checkpoint
+ * @param snap_file the replica accepts raw snapshot file transfer
  */
 void
-relay_initial_join(int fd, uint64_t sync, struct vclock *vclock);
+relay_initial_join(int fd, uint64_t sync, struct vclock *vclock,
+		   bool snap_file);
 
 /**
  * Send final JOIN rows to the replica.
@@ -77,10 +108,11 @@ relay_final_join(int fd, uint64_t sync, struct vclock *start_vclock,
 /**
  * Subscribe a replica to updates.
  *
+ * @param zstd_level requested stream compression level, 0 - off.
  * @return none.
  */
 void
 relay_subscribe(int fd, uint64_t sync, struct replica *replica,
-		struct vclock *replica_vclock);
+		struct vclock *replica_vclock, int zstd_level);
 
 #endif /* TARANTOOL_REPLICATION_RELAY_H_INCLUDED */
@@ -39,6 +39,7 @@
 #include "box.h"
 #include "applier.h"
 #include "error.h"
+#include "gc.h"
 #include "vclock.h" /* VCLOCK_MAX */
 
 struct vclock replicaset_vclock;
@@ -118,6 +119,7 @@ replica_new(const struct tt_uuid *uuid)
 	replica->uuid = *uuid;
 	replica->applier = NULL;
 	replica->relay = NULL;
+	replica->gc = NULL;
 	return replica;
 }
 
@@ -169,6 +171,14 @@ replica_clear_id(struct replica *replica)
 	 * replication.
 	 */
 	replica->id = REPLICA_ID_NIL;
+	/*
+	 * The replica has been dropped from _cluster - stop
+	 * retaining WALs on its behalf.
+	 */
+	if (replica->gc != NULL) {
+		gc_consumer_unregister(replica->gc);
+		replica->gc = NULL;
+	}
 	if (replica_is_orphan(replica)) {
 		replicaset_remove(&replicaset, replica);
 		replica_delete(replica);
@@ -86,6 +86,8 @@
 extern "C" {
 #endif /* defined(__cplusplus) */
 
+struct gc_consumer;
+
 void
 replication_init(void);
 
@@ -113,6 +115,13 @@ struct replica {
 	struct tt_uuid uuid;
 	struct applier *applier;
 	struct relay *relay;
+	/**
+	 * Garbage collection consumer retaining the WALs the
+	 * replica has not fetched yet, see gc_consumer_register().
+	 * Registered on the first subscription, dropped together
+	 * with the replica registration.
+	 */
+	struct gc_consumer *gc;
 	uint32_t id;
 };
 
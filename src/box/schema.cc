@@ -30,6 +30,7 @@
  */
 #include "schema.h"
 #include "user_def.h"
+#include "user.h" /* user_cache_version */
 #include "engine.h"
 #include "memtx_index.h"
 #include "func.h"
@@ -41,6 +42,7 @@
 #include "alter.h"
 #include "scoped_guard.h"
 #include <stdio.h>
+#include <stdlib.h>
 /**
  * @module Data Dictionary
  *
@@ -57,15 +59,168 @@
  */
 
 /** All existing spaces. */
-static struct mh_i32ptr_t *spaces;
-static struct mh_i32ptr_t *funcs;
+static struct mh_rh_i32ptr_t *spaces;
+static struct mh_rh_i32ptr_t *funcs;
 static struct mh_strnptr_t *funcs_by_name;
 uint32_t schema_version = 0;
+uint32_t func_cache_version = 0;
 /**
  * Lock of scheme modification
  */
 struct latch schema_lock = LATCH_INITIALIZER(schema_lock);
 
+/* {{{ Schema views - lock-free read-only snapshots. */
+
+/** The published view, swapped atomically on every DDL. */
+static struct schema_view *schema_view_current;
+/**
+ * Views which dropped to zero references, pushed by any cord,
+ * drained by the tx thread at the next publication.
+ */
+static struct schema_view *schema_view_retired;
+/** Free view buffers, tx thread only. */
+static struct schema_view *schema_view_pool;
+
+/**
+ * View buffers are recycled through the pool above and never
+ * returned to malloc while the server runs: a reader pinning a
+ * view races with its retirement, and type-stable memory makes
+ * the race benign - the retry loop in schema_view_get() detects
+ * that the view was republished or replaced and starts over.
+ * Capacities are rounded up to a power of two, so the pool holds
+ * O(log n) buffers, not one per DDL.
+ */
+static struct schema_view *
+schema_view_alloc(uint32_t count)
+{
+	/* Drain the retired views into the pool. */
+	struct schema_view *retired = __atomic_exchange_n(
+		&schema_view_retired, NULL, __ATOMIC_ACQUIRE);
+	while (retired != NULL) {
+		struct schema_view *next = retired->next_free;
+		retired->next_free = schema_view_pool;
+		schema_view_pool = retired;
+		retired = next;
+	}
+	struct schema_view **link = &schema_view_pool;
+	for (; *link != NULL; link = &(*link)->next_free) {
+		if ((*link)->space_capacity >= count) {
+			struct schema_view *view = *link;
+			*link = view->next_free;
+			return view;
+		}
+	}
+	uint32_t capacity = 8;
+	while (capacity < count)
+		capacity *= 2;
+	struct schema_view *view = (struct schema_view *)
+		malloc(sizeof(*view) + capacity * sizeof(view->spaces[0]));
+	if (view == NULL) {
+		panic_syserror("Out of memory for the data "
+			       "dictionary cache.");
+	}
+	view->refs = 0;
+	view->space_capacity = capacity;
+	return view;
+}
+
+static int
+schema_view_space_cmp(const void *a, const void *b)
+{
+	uint32_t ida = ((const struct schema_view_space *) a)->id;
+	uint32_t idb = ((const struct schema_view_space *) b)->id;
+	return ida < idb ? -1 : ida > idb;
+}
+
+/** Build and publish a fresh view of the space cache. */
+extern "C" void
+schema_view_publish(void)
+{
+	/*
+	 * The user cache comes up before the schema subsystem;
+	 * its early version bumps have nothing to publish yet.
+	 */
+	if (spaces == NULL)
+		return;
+	struct schema_view *view = schema_view_alloc(mh_size(spaces));
+	view->version = schema_version;
+	view->user_cache_version = user_cache_version;
+	view->space_count = 0;
+	mh_int_t i;
+	mh_rh_foreach(spaces, i) {
+		struct space *space = (struct space *)
+			mh_rh_i32ptr_node(spaces, i)->val;
+		struct schema_view_space *entry =
+			&view->spaces[view->space_count++];
+		entry->id = space_id(space);
+		entry->index_count = space->index_count;
+		entry->stale_ttl = space->def.opts.stale_read_ttl;
+		entry->space = space;
+	}
+	qsort(view->spaces, view->space_count, sizeof(view->spaces[0]),
+	      schema_view_space_cmp);
+	/*
+	 * The publisher's own reference; an atomic increment, not
+	 * an assignment, to leave the increment of a reader which
+	 * pinned this buffer in its previous life intact - such a
+	 * reader detects the republication and puts the reference
+	 * back.
+	 */
+	__atomic_add_fetch(&view->refs, 1, __ATOMIC_ACQ_REL);
+	struct schema_view *old = schema_view_current;
+	__atomic_store_n(&schema_view_current, view, __ATOMIC_RELEASE);
+	if (old != NULL)
+		schema_view_put(old);
+}
+
+extern "C" struct schema_view *
+schema_view_get(void)
+{
+	for (;;) {
+		struct schema_view *view = __atomic_load_n(
+			&schema_view_current, __ATOMIC_ACQUIRE);
+		__atomic_add_fetch(&view->refs, 1, __ATOMIC_ACQ_REL);
+		if (__atomic_load_n(&schema_view_current,
+				    __ATOMIC_ACQUIRE) == view)
+			return view;
+		/* Raced with a DDL publication - retry. */
+		schema_view_put(view);
+	}
+}
+
+extern "C" void
+schema_view_put(struct schema_view *view)
+{
+	if (__atomic_sub_fetch(&view->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	/* Push onto the retired stack, lock-free. */
+	struct schema_view *head = __atomic_load_n(&schema_view_retired,
+						   __ATOMIC_RELAXED);
+	do {
+		view->next_free = head;
+	} while (!__atomic_compare_exchange_n(&schema_view_retired, &head,
+					      view, false, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+extern "C" const struct schema_view_space *
+schema_view_find(const struct schema_view *view, uint32_t id)
+{
+	uint32_t low = 0, high = view->space_count;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (view->spaces[mid].id < id)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < view->space_count && view->spaces[low].id == id)
+		return &view->spaces[low];
+	return NULL;
+}
+
+/* }}} */
+
 bool
 space_is_system(struct space *space)
 {
@@ -77,10 +232,10 @@ space_is_system(struct space *space)
 extern "C" struct space *
 space_by_id(uint32_t id)
 {
-	mh_int_t space = mh_i32ptr_find(spaces, id, NULL);
+	mh_int_t space = mh_rh_i32ptr_find(spaces, id, NULL);
 	if (space == mh_end(spaces))
 		return NULL;
-	return (struct space *) mh_i32ptr_node(spaces, space)->val;
+	return (struct space *) mh_rh_i32ptr_node(spaces, space)->val;
 }
 
 /** Return current schema version */
@@ -126,8 +281,8 @@ space_foreach(void (*func)(struct space *sp, void *udata), void *udata)
 		}
 	}
 
-	mh_foreach(spaces, i) {
-		space = (struct space *) mh_i32ptr_node(spaces, i)->val;
+	mh_rh_foreach(spaces, i) {
+		space = (struct space *) mh_rh_i32ptr_node(spaces, i)->val;
 		if (space_is_system(space))
 			continue;
 		func(space, udata);
@@ -140,11 +295,12 @@ space_cache_delete(uint32_t id)
 {
 	if (tarantool_L)
 		box_lua_space_delete(tarantool_L, id);
-	mh_int_t k = mh_i32ptr_find(spaces, id, NULL);
+	mh_int_t k = mh_rh_i32ptr_find(spaces, id, NULL);
 	assert(k != mh_end(spaces));
-	struct space *space = (struct space *)mh_i32ptr_node(spaces, k)->val;
-	mh_i32ptr_del(spaces, k, NULL);
+	struct space *space = (struct space *)mh_rh_i32ptr_node(spaces, k)->val;
+	mh_rh_i32ptr_del(spaces, k, NULL);
 	schema_version++;
+	schema_view_publish();
 	return space;
 }
 
@@ -157,12 +313,13 @@ space_cache_replace(struct space *space)
 {
 	const struct mh_i32ptr_node_t node = { space_id(space), space };
 	struct mh_i32ptr_node_t old, *p_old = &old;
-	mh_int_t k = mh_i32ptr_put(spaces, &node, &p_old, NULL);
+	mh_int_t k = mh_rh_i32ptr_put(spaces, &node, &p_old, NULL);
 	if (k == mh_end(spaces)) {
 		panic_syserror("Out of memory for the data "
 			       "dictionary cache.");
 	}
 	schema_version++;
+	schema_view_publish();
 	/*
 	 * Must be after the space is put into the hash, since
 	 * box.schema.space.bless() uses hash look up to find the
@@ -236,9 +393,11 @@ void
 schema_init()
 {
 	/* Initialize the space cache. */
-	spaces = mh_i32ptr_new();
-	funcs = mh_i32ptr_new();
+	spaces = mh_rh_i32ptr_new();
+	funcs = mh_rh_i32ptr_new();
 	funcs_by_name = mh_strnptr_new();
+	/* An empty view, so schema_view_get() never sees NULL. */
+	schema_view_publish();
 	/*
 	 * Create surrogate space objects for the mandatory system
 	 * spaces (the primal eggs from which we get all the
@@ -252,7 +411,7 @@ schema_init()
 	/* _schema - key/value space with schema description */
 	struct space_def def = {
 		BOX_SCHEMA_ID, ADMIN, 0, "_schema", "memtx",
-		{false, NULL}
+		space_opts_default
 	};
 	struct index_opts opts = index_opts_default;
 	struct index_def *index_def = index_def_new(def.id,
@@ -329,22 +488,42 @@ schema_free(void)
 	if (spaces == NULL)
 		return;
 	while (mh_size(spaces) > 0) {
-		mh_int_t i = mh_first(spaces);
+		mh_int_t i = mh_rh_first(spaces);
 
 		struct space *space = (struct space *)
-				mh_i32ptr_node(spaces, i)->val;
+				mh_rh_i32ptr_node(spaces, i)->val;
 		space_cache_delete(space_id(space));
 		space_delete(space);
 	}
-	mh_i32ptr_delete(spaces);
+	mh_rh_i32ptr_delete(spaces);
 	while (mh_size(funcs) > 0) {
-		mh_int_t i = mh_first(funcs);
+		mh_int_t i = mh_rh_first(funcs);
 
 		struct func *func = ((struct func *)
-				     mh_i32ptr_node(funcs, i)->val);
+				     mh_rh_i32ptr_node(funcs, i)->val);
 		func_cache_delete(func->def.fid);
 	}
-	mh_i32ptr_delete(funcs);
+	mh_rh_i32ptr_delete(funcs);
+	/*
+	 * Release the published view and free every view buffer;
+	 * by now all cords which could hold a view are gone.
+	 */
+	if (schema_view_current != NULL) {
+		schema_view_put(schema_view_current);
+		schema_view_current = NULL;
+	}
+	struct schema_view *retired = __atomic_exchange_n(
+		&schema_view_retired, NULL, __ATOMIC_ACQUIRE);
+	while (retired != NULL) {
+		struct schema_view *next = retired->next_free;
+		free(retired);
+		retired = next;
+	}
+	while (schema_view_pool != NULL) {
+		struct schema_view *next = schema_view_pool->next_free;
+		free(schema_view_pool);
+		schema_view_pool = next;
+	}
 }
 
 void
@@ -353,6 +532,7 @@ func_cache_replace(struct func_def *def)
 	struct func *old = func_by_id(def->fid);
 	if (old) {
 		func_update(old, def);
+		func_cache_version++;
 		return;
 	}
 	if (mh_size(funcs) >= BOX_FUNCTION_MAX)
@@ -364,7 +544,7 @@ error:
 			       "dictionary cache (stored function).");
 	}
 	const struct mh_i32ptr_node_t node = { def->fid, func };
-	mh_int_t k1 = mh_i32ptr_put(funcs, &node, NULL, NULL);
+	mh_int_t k1 = mh_rh_i32ptr_put(funcs, &node, NULL, NULL);
 	if (k1 == mh_end(funcs)) {
 		func_delete(func);
 		goto error;
@@ -376,35 +556,37 @@ error:
 
 	mh_int_t k2 = mh_strnptr_put(funcs_by_name, &strnode, NULL, NULL);
 	if (k2 == mh_end(funcs_by_name)) {
-		mh_i32ptr_del(funcs, k1, NULL);
+		mh_rh_i32ptr_del(funcs, k1, NULL);
 		func_delete(func);
 		goto error;
 	}
+	func_cache_version++;
 }
 
 void
 func_cache_delete(uint32_t fid)
 {
-	mh_int_t k = mh_i32ptr_find(funcs, fid, NULL);
+	mh_int_t k = mh_rh_i32ptr_find(funcs, fid, NULL);
 	if (k == mh_end(funcs))
 		return;
 	struct func *func = (struct func *)
-		mh_i32ptr_node(funcs, k)->val;
-	mh_i32ptr_del(funcs, k, NULL);
+		mh_rh_i32ptr_node(funcs, k)->val;
+	mh_rh_i32ptr_del(funcs, k, NULL);
 	k = mh_strnptr_find_inp(funcs_by_name, func->def.name,
 				strlen(func->def.name));
 	if (k != mh_end(funcs))
 		mh_strnptr_del(funcs_by_name, k, NULL);
 	func_delete(func);
+	func_cache_version++;
 }
 
 struct func *
 func_by_id(uint32_t fid)
 {
-	mh_int_t func = mh_i32ptr_find(funcs, fid, NULL);
+	mh_int_t func = mh_rh_i32ptr_find(funcs, fid, NULL);
 	if (func == mh_end(funcs))
 		return NULL;
-	return (struct func *) mh_i32ptr_node(funcs, func)->val;
+	return (struct func *) mh_rh_i32ptr_node(funcs, func)->val;
 }
 
 struct func *
@@ -68,6 +68,102 @@ enum {
 #include <stdint.h>
 
 extern uint32_t schema_version;
+/**
+ * Incremented whenever a stored function is created, updated or
+ * dropped. Lets callers cache resolved struct func pointers and
+ * invalidate the whole cache with one comparison instead of
+ * re-running the name hash lookup on every call.
+ */
+extern uint32_t func_cache_version;
+
+struct space;
+
+/** One space in a schema view, see struct schema_view. */
+struct schema_view_space {
+	/** Space id. */
+	uint32_t id;
+	/** The number of enabled indexes. */
+	uint32_t index_count;
+	/**
+	 * Staleness budget of the net-thread select cache, copied
+	 * from space_opts::stale_read_ttl; 0 - stale reads are
+	 * disabled for the space.
+	 */
+	double stale_ttl;
+	/**
+	 * The space object. Safe to dereference in the tx thread
+	 * only: the object dies on the next DDL, while the view
+	 * may outlive it in another cord. Other cords may use
+	 * the plain fields above.
+	 */
+	struct space *space;
+};
+
+/**
+ * An immutable snapshot of the space directory. A fresh view is
+ * built and published on every DDL change; readers in any cord
+ * pin the current view with schema_view_get() and read it
+ * without locks, which allows e.g. the net threads to
+ * pre-resolve space ids of incoming requests before they reach
+ * the tx thread. A pinned view is a consistent, possibly stale,
+ * directory: the view a reader holds tells what the schema
+ * looked like at version view->version.
+ */
+struct schema_view {
+	/** Reference count; atomic, do not touch directly. */
+	int refs;
+	/** Value of schema_version the view was built at. */
+	uint32_t version;
+	/**
+	 * Value of user_cache_version the view was built at.
+	 * Lets other cords detect user and privilege changes the
+	 * same way view->version lets them detect DDL.
+	 */
+	uint32_t user_cache_version;
+	/** The number of entries in spaces[]. */
+	uint32_t space_count;
+	/** Allocated capacity of spaces[], entries. */
+	uint32_t space_capacity;
+	/** Link in the free buffer stash of schema.cc. */
+	struct schema_view *next_free;
+	/** The spaces, sorted by id. */
+	struct schema_view_space spaces[];
+};
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Pin and return the current schema view. Lock-free, callable
+ * from any cord once the schema subsystem is initialized. Must
+ * be paired with schema_view_put().
+ */
+struct schema_view *
+schema_view_get(void);
+
+/** Release a view pinned with schema_view_get(). */
+void
+schema_view_put(struct schema_view *view);
+
+/**
+ * Look up a space in a view by id.
+ * @retval NULL The view knows no such space.
+ */
+const struct schema_view_space *
+schema_view_find(const struct schema_view *view, uint32_t id);
+
+/**
+ * Rebuild and publish a fresh view. Called after every change to
+ * the state the view mirrors: space DDL and user cache version
+ * bumps. A no-op before the schema subsystem is initialized.
+ */
+void
+schema_view_publish(void);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
 
 #if defined(__cplusplus)
 
@@ -37,6 +37,7 @@
 #include "trigger.h"
 #include "random.h"
 #include "user.h"
+#include "error.h"
 
 static struct mh_i64ptr_t *session_registry;
 
@@ -84,6 +85,8 @@ session_create(int fd)
 	session->id = sid_max();
 	session->fd =  fd;
 	session->sync = 0;
+	session->deadline = 0;
+	session->request_timeout = 0;
 	/* For on_connect triggers. */
 	credentials_init(&session->credentials, guest_user->auth_token,
 			 guest_user->def.uid);
@@ -187,6 +190,12 @@ session_destroy(struct session *session)
 	mempool_free(&session_pool, session);
 }
 
+void
+session_deadline_diag(void)
+{
+	diag_set(ClientError, ER_DEADLINE_EXCEEDED);
+}
+
 struct session *
 session_find(uint64_t sid)
 {
@@ -73,6 +73,19 @@ struct session {
 	 * the first yield.
 	 */
 	uint64_t sync;
+	/**
+	 * Absolute deadline of the current request (event loop
+	 * time), 0 if none. Armed at the start of every iproto
+	 * request from request_timeout, or explicitly with
+	 * box.session.set_deadline().
+	 */
+	double deadline;
+	/**
+	 * Default per-request timeout, in seconds. When positive,
+	 * every iproto request of this session starts with
+	 * deadline = now + request_timeout.
+	 */
+	double request_timeout;
 	/** Authentication salt. */
 	char salt[SESSION_SEED_SIZE];
 	/** Cached user id and global grants */
@@ -115,6 +128,30 @@ fiber_set_session(struct fiber *fiber, struct session *session)
 	fiber_set_key(fiber, FIBER_KEY_SESSION, session);
 }
 
+/**
+ * Set the diag to ER_DEADLINE_EXCEEDED. Kept out of line so that
+ * the inline check below stays a couple of comparisons.
+ */
+void
+session_deadline_diag(void);
+
+/**
+ * Check whether the current request of @a session has run past
+ * its deadline. Cheap enough (a load and a comparison in the
+ * common case) to be called from iterator loops.
+ * @retval 0 no deadline is set or it has not been reached.
+ * @retval -1 deadline exceeded, diag is set.
+ */
+static inline int
+session_check_deadline(struct session *session)
+{
+	if (session == NULL || session->deadline == 0 ||
+	    fiber_time() <= session->deadline)
+		return 0;
+	session_deadline_diag();
+	return -1;
+}
+
 static inline void
 credentials_init(struct credentials *cr, uint8_t auth_token, uint32_t uid)
 {
@@ -126,12 +126,13 @@ space_new(struct space_def *def, struct rlist *key_list)
 	rlist_foreach_entry(index_def, key_list, link) {
 		keys[key_no++] = &index_def->key_def;
 	}
-	space->format = tuple_format_new(engine->format, keys, index_count, 0);
+	space->format = tuple_format_new(engine->format, keys, index_count, 0,
+					 def->exact_field_count,
+					 (uint32_t) def->opts.min_field_count);
 	if (space->format == NULL)
 		diag_raise();
 	space->has_unique_secondary_key = has_unique_secondary_key;
 	tuple_format_ref(space->format, 1);
-	space->format->exact_field_count = def->exact_field_count;
 	space->index_id_max = index_id_max;
 	/* init space engine instance */
 	space->handler = engine->open();
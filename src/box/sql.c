@@ -48,10 +48,13 @@
 #include "index.h"
 #include "schema.h"
 #include "box.h"
+#include "txn.h"
 #include "key_def.h"
 #include "tuple.h"
 #include "fiber.h"
+#include "coeio.h"
 #include "small/region.h"
+#include <pthread.h>
 
 static sqlite3 *db;
 
@@ -72,9 +75,13 @@ sql_init()
 	assert(db != NULL);
 }
 
+static void
+sql_stmt_cache_reset();
+
 void
 sql_free()
 {
+	sql_stmt_cache_reset();
 	sqlite3_close(db); db = NULL;
 }
 
@@ -84,6 +91,205 @@ sql_get()
 	return db;
 }
 
+/*********************************************************************
+ * Worker threads for the sorter (vdbesort.c).
+ *
+ * The sorter tasks are self-contained: they sort and spill
+ * serialized records and never call back into box, so they can
+ * run on plain pthreads next to the tx thread. The join is
+ * routed through coeio so that the tx fiber yields while a sort
+ * finishes instead of stalling the event loop in pthread_join().
+ */
+
+struct SQLiteThread {
+	pthread_t id;
+	/* Fallback when thread creation fails: run at join time. */
+	void *(*task)(void *);
+	void *arg;
+	/* True if the pthread was actually started. */
+	int created;
+};
+
+int
+sqlite3ThreadCreate(SQLiteThread **out, void *(*task)(void *), void *arg)
+{
+	struct SQLiteThread *t = malloc(sizeof(*t));
+	if (t == NULL) {
+		*out = NULL;
+		return SQLITE_NOMEM;
+	}
+	t->task = task;
+	t->arg = arg;
+	t->created = pthread_create(&t->id, NULL, task, arg) == 0;
+	*out = t;
+	return SQLITE_OK;
+}
+
+static ssize_t
+sql_thread_join_cb(va_list ap)
+{
+	struct SQLiteThread *t = va_arg(ap, struct SQLiteThread *);
+	void **ret = va_arg(ap, void **);
+	return pthread_join(t->id, ret) == 0 ? 0 : -1;
+}
+
+int
+sqlite3ThreadJoin(SQLiteThread *t, void **ret)
+{
+	if (t == NULL)
+		return SQLITE_NOMEM;
+	int rc = SQLITE_OK;
+	if (t->created) {
+		if (box_txn()) {
+			/*
+			 * coio_call() yields, and memtx rolls multi-
+			 * statement transactions back on a yield. Block
+			 * the tx thread instead: the sorter thread has
+			 * been told to stop and winds down promptly.
+			 */
+			if (pthread_join(t->id, ret) != 0)
+				rc = SQLITE_ERROR;
+		} else if (coio_call(sql_thread_join_cb, t, ret) != 0) {
+			rc = SQLITE_ERROR;
+		}
+	} else {
+		/* The thread never started - run the task inline. */
+		*ret = t->task(t->arg);
+	}
+	free(t);
+	return rc;
+}
+
+/*********************************************************************
+ * Prepared statement cache, see the comment in sql.h.
+ *
+ * The cache is direct-mapped: a slot holds at most one idle
+ * statement and an insert evicts the previous occupant. All
+ * access happens in the tx thread and entries are removed while
+ * in use, so no locking is needed. Statements prepared with the
+ * _v2 interface recompile themselves when the schema changes, so
+ * a cached program can not go stale.
+ */
+
+enum {
+	SQL_STMT_CACHE_SIZE = 64,
+};
+
+struct sql_stmt_cache_entry {
+	/* Statement text, the cache key. NULL if the slot is free. */
+	char *sql;
+	int len;
+	/* Input bytes the prepare of this statement consumed. */
+	int consumed;
+	/* The idle compiled statement. */
+	sqlite3_stmt *stmt;
+};
+
+static struct sql_stmt_cache_entry sql_stmt_cache[SQL_STMT_CACHE_SIZE];
+
+static struct sql_stmt_cache_entry *
+sql_stmt_cache_slot(const char *sql, int len)
+{
+	uint32_t hash = 5381;
+	for (int i = 0; i < len; i++)
+		hash = hash * 33 ^ (uint8_t)sql[i];
+	return &sql_stmt_cache[hash % SQL_STMT_CACHE_SIZE];
+}
+
+sqlite3_stmt *
+sql_stmt_cache_get(const char *sql, int len, int *consumed)
+{
+	struct sql_stmt_cache_entry *e = sql_stmt_cache_slot(sql, len);
+	if (e->sql == NULL || e->len != len ||
+	    memcmp(e->sql, sql, len) != 0)
+		return NULL;
+	sqlite3_stmt *stmt = e->stmt;
+	sqlite3_reset(stmt);
+	free(e->sql);
+	e->sql = NULL;
+	e->stmt = NULL;
+	*consumed = e->consumed;
+	return stmt;
+}
+
+void
+sql_stmt_cache_put(const char *sql, int len, int consumed,
+		   sqlite3_stmt *stmt)
+{
+	struct sql_stmt_cache_entry *e = sql_stmt_cache_slot(sql, len);
+	char *key = malloc(len);
+	if (key == NULL) {
+		/* Out of memory - live without the caching. */
+		sqlite3_finalize(stmt);
+		return;
+	}
+	memcpy(key, sql, len);
+	if (e->sql != NULL) {
+		/* Evict the previous occupant of the slot. */
+		sqlite3_finalize(e->stmt);
+		free(e->sql);
+	}
+	e->sql = key;
+	e->len = len;
+	e->consumed = consumed;
+	e->stmt = stmt;
+}
+
+static void
+sql_stmt_cache_reset()
+{
+	for (int i = 0; i < SQL_STMT_CACHE_SIZE; i++) {
+		struct sql_stmt_cache_entry *e = &sql_stmt_cache[i];
+		if (e->sql == NULL)
+			continue;
+		sqlite3_finalize(e->stmt);
+		free(e->sql);
+		e->sql = NULL;
+		e->stmt = NULL;
+	}
+}
+
+/*
+ * Runtime vdbe profiler. The counters themselves live in the
+ * vdbe (sqlite3VdbeProfiler*, see sql/global.c); these accessors
+ * keep the Lua module free of sqlite internals.
+ */
+
+void
+sql_vdbe_profiler_enable(bool enable)
+{
+	if (enable && !sqlite3VdbeProfilerOn) {
+		memset(sqlite3VdbeProfilerCnt, 0,
+		       sizeof(sqlite3VdbeProfilerCnt));
+		memset(sqlite3VdbeProfilerCycles, 0,
+		       sizeof(sqlite3VdbeProfilerCycles));
+	}
+	sqlite3VdbeProfilerOn = enable;
+}
+
+bool
+sql_vdbe_profiler_is_enabled(void)
+{
+	return sqlite3VdbeProfilerOn;
+}
+
+int
+sql_vdbe_profiler_stat(int opcode, const char **name, uint64_t *count,
+		       uint64_t *cycles)
+{
+	if (opcode < 0 || opcode > 255)
+		return -1;
+	*count = sqlite3VdbeProfilerCnt[opcode];
+	*cycles = sqlite3VdbeProfilerCycles[opcode];
+	/*
+	 * sqlite3OpcodeName() indexes a table sized to the largest
+	 * defined opcode without a bounds check; an opcode number
+	 * that never executed may not have a name at all.
+	 */
+	*name = *count != 0 ? sqlite3OpcodeName(opcode) : NULL;
+	return 0;
+}
+
 /*********************************************************************
  * SQLite cursor implementation on top of Tarantool storage API-s.
  * See the corresponding SQLite function in btree.c for documentation.
@@ -135,11 +341,30 @@ sql_get()
  * Tarantool iterator API was apparently designed by space aliens.
  * This wrapper is necessary for interfacing with the SQLite btree code.
  */
+enum {
+	/* Max comparisons pushed down to one cursor. */
+	TA_CURSOR_FILTER_MAX = 4,
+};
+
+/*
+ * A pushed-down comparison: tuple field <op> numeric constant.
+ * See tarantoolSqlite3CursorFilter().
+ */
+struct ta_filter {
+	uint32_t fieldno;
+	int op;          /* enum ta_filter_op */
+	int rhs_is_int;  /* 1 - rhs_i is valid, 0 - rhs_r */
+	int64_t rhs_i;
+	double rhs_r;
+};
+
 struct ta_cursor {
 	size_t             size;
 	box_iterator_t    *iter;
 	struct tuple      *tuple_last;
 	enum iterator_type type;
+	uint32_t           filter_count;
+	struct ta_filter   filter[TA_CURSOR_FILTER_MAX];
 	char               key[1];
 };
 
@@ -158,6 +383,46 @@ const char *tarantoolErrorMessage()
 	return box_error_message(box_error_last());
 }
 
+int tarantoolSqlite3TxnBegin(int iTable)
+{
+	uint32_t space_id = SQLITE_PAGENO_TO_SPACEID(iTable);
+	/* DDL: system spaces do not support multi-statement
+	 * transactions, and DDL statements write nothing else. */
+	if (space_id <= BOX_SYSTEM_ID_MAX)
+		return 0;
+	/* An explicit outer transaction already does the batching. */
+	if (box_txn())
+		return 0;
+	/* If the transaction can not be started, simply live
+	 * without the batching. */
+	if (box_txn_begin() != 0)
+		return 0;
+	return 1;
+}
+
+int tarantoolSqlite3TxnCommit()
+{
+	if (!box_txn()) {
+		/* The batch was rolled back behind our back - memtx
+		 * aborts a transaction when the fiber yields. The
+		 * rows written before the yield are gone; committing
+		 * "successfully" would lose them silently. */
+		box_error_set(__FILE__, __LINE__, ER_NO_ACTIVE_TRANSACTION,
+			      "the transaction batching statement writes "
+			      "was aborted by a fiber yield");
+		return SQLITE_TARANTOOL_ERROR;
+	}
+	if (box_txn_commit() != 0)
+		return SQLITE_TARANTOOL_ERROR;
+	return SQLITE_OK;
+}
+
+int tarantoolSqlite3TxnRollback()
+{
+	box_txn_rollback();
+	return SQLITE_OK;
+}
+
 int tarantoolSqlite3CloseCursor(BtCursor *pCur)
 {
 	assert(pCur->curFlags & BTCF_TaCursor);
@@ -307,6 +572,17 @@ int tarantoolSqlite3Count(BtCursor *pCur, i64 *pnEntry)
 	return SQLITE_OK;
 }
 
+LogEst tarantoolSqlite3PageRowEst(int pageNo)
+{
+	if (pageNo <= 0)
+		return -1;
+	ssize_t len = box_index_len(SQLITE_PAGENO_TO_SPACEID(pageNo),
+				    SQLITE_PAGENO_TO_INDEXID(pageNo));
+	if (len < 0)
+		return -1;
+	return sqlite3LogEst((u64)len);
+}
+
 int tarantoolSqlite3Insert(BtCursor *pCur, const BtreePayload *pX)
 {
 	assert(pCur->curFlags & BTCF_TaCursor);
@@ -536,11 +812,144 @@ cursor_create(struct ta_cursor *c, size_t key_size)
 		if (!c) {
 			res->iter = NULL;
 			res->tuple_last = NULL;
+			res->filter_count = 0;
 		}
 	}
 	return res;
 }
 
+/*
+ * Exact comparison of an integer with a double, following the
+ * same rules as the vdbe comparators (see sqlite3IntFloatCompare
+ * in vdbeaux.c): a plain double cast of the integer would lose
+ * precision above 2^53 and could make the filter skip a matching
+ * row.
+ */
+static int
+ta_cmp_int_double(int64_t i, double r)
+{
+	if (r < -9223372036854775808.0)
+		return 1;
+	if (r > 9223372036854775807.0)
+		return -1;
+	int64_t y = (int64_t)r;
+	if (i < y)
+		return -1;
+	if (i > y)
+		return 1;
+	double s = (double)i;
+	if (s < r)
+		return -1;
+	if (s > r)
+		return 1;
+	return 0;
+}
+
+/*
+ * Check the pushed-down comparisons against a tuple.
+ * @retval 1 the tuple may match
+ * @retval 0 the tuple can not match
+ * Undecidable fields (missing or non-numeric) pass: the bytecode
+ * test coded above the cursor stays authoritative.
+ */
+static int
+ta_filter_match(const struct ta_cursor *c, struct tuple *tuple)
+{
+	for (uint32_t k = 0; k < c->filter_count; k++) {
+		const struct ta_filter *f = &c->filter[k];
+		const char *field = box_tuple_field(tuple, f->fieldno);
+		if (field == NULL)
+			continue;
+		int64_t fi = 0;
+		double fr = 0;
+		int f_is_int;
+		switch (mp_typeof(*field)) {
+		case MP_UINT: {
+			uint64_t u = mp_decode_uint(&field);
+			if (u > INT64_MAX)
+				continue;
+			fi = (int64_t)u;
+			f_is_int = 1;
+			break;
+		}
+		case MP_INT:
+			fi = mp_decode_int(&field);
+			f_is_int = 1;
+			break;
+		case MP_FLOAT:
+			fr = mp_decode_float(&field);
+			f_is_int = 0;
+			break;
+		case MP_DOUBLE:
+			fr = mp_decode_double(&field);
+			f_is_int = 0;
+			break;
+		default:
+			continue;
+		}
+		int cmp;
+		if (f_is_int && f->rhs_is_int)
+			cmp = fi < f->rhs_i ? -1 : fi > f->rhs_i;
+		else if (f_is_int)
+			cmp = ta_cmp_int_double(fi, f->rhs_r);
+		else if (f->rhs_is_int)
+			cmp = -ta_cmp_int_double(f->rhs_i, fr);
+		else
+			cmp = fr < f->rhs_r ? -1 : fr > f->rhs_r;
+		int match;
+		switch (f->op) {
+		case TA_FILTER_LT: match = cmp < 0; break;
+		case TA_FILTER_LE: match = cmp <= 0; break;
+		case TA_FILTER_EQ: match = cmp == 0; break;
+		case TA_FILTER_NE: match = cmp != 0; break;
+		case TA_FILTER_GE: match = cmp >= 0; break;
+		case TA_FILTER_GT: match = cmp > 0; break;
+		default: match = 1; break;
+		}
+		if (!match)
+			return 0;
+	}
+	return 1;
+}
+
+int tarantoolSqlite3CursorFilter(BtCursor *pCur, int iField, int op,
+				 sqlite3_value *pVal)
+{
+	assert(pCur->curFlags & BTCF_TaCursor);
+
+	struct ta_cursor *c = pCur->pTaCursor;
+	struct ta_filter f;
+
+	/* The cursor is created by the seek preceding the loop
+	 * body; without one there is nothing to filter. */
+	if (c == NULL)
+		return SQLITE_OK;
+	if (pVal->flags & MEM_Int) {
+		f.rhs_is_int = 1;
+		f.rhs_i = pVal->u.i;
+		f.rhs_r = 0;
+	} else if (pVal->flags & MEM_Real) {
+		f.rhs_is_int = 0;
+		f.rhs_i = 0;
+		f.rhs_r = pVal->u.r;
+	} else {
+		return SQLITE_OK;
+	}
+	f.fieldno = iField;
+	f.op = op;
+	/* Refresh an already installed comparison in place. */
+	for (uint32_t k = 0; k < c->filter_count; k++) {
+		if (c->filter[k].fieldno == f.fieldno &&
+		    c->filter[k].op == f.op) {
+			c->filter[k] = f;
+			return SQLITE_OK;
+		}
+	}
+	if (c->filter_count < TA_CURSOR_FILTER_MAX)
+		c->filter[c->filter_count++] = f;
+	return SQLITE_OK;
+}
+
 /* Cursor positioning. */
 static int
 cursor_seek(BtCursor *pCur, int *pRes, enum iterator_type type,
@@ -553,12 +962,6 @@ cursor_seek(BtCursor *pCur, int *pRes, enum iterator_type type,
 	uint32_t index_id = SQLITE_PAGENO_TO_INDEXID(pCur->pgnoRoot);
 	size_t key_size = 0;
 
-	/* Close existing iterator, if any */
-	if (c && c->iter) {
-		box_iterator_free(c->iter);
-		c->iter = NULL;
-	}
-
 	/* Allocate or grow cursor if needed. */
 	if (type == ITER_EQ || type == ITER_REQ) {
 		key_size = (size_t)(ke - k);
@@ -577,11 +980,31 @@ cursor_seek(BtCursor *pCur, int *pRes, enum iterator_type type,
 		k = c->key;
 	}
 
+	/* Re-seek the existing iterator in place when possible:
+	 * a cursor is bound to one index, so re-seeks are frequent
+	 * and the free + alloc round-trip per lookup dominates
+	 * point queries. */
+	if (c->iter) {
+		switch (box_iterator_reset(c->iter, type, k, ke)) {
+		case 0:
+			goto positioned;
+		case 1:
+			/* DDL made the iterator stale - recreate. */
+			box_iterator_free(c->iter);
+			c->iter = NULL;
+			break;
+		default:
+			pCur->eState = CURSOR_INVALID;
+			return SQLITE_TARANTOOL_ERROR;
+		}
+	}
+
 	c->iter = box_index_iterator(space_id, index_id, type, k, ke);
 	if (c->iter == NULL) {
 		pCur->eState = CURSOR_INVALID;
 		return SQLITE_TARANTOOL_ERROR;
 	}
+positioned:
 	c->type = type;
 	pCur->eState = CURSOR_VALID;
 	pCur->curIntKey = 0;
@@ -601,9 +1024,14 @@ cursor_advance(BtCursor *pCur, int *pRes)
 	assert(c);
 	assert(c->iter);
 
-	rc = box_iterator_next(c->iter, &tuple);
-	if (rc)
-		return SQLITE_TARANTOOL_ERROR;
+	/* Rows rejected by the pushed-down comparisons are skipped
+	 * right here, without surfacing into the vdbe. */
+	do {
+		rc = box_iterator_next(c->iter, &tuple);
+		if (rc)
+			return SQLITE_TARANTOOL_ERROR;
+	} while (tuple != NULL && c->filter_count != 0 &&
+		 !ta_filter_match(c, tuple));
 	if (c->tuple_last) box_tuple_unref(c->tuple_last);
 	if (tuple) {
 		box_tuple_ref(tuple);
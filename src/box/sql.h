@@ -31,6 +31,9 @@
  * SUCH DAMAGE.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -55,6 +58,64 @@ sql_free();
 struct sqlite3 *
 sql_get();
 
+struct sqlite3_stmt;
+
+/*
+ * Prepared statement cache.
+ *
+ * Preparing a statement runs the full SQL parser and planner;
+ * for a workload which keeps issuing the same statement texts
+ * this dominates execution. The cache keeps finished statements
+ * keyed by their text, so a repeated text gets the compiled vdbe
+ * program back instead of a reparse. Statements handed out by
+ * sql_stmt_cache_get() are removed from the cache for the
+ * duration of use, so concurrent fibers running the same text
+ * simply miss and prepare their own copy.
+ */
+
+/*
+ * Look up a cached statement for the SQL text [sql, sql + len).
+ * A multi-statement text is keyed by its remaining tail, the way
+ * sqlite3_prepare_v2() consumes it statement by statement.
+ * On a hit the statement is reset, removed from the cache and
+ * *consumed is set to the number of key bytes the statement
+ * covers. Returns NULL on a miss.
+ */
+struct sqlite3_stmt *
+sql_stmt_cache_get(const char *sql, int len, int *consumed);
+
+/*
+ * Return a statement to the cache, taking ownership: the
+ * statement is either kept for reuse or finalized. @a sql, @a
+ * len and @a consumed must match the sql_stmt_cache_get() call
+ * or the prepare that created the statement.
+ */
+void
+sql_stmt_cache_put(const char *sql, int len, int consumed,
+		   struct sqlite3_stmt *stmt);
+
+/*
+ * Runtime vdbe profiler, serving box.sql.debug(): while enabled,
+ * the bytecode interpreter attributes execution counts and cpu
+ * cycles to every opcode, showing where a slow query actually
+ * spends its time. Enabling resets the accumulated counters;
+ * disabling keeps them around for reading.
+ */
+void
+sql_vdbe_profiler_enable(bool enable);
+
+bool
+sql_vdbe_profiler_is_enabled(void);
+
+/*
+ * Fetch the accumulated stat of one opcode. Returns 0 and fills
+ * the out parameters for @a opcode in [0, 255], -1 otherwise.
+ * Opcodes that never executed report a zero count.
+ */
+int
+sql_vdbe_profiler_stat(int opcode, const char **name, uint64_t *count,
+		       uint64_t *cycles);
+
 #if defined(__cplusplus)
 } /* extern "C" { */
 #endif
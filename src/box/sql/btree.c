@@ -4247,6 +4247,20 @@ int sqlite3BtreeCloseCursor(BtCursor *pCur){
   return SQLITE_OK;
 }
 
+/*
+** Install an advisory "field iField <op> pVal" filter on the cursor.
+** The storage layer may use it to skip rows that can not possibly
+** match; rows it can not decide on are passed through, so whatever
+** test generated the filter must still be applied above the cursor.
+** Cursors not backed by Tarantool ignore the hint.
+*/
+int sqlite3BtreeFilter(BtCursor *pCur, int iField, int op, sqlite3_value *pVal){
+  if( pCur->curFlags & BTCF_TaCursor ){
+    return tarantoolSqlite3CursorFilter(pCur, iField, op, pVal);
+  }
+  return SQLITE_OK;
+}
+
 /*
 ** Make sure the BtCursor* given in the argument has a valid
 ** BtCursor.info structure.  If it is not already valid, call
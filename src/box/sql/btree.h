@@ -238,6 +238,7 @@ void sqlite3BtreeCursorHint(BtCursor*, int, ...);
 #endif
 
 int sqlite3BtreeCloseCursor(BtCursor*);
+int sqlite3BtreeFilter(BtCursor*, int iField, int op, sqlite3_value *pVal);
 int sqlite3BtreeMovetoUnpacked(
   BtCursor*,
   UnpackedRecord *pUnKey,
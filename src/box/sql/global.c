@@ -273,6 +273,17 @@ int sqlite3PendingByte = 0x40000000;
 */
 const unsigned char sqlite3OpcodeProperty[] = OPFLG_INITIALIZER;
 
+/*
+** Runtime vdbe profiler: per-opcode execution counts and cycle
+** sums, collected by sqlite3VdbeExec() whenever
+** sqlite3VdbeProfilerOn is set and read back via box.sql.debug().
+** SQL statements only ever run in the tx thread, so plain
+** variables suffice.
+*/
+int sqlite3VdbeProfilerOn = 0;
+u64 sqlite3VdbeProfilerCnt[256];
+u64 sqlite3VdbeProfilerCycles[256];
+
 /*
 ** Name of the default collating sequence
 */
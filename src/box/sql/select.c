@@ -757,10 +757,26 @@ static void selectInnerLoop(
         }
       }
       regOrig = 0;
-      assert( eDest==SRT_Set || eDest==SRT_Mem 
+      assert( eDest==SRT_Set || eDest==SRT_Mem
            || eDest==SRT_Coroutine || eDest==SRT_Output );
     }
+    i = sqlite3VdbeCurrentAddr(v);
     nResultCol = sqlite3ExprCodeExprList(pParse,pEList,regResult,0,ecelFlags);
+    if( eDest==SRT_Output && pSort==0 && hasDistinct==0 ){
+      /* The values flow straight into the OP_ResultRow below and no
+      ** cursor moves in between, so plain column fetches may leave
+      ** strings and blobs as references into the row instead of
+      ** copying them out (see OPFLAG_EPHEM in OP_Column).  */
+      int iAddr;
+      for(iAddr=i; iAddr<sqlite3VdbeCurrentAddr(v); iAddr++){
+        VdbeOp *pOp = sqlite3VdbeGetOp(v, iAddr);
+        if( pOp->opcode==OP_Column
+         && pOp->p3>=regResult && pOp->p3<regResult+nResultCol
+        ){
+          pOp->p5 |= OPFLAG_EPHEM;
+        }
+      }
+    }
   }
 
   /* If the DISTINCT keyword was present on the SELECT statement
@@ -5324,6 +5340,13 @@ int sqlite3Select(
       int addrSortingIdx; /* The OP_OpenEphemeral for the sorting index */
       int addrReset;      /* Subroutine for resetting the accumulator */
       int regReset;       /* Return address register for reset subroutine */
+      int nGroupPrefix = 0; /* GROUP BY prefix already ordered by the source */
+      int iPMem = 0;      /* First register holding the previous prefix */
+      int regPrefixFlag;  /* True once iPMem holds a prefix */
+      int regDrain = 0;   /* Return address register for the drain subroutine */
+      int addrDrain = 0;  /* Entry point of the batch drain subroutine */
+      int addrDrainEnd = 0; /* Jumps over the drain subroutine body */
+      int addrBatchEmpty = 0; /* OP_SorterSort target for an empty batch */
 
       /* If there is a GROUP BY clause we might need a sorting index to
       ** implement it.  Allocate that sorting index now.  If it turns out
@@ -5348,10 +5371,13 @@ int sqlite3Select(
       pParse->nMem += pGroupBy->nExpr;
       iBMem = pParse->nMem + 1;
       pParse->nMem += pGroupBy->nExpr;
+      regPrefixFlag = ++pParse->nMem;
       sqlite3VdbeAddOp2(v, OP_Integer, 0, iAbortFlag);
       VdbeComment((v, "clear abort flag"));
       sqlite3VdbeAddOp2(v, OP_Integer, 0, iUseFlag);
       VdbeComment((v, "indicate accumulator empty"));
+      sqlite3VdbeAddOp2(v, OP_Integer, 0, regPrefixFlag);
+      VdbeComment((v, "clear sorted-prefix flag"));
       sqlite3VdbeAddOp3(v, OP_Null, 0, iAMem, iAMem+pGroupBy->nExpr-1);
 
       /* Begin a loop that will extract all source rows in GROUP BY order.
@@ -5387,6 +5413,24 @@ int sqlite3Select(
 
         groupBySort = 1;
         nGroupBy = pGroupBy->nExpr;
+
+        /* If the source delivers rows ordered on a proper prefix of
+        ** the GROUP BY terms, rows of one group never straddle a
+        ** prefix change, so the sorter can be sorted and drained
+        ** once per prefix batch instead of materializing the whole
+        ** input. Not when the sorter output must also serve the
+        ** ORDER BY clause: batches arrive in source order, which is
+        ** not necessarily the order of pKeyInfo. */
+        if( !orderByGrp ){
+          nGroupPrefix = sqlite3WhereIsOrdered(pWInfo);
+          if( nGroupPrefix<0 ) nGroupPrefix = 0;
+        }
+        if( nGroupPrefix>0 ){
+          regDrain = ++pParse->nMem;
+          addrDrain = sqlite3VdbeMakeLabel(v);
+          iPMem = pParse->nMem + 1;
+          pParse->nMem += nGroupPrefix;
+        }
         nCol = nGroupBy;
         j = nGroupBy;
         for(i=0; i<sAggInfo.nColumn; i++){
@@ -5398,6 +5442,28 @@ int sqlite3Select(
         regBase = sqlite3GetTempRange(pParse, nCol);
         sqlite3ExprCacheClear(pParse);
         sqlite3ExprCodeExprList(pParse, pGroupBy, regBase, 0, 0);
+
+        /* On a prefix change the previous batch holds every row of
+        ** its groups: sort and aggregate it before inserting the
+        ** current row. */
+        if( nGroupPrefix>0 ){
+          int lblInsert = sqlite3VdbeMakeLabel(v);
+          int addrIf = sqlite3VdbeAddOp1(v, OP_If, regPrefixFlag);
+          VdbeCoverage(v);
+          sqlite3VdbeAddOp2(v, OP_Integer, 1, regPrefixFlag);
+          sqlite3VdbeAddOp3(v, OP_Copy, regBase, iPMem, nGroupPrefix-1);
+          sqlite3VdbeGoto(v, lblInsert);
+          sqlite3VdbeJumpHere(v, addrIf);
+          sqlite3VdbeAddOp4(v, OP_Compare, regBase, iPMem, nGroupPrefix,
+                            (char*)sqlite3KeyInfoRef(pKeyInfo), P4_KEYINFO);
+          addr1 = sqlite3VdbeCurrentAddr(v);
+          sqlite3VdbeAddOp3(v, OP_Jump, addr1+1, lblInsert, addr1+1);
+          VdbeCoverage(v);
+          sqlite3VdbeAddOp2(v, OP_Gosub, regDrain, addrDrain);
+          VdbeComment((v, "sort and aggregate one batch"));
+          sqlite3VdbeAddOp3(v, OP_Copy, regBase, iPMem, nGroupPrefix-1);
+          sqlite3VdbeResolveLabel(v, lblInsert);
+        }
         j = nGroupBy;
         for(i=0; i<sAggInfo.nColumn; i++){
           struct AggInfo_col *pCol = &sAggInfo.aCol[i];
@@ -5417,7 +5483,21 @@ int sqlite3Select(
         sAggInfo.sortingIdxPTab = sortPTab = pParse->nTab++;
         sortOut = sqlite3GetTempReg(pParse);
         sqlite3VdbeAddOp3(v, OP_OpenPseudo, sortPTab, sortOut, nCol);
-        sqlite3VdbeAddOp2(v, OP_SorterSort, sAggInfo.sortingIdx, addrEnd);
+        if( nGroupPrefix>0 ){
+          /* The sort-and-aggregate code below doubles as the batch
+          ** drain subroutine. Drain whatever the final batch left
+          ** behind, then jump over the subroutine body. */
+          addrBatchEmpty = sqlite3VdbeMakeLabel(v);
+          addrDrainEnd = sqlite3VdbeMakeLabel(v);
+          sqlite3VdbeAddOp2(v, OP_Gosub, regDrain, addrDrain);
+          VdbeComment((v, "sort and aggregate the final batch"));
+          sqlite3VdbeGoto(v, addrDrainEnd);
+          sqlite3VdbeResolveLabel(v, addrDrain);
+          sqlite3VdbeAddOp2(v, OP_SorterSort, sAggInfo.sortingIdx,
+                            addrBatchEmpty);
+        }else{
+          sqlite3VdbeAddOp2(v, OP_SorterSort, sAggInfo.sortingIdx, addrEnd);
+        }
         VdbeComment((v, "GROUP BY sort")); VdbeCoverage(v);
         sAggInfo.useSortingIdx = 1;
         sqlite3ExprCacheClear(pParse);
@@ -5492,6 +5572,14 @@ int sqlite3Select(
       if( groupBySort ){
         sqlite3VdbeAddOp2(v, OP_SorterNext, sAggInfo.sortingIdx, addrTopOfLoop);
         VdbeCoverage(v);
+        if( nGroupPrefix>0 ){
+          /* Return from the batch drain subroutine with the sorter
+          ** emptied, ready for the next prefix batch. */
+          sqlite3VdbeAddOp1(v, OP_ResetSorter, sAggInfo.sortingIdx);
+          sqlite3VdbeResolveLabel(v, addrBatchEmpty);
+          sqlite3VdbeAddOp1(v, OP_Return, regDrain);
+          sqlite3VdbeResolveLabel(v, addrDrainEnd);
+        }
       }else{
         sqlite3WhereEnd(pWInfo);
         sqlite3VdbeChangeToNoop(v, addrSortingIdx);
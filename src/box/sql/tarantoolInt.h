@@ -38,6 +38,34 @@ void tarantoolSqlite3LoadSchema(InitData *init);
 /* Misc */
 const char *tarantoolErrorMessage();
 
+/*
+ * Live row count of the space/index behind a page number, as a
+ * LogEst, for query planning. Returns -1 if the page number does
+ * not map to a Tarantool index or the count is unavailable.
+ */
+LogEst tarantoolSqlite3PageRowEst(int pageNo);
+
+/*
+ * Statement write batching. A write statement normally lands each
+ * row as its own box transaction, i.e. its own WAL entry. The vdbe
+ * calls TxnBegin when it opens a write cursor on a user space to
+ * group every row the statement writes into one transaction, and
+ * resolves it in sqlite3VdbeHalt(). Returns 1 if a transaction was
+ * started and the caller now owns it, 0 otherwise (a DDL statement
+ * writing a system space, an active outer transaction which
+ * already does the batching, or a failure to begin - the statement
+ * then simply runs unbatched).
+ */
+int tarantoolSqlite3TxnBegin(int iTable);
+
+/* Commit the batch. SQLITE_TARANTOOL_ERROR if the commit fails or
+ * the transaction was aborted behind our back (memtx rolls back on
+ * a fiber yield), losing the rows written so far. */
+int tarantoolSqlite3TxnCommit();
+
+/* Roll the batch back after a failed statement. */
+int tarantoolSqlite3TxnRollback();
+
 /* Storage interface. */
 int tarantoolSqlite3CloseCursor(BtCursor *pCur);
 const void *tarantoolSqlite3PayloadFetch(BtCursor *pCur, u32 *pAmt);
@@ -52,6 +80,30 @@ int tarantoolSqlite3Insert(BtCursor *pCur, const BtreePayload *pX);
 int tarantoolSqlite3Delete(BtCursor *pCur, u8 flags);
 int tarantoolSqlite3ClearTable(int iTable);
 
+/*
+ * Advisory predicate pushdown: comparison operators a cursor
+ * filter can apply below the SQL boundary.
+ */
+enum ta_filter_op {
+	TA_FILTER_LT = 1,
+	TA_FILTER_LE,
+	TA_FILTER_EQ,
+	TA_FILTER_NE,
+	TA_FILTER_GE,
+	TA_FILTER_GT
+};
+
+/*
+ * Install "tuple field iField <op> pVal" on the cursor. The
+ * cursor may use it to skip rows that can not match without
+ * surfacing them; rows it can not decide on are passed through,
+ * so the bytecode test coded above the cursor stays
+ * authoritative. Only numeric values are filtered; anything else
+ * is silently ignored.
+ */
+int tarantoolSqlite3CursorFilter(BtCursor *pCur, int iField, int op,
+				 sqlite3_value *pVal);
+
 /* Compare against the index key under a cursor -
  * the key may span non-adjacent fields in a random order,
  * ex: [4]-[1]-[2]
@@ -503,14 +503,28 @@ static void registerTrace(int iReg, Mem *p){
 #endif
 
 
-#ifdef VDBE_PROFILE
+#if defined(VDBE_PROFILE) \
+ || ((defined(__GNUC__) || defined(_MSC_VER)) \
+     && (defined(i386) || defined(__i386__) || defined(_M_IX86) \
+         || defined(__x86_64__) || defined(__ppc__)))
 
-/* 
-** hwtime.h contains inline assembler code for implementing 
-** high-performance timing routines.
+/*
+** hwtime.h contains inline assembler code for implementing
+** high-performance timing routines.  Besides the compile-time
+** VDBE_PROFILE build it also serves the runtime profiler
+** (sqlite3VdbeProfilerOn), hence it is pulled in on every
+** platform it supports.
 */
 #include "hwtime.h"
 
+#else
+
+/*
+** No cycle counter on this platform: the runtime profiler still
+** counts opcode executions, with zero cycle attribution.
+*/
+static sqlite_uint64 sqlite3Hwtime(void){ return 0; }
+
 #endif
 
 #ifndef NDEBUG
@@ -591,6 +605,8 @@ int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
   u64 start;                 /* CPU clock count at start of opcode */
 #endif
+  u64 profStart = 0;         /* Runtime profiler: cycles at opcode start */
+  u8 profOp = 0;             /* Runtime profiler: opcode being timed */
   /*** INSERT STACK UNION HERE ***/
 
   assert( p->magic==VDBE_MAGIC_RUN );  /* sqlite3_step() verifies this */
@@ -652,6 +668,10 @@ int sqlite3VdbeExec(
 #ifdef VDBE_PROFILE
     start = sqlite3Hwtime();
 #endif
+    if( sqlite3VdbeProfilerOn ){
+      profOp = pOp->opcode;
+      profStart = sqlite3Hwtime();
+    }
     nVmStep++;
 #ifdef SQLITE_ENABLE_STMT_SCANSTATUS
     if( p->anExec ) p->anExec[(int)(pOp-aOp)]++;
@@ -1377,17 +1397,21 @@ case OP_ResultRow: {
   /* Invalidate all ephemeral cursor row caches */
   p->cacheCtr = (p->cacheCtr + 2)|1;
 
-  /* Make sure the results of the current row are \000 terminated
-  ** and have an assigned type.  The results are de-ephemeralized as
-  ** a side effect.
+  /* Make sure the non-ephemeral results of the current row are \000
+  ** terminated.  Ephemeral values are left alone: they reference the
+  ** current cursor row (see OPFLAG_EPHEM on OP_Column) or another
+  ** register, both of which stay put while the statement is halted,
+  ** so the values remain valid until the next sqlite3_step().
+  ** Copying them here would re-introduce the copy the code generator
+  ** went out of its way to avoid; sqlite3_column_text() still copies
+  ** on demand if a caller needs a terminated string.
   */
   pMem = p->pResultSet = &aMem[pOp->p1];
   for(i=0; i<pOp->p2; i++){
     assert( memIsValid(&pMem[i]) );
-    Deephemeralize(&pMem[i]);
-    assert( (pMem[i].flags & MEM_Ephem)==0
-            || (pMem[i].flags & (MEM_Str|MEM_Blob))==0 );
-    sqlite3VdbeMemNulTerminate(&pMem[i]);
+    if( (pMem[i].flags & MEM_Ephem)==0 ){
+      sqlite3VdbeMemNulTerminate(&pMem[i]);
+    }
     REGISTER_TRACE(pOp->p1+i, &pMem[i]);
   }
   if( db->mallocFailed ) goto no_mem;
@@ -2441,6 +2465,10 @@ case OP_NotNull: {            /* same as TK_NOTNULL, jump, in1 */
 ** the result is guaranteed to only be used as the argument of a length()
 ** or typeof() function, respectively.  The loading of large blobs can be
 ** skipped for length() and all content loading can be skipped for typeof().
+**
+** If the OPFLAG_EPHEM bit is set on P5, the value is guaranteed to be
+** consumed before the cursor moves again, so a string or blob may be
+** left as a reference into the row instead of being copied out.
 */
 case OP_Column: {
   int p2;            /* column number to retrieve */
@@ -2556,7 +2584,22 @@ case OP_Column: {
     zParse = zData+aOffset[i];
 
     /* Fill in aOffset[i] values through the p2-th field. */
-    do{
+    if( pC->eCurType==CURTYPE_BTREE
+     && (pC->uc.pCursor->curFlags & BTCF_TaCursor)!=0
+    ){
+      /* Rows in a Tarantool space are well-formed MsgPack - box
+      ** validates tuples on insert - so fields can be skipped over
+      ** without re-validating each one.  A single bounds check after
+      ** the skip still catches a mangled row.  */
+      do{
+        mp_next((const char **)&zParse);
+        aOffset[++i] = (u32)(zParse-zData);
+      }while( i<=p2 );
+      if( zParse>zEnd ){
+        rc = SQLITE_CORRUPT_BKPT;
+        goto op_column_error;
+      }
+    }else do{
       if( mp_check((const char **)&zParse, zEnd) != 0 ){
         rc = SQLITE_CORRUPT_BKPT;
         goto op_column_error;
@@ -2593,17 +2636,25 @@ case OP_Column: {
   }
 
   if( pDest->flags & MEM_Ephem ){
-    int len = pDest->n;
-    if( pDest->szMalloc<len+2 ){
-      if( sqlite3VdbeMemGrow(pDest, len+2, 1) ) goto op_column_error;
-    } else {
-      pDest->z = memcpy(pDest->zMalloc, pDest->z, len);
-      pDest->flags &= ~MEM_Ephem;
+    if( (pOp->p5 & OPFLAG_EPHEM)!=0 && zData==pC->aRow ){
+      /* The code generator promises the value is consumed before the
+      ** cursor moves again (it flows straight into OP_ResultRow), so
+      ** leave it as a reference into the row instead of copying every
+      ** byte out of it.  */
+      pDest->enc = encoding;
+    }else{
+      int len = pDest->n;
+      if( pDest->szMalloc<len+2 ){
+        if( sqlite3VdbeMemGrow(pDest, len+2, 1) ) goto op_column_error;
+      } else {
+        pDest->z = memcpy(pDest->zMalloc, pDest->z, len);
+        pDest->flags &= ~MEM_Ephem;
+      }
+      pDest->z[len] = 0;
+      pDest->z[len+1] = 0;
+      pDest->flags |= MEM_Term;
+      pDest->enc = encoding;
     }
-    pDest->z[len] = 0;
-    pDest->z[len+1] = 0;
-    pDest->flags |= MEM_Term;
-    pDest->enc = encoding;
   }
 
   if( zData!=pC->aRow ) sqlite3VdbeMemRelease(&sMem);
@@ -3340,6 +3391,15 @@ case OP_OpenWrite:
 #endif
   rc = sqlite3BtreeCursor(pX, p2, wrFlag, pKeyInfo, pCur->uc.pCursor);
   pCur->pKeyInfo = pKeyInfo;
+  if( pOp->opcode==OP_OpenWrite && iDb==0 && (pOp->p5 & OPFLAG_P2ISREG)==0
+   && !p->inBoxTxn
+  ){
+    /* Batch every row this statement writes into a single box
+    ** transaction, so a multi-row INSERT lands in the WAL as one
+    ** entry instead of one per row.  The transaction is committed
+    ** or rolled back with the statement in sqlite3VdbeHalt(). */
+    p->inBoxTxn = tarantoolSqlite3TxnBegin(p2)!=0;
+  }
   /* Set the VdbeCursor.isTable variable. Previous versions of
   ** SQLite used to check if the root-page flags were sane at this point
   ** and report database corruption if they were not, but this check has
@@ -5178,6 +5238,30 @@ case OP_IdxGE:  {       /* jump */
   break;
 }
 
+/* Opcode: TaFilter P1 P2 P3 P4 *
+** Synopsis: if field[P2] !op r[P3] skip
+**
+** Install an advisory filter "tuple field P2 <P4> r[P3]" on cursor P1,
+** where P4 encodes a comparison operator.  The storage layer may use
+** the filter to skip rows that can not possibly satisfy the comparison
+** without surfacing them into the bytecode.  The filter is a hint: the
+** comparison must still be coded in the loop body, and remains the
+** authoritative test.
+*/
+case OP_TaFilter: {
+  VdbeCursor *pC;
+
+  assert( pOp->p1>=0 && pOp->p1<p->nCursor );
+  pC = p->apCsr[pOp->p1];
+  assert( pC!=0 );
+  if( pC->eCurType==CURTYPE_BTREE ){
+    rc = sqlite3BtreeFilter(pC->uc.pCursor, pOp->p2, pOp->p4.i,
+                            &aMem[pOp->p3]);
+    if( rc ) goto abort_due_to_error;
+  }
+  break;
+}
+
 /* Opcode: Destroy P1 P2 P3 * *
 **
 ** Delete an entire database table or index whose root page in the database
@@ -6926,6 +7010,13 @@ default: {          /* This is really OP_Noop and OP_Explain */
       pOrigOp->cnt++;
     }
 #endif
+    if( sqlite3VdbeProfilerOn ){
+      u64 profEnd = sqlite3Hwtime();
+      sqlite3VdbeProfilerCnt[profOp]++;
+      if( profEnd>profStart ){
+        sqlite3VdbeProfilerCycles[profOp] += profEnd - profStart;
+      }
+    }
 
     /* The following code adds nothing to the actual functionality
     ** of the program.  It is only here for testing and debugging.
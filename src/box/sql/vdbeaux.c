@@ -2629,6 +2629,28 @@ int sqlite3VdbeHalt(Vdbe *p){
   }
   checkActiveVdbeCnt(db);
 
+  /* Resolve the box transaction batching this statement's writes
+  ** (see OP_OpenWrite).  p->rc is final here: on success the whole
+  ** batch goes to the WAL as one entry; on failure every row the
+  ** statement wrote is rolled back together.  The exception is the
+  ** 'OR FAIL' conflict action, which per its contract keeps the
+  ** rows written before the failure, so the partial batch is
+  ** committed just as the main autocommit logic below would.  */
+  if( p->inBoxTxn ){
+    int mrc = p->rc & 0xff;
+    int isSpecial = mrc==SQLITE_NOMEM || mrc==SQLITE_IOERR
+                    || mrc==SQLITE_INTERRUPT || mrc==SQLITE_FULL;
+    p->inBoxTxn = 0;
+    if( p->rc==SQLITE_OK || (p->errorAction==OE_Fail && !isSpecial) ){
+      if( tarantoolSqlite3TxnCommit()!=SQLITE_OK ){
+        p->rc = SQLITE_TARANTOOL_ERROR;
+        sqlite3VdbeError(p, "%s", tarantoolErrorMessage());
+      }
+    }else{
+      tarantoolSqlite3TxnRollback();
+    }
+  }
+
   /* No commit or rollback needed if the program never started or if the
   ** SQL statement does not read or write a database file.  */
   if( p->pc>=0 && p->bIsReader ){
@@ -18,6 +18,7 @@
 */
 #include "sqliteInt.h"
 #include "whereInt.h"
+#include "tarantoolInt.h"
 
 /* Forward declaration of methods */
 static int whereLoopResize(sqlite3*, WhereLoop*, int);
@@ -2786,6 +2787,14 @@ static int whereLoopAddBtree(
     }
     pProbe = &sPk;
   }
+  /* Tarantool: this build has no ANALYZE data, so refresh the table
+  ** cardinality from the live space instead of relying on the sqlite
+  ** default guess, which makes the planner prefer full scans on big
+  ** spaces. */
+  if( pTab->tnum>0 ){
+    LogEst rEst = tarantoolSqlite3PageRowEst(pTab->tnum);
+    if( rEst>=0 ) pTab->nRowLogEst = rEst;
+  }
   rSize = pTab->nRowLogEst;
   rLogSize = estLog(rSize);
 
@@ -2847,6 +2856,13 @@ static int whereLoopAddBtree(
       testcase( pNew->iTab!=pSrc->iCursor );  /* See ticket [98d973b8f5] */
       continue;  /* Partial index inappropriate for this query */
     }
+    /* Tarantool: use the live index size for the scan cardinality.
+    ** The per-column selectivities in aiRowLogEst[1..] are left as
+    ** ANALYZE (or the defaults) set them. */
+    if( pProbe->tnum>0 ){
+      LogEst rEst = tarantoolSqlite3PageRowEst(pProbe->tnum);
+      if( rEst>=0 ) pProbe->aiRowLogEst[0] = rEst;
+    }
     rSize = pProbe->aiRowLogEst[0];
     pNew->u.btree.nEq = 0;
     pNew->u.btree.nBtm = 0;
@@ -19,6 +19,7 @@
 */
 #include "sqliteInt.h"
 #include "whereInt.h"
+#include "tarantoolInt.h"
 
 #ifndef SQLITE_OMIT_EXPLAIN
 
@@ -1042,6 +1043,67 @@ static void codeExprOrVector(Parse *pParse, Expr *p, int iReg, int nReg){
   }
 }
 
+/*
+** If pE is a comparison between a column of the table scanned by cursor
+** iCur and a numeric literal, emit an OP_TaFilter that installs the
+** comparison on the cursor as an advisory filter, letting the storage
+** layer skip rows that can not match without surfacing them into the
+** bytecode.  The filter is a hint only: the caller must still code the
+** full test, which remains authoritative.  Terms that do not fit the
+** pattern are silently left alone.
+**
+** Only numeric-affinity columns qualify.  With TEXT affinity the
+** comparison applies text affinity to the literal and every numeric
+** sorts before every string, so a numeric filter would skip rows the
+** bytecode test accepts.
+*/
+static void codeTaFilterTerm(Parse *pParse, int iCur, Expr *pE){
+  Vdbe *v = pParse->pVdbe;
+  Expr *pCol;          /* The column side of the comparison */
+  Expr *pVal;          /* The literal side of the comparison */
+  Expr *pLit;          /* pVal with any unary minus stripped */
+  int op;              /* Filter operator, from enum ta_filter_op */
+  int r1;              /* Register holding the literal */
+  int regFree = 0;     /* Temp register to release, if any */
+  char aff;
+
+  switch( pE->op ){
+    case TK_LT: op = TA_FILTER_LT; break;
+    case TK_LE: op = TA_FILTER_LE; break;
+    case TK_EQ: op = TA_FILTER_EQ; break;
+    case TK_NE: op = TA_FILTER_NE; break;
+    case TK_GE: op = TA_FILTER_GE; break;
+    case TK_GT: op = TA_FILTER_GT; break;
+    default:    return;
+  }
+  pCol = pE->pLeft;
+  pVal = pE->pRight;
+  if( pCol==0 || pVal==0 ) return;
+  if( pCol->op!=TK_COLUMN ){
+    /* Literal on the left: mirror the comparison */
+    SWAP(Expr*, pCol, pVal);
+    switch( op ){
+      case TA_FILTER_LT: op = TA_FILTER_GT; break;
+      case TA_FILTER_LE: op = TA_FILTER_GE; break;
+      case TA_FILTER_GE: op = TA_FILTER_LE; break;
+      case TA_FILTER_GT: op = TA_FILTER_LT; break;
+    }
+  }
+  if( pCol->op!=TK_COLUMN || pCol->iTable!=iCur || pCol->iColumn<0 ) return;
+  aff = sqlite3ExprAffinity(pCol);
+  if( aff!=SQLITE_AFF_INTEGER && aff!=SQLITE_AFF_REAL
+   && aff!=SQLITE_AFF_NUMERIC ){
+    return;
+  }
+  pLit = pVal;
+  if( pLit->op==TK_UMINUS || pLit->op==TK_UPLUS ) pLit = pLit->pLeft;
+  if( pLit==0 || (pLit->op!=TK_INTEGER && pLit->op!=TK_FLOAT) ) return;
+  if( !sqlite3ExprIsConstant(pVal) ) return;
+  r1 = sqlite3ExprCodeTemp(pParse, pVal, &regFree);
+  sqlite3VdbeAddOp4Int(v, OP_TaFilter, iCur, pCol->iColumn, r1, op);
+  sqlite3ReleaseTempReg(pParse, regFree);
+}
+
 /*
 ** Generate code for the start of the iLevel-th loop in the WHERE clause
 ** implementation described by pWInfo.
@@ -1992,6 +2054,20 @@ Bitmask sqlite3WhereCodeOneLoopStart(
       VdbeCoverage(v);
 #endif
     }
+    /* On a plain full scan, also push simple numeric comparisons down
+    ** to the cursor so the storage layer can reject rows without
+    ** surfacing them.  Skip statements where the cursor is reused for
+    ** seeks outside this loop (OR subclauses, one-pass and two-pass
+    ** UPDATE/DELETE) and outer joins that must see unmatched rows.
+    ** The ExprIfFalse test below is still coded and stays
+    ** authoritative; the filter only prunes rows it is sure about.  */
+    if( (pWInfo->wctrlFlags
+          & (WHERE_OR_SUBCLAUSE|WHERE_ONEPASS_DESIRED|WHERE_SEEK_TABLE))==0
+     && (pLoop->wsFlags & (WHERE_INDEXED|WHERE_VIRTUALTABLE|WHERE_MULTI_OR))==0
+     && pLevel->iLeftJoin==0
+    ){
+      codeTaFilterTerm(pParse, iCur, pE);
+    }
     sqlite3ExprIfFalse(pParse, pE, addrCont, SQLITE_JUMPIFNULL);
     if( skipLikeAddr ) sqlite3VdbeJumpHere(v, skipLikeAddr);
     pTerm->wtFlags |= TERM_CODED;
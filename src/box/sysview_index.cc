@@ -34,13 +34,69 @@
 #include "func.h"
 #include "tuple.h"
 #include "session.h"
+#include "user.h"
 
 struct sysview_iterator {
 	struct iterator base;
 	struct iterator *source;
 	struct space *space;
+	/** Position in the materialized result, if it is used. */
+	uint32_t mat_pos;
 };
 
+/* {{{ Materialized full scans *************************************/
+
+/**
+ * The cached result of a full filtered scan of the source space.
+ * The result depends on the source contents and on the reader's
+ * access rights, so it is keyed by the versions of the schema,
+ * user and function caches plus the reader credentials: a result
+ * built for one set stays valid until any of them changes. The
+ * cached tuples are referenced, which may keep replaced source
+ * rows alive until the next view read resets the cache.
+ */
+struct sysview_mat {
+	/** Versions of the caches the result was built at. */
+	uint32_t schema_version;
+	uint32_t user_cache_version;
+	uint32_t func_cache_version;
+	/** Credentials the filter ran under. */
+	uint32_t uid;
+	uint8_t auth_token;
+	uint8_t universal_access;
+	/** True when tuples[] holds a usable result. */
+	bool is_valid;
+	/** The tuples which passed the filter, in source order. */
+	struct tuple **tuples;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/** Unreference the cached tuples and mark the result stale. */
+static void
+sysview_mat_reset(struct sysview_mat *mat)
+{
+	for (uint32_t i = 0; i < mat->count; i++)
+		tuple_unref(mat->tuples[i]);
+	mat->count = 0;
+	mat->is_valid = false;
+}
+
+/** True if the cached result may be served to @a cr. */
+static bool
+sysview_mat_is_fresh(struct sysview_mat *mat, struct credentials *cr)
+{
+	return mat->is_valid &&
+	       mat->schema_version == ::schema_version &&
+	       mat->user_cache_version == ::user_cache_version &&
+	       mat->func_cache_version == ::func_cache_version &&
+	       mat->uid == cr->uid &&
+	       mat->auth_token == cr->auth_token &&
+	       mat->universal_access == cr->universal_access;
+}
+
+/* }}} */
+
 static inline struct sysview_iterator *
 sysview_iterator(struct iterator *ptr)
 {
@@ -73,15 +129,91 @@ sysview_iterator_next(struct iterator *iterator)
 	return NULL;
 }
 
+/** Serve a full scan from the materialized result. */
+static struct tuple *
+sysview_iterator_next_mat(struct iterator *iterator)
+{
+	assert(iterator->free == sysview_iterator_free);
+	struct sysview_iterator *it = sysview_iterator(iterator);
+	class SysviewIndex *index = (class SysviewIndex *) iterator->index;
+	struct sysview_mat *mat = index->mat;
+	/*
+	 * The same semantics as the schema_version check of the
+	 * filtering path: a change under an open iterator ends
+	 * the iteration.
+	 */
+	if (!sysview_mat_is_fresh(mat, &current_session()->credentials))
+		return NULL;
+	if (it->mat_pos >= mat->count)
+		return NULL;
+	return mat->tuples[it->mat_pos++];
+}
+
+/**
+ * Rebuild the materialized result of @a index, unless it is
+ * fresh. One filtered scan of the source primary key, after
+ * which full-scan reads are served from the cache.
+ */
+static void
+sysview_materialize(const class SysviewIndex *index, struct space *source,
+		    struct Index *pk)
+{
+	struct sysview_mat *mat = index->mat;
+	struct credentials *cr = &current_session()->credentials;
+	if (sysview_mat_is_fresh(mat, cr))
+		return;
+	sysview_mat_reset(mat);
+	struct iterator *it = pk->allocIterator();
+	IteratorGuard guard(it);
+	pk->initIterator(it, ITER_ALL, NULL, 0);
+	struct tuple *tuple;
+	while ((tuple = it->next(it)) != NULL) {
+		if (!index->filter(source, tuple))
+			continue;
+		if (mat->count == mat->capacity) {
+			uint32_t capacity = mat->capacity == 0 ? 128 :
+					    mat->capacity * 2;
+			struct tuple **tuples = (struct tuple **)
+				realloc(mat->tuples,
+					capacity * sizeof(*tuples));
+			if (tuples == NULL) {
+				tnt_raise(OutOfMemory,
+					  capacity * sizeof(*tuples),
+					  "realloc", "sysview_mat");
+			}
+			mat->tuples = tuples;
+			mat->capacity = capacity;
+		}
+		if (tuple_ref(tuple) != 0)
+			diag_raise();
+		mat->tuples[mat->count++] = tuple;
+	}
+	mat->schema_version = ::schema_version;
+	mat->user_cache_version = ::user_cache_version;
+	mat->func_cache_version = ::func_cache_version;
+	mat->uid = cr->uid;
+	mat->auth_token = cr->auth_token;
+	mat->universal_access = cr->universal_access;
+	mat->is_valid = true;
+}
+
 SysviewIndex::SysviewIndex(struct index_def *index_def, uint32_t source_space_id,
 		     uint32_t source_index_id, sysview_filter_f filter)
 	: Index(index_def), source_space_id(source_space_id),
 	  source_index_id(source_index_id), filter(filter)
 {
+	mat = (struct sysview_mat *) calloc(1, sizeof(*mat));
+	if (mat == NULL) {
+		tnt_raise(OutOfMemory, sizeof(*mat), "SysviewIndex",
+			  "materialization");
+	}
 }
 
 SysviewIndex::~SysviewIndex()
 {
+	sysview_mat_reset(mat);
+	free(mat->tuples);
+	free(mat);
 }
 
 struct iterator *
@@ -113,6 +245,19 @@ SysviewIndex::initIterator(struct iterator *iterator,
 	 */
 	if (key_validate(pk->index_def, type, key, part_count))
 		diag_raise();
+	iterator->index = (Index *) this;
+	it->space = source;
+	/*
+	 * A full scan - the shape of a monitoring poll - is
+	 * served from the materialized result. Everything else
+	 * goes through the filtering path.
+	 */
+	if (type == ITER_ALL || (type == ITER_GE && part_count == 0)) {
+		sysview_materialize(this, source, pk);
+		it->mat_pos = 0;
+		iterator->next = sysview_iterator_next_mat;
+		return;
+	}
 	/* Re-allocate iterator if schema was changed */
 	if (it->source != NULL && it->source->schema_version != ::schema_version) {
 		it->source->free(it->source);
@@ -123,9 +268,7 @@ SysviewIndex::initIterator(struct iterator *iterator,
 		it->source->schema_version = ::schema_version;
 	}
 	pk->initIterator(it->source, type, key, part_count);
-	iterator->index = (Index *) this;
 	iterator->next = sysview_iterator_next;
-	it->space = source;
 }
 
 struct tuple *
@@ -34,6 +34,7 @@
 #include "index.h"
 
 struct sysview_iterator;
+struct sysview_mat;
 
 typedef bool (*sysview_filter_f)(struct space *source, struct tuple *);
 
@@ -54,6 +55,15 @@ public:
 	uint32_t source_space_id;
 	uint32_t source_index_id;
 	sysview_filter_f filter;
+	/**
+	 * Materialized full scan result: the tuples which passed
+	 * the filter, in source index order. Rebuilt lazily when
+	 * the schema, users, privileges or the reader credentials
+	 * change, so that e.g. a monitoring agent polling _vspace
+	 * every second pays for one filtered scan per DDL change
+	 * instead of one per request.
+	 */
+	struct sysview_mat *mat;
 };
 
 class SysviewVspaceIndex: public SysviewIndex {
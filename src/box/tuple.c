@@ -30,9 +30,11 @@
  */
 #include "tuple.h"
 
+#include "trivia/config.h"
 #include "trivia/util.h"
 #include "fiber.h"
 #include "tt_uuid.h"
+#include "cpu_feature.h"
 #include "third_party/PMurHash.h"
 
 enum {
@@ -41,6 +43,24 @@ enum {
 
 static struct mempool tuple_iterator_pool;
 
+enum {
+	/**
+	 * Cap on the deferred free queue. When the queue fills up
+	 * it is drained inline, so at most this many dead tuples
+	 * are parked between two event loop iterations.
+	 */
+	TUPLE_DELETE_QUEUE_MAX = 1024,
+};
+
+/**
+ * Dead tuples of the tx thread waiting for a batched free,
+ * \sa tuple_delete_deferred().
+ */
+static struct tuple *tuple_delete_queue[TUPLE_DELETE_QUEUE_MAX];
+static uint32_t tuple_delete_queue_size;
+/** Drains the queue once per tx event loop iteration. */
+static struct ev_prepare tuple_delete_queue_watcher;
+
 /**
  * Last tuple returned by public C API
  * \sa tuple_bless()
@@ -55,8 +75,9 @@ tuple_validate_raw(struct tuple_format *format, const char *tuple)
 
 	/* Check to see if the tuple has a sufficient number of fields. */
 	uint32_t field_count = mp_decode_array(&tuple);
-	if (format->exact_field_count > 0 &&
-	    format->exact_field_count != field_count) {
+	if (field_count < format->min_field_count ||
+	    (format->exact_field_count > 0 &&
+	     field_count > format->exact_field_count)) {
 		diag_set(ClientError, ER_EXACT_FIELD_COUNT,
 			 (unsigned) field_count,
 			 (unsigned) format->exact_field_count);
@@ -70,12 +91,39 @@ tuple_validate_raw(struct tuple_format *format, const char *tuple)
 	}
 
 	/* Check field types */
-	for (uint32_t i = 0; i < format->field_count; i++) {
+	uint32_t i = 0;
+	while (i < format->field_count) {
+		/*
+		 * Fast path: validate and skip eight fields at
+		 * once when they all are positive fixints (lead
+		 * byte < 0x80, i.e. MP_UINT occupying one byte).
+		 * Since at least 8 more fields follow and every
+		 * field takes at least one byte, reading a whole
+		 * word here can not cross the end of the tuple.
+		 */
+		while (i + 8 <= format->field_count) {
+			uint64_t window;
+			memcpy(&window, tuple, sizeof(window));
+			if ((window & UINT64_C(0x8080808080808080)) != 0)
+				break;
+			uint32_t j = 0;
+			while (j < 8 &&
+			       (key_mp_type[format->fields[i + j].type] &
+				(1U << MP_UINT)) != 0)
+				j++;
+			if (j < 8)
+				break;
+			tuple += 8;
+			i += 8;
+		}
+		if (i == format->field_count)
+			break;
 		if (key_mp_type_validate(format->fields[i].type,
 					 mp_typeof(*tuple), ER_FIELD_TYPE,
 					 i + TUPLE_INDEX_BASE))
 			return -1;
 		mp_next(&tuple);
+		i++;
 	}
 	return 0;
 }
@@ -199,15 +247,60 @@ tuple_extract_key_raw(const char *data, const char *data_end,
 	return key;
 }
 
+static void
+tuple_delete_queue_drain(void)
+{
+	while (tuple_delete_queue_size > 0)
+		tuple_delete(tuple_delete_queue[--tuple_delete_queue_size]);
+}
+
+/** \copydoc declaration in tuple.h */
+void
+tuple_delete_deferred(struct tuple *tuple)
+{
+	assert(tuple->refs == 0);
+	/*
+	 * Vinyl worker threads unref statements too; the queue
+	 * and its watcher belong to the tx thread, everyone else
+	 * frees right away.
+	 */
+	if (!cord_is_main()) {
+		tuple_delete(tuple);
+		return;
+	}
+	if (tuple_delete_queue_size == TUPLE_DELETE_QUEUE_MAX)
+		tuple_delete_queue_drain();
+	tuple_delete_queue[tuple_delete_queue_size++] = tuple;
+}
+
+static void
+tuple_delete_queue_cb(ev_loop *loop, struct ev_prepare *watcher, int events)
+{
+	(void) loop;
+	(void) watcher;
+	(void) events;
+	tuple_delete_queue_drain();
+}
+
 void
 tuple_init(void)
 {
 	tuple_format_init();
 
+#if defined(HAVE_CPUID) && (defined(__x86_64__) || defined(__i386__))
+	if (sse42_enabled_cpu()) {
+		tuple_hash_calc = tuple_hash_crc32c;
+		key_hash_calc = key_hash_crc32c;
+	}
+#endif
+
 	mempool_create(&tuple_iterator_pool, &cord()->slabc,
 		       sizeof(struct tuple_iterator));
 
 	box_tuple_last = NULL;
+
+	ev_prepare_init(&tuple_delete_queue_watcher, tuple_delete_queue_cb);
+	ev_prepare_start(loop(), &tuple_delete_queue_watcher);
 }
 
 void
@@ -219,6 +312,9 @@ tuple_free(void)
 		box_tuple_last = NULL;
 	}
 
+	ev_prepare_stop(loop(), &tuple_delete_queue_watcher);
+	tuple_delete_queue_drain();
+
 	mempool_destroy(&tuple_iterator_pool);
 
 	tuple_format_free();
@@ -279,6 +375,37 @@ box_tuple_field(const box_tuple_t *tuple, uint32_t fieldno)
 	return tuple_field(tuple, fieldno);
 }
 
+void
+box_tuple_field_n(box_tuple_t **tuples, uint32_t count, uint32_t fieldno,
+		  const char **fields)
+{
+	assert(tuples != NULL && fields != NULL);
+	/*
+	 * The tuples of a batch are scattered over the arena, so
+	 * each header access is an independent cache miss. Keep a
+	 * few prefetches in flight ahead of the lookups.
+	 */
+	enum { PREFETCH_DISTANCE = 8 };
+	for (uint32_t i = 0; i < count; i++) {
+		if (i + PREFETCH_DISTANCE < count)
+			prefetch(tuples[i + PREFETCH_DISTANCE], 0, 3);
+		fields[i] = tuple_field(tuples[i], fieldno);
+	}
+}
+
+int32_t
+box_tuple_field_slot(const box_tuple_t *tuple, uint32_t fieldno)
+{
+	assert(tuple != NULL);
+	const struct tuple_format *format = tuple_format(tuple);
+	if (fieldno < format->field_count)
+		return format->fields[fieldno].offset_slot;
+	if (fieldno < format->field_count + format->ext_field_count)
+		return format->ext_offset_slot -
+		       (int32_t)(fieldno - format->field_count);
+	return TUPLE_OFFSET_SLOT_NIL;
+}
+
 typedef struct tuple_iterator box_tuple_iterator_t;
 
 box_tuple_iterator_t *
@@ -378,13 +505,49 @@ tuple_hash_slow_path(const struct tuple *tuple, const struct key_def *key_def)
 
 	for (const struct key_part *part = key_def->parts;
 	     part < key_def->parts + key_def->part_count; part++) {
-		const char *field = tuple_field(tuple, part->fieldno);
+		const char *field = tuple_field_cached(tuple, part->fieldno);
+		if (field == NULL)
+			field = tuple_field(tuple, part->fieldno);
 		total_size += tuple_hash_field(&h, &carry, &field, part->type);
 	}
 
 	return PMurHash32_Result(h, carry, total_size);
 }
 
+__thread struct tuple_field_cache *tuple_field_cache_cur;
+
+void
+tuple_field_cache_publish(struct tuple_field_cache *cache,
+			  const struct tuple *tuple)
+{
+	const struct tuple_format *format = tuple_format(tuple);
+	uint32_t field_count = format->field_count;
+	if (field_count > TUPLE_FIELD_CACHE_MAX)
+		field_count = TUPLE_FIELD_CACHE_MAX;
+	cache->tuple = tuple;
+	cache->field_count = field_count;
+	cache->uint_mask = 0;
+	/*
+	 * One linear pass: the tuple has been validated against
+	 * the format at creation, so an unsigned field can be
+	 * decoded right away and decoding doubles as the skip.
+	 */
+	const char *pos = tuple_data(tuple);
+	uint32_t n = mp_decode_array(&pos);
+	assert(n >= field_count);
+	(void) n;
+	for (uint32_t i = 0; i < field_count; i++) {
+		cache->fields[i] = pos;
+		if (format->fields[i].type == FIELD_TYPE_UNSIGNED) {
+			cache->uint_vals[i] = mp_decode_uint(&pos);
+			cache->uint_mask |= 1U << i;
+		} else {
+			mp_next(&pos);
+		}
+	}
+	tuple_field_cache_cur = cache;
+}
+
 uint32_t
 key_hash_slow_path(const char *key, const struct key_def *key_def)
 {
@@ -402,3 +565,70 @@ key_hash_slow_path(const char *key, const struct key_def *key_def)
 
 	return PMurHash32_Result(h, carry, total_size);
 }
+
+#if defined(HAVE_CPUID) && (defined(__x86_64__) || defined(__i386__))
+
+/**
+ * CRC32C-instruction counterpart of tuple_hash_field(): same
+ * field boundaries and the same MP_STR special case, but the mix
+ * is a single crc32 instruction per 8 bytes instead of the murmur
+ * multiply-rotate pipeline, and multi-part keys combine by simply
+ * continuing the crc chain.
+ */
+static uint32_t
+tuple_hash_field_crc32c(uint32_t crc, const char **field,
+			enum field_type type)
+{
+	const char *f = *field;
+	uint32_t size;
+
+	switch (type) {
+	case FIELD_TYPE_STRING:
+		/* MP_STR is hashed without the format identifier,
+		 * see tuple_hash_field(). */
+		f = mp_decode_str(field, &size);
+		break;
+	default:
+		mp_next(field);
+		size = *field - f;
+		break;
+	}
+	return crc32c_hw(crc, f, size);
+}
+
+static uint32_t
+key_hash_crc32c(const char *key, const struct key_def *key_def)
+{
+	const struct key_part *part = key_def->parts;
+
+	if (key_def->part_count == 1 && part->type == FIELD_TYPE_UNSIGNED)
+		return key_hash(key, key_def);
+
+	uint32_t crc = HASH_SEED;
+	for (; part < key_def->parts + key_def->part_count; part++)
+		crc = tuple_hash_field_crc32c(crc, &key, part->type);
+	return crc;
+}
+
+static uint32_t
+tuple_hash_crc32c(const struct tuple *tuple, const struct key_def *key_def)
+{
+	const struct key_part *part = key_def->parts;
+
+	if (key_def->part_count == 1 && part->type == FIELD_TYPE_UNSIGNED)
+		return tuple_hash(tuple, key_def);
+
+	uint32_t crc = HASH_SEED;
+	for (; part < key_def->parts + key_def->part_count; part++) {
+		const char *field = tuple_field_cached(tuple, part->fieldno);
+		if (field == NULL)
+			field = tuple_field(tuple, part->fieldno);
+		crc = tuple_hash_field_crc32c(crc, &field, part->type);
+	}
+	return crc;
+}
+
+#endif /* defined(HAVE_CPUID) && (__x86_64__ || __i386__) */
+
+tuple_hash_func tuple_hash_calc = tuple_hash;
+key_hash_func key_hash_calc = key_hash;
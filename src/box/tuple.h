@@ -144,6 +144,28 @@ box_tuple_format(const box_tuple_t *tuple);
 const char *
 box_tuple_field(const box_tuple_t *tuple, uint32_t fieldno);
 
+/**
+ * Return the same raw field of several tuples in one call.
+ *
+ * Equivalent to box_tuple_field() on each tuple of the batch, but
+ * the tuples are prefetched ahead of the field lookups, so a
+ * columnar scan over tuples collected with box_iterator_next_n()
+ * overlaps the cache misses instead of paying them one by one.
+ *
+ * The stored pointers are valid as long as the tuples are
+ * referenced.
+ *
+ * \param tuples array of \a count tuples
+ * \param count number of tuples
+ * \param fieldno zero-based index in MsgPack array
+ * \param[out] fields array of \a count pointers; NULL is stored
+ *  for the tuples which have no field \a fieldno
+ * \sa box_iterator_next_n()
+ */
+void
+box_tuple_field_n(box_tuple_t **tuples, uint32_t count, uint32_t fieldno,
+		  const char **fields);
+
 /**
  * Tuple iterator
  */
@@ -243,6 +265,18 @@ box_tuple_extract_key(const box_tuple_t *tuple, uint32_t space_id,
 
 /** \endcond public */
 
+/**
+ * Return the field-map offset slot of field \a fieldno in the
+ * format of \a tuple, or TUPLE_OFFSET_SLOT_NIL if the format
+ * stores no offset for it. Slots are negative indexes into the
+ * uint32 array located at the tuple data offset, so
+ * data + ((uint32_t *) data)[slot] is the field, \sa
+ * tuple_field_raw(). Exported for the FFI fast path of tuple
+ * field access in Lua.
+ */
+int32_t
+box_tuple_field_slot(const box_tuple_t *tuple, uint32_t fieldno);
+
 /**
  * An atom of Tarantool storage. Represents MsgPack Array.
  * Tuple has the following structure:
@@ -393,6 +427,19 @@ tuple_delete(struct tuple *tuple)
 	format->vtab.destroy(format, tuple);
 }
 
+/**
+ * Free the tuple later, from a batch: in the tx thread dead
+ * tuples are parked on a bounded queue which is drained once per
+ * event loop iteration (or inline when the queue fills up), so
+ * bursts of final unrefs in hot loops - ports being dumped,
+ * iterators dying - do not interleave allocator frees with
+ * request processing. In other threads this is plain
+ * tuple_delete().
+ * @pre tuple->refs == 0
+ */
+void
+tuple_delete_deferred(struct tuple *tuple);
+
 /**
  * Check tuple data correspondence to space format.
  * Actually checks everything that checks tuple_init_field_map.
@@ -458,6 +505,68 @@ tuple_field(const struct tuple *tuple, uint32_t fieldno)
 			       tuple_field_map(tuple), fieldno);
 }
 
+enum { TUPLE_FIELD_CACHE_MAX = 16 };
+
+/**
+ * A per-statement key extraction cache. When one DML statement
+ * updates several indexes of a space, every index write decodes
+ * key fields of the same tuple from msgpack over again. The
+ * owner of the statement decodes the indexed fields once into
+ * this scratch vector and publishes it for the duration of the
+ * index updates; tuple_hash() and friends pick the decoded data
+ * up by a tuple pointer match. The cache lives in the statement
+ * (struct txn_stmt), so its lifetime is bounded by the statement
+ * region.
+ */
+struct tuple_field_cache {
+	/** The tuple the cache describes, NULL if empty. */
+	const struct tuple *tuple;
+	/** The number of cached fields. */
+	uint32_t field_count;
+	/** Bit i is set if uint_vals[i] holds a decoded value. */
+	uint32_t uint_mask;
+	/** Raw positions of the first field_count fields. */
+	const char *fields[TUPLE_FIELD_CACHE_MAX];
+	/** Decoded values of unsigned fields. */
+	uint64_t uint_vals[TUPLE_FIELD_CACHE_MAX];
+};
+
+/**
+ * The cache of the statement being applied on this cord, NULL
+ * outside of an index update loop.
+ */
+extern __thread struct tuple_field_cache *tuple_field_cache_cur;
+
+/**
+ * Fill @a cache with positions and decoded values of the
+ * indexed fields of @a tuple in one pass over its msgpack and
+ * publish it on the cord.
+ */
+void
+tuple_field_cache_publish(struct tuple_field_cache *cache,
+			  const struct tuple *tuple);
+
+/** Withdraw the published cache, if any. */
+static inline void
+tuple_field_cache_withdraw(void)
+{
+	tuple_field_cache_cur = NULL;
+}
+
+/**
+ * Position of field @a fieldno of @a tuple, or NULL if the
+ * tuple is not the one the published cache describes.
+ */
+static inline const char *
+tuple_field_cached(const struct tuple *tuple, uint32_t fieldno)
+{
+	struct tuple_field_cache *cache = tuple_field_cache_cur;
+	if (cache == NULL || cache->tuple != tuple ||
+	    fieldno >= cache->field_count)
+		return NULL;
+	return cache->fields[fieldno];
+}
+
 /**
  * @brief Tuple Interator
  */
@@ -578,7 +687,7 @@ tuple_unref(struct tuple *tuple)
 	tuple->refs--;
 
 	if (tuple->refs == 0)
-		tuple_delete(tuple);
+		tuple_delete_deferred(tuple);
 }
 
 extern struct tuple *box_tuple_last;
@@ -632,8 +741,16 @@ tuple_hash(const struct tuple *tuple, const struct key_def *key_def)
 	 * single-part hash_table over an integer field.
 	 */
 	if (key_def->part_count == 1 && part->type == FIELD_TYPE_UNSIGNED) {
-		const char *field = tuple_field(tuple, part->fieldno);
-		uint64_t val = mp_decode_uint(&field);
+		uint64_t val;
+		struct tuple_field_cache *cache = tuple_field_cache_cur;
+		if (cache != NULL && cache->tuple == tuple &&
+		    part->fieldno < cache->field_count &&
+		    (cache->uint_mask & (1U << part->fieldno))) {
+			val = cache->uint_vals[part->fieldno];
+		} else {
+			const char *field = tuple_field(tuple, part->fieldno);
+			val = mp_decode_uint(&field);
+		}
 		if (likely(val <= UINT32_MAX))
 			return val;
 		return ((uint32_t)((val)>>33^(val)^(val)<<11));
@@ -670,6 +787,23 @@ key_hash(const char *key, const struct key_def *key_def)
 	return key_hash_slow_path(key, key_def);
 }
 
+typedef uint32_t (*tuple_hash_func)(const struct tuple *tuple,
+				    const struct key_def *key_def);
+typedef uint32_t (*key_hash_func)(const char *key,
+				  const struct key_def *key_def);
+
+/**
+ * Pointers to the hash family used by volatile hash tables, e.g.
+ * memtx hash indexes. Selected once per process in tuple_init():
+ * a CRC32C-instruction based implementation on CPUs with SSE 4.2,
+ * plain tuple_hash()/key_hash() otherwise. The selection depends
+ * on the CPU, so anything whose hashes outlive the process - the
+ * vinyl bloom filters in particular - must keep calling
+ * tuple_hash()/key_hash() directly.
+ */
+extern tuple_hash_func tuple_hash_calc;
+extern key_hash_func key_hash_calc;
+
 /** These functions are implemented in tuple_convert.cc. */
 
 struct obuf;
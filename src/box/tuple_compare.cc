@@ -343,16 +343,58 @@ tuple_compare_slowpath_raw(const struct tuple_format *format_a,
 	return r;
 }
 
+/**
+ * Field lookup through the compiled comparison plan,
+ * @sa key_part::offset_slot. The caller must have checked that
+ * the tuple's format is the one the plan was built for.
+ */
+static inline const char *
+plan_field(const struct tuple_format *format, const char *data,
+	   const uint32_t *field_map, const struct key_part *part)
+{
+	int32_t offset_slot = part->offset_slot;
+	if (likely(offset_slot != TUPLE_OFFSET_SLOT_NIL))
+		return data + field_map[offset_slot];
+	return tuple_field_raw(format, data, field_map, part->fieldno);
+}
+
 static int
 tuple_compare_slowpath(const struct tuple *tuple_a, const struct tuple *tuple_b,
 		       const struct key_def *key_def)
 {
-	return tuple_compare_slowpath_raw(tuple_format(tuple_a),
-					  tuple_data(tuple_a),
-					  tuple_field_map(tuple_a),
-					  tuple_format(tuple_b),
-					  tuple_data(tuple_b),
-					  tuple_field_map(tuple_b), key_def);
+	const struct tuple_format *format_a = tuple_format(tuple_a);
+	const struct tuple_format *format_b = tuple_format(tuple_b);
+	if (key_def->plan_format_id != format_a->id ||
+	    key_def->plan_format_id != format_b->id) {
+		return tuple_compare_slowpath_raw(format_a,
+						  tuple_data(tuple_a),
+						  tuple_field_map(tuple_a),
+						  format_b,
+						  tuple_data(tuple_b),
+						  tuple_field_map(tuple_b),
+						  key_def);
+	}
+	/*
+	 * Both tuples are of the format the plan was compiled
+	 * for: each part carries the offset slot of its field,
+	 * no dependent load through format->fields[] per part.
+	 */
+	const char *data_a = tuple_data(tuple_a);
+	const uint32_t *field_map_a = tuple_field_map(tuple_a);
+	const char *data_b = tuple_data(tuple_b);
+	const uint32_t *field_map_b = tuple_field_map(tuple_b);
+	const struct key_part *part = key_def->parts;
+	const struct key_part *end = part + key_def->part_count;
+	int r = 0;
+	for (; part < end; part++) {
+		const char *field_a = plan_field(format_a, data_a,
+						 field_map_a, part);
+		const char *field_b = plan_field(format_b, data_b,
+						 field_map_b, part);
+		if ((r = tuple_compare_field(field_a, field_b, part->type)))
+			break;
+	}
+	return r;
 }
 
 static inline int
@@ -455,10 +497,35 @@ tuple_compare_with_key_slowpath(const struct tuple *tuple, const char *key,
 			        uint32_t part_count,
 			        const struct key_def *key_def)
 {
-	return tuple_compare_with_key_slowpath_raw(tuple_format(tuple),
-						   tuple_data(tuple),
-						   tuple_field_map(tuple), key,
-						   part_count, key_def);
+	const struct tuple_format *format = tuple_format(tuple);
+	if (key_def->plan_format_id != format->id) {
+		return tuple_compare_with_key_slowpath_raw(format,
+							   tuple_data(tuple),
+							   tuple_field_map(tuple),
+							   key, part_count,
+							   key_def);
+	}
+	/* The compiled plan variant, @sa tuple_compare_slowpath(). */
+	assert(key != NULL || part_count == 0);
+	assert(part_count <= key_def->part_count);
+	const char *data = tuple_data(tuple);
+	const uint32_t *field_map = tuple_field_map(tuple);
+	const struct key_part *part = key_def->parts;
+	if (likely(part_count == 1)) {
+		const char *field = plan_field(format, data, field_map, part);
+		return tuple_compare_field(field, key, part->type);
+	}
+	const struct key_part *end = part + MIN(part_count,
+						key_def->part_count);
+	int r = 0; /* Part count can be 0 in wildcard searches. */
+	for (; part < end; part++) {
+		const char *field = plan_field(format, data, field_map, part);
+		r = tuple_compare_field(field, key, part->type);
+		if (r != 0)
+			break;
+		mp_next(&key);
+	}
+	return r;
 }
 
 template <int TYPE>
@@ -611,6 +678,134 @@ struct TupleCompare<0, TYPE, MORE_TYPES...> {
 };
 } /* end of anonymous namespace */
 
+/**
+ * A comparator for a single key part selected by the part's field
+ * type once, when a key_def is created. Using a table of these
+ * instead of a switch on part->type removes the per-part branch
+ * cascade from the comparison inner loop.
+ */
+static int
+mp_compare_uint_f(const char *field_a, const char *field_b)
+{
+	return mp_compare_uint(field_a, field_b);
+}
+
+static int
+mp_compare_str_f(const char *field_a, const char *field_b)
+{
+	return mp_compare_str(field_a, field_b);
+}
+
+static const mp_compare_f field_type_comparators[] = {
+	/* .FIELD_TYPE_ANY      = */ NULL,
+	/* .FIELD_TYPE_UNSIGNED = */ mp_compare_uint_f,
+	/* .FIELD_TYPE_STRING   = */ mp_compare_str_f,
+	/* .FIELD_TYPE_ARRAY    = */ NULL,
+	/* .FIELD_TYPE_NUMBER   = */ mp_compare_number,
+	/* .FIELD_TYPE_INTEGER  = */ mp_compare_integer,
+	/* .FIELD_TYPE_SCALAR   = */ mp_compare_scalar,
+};
+
+/** Max part count for which an unrolled comparator is generated. */
+enum { COMPARE_UNROLL_PART_MAX = 8 };
+
+/**
+ * A comparator instantiated for each supported part count.
+ * The constant trip count lets the compiler fully unroll the
+ * loop, and the per-part type dispatch is a single indirect call
+ * through field_type_comparators, so an arbitrary mix of field
+ * types avoids tuple_compare_slowpath() and its type switch.
+ */
+template <uint32_t PART_COUNT>
+static int
+tuple_compare_unrolled(const struct tuple *tuple_a,
+		       const struct tuple *tuple_b,
+		       const struct key_def *key_def)
+{
+	assert(key_def->part_count == PART_COUNT);
+	struct tuple_format *format_a = tuple_format(tuple_a);
+	struct tuple_format *format_b = tuple_format(tuple_b);
+	const char *data_a = tuple_data(tuple_a);
+	const char *data_b = tuple_data(tuple_b);
+	const uint32_t *field_map_a = tuple_field_map(tuple_a);
+	const uint32_t *field_map_b = tuple_field_map(tuple_b);
+	const struct key_part *part = key_def->parts;
+	for (uint32_t i = 0; i < PART_COUNT; i++, part++) {
+		const char *field_a = tuple_field_raw(format_a, data_a,
+						      field_map_a,
+						      part->fieldno);
+		const char *field_b = tuple_field_raw(format_b, data_b,
+						      field_map_b,
+						      part->fieldno);
+		assert(field_a != NULL && field_b != NULL);
+		int r = field_type_comparators[part->type](field_a, field_b);
+		if (r != 0)
+			return r;
+	}
+	return 0;
+}
+
+template <uint32_t PART_COUNT>
+static int
+tuple_compare_with_key_unrolled(const struct tuple *tuple, const char *key,
+				uint32_t part_count,
+				const struct key_def *key_def)
+{
+	assert(key_def->part_count == PART_COUNT);
+	assert(part_count <= PART_COUNT);
+	struct tuple_format *format = tuple_format(tuple);
+	const char *data = tuple_data(tuple);
+	const uint32_t *field_map = tuple_field_map(tuple);
+	const struct key_part *part = key_def->parts;
+	for (uint32_t i = 0; i < PART_COUNT; i++, part++) {
+		/* Part count can be 0 in wildcard searches. */
+		if (i >= part_count)
+			return 0;
+		const char *field = tuple_field_raw(format, data, field_map,
+						    part->fieldno);
+		int r = field_type_comparators[part->type](field, key);
+		if (r != 0)
+			return r;
+		mp_next(&key);
+	}
+	return 0;
+}
+
+static const tuple_compare_t compare_unrolled_arr[] = {
+	NULL,
+	tuple_compare_unrolled<1>, tuple_compare_unrolled<2>,
+	tuple_compare_unrolled<3>, tuple_compare_unrolled<4>,
+	tuple_compare_unrolled<5>, tuple_compare_unrolled<6>,
+	tuple_compare_unrolled<7>, tuple_compare_unrolled<8>,
+};
+
+static const tuple_compare_with_key_t compare_with_key_unrolled_arr[] = {
+	NULL,
+	tuple_compare_with_key_unrolled<1>, tuple_compare_with_key_unrolled<2>,
+	tuple_compare_with_key_unrolled<3>, tuple_compare_with_key_unrolled<4>,
+	tuple_compare_with_key_unrolled<5>, tuple_compare_with_key_unrolled<6>,
+	tuple_compare_with_key_unrolled<7>, tuple_compare_with_key_unrolled<8>,
+};
+
+/**
+ * True if every part of @a def can be compared through
+ * field_type_comparators, i.e. an unrolled comparator is
+ * applicable.
+ */
+static bool
+key_def_is_unrollable(const struct key_def *def)
+{
+	if (def->part_count == 0 ||
+	    def->part_count > COMPARE_UNROLL_PART_MAX)
+		return false;
+	for (uint32_t i = 0; i < def->part_count; i++) {
+		if (def->parts[i].type >= field_type_MAX ||
+		    field_type_comparators[def->parts[i].type] == NULL)
+			return false;
+	}
+	return true;
+}
+
 struct comparator_signature {
 	tuple_compare_t f;
 	uint32_t p[64];
@@ -653,6 +848,8 @@ tuple_compare_create(const struct key_def *def) {
 	}
 	if (key_def_is_sequential(def))
 		return tuple_compare_sequential;
+	if (key_def_is_unrollable(def))
+		return compare_unrolled_arr[def->part_count];
 	return tuple_compare_slowpath;
 }
 
@@ -854,6 +1051,8 @@ tuple_compare_with_key_create(const struct key_def *def)
 	}
 	if (key_def_is_sequential(def))
 		return tuple_compare_with_key_sequential;
+	if (key_def_is_unrollable(def))
+		return compare_with_key_unrolled_arr[def->part_count];
 	return tuple_compare_with_key_slowpath;
 }
 
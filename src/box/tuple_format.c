@@ -29,6 +29,7 @@
  * SUCH DAMAGE.
  */
 #include "tuple_format.h"
+#include "third_party/PMurHash.h"
 
 /** Global table of tuple formats */
 struct tuple_format **tuple_formats;
@@ -36,14 +37,30 @@ struct tuple_format *tuple_format_default;
 static intptr_t recycled_format_ids = FORMAT_ID_NIL;
 
 static uint32_t formats_size = 0, formats_capacity = 0;
+/** The number of live registered formats. */
+static uint32_t formats_active = 0;
+/** How many times an interned format was returned instead of a new one. */
+static uint64_t formats_reused = 0;
+/** Formats eligible for interning, @sa tuple_format_new(). */
+static RLIST_HEAD(interned_formats);
+
+/** @sa declaration for details. */
+uint32_t tuple_field_map_ext_budget = 0;
+
+static int
+tuple_init_field_map_typed(const struct tuple_format *format,
+			   uint32_t *field_map, const char *tuple);
 
 /** Extract all available type info from keys. */
 static int
 tuple_format_create(struct tuple_format *format, struct key_def **keys,
 		    uint16_t key_count)
 {
+	format->field_map_decoder = NULL;
 	if (format->field_count == 0) {
 		format->field_map_size = 0;
+		format->ext_field_count = 0;
+		format->ext_offset_slot = TUPLE_OFFSET_SLOT_NIL;
 		return 0;
 	}
 
@@ -96,6 +113,26 @@ tuple_format_create(struct tuple_format *format, struct key_def **keys,
 	}
 
 	assert(format->fields[0].offset_slot == TUPLE_OFFSET_SLOT_NIL);
+	/*
+	 * Spend the field map extension budget on fields which did
+	 * not get an offset slot above: first on gaps between
+	 * indexed fields, then on fields right after the last
+	 * indexed one. Offsets of these fields are materialized
+	 * along the way in tuple_init_field_map() and make repeated
+	 * reads of hot unindexed fields O(1).
+	 */
+	uint32_t ext_budget = tuple_field_map_ext_budget / sizeof(uint32_t);
+	for (uint32_t i = 1; i < format->field_count && ext_budget > 0; i++) {
+		if (format->fields[i].offset_slot != TUPLE_OFFSET_SLOT_NIL)
+			continue;
+		format->fields[i].offset_slot = --current_slot;
+		ext_budget--;
+	}
+	format->ext_field_count = ext_budget;
+	format->ext_offset_slot = ext_budget > 0 ? current_slot - 1 :
+				  TUPLE_OFFSET_SLOT_NIL;
+	current_slot -= ext_budget;
+
 	size_t field_map_size = -current_slot * sizeof(uint32_t);
 	if (field_map_size + format->extra_size > UINT16_MAX) {
 		/** tuple->data_offset is 16 bits */
@@ -104,6 +141,37 @@ tuple_format_create(struct tuple_format *format, struct key_def **keys,
 		return -1;
 	}
 	format->field_map_size = field_map_size;
+	/*
+	 * A fully typed format gets a specialized decoder: when
+	 * every field's type is pinned by some index, the walk
+	 * over the tuple compiles into per-type straight-line
+	 * decoding, @sa tuple_init_field_map_typed().
+	 */
+	bool is_fully_typed = true;
+	for (uint32_t i = 0; i < format->field_count; i++) {
+		if (format->fields[i].type == FIELD_TYPE_ANY) {
+			is_fully_typed = false;
+			break;
+		}
+	}
+	if (is_fully_typed)
+		format->field_map_decoder = tuple_init_field_map_typed;
+	/*
+	 * Compile the comparison plan: interleave each key part
+	 * with the offset slot of its field in this format, so
+	 * the comparator loop reads everything about a part
+	 * from the part entry itself instead of going through
+	 * format->fields[], @sa tuple_compare.cc.
+	 */
+	for (uint16_t key_no = 0; key_no < key_count; ++key_no) {
+		struct key_def *key_def = keys[key_no];
+		for (uint32_t i = 0; i < key_def->part_count; i++) {
+			struct key_part *part = &key_def->parts[i];
+			part->offset_slot =
+				format->fields[part->fieldno].offset_slot;
+		}
+		key_def->plan_format_id = format->id;
+	}
 	return 0;
 }
 
@@ -140,6 +208,7 @@ tuple_format_register(struct tuple_format *format)
 		format->id = formats_size++;
 	}
 	tuple_formats[format->id] = format;
+	formats_active++;
 	return 0;
 }
 
@@ -151,6 +220,7 @@ tuple_format_deregister(struct tuple_format *format)
 	tuple_formats[format->id] = (struct tuple_format *) recycled_format_ids;
 	recycled_format_ids = format->id;
 	format->id = FORMAT_ID_NIL;
+	formats_active--;
 }
 
 static struct tuple_format *
@@ -182,25 +252,72 @@ tuple_format_alloc(struct key_def **keys, uint16_t key_count)
 	format->id = FORMAT_ID_NIL;
 	format->field_count = field_count;
 	format->exact_field_count = 0;
+	format->min_field_count = 0;
+	format->tuple_count = 0;
+	format->tuple_mem_used = 0;
+	rlist_create(&format->in_interned);
 	return format;
 }
 
 void
 tuple_format_delete(struct tuple_format *format)
 {
+	rlist_del(&format->in_interned);
 	tuple_format_deregister(format);
 	free(format);
 }
 
+/** Content hash of a format, @sa tuple_format_new(). */
+static uint32_t
+tuple_format_calc_hash(const struct tuple_format *format)
+{
+	uint32_t h = 13;
+	uint32_t carry = 0;
+	uint32_t size = format->field_count *
+			sizeof(struct tuple_field_format);
+	PMurHash32_Process(&h, &carry, format->fields, size);
+	PMurHash32_Process(&h, &carry, &format->extra_size,
+			   sizeof(format->extra_size));
+	size += sizeof(format->extra_size);
+	PMurHash32_Process(&h, &carry, &format->exact_field_count,
+			   sizeof(format->exact_field_count));
+	size += sizeof(format->exact_field_count);
+	PMurHash32_Process(&h, &carry, &format->min_field_count,
+			   sizeof(format->min_field_count));
+	size += sizeof(format->min_field_count);
+	return PMurHash32_Result(h, carry, size);
+}
+
+/** True if two formats describe identical tuple layouts. */
+static bool
+tuple_format_eq(const struct tuple_format *a, const struct tuple_format *b)
+{
+	return a->vtab.destroy == b->vtab.destroy &&
+	       a->extra_size == b->extra_size &&
+	       a->exact_field_count == b->exact_field_count &&
+	       a->min_field_count == b->min_field_count &&
+	       a->field_count == b->field_count &&
+	       a->field_map_size == b->field_map_size &&
+	       a->ext_field_count == b->ext_field_count &&
+	       a->ext_offset_slot == b->ext_offset_slot &&
+	       memcmp(a->fields, b->fields, a->field_count *
+		      sizeof(struct tuple_field_format)) == 0;
+}
+
 struct tuple_format *
 tuple_format_new(struct tuple_format_vtab *vtab, struct key_def **keys,
-		 uint16_t key_count, uint16_t extra_size)
+		 uint16_t key_count, uint16_t extra_size,
+		 uint32_t exact_field_count, uint32_t min_field_count)
 {
 	struct tuple_format *format = tuple_format_alloc(keys, key_count);
 	if (format == NULL)
 		return NULL;
 	format->vtab = *vtab;
 	format->extra_size = extra_size;
+	format->exact_field_count = exact_field_count;
+	/* No explicit lower bound - the field count is exact. */
+	format->min_field_count =
+		min_field_count != 0 ? min_field_count : exact_field_count;
 	if (tuple_format_register(format) < 0) {
 		tuple_format_delete(format);
 		return NULL;
@@ -209,9 +326,57 @@ tuple_format_new(struct tuple_format_vtab *vtab, struct key_def **keys,
 		tuple_format_delete(format);
 		return NULL;
 	}
+	format->hash = tuple_format_calc_hash(format);
+	/*
+	 * Intern: if a format with identical content already
+	 * exists, drop the new object and share the existing one.
+	 * Formats are immutable after creation, so sharing is
+	 * transparent; it also keeps the comparison plans of all
+	 * spaces with equal definitions on one format id.
+	 */
+	struct tuple_format *other;
+	rlist_foreach_entry(other, &interned_formats, in_interned) {
+		if (other->hash != format->hash ||
+		    !tuple_format_eq(other, format))
+			continue;
+		/*
+		 * tuple_format_create() stamped the comparison
+		 * plan of the keys with the new id; move it over
+		 * to the interned format. The offset slots match
+		 * since the field arrays are identical.
+		 */
+		for (uint16_t key_no = 0; key_no < key_count; ++key_no)
+			keys[key_no]->plan_format_id = other->id;
+		tuple_format_delete(format);
+		formats_reused++;
+		return other;
+	}
+	rlist_add_entry(&interned_formats, format, in_interned);
 	return format;
 }
 
+void
+tuple_format_stats(uint32_t *n_formats, uint64_t *n_reused)
+{
+	*n_formats = formats_active;
+	*n_reused = formats_reused;
+}
+
+int
+tuple_format_mem_stats_foreach(int (*cb)(const struct tuple_format *format,
+					 void *cb_ctx), void *cb_ctx)
+{
+	struct tuple_format *format;
+	rlist_foreach_entry(format, &interned_formats, in_interned) {
+		if (format->tuple_count == 0)
+			continue;
+		int rc = cb(format, cb_ctx);
+		if (rc != 0)
+			return rc;
+	}
+	return 0;
+}
+
 struct tuple_format *
 tuple_format_dup(const struct tuple_format *src)
 {
@@ -226,6 +391,14 @@ tuple_format_dup(const struct tuple_format *src)
 	}
 	memcpy(format, src, total);
 	format->id = FORMAT_ID_NIL;
+	format->tuple_count = 0;
+	format->tuple_mem_used = 0;
+	/*
+	 * The copy is owned and possibly mutated by the caller:
+	 * keep it off the interning list (the memcpy above aliased
+	 * the source links).
+	 */
+	rlist_create(&format->in_interned);
 	if (tuple_format_register(format) != 0) {
 		free(format);
 		return NULL;
@@ -233,10 +406,10 @@ tuple_format_dup(const struct tuple_format *src)
 	return format;
 }
 
-/** @sa declaration for details. */
-int
-tuple_init_field_map(const struct tuple_format *format, uint32_t *field_map,
-		     const char *tuple)
+/** The generic field map walker, @sa tuple_init_field_map(). */
+static int
+tuple_init_field_map_slow(const struct tuple_format *format,
+			  uint32_t *field_map, const char *tuple)
 {
 	if (format->field_count == 0)
 		return 0; /* Nothing to initialize */
@@ -245,8 +418,9 @@ tuple_init_field_map(const struct tuple_format *format, uint32_t *field_map,
 
 	/* Check to see if the tuple has a sufficient number of fields. */
 	uint32_t field_count = mp_decode_array(&pos);
-	if (format->exact_field_count > 0 &&
-	    format->exact_field_count != field_count) {
+	if (field_count < format->min_field_count ||
+	    (format->exact_field_count > 0 &&
+	     field_count > format->exact_field_count)) {
 		diag_set(ClientError, ER_EXACT_FIELD_COUNT,
 			 (unsigned) field_count,
 			 (unsigned) format->exact_field_count);
@@ -276,14 +450,119 @@ tuple_init_field_map(const struct tuple_format *format, uint32_t *field_map,
 				(uint32_t) (pos - tuple);
 		mp_next(&pos);
 	}
+	/*
+	 * Materialize offsets of unindexed fields following the
+	 * last indexed one, as far as the field map extension
+	 * reaches. A missing field leaves 0 in its slot, which is
+	 * never a valid field offset: the array header of the
+	 * tuple comes first.
+	 */
+	for (uint32_t i = 0; i < format->ext_field_count; i++) {
+		int32_t offset_slot = format->ext_offset_slot - (int32_t) i;
+		if (format->field_count + i < field_count) {
+			field_map[offset_slot] = (uint32_t) (pos - tuple);
+			mp_next(&pos);
+		} else {
+			field_map[offset_slot] = 0;
+		}
+	}
 	return 0;
 }
 
+/**
+ * A decoder specialized for fully typed formats,
+ * @sa tuple_format::field_map_decoder. Since the type of every
+ * field is known up front, each field is validated and skipped
+ * with a straight-line per-type decode instead of the generic
+ * mp_typeof()/mp_next() dispatch. The two types which dominate
+ * rigid formats, unsigned and string, never enter the msgpack
+ * jump table at all. On the first field which contradicts the
+ * format the walk is restarted on the generic path, which owns
+ * the exact diagnostics.
+ */
+static int
+tuple_init_field_map_typed(const struct tuple_format *format,
+			   uint32_t *field_map, const char *tuple)
+{
+	const char *pos = tuple;
+
+	uint32_t field_count = mp_decode_array(&pos);
+	if (field_count < format->min_field_count ||
+	    (format->exact_field_count > 0 &&
+	     field_count > format->exact_field_count)) {
+		diag_set(ClientError, ER_EXACT_FIELD_COUNT,
+			 (unsigned) field_count,
+			 (unsigned) format->exact_field_count);
+		return -1;
+	}
+	if (unlikely(field_count < format->field_count)) {
+		diag_set(ClientError, ER_INDEX_FIELD_COUNT,
+			 (unsigned) field_count,
+			 (unsigned) format->field_count);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < format->field_count; i++) {
+		const struct tuple_field_format *field = &format->fields[i];
+		if (field->offset_slot != TUPLE_OFFSET_SLOT_NIL)
+			field_map[field->offset_slot] =
+				(uint32_t) (pos - tuple);
+		switch (field->type) {
+		case FIELD_TYPE_UNSIGNED:
+			if (unlikely(mp_typeof(*pos) != MP_UINT))
+				goto mismatch;
+			(void) mp_decode_uint(&pos);
+			break;
+		case FIELD_TYPE_STRING: {
+			if (unlikely(mp_typeof(*pos) != MP_STR))
+				goto mismatch;
+			uint32_t len = mp_decode_strl(&pos);
+			pos += len;
+			break;
+		}
+		default:
+			/*
+			 * Permissive types (number, integer,
+			 * scalar, array): a mask check plus the
+			 * generic skip.
+			 */
+			if (key_mp_type_validate(field->type, mp_typeof(*pos),
+						 ER_FIELD_TYPE,
+						 i + TUPLE_INDEX_BASE))
+				return -1;
+			mp_next(&pos);
+			break;
+		}
+	}
+	for (uint32_t i = 0; i < format->ext_field_count; i++) {
+		int32_t offset_slot = format->ext_offset_slot - (int32_t) i;
+		if (format->field_count + i < field_count) {
+			field_map[offset_slot] = (uint32_t) (pos - tuple);
+			mp_next(&pos);
+		} else {
+			field_map[offset_slot] = 0;
+		}
+	}
+	return 0;
+mismatch:
+	return tuple_init_field_map_slow(format, field_map, tuple);
+}
+
+/** @sa declaration for details. */
+int
+tuple_init_field_map(const struct tuple_format *format, uint32_t *field_map,
+		     const char *tuple)
+{
+	if (format->field_map_decoder != NULL)
+		return format->field_map_decoder(format, field_map, tuple);
+	return tuple_init_field_map_slow(format, field_map, tuple);
+}
+
 int
 tuple_format_init()
 {
 	tuple_format_default = tuple_format_new(&memtx_tuple_format_vtab,
-						NULL, 0, 0);
+						NULL, 0, 0, 0, 0);
 	if (tuple_format_default == NULL)
 		return -1;
 	/* Make sure this one stays around. */
@@ -312,7 +591,7 @@ box_tuple_format_t *
 box_tuple_format_new(struct key_def **keys, uint16_t key_count)
 {
 	box_tuple_format_t *format = tuple_format_new(&memtx_tuple_format_vtab,
-						      keys, key_count, 0);
+						      keys, key_count, 0, 0, 0);
 	if (format != NULL)
 		tuple_format_ref(format, 1);
 	return format;
@@ -114,6 +114,15 @@ struct tuple_format_vtab {
  */
 extern struct tuple_format_vtab memtx_tuple_format_vtab;
 
+/**
+ * Decode a tuple of this format: validate the fields and fill
+ * the field map with their offsets.
+ * @sa tuple_init_field_map() for the contract.
+ */
+typedef int
+(*tuple_field_map_decoder_f)(const struct tuple_format *format,
+			     uint32_t *field_map, const char *tuple);
+
 /**
  * @brief Tuple format
  * Tuple format describes how tuple is stored and information about its fields
@@ -141,12 +150,76 @@ struct tuple_format {
 	 * fields. If set, each tuple must have exactly this number of fields.
 	 */
 	uint32_t exact_field_count;
+	/**
+	 * The smallest field count a tuple is allowed to have.
+	 * Equal to exact_field_count unless the field count of a
+	 * non-empty space was raised online: then it stays at the
+	 * old count so tuples written before the alter remain
+	 * valid until they are rewritten with the new layout.
+	 * \sa space_opts::min_field_count
+	 */
+	uint32_t min_field_count;
 	/* Length of 'fields' array. */
 	uint32_t field_count;
+	/**
+	 * The number of extra offset slots for fields right
+	 * after the last indexed field. Gives O(1) access to
+	 * hot unindexed fields at the cost of 4 bytes of
+	 * metadata per slot per tuple. Bounded by
+	 * tuple_field_map_ext_budget at format creation.
+	 */
+	uint32_t ext_field_count;
+	/**
+	 * Offset slot of the first extended field; slots of the
+	 * subsequent extended fields follow it downwards:
+	 * ext_offset_slot - i for field_count + i.
+	 */
+	int32_t ext_offset_slot;
+	/**
+	 * A decoder specialized for this format, or NULL to use
+	 * the generic field map walker. Registered at format
+	 * creation when every field of the format is typed by
+	 * some index, which makes a straight-line per-type
+	 * decode possible. Used on the tuple_new() path of
+	 * replace, @sa tuple_init_field_map().
+	 */
+	tuple_field_map_decoder_f field_map_decoder;
+	/**
+	 * Link in the list of formats eligible for interning.
+	 * Formats are immutable once created, so spaces with
+	 * identical definitions share one format object, its
+	 * field map layout and its comparison plans,
+	 * @sa tuple_format_new(). Duplicated formats are mutated
+	 * by their owners and stay off the list.
+	 */
+	struct rlist in_interned;
+	/** Content hash, used to intern identical formats. */
+	uint32_t hash;
+	/**
+	 * Number of live memtx tuples of this format and the
+	 * bytes the slab allocator holds for them, header and
+	 * field map included. Maintained by the tx thread on
+	 * tuple allocation and freeing, so readers get a live
+	 * view without stopping the world. When identical spaces
+	 * share an interned format the counters aggregate all of
+	 * them.
+	 */
+	uint64_t tuple_count;
+	uint64_t tuple_mem_used;
 	/* Formats of the fields */
 	struct tuple_field_format fields[];
 };
 
+/**
+ * Per-tuple memory budget, in bytes, for field map entries of
+ * fields which do not participate in any index. Each 4 bytes of
+ * budget materialize the offset of one more field when a tuple is
+ * created, so repeated access to that field does not re-decode
+ * the tuple from the last indexed offset. 0 disables the
+ * extension.
+ */
+extern uint32_t tuple_field_map_ext_budget;
+
 /**
  * Default format for a tuple which does not belong
  * to any space and is stored in memory.
@@ -185,18 +258,47 @@ tuple_format_ref(struct tuple_format *format, int count)
 };
 
 /**
- * Allocate, construct and register a new in-memory tuple format.
- * @param vtab             Virtual function table for specific engines.
- * @param keys             Array of key_defs of a space.
- * @param key_count        The number of keys in @a keys array.
- * @param extra_size       Extra bytes to reserve in tuples metadata.
+ * Allocate, construct and register a new in-memory tuple format,
+ * or return an existing format with identical content: formats
+ * are immutable after creation and interned by a content hash,
+ * so spaces with matching definitions share one format object.
+ * @param vtab              Virtual function table for specific engines.
+ * @param keys              Array of key_defs of a space.
+ * @param key_count         The number of keys in @a keys array.
+ * @param extra_size        Extra bytes to reserve in tuples metadata.
+ * @param exact_field_count Exact tuple field count the format
+ *                          enforces, 0 for no constraint.
+ * @param min_field_count   Smallest field count still accepted,
+ *                          for spaces whose field count was
+ *                          raised online; 0 means tuples must
+ *                          have exactly @a exact_field_count
+ *                          fields.
  *
  * @retval not NULL Tuple format.
  * @retval     NULL Memory error.
  */
 struct tuple_format *
 tuple_format_new(struct tuple_format_vtab *vtab, struct key_def **keys,
-		 uint16_t key_count, uint16_t extra_size);
+		 uint16_t key_count, uint16_t extra_size,
+		 uint32_t exact_field_count, uint32_t min_field_count);
+
+/**
+ * Interned format statistics for box.info.formats: the number of
+ * live registered formats and the total number of times
+ * tuple_format_new() returned an existing format instead of
+ * creating one.
+ */
+void
+tuple_format_stats(uint32_t *n_formats, uint64_t *n_reused);
+
+/**
+ * Visit every interned format which owns live memtx tuples and
+ * report its memory counters, for box.slab.tuples(). Stops and
+ * returns the callback return value when it is not 0.
+ */
+int
+tuple_format_mem_stats_foreach(int (*cb)(const struct tuple_format *format,
+					 void *cb_ctx), void *cb_ctx);
 
 /**
  * Register the duplicate of the specified format.
@@ -300,6 +402,17 @@ tuple_field_raw(const struct tuple_format *format, const char *tuple,
 		int32_t offset_slot = format->fields[field_no].offset_slot;
 		if (offset_slot != TUPLE_OFFSET_SLOT_NIL)
 			return tuple + field_map[offset_slot];
+	} else if (field_no < format->field_count + format->ext_field_count) {
+		/*
+		 * An unindexed field covered by the field map
+		 * extension. A zero offset means the tuple is too
+		 * short to have this field materialized.
+		 */
+		int32_t offset_slot = format->ext_offset_slot -
+			(int32_t)(field_no - format->field_count);
+		uint32_t offset = field_map[offset_slot];
+		if (offset != 0)
+			return tuple + offset;
 	}
 	ERROR_INJECT(ERRINJ_TUPLE_FIELD, return NULL);
 	uint32_t field_count = mp_decode_array(&tuple);
@@ -100,7 +100,13 @@ struct tuple_update
 {
 	tuple_update_alloc_func alloc;
 	void *alloc_ctx;
-	struct rope *rope;
+	/**
+	 * Field index, embedded to avoid a separate allocation
+	 * per update. Rope nodes themselves come from the same
+	 * region as everything else and are recycled by the rope
+	 * node cache within a single update.
+	 */
+	struct rope rope;
 	struct update_op *ops;
 	uint32_t op_count;
 	int index_base; /* 0 for C and 1 for Lua */
@@ -504,26 +510,26 @@ make_arith_operation(struct op_arith_arg arg1, struct op_arith_arg arg2,
 static int
 do_op_insert(struct tuple_update *update, struct update_op *op)
 {
-	if (op_adjust_field_no(update, op, rope_size(update->rope) + 1))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope) + 1))
 		return -1;
 	struct update_field *field = (struct update_field *)
 		update->alloc(update->alloc_ctx, sizeof(*field));
 	if (field == NULL)
 		return -1;
 	update_field_init(field, op->arg.set.value, op->arg.set.length, 0);
-	return rope_insert(update->rope, op->field_no, field, 1);
+	return rope_insert(&update->rope, op->field_no, field, 1);
 }
 
 static int
 do_op_set(struct tuple_update *update, struct update_op *op)
 {
 	/* intepret '=' for n +1 field as insert */
-	if (op->field_no == (int32_t) rope_size(update->rope))
+	if (op->field_no == (int32_t) rope_size(&update->rope))
 		return do_op_insert(update, op);
-	if (op_adjust_field_no(update, op, rope_size(update->rope)))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope)))
 		return -1;
 	struct update_field *field = (struct update_field *)
-		rope_extract(update->rope, op->field_no);
+		rope_extract(&update->rope, op->field_no);
 	if (field == NULL)
 		return -1;
 	/* Ignore the previous op, if any. */
@@ -535,12 +541,12 @@ do_op_set(struct tuple_update *update, struct update_op *op)
 static int
 do_op_delete(struct tuple_update *update, struct update_op *op)
 {
-	if (op_adjust_field_no(update, op, rope_size(update->rope)))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope)))
 		return -1;
 	uint32_t delete_count = op->arg.del.count;
 
-	if ((uint64_t) op->field_no + delete_count > rope_size(update->rope))
-		delete_count = rope_size(update->rope) - op->field_no;
+	if ((uint64_t) op->field_no + delete_count > rope_size(&update->rope))
+		delete_count = rope_size(&update->rope) - op->field_no;
 
 	if (delete_count == 0) {
 		diag_set(ClientError, ER_UPDATE_FIELD,
@@ -550,18 +556,18 @@ do_op_delete(struct tuple_update *update, struct update_op *op)
 	}
 
 	for (uint32_t u = 0; u < delete_count; u++)
-		rope_erase(update->rope, op->field_no);
+		rope_erase(&update->rope, op->field_no);
 	return 0;
 }
 
 static int
 do_op_arith(struct tuple_update *update, struct update_op *op)
 {
-	if (op_adjust_field_no(update, op, rope_size(update->rope)))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope)))
 		return -1;
 
 	struct update_field *field = (struct update_field *)
-		rope_extract(update->rope, op->field_no);
+		rope_extract(&update->rope, op->field_no);
 	if (field == NULL)
 		return -1;
 	if (field->op) {
@@ -588,10 +594,10 @@ do_op_arith(struct tuple_update *update, struct update_op *op)
 static int
 do_op_bit(struct tuple_update *update, struct update_op *op)
 {
-	if (op_adjust_field_no(update, op, rope_size(update->rope)))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope)))
 		return -1;
 	struct update_field *field = (struct update_field *)
-		rope_extract(update->rope, op->field_no);
+		rope_extract(&update->rope, op->field_no);
 	if (field == NULL)
 		return -1;
 	struct op_bit_arg *arg = &op->arg.bit;
@@ -626,10 +632,10 @@ do_op_bit(struct tuple_update *update, struct update_op *op)
 static int
 do_op_splice(struct tuple_update *update, struct update_op *op)
 {
-	if (op_adjust_field_no(update, op, rope_size(update->rope)))
+	if (op_adjust_field_no(update, op, rope_size(&update->rope)))
 		return -1;
 	struct update_field *field = (struct update_field *)
-		rope_extract(update->rope, op->field_no);
+		rope_extract(&update->rope, op->field_no);
 	if (field == NULL)
 		return -1;
 	if (field->op) {
@@ -816,10 +822,8 @@ update_create_rope(struct tuple_update *update,
 {
 	uint32_t field_count = mp_decode_array(&tuple_data);
 
-	update->rope = rope_new(update_field_split, update, update->alloc,
-				region_alloc_free_stub, update->alloc_ctx);
-	if (update->rope == NULL)
-		return -1;
+	rope_create(&update->rope, update_field_split, update, update->alloc,
+		    region_alloc_free_stub, update->alloc_ctx);
 	/* Initialize the rope with the old tuple. */
 
 	struct update_field *first = (struct update_field *)
@@ -835,17 +839,17 @@ update_create_rope(struct tuple_update *update,
 	update_field_init(first, field, field_len,
 			  end - field - field_len);
 
-	return rope_append(update->rope, first, field_count);
+	return rope_append(&update->rope, first, field_count);
 }
 
 static uint32_t
 update_calc_tuple_length(struct tuple_update *update)
 {
-	uint32_t res = mp_sizeof_array(rope_size(update->rope));
+	uint32_t res = mp_sizeof_array(rope_size(&update->rope));
 	struct rope_iter it;
 	struct rope_node *node;
 
-	rope_iter_create(&it, update->rope);
+	rope_iter_create(&it, &update->rope);
 	for (node = rope_iter_start(&it); node; node = rope_iter_next(&it)) {
 		struct update_field *field =
 				(struct update_field *) rope_leaf_data(node);
@@ -861,7 +865,7 @@ static uint32_t
 update_write_tuple(struct tuple_update *update, char *buffer, char *buffer_end)
 {
 	char *new_data = buffer;
-	new_data = mp_encode_array(new_data, rope_size(update->rope));
+	new_data = mp_encode_array(new_data, rope_size(&update->rope));
 
 	(void) buffer_end;
 
@@ -870,7 +874,7 @@ update_write_tuple(struct tuple_update *update, char *buffer, char *buffer_end)
 	struct rope_iter it;
 	struct rope_node *node;
 
-	rope_iter_create(&it, update->rope);
+	rope_iter_create(&it, &update->rope);
 	for (node = rope_iter_start(&it); node; node = rope_iter_next(&it)) {
 		struct update_field *field = (struct update_field *)
 				rope_leaf_data(node);
@@ -894,7 +898,7 @@ update_write_tuple(struct tuple_update *update, char *buffer, char *buffer_end)
 		total_field_count += field_count;
 	}
 
-	assert(rope_size(update->rope) == total_field_count);
+	assert(rope_size(&update->rope) == total_field_count);
 	assert(new_data <= buffer_end);
 	return new_data - buffer; /* real_tuple_size */
 }
@@ -1123,6 +1127,140 @@ tuple_update_check_ops(tuple_update_alloc_func alloc, void *alloc_ctx,
 	return update_read_ops(&update, expr, expr_end);
 }
 
+/**
+ * Apply a simple update without building a rope.
+ *
+ * When every operation is a scalar assignment, arithmetic or
+ * bitwise op which does not change the binary size of its field,
+ * the result differs from the old tuple only in a few byte
+ * ranges. For such updates (e.g. box.update('+') on a counter
+ * field) the rope is pure overhead: copy the old tuple once and
+ * patch the changed fields in the copy.
+ *
+ * Returns the new tuple data, or NULL when the update does not
+ * qualify (or allocation failed) and the generic rope path must
+ * be taken. Operation arguments are never modified here, so
+ * replaying the ops through the rope after a fallback is safe;
+ * any diagnostics set here would be set identically by the
+ * generic path.
+ */
+static const char *
+update_patch_scalars(struct tuple_update *update, const char *old_data,
+		     const char *old_data_end, uint32_t *p_tuple_len)
+{
+	/*
+	 * column_mask == UINT64_MAX means some operation touches
+	 * a field outside [0, 63] or shifts fields around; leave
+	 * such updates to the rope to keep the bookkeeping cheap.
+	 */
+	if (update->op_count == 0 || update->column_mask == UINT64_MAX)
+		return NULL;
+	uint64_t seen = 0;
+	struct update_op *op = update->ops;
+	struct update_op *ops_end = op + update->op_count;
+	for (; op < ops_end; op++) {
+		switch (op->opcode) {
+		case '=':
+		case '+':
+		case '-':
+		case '&':
+		case '|':
+		case '^':
+			break;
+		default:
+			return NULL;
+		}
+		assert(op->field_no >= 0 && op->field_no <= 63);
+		uint64_t bit = (uint64_t) 1 << op->field_no;
+		/* Leave double updates of a field to the rope. */
+		if (seen & bit)
+			return NULL;
+		seen |= bit;
+	}
+	const char *pos = old_data;
+	uint32_t field_count = mp_decode_array(&pos);
+	/*
+	 * Locate the updated fields in a single pass over the
+	 * tuple prefix. fields[i + 1] doubles as the end of
+	 * field i.
+	 */
+	const char *fields[64 + 1];
+	uint32_t prefix = field_count < 64 ? field_count : 64;
+	for (uint32_t i = 0; i < prefix; i++) {
+		fields[i] = pos;
+		mp_next(&pos);
+	}
+	fields[prefix] = pos;
+	for (op = update->ops; op < ops_end; op++) {
+		/*
+		 * A missing field - or '=' appending a field
+		 * right after the last one - changes the tuple
+		 * layout, which is the rope's job.
+		 */
+		if ((uint32_t) op->field_no >= prefix)
+			return NULL;
+	}
+	uint32_t len = old_data_end - old_data;
+	char *buf = (char *) update->alloc(update->alloc_ctx, len);
+	if (buf == NULL)
+		return NULL;
+	memcpy(buf, old_data, len);
+	for (op = update->ops; op < ops_end; op++) {
+		const char *old = fields[op->field_no];
+		uint32_t old_len = fields[op->field_no + 1] - old;
+		char *out = buf + (old - old_data);
+		switch (op->opcode) {
+		case '=':
+			if (op->arg.set.length != old_len)
+				return NULL;
+			memcpy(out, op->arg.set.value, old_len);
+			break;
+		case '+':
+		case '-': {
+			struct op_arith_arg left, res;
+			const char *f = old;
+			if (mp_read_arith_arg(update->index_base, op, &f,
+					      &left) != 0)
+				return NULL;
+			if (make_arith_operation(left, op->arg.arith,
+						 op->opcode,
+						 update->index_base +
+						 op->field_no, &res) != 0)
+				return NULL;
+			if (mp_sizeof_op_arith_arg(res) != old_len)
+				return NULL;
+			store_op_arith(&res, NULL, out);
+			break;
+		}
+		default: {
+			const char *f = old;
+			uint64_t val;
+			if (mp_read_uint(update->index_base, op, &f,
+					 &val) != 0)
+				return NULL;
+			switch (op->opcode) {
+			case '&':
+				val &= op->arg.bit.val;
+				break;
+			case '|':
+				val |= op->arg.bit.val;
+				break;
+			default:
+				assert(op->opcode == '^');
+				val ^= op->arg.bit.val;
+				break;
+			}
+			if (mp_sizeof_uint(val) != old_len)
+				return NULL;
+			mp_encode_uint(out, val);
+			break;
+		}
+		}
+	}
+	*p_tuple_len = len;
+	return buf;
+}
+
 const char *
 tuple_update_execute(tuple_update_alloc_func alloc, void *alloc_ctx,
 		     const char *expr,const char *expr_end,
@@ -1135,11 +1273,17 @@ tuple_update_execute(tuple_update_alloc_func alloc, void *alloc_ctx,
 
 	if (update_read_ops(&update, expr, expr_end))
 		return NULL;
-	if (update_do_ops(&update, old_data, old_data_end))
-		return NULL;
 	if (column_mask)
 		*column_mask = update.column_mask;
 
+	const char *new_data = update_patch_scalars(&update, old_data,
+						    old_data_end, p_tuple_len);
+	if (new_data != NULL)
+		return new_data;
+
+	if (update_do_ops(&update, old_data, old_data_end))
+		return NULL;
+
 	return update_finish(&update, p_tuple_len);
 }
 
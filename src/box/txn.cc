@@ -29,6 +29,8 @@
  * SUCH DAMAGE.
  */
 #include "txn.h"
+#include <stdlib.h>
+#include "alloc_stat.h"
 #include "engine.h"
 #include "tuple.h"
 #include "journal.h"
@@ -51,6 +53,12 @@ fiber_set_txn(struct fiber *fiber, struct txn *txn)
 	fiber_set_key(fiber, FIBER_KEY_TXN, (void *) txn);
 }
 
+static bool
+txn_commit_is_async(struct txn *txn);
+
+static struct journal_entry *
+txn_entry_new_detached(struct txn *txn);
+
 static void
 txn_add_redo(struct txn_stmt *stmt, struct request *request)
 {
@@ -85,6 +93,7 @@ txn_stmt_new(struct txn *txn)
 	stmt->bsize_change = 0;
 	stmt->engine_savepoint = NULL;
 	stmt->row = NULL;
+	stmt->field_cache.tuple = NULL;
 
 	stailq_add_tail_entry(&txn->stmts, stmt, next);
 	++txn->in_sub_stmt;
@@ -143,6 +152,95 @@ txn_begin_stmt(struct space *space)
 	return txn;
 }
 
+struct txn *
+txn_begin_stmt_fast(struct txn_fast *fast, struct space *space)
+{
+	assert(! in_txn());
+	struct txn *txn = &fast->txn;
+	/* Initialize members explicitly to save time on memset() */
+	stailq_create(&txn->stmts);
+	txn->n_rows = 0;
+	txn->is_autocommit = true;
+	txn->has_triggers  = false;
+	txn->in_sub_stmt = 0;
+	txn->engine = NULL;
+	txn->engine_tx = NULL;
+	fiber_set_txn(fiber(), txn);
+
+	Engine *engine = space->handler->engine;
+	txn_begin_in_engine(engine, txn);
+
+	struct txn_stmt *stmt = &fast->stmt;
+	stmt->space = space;
+	stmt->old_tuple = NULL;
+	stmt->new_tuple = NULL;
+	stmt->bsize_change = 0;
+	stmt->engine_savepoint = NULL;
+	stmt->row = NULL;
+	stmt->field_cache.tuple = NULL;
+	stailq_add_tail_entry(&txn->stmts, stmt, next);
+	++txn->in_sub_stmt;
+
+	engine->beginStatement(txn);
+	return txn;
+}
+
+void
+txn_commit_stmt_fast(struct txn *txn, struct request *request)
+{
+	assert(txn == in_txn());
+	assert(txn->in_sub_stmt == 1);
+	struct txn_stmt *stmt = txn_last_stmt(txn);
+	assert(rlist_empty(&stmt->space->on_replace));
+
+	/* Create WAL record for the write requests in non-temporary spaces */
+	if (!space_is_temporary(stmt->space)) {
+		txn_add_redo(stmt, request);
+		++txn->n_rows;
+	}
+	--txn->in_sub_stmt;
+
+	assert(txn->engine != NULL);
+	int64_t signature = -1;
+	txn->engine->prepare(txn);
+	if (txn->n_rows > 0) {
+		bool async = txn_commit_is_async(txn);
+		struct journal_entry *req;
+		if (async) {
+			req = txn_entry_new_detached(txn);
+		} else {
+			/* A single-row journal entry, no statement walk. */
+			req = journal_entry_new(1);
+			if (req == NULL)
+				diag_raise();
+			req->rows[0] = stmt->row;
+		}
+
+		ev_tstamp start = ev_now(loop()), stop;
+		int64_t res = journal_write(req);
+		stop = ev_now(loop());
+		if (stop - start > too_long_threshold)
+			say_warn("too long WAL write: %.3f sec", stop - start);
+		if (res < 0) {
+			if (async)
+				free(req);
+			/* Cascading rollback, see txn_write_to_wal(). */
+			txn_rollback();
+			fiber_reschedule();
+			tnt_raise(LoggedError, ER_WAL_IO);
+		}
+		signature = res;
+	}
+	/* The engine may have attached commit triggers. */
+	if (txn->has_triggers)
+		trigger_run(&txn->on_commit, txn);
+	txn->engine->commit(txn, signature);
+	/** Free volatile request memory. */
+	alloc_stat_account_region(region_used(&fiber()->gc));
+	fiber_gc();
+	fiber_set_txn(fiber(), NULL);
+}
+
 /**
  * End a statement. In autocommit mode, end
  * the current transaction as well.
@@ -182,23 +280,101 @@ txn_commit_stmt(struct txn *txn, struct request *request)
 }
 
 
-static int64_t
-txn_write_to_wal(struct txn *txn)
+/**
+ * True if the transaction may be acked before its WAL write
+ * lands: every row goes to a memtx space with the async_commit
+ * option and the journal can complete detached entries. Memtx
+ * only - its commit does not look at the signature, while vinyl
+ * needs the real LSN, so vinyl spaces always commit
+ * synchronously.
+ */
+static bool
+txn_commit_is_async(struct txn *txn)
 {
-	assert(txn->n_rows > 0);
+	if (! current_journal->async_capable)
+		return false;
+	struct txn_stmt *stmt;
+	stailq_foreach_entry(stmt, &txn->stmts, next) {
+		if (stmt->row == NULL)
+			continue;
+		if (stmt->space == NULL || !space_is_memtx(stmt->space) ||
+		    !stmt->space->def.opts.async_commit)
+			return false;
+	}
+	return true;
+}
 
-	struct journal_entry *req = journal_entry_new(txn->n_rows);
+/**
+ * Build a self-contained copy of the transaction redo log: the
+ * entry, the row headers and the row bodies all live in one
+ * malloc()ed block. A detached entry must not reference the
+ * fiber region - it is truncated right after commit, long
+ * before the WAL thread gets to write the rows.
+ */
+static struct journal_entry *
+txn_entry_new_detached(struct txn *txn)
+{
+	size_t payload = txn->n_rows * sizeof(struct xrow_header);
+	struct txn_stmt *stmt;
+	stailq_foreach_entry(stmt, &txn->stmts, next) {
+		if (stmt->row == NULL)
+			continue;
+		for (int i = 0; i < stmt->row->bodycnt; i++)
+			payload += stmt->row->body[i].iov_len;
+	}
+	struct journal_entry *req =
+		journal_entry_new_detached(txn->n_rows, payload);
 	if (req == NULL)
 		diag_raise();
 
-	struct txn_stmt *stmt;
-	struct xrow_header **row = req->rows;
+	struct xrow_header *header =
+		(struct xrow_header *) &req->rows[txn->n_rows];
+	char *data = (char *) (header + txn->n_rows);
+	int n = 0;
 	stailq_foreach_entry(stmt, &txn->stmts, next) {
 		if (stmt->row == NULL)
-			continue; /* A read (e.g. select) request */
-		*row++ = stmt->row;
+			continue;
+		struct xrow_header *copy = &header[n];
+		*copy = *stmt->row;
+		/* Gather the body iovecs into the same block. */
+		copy->bodycnt = stmt->row->bodycnt > 0 ? 1 : 0;
+		copy->body[0].iov_base = data;
+		copy->body[0].iov_len = 0;
+		for (int i = 0; i < stmt->row->bodycnt; i++) {
+			memcpy(data, stmt->row->body[i].iov_base,
+			       stmt->row->body[i].iov_len);
+			data += stmt->row->body[i].iov_len;
+			copy->body[0].iov_len += stmt->row->body[i].iov_len;
+		}
+		req->rows[n++] = copy;
+	}
+	assert(n == req->n_rows);
+	return req;
+}
+
+static int64_t
+txn_write_to_wal(struct txn *txn)
+{
+	assert(txn->n_rows > 0);
+
+	bool async = txn_commit_is_async(txn);
+	struct journal_entry *req;
+	if (async) {
+		req = txn_entry_new_detached(txn);
+	} else {
+		req = journal_entry_new(txn->n_rows);
+		if (req == NULL)
+			diag_raise();
+
+		struct txn_stmt *stmt;
+		struct xrow_header **row = req->rows;
+		stailq_foreach_entry(stmt, &txn->stmts, next) {
+			if (stmt->row == NULL)
+				continue; /* A read (e.g. select) request */
+			*row++ = stmt->row;
+		}
+		assert(row == req->rows + req->n_rows);
 	}
-	assert(row == req->rows + req->n_rows);
 
 	ev_tstamp start = ev_now(loop()), stop;
 	int64_t res = journal_write(req);
@@ -207,6 +383,9 @@ txn_write_to_wal(struct txn *txn)
 	if (stop - start > too_long_threshold)
 		say_warn("too long WAL write: %.3f sec", stop - start);
 	if (res < 0) {
+		/* The entry was never queued, drop the copy. */
+		if (async)
+			free(req);
 		/* Cascading rollback. */
 		txn_rollback(); /* Perform our part of cascading rollback. */
 		/*
@@ -219,6 +398,8 @@ txn_write_to_wal(struct txn *txn)
 	}
 	/*
 	 * Use vclock_sum() from WAL writer as transaction signature.
+	 * For an async commit it is provisional - memtx does not
+	 * look at it.
 	 */
 	return res;
 }
@@ -249,6 +430,7 @@ txn_commit(struct txn *txn)
 	}
 	TRASH(txn);
 	/** Free volatile txn memory. */
+	alloc_stat_account_region(region_used(&fiber()->gc));
 	fiber_gc();
 	fiber_set_txn(fiber(), NULL);
 }
@@ -292,6 +474,7 @@ txn_rollback()
 		txn->engine->rollback(txn);
 	TRASH(txn);
 	/** Free volatile txn memory. */
+	alloc_stat_account_region(region_used(&fiber()->gc));
 	fiber_gc();
 	fiber_set_txn(fiber(), NULL);
 }
@@ -33,6 +33,7 @@
 
 #include <stdbool.h>
 #include "salad/stailq.h"
+#include "tuple.h" /* for struct tuple_field_cache */
 
 #if defined(__cplusplus)
 extern "C" {
@@ -63,6 +64,11 @@ struct txn_stmt {
 	void *engine_savepoint;
 	/** Redo info: the binary log row */
 	struct xrow_header *row;
+	/**
+	 * Key extraction cache shared by all index writes of
+	 * this statement, @sa struct tuple_field_cache.
+	 */
+	struct tuple_field_cache field_cache;
 };
 
 
@@ -204,6 +210,32 @@ txn_commit_ro_stmt(struct txn *txn)
 void
 txn_commit_stmt(struct txn *txn, struct request *request);
 
+/**
+ * Stack frame of the fused autocommit fast path, see
+ * txn_begin_stmt_fast().
+ */
+struct txn_fast {
+	struct txn txn;
+	struct txn_stmt stmt;
+};
+
+/**
+ * A fused fast path for the dominant case: a single-statement
+ * autocommit request on a space without on_replace triggers.
+ * The transaction and the statement live in @a fast on the
+ * caller's stack instead of the fiber region and the savepoint
+ * and trigger scaffolding of the generic path is skipped. The
+ * caller checks the preconditions: no active transaction and an
+ * empty space->on_replace list. Pair with txn_commit_stmt_fast();
+ * on error the regular txn_rollback_stmt() applies.
+ */
+struct txn *
+txn_begin_stmt_fast(struct txn_fast *fast, struct space *space);
+
+/** Commit counterpart of txn_begin_stmt_fast(). */
+void
+txn_commit_stmt_fast(struct txn *txn, struct request *request);
+
 /**
  * Rollback a statement. In autocommit mode,
  * rolls back the entire transaction.
@@ -30,6 +30,7 @@
  */
 #include "user.h"
 #include "user_def.h"
+#include "authentication.h"
 #include "assoc.h"
 #include "schema.h"
 #include "space.h"
@@ -43,6 +44,7 @@ struct universe universe;
 static struct user users[BOX_USER_MAX];
 struct user *guest_user = users;
 struct user *admin_user = users + 1;
+uint32_t user_cache_version = 0;
 
 static struct user_map user_map_nil;
 
@@ -391,6 +393,14 @@ user_cache_replace(struct user_def *def)
 		mh_i32ptr_put(user_registry, &node, NULL, NULL);
 	}
 	*(struct user_def *) user = *def;
+	/*
+	 * The definition may carry a new password hash; a stale
+	 * resumption token must not outlive the password it was
+	 * issued under.
+	 */
+	resume_token_invalidate(def->uid);
+	user_cache_version++;
+	schema_view_publish();
 	return user;
 }
 
@@ -411,6 +421,9 @@ user_cache_delete(uint32_t uid)
 		 */
 		user_destroy(user);
 		mh_i32ptr_del(user_registry, uid, NULL);
+		resume_token_invalidate(uid);
+		user_cache_version++;
+		schema_view_publish();
 	}
 }
 
@@ -538,6 +551,8 @@ role_check(struct user *grantee, struct user *role)
 void
 rebuild_effective_grants(struct user *grantee)
 {
+	user_cache_version++;
+	schema_view_publish();
 	/*
 	 * Recurse over all roles to which grantee is granted
 	 * and mark them as dirty - in need for rebuild.
@@ -639,6 +654,12 @@ role_revoke(struct user *grantee, struct user *role)
 void
 priv_grant(struct user *grantee, struct priv_def *priv)
 {
+	/*
+	 * Bump the version even if the object is gone: the _priv
+	 * contents have changed either way.
+	 */
+	user_cache_version++;
+	schema_view_publish();
 	struct access *object = access_find(priv);
 	if (object == NULL)
 		return;
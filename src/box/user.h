@@ -117,6 +117,14 @@ user_find(uint32_t uid);
  */
 extern struct user *guest_user, *admin_user;
 
+/**
+ * Incremented whenever a user is created, altered or dropped, or
+ * any privilege is granted or revoked. Like func_cache_version,
+ * it lets callers cache data derived from users and privileges
+ * and invalidate the cache with one comparison.
+ */
+extern uint32_t user_cache_version;
+
 /*
  * Insert or update user object (a cache entry
  * for user).
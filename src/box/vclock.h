@@ -204,11 +204,15 @@ vclock_compare(const struct vclock *a, const struct vclock *b)
 {
 	bool le = true, ge = true;
 	unsigned int map = a->map | b->map;
-	struct bit_iterator it;
-	bit_iterator_init(&it, &map, sizeof(map), true);
-
-	for (size_t replica_id = bit_iterator_next(&it); replica_id < VCLOCK_MAX;
-	     replica_id = bit_iterator_next(&it)) {
+	/*
+	 * The component map is a single word, so iterate over the
+	 * set bits with ctz directly instead of going through the
+	 * generic byte-wise bit_iterator: this function is called
+	 * for every replicated row in relay and applier.
+	 */
+	while (map != 0) {
+		uint32_t replica_id = bit_ctz_u32(map);
+		map &= map - 1;
 
 		int64_t lsn_a = a->lsn[replica_id];
 		int64_t lsn_b = b->lsn[replica_id];
@@ -42,10 +42,13 @@
 #include <bit/bit.h>
 #include <small/rlist.h>
 #define RB_COMPACT 1
+#include <sys/mman.h>
 #include <small/rb.h>
 #include <small/mempool.h>
 #include <small/region.h>
 #include <small/lsregion.h>
+#include <small/quota.h>
+#include <small/slab_arena.h>
 #include <msgpuck/msgpuck.h>
 #include <coeio_file.h>
 
@@ -122,6 +125,14 @@ struct vy_conf {
 	double bloom_fpr;
 };
 
+/**
+ * Slab size of the arena backing the in-memory level. Large
+ * slabs keep the slab count - and with it the number of mmap
+ * round trips and page fault bursts - low even with tens of
+ * gigabytes of vinyl_memory.
+ */
+enum { VY_MEM_ARENA_SLAB_SIZE = 16 * 1024 * 1024 };
+
 struct vy_env {
 	/** Recovery status */
 	enum vy_status status;
@@ -143,6 +154,13 @@ struct vy_env {
 	struct mempool      cursor_pool;
 	/** Allocator for tuples */
 	struct lsregion     allocator;
+	/** Arena backing the lsregion allocator. */
+	struct slab_arena   mem_arena;
+	/**
+	 * Quota of mem_arena. Effectively unlimited: the real
+	 * memory limit is enforced by vy_quota below.
+	 */
+	struct quota        mem_quota;
 	/** Memory quota */
 	struct vy_quota     quota;
 	/** Timer for updating quota watermark. */
@@ -559,6 +577,20 @@ struct vy_index {
 	uint64_t size;
 	/** Histogram of number of runs in range. */
 	struct histogram *run_hist;
+	/**
+	 * Background I/O done on behalf of this index, collected
+	 * at task completion in the scheduler fiber. Time is
+	 * worker wall clock time, seconds; bytes are dumped
+	 * statement bytes, i.e. the write amplification of
+	 * compaction is visible as compact_bytes growing faster
+	 * than dump_bytes.
+	 */
+	int64_t dump_count;
+	int64_t dump_bytes;
+	double dump_time;
+	int64_t compact_count;
+	int64_t compact_bytes;
+	double compact_time;
 	/**
 	 * Reference counter. Used to postpone index drop
 	 * until all pending operations have completed.
@@ -752,10 +784,16 @@ struct vy_tx {
 	 */
 	struct vy_read_view *read_view;
 	/**
-	 * Prepare sequence number. 
+	 * Prepare sequence number.
 	 * Is -1 if the transaction is not prepared.
 	 */
 	int64_t psn;
+	/**
+	 * Number of bytes the transaction added to in-memory
+	 * trees. Set on prepare, used on commit to pace the
+	 * writer when memory quota is running out.
+	 */
+	size_t write_size;
 	/*
 	 * For non-autocommit transactions, the list of open
 	 * cursors. When a transaction ends, all open cursors are
@@ -815,6 +853,13 @@ struct vy_merge_iterator {
 	struct tuple_format *upsert_format;
 	/** Set if this iterator is for a primary index. */
 	bool is_primary;
+	/**
+	 * Number of UPSERT statements applied for the current key
+	 * by vy_merge_iterator_squash_upsert(). Used to detect hot
+	 * keys whose upsert chains have grown long on the read
+	 * path, see vy_read_iterator_next().
+	 */
+	uint32_t upserts_applied;
 
 	/* {{{ Range version checking */
 	/* pointer to index->version */
@@ -837,6 +882,22 @@ struct vy_merge_iterator {
 	 * current iteration (optimization)
 	 */
 	uint32_t front_id;
+	/**
+	 * Tournament tree over the sources: a complete binary tree
+	 * stored in an array, where each leaf corresponds to a
+	 * source and each inner node holds the index of the source
+	 * with the minimal statement (in the iteration order)
+	 * among the leaves of its subtree, tourn_tree[1] being the
+	 * root. When a source is advanced only the path from its
+	 * leaf to the root is replayed instead of comparing all
+	 * sources again. Built lazily by next_key() once all
+	 * sources are positioned, for iterators without mutable
+	 * sources (the write iterator profile); NULL means the
+	 * linear scan is used.
+	 */
+	uint32_t *tourn_tree;
+	/** Offset of the first leaf in tourn_tree (power of two). */
+	uint32_t tourn_leaf_offset;
 	/**
 	 * For some optimization the flag is set for unique
 	 * index and full key and EQ order - that means that only
@@ -1769,6 +1830,15 @@ vy_run_dump_stmt(struct tuple *value, struct xlog *data_xlog,
 	if (rc != 0)
 		return -1;
 
+	/*
+	 * Store the LSN as a zigzag delta against the page base
+	 * LSN: deltas within a page are small, so they take a
+	 * couple of bytes instead of nine and compress much
+	 * better. Undone by vy_page_xrow().
+	 */
+	int64_t delta = xrow.lsn - info->base_lsn;
+	xrow.lsn = (int64_t)(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+
 	ssize_t row_size;
 	if ((row_size = xlog_write_row(data_xlog, &xrow)) < 0)
 		return -1;
@@ -2065,6 +2135,7 @@ vy_run_write_data(struct vy_run *run, const char *dirpath,
 
 	run->fd = data_xlog.fd;
 	xlog_close(&data_xlog, true);
+	vy_run_map_data(run);
 	fiber_gc();
 
 	bloom_spectrum_choose(&bs, &run->info.bloom);
@@ -2112,7 +2183,7 @@ vy_page_info_encode(const struct vy_page_info *page_info,
 	/* calc tuple size */
 	uint32_t size;
 	/* 3 items: page offset, size, and map */
-	size = mp_sizeof_map(6) +
+	size = mp_sizeof_map(7) +
 	       mp_sizeof_uint(VY_PAGE_INFO_OFFSET) +
 	       mp_sizeof_uint(page_info->offset) +
 	       mp_sizeof_uint(VY_PAGE_INFO_SIZE) +
@@ -2124,7 +2195,9 @@ vy_page_info_encode(const struct vy_page_info *page_info,
 	       mp_sizeof_uint(VY_PAGE_INFO_UNPACKED_SIZE) +
 	       mp_sizeof_uint(page_info->unpacked_size) +
 	       mp_sizeof_uint(VY_PAGE_INFO_PAGE_INDEX_OFFSET) +
-	       mp_sizeof_uint(page_info->page_index_offset);
+	       mp_sizeof_uint(page_info->page_index_offset) +
+	       mp_sizeof_uint(VY_PAGE_INFO_BASE_LSN) +
+	       mp_sizeof_uint(page_info->base_lsn);
 
 	char *pos = region_alloc(region, size);
 	if (pos == NULL) {
@@ -2135,7 +2208,7 @@ vy_page_info_encode(const struct vy_page_info *page_info,
 	memset(xrow, 0, sizeof(*xrow));
 	/* encode page */
 	xrow->body->iov_base = pos;
-	pos = mp_encode_map(pos, 6);
+	pos = mp_encode_map(pos, 7);
 	pos = mp_encode_uint(pos, VY_PAGE_INFO_OFFSET);
 	pos = mp_encode_uint(pos, page_info->offset);
 	pos = mp_encode_uint(pos, VY_PAGE_INFO_SIZE);
@@ -2149,6 +2222,8 @@ vy_page_info_encode(const struct vy_page_info *page_info,
 	pos = mp_encode_uint(pos, page_info->unpacked_size);
 	pos = mp_encode_uint(pos, VY_PAGE_INFO_PAGE_INDEX_OFFSET);
 	pos = mp_encode_uint(pos, page_info->page_index_offset);
+	pos = mp_encode_uint(pos, VY_PAGE_INFO_BASE_LSN);
+	pos = mp_encode_uint(pos, page_info->base_lsn);
 	xrow->body->iov_len = (void *)pos - xrow->body->iov_base;
 	xrow->bodycnt = 1;
 
@@ -2621,6 +2696,63 @@ fail:
 	return false;
 }
 
+/**
+ * Size-tiered compaction trigger: runs are grouped into tiers of
+ * comparable size - a run belongs to the current tier as long as
+ * it is within run_size_ratio of the first run of the tier. When
+ * a tier accumulates more than run_count_per_level runs, all its
+ * runs along with all newer ones are merged into a single run of
+ * the next tier. Unlike the leveled policy, a run is never merged
+ * into a substantially larger one, so a statement is rewritten at
+ * most once per tier it passes through, at the cost of more runs
+ * a read has to visit.
+ *
+ * With @lazy_leveling, the oldest (largest) tier is additionally
+ * kept compacted down to a single run, which bounds the number of
+ * runs while preserving tiered behavior for fresh data.
+ */
+static void
+vy_range_update_compact_priority_tiered(struct vy_range *range,
+					bool lazy_leveling)
+{
+	struct index_opts *opts = &range->index->index_def->opts;
+
+	range->compact_priority = 0;
+
+	/* Total number of checked runs. */
+	uint32_t total_run_count = 0;
+	/* The number of runs in the current tier. */
+	uint32_t tier_run_count = 0;
+	/* The size of the run that opened the current tier. */
+	uint64_t tier_first_size = 0;
+
+	struct vy_slice *slice;
+	rlist_foreach_entry(slice, &range->slices, in_range) {
+		total_run_count++;
+		if (tier_first_size == 0 ||
+		    slice->size > tier_first_size * opts->run_size_ratio) {
+			/* The run is too big - it opens a new tier. */
+			tier_first_size = slice->size;
+			tier_run_count = 1;
+		} else {
+			tier_run_count++;
+		}
+		if (tier_run_count > opts->run_count_per_level) {
+			/*
+			 * The tier is full. Merge its runs along
+			 * with all newer ones.
+			 */
+			range->compact_priority = total_run_count;
+		}
+	}
+	/*
+	 * Keep the last level compacted down to a single run so
+	 * that queries visit at most one large run.
+	 */
+	if (lazy_leveling && tier_run_count > 1)
+		range->compact_priority = total_run_count;
+}
+
 /**
  * To reduce write amplification caused by compaction, we follow
  * the LSM tree design. Runs in each range are divided into groups
@@ -2643,6 +2775,11 @@ fail:
  * Given a range, this function computes the maximal level that needs
  * to be compacted and sets @compact_priority to the number of runs in
  * this level and all preceding levels.
+ *
+ * The above describes the default, leveled policy. An index may
+ * opt for the tiered or lazy_leveling policy instead (see the
+ * compaction_policy index option), in which case the trigger is
+ * computed by vy_range_update_compact_priority_tiered().
  */
 static void
 vy_range_update_compact_priority(struct vy_range *range)
@@ -2652,6 +2789,12 @@ vy_range_update_compact_priority(struct vy_range *range)
 	assert(opts->run_count_per_level > 0);
 	assert(opts->run_size_ratio > 1);
 
+	if (opts->compaction_policy != VY_COMPACTION_LEVELED) {
+		vy_range_update_compact_priority_tiered(range,
+			opts->compaction_policy == VY_COMPACTION_LAZY_LEVELING);
+		return;
+	}
+
 	range->compact_priority = 0;
 
 	/* Total number of checked runs. */
@@ -3204,6 +3347,18 @@ static void
 vy_index_commit_upsert(struct vy_index *index, struct vy_mem *mem,
 		       const struct tuple *stmt);
 
+/*
+ * If there are a lot of successive upserts for the same key,
+ * select might take too long to squash them all. So once the
+ * number of upserts exceeds a certain threshold, we schedule
+ * a fiber to merge them and insert the resulting statement
+ * after the latest upsert.
+ */
+enum {
+	VY_UPSERT_THRESHOLD = 128,
+	VY_UPSERT_INF = 128,
+};
+
 /*
  * Confirm that the statement stays in the index's in-memory tree.
  * @param index Index the statement is for.
@@ -3266,17 +3421,6 @@ vy_index_commit_upsert(struct vy_index *index, struct vy_mem *mem,
 	int64_t lsn = vy_stmt_lsn(stmt);
 	older = vy_mem_older_lsn(mem, stmt);
 
-	/*
-	 * If there are a lot of successive upserts for the same key,
-	 * select might take too long to squash them all. So once the
-	 * number of upserts exceeds a certain threshold, we schedule
-	 * a fiber to merge them and insert the resulting statement
-	 * after the latest upsert.
-	 */
-	enum {
-		VY_UPSERT_THRESHOLD = 128,
-		VY_UPSERT_INF = 128,
-	};
 	if (older != NULL && vy_stmt_type(older) == IPROTO_UPSERT) {
 		uint8_t n_upserts = vy_stmt_n_upserts(older);
 		if (n_upserts != VY_UPSERT_INF) {
@@ -3284,7 +3428,14 @@ vy_index_commit_upsert(struct vy_index *index, struct vy_mem *mem,
 			if (n_upserts == VY_UPSERT_THRESHOLD) {
 				struct tuple *dup =
 					vy_stmt_dup(stmt, index->upsert_format);
-				vy_index_squash_upserts(index, dup);
+				if (dup != NULL) {
+					vy_index_squash_upserts(index, dup);
+					tuple_unref(dup);
+				}
+				/*
+				 * Ignore a memory error, because it is
+				 * not critical to miss the squash.
+				 */
 			}
 		}
 		vy_stmt_set_n_upserts((struct tuple *)stmt, n_upserts);
@@ -3453,6 +3604,8 @@ struct vy_task_ops {
 
 struct vy_task {
 	const struct vy_task_ops *ops;
+	/** Worker pool this task was handed to. */
+	struct vy_worker_pool *pool;
 	/** Return code of ->execute. */
 	int status;
 	/** If ->execute fails, the error is stored here. */
@@ -4181,26 +4334,48 @@ vy_compact_heap_less(struct heap_node *a, struct heap_node *b)
 
 #include "salad/heap.h"
 
+/**
+ * A lane of worker threads dedicated to one class of background
+ * tasks. Dumps and compactions run in separate lanes, so that a
+ * long compaction of a big range can never delay a dump and thus
+ * the release of memory quota.
+ */
+struct vy_worker_pool {
+	/** Scheduler the pool belongs to. */
+	struct vy_scheduler *scheduler;
+	/** Worker threads of the pool. */
+	struct cord *threads;
+	/** Total number of worker threads. */
+	int size;
+	/** Number of worker threads that are currently idle. */
+	int available;
+	/**
+	 * A queue with all vy_task objects handed to this pool
+	 * and not yet taken by a worker. Protected by
+	 * vy_scheduler->mutex.
+	 */
+	struct stailq input_queue;
+	/**
+	 * There is a pending task in the input queue, or we want
+	 * to shutdown workers.
+	 */
+	pthread_cond_t cond;
+};
+
 struct vy_scheduler {
 	pthread_mutex_t        mutex;
 	struct vy_env    *env;
 	heap_t dump_heap;
 	heap_t compact_heap;
 
-	struct cord *worker_pool;
 	struct fiber *scheduler;
 	struct ev_loop *loop;
-	/** Total number of worker threads. */
-	int worker_pool_size;
-	/** Number worker threads that are currently idle. */
-	int workers_available;
+	/** Workers for dump tasks. */
+	struct vy_worker_pool dump_pool;
+	/** Workers for compaction tasks. */
+	struct vy_worker_pool compact_pool;
 	bool is_worker_pool_running;
 
-	/**
-	 * There is a pending task for workers in the pool,
-	 * or we want to shutdown workers.
-	 */
-	pthread_cond_t worker_cond;
 	/**
 	 * There is no pending tasks for workers, so scheduler
 	 * needs to create one, or we want to shutdown the
@@ -4211,11 +4386,6 @@ struct vy_scheduler {
 	struct ipc_cond scheduler_cond;
 	/** Used for throttling tx when quota is full. */
 	struct ipc_cond quota_cond;
-	/**
-	 * A queue with all vy_task objects created by the
-	 * scheduler and not yet taken by a worker.
-	 */
-	struct stailq input_queue;
 	/**
 	 * A queue of processed vy_tasks objects.
 	 */
@@ -4316,7 +4486,8 @@ vy_scheduler_new(struct vy_env *env)
 	scheduler->env = env;
 	vy_compact_heap_create(&scheduler->compact_heap);
 	vy_dump_heap_create(&scheduler->dump_heap);
-	tt_pthread_cond_init(&scheduler->worker_cond, NULL);
+	tt_pthread_cond_init(&scheduler->dump_pool.cond, NULL);
+	tt_pthread_cond_init(&scheduler->compact_pool.cond, NULL);
 	scheduler->loop = loop();
 	ev_async_init(&scheduler->scheduler_async, vy_scheduler_async_cb);
 	ipc_cond_create(&scheduler->scheduler_cond);
@@ -4346,7 +4517,8 @@ vy_scheduler_delete(struct vy_scheduler *scheduler)
 	diag_destroy(&scheduler->diag);
 	vy_compact_heap_destroy(&scheduler->compact_heap);
 	vy_dump_heap_destroy(&scheduler->dump_heap);
-	tt_pthread_cond_destroy(&scheduler->worker_cond);
+	tt_pthread_cond_destroy(&scheduler->dump_pool.cond);
+	tt_pthread_cond_destroy(&scheduler->compact_pool.cond);
 	TRASH(&scheduler->scheduler_async);
 	ipc_cond_destroy(&scheduler->scheduler_cond);
 	ipc_cond_destroy(&scheduler->quota_cond);
@@ -4506,27 +4678,36 @@ vy_schedule(struct vy_scheduler *scheduler, struct vy_task **ptask)
 	if (rlist_empty(&scheduler->env->indexes))
 		return 0;
 
-	if (vy_scheduler_peek_dump(scheduler, ptask) != 0)
-		goto fail;
-	if (*ptask != NULL)
-		return 0;
-
-	if (scheduler->workers_available <= 1) {
-		/*
-		 * If all worker threads are busy doing compaction
-		 * when we run out of quota, ongoing transactions will
-		 * hang until one of the threads has finished, which
-		 * may take quite a while. To avoid unpredictably long
-		 * stalls, always keep one worker thread reserved for
-		 * dumps.
-		 */
-		return 0;
+	/*
+	 * Dumps have their own worker lane, so they are never
+	 * stuck behind a long compaction. Under quota pressure
+	 * a dump may additionally borrow an idle compaction
+	 * worker: freeing memory for stalled transactions is
+	 * more urgent than reducing read amplification.
+	 */
+	struct vy_worker_pool *pool = NULL;
+	if (scheduler->dump_pool.available > 0)
+		pool = &scheduler->dump_pool;
+	else if (vy_quota_is_exceeded(&scheduler->env->quota) &&
+		 scheduler->compact_pool.available > 0)
+		pool = &scheduler->compact_pool;
+	if (pool != NULL) {
+		if (vy_scheduler_peek_dump(scheduler, ptask) != 0)
+			goto fail;
+		if (*ptask != NULL) {
+			(*ptask)->pool = pool;
+			return 0;
+		}
 	}
 
-	if (vy_scheduler_peek_compact(scheduler, ptask) != 0)
-		goto fail;
-	if (*ptask != NULL)
-		return 0;
+	if (scheduler->compact_pool.available > 0) {
+		if (vy_scheduler_peek_compact(scheduler, ptask) != 0)
+			goto fail;
+		if (*ptask != NULL) {
+			(*ptask)->pool = &scheduler->compact_pool;
+			return 0;
+		}
+	}
 
 	/* no task to run */
 	return 0;
@@ -4620,6 +4801,7 @@ vy_scheduler_f(va_list va)
 
 		/* Complete and delete all processed tasks. */
 		stailq_foreach_entry_safe(task, next, &output_queue, link) {
+			struct vy_worker_pool *pool = task->pool;
 			if (vy_scheduler_complete_task(scheduler, task) != 0)
 				tasks_failed++;
 			else
@@ -4628,10 +4810,23 @@ vy_scheduler_f(va_list va)
 				vy_stat_dump(env->stat, task->exec_time,
 					     task->dump_size,
 					     task->dumped_statements);
+			/*
+			 * Attribute the work to the index before the
+			 * task releases its reference. Only compaction
+			 * tasks have a range attached.
+			 */
+			if (task->range != NULL) {
+				task->index->compact_count++;
+				task->index->compact_bytes += task->dump_size;
+				task->index->compact_time += task->exec_time;
+			} else {
+				task->index->dump_count++;
+				task->index->dump_bytes += task->dump_size;
+				task->index->dump_time += task->exec_time;
+			}
 			vy_task_delete(&scheduler->task_pool, task);
-			scheduler->workers_available++;
-			assert(scheduler->workers_available <=
-			       scheduler->worker_pool_size);
+			pool->available++;
+			assert(pool->available <= pool->size);
 		}
 		/*
 		 * Reset the timeout if we managed to successfully
@@ -4653,7 +4848,8 @@ vy_scheduler_f(va_list va)
 		if (tasks_failed > 0)
 			goto error;
 		/* All worker threads are busy. */
-		if (scheduler->workers_available == 0)
+		if (scheduler->dump_pool.available == 0 &&
+		    scheduler->compact_pool.available == 0)
 			goto wait;
 		/* Get a task to schedule. */
 		if (vy_schedule(scheduler, &task) != 0)
@@ -4662,15 +4858,16 @@ vy_scheduler_f(va_list va)
 		if (task == NULL)
 			goto wait;
 
-		/* Queue the task and notify workers if necessary. */
+		/* Queue the task and notify its lane if necessary. */
+		struct vy_worker_pool *pool = task->pool;
 		tt_pthread_mutex_lock(&scheduler->mutex);
-		was_empty = stailq_empty(&scheduler->input_queue);
-		stailq_add_tail_entry(&scheduler->input_queue, task, link);
+		was_empty = stailq_empty(&pool->input_queue);
+		stailq_add_tail_entry(&pool->input_queue, task, link);
 		if (was_empty)
-			tt_pthread_cond_signal(&scheduler->worker_cond);
+			tt_pthread_cond_signal(&pool->cond);
 		tt_pthread_mutex_unlock(&scheduler->mutex);
 
-		scheduler->workers_available--;
+		pool->available--;
 		fiber_reschedule();
 		continue;
 error:
@@ -4709,22 +4906,23 @@ wait:
 static int
 vy_worker_f(va_list va)
 {
-	struct vy_scheduler *scheduler = va_arg(va, struct vy_scheduler *);
+	struct vy_worker_pool *pool = va_arg(va, struct vy_worker_pool *);
+	struct vy_scheduler *scheduler = pool->scheduler;
 	coeio_enable();
 	struct vy_task *task = NULL;
 
 	tt_pthread_mutex_lock(&scheduler->mutex);
 	while (scheduler->is_worker_pool_running) {
 		/* Wait for a task */
-		if (stailq_empty(&scheduler->input_queue)) {
+		if (stailq_empty(&pool->input_queue)) {
 			/* Wake scheduler up if there are no more tasks */
 			ev_async_send(scheduler->loop,
 				      &scheduler->scheduler_async);
-			tt_pthread_cond_wait(&scheduler->worker_cond,
+			tt_pthread_cond_wait(&pool->cond,
 					     &scheduler->mutex);
 			continue;
 		}
-		task = stailq_shift_entry(&scheduler->input_queue,
+		task = stailq_shift_entry(&pool->input_queue,
 					  struct vy_task, link);
 		tt_pthread_mutex_unlock(&scheduler->mutex);
 		assert(task != NULL);
@@ -4747,6 +4945,33 @@ vy_worker_f(va_list va)
 	return 0;
 }
 
+static void
+vy_worker_pool_start(struct vy_scheduler *scheduler,
+		     struct vy_worker_pool *pool, const char *name, int size)
+{
+	assert(size >= 1);
+	pool->scheduler = scheduler;
+	pool->size = size;
+	pool->available = size;
+	stailq_create(&pool->input_queue);
+	pool->threads = (struct cord *) calloc(size, sizeof(struct cord));
+	if (pool->threads == NULL)
+		panic("failed to allocate vinyl worker pool");
+	for (int i = 0; i < size; i++)
+		cord_costart(&pool->threads[i], name, vy_worker_f, pool);
+}
+
+static void
+vy_worker_pool_stop(struct vy_worker_pool *pool)
+{
+	for (int i = 0; i < pool->size; i++)
+		cord_join(&pool->threads[i]);
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->size = 0;
+	pool->available = 0;
+}
+
 static void
 vy_scheduler_start_workers(struct vy_scheduler *scheduler)
 {
@@ -4754,21 +4979,23 @@ vy_scheduler_start_workers(struct vy_scheduler *scheduler)
 
 	/* Start worker threads */
 	scheduler->is_worker_pool_running = true;
-	scheduler->worker_pool_size = cfg_geti("vinyl_threads");
-	/* One thread is reserved for dumps, see vy_schedule(). */
-	assert(scheduler->worker_pool_size >= 2);
-	scheduler->workers_available = scheduler->worker_pool_size;
-	stailq_create(&scheduler->input_queue);
+	int total = cfg_geti("vinyl_threads");
+	/* At least one thread per lane, see vy_schedule(). */
+	assert(total >= 2);
+	/*
+	 * Dumps are short and latency critical - they release
+	 * memory quota - so they get a lane of their own, about
+	 * a quarter of the threads. The rest do compactions.
+	 */
+	int dump_threads = total / 4;
+	if (dump_threads < 1)
+		dump_threads = 1;
 	stailq_create(&scheduler->output_queue);
-	scheduler->worker_pool = (struct cord *)
-		calloc(scheduler->worker_pool_size, sizeof(struct cord));
-	if (scheduler->worker_pool == NULL)
-		panic("failed to allocate vinyl worker pool");
 	ev_async_start(scheduler->loop, &scheduler->scheduler_async);
-	for (int i = 0; i < scheduler->worker_pool_size; i++) {
-		cord_costart(&scheduler->worker_pool[i], "vinyl.worker",
-			     vy_worker_f, scheduler);
-	}
+	vy_worker_pool_start(scheduler, &scheduler->dump_pool,
+			     "vinyl.dump", dump_threads);
+	vy_worker_pool_start(scheduler, &scheduler->compact_pool,
+			     "vinyl.compact", total - dump_threads);
 }
 
 static void
@@ -4780,19 +5007,18 @@ vy_scheduler_stop_workers(struct vy_scheduler *scheduler)
 	assert(scheduler->is_worker_pool_running);
 	scheduler->is_worker_pool_running = false;
 
-	/* Clear the input queue and wake up worker threads. */
+	/* Clear the input queues and wake up worker threads. */
 	tt_pthread_mutex_lock(&scheduler->mutex);
-	stailq_concat(&task_queue, &scheduler->input_queue);
-	pthread_cond_broadcast(&scheduler->worker_cond);
+	stailq_concat(&task_queue, &scheduler->dump_pool.input_queue);
+	stailq_concat(&task_queue, &scheduler->compact_pool.input_queue);
+	pthread_cond_broadcast(&scheduler->dump_pool.cond);
+	pthread_cond_broadcast(&scheduler->compact_pool.cond);
 	tt_pthread_mutex_unlock(&scheduler->mutex);
 
 	/* Wait for worker threads to exit. */
-	for (int i = 0; i < scheduler->worker_pool_size; i++)
-		cord_join(&scheduler->worker_pool[i]);
+	vy_worker_pool_stop(&scheduler->dump_pool);
+	vy_worker_pool_stop(&scheduler->compact_pool);
 	ev_async_stop(scheduler->loop, &scheduler->scheduler_async);
-	free(scheduler->worker_pool);
-	scheduler->worker_pool = NULL;
-	scheduler->worker_pool_size = 0;
 
 	/* Abort all pending tasks. */
 	struct vy_task *task, *next;
@@ -4990,6 +5216,11 @@ vy_info_append_memory(struct vy_env *env, struct info_handler *h)
 	info_append_u64(h, "watermark", q->watermark);
 	snprintf(buf, sizeof(buf), "%d%%", (int)(100 * q->used / q->limit));
 	info_append_str(h, "ratio", buf);
+	info_append_u64(h, "slab_prealloc", env->mem_arena.prealloc);
+	/* Allocation latencies are in nanoseconds. */
+	info_append_u64(h, "alloc_count", vy_lsalloc_stat.count);
+	info_append_u64(h, "alloc_time", vy_lsalloc_stat.time_total);
+	info_append_u64(h, "alloc_time_max", vy_lsalloc_stat.time_max);
 	info_table_end(h);
 }
 
@@ -5087,16 +5318,53 @@ void
 vy_index_info(struct vy_index *index, struct info_handler *h)
 {
 	char buf[1024];
+	/*
+	 * Collect the in-memory arena stats: all in-memory trees
+	 * of the index, the active one and the sealed ones.
+	 */
+	uint32_t tree_count = 1;
+	uint64_t tree_extents = vy_mem_tree_extent_size(index->mem);
+	struct vy_mem *mem;
+	rlist_foreach_entry(mem, &index->sealed, in_sealed) {
+		tree_count++;
+		tree_extents += vy_mem_tree_extent_size(mem);
+	}
 	info_begin(h);
 	info_append_u64(h, "range_size", index->index_def->opts.range_size);
 	info_append_u64(h, "page_size", index->index_def->opts.page_size);
 	info_append_u64(h, "memory_used", index->mem_used);
+	info_table_begin(h, "memory");
+	/* Sum of the statement sizes. */
+	info_append_u64(h, "statements", index->mem_used);
+	/* BPS tree extents allocated on the same arena. */
+	info_append_u64(h, "tree_extents", tree_extents);
+	info_append_u64(h, "used", index->mem_used + tree_extents);
+	info_append_u32(h, "tree_count", tree_count);
+	/* Oldest generation still pinning the arena. */
+	info_append_u64(h, "generation", index->generation);
+	info_table_end(h);
+	info_table_begin(h, "cache");
+	info_append_u64(h, "used", index->cache->used);
+	info_append_u64(h, "quota", index->cache->quota);
+	info_append_u64(h, "hits", index->cache->hits);
+	info_append_u64(h, "misses", index->cache->misses);
+	info_table_end(h);
 	info_append_u64(h, "size", index->size);
 	info_append_u64(h, "count", index->stmt_count);
 	info_append_u32(h, "page_count", index->page_count);
 	info_append_u32(h, "range_count", index->range_count);
 	info_append_u32(h, "run_count", index->run_count);
 	info_append_u32(h, "run_avg", index->run_count / index->range_count);
+	info_table_begin(h, "dump");
+	info_append_u64(h, "count", index->dump_count);
+	info_append_u64(h, "bytes", index->dump_bytes);
+	info_append_u64(h, "time_us", (uint64_t)(index->dump_time * 1e6));
+	info_table_end(h);
+	info_table_begin(h, "compaction");
+	info_append_u64(h, "count", index->compact_count);
+	info_append_u64(h, "bytes", index->compact_bytes);
+	info_append_u64(h, "time_us", (uint64_t)(index->compact_time * 1e6));
+	info_table_end(h);
 	histogram_snprint(buf, sizeof(buf), index->run_hist);
 	info_append_str(h, "run_histogram", buf);
 	info_end(h);
@@ -5318,7 +5586,7 @@ vy_index_new(struct vy_env *e, struct index_def *user_index_def,
 	struct key_def *def = &index->index_def->key_def;
 
 	index->surrogate_format = tuple_format_new(&vy_tuple_format_vtab,
-						   &def, 1, 0);
+						   &def, 1, 0, 0, 0);
 	if (index->surrogate_format == NULL)
 		goto fail_format;
 	tuple_format_ref(index->surrogate_format, 1);
@@ -5363,7 +5631,8 @@ vy_index_new(struct vy_env *e, struct index_def *user_index_def,
 		}
 	}
 
-	index->cache = vy_cache_new(&e->cache_env, &index->index_def->key_def);
+	index->cache = vy_cache_new(&e->cache_env, &index->index_def->key_def,
+				    index->index_def->opts.cache_size);
 	if (index->cache == NULL)
 		goto fail_cache_init;
 
@@ -6170,24 +6439,39 @@ vy_replace_impl(struct vy_tx *tx, struct space *space, struct request *request,
 	if (vy_tx_set(tx, pk, new_stmt) != 0)
 		goto error;
 
-	if (space->index_count > 1 && old_stmt != NULL) {
-		delete = vy_stmt_new_surrogate_delete(space->format, old_stmt);
-		if (delete == NULL)
-			goto error;
-	}
-
 	/* Update secondary keys, avoid duplicates. */
 	for (uint32_t iid = 1; iid < space->index_count; ++iid) {
 		struct vy_index *index;
 		index = vy_index(space->index[iid]);
 		if (vy_is_committed_one(tx, index))
 			continue;
+		/*
+		 * If the replace does not change the secondary
+		 * key, the old secondary statement points at the
+		 * same primary key and remains valid: a reader
+		 * fetches the up-to-date tuple from the primary
+		 * index anyway. Skip both the DELETE and the
+		 * REPLACE, along with the uniqueness check and
+		 * its look up in the index.
+		 */
+		if (old_stmt != NULL &&
+		    vy_tuple_compare(old_stmt, new_stmt,
+				     &index->index_def->key_def) == 0)
+			continue;
 		/*
 		 * Delete goes first, so if old and new keys
 		 * fully match, there is no look up beyond the
-		 * transaction index.
+		 * transaction index. The surrogate DELETE is
+		 * created lazily: a replace not changing any
+		 * secondary key does not need it at all.
 		 */
 		if (old_stmt != NULL) {
+			if (delete == NULL) {
+				delete = vy_stmt_new_surrogate_delete(
+					space->format, old_stmt);
+				if (delete == NULL)
+					goto error;
+			}
 			if (vy_tx_set(tx, index, delete) != 0)
 				goto error;
 		}
@@ -6861,6 +7145,7 @@ vy_tx_create(struct tx_manager *xm, struct vy_tx *tx)
 	tx->state = VINYL_TX_READY;
 	tx->read_view = (struct vy_read_view *) xm->p_global_read_view;
 	tx->psn = 0;
+	tx->write_size = 0;
 	rlist_create(&tx->cursors);
 	xm->tx_count++;
 }
@@ -7080,6 +7365,7 @@ vy_tx_prepare(struct vy_tx *tx)
 	size_t write_size = mem_used_after - mem_used_before;
 	vy_stat_tx(env->stat, tx->start, count, write_count, write_size);
 	vy_quota_force_use(&env->quota, write_size);
+	tx->write_size = write_size;
 	xm->last_prepared_tx = tx;
 	return 0;
 }
@@ -7116,7 +7402,21 @@ vy_tx_commit(struct vy_tx *tx, int64_t lsn)
 	/* Update read views of dependant transactions. */
 	if (tx->read_view != &xm->global_read_view)
 		tx->read_view->vlsn = lsn;
+	size_t write_size = tx->write_size;
 	vy_tx_destroy(tx);
+
+	/*
+	 * Pace the writer once memory usage is above the
+	 * watermark: the injected delay grows with quota usage so
+	 * that at the limit each written byte costs one second per
+	 * dump-bandwidth bytes, making the write rate converge to
+	 * the dump bandwidth instead of slamming into the hard
+	 * limit. Done after the mems are unpinned, so a sleeping
+	 * writer cannot delay a dump.
+	 */
+	double delay = vy_quota_throttle_time(&xm->env->quota, write_size);
+	if (delay > 0.)
+		fiber_sleep(delay);
 }
 
 static void
@@ -7303,7 +7603,7 @@ vy_env_new(void)
 	if (e->squash_queue == NULL)
 		goto error_squash_queue;
 	e->key_format = tuple_format_new(&vy_tuple_format_vtab,
-					  NULL, 0, 0);
+					  NULL, 0, 0, 0, 0);
 	if (e->key_format == NULL)
 		goto error_key_format;
 	tuple_format_ref(e->key_format, 1);
@@ -7311,7 +7611,27 @@ vy_env_new(void)
 	struct slab_cache *slab_cache = cord_slab_cache();
 	mempool_create(&e->cursor_pool, slab_cache,
 	               sizeof(struct vy_cursor));
-	lsregion_create(&e->allocator, slab_cache->arena);
+	/*
+	 * Back the in-memory level with its own arena, mapped up
+	 * front and handing out large slabs: on the shared
+	 * runtime arena a big vinyl_memory instance grows slab by
+	 * slab in the middle of ingest, paying for mmap() exactly
+	 * when the write path is hottest. The reservation is
+	 * address space, not committed memory, so an over-sized
+	 * limit costs nothing until the pages are touched.
+	 */
+	size_t mem_prealloc = small_align(e->conf->memory_limit,
+					  VY_MEM_ARENA_SLAB_SIZE);
+	quota_init(&e->mem_quota, QUOTA_MAX);
+	if (slab_arena_create(&e->mem_arena, &e->mem_quota, mem_prealloc,
+			      VY_MEM_ARENA_SLAB_SIZE, MAP_PRIVATE) != 0 &&
+	    slab_arena_create(&e->mem_arena, &e->mem_quota, 0,
+			      VY_MEM_ARENA_SLAB_SIZE, MAP_PRIVATE) != 0) {
+		diag_set(OutOfMemory, mem_prealloc, "slab_arena_create",
+			 "vinyl memory arena");
+		goto error_mem_arena;
+	}
+	lsregion_create(&e->allocator, &e->mem_arena);
 
 	vy_quota_init(&e->quota, vy_scheduler_quota_cb, e->scheduler);
 	ev_timer_init(&e->quota_timer, vy_env_quota_timer_cb, 0, 1.);
@@ -7322,6 +7642,9 @@ vy_env_new(void)
 	vy_run_env_create(&e->run_env);
 	vy_log_init(e->conf->path);
 	return e;
+error_mem_arena:
+	mempool_destroy(&e->cursor_pool);
+	tuple_format_ref(e->key_format, -1);
 error_key_format:
 	vy_squash_queue_delete(e->squash_queue);
 error_squash_queue:
@@ -7353,6 +7676,7 @@ vy_env_delete(struct vy_env *e)
 	mempool_destroy(&e->cursor_pool);
 	vy_run_env_destroy(&e->run_env);
 	lsregion_destroy(&e->allocator);
+	slab_arena_destroy(&e->mem_arena);
 	vy_cache_env_destroy(&e->cache_env);
 	if (e->recovery != NULL)
 		vy_recovery_delete(e->recovery);
@@ -7772,6 +8096,7 @@ vy_merge_iterator_open(struct vy_merge_iterator *itr,
 	itr->format = format;
 	itr->upsert_format = upsert_format;
 	itr->is_primary = is_primary;
+	itr->upserts_applied = 0;
 	itr->index_version = 0;
 	itr->range_version = 0;
 	itr->p_index_version = NULL;
@@ -7784,6 +8109,8 @@ vy_merge_iterator_open(struct vy_merge_iterator *itr,
 	itr->src = NULL;
 	itr->curr_src = UINT32_MAX;
 	itr->front_id = 1;
+	itr->tourn_tree = NULL;
+	itr->tourn_leaf_offset = 0;
 	itr->mutable_start = 0;
 	itr->mutable_end = 0;
 	itr->skipped_start = 0;
@@ -7814,6 +8141,9 @@ vy_merge_iterator_cleanup(struct vy_merge_iterator *itr)
 		if (cb != NULL)
 			cb(&itr->src[i].iterator);
 	}
+	free(itr->tourn_tree);
+	itr->tourn_tree = NULL;
+	itr->tourn_leaf_offset = 0;
 	itr->src_capacity = 0;
 	itr->range_version = 0;
 	itr->index_version = 0;
@@ -7927,6 +8257,157 @@ vy_merge_iterator_check_version(struct vy_merge_iterator *itr)
 	return 0;
 }
 
+/**
+ * Minimal number of sources for which maintaining a tournament
+ * tree pays off; with fewer sources the plain linear scan is
+ * cheaper than replaying tree paths.
+ */
+#define VY_MERGE_TOURN_MIN_SOURCES	4
+
+/**
+ * Play a tournament match between two sources: return the one
+ * positioned on the statement that goes first in the iteration
+ * order. An absent (UINT32_MAX) or exhausted source loses to any
+ * other one. On a tie the left operand wins: leaves are filled
+ * in the source order, so the winner of equal keys is always the
+ * source with the smaller index, i.e. the newer one, exactly as
+ * in the linear scan.
+ */
+static uint32_t
+vy_merge_iterator_tourn_match(struct vy_merge_iterator *itr,
+			      uint32_t a, uint32_t b)
+{
+	if (a == UINT32_MAX || itr->src[a].stmt == NULL)
+		return b;
+	if (b == UINT32_MAX || itr->src[b].stmt == NULL)
+		return a;
+	int dir = iterator_direction(itr->iterator_type);
+	int cmp = dir * vy_tuple_compare(itr->src[a].stmt, itr->src[b].stmt,
+					 itr->key_def);
+	return cmp <= 0 ? a : b;
+}
+
+/**
+ * Replay the tournament matches on the path from the leaf of the
+ * given source to the root after the source has been advanced.
+ */
+static void
+vy_merge_iterator_tourn_replay(struct vy_merge_iterator *itr, uint32_t src_idx)
+{
+	uint32_t *tree = itr->tourn_tree;
+	for (uint32_t n = (itr->tourn_leaf_offset + src_idx) / 2; n > 0; n /= 2)
+		tree[n] = vy_merge_iterator_tourn_match(itr, tree[2 * n],
+							tree[2 * n + 1]);
+}
+
+/**
+ * Stamp the current front_id on every source positioned on the
+ * same key as the statement the winner is positioned on. Only
+ * subtrees whose winner is on that key are descended into, so
+ * the cost is proportional to the number of front sources, not
+ * to the total source count. next_lsn() relies on all such
+ * sources being stamped.
+ */
+static void
+vy_merge_iterator_tourn_mark_front(struct vy_merge_iterator *itr,
+				   uint32_t node, const struct tuple *min_stmt)
+{
+	uint32_t *tree = itr->tourn_tree;
+	if (node >= itr->tourn_leaf_offset) {
+		itr->src[tree[node]].front_id = itr->front_id;
+		return;
+	}
+	for (uint32_t c = 2 * node; c <= 2 * node + 1; c++) {
+		uint32_t i = tree[c];
+		if (i != UINT32_MAX && itr->src[i].stmt != NULL &&
+		    vy_tuple_compare(itr->src[i].stmt, min_stmt,
+				     itr->key_def) == 0)
+			vy_merge_iterator_tourn_mark_front(itr, c, min_stmt);
+	}
+}
+
+/**
+ * Try to switch the iterator to tournament-based merging. The
+ * tree is built only when all sources are immutable and already
+ * positioned and no per-source stop flags can fire (immutable
+ * sources never set them), which is exactly the profile of the
+ * write iterator merging many runs and mems on dump and
+ * compaction. Does nothing when the profile does not fit or the
+ * tree cannot be allocated - the linear scan then remains in
+ * use, so the failure needs no diagnostics.
+ */
+static void
+vy_merge_iterator_tourn_build(struct vy_merge_iterator *itr)
+{
+	if (itr->mutable_start != itr->mutable_end ||
+	    itr->skipped_start != itr->src_count ||
+	    itr->unique_optimization ||
+	    itr->src_count < VY_MERGE_TOURN_MIN_SOURCES)
+		return;
+	uint32_t leaves = 1;
+	while (leaves < itr->src_count)
+		leaves <<= 1;
+	uint32_t *tree = malloc(2 * leaves * sizeof(*tree));
+	if (tree == NULL)
+		return;
+	itr->tourn_tree = tree;
+	itr->tourn_leaf_offset = leaves;
+	for (uint32_t i = 0; i < leaves; i++)
+		tree[leaves + i] = i < itr->src_count ? i : UINT32_MAX;
+	for (uint32_t n = leaves - 1; n > 0; n--)
+		tree[n] = vy_merge_iterator_tourn_match(itr, tree[2 * n],
+							tree[2 * n + 1]);
+}
+
+/**
+ * Iterate to the next key using the tournament tree: advance the
+ * sources that were on the previous front, replay only their
+ * leaf-to-root paths and take the winner from the root instead
+ * of comparing all sources with the minimum again.
+ * @retval 0 success or EOF (*ret == NULL)
+ * @retval -1 read error
+ * @retval -2 iterator is not valid anymore
+ */
+static NODISCARD int
+vy_merge_iterator_next_key_tourn(struct vy_merge_iterator *itr,
+				 struct tuple **ret)
+{
+	uint32_t prev_front_id = itr->front_id;
+	itr->front_id++;
+	itr->curr_src = UINT32_MAX;
+	itr->range_ended = true;
+	for (uint32_t i = 0; i < itr->src_count; i++) {
+		struct vy_merge_src *src = &itr->src[i];
+		if (src->front_id == prev_front_id) {
+			bool stop = false;
+			int rc = src->iterator.iface->next_key(&src->iterator,
+							       &src->stmt,
+							       &stop);
+			if (vy_merge_iterator_check_version(itr))
+				return -2;
+			if (rc != 0)
+				return rc;
+			vy_merge_iterator_tourn_replay(itr, i);
+		}
+		if (src->stmt != NULL)
+			itr->range_ended = itr->range_ended &&
+					   !src->belong_range;
+	}
+	uint32_t winner = itr->tourn_tree[1];
+	struct tuple *min_stmt = NULL;
+	if (winner != UINT32_MAX && itr->src[winner].stmt != NULL) {
+		min_stmt = itr->src[winner].stmt;
+		tuple_ref(min_stmt);
+		itr->curr_src = winner;
+		vy_merge_iterator_tourn_mark_front(itr, 1, min_stmt);
+	}
+	if (itr->curr_stmt != NULL)
+		tuple_unref(itr->curr_stmt);
+	itr->curr_stmt = min_stmt;
+	*ret = itr->curr_stmt;
+	return 0;
+}
+
 /**
  * Iterate to the next key
  * @retval 0 success or EOF (*ret == NULL)
@@ -7942,6 +8423,10 @@ vy_merge_iterator_next_key(struct vy_merge_iterator *itr, struct tuple **ret)
 	itr->search_started = true;
 	if (vy_merge_iterator_check_version(itr))
 		return -2;
+	if (itr->tourn_tree == NULL)
+		vy_merge_iterator_tourn_build(itr);
+	if (itr->tourn_tree != NULL)
+		return vy_merge_iterator_next_key_tourn(itr, ret);
 	const struct key_def *def = itr->key_def;
 	int dir = iterator_direction(itr->iterator_type);
 	uint32_t prev_front_id = itr->front_id;
@@ -8154,6 +8639,7 @@ vy_merge_iterator_squash_upsert(struct vy_merge_iterator *itr,
 	*ret = NULL;
 	struct tuple *t = itr->curr_stmt;
 
+	itr->upserts_applied = 0;
 	if (t == NULL)
 		return 0;
 	/* Upserts enabled only in the primary index. */
@@ -8176,6 +8662,7 @@ vy_merge_iterator_squash_upsert(struct vy_merge_iterator *itr,
 		if (applied == NULL)
 			return -1;
 		t = applied;
+		itr->upserts_applied++;
 	}
 	*ret = t;
 	return 0;
@@ -8691,6 +9178,40 @@ vy_read_iterator_open(struct vy_read_iterator *itr, struct vy_index *index,
 	itr->curr_range = NULL;
 }
 
+/**
+ * Start background reads for the range following the current one
+ * so that, by the time the scan gets there, its run pages are
+ * already in the OS page cache. Only makes sense for multi-range
+ * scans served from the TX thread, where synchronous page reads
+ * go through coio anyway and other ranges sit on idle disks.
+ */
+static void
+vy_read_iterator_prefetch_next_range(struct vy_read_iterator *itr)
+{
+	struct vy_index *index = itr->index;
+	if (itr->curr_range == NULL)
+		return;
+	/* Point lookups rarely cross range boundaries. */
+	if (itr->iterator_type == ITER_EQ)
+		return;
+	if (!cord_is_main() || index->env->status != VINYL_ONLINE)
+		return;
+	struct vy_range *next;
+	if (itr->iterator_type == ITER_LE || itr->iterator_type == ITER_LT)
+		next = vy_range_tree_prev(&index->tree, itr->curr_range);
+	else
+		next = vy_range_tree_next(&index->tree, itr->curr_range);
+	if (next == NULL)
+		return;
+	struct vy_slice *slice;
+	rlist_foreach_entry(slice, &next->slices, in_range) {
+		/* Same filter as in vy_read_iterator_add_disk(). */
+		if (slice->run->info.min_lsn > index->dump_lsn)
+			continue;
+		vy_slice_prefetch(&index->env->run_env, slice);
+	}
+}
+
 /**
  * Start lazy search
  */
@@ -8712,6 +9233,7 @@ vy_read_iterator_start(struct vy_read_iterator *itr)
 			       itr->index->upsert_format,
 			       index_def->iid == 0);
 	vy_read_iterator_use_range(itr);
+	vy_read_iterator_prefetch_next_range(itr);
 }
 
 /**
@@ -8805,6 +9327,7 @@ vy_read_iterator_next_range(struct vy_read_iterator *itr, struct tuple **ret)
 			       index_def->iid == 0);
 	vy_range_iterator_next(&itr->range_iterator, &itr->curr_range);
 	vy_read_iterator_use_range(itr);
+	vy_read_iterator_prefetch_next_range(itr);
 	struct tuple *stmt = NULL;
 	int rc = vy_read_iterator_merge_next_key(itr, &stmt);
 	if (rc < 0)
@@ -8892,6 +9415,22 @@ vy_read_iterator_next(struct vy_read_iterator *itr, struct tuple **result)
 	*result = itr->curr_stmt;
 	assert(*result == NULL || vy_stmt_type(*result) == IPROTO_REPLACE);
 
+	/*
+	 * The upsert chain counter kept in the in-memory tree is
+	 * reset by a dump, so a chain spanning several runs grows
+	 * unnoticed by the commit path. This read has replayed the
+	 * whole chain anyway: if it turned out to be long, schedule
+	 * background squashing so that the next read of this hot
+	 * key is cheap. Reads of older read views (including the
+	 * ones made by the squash fiber itself) do not qualify:
+	 * they may replay chains already squashed for latest
+	 * readers.
+	 */
+	if (*result != NULL && def->iid == 0 &&
+	    (**itr->read_view).vlsn == INT64_MAX &&
+	    mi->upserts_applied >= VY_UPSERT_THRESHOLD)
+		vy_index_squash_upserts(itr->index, itr->curr_stmt);
+
 	/**
 	 * Add a statement to the cache
 	 */
@@ -9079,7 +9618,7 @@ vy_join_cb(const struct vy_log_record *record, void *arg)
 		if (ctx->format != NULL)
 			tuple_format_ref(ctx->format, -1);
 		ctx->format = tuple_format_new(&vy_tuple_format_vtab,
-				(struct key_def **)&ctx->key_def, 1, 0);
+				(struct key_def **)&ctx->key_def, 1, 0, 0, 0);
 		if (ctx->format == NULL)
 			return -1;
 		tuple_format_ref(ctx->format, 1);
@@ -9454,6 +9993,17 @@ vy_squash_process(struct vy_squash *squash)
 		vy_mem_tree_iterator_prev(&mem->tree, &mem_itr);
 	}
 
+	/*
+	 * If the whole chain was dumped, the resulting statement is
+	 * older than everything in the active in-memory tree and
+	 * cannot be inserted into it without breaking its min_lsn.
+	 * Leave such a chain to compaction.
+	 */
+	if (vy_stmt_lsn(result) < mem->min_lsn) {
+		tuple_unref(result);
+		return 0;
+	}
+
 	rmean_collect(stat->rmean, VY_STAT_UPSERT_SQUASHED, 1);
 
 	/*
@@ -9545,7 +10095,19 @@ vy_index_squash_upserts(struct vy_index *index, struct tuple *stmt)
 		fiber_start(sq->fiber, sq);
 	}
 
-	struct vy_squash *squash = vy_squash_new(&sq->pool, index, stmt);
+	/*
+	 * A hot key can be reported many times before the first
+	 * squash lands; do not let duplicates pile up in the queue.
+	 */
+	struct vy_squash *squash;
+	stailq_foreach_entry(squash, &sq->queue, next) {
+		if (squash->index == index &&
+		    vy_tuple_compare(squash->stmt, stmt,
+				     &index_def->key_def) == 0)
+			return;
+	}
+
+	squash = vy_squash_new(&sq->pool, index, stmt);
 	if (squash == NULL)
 		goto fail;
 
@@ -156,8 +156,11 @@ VinylEngine::buildSecondaryKey(struct space *old_space,
 }
 
 void
-VinylEngine::join(struct vclock *vclock, struct xstream *stream)
+VinylEngine::join(struct vclock *vclock, struct xstream *stream,
+		  bool snap_file)
 {
+	/* Vinyl checkpoints are not single files - stream rows. */
+	(void) snap_file;
 	if (vy_join(env, vclock, stream) != 0)
 		diag_raise();
 }
@@ -55,8 +55,8 @@ struct VinylEngine: public Engine {
 	virtual void beginInitialRecovery(const struct vclock *) override;
 	virtual void beginFinalRecovery() override;
 	virtual void endRecovery() override;
-	virtual void join(struct vclock *vclock,
-			  struct xstream *stream) override;
+	virtual void join(struct vclock *vclock, struct xstream *stream,
+			  bool snap_file) override;
 	virtual int beginCheckpoint() override;
 	virtual int waitCheckpoint(struct vclock *vclock) override;
 	virtual void commitCheckpoint(struct vclock *vclock) override;
@@ -54,6 +54,7 @@ vy_cache_env_create(struct vy_cache_env *e, struct slab_cache *slab_cache,
 		    uint64_t mem_quota)
 {
 	rlist_create(&e->cache_lru);
+	rlist_create(&e->cache_probation);
 	vy_quota_init(&e->quota, NULL, NULL);
 	vy_quota_set_limit(&e->quota, mem_quota);
 	mempool_create(&e->cache_entry_mempool, slab_cache,
@@ -81,22 +82,41 @@ vy_cache_entry_new(struct vy_cache_env *env, struct vy_cache *cache,
 	entry->flags = 0;
 	entry->left_boundary_level = cache->key_def->part_count;
 	entry->right_boundary_level = cache->key_def->part_count;
-	rlist_add(&env->cache_lru, &entry->in_lru);
+	/* A new entry must prove its worth before joining the LRU */
+	rlist_add(&env->cache_probation, &entry->in_lru);
+	rlist_add(&cache->cache_lru, &entry->in_cache_lru);
 	size_t use = sizeof(struct vy_cache_entry) + tuple_size(stmt);
 	vy_quota_force_use(&env->quota, use);
+	cache->used += use;
 	env->cached_count++;
 	return entry;
 }
 
+/**
+ * Mark an entry as touched. Entries are admitted to the common
+ * LRU list on the second touch only; the first touch leaves them
+ * in the probation list (see vy_cache_env::cache_probation).
+ */
+static void
+vy_cache_entry_touch(struct vy_cache_entry *entry)
+{
+	struct vy_cache *cache = entry->cache;
+	rlist_move(&cache->env->cache_lru, &entry->in_lru);
+	rlist_move(&cache->cache_lru, &entry->in_cache_lru);
+}
+
 static void
 vy_cache_entry_delete(struct vy_cache_env *env, struct vy_cache_entry *entry)
 {
 	struct tuple *stmt = entry->stmt;
 	size_t put = sizeof(struct vy_cache_entry) + tuple_size(stmt);
+	assert(entry->cache->used >= put);
+	entry->cache->used -= put;
 	env->cached_count--;
 	vy_quota_release(&env->quota, put);
 	tuple_unref(stmt);
 	rlist_del(&entry->in_lru);
+	rlist_del(&entry->in_cache_lru);
 	TRASH(entry);
 	mempool_free(&env->cache_entry_mempool, entry);
 }
@@ -118,7 +138,8 @@ vy_cache_tree_page_free(void *ctx, void *p)
 }
 
 struct vy_cache *
-vy_cache_new(struct vy_cache_env *env, struct key_def *key_def)
+vy_cache_new(struct vy_cache_env *env, struct key_def *key_def,
+	     size_t quota)
 {
 	struct vy_cache *cache = (struct vy_cache *)
 		malloc(sizeof(struct vy_cache));
@@ -131,6 +152,11 @@ vy_cache_new(struct vy_cache_env *env, struct key_def *key_def)
 	cache->env = env;
 	cache->key_def = key_def;
 	cache->version = 1;
+	rlist_create(&cache->cache_lru);
+	cache->used = 0;
+	cache->quota = quota;
+	cache->hits = 0;
+	cache->misses = 0;
 	vy_cache_tree_create(&cache->cache_tree, key_def,
 			     vy_cache_tree_page_alloc,
 			     vy_cache_tree_page_free, env);
@@ -154,12 +180,13 @@ vy_cache_delete(struct vy_cache *cache)
 	free(cache);
 }
 
+/**
+ * Unlink an entry from the neighbors of its chain and delete it
+ * from its cache.
+ */
 static void
-vy_cache_gc_step(struct vy_cache_env *env)
+vy_cache_evict(struct vy_cache_entry *entry)
 {
-	struct rlist *lru = &env->cache_lru;
-	struct vy_cache_entry *entry =
-	rlist_last_entry(lru, struct vy_cache_entry, in_lru);
 	struct vy_cache *cache = entry->cache;
 	struct vy_cache_tree *tree = &cache->cache_tree;
 	if (entry->flags & (VY_CACHE_LEFT_LINKED |
@@ -192,6 +219,17 @@ vy_cache_gc_step(struct vy_cache_env *env)
 	vy_cache_entry_delete(cache->env, entry);
 }
 
+static void
+vy_cache_gc_step(struct vy_cache_env *env)
+{
+	/* Probationers go first, the LRU proper is scan-resistant */
+	struct rlist *lru = !rlist_empty(&env->cache_probation) ?
+			    &env->cache_probation : &env->cache_lru;
+	struct vy_cache_entry *entry =
+	rlist_last_entry(lru, struct vy_cache_entry, in_lru);
+	vy_cache_evict(entry);
+}
+
 static void
 vy_cache_gc(struct vy_cache_env *env)
 {
@@ -203,6 +241,22 @@ vy_cache_gc(struct vy_cache_env *env)
 	}
 }
 
+/**
+ * Enforce the individual quota of a cache, if any is set.
+ */
+static void
+vy_cache_gc_quota(struct vy_cache *cache)
+{
+	for (uint32_t i = 0;
+	     cache->quota != 0 && cache->used > cache->quota &&
+	     i < VY_CACHE_CLEANUP_MAX_STEPS; i++) {
+		struct vy_cache_entry *entry =
+			rlist_last_entry(&cache->cache_lru,
+					 struct vy_cache_entry, in_cache_lru);
+		vy_cache_evict(entry);
+	}
+}
+
 void
 vy_cache_add(struct vy_cache *cache, struct tuple *stmt,
 	     struct tuple *prev_stmt, const struct tuple *key,
@@ -210,6 +264,7 @@ vy_cache_add(struct vy_cache *cache, struct tuple *stmt,
 {
 	/* Delete some entries if quota overused */
 	vy_cache_gc(cache->env);
+	vy_cache_gc_quota(cache);
 
 	if (stmt != NULL && vy_stmt_lsn(stmt) == INT64_MAX) {
 		/* Do not store a statement from write set of a tx */
@@ -287,6 +342,8 @@ vy_cache_add(struct vy_cache *cache, struct tuple *stmt,
 		entry->left_boundary_level = replaced->left_boundary_level;
 		entry->right_boundary_level = replaced->right_boundary_level;
 		vy_cache_entry_delete(cache->env, replaced);
+		/* The key was read repeatedly - admit it to the LRU */
+		vy_cache_entry_touch(entry);
 	}
 	if (direction > 0 && boundary_level < entry->left_boundary_level)
 		entry->left_boundary_level = boundary_level;
@@ -321,6 +378,7 @@ vy_cache_add(struct vy_cache *cache, struct tuple *stmt,
 		prev_entry->left_boundary_level = replaced->left_boundary_level;
 		prev_entry->right_boundary_level = replaced->right_boundary_level;
 		vy_cache_entry_delete(cache->env, replaced);
+		vy_cache_entry_touch(prev_entry);
 	}
 
 	/* Set proper flags */
@@ -492,8 +550,10 @@ vy_cache_iterator_start(struct vy_cache_iterator *itr, struct tuple **ret,
 				itr->iterator_type == ITER_LT ?
 				vy_cache_tree_lower_bound(tree, key, &exact) :
 				vy_cache_tree_upper_bound(tree, key, &exact);
-		if (itr->iterator_type == ITER_EQ && !exact)
+		if (itr->iterator_type == ITER_EQ && !exact) {
+			itr->cache->misses++;
 			return;
+		}
 	} else if (itr->iterator_type == ITER_LE) {
 		itr->curr_pos = vy_cache_tree_invalid_iterator();
 	} else {
@@ -503,8 +563,10 @@ vy_cache_iterator_start(struct vy_cache_iterator *itr, struct tuple **ret,
 
 	if (itr->iterator_type == ITER_LT || itr->iterator_type == ITER_LE)
 		vy_cache_tree_iterator_prev(tree, &itr->curr_pos);
-	if (vy_cache_tree_iterator_is_invalid(&itr->curr_pos))
+	if (vy_cache_tree_iterator_is_invalid(&itr->curr_pos)) {
+		itr->cache->misses++;
 		return;
+	}
 
 	struct vy_cache_entry **entry =
 		vy_cache_tree_iterator_get_elem(tree, &itr->curr_pos);
@@ -519,15 +581,21 @@ vy_cache_iterator_start(struct vy_cache_iterator *itr, struct tuple **ret,
 			vy_cache_tree_iterator_next(tree, &itr->curr_pos);
 		else
 			vy_cache_tree_iterator_prev(tree, &itr->curr_pos);
-		if (vy_cache_tree_iterator_is_invalid(&itr->curr_pos))
+		if (vy_cache_tree_iterator_is_invalid(&itr->curr_pos)) {
+			itr->cache->misses++;
 			return;
+		}
 		entry = vy_cache_tree_iterator_get_elem(tree,
 							&itr->curr_pos);
 		candidate = (*entry)->stmt;
 		if (itr->iterator_type == ITER_EQ &&
-		    vy_stmt_compare(key, candidate, itr->cache->key_def))
+		    vy_stmt_compare(key, candidate, itr->cache->key_def)) {
+			itr->cache->misses++;
 			return;
+		}
 	}
+	itr->cache->hits++;
+	vy_cache_entry_touch(*entry);
 	itr->curr_stmt = candidate;
 	tuple_ref(itr->curr_stmt);
 	*ret = itr->curr_stmt;
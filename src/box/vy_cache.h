@@ -54,8 +54,10 @@ struct vy_cache_entry {
 	struct vy_cache *cache;
 	/* Statement in cache */
 	struct tuple *stmt;
-	/* Link in LRU list */
+	/* Link in global LRU or probation list */
 	struct rlist in_lru;
+	/* Link in per-index LRU list */
+	struct rlist in_cache_lru;
 	/* VY_CACHE_LEFT_LINKED and/or VY_CACHE_RIGHT_LINKED, see
 	 * description of them for more information */
 	uint32_t flags;
@@ -88,7 +90,7 @@ vy_cache_tree_key_cmp(struct vy_cache_entry *a,
 #define VY_CACHE_TREE_EXTENT_SIZE (16 * 1024)
 
 #define BPS_TREE_NAME vy_cache_tree
-#define BPS_TREE_BLOCK_SIZE 512
+/* Block size is derived from the element size (512 for a pointer). */
 #define BPS_TREE_EXTENT_SIZE VY_CACHE_TREE_EXTENT_SIZE
 #define BPS_TREE_COMPARE(a, b, index) vy_cache_tree_cmp(a, b, index)
 #define BPS_TREE_COMPARE_KEY(a, b, index) vy_cache_tree_key_cmp(a, b, index)
@@ -115,6 +117,14 @@ vy_cache_tree_key_cmp(struct vy_cache_entry *a,
 struct vy_cache_env {
 	/** Common LRU list of read cache. The first element is the newest */
 	struct rlist cache_lru;
+	/**
+	 * Probation list for freshly added entries. An entry is
+	 * moved to cache_lru only when it is touched for the
+	 * second time; until then it is evicted before any entry
+	 * of cache_lru, so a one-shot scan cannot wash out the
+	 * working set of point lookups.
+	 */
+	struct rlist cache_probation;
 	/** Common quota for read cache */
 	struct vy_quota quota;
 	/** Common mempool for vy_cache_entry struct */
@@ -152,16 +162,28 @@ struct vy_cache {
 	uint32_t version;
 	/* Saved pointer to common cache environment */
 	struct vy_cache_env *env;
+	/* Per-index LRU list, keeps the same order as the common one */
+	struct rlist cache_lru;
+	/* Memory taken by entries of this cache */
+	size_t used;
+	/* Per-index memory limit, 0 - only the common quota applies */
+	size_t quota;
+	/* Number of lookups that were served from this cache */
+	size_t hits;
+	/* Number of lookups that had to go to mems and runs */
+	size_t misses;
 };
 
 /**
  * Allocate and initialize tuple cache.
  * @param env - pointer to common cache environment.
  * @param key_def - key definition for tuple comparison.
+ * @param quota - per-index memory limit, 0 - no individual limit.
  * @retval - new tuple cache.
  */
 struct vy_cache *
-vy_cache_new(struct vy_cache_env *env, struct key_def *key_def);
+vy_cache_new(struct vy_cache_env *env, struct key_def *key_def,
+	     size_t quota);
 
 /**
  * Destroy and deallocate tuple cache.
@@ -197,9 +197,31 @@ struct vy_log {
 	 * only relevant if @tx_failed is set.
 	 */
 	struct diag tx_diag;
+	/**
+	 * Number of records appended to the current log file
+	 * since it was created. Used to decide when the log
+	 * is worth snapshotting in the background.
+	 */
+	int64_t tail_records;
+	/**
+	 * Fiber taking a background snapshot of the log or NULL.
+	 * At most one snapshot may be in progress at a time.
+	 */
+	struct fiber *snapshot_fiber;
 };
 static struct vy_log vy_log;
 
+enum {
+	/**
+	 * Number of records appended to a log file after which
+	 * a compacted snapshot of live objects is written to a
+	 * new file in the background, so that recovery replays
+	 * only the log tail instead of years of accumulated
+	 * run/range history.
+	 */
+	VY_LOG_SNAPSHOT_THRESHOLD = 100000,
+};
+
 /** Recovery context. */
 struct vy_recovery {
 	/** ID -> vy_index_recovery_info. */
@@ -734,6 +756,9 @@ vy_log_init(const char *dir)
 	wal_init_vy_log();
 }
 
+static void
+vy_log_maybe_snapshot(void);
+
 /**
  * Try to flush the log buffer to disk.
  *
@@ -785,7 +810,9 @@ vy_log_flush(void)
 	stailq_foreach_entry_safe(record, next, &vy_log.tx, in_tx)
 		mempool_free(&vy_log.record_pool, record);
 	stailq_create(&vy_log.tx);
+	vy_log.tail_records += vy_log.tx_size;
 	vy_log.tx_size = 0;
+	vy_log_maybe_snapshot();
 	return 0;
 }
 
@@ -809,7 +836,7 @@ vy_log_open(struct xlog *xlog)
 			vclock_sum(&vy_log.last_checkpoint), NONE);
 	if (access(path, F_OK) < 0 && errno == ENOENT) {
 		if (xdir_create_xlog(&vy_log.dir, xlog,
-				     &vy_log.last_checkpoint) < 0 ||
+				     &vy_log.last_checkpoint, NULL) < 0 ||
 		    xlog_rename(xlog) < 0)
 			return -1;
 	} else {
@@ -890,6 +917,9 @@ vy_log_begin_recovery(const struct vclock *vclock)
 static int
 vy_log_create(const struct vclock *vclock, struct vy_recovery *recovery);
 
+static struct vy_recovery *
+vy_recovery_new_locked(int64_t recovery_signature);
+
 int
 vy_log_end_recovery(void)
 {
@@ -945,7 +975,7 @@ vy_log_rotate_cb_func(const struct vy_log_record *record, void *cb_arg)
 
 	/* Create the log file on the first write. */
 	if (!xlog_is_open(xlog) &&
-	    xdir_create_xlog(arg->dir, xlog, arg->vclock) < 0)
+	    xdir_create_xlog(arg->dir, xlog, arg->vclock, NULL) < 0)
 		return -1;
 
 	if (vy_log_record_encode(record, &row) < 0 ||
@@ -1015,10 +1045,11 @@ vy_log_rotate(const struct vclock *vclock)
 	/*
 	 * This function is called right after bootstrap (by snapshot),
 	 * in which case old and new signatures coincide and there's
-	 * nothing we need to do.
+	 * nothing we need to do. A background snapshot may also find
+	 * out that a checkpoint has already rotated the log past its
+	 * vclock, in which case the log is fresh enough as it is.
 	 */
-	assert(vclock_compare(vclock, &vy_log.last_checkpoint) >= 0);
-	if (vclock_compare(vclock, &vy_log.last_checkpoint) == 0)
+	if (vclock_compare(vclock, &vy_log.last_checkpoint) <= 0)
 		return 0;
 
 	struct vclock *new_vclock = malloc(sizeof(*new_vclock));
@@ -1032,10 +1063,6 @@ vy_log_rotate(const struct vclock *vclock)
 	say_debug("%s: signature %lld", __func__,
 		  (long long)vclock_sum(vclock));
 
-	struct vy_recovery *recovery = vy_recovery_new(INT64_MAX);
-	if (recovery == NULL)
-		goto fail;
-
 	/*
 	 * Lock out all concurrent log writers while we are rotating it.
 	 * This effectively stalls the vinyl scheduler for a while, but
@@ -1047,6 +1074,23 @@ vy_log_rotate(const struct vclock *vclock)
 	 */
 	latch_lock(&vy_log.latch);
 
+	/*
+	 * Re-check under the latch: a concurrent rotation (e.g. a
+	 * checkpoint racing with a background snapshot) could have
+	 * advanced the last checkpoint while we were waiting.
+	 */
+	if (vclock_compare(vclock, &vy_log.last_checkpoint) <= 0) {
+		latch_unlock(&vy_log.latch);
+		free(new_vclock);
+		return 0;
+	}
+
+	struct vy_recovery *recovery = vy_recovery_new_locked(INT64_MAX);
+	if (recovery == NULL) {
+		latch_unlock(&vy_log.latch);
+		goto fail;
+	}
+
 	/* Do actual work from coeio so as not to stall tx thread. */
 	int rc = coio_call(vy_log_rotate_f, recovery, vclock);
 	vy_recovery_delete(recovery);
@@ -1061,6 +1105,7 @@ vy_log_rotate(const struct vclock *vclock)
 	 */
 	wal_rotate_vy_log();
 	vclock_copy(&vy_log.last_checkpoint, vclock);
+	vy_log.tail_records = 0;
 
 	/* Add the new vclock to the xdir so that we can track it. */
 	xdir_add_vclock(&vy_log.dir, new_vclock);
@@ -1077,6 +1122,55 @@ fail:
 	return -1;
 }
 
+/**
+ * Fiber function that writes a compacted snapshot of live objects
+ * to a new log file so that recovery does not have to replay the
+ * whole accumulated history.
+ */
+static int
+vy_log_snapshot_f(va_list ap)
+{
+	(void)ap;
+	struct vclock vclock;
+	if (wal_checkpoint(&vclock, false) != 0) {
+		say_error("failed to get WAL vclock for "
+			  "metadata log snapshot");
+		goto out;
+	}
+	/*
+	 * vy_log_rotate() is a no-op if a checkpoint has rotated
+	 * the log past the current vclock in the meantime. On
+	 * failure it logs an error itself; we will retry once the
+	 * log tail grows by another VY_LOG_SNAPSHOT_THRESHOLD
+	 * records.
+	 */
+	vy_log_rotate(&vclock);
+out:
+	vy_log.snapshot_fiber = NULL;
+	return 0;
+}
+
+/**
+ * Take a background snapshot of the log if its tail has grown
+ * too long for a quick recovery.
+ */
+static void
+vy_log_maybe_snapshot(void)
+{
+	if (vy_log.tail_records < VY_LOG_SNAPSHOT_THRESHOLD ||
+	    vy_log.recovery != NULL || vy_log.snapshot_fiber != NULL)
+		return;
+	struct fiber *fiber = fiber_new("vinyl.vylog_snapshot",
+					vy_log_snapshot_f);
+	if (fiber == NULL) {
+		/* Not a big deal, will retry on the next flush. */
+		diag_clear(diag_get());
+		return;
+	}
+	vy_log.snapshot_fiber = fiber;
+	fiber_start(fiber);
+}
+
 static ssize_t
 vy_log_collect_garbage_f(va_list ap)
 {
@@ -1921,29 +2015,37 @@ fail:
 	return -1;
 }
 
-struct vy_recovery *
-vy_recovery_new(int64_t recovery_signature)
+/** Load the log into a recovery context. The latch must be held. */
+static struct vy_recovery *
+vy_recovery_new_locked(int64_t recovery_signature)
 {
 	int rc;
 	struct vy_recovery *recovery;
 
-	/* Lock out concurrent writers while we are loading the log. */
-	latch_lock(&vy_log.latch);
 	/*
 	 * Before proceeding to log recovery, make sure that all
 	 * pending records have been flushed out.
 	 */
 	rc = vy_log_flush();
 	if (rc != 0)
-		goto out;
+		return NULL;
 
 	/* Load the log from coeio so as not to stall tx thread. */
 	rc = coio_call(vy_recovery_new_f, recovery_signature, &recovery);
-out:
-	latch_unlock(&vy_log.latch);
 	return rc == 0 ? recovery : NULL;
 }
 
+struct vy_recovery *
+vy_recovery_new(int64_t recovery_signature)
+{
+	/* Lock out concurrent writers while we are loading the log. */
+	latch_lock(&vy_log.latch);
+	struct vy_recovery *recovery =
+		vy_recovery_new_locked(recovery_signature);
+	latch_unlock(&vy_log.latch);
+	return recovery;
+}
+
 /** Helper to delete mh_i64ptr_t along with all its records. */
 static void
 vy_recovery_delete_hash(struct mh_i64ptr_t *h)
@@ -90,7 +90,7 @@ vy_mem_tree_cmp_key(const struct tuple *a, struct tree_mem_key *key,
 #define VY_MEM_TREE_EXTENT_SIZE (16 * 1024)
 
 #define BPS_TREE_NAME vy_mem_tree
-#define BPS_TREE_BLOCK_SIZE 512
+/* Block size is derived from the element size (512 for a pointer). */
 #define BPS_TREE_EXTENT_SIZE VY_MEM_TREE_EXTENT_SIZE
 #define BPS_TREE_COMPARE(a, b, key_def) vy_mem_tree_cmp(a, b, key_def)
 #define BPS_TREE_COMPARE_KEY(a, b, key_def) vy_mem_tree_cmp_key(a, b, key_def)
@@ -216,6 +216,19 @@ vy_mem_wait_pinned(struct vy_mem *mem)
 		ipc_cond_wait(&mem->pin_cond);
 }
 
+/**
+ * Size of memory (in bytes) occupied by the BPS tree extents of
+ * an in-memory level. Both the extents and the statements they
+ * point at are allocated on the generation-scoped lsregion arena
+ * and are released at once by lsregion_gc() when the generation
+ * is dumped.
+ */
+static inline size_t
+vy_mem_tree_extent_size(struct vy_mem *mem)
+{
+	return vy_mem_tree_mem_used(&mem->tree);
+}
+
 /**
  * Instantiate a new in-memory level.
  *
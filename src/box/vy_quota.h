@@ -67,6 +67,12 @@ struct vy_quota {
 	size_t watermark;
 	/** Current memory consumption. */
 	size_t used;
+	/**
+	 * Rate at which used memory is released by background
+	 * dumps, bytes per second. Set along with the watermark
+	 * by vy_quota_update_watermark().
+	 */
+	size_t release_rate;
 	/** Quota callback. */
 	vy_quota_cb cb;
 	/** Argument passed to cb. */
@@ -79,6 +85,7 @@ vy_quota_init(struct vy_quota *q, vy_quota_cb cb, void *cb_arg)
 	q->limit = SIZE_MAX;
 	q->watermark = SIZE_MAX;
 	q->used = 0;
+	q->release_rate = 0;
 	q->cb = cb;
 	q->cb_arg = cb_arg;
 }
@@ -126,6 +133,29 @@ vy_quota_update_watermark(struct vy_quota *q, size_t chunk_size,
 		q->watermark = q->limit - gap;
 	else
 		q->watermark = 0;
+	q->release_rate = release_rate;
+}
+
+/**
+ * Compute the delay to inject into a writer that has just
+ * consumed @size bytes of memory. The delay is zero below the
+ * watermark and grows linearly with quota usage, reaching one
+ * second per release_rate bytes at the limit. This way the write
+ * rate smoothly converges to the measured dump bandwidth instead
+ * of oscillating between full speed and a hard stall at the
+ * limit.
+ */
+static inline double
+vy_quota_throttle_time(struct vy_quota *q, size_t size)
+{
+	if (q->used < q->watermark || q->limit <= q->watermark ||
+	    q->release_rate == 0)
+		return 0.;
+	double k = (double)(q->used - q->watermark) /
+		   (q->limit - q->watermark);
+	if (k > 1.)
+		k = 1.;
+	return k * size / q->release_rate;
 }
 
 /**
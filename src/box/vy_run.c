@@ -29,6 +29,10 @@
  * SUCH DAMAGE.
  */
 #include "vy_run.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "fiber.h"
 #include "ipc.h"
 #include "coeio.h"
@@ -99,14 +103,17 @@ vy_page_info_create(struct vy_page_info *page_info, uint64_t offset,
 	memset(page_info, 0, sizeof(*page_info));
 	page_info->offset = offset;
 	page_info->unpacked_size = 0;
+	page_info->base_lsn = vy_stmt_lsn(min_key);
+	page_info->has_base_lsn = true;
 	struct region *region = &fiber()->gc;
-	size_t used = region_used(region);
+	struct region_svp svp;
+	region_svp_create(&svp, region);
 	uint32_t size;
 	const char *region_key = tuple_extract_key(min_key, key_def, &size);
 	if (region_key == NULL)
 		return -1;
 	page_info->min_key = vy_key_dup(region_key);
-	region_truncate(region, used);
+	region_svp_restore(&svp, region);
 	return page_info->min_key == NULL ? -1 : 0;
 }
 
@@ -133,6 +140,8 @@ vy_run_new(int64_t id)
 	run->id = id;
 	run->dump_lsn = -1;
 	run->fd = -1;
+	run->data_map = NULL;
+	run->data_map_size = 0;
 	run->refs = 1;
 	run->compacted_slice_count = 0;
 	rlist_create(&run->in_unused);
@@ -145,6 +154,9 @@ void
 vy_run_delete(struct vy_run *run)
 {
 	assert(run->refs == 0);
+	if (run->data_map != NULL &&
+	    munmap(run->data_map, run->data_map_size) < 0)
+		say_syserror("munmap failed");
 	if (run->fd >= 0 && close(run->fd) < 0)
 		say_syserror("close failed");
 	if (run->info.page_infos != NULL) {
@@ -161,6 +173,28 @@ vy_run_delete(struct vy_run *run)
 	free(run);
 }
 
+void
+vy_run_map_data(struct vy_run *run)
+{
+	assert(run->fd >= 0);
+	assert(run->data_map == NULL);
+	struct stat st;
+	if (fstat(run->fd, &st) < 0) {
+		say_syserror("fstat failed");
+		return;
+	}
+	if (st.st_size == 0)
+		return;
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+			 run->fd, 0);
+	if (map == MAP_FAILED) {
+		say_syserror("mmap failed");
+		return;
+	}
+	run->data_map = (char *)map;
+	run->data_map_size = st.st_size;
+}
+
 /**
  * Search a page in a run that may contain a given key.
  * Return the index of the found page or -1 if the key is
@@ -336,6 +370,10 @@ vy_page_info_decode(struct vy_page_info *page, const struct xrow_header *xrow,
 		case VY_PAGE_INFO_PAGE_INDEX_OFFSET:
 			page->page_index_offset = mp_decode_uint(&pos);
 			break;
+		case VY_PAGE_INFO_BASE_LSN:
+			page->base_lsn = mp_decode_uint(&pos);
+			page->has_base_lsn = true;
+			break;
 		default:
 			diag_set(ClientError, ER_INVALID_INDEX_FILE, filename,
 				 tt_sprintf("Can't decode page info: "
@@ -489,6 +527,8 @@ vy_page_new(const struct vy_page_info *page_info)
 	}
 	page->count = page_info->count;
 	page->unpacked_size = page_info->unpacked_size;
+	page->base_lsn = page_info->base_lsn;
+	page->has_base_lsn = page_info->has_base_lsn;
 	page->page_index = calloc(page_info->count, sizeof(uint32_t));
 	if (page->page_index == NULL) {
 		diag_set(OutOfMemory, page_info->count * sizeof(uint32_t),
@@ -497,14 +537,13 @@ vy_page_new(const struct vy_page_info *page_info)
 		return NULL;
 	}
 
-	page->data = (char *)malloc(page_info->unpacked_size);
-	if (page->data == NULL) {
-		diag_set(OutOfMemory, page_info->unpacked_size,
-			 "malloc", "page->data");
-		free(page->page_index);
-		free(page);
-		return NULL;
-	}
+	/*
+	 * Page data is allocated by vy_page_read(): if the page
+	 * can be served from the run file mapping, no private
+	 * buffer is needed at all.
+	 */
+	page->data = NULL;
+	page->mapped = false;
 	return page;
 }
 
@@ -512,10 +551,12 @@ void
 vy_page_delete(struct vy_page *page)
 {
 	uint32_t *page_index = page->page_index;
-	char *data = page->data;
+	/* Data borrowed from the run file mapping is not owned. */
+	char *data = page->mapped ? NULL : page->data;
 #if !defined(NDEBUG)
 	memset(page->page_index, '#', sizeof(uint32_t) * page->count);
-	memset(page->data, '#', page->unpacked_size);
+	if (data != NULL)
+		memset(data, '#', page->unpacked_size);
 	memset(page, '#', sizeof(*page));
 #endif /* !defined(NDEBUG) */
 	free(page_index);
@@ -532,7 +573,18 @@ vy_page_xrow(struct vy_page *page, uint32_t stmt_no,
 	const char *data_end = stmt_no + 1 < page->count ?
 			       page->data + page->page_index[stmt_no + 1] :
 			       page->data + page->unpacked_size;
-	return xrow_header_decode(xrow, &data, data_end);
+	if (xrow_header_decode(xrow, &data, data_end) != 0)
+		return -1;
+	if (page->has_base_lsn) {
+		/*
+		 * Undo the zigzag delta encoding of the row LSN,
+		 * see vy_run_dump_stmt().
+		 */
+		uint64_t zz = (uint64_t)xrow->lsn;
+		xrow->lsn = page->base_lsn +
+			    ((int64_t)(zz >> 1) ^ -(int64_t)(zz & 1));
+	}
+	return 0;
 }
 
 /* {{{ vy_run_iterator vy_run_iterator support functions */
@@ -670,40 +722,76 @@ vy_page_index_decode(uint32_t *page_index, uint32_t count,
  * @retval -1 on error, check diag
  */
 int
-vy_page_read(struct vy_page *page, const struct vy_page_info *page_info, int fd,
-	     ZSTD_DStream *zdctx)
+vy_page_read(struct vy_page *page, const struct vy_page_info *page_info,
+	     struct vy_run *run, ZSTD_DStream *zdctx)
 {
-	/* read xlog tx from xlog file */
-	size_t region_svp = region_used(&fiber()->gc);
-	char *data = (char *)region_alloc(&fiber()->gc, page_info->size);
-	if (data == NULL) {
-		diag_set(OutOfMemory, page_info->size, "region gc", "page");
-		return -1;
-	}
-	ssize_t readen = fio_pread(fd, data, page_info->size,
-				   page_info->offset);
-	if (readen < 0) {
-		/* TODO: report filename */
-		diag_set(SystemError, "failed to read from file");
-		goto error;
+	struct region_svp svp;
+	region_svp_create(&svp, &fiber()->gc);
+	/*
+	 * If the data file is mapped and the page is stored
+	 * uncompressed, serve it straight from the mapping
+	 * instead of reading it into a private buffer.
+	 */
+	if (run->data_map != NULL &&
+	    page_info->offset + page_info->size <= run->data_map_size) {
+		const char *raw = run->data_map + page_info->offset;
+		const char *rows, *rows_end;
+		int rc = xlog_tx_decode_borrow(raw, raw + page_info->size,
+					       &rows, &rows_end);
+		if (rc < 0)
+			return -1;
+		if (rc == 0) {
+			if (rows_end - rows !=
+			    (ptrdiff_t)page_info->unpacked_size) {
+				/* TODO: report filename */
+				diag_set(ClientError, ER_INVALID_RUN_FILE,
+					 "Unexpected page size");
+				return -1;
+			}
+			page->data = (char *)rows;
+			page->mapped = true;
+		}
+		/* rc > 0: compressed page, use the read path below. */
 	}
-	if (readen != (ssize_t)page_info->size) {
-		/* TODO: replace with XlogError, report filename */
-		diag_set(ClientError, ER_INVALID_RUN_FILE,
-			 "Unexpected end of file");
-		goto error;
+	if (!page->mapped) {
+		/* read xlog tx from xlog file */
+		char *data = (char *)region_alloc(&fiber()->gc,
+						  page_info->size);
+		if (data == NULL) {
+			diag_set(OutOfMemory, page_info->size,
+				 "region gc", "page");
+			return -1;
+		}
+		ssize_t readen = fio_pread(run->fd, data, page_info->size,
+					   page_info->offset);
+		if (readen < 0) {
+			/* TODO: report filename */
+			diag_set(SystemError, "failed to read from file");
+			goto error;
+		}
+		if (readen != (ssize_t)page_info->size) {
+			/* TODO: replace with XlogError, report filename */
+			diag_set(ClientError, ER_INVALID_RUN_FILE,
+				 "Unexpected end of file");
+			goto error;
+		}
+		/* decode xlog tx */
+		const char *data_end = data + readen;
+		page->data = (char *)malloc(page_info->unpacked_size);
+		if (page->data == NULL) {
+			diag_set(OutOfMemory, page_info->unpacked_size,
+				 "malloc", "page->data");
+			goto error;
+		}
+		char *rows = page->data;
+		char *rows_end = rows + page_info->unpacked_size;
+		if (xlog_tx_decode(data, data_end, rows, rows_end, zdctx) != 0)
+			goto error;
 	}
 	ERROR_INJECT(ERRINJ_VY_READ_PAGE_TIMEOUT, {usleep(50000);});
 
-	/* decode xlog tx */
-	const char *data_pos = data;
-	const char *data_end = data + readen;
-	char *rows = page->data;
-	char *rows_end = rows + page_info->unpacked_size;
-	if (xlog_tx_decode(data, data_end, rows, rows_end, zdctx) != 0)
-		goto error;
-
 	struct xrow_header xrow;
+	const char *data_pos, *data_end;
 	data_pos = page->data + page_info->page_index_offset;
 	data_end = page->data + page_info->unpacked_size;
 	if (xrow_header_decode(&xrow, &data_pos, data_end) == -1)
@@ -718,13 +806,13 @@ vy_page_read(struct vy_page *page, const struct vy_page_info *page_info, int fd,
 	}
 	if (vy_page_index_decode(page->page_index, page->count, &xrow) != 0)
 		goto error;
-	region_truncate(&fiber()->gc, region_svp);
+	region_svp_restore(&svp, &fiber()->gc);
 	ERROR_INJECT(ERRINJ_VY_READ_PAGE, {
 		diag_set(ClientError, ER_INJECTION, "vinyl page read");
 		return -1;});
 	return 0;
 	error:
-	region_truncate(&fiber()->gc, region_svp);
+	region_svp_restore(&svp, &fiber()->gc);
 	return -1;
 }
 
@@ -758,7 +846,7 @@ vy_page_read_cb(struct coio_task *base)
 	if (zdctx == NULL)
 		return -1;
 	task->rc = vy_page_read(task->page, &task->page_info,
-				task->slice->run->fd, zdctx);
+				task->slice->run, zdctx);
 	return task->rc;
 }
 
@@ -776,6 +864,134 @@ vy_page_read_cb_free(struct coio_task *base)
 	return 0;
 }
 
+/**
+ * Post a detached read of the given page to warm up the OS page
+ * cache in parallel with useful work.
+ */
+static void
+vy_page_prefetch(struct vy_run_env *run_env, struct vy_slice *slice,
+		 uint32_t page_no)
+{
+	struct vy_run *run = slice->run;
+	struct vy_page_info *page_info = vy_run_page_info(run, page_no);
+	/*
+	 * Readahead is best-effort: on any allocation failure
+	 * simply don't prefetch.
+	 */
+	struct vy_page *page = vy_page_new(page_info);
+	if (page == NULL) {
+		diag_clear(diag_get());
+		return;
+	}
+	struct vy_page_read_task *task =
+		(struct vy_page_read_task *)mempool_alloc(&run_env->read_task_pool);
+	if (task == NULL) {
+		vy_page_delete(page);
+		return;
+	}
+	coio_task_create(&task->base, vy_page_read_cb, vy_page_read_cb_free);
+
+	/* Keep the run file open while the task is in flight. */
+	vy_slice_pin(slice);
+
+	task->slice = slice;
+	task->page_info = *page_info;
+	task->run_env = run_env;
+	task->page = page;
+
+	/*
+	 * The page itself is thrown away by the completion
+	 * callback - the point is to pull the data into the OS
+	 * page cache in parallel with useful work, so that the
+	 * upcoming synchronous read does not touch the disk.
+	 */
+	coio_task_post_detached(&task->base);
+}
+
+void
+vy_slice_prefetch(struct vy_run_env *run_env, struct vy_slice *slice)
+{
+	if (vy_run_is_empty(slice->run))
+		return;
+	vy_page_prefetch(run_env, slice, slice->first_page_no);
+}
+
+/**
+ * Readahead for sequential range scans. A scan which keeps
+ * loading adjacent pages is detected after a few accesses and
+ * from then on the pages ahead of it are posted for detached
+ * reads, a growing window at a time, so that by the time the
+ * scan gets there the data is already in the OS page cache. A
+ * single random access drops the window back to zero.
+ */
+enum {
+	/** Sequential page loads before readahead kicks in. */
+	VY_READAHEAD_THRESHOLD = 3,
+	/** Initial readahead window, in pages. */
+	VY_READAHEAD_MIN_WINDOW = 2,
+	/** Maximal readahead window, in pages. */
+	VY_READAHEAD_MAX_WINDOW = 64,
+};
+
+/**
+ * Account a page load in the iterator access pattern detector
+ * and post readahead reads if the scan looks sequential. Purely
+ * an optimization: any page not prefetched in time is simply
+ * read synchronously when its turn comes.
+ */
+static void
+vy_run_iterator_update_readahead(struct vy_run_iterator *itr, uint32_t page_no)
+{
+	/*
+	 * Detached reads go through coeio; when the iterator
+	 * itself reads synchronously (recovery, non-TX threads),
+	 * don't post tasks on its behalf.
+	 */
+	if (!itr->coio_read)
+		return;
+	struct vy_slice *slice = itr->slice;
+	int dir = iterator_direction(itr->iterator_type);
+	if (itr->last_page_no != UINT32_MAX &&
+	    page_no == itr->last_page_no + dir) {
+		itr->seq_page_count++;
+	} else if (page_no != itr->last_page_no) {
+		/* Random access: start over with no window. */
+		itr->seq_page_count = 1;
+		itr->readahead_window = 0;
+	}
+	itr->last_page_no = page_no;
+	if (itr->seq_page_count < VY_READAHEAD_THRESHOLD)
+		return;
+	if (itr->readahead_window == 0) {
+		itr->readahead_window = VY_READAHEAD_MIN_WINDOW;
+		itr->readahead_edge = page_no + dir;
+	}
+	/*
+	 * Refill once the scan has consumed half of the posted
+	 * window, and scale the window up while the pattern
+	 * holds: each refill doubles it up to the maximum.
+	 */
+	int64_t ahead = dir > 0 ?
+			(int64_t)itr->readahead_edge - page_no - 1 :
+			(int64_t)page_no - itr->readahead_edge - 1;
+	if (ahead > itr->readahead_window / 2)
+		return;
+	if (ahead < 0) {
+		ahead = 0;
+		itr->readahead_edge = page_no + dir;
+	}
+	while (ahead < itr->readahead_window) {
+		uint32_t no = itr->readahead_edge;
+		if (no < slice->first_page_no || no > slice->last_page_no)
+			break;
+		vy_page_prefetch(itr->run_env, slice, no);
+		itr->readahead_edge += dir;
+		ahead++;
+	}
+	if (itr->readahead_window < VY_READAHEAD_MAX_WINDOW)
+		itr->readahead_window *= 2;
+}
+
 /**
  * Get a page by the given number the cache or load it from the disk.
  *
@@ -793,6 +1009,8 @@ vy_run_iterator_load_page(struct vy_run_iterator *itr, uint32_t page_no,
 	if (*result != NULL)
 		return 0;
 
+	vy_run_iterator_update_readahead(itr, page_no);
+
 	/* Allocate buffers */
 	struct vy_page_info *page_info = vy_run_page_info(slice->run, page_no);
 	struct vy_page *page = vy_page_new(page_info);
@@ -856,7 +1074,7 @@ vy_run_iterator_load_page(struct vy_run_iterator *itr, uint32_t page_no,
 			vy_page_delete(page);
 			return -1;
 		}
-		if (vy_page_read(page, page_info, slice->run->fd, zdctx) != 0) {
+		if (vy_page_read(page, page_info, slice->run, zdctx) != 0) {
 			vy_page_delete(page);
 			return -1;
 		}
@@ -1393,6 +1611,11 @@ vy_run_iterator_open(struct vy_run_iterator *itr, bool coio_read,
 	itr->curr_page = NULL;
 	itr->prev_page = NULL;
 
+	itr->last_page_no = UINT32_MAX;
+	itr->seq_page_count = 0;
+	itr->readahead_window = 0;
+	itr->readahead_edge = 0;
+
 	itr->search_started = false;
 	itr->search_ended = false;
 }
@@ -1818,6 +2041,7 @@ vy_run_recover(struct vy_run *run, const char *index_path,
 	}
 	run->fd = cursor.fd;
 	xlog_cursor_close(&cursor, true);
+	vy_run_map_data(run);
 	return 0;
 
 	fail_close:
@@ -92,7 +92,16 @@ struct vy_run_info {
 	int64_t  max_lsn;
 	/** Size of run on disk. */
 	uint64_t size;
-	/** Bloom filter of all tuples in run */
+	/**
+	 * Bloom filter of all tuples in the run, hashed by the
+	 * full user-visible key (user_key_def). It is built while
+	 * the run is written (both dump and compaction), persisted
+	 * in the VY_RUN_INFO_BLOOM field of the .index file and
+	 * loaded back on recovery. Full-key equality lookups probe
+	 * it in vy_run_iterator_start_from() before touching any
+	 * page, so a negative point lookup normally costs no page
+	 * read at all (see the bloom_reflections statistic).
+	 */
 	bool has_bloom;
 	struct bloom bloom;
 	/** Pages meta. */
@@ -117,6 +126,19 @@ struct vy_page_info {
 	char *min_key;
 	/* row index offset in page */
 	uint32_t page_index_offset;
+	/*
+	 * Base LSN of the page: rows store their LSN as a
+	 * zigzag-encoded delta from it, which turns huge
+	 * quasi-monotonic LSNs into small varints and cuts the
+	 * entropy ZSTD has to deal with.
+	 */
+	int64_t base_lsn;
+	/*
+	 * Set if the page was written with delta-encoded LSNs,
+	 * i.e. the VY_PAGE_INFO_BASE_LSN key was present in the
+	 * .index file. Old-format pages store absolute LSNs.
+	 */
+	bool has_base_lsn;
 };
 
 /**
@@ -126,6 +148,19 @@ struct vy_run {
 	struct vy_run_info info;
 	/** Run data file. */
 	int fd;
+	/**
+	 * Read-only memory mapping of the data file, or NULL if
+	 * the file could not be mapped. Pages that are stored
+	 * uncompressed are served straight from the mapping,
+	 * without a read() and a copy into a private buffer, see
+	 * vy_page_read(). The mapping lives as long as the run
+	 * itself; a page borrowing data from it keeps the run
+	 * referenced via its slice, so the mapping cannot go away
+	 * from under an open iterator.
+	 */
+	char *data_map;
+	/** Size of data_map, 0 if the file is not mapped. */
+	size_t data_map_size;
 	/** Unique ID of this run. */
 	int64_t id;
 	/** Max LSN stored on disk. */
@@ -265,6 +300,29 @@ struct vy_run_iterator {
 	/** LRU cache of two active pages (two pages is enough). */
 	struct vy_page *curr_page;
 	struct vy_page *prev_page;
+
+	/* Readahead state */
+	/**
+	 * Page loaded by the previous disk access, to tell
+	 * sequential scans from random lookups. UINT32_MAX
+	 * until the first load.
+	 */
+	uint32_t last_page_no;
+	/** Consecutive sequential page loads seen so far. */
+	uint32_t seq_page_count;
+	/**
+	 * Current readahead window, in pages. 0 until the scan
+	 * proves sequential, then grows up to a maximum while
+	 * the pattern holds and drops back to 0 on the first
+	 * random access.
+	 */
+	uint32_t readahead_window;
+	/**
+	 * The next page, in scan direction, which has not been
+	 * posted for readahead yet.
+	 */
+	uint32_t readahead_edge;
+
 	/** Is false until first .._get or .._next_.. method is called */
 	bool search_started;
 	/** Search is finished, you will not get more values from iterator */
@@ -283,8 +341,17 @@ struct vy_page {
 	uint32_t unpacked_size;
 	/** Array with row offsets in page data */
 	uint32_t *page_index;
+	/** Base LSN the row LSNs are stored relative to */
+	int64_t base_lsn;
+	/** Set if row LSNs are zigzag deltas from base_lsn */
+	bool has_base_lsn;
 	/** Page data */
 	char *data;
+	/**
+	 * Set if data points into the run file mapping
+	 * (vy_run::data_map) and must not be freed.
+	 */
+	bool mapped;
 };
 
 /**
@@ -357,6 +424,16 @@ int
 vy_run_recover(struct vy_run *run, const char *index_path,
 	       const char *run_path);
 
+/**
+ * Try to map the run data file into memory so that uncompressed
+ * pages can be served without a read() and a copy. Must be called
+ * after the data file has been opened, before the run is exposed
+ * to readers. Mapping failure is not an error - the run simply
+ * falls back to the plain read path.
+ */
+void
+vy_run_map_data(struct vy_run *run);
+
 /**
  * Allocate a new run slice.
  * This function increments @run->refs.
@@ -374,6 +451,16 @@ vy_slice_new(int64_t id, struct vy_run *run,
 void
 vy_slice_delete(struct vy_slice *slice);
 
+/**
+ * Kick off a background read of the first page of a run slice
+ * to warm the OS page cache. Fire and forget: the submitting
+ * fiber does not wait and the task resources are released by
+ * the completion callback. Used by range scans to overlap disk
+ * reads of the next range with consumption of the current one.
+ */
+void
+vy_slice_prefetch(struct vy_run_env *run_env, struct vy_slice *slice);
+
 /**
  * Pin a run slice.
  * A pinned slice can't be deleted until it's unpinned.
@@ -479,8 +566,8 @@ vy_page_xrow(struct vy_page *page, uint32_t stmt_no,
  * @retval -1 on error, check diag
  */
 int
-vy_page_read(struct vy_page *page, const struct vy_page_info *page_info, int fd,
-	     ZSTD_DStream *zdctx);
+vy_page_read(struct vy_page *page, const struct vy_page_info *page_info,
+	     struct vy_run *run, ZSTD_DStream *zdctx);
 
 #if defined(__cplusplus)
 } /* extern "C" */
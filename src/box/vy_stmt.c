@@ -40,11 +40,27 @@
 #include <small/region.h>
 #include "small/lsregion.h"
 
+#include "clock.h"
 #include "error.h"
 #include "tuple_format.h"
 #include "xrow.h"
 #include "fiber.h"
 
+struct vy_lsalloc_stat vy_lsalloc_stat;
+
+void *
+vy_lsalloc(struct lsregion *lsregion, size_t size, int64_t alloc_id)
+{
+	uint64_t start = clock_monotonic64();
+	void *ptr = lsregion_alloc(lsregion, size, alloc_id);
+	uint64_t elapsed = clock_monotonic64() - start;
+	vy_lsalloc_stat.count++;
+	vy_lsalloc_stat.time_total += elapsed;
+	if (elapsed > vy_lsalloc_stat.time_max)
+		vy_lsalloc_stat.time_max = elapsed;
+	return ptr;
+}
+
 void
 vy_tuple_delete(struct tuple_format *format, struct tuple *tuple)
 {
@@ -124,7 +140,7 @@ vy_stmt_dup_lsregion(const struct tuple *stmt, struct lsregion *lsregion,
 {
 	size_t size = tuple_size(stmt);
 	struct tuple *mem_stmt;
-	mem_stmt = lsregion_alloc(lsregion, size, alloc_id);
+	mem_stmt = vy_lsalloc(lsregion, size, alloc_id);
 	if (mem_stmt == NULL) {
 		diag_set(OutOfMemory, size, "lsregion_alloc", "mem_stmt");
 		return NULL;
@@ -209,6 +209,29 @@ struct tuple *
 vy_stmt_dup_lsregion(const struct tuple *stmt, struct lsregion *lsregion,
 		     int64_t alloc_id);
 
+/**
+ * Counters of lsregion allocations of the in-memory level:
+ * statement copies and tree extents alike. Grabbing a new slab
+ * inside lsregion_alloc() is the only write-path operation which
+ * may reach mmap, so the worst observed latency tells whether
+ * ingest stalls correlate with slab acquisition. Times are in
+ * nanoseconds; updated from the tx thread only.
+ */
+struct vy_lsalloc_stat {
+	/** Number of allocations. */
+	int64_t count;
+	/** Time spent in lsregion_alloc(), total. */
+	uint64_t time_total;
+	/** The slowest single allocation. */
+	uint64_t time_max;
+};
+
+extern struct vy_lsalloc_stat vy_lsalloc_stat;
+
+/** lsregion_alloc() with the counters above maintained. */
+void *
+vy_lsalloc(struct lsregion *lsregion, size_t size, int64_t alloc_id);
+
 /**
  * Return true if @a stmt was allocated on lsregion.
  * @param stmt a statement
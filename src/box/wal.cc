@@ -34,9 +34,13 @@
 #include "fiber.h"
 #include "fio.h"
 #include "errinj.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include "histogram.h"
 
 #include "xlog.h"
 #include "xrow.h"
+#include "clock.h"
 #include "vy_log.h"
 #include "cbus.h"
 #include "coeio.h"
@@ -105,6 +109,41 @@ struct wal_writer
 	struct vclock vclock;
 	/** The current WAL file. */
 	struct xlog current_wal;
+	/**
+	 * Group commit window, seconds. Used in WAL_FSYNC mode
+	 * only. Before writing a batch out the WAL thread waits
+	 * for this long, letting the requests which arrive in
+	 * the meantime pile up into the next batch on the tx
+	 * side, so that many transactions share one fsync().
+	 * Auto-tuned from the observed fsync() latency, hence
+	 * on a fast disk the extra delay shrinks to nothing.
+	 */
+	double sync_window;
+	/** Smoothed fsync() latency, seconds. */
+	double sync_time;
+	/**
+	 * Rows per written batch, for box.stat.wal(). Tells how
+	 * well requests coalesce into wal_msg batches. May be
+	 * NULL if allocation failed - then no stats are kept.
+	 */
+	struct histogram *batch_rows_hist;
+	/** fsync() latency in microseconds, for box.stat.wal(). */
+	struct histogram *fsync_delay_hist;
+	/**
+	 * Batch queue wait in microseconds - from submission on
+	 * the tx side to the moment the WAL thread picked the
+	 * batch up. Grows when the writer falls behind, i.e. the
+	 * disk is saturated. May be NULL, like the above.
+	 */
+	struct histogram *queue_wait_hist;
+	/** The total number of rows submitted to the WAL. */
+	int64_t row_count;
+	/** Bytes appended to WAL files. */
+	int64_t write_bytes;
+	/** Cumulative time spent writing batches out, seconds. */
+	double write_time;
+	/** Cumulative time spent in fsync(), seconds. */
+	double fsync_time;
 	/**
 	 * Used if there was a WAL I/O error and we need to
 	 * keep adding all incoming requests to the rollback
@@ -122,6 +161,16 @@ struct wal_writer
 };
 
 struct wal_msg: public cmsg {
+	/** Submission time, to measure the queue wait. */
+	double submit_time;
+	/**
+	 * True if the batch is malloc()ed and must be freed by
+	 * tx_schedule_commit(). A batch opened by a detached
+	 * (async commit) entry can not live on the fiber region:
+	 * the submitting fiber does not wait for the write and
+	 * truncates its region right after commit.
+	 */
+	bool is_dynamic;
 	/** Input queue, on output contains all committed requests. */
 	struct stailq commit;
 	/**
@@ -164,6 +213,8 @@ static void
 wal_msg_create(struct wal_msg *batch)
 {
 	cmsg_init(batch, wal_request_route);
+	batch->submit_time = clock_fast();
+	batch->is_dynamic = false;
 	stailq_create(&batch->commit);
 	stailq_create(&batch->rollback);
 }
@@ -196,6 +247,9 @@ xlog_write_entry(struct xlog *l, struct journal_entry *entry)
 	return xlog_tx_commit(l);
 }
 
+/** Asynchronously committed row accounting, tx thread only. */
+static struct wal_async_stat wal_async_stats;
+
 /**
  * Invoke fibers waiting for their journal_entry's to be
  * completed. The fibers are invoked in strict fifo order:
@@ -206,13 +260,49 @@ xlog_write_entry(struct xlog *l, struct journal_entry *entry)
 static void
 tx_schedule_queue(struct stailq *queue)
 {
-	/*
-	 * fiber_wakeup() is faster than fiber_call() when there
-	 * are many ready fibers.
-	 */
-	struct journal_entry *req;
-	stailq_foreach_entry(req, queue, fifo)
-		fiber_wakeup(req->fiber);
+	struct journal_entry *req, *next;
+	stailq_foreach_entry_safe(req, next, queue, fifo) {
+		if (req->fiber != NULL) {
+			/*
+			 * fiber_wakeup() is faster than
+			 * fiber_call() when there are many ready
+			 * fibers.
+			 */
+			fiber_wakeup(req->fiber);
+			continue;
+		}
+		/*
+		 * A detached (async commit) entry: the client was
+		 * acked at submission, complete the entry here.
+		 */
+		if (req->res >= 0) {
+			/*
+			 * Promote the replica set vclock, as
+			 * wal_write() does for waited-for entries.
+			 * An entry further down the batch may have
+			 * already advanced it, hence the check.
+			 */
+			struct xrow_header *last =
+				req->rows[req->n_rows - 1];
+			if (last->replica_id == instance_id &&
+			    vclock_get(&replicaset_vclock,
+				       instance_id) < last->lsn)
+				vclock_follow(&replicaset_vclock,
+					      instance_id, last->lsn);
+			wal_async_stats.written += req->n_rows;
+		} else {
+			/*
+			 * The rows were acked and applied in
+			 * memory; there is nothing to roll back,
+			 * they are simply lost.
+			 */
+			wal_async_stats.lost += req->n_rows;
+			say_error("%d asynchronously committed rows "
+				  "lost to a WAL write error",
+				  req->n_rows);
+		}
+		free(req);
+	}
 }
 
 /**
@@ -235,7 +325,10 @@ tx_schedule_commit(struct cmsg *msg)
 		/* Closes the input valve. */
 		stailq_concat(&writer->rollback, &batch->rollback);
 	}
+	bool is_dynamic = batch->is_dynamic;
 	tx_schedule_queue(&batch->commit);
+	if (is_dynamic)
+		free(batch);
 }
 
 static void
@@ -272,11 +365,44 @@ wal_writer_create(struct wal_writer *writer, enum wal_mode wal_mode,
 	writer->wal_max_size = wal_max_size;
 	journal_create(&writer->base, wal_mode == WAL_NONE ?
 		       wal_write_in_wal_mode_none : wal_write, NULL);
+	/* Only a real WAL thread can complete detached entries. */
+	writer->base.async_capable = wal_mode != WAL_NONE;
 
 	xdir_create(&writer->wal_dir, wal_dirname, XLOG, instance_uuid);
 	xlog_clear(&writer->current_wal);
+	/*
+	 * In WAL_FSYNC mode the file used to be opened with
+	 * O_SYNC, which syncs every writev(2) call. Instead,
+	 * wal_write_to_disk() now calls fsync() explicitly,
+	 * once per batch, see wal_fsync(). The sync must be
+	 * blocking: an entry may be acked only when durable.
+	 */
 	if (wal_mode == WAL_FSYNC)
-		writer->wal_dir.open_wflags |= O_SYNC;
+		writer->wal_dir.sync_is_async = false;
+	writer->sync_window = 0.;
+	writer->sync_time = 0.;
+
+	enum { US = 1, MS = 1000 * US };
+	static int64_t rows_buckets[] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 256, 512,
+		1024, 2048, 4096, 8192, 16384,
+	};
+	static int64_t delay_buckets[] = {
+		10 * US, 50 * US, 100 * US, 250 * US, 500 * US,
+		1 * MS, 2 * MS, 5 * MS, 10 * MS, 25 * MS, 50 * MS,
+		100 * MS, 250 * MS, 500 * MS, 1000 * MS,
+	};
+	/* If we are out of memory, simply live without the stats. */
+	writer->batch_rows_hist = histogram_new(rows_buckets,
+						lengthof(rows_buckets));
+	writer->fsync_delay_hist = histogram_new(delay_buckets,
+						 lengthof(delay_buckets));
+	writer->queue_wait_hist = histogram_new(delay_buckets,
+						lengthof(delay_buckets));
+	writer->row_count = 0;
+	writer->write_bytes = 0;
+	writer->write_time = 0.;
+	writer->fsync_time = 0.;
 
 	stailq_create(&writer->rollback);
 	cmsg_init(&writer->in_rollback, NULL);
@@ -293,6 +419,9 @@ wal_writer_create(struct wal_writer *writer, enum wal_mode wal_mode,
 static void
 wal_writer_destroy(struct wal_writer *writer)
 {
+	histogram_delete(writer->batch_rows_hist);
+	histogram_delete(writer->fsync_delay_hist);
+	histogram_delete(writer->queue_wait_hist);
 	xdir_destroy(&writer->wal_dir);
 	tt_pthread_mutex_destroy(&writer->watchers_mutex);
 }
@@ -462,6 +591,61 @@ wal_collect_garbage(int64_t lsn)
 	fiber_set_cancellable(cancellable);
 }
 
+struct wal_stat_msg: public cbus_call_msg
+{
+	struct wal_stat *stat;
+};
+
+static int
+wal_stat_f(struct cbus_call_msg *data)
+{
+	struct wal_stat *stat = ((struct wal_stat_msg *)data)->stat;
+	struct wal_writer *writer = &wal_writer_singleton;
+	struct histogram *hist = writer->batch_rows_hist;
+	if (hist != NULL) {
+		stat->batches = hist->total;
+		stat->rows = writer->row_count;
+		stat->rows_per_batch_p50 = histogram_percentile(hist, 50);
+		stat->rows_per_batch_p90 = histogram_percentile(hist, 90);
+		stat->rows_per_batch_p99 = histogram_percentile(hist, 99);
+		stat->rows_per_batch_max = hist->max;
+	}
+	hist = writer->fsync_delay_hist;
+	if (hist != NULL) {
+		stat->fsyncs = hist->total;
+		stat->fsync_delay_p50 = histogram_percentile(hist, 50);
+		stat->fsync_delay_p99 = histogram_percentile(hist, 99);
+		stat->fsync_delay_max = hist->max;
+	}
+	hist = writer->queue_wait_hist;
+	if (hist != NULL) {
+		stat->queue_wait_p50 = histogram_percentile(hist, 50);
+		stat->queue_wait_p99 = histogram_percentile(hist, 99);
+		stat->queue_wait_max = hist->max;
+	}
+	stat->bytes_written = writer->write_bytes;
+	stat->write_time = writer->write_time;
+	stat->fsync_time = writer->fsync_time;
+	return 0;
+}
+
+int
+wal_stat(struct wal_stat *stat)
+{
+	struct wal_writer *writer = &wal_writer_singleton;
+	memset(stat, 0, sizeof(*stat));
+	if (! journal_is_initialized(&writer->base) ||
+	    writer->wal_mode == WAL_NONE)
+		return -1;
+	struct wal_stat_msg msg;
+	msg.stat = stat;
+	bool cancellable = fiber_set_cancellable(false);
+	int rc = cbus_call(&wal_thread.wal_pipe, &wal_thread.tx_pipe, &msg,
+			   wal_stat_f, NULL, TIMEOUT_INFINITY);
+	fiber_set_cancellable(cancellable);
+	return rc;
+}
+
 /**
  * If there is no current WAL, try to open it, and close the
  * previous WAL. We close the previous WAL only after opening
@@ -507,11 +691,18 @@ wal_opt_rotate(struct wal_writer *writer)
 	vclock_copy(vclock, &writer->vclock);
 
 	if (xdir_create_xlog(&writer->wal_dir, &writer->current_wal,
-			     &writer->vclock) != 0) {
+			     &writer->vclock, NULL) != 0) {
 		error_log(diag_last_error(diag_get()));
 		free(vclock);
 		return -1;
 	}
+	/*
+	 * Journal entries are not freed until the batch which
+	 * wrote them is flushed to disk, so row bodies can be
+	 * written by reference, straight from the submitter's
+	 * buffers, saving a copy of every logged byte.
+	 */
+	writer->current_wal.ref_bodies = true;
 	xdir_add_vclock(&writer->wal_dir, vclock);
 
 	return 0;
@@ -584,16 +775,79 @@ wal_assign_lsn(struct wal_writer *writer, struct xrow_header **row,
 	}
 }
 
+/**
+ * How much disk space to preallocate ahead of the WAL write
+ * position, @sa xlog_fallocate().
+ */
+enum { WAL_FALLOCATE_LEN = 1024 * 1024 };
+
+/** Hard cap on the group commit window, seconds. */
+static const double wal_sync_window_max = 0.0005;
+
+/**
+ * Sync the current WAL file to disk and re-tune the group
+ * commit window from the measured fsync() latency.
+ */
+static int
+wal_fsync(struct wal_writer *writer)
+{
+	/*
+	 * Rehearse a degraded disk: stall the wal thread the way
+	 * a slow fsync() would. The delay is deliberately taken
+	 * into the measured latency below, so the group commit
+	 * window auto-tuning reacts exactly as it would to real
+	 * disk trouble.
+	 */
+	FAULT_INJECT(FAULT_INJ_WAL_SYNC_DELAY, 0, 0, {
+		usleep(fault_inj_delay(FAULT_INJ_WAL_SYNC_DELAY) * 1e6);
+	});
+	double start = clock_fast();
+	if (xlog_sync(&writer->current_wal) != 0)
+		return -1;
+	double elapsed = clock_fast() - start;
+	writer->fsync_time += elapsed;
+	if (writer->fsync_delay_hist != NULL)
+		histogram_collect(writer->fsync_delay_hist, elapsed * 1e6);
+	/* Smooth the estimate to filter out one-off spikes. */
+	writer->sync_time = writer->sync_time == 0. ? elapsed :
+		0.9 * writer->sync_time + 0.1 * elapsed;
+	/*
+	 * Waiting a quarter of the sync latency before the next
+	 * batch adds at most ~25% to the commit delay, while
+	 * every transaction arriving within the window shares
+	 * a single fsync() instead of issuing its own.
+	 */
+	writer->sync_window = MIN(writer->sync_time / 4,
+				  wal_sync_window_max);
+	return 0;
+}
+
 static void
 wal_write_to_disk(struct cmsg *msg)
 {
 	struct wal_writer *writer = &wal_writer_singleton;
 	struct wal_msg *wal_msg = (struct wal_msg *) msg;
 
+	if (writer->queue_wait_hist != NULL) {
+		double wait = clock_fast() - wal_msg->submit_time;
+		histogram_collect(writer->queue_wait_hist, wait * 1e6);
+	}
+
 	struct errinj *inj = errinj(ERRINJ_WAL_DELAY, ERRINJ_BOOL);
 	while (inj != NULL && inj->bparam)
 		usleep(10);
 
+	if (writer->wal_mode == WAL_FSYNC && writer->sync_window > 0.) {
+		/*
+		 * Group commit: hold the batch for a short while
+		 * before hitting the disk. The requests arriving
+		 * in the meantime accumulate in the next batch on
+		 * the tx side, so the write and the fsync() below
+		 * get amortized across more transactions.
+		 */
+		usleep(writer->sync_window * 1e6);
+	}
+
 	if (writer->in_rollback.route != NULL) {
 		/* We're rolling back a failed write. */
 		stailq_concat(&wal_msg->rollback, &wal_msg->commit);
@@ -633,6 +887,30 @@ wal_write_to_disk(struct cmsg *msg)
 	 * Iterate over requests (transactions)
 	 */
 	struct journal_entry *entry, *last_commit_entry = NULL;
+
+	/* Split plain write time from the fsync() time below. */
+	double write_start = clock_fast();
+	int64_t write_offset = l->offset;
+
+	if (writer->batch_rows_hist != NULL) {
+		int64_t rows = 0;
+		stailq_foreach_entry(entry, &wal_msg->commit, fifo)
+			rows += entry->n_rows;
+		histogram_collect(writer->batch_rows_hist, rows);
+		writer->row_count += rows;
+	}
+
+	/*
+	 * Keep a chunk of disk space preallocated ahead of the
+	 * append position. Otherwise every append crossing into
+	 * a new file block would allocate it synchronously, and
+	 * on a journalling filesystem block allocation entails
+	 * a journal commit which may stall the WAL for tens of
+	 * milliseconds.
+	 */
+	if (xlog_fallocate(l, WAL_FALLOCATE_LEN) != 0)
+		goto done;
+
 	stailq_foreach_entry(entry, &wal_msg->commit, fifo) {
 		wal_assign_lsn(writer, entry->rows, entry->rows + entry->n_rows);
 		entry->res = vclock_sum(&writer->vclock);
@@ -650,6 +928,18 @@ wal_write_to_disk(struct cmsg *msg)
 					      struct journal_entry, fifo);
 
 done:
+	writer->write_time += clock_fast() - write_start;
+	writer->write_bytes += l->offset - write_offset;
+	/*
+	 * An entry may be reported as committed only once its
+	 * data is known to have reached the disk. If the sync
+	 * fails, no such guarantee exists for anything written
+	 * in this batch, so roll the whole batch back.
+	 */
+	if (writer->wal_mode == WAL_FSYNC && last_commit_entry != NULL &&
+	    wal_fsync(writer) != 0)
+		last_commit_entry = NULL;
+
 	struct error *error = diag_last_error(diag_get());
 	if (error) {
 		/* Until we can pass the error to tx, log it and clear. */
@@ -694,6 +984,8 @@ wal_thread_f(va_list ap)
 
 	struct cbus_endpoint endpoint;
 	cbus_endpoint_create(&endpoint, "wal", fiber_schedule_cb, fiber());
+	/* Every committed transaction passes through this queue. */
+	cbus_endpoint_set_lockfree(&endpoint);
 	/*
 	 * Create a pipe to TX thread. Use a high priority
 	 * endpoint, to ensure that WAL messages are delivered
@@ -747,10 +1039,23 @@ wal_write(struct journal *journal, struct journal_entry *entry)
 
 		stailq_add_tail_entry(&batch->commit, entry, fifo);
 	} else {
-		batch = (struct wal_msg *)
-			region_alloc_xc(&fiber()->gc,
-					sizeof(struct wal_msg));
+		if (entry->fiber != NULL) {
+			batch = (struct wal_msg *)
+				region_alloc_xc(&fiber()->gc,
+						sizeof(struct wal_msg));
+		} else {
+			/* See the wal_msg::is_dynamic comment. */
+			batch = (struct wal_msg *)
+				malloc(sizeof(struct wal_msg));
+			if (batch == NULL) {
+				diag_set(OutOfMemory,
+					 sizeof(struct wal_msg),
+					 "malloc", "struct wal_msg");
+				return -1;
+			}
+		}
 		wal_msg_create(batch);
+		batch->is_dynamic = entry->fiber == NULL;
 		/*
 		 * Sic: first add a request, then push the batch,
 		 * since cpipe_push() may pass the batch to WAL
@@ -761,6 +1066,18 @@ wal_write(struct journal *journal, struct journal_entry *entry)
 	}
 	wal_thread.wal_pipe.n_input += entry->n_rows * XROW_IOVMAX;
 	cpipe_flush_input(&wal_thread.wal_pipe);
+	if (entry->fiber == NULL) {
+		/*
+		 * A fire-and-forget entry: the caller is acked
+		 * right away, tx_schedule_queue() accounts and
+		 * frees the entry once the WAL thread reports
+		 * back. The caller gets a provisional signature:
+		 * only memtx may commit on it, since it ignores
+		 * the value.
+		 */
+		wal_async_stats.submitted += entry->n_rows;
+		return 0;
+	}
 	/**
 	 * It's not safe to spuriously wakeup this fiber
 	 * since in that case it will ignore a possible
@@ -772,12 +1089,22 @@ wal_write(struct journal *journal, struct journal_entry *entry)
 	fiber_set_cancellable(cancellable);
 	/* All rows in request have the same replica id. */
 	struct xrow_header *last = entry->rows[entry->n_rows - 1];
-	/* Promote replica set vclock with local writes. */
-	if (last->replica_id == instance_id)
+	/*
+	 * Promote replica set vclock with local writes. An async
+	 * commit completion may have already moved it further.
+	 */
+	if (last->replica_id == instance_id &&
+	    vclock_get(&replicaset_vclock, instance_id) < last->lsn)
 		vclock_follow(&replicaset_vclock, instance_id, last->lsn);
 	return entry->res;
 }
 
+void
+wal_async_stat(struct wal_async_stat *stat)
+{
+	*stat = wal_async_stats;
+}
+
 int64_t
 wal_write_in_wal_mode_none(struct journal *journal,
 			   struct journal_entry *entry)
@@ -103,6 +103,72 @@ wal_checkpoint(struct vclock *vclock, bool rotate);
 void
 wal_collect_garbage(int64_t lsn);
 
+/**
+ * WAL write batching and sync statistics, as reported by
+ * box.stat.wal(). Latencies are in microseconds.
+ */
+struct wal_stat {
+	/** The number of batches written out. */
+	int64_t batches;
+	/** The total number of rows submitted to the WAL. */
+	int64_t rows;
+	/** Rows per batch percentiles. */
+	int64_t rows_per_batch_p50;
+	int64_t rows_per_batch_p90;
+	int64_t rows_per_batch_p99;
+	int64_t rows_per_batch_max;
+	/** The number of fsync() calls. */
+	int64_t fsyncs;
+	/** fsync() latency percentiles. */
+	int64_t fsync_delay_p50;
+	int64_t fsync_delay_p99;
+	int64_t fsync_delay_max;
+	/** Bytes appended to WAL files. */
+	int64_t bytes_written;
+	/** Total time spent writing batches out, seconds. */
+	double write_time;
+	/** Total time spent in fsync(), seconds. */
+	double fsync_time;
+	/**
+	 * Batch queue wait percentiles - submission on the tx
+	 * side to pickup by the WAL thread. Grows when the
+	 * writer falls behind the load, i.e. the disk is
+	 * saturated.
+	 */
+	int64_t queue_wait_p50;
+	int64_t queue_wait_p99;
+	int64_t queue_wait_max;
+};
+
+/**
+ * Fetch WAL write statistics from the WAL thread. Zeroes @stat
+ * and returns -1 if the WAL is not keeping any: wal_mode is
+ * 'none' or the writer is not yet initialized.
+ */
+int
+wal_stat(struct wal_stat *stat);
+
+/**
+ * Accounting of asynchronously committed rows (written to spaces
+ * with the async_commit option), as reported by
+ * box.info.wal_async. All counters live in the tx thread.
+ */
+struct wal_async_stat {
+	/** Rows queued to the WAL thread and acked to clients. */
+	int64_t submitted;
+	/** Rows confirmed on disk. */
+	int64_t written;
+	/**
+	 * Rows lost to a WAL write error: they were acked and
+	 * applied, but never made it to disk. submitted -
+	 * written - lost is the current unsynced gap.
+	 */
+	int64_t lost;
+};
+
+void
+wal_async_stat(struct wal_async_stat *stat);
+
 void
 wal_init_vy_log();
 
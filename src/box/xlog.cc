@@ -34,6 +34,7 @@
 #include <ctype.h>
 
 #include "fiber.h"
+#include "tt_pthread.h"
 #include "crc32.h"
 #include "fio.h"
 #include "third_party/tarantool_eio.h"
@@ -77,6 +78,18 @@ enum {
 	 * Maybe this should be a configuration option.
 	 */
 	XLOG_TX_COMPRESS_THRESHOLD = 2 * 1024,
+	/**
+	 * Reference row bodies at least this big instead of
+	 * copying them to the write buffer. A separate iovec
+	 * in the scatter list costs more than a short memcpy.
+	 */
+	XLOG_REF_THRESHOLD = 128,
+	/**
+	 * The maximal length of a scatter list for a single
+	 * transaction: every referenced body may split an
+	 * output buffer chunk in two.
+	 */
+	XLOG_TX_IOVMAX = SMALL_OBUF_IOV_MAX + 1 + 2 * XLOG_REF_MAX,
 };
 
 const struct type type_XlogError = make_type("XlogError", &type_Exception);
@@ -126,13 +139,14 @@ enum {
 	 *
 	 * @sa xlog_meta_parse()
 	 */
-	XLOG_META_LEN_MAX = 1024 + VCLOCK_STR_LEN_MAX
+	XLOG_META_LEN_MAX = 1024 + 2 * VCLOCK_STR_LEN_MAX
 };
 
 #define INSTANCE_UUID_KEY "Instance"
 #define INSTANCE_UUID_KEY_V12 "Server"
 #define VCLOCK_KEY "VClock"
 #define VERSION_KEY "Version"
+#define PREV_VCLOCK_KEY "PrevVClock"
 
 static const char v13[] = "0.13";
 static const char v12[] = "0.12";
@@ -161,10 +175,21 @@ xlog_meta_format(const struct xlog_meta *meta, char *buf, int size)
 		"%s\n"
 		VERSION_KEY ": %s\n"
 		INSTANCE_UUID_KEY ": %s\n"
-		VCLOCK_KEY ": %s\n\n",
+		VCLOCK_KEY ": %s\n",
 		meta->filetype, v13, PACKAGE_VERSION, instance_uuid, vstr);
 	assert(total > 0);
 	free(vstr);
+	if (meta->has_prev_vclock) {
+		char *pstr = vclock_to_string(&meta->prev_vclock);
+		if (pstr == NULL)
+			return -1;
+		int off = MIN(total, size);
+		total += snprintf(buf + off, size - off,
+				  PREV_VCLOCK_KEY ": %s\n", pstr);
+		free(pstr);
+	}
+	int off = MIN(total, size);
+	total += snprintf(buf + off, size - off, "\n");
 	return total;
 }
 
@@ -276,6 +301,25 @@ xlog_meta_parse(struct xlog_meta *meta, const char **data,
 					  "offset %zd", off);
 				return -1;
 			}
+		} else if (memcmp(key, PREV_VCLOCK_KEY, key_end - key) == 0) {
+			/*
+			 * PrevVClock: <vclock>
+			 */
+			if (val_end - val > VCLOCK_STR_LEN_MAX) {
+				tnt_error(XlogError, "can't parse prev vclock");
+				return -1;
+			}
+			char vclock[VCLOCK_STR_LEN_MAX + 1];
+			memcpy(vclock, val, val_end - val);
+			vclock[val_end - val] = '\0';
+			size_t off = vclock_from_string(&meta->prev_vclock,
+							vclock);
+			if (off != 0) {
+				tnt_error(XlogError, "invalid prev vclock at "
+					  "offset %zd", off);
+				return -1;
+			}
+			meta->has_prev_vclock = true;
 		} else if (memcmp(key, VERSION_KEY, key_end - key) == 0) {
 			/* Ignore Version: for now */
 		} else {
@@ -306,7 +350,37 @@ xdir_create(struct xdir *dir, const char *dirname,
 	/* Default mode. */
 	dir->mode = 0660;
 	dir->instance_uuid = instance_uuid;
-	snprintf(dir->dirname, PATH_MAX, "%s", dirname);
+	/*
+	 * A ';'-separated list of directories stripes the log:
+	 * the first one is the primary directory, the rest are
+	 * extra stripes (see struct xdir). Only write ahead logs
+	 * benefit from striping - snapshots and the vinyl log are
+	 * written by one long sequential pass each - so the list
+	 * form is accepted for XLOG directories only.
+	 */
+	const char *sep = type == XLOG ? strchr(dirname, ';') : NULL;
+	if (sep == NULL) {
+		snprintf(dir->dirname, PATH_MAX, "%s", dirname);
+	} else {
+		snprintf(dir->dirname, PATH_MAX, "%.*s",
+			 (int) (sep - dirname), dirname);
+		while (sep != NULL) {
+			const char *begin = sep + 1;
+			sep = strchr(begin, ';');
+			int len = sep != NULL ? (int) (sep - begin) :
+				  (int) strlen(begin);
+			if (len == 0)
+				continue;
+			if (dir->stripe_count == XDIR_STRIPE_MAX - 1) {
+				say_warn("too many log directories, "
+					 "ignoring `%.*s' and the rest",
+					 len, begin);
+				break;
+			}
+			snprintf(dir->stripes[dir->stripe_count++],
+				 PATH_MAX, "%.*s", len, begin);
+		}
+	}
 	dir->open_wflags = O_RDWR | O_CREAT | O_EXCL;
 	switch (type) {
 	case SNAP:
@@ -328,6 +402,12 @@ xdir_create(struct xdir *dir, const char *dirname,
 		dir->suffix = INPROGRESS;
 		dir->force_recovery = true;
 		break;
+	case DSNAP:
+		dir->filetype = "DSNAP";
+		dir->filename_ext = ".delta.snap";
+		dir->suffix = INPROGRESS;
+		dir->sync_interval = SNAP_SYNC_INTERVAL;
+		break;
 	default:
 		unreachable();
 	}
@@ -412,7 +492,7 @@ int
 xdir_open_cursor(struct xdir *dir, int64_t signature,
 		 struct xlog_cursor *cursor)
 {
-	const char *filename = xdir_format_filename(dir, signature, NONE);
+	const char *filename = xdir_resolve_filename(dir, signature, NONE);
 	int fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		diag_set(SystemError, "failed to open '%s' file", filename);
@@ -460,6 +540,8 @@ cmp_i64(const void *_a, const void *_b)
 
 /**
  * Scan (or rescan) a directory with snapshot or write ahead logs.
+ * With a striped WAL dir, all stripe directories are scanned and
+ * the files are merged into one vclock-ordered index.
  * Read all files matching a pattern from the directory -
  * the filename pattern is \d+.xlog
  * The name of the file is based on its vclock signature,
@@ -492,22 +574,25 @@ cmp_i64(const void *_a, const void *_b)
  *
  * @return nothing.
  */
-int
-xdir_scan(struct xdir *dir)
-{
-	DIR *dh = opendir(dir->dirname);        /* log dir */
-	int64_t *signatures = NULL;             /* log file names */
-	size_t s_count = 0, s_capacity = 0;
 
+/**
+ * Collect the signatures of the log files of one stripe
+ * directory into a growing array shared by all stripes.
+ * Part of xdir_scan(), see above.
+ */
+static int
+xdir_scan_stripe(struct xdir *dir, const char *dirname, int64_t **signatures,
+		 size_t *s_count, size_t *s_capacity)
+{
+	DIR *dh = opendir(dirname);             /* log dir */
 	if (dh == NULL) {
 		tnt_error(SystemError, "error reading directory '%s'",
-			  dir->dirname);
+			  dirname);
 		return -1;
 	}
 
 	auto dir_guard = make_scoped_guard([&]{
 		closedir(dh);
-		free(signatures);
 	});
 
 	struct dirent *dent;
@@ -550,20 +635,60 @@ xdir_scan(struct xdir *dir)
 			continue;
 		}
 
-		if (s_count == s_capacity) {
-			s_capacity = s_capacity > 0 ? 2 * s_capacity : 16;
-			size_t size = sizeof(*signatures) * s_capacity;
-			signatures = (int64_t *) realloc(signatures, size);
-			if (signatures == NULL) {
+		if (*s_count == *s_capacity) {
+			*s_capacity = *s_capacity > 0 ? 2 * *s_capacity : 16;
+			size_t size = sizeof(**signatures) * *s_capacity;
+			int64_t *prev = *signatures;
+			*signatures = (int64_t *) realloc(prev, size);
+			if (*signatures == NULL) {
+				*signatures = prev;
 				tnt_error(OutOfMemory,
 					  size, "realloc", "signatures array");
 				return -1;
 			}
 		}
-		signatures[s_count++] = signature;
+		(*signatures)[(*s_count)++] = signature;
+	}
+	return 0;
+}
+
+int
+xdir_scan(struct xdir *dir)
+{
+	int64_t *signatures = NULL;             /* log file names */
+	size_t s_count = 0, s_capacity = 0;
+
+	auto sig_guard = make_scoped_guard([&]{
+		free(signatures);
+	});
+
+	if (xdir_scan_stripe(dir, dir->dirname, &signatures,
+			     &s_count, &s_capacity) != 0)
+		return -1;
+	for (int i = 0; i < dir->stripe_count; i++) {
+		if (xdir_scan_stripe(dir, dir->stripes[i], &signatures,
+				     &s_count, &s_capacity) != 0)
+			return -1;
 	}
 	/** Sort the list of files */
 	qsort(signatures, s_count, sizeof(*signatures), cmp_i64);
+	/*
+	 * A file duplicated across stripes (e.g. a directory was
+	 * copied by hand) would be indexed twice - drop the extra
+	 * occurrences. Lookups by signature pick the first stripe
+	 * which has the file.
+	 */
+	size_t w = 0;
+	for (size_t rd = 0; rd < s_count; rd++) {
+		if (w > 0 && signatures[w - 1] == signatures[rd]) {
+			say_warn("duplicate log file for signature %lld "
+				 "in another stripe directory, skipping",
+				 (long long) signatures[rd]);
+			continue;
+		}
+		signatures[w++] = signatures[rd];
+	}
+	s_count = w;
 	/**
 	 * Update the log dir index with the current state:
 	 * remove files which no longer exist, add files which
@@ -609,37 +734,66 @@ xdir_scan(struct xdir *dir)
 int
 xdir_check(struct xdir *dir)
 {
-	DIR *dh = opendir(dir->dirname);        /* log dir */
-	if (dh == NULL) {
-		tnt_error(SystemError, "error reading directory '%s'",
-			  dir->dirname);
-		return -1;
+	for (int i = -1; i < dir->stripe_count; i++) {
+		const char *dirname = i < 0 ? dir->dirname : dir->stripes[i];
+		DIR *dh = opendir(dirname);     /* log dir */
+		if (dh == NULL) {
+			tnt_error(SystemError, "error reading directory '%s'",
+				  dirname);
+			return -1;
+		}
+		closedir(dh);
 	}
-	closedir(dh);
 	return 0;
 }
 
-char *
-xdir_format_filename(struct xdir *dir, int64_t signature,
-		enum log_suffix suffix)
+/** Format a file name in the given stripe directory. */
+static char *
+xdir_format_filename_in(struct xdir *dir, const char *dirname,
+			int64_t signature, enum log_suffix suffix)
 {
 	static __thread char filename[PATH_MAX + 1];
 	const char *suffix_str = (suffix == INPROGRESS ?
 				  inprogress_suffix : "");
 	snprintf(filename, PATH_MAX, "%s/%020lld%s%s",
-		 dir->dirname, (long long) signature,
+		 dirname, (long long) signature,
 		 dir->filename_ext, suffix_str);
 	return filename;
 }
 
+char *
+xdir_format_filename(struct xdir *dir, int64_t signature,
+		enum log_suffix suffix)
+{
+	return xdir_format_filename_in(dir, dir->dirname, signature, suffix);
+}
+
+char *
+xdir_resolve_filename(struct xdir *dir, int64_t signature,
+		      enum log_suffix suffix)
+{
+	for (int i = 0; i < dir->stripe_count; i++) {
+		char *filename = xdir_format_filename_in(dir, dir->stripes[i],
+							 signature, suffix);
+		if (access(filename, F_OK) == 0)
+			return filename;
+	}
+	/*
+	 * Fall back to the primary directory: either the file is
+	 * there, or the caller gets the most natural name to
+	 * complain about.
+	 */
+	return xdir_format_filename(dir, signature, suffix);
+}
+
 void
 xdir_collect_garbage(struct xdir *dir, int64_t signature)
 {
 	struct vclock *it = vclockset_first(&dir->index);
 	while (it != NULL && vclock_sum(it) < signature) {
 		struct vclock *next = vclockset_next(&dir->index, it);
-		char *filename = xdir_format_filename(dir, vclock_sum(it),
-						      NONE);
+		char *filename = xdir_resolve_filename(dir, vclock_sum(it),
+						       NONE);
 		say_info("removing %s", filename);
 		if (unlink(filename) < 0 && errno != ENOENT) {
 			say_syserror("error while removing %s", filename);
@@ -685,11 +839,14 @@ static int
 xlog_init(struct xlog *xlog)
 {
 	memset(xlog, 0, sizeof(*xlog));
+	xlog->sink_fd = -1;
 	xlog->sync_interval = SNAP_SYNC_INTERVAL;
 	xlog->sync_time = ev_time();
 	xlog->is_autocommit = true;
 	obuf_create(&xlog->obuf, &cord()->slabc, XLOG_TX_AUTOCOMMIT_THRESHOLD);
 	obuf_create(&xlog->zbuf, &cord()->slabc, XLOG_TX_AUTOCOMMIT_THRESHOLD);
+	/* 3 is a fast compression level, fit for the hot path. */
+	xlog->zstd_level = 3;
 	xlog->zctx = ZSTD_createCCtx();
 	if (xlog->zctx == NULL) {
 		diag_set(ClientError, ER_COMPRESSION,
@@ -704,6 +861,7 @@ xlog_clear(struct xlog *l)
 {
 	memset(l, 0, sizeof(*l));
 	l->fd = -1;
+	l->sink_fd = -1;
 }
 
 static void
@@ -714,6 +872,7 @@ xlog_destroy(struct xlog *xlog)
 	ZSTD_freeCCtx(xlog->zctx);
 	TRASH(xlog);
 	xlog->fd = -1;
+	xlog->sink_fd = -1;
 }
 
 int
@@ -780,6 +939,47 @@ err:
 	return -1;
 }
 
+int
+xlog_sink_attach(struct xlog *log, int fd)
+{
+	assert(log->sink_fd == -1);
+	assert(log->offset > 0); /* the meta has been written */
+	/*
+	 * Replay the meta header: the sink stream must be
+	 * byte-identical to the file.
+	 */
+	char meta_buf[XLOG_META_LEN_MAX];
+	int meta_len = xlog_meta_format(&log->meta, meta_buf,
+					sizeof(meta_buf));
+	if (meta_len < 0)
+		return -1;
+	assert(meta_len == log->offset);
+	if (fio_writen(fd, meta_buf, meta_len) < 0) {
+		diag_set(SystemError, "%s: failed to write xlog meta "
+			 "to the sink", log->filename);
+		return -1;
+	}
+	log->sink_fd = fd;
+	return 0;
+}
+
+int
+xlog_sink_detach(struct xlog *log, bool commit)
+{
+	assert(log->sink_fd >= 0);
+	int rc = 0;
+	if (commit &&
+	    fio_writen(log->sink_fd, &eof_marker,
+		       sizeof(log_magic_t)) < 0) {
+		diag_set(SystemError, "%s: failed to write EOF marker "
+			 "to the sink", log->filename);
+		rc = -1;
+	}
+	close(log->sink_fd);
+	log->sink_fd = -1;
+	return rc;
+}
+
 int
 xlog_open(struct xlog *xlog, const char *name)
 {
@@ -852,7 +1052,7 @@ xdir_touch_xlog(struct xdir *dir, const struct vclock *vclock)
 {
 	char *filename;
 	int64_t signature = vclock_sum(vclock);
-	filename = xdir_format_filename(dir, signature, NONE);
+	filename = xdir_resolve_filename(dir, signature, NONE);
 
 	if (dir->type != SNAP) {
 		assert(false);
@@ -873,7 +1073,8 @@ xdir_touch_xlog(struct xdir *dir, const struct vclock *vclock)
  */
 int
 xdir_create_xlog(struct xdir *dir, struct xlog *xlog,
-		 const struct vclock *vclock)
+		 const struct vclock *vclock,
+		 const struct vclock *prev_vclock)
 {
 	char *filename;
 	int64_t signature = vclock_sum(vclock);
@@ -885,12 +1086,31 @@ xdir_create_xlog(struct xdir *dir, struct xlog *xlog,
 	* Check whether a file with this name already exists.
 	* We don't overwrite existing files.
 	*/
-	filename = xdir_format_filename(dir, signature, NONE);
+	if (dir->stripe_count == 0) {
+		filename = xdir_format_filename(dir, signature, NONE);
+	} else {
+		/*
+		 * Stripe new files across the directories in
+		 * round-robin order, so that consecutive segments
+		 * land on different devices: while the previous
+		 * segment is still being fsynced and closed, the
+		 * next one is appended to on another device.
+		 */
+		int next = dir->stripe_next;
+		dir->stripe_next = (next + 1) % (dir->stripe_count + 1);
+		const char *dirname = next == 0 ? dir->dirname :
+				      dir->stripes[next - 1];
+		filename = xdir_format_filename_in(dir, dirname,
+						   signature, NONE);
+	}
 
 	/* Setup inherited values */
 	snprintf(meta.filetype, sizeof(meta.filetype), "%s", dir->filetype);
 	meta.instance_uuid = *dir->instance_uuid;
 	vclock_copy(&meta.vclock, vclock);
+	meta.has_prev_vclock = prev_vclock != NULL;
+	if (prev_vclock != NULL)
+		vclock_copy(&meta.prev_vclock, prev_vclock);
 
 	if (xlog_create(xlog, filename, &meta) != 0)
 		return -1;
@@ -912,6 +1132,50 @@ xdir_create_xlog(struct xdir *dir, struct xlog *xlog,
 	return 0;
 }
 
+/**
+ * Build a scatter list for the current transaction: the copied
+ * contents of obuf with the referenced row bodies spliced in at
+ * their recorded positions. The first entry starts with the tx
+ * fixheader, just like the first obuf chunk does.
+ *
+ * @return the number of filled entries in @iov
+ */
+static int
+xlog_tx_build_iov(struct xlog *log, struct iovec *iov)
+{
+	int iovcnt = 0;
+	int ref = 0;
+	/* The stream position of the copied data consumed so far. */
+	size_t pos = 0;
+	struct iovec *src;
+	for (src = log->obuf.iov; src->iov_len; ++src) {
+		char *base = (char *)src->iov_base;
+		size_t len = src->iov_len;
+		while (ref < log->ref_count &&
+		       log->ref[ref].pos <= pos + len) {
+			size_t cut = log->ref[ref].pos - pos;
+			if (cut > 0) {
+				iov[iovcnt].iov_base = base;
+				iov[iovcnt].iov_len = cut;
+				iovcnt++;
+				base += cut;
+				len -= cut;
+				pos += cut;
+			}
+			iov[iovcnt++] = log->ref[ref++].iov;
+		}
+		if (len > 0) {
+			iov[iovcnt].iov_base = base;
+			iov[iovcnt].iov_len = len;
+			iovcnt++;
+			pos += len;
+		}
+	}
+	assert(ref == log->ref_count);
+	assert(iovcnt <= XLOG_TX_IOVMAX);
+	return iovcnt;
+}
+
 /**
  * Write a sequence of uncompressed xrow objects.
  *
@@ -929,18 +1193,19 @@ xlog_tx_write_plain(struct xlog *log)
 	*(log_magic_t *)fixheader = row_marker;
 	char *data = fixheader + sizeof(log_magic_t);
 
-	data = mp_encode_uint(data,
-			      obuf_size(&log->obuf) - XLOG_FIXHEADER_SIZE);
-	/* Encode crc32 for previous row */
-	data = mp_encode_uint(data, 0);
+	data = mp_encode_uint(data, obuf_size(&log->obuf) + log->ref_size -
+			      XLOG_FIXHEADER_SIZE);
+	/* Encode crc32 for previous tx - the checksum chain */
+	data = mp_encode_uint(data, log->crc32_prev);
 	/* Encode crc32 for current row */
 	uint32_t crc32c = 0;
-	struct iovec *iov;
+	struct iovec iov[XLOG_TX_IOVMAX];
+	int iovcnt = xlog_tx_build_iov(log, iov);
 	size_t offset = XLOG_FIXHEADER_SIZE;
-	for (iov = log->obuf.iov; iov->iov_len; ++iov) {
+	for (int i = 0; i < iovcnt; ++i) {
 		crc32c = crc32_calc(crc32c,
-				    (char *)iov->iov_base + offset,
-				    iov->iov_len - offset);
+				    (char *)iov[i].iov_base + offset,
+				    iov[i].iov_len - offset);
 		offset = 0;
 	}
 	data = mp_encode_uint(data, crc32c);
@@ -962,13 +1227,25 @@ xlog_tx_write_plain(struct xlog *log)
 		return -1;
 	});
 
-	ssize_t written = fio_writevn(log->fd, log->obuf.iov, log->obuf.pos + 1);
+	ssize_t written = fio_writevn(log->fd, iov, iovcnt);
 	if (written < 0) {
 		diag_set(SystemError, "failed to write to '%s' file",
 			 log->filename);
 		return -1;
 	}
-	return obuf_size(&log->obuf);
+	/*
+	 * Tee the same bytes to the sink, if attached.
+	 * fio_writevn() copies the iov into a batch, so it may
+	 * be replayed.
+	 */
+	if (log->sink_fd >= 0 &&
+	    fio_writevn(log->sink_fd, iov, iovcnt) < 0) {
+		diag_set(SystemError, "%s: failed to write to the sink",
+			 log->filename);
+		return -1;
+	}
+	log->crc32_prev = crc32c;
+	return obuf_size(&log->obuf) + log->ref_size;
 }
 
 /**
@@ -983,13 +1260,13 @@ xlog_tx_write_zstd(struct xlog *log)
 					     XLOG_FIXHEADER_SIZE);
 
 	uint32_t crc32c = 0;
-	struct iovec *iov;
-	/* 3 is compression level. */
-	ZSTD_compressBegin(log->zctx, 3);
+	struct iovec iov[XLOG_TX_IOVMAX];
+	int iovcnt = xlog_tx_build_iov(log, iov);
+	ZSTD_compressBegin(log->zctx, log->zstd_level);
 	size_t offset = XLOG_FIXHEADER_SIZE;
-	for (iov = log->obuf.iov; iov->iov_len; ++iov) {
+	for (int i = 0; i < iovcnt; ++i) {
 		/* Estimate max output buffer size. */
-		size_t zmax_size = ZSTD_compressBound(iov->iov_len - offset);
+		size_t zmax_size = ZSTD_compressBound(iov[i].iov_len - offset);
 		/* Allocate a destination buffer. */
 		void *zdst = obuf_reserve(&log->zbuf, zmax_size);
 		if (!zdst) {
@@ -999,19 +1276,15 @@ xlog_tx_write_zstd(struct xlog *log)
 		}
 		size_t (*fcompress)(ZSTD_CCtx *, void *, size_t,
 				    const void *, size_t);
-		/*
-		 * If it's the last iov or the last
-		 * log has 0 bytes, end the stream.
-		 */
-		if (iov == log->obuf.iov + log->obuf.pos ||
-		    !(iov + 1)->iov_len) {
+		/* End the stream on the last iov. */
+		if (i == iovcnt - 1) {
 			fcompress = ZSTD_compressEnd;
 		} else {
 			fcompress = ZSTD_compressContinue;
 		}
 		size_t zsize = fcompress(log->zctx, zdst, zmax_size,
-					 (char *)iov->iov_base + offset,
-					 iov->iov_len - offset);
+					 (char *)iov[i].iov_base + offset,
+					 iov[i].iov_len - offset);
 		if (ZSTD_isError(zsize)) {
 			diag_set(ClientError, ER_COMPRESSION,
 				 ZSTD_getErrorName(zsize));
@@ -1030,8 +1303,8 @@ xlog_tx_write_zstd(struct xlog *log)
 	data = fixheader + sizeof(log_magic_t);
 	data = mp_encode_uint(data,
 			      obuf_size(&log->zbuf) - XLOG_FIXHEADER_SIZE);
-	/* Encode crc32 for previous row */
-	data = mp_encode_uint(data, 0);
+	/* Encode crc32 for previous tx - the checksum chain */
+	data = mp_encode_uint(data, log->crc32_prev);
 	/* Encode crc32 for current row */
 	data = mp_encode_uint(data, crc32c);
 	/* Encode padding */
@@ -1059,6 +1332,15 @@ xlog_tx_write_zstd(struct xlog *log)
 			 log->filename);
 		goto error;
 	}
+	/* Tee the same bytes to the sink, if attached. */
+	if (log->sink_fd >= 0 &&
+	    fio_writevn(log->sink_fd, log->zbuf.iov,
+			log->zbuf.pos + 1) < 0) {
+		diag_set(SystemError, "%s: failed to write to the sink",
+			 log->filename);
+		goto error;
+	}
+	log->crc32_prev = crc32c;
 	obuf_reset(&log->zbuf);
 	return written;
 error:
@@ -1066,6 +1348,42 @@ error:
 	return -1;
 }
 
+int
+xlog_fallocate(struct xlog *log, size_t size)
+{
+#ifdef HAVE_FALLOCATE
+	static bool fallocate_not_supported = false;
+	if (fallocate_not_supported)
+		return 0;
+	if (log->allocated >= size)
+		return 0;
+	/*
+	 * Keep the file size unchanged: otherwise recovery
+	 * would have to distinguish preallocated zeros from
+	 * a torn write at the end of the file.
+	 */
+	if (fallocate(log->fd, FALLOC_FL_KEEP_SIZE,
+		      log->offset + log->allocated, size) != 0) {
+		if (errno == ENOSYS || errno == EOPNOTSUPP) {
+			/*
+			 * The filesystem can't preallocate -
+			 * fall back on plain appends.
+			 */
+			fallocate_not_supported = true;
+			return 0;
+		}
+		diag_set(SystemError, "%s: can't allocate disk space",
+			 log->filename);
+		return -1;
+	}
+	log->allocated += size;
+#else
+	(void) log;
+	(void) size;
+#endif /* HAVE_FALLOCATE */
+	return 0;
+}
+
 /* file syncing and posix_fadvise() should be rounded by a page boundary */
 #define SYNC_MASK		(4096 - 1)
 #define SYNC_ROUND_DOWN(size)	((size) & ~(4096 - 1))
@@ -1081,7 +1399,8 @@ xlog_tx_write(struct xlog *log)
 		return 0;
 	ssize_t written;
 
-	if (obuf_size(&log->obuf) >= XLOG_TX_COMPRESS_THRESHOLD) {
+	if (obuf_size(&log->obuf) + log->ref_size >=
+	    XLOG_TX_COMPRESS_THRESHOLD) {
 		written = xlog_tx_write_zstd(log);
 	} else {
 		written = xlog_tx_write_plain(log);
@@ -1089,6 +1408,8 @@ xlog_tx_write(struct xlog *log)
 	ERROR_INJECT(ERRINJ_WAL_WRITE, written = -1;);
 
 	obuf_reset(&log->obuf);
+	log->ref_count = 0;
+	log->ref_size = 0;
 	/*
 	 * Simplify recovery after a temporary write failure:
 	 * truncate the file to the best known good write
@@ -1101,6 +1422,8 @@ xlog_tx_write(struct xlog *log)
 		return -1;
 	}
 	log->offset += written;
+	log->allocated = (size_t) written < log->allocated ?
+			 log->allocated - written : 0;
 	log->rows += log->tx_rows;
 	log->tx_rows = 0;
 	if ((log->sync_interval && log->offset >=
@@ -1144,6 +1467,14 @@ xlog_tx_write(struct xlog *log)
 	return written;
 }
 
+/** Drop row body references added after @ref_svp. */
+static void
+xlog_rollback_refs(struct xlog *log, int ref_svp)
+{
+	while (log->ref_count > ref_svp)
+		log->ref_size -= log->ref[--log->ref_count].iov.iov_len;
+}
+
 /*
  * Add a row to a log and possibly flush the log.
  *
@@ -1166,11 +1497,12 @@ xlog_write_row(struct xlog *log, const struct xrow_header *packet)
 		}
 	}
 
-	size_t page_offset = obuf_size(&log->obuf);
+	size_t page_offset = obuf_size(&log->obuf) + log->ref_size;
 	/** encode row into iovec */
 	struct iovec iov[XROW_IOVMAX];
 	int iovcnt = xrow_header_encode(packet, iov, 0);
 	struct obuf_svp svp = obuf_create_svp(&log->obuf);
+	int ref_svp = log->ref_count;
 	for (int i = 0; i < iovcnt; ++i) {
 		struct errinj *inj = errinj(ERRINJ_WAL_WRITE_PARTIAL,
 					    ERRINJ_U64);
@@ -1178,22 +1510,42 @@ xlog_write_row(struct xlog *log, const struct xrow_header *packet)
 			diag_set(ClientError, ER_INJECTION,
 				 "xlog write injection");
 			obuf_rollback_to_svp(&log->obuf, &svp);
+			xlog_rollback_refs(log, ref_svp);
 			return -1;
 		};
+		/*
+		 * The encoded header (iov[0]) sits on the fiber
+		 * region, which is about to be reused, so it is
+		 * always copied. Row bodies are caller memory:
+		 * reference the large ones instead of copying
+		 * when the caller has promised to keep them
+		 * valid until the flush.
+		 */
+		if (i > 0 && log->ref_bodies &&
+		    iov[i].iov_len >= XLOG_REF_THRESHOLD &&
+		    log->ref_count < XLOG_REF_MAX) {
+			struct xlog_ref *ref = &log->ref[log->ref_count++];
+			ref->pos = obuf_size(&log->obuf);
+			ref->iov = iov[i];
+			log->ref_size += iov[i].iov_len;
+			continue;
+		}
 		if (obuf_dup(&log->obuf, iov[i].iov_base, iov[i].iov_len) <
 		    iov[i].iov_len) {
 			tnt_error(OutOfMemory, XLOG_FIXHEADER_SIZE,
 				  "runtime arena", "xlog tx output buffer");
 			obuf_rollback_to_svp(&log->obuf, &svp);
+			xlog_rollback_refs(log, ref_svp);
 			return -1;
 		}
 	}
 	assert(iovcnt <= XROW_IOVMAX);
 	log->tx_rows++;
 
-	size_t row_size = obuf_size(&log->obuf) - page_offset;
+	size_t row_size = obuf_size(&log->obuf) + log->ref_size - page_offset;
 	if (log->is_autocommit &&
-	    obuf_size(&log->obuf) >= XLOG_TX_AUTOCOMMIT_THRESHOLD &&
+	    obuf_size(&log->obuf) + log->ref_size >=
+	    XLOG_TX_AUTOCOMMIT_THRESHOLD &&
 	    xlog_tx_write(log) < 0)
 		return -1;
 
@@ -1223,7 +1575,8 @@ ssize_t
 xlog_tx_commit(struct xlog *log)
 {
 	log->is_autocommit = true;
-	if (obuf_size(&log->obuf) >= XLOG_TX_AUTOCOMMIT_THRESHOLD) {
+	if (obuf_size(&log->obuf) + log->ref_size >=
+	    XLOG_TX_AUTOCOMMIT_THRESHOLD) {
 		return xlog_tx_write(log);
 	}
 	return 0;
@@ -1238,6 +1591,8 @@ xlog_tx_rollback(struct xlog *log)
 	log->is_autocommit = true;
 	log->tx_rows = 0;
 	obuf_reset(&log->obuf);
+	log->ref_count = 0;
+	log->ref_size = 0;
 }
 
 /**
@@ -1291,6 +1646,15 @@ xlog_close(struct xlog *l, bool reuse_fd)
 	if (rc < 0)
 		say_syserror("%s: failed to write EOF marker", l->filename);
 
+	/*
+	 * A sink still attached here means the caller did not
+	 * commit the stream with xlog_sink_detach(): close the
+	 * connection without the EOF marker, so the peer
+	 * discards the copy.
+	 */
+	if (l->sink_fd >= 0)
+		xlog_sink_detach(l, false);
+
 	/*
 	 * Sync the file before closing, since
 	 * otherwise we can end up with a partially
@@ -1348,7 +1712,7 @@ xlog_cursor_ensure(struct xlog_cursor *cursor, size_t count)
 		return 1;
 
 	size_t to_load = count - ibuf_used(&cursor->rbuf);
-	to_load += XLOG_READ_AHEAD;
+	to_load += cursor->read_ahead;
 
 	void *dst = ibuf_reserve(&cursor->rbuf, to_load);
 	if (dst == NULL) {
@@ -1368,6 +1732,21 @@ xlog_cursor_ensure(struct xlog_cursor *cursor, size_t count)
 	assert((size_t)readen <= to_load);
 	ibuf_alloc(&cursor->rbuf, readen);
 	cursor->read_offset += readen;
+#ifdef HAVE_POSIX_FADVISE
+	/*
+	 * Ask the kernel to prefetch the next window while the
+	 * one just read is being decoded, so that the file is
+	 * double-buffered into the page cache and the decoder
+	 * does not block on cold reads.
+	 */
+	if (cursor->read_offset + (off_t)cursor->read_ahead >
+	    cursor->advised_offset) {
+		posix_fadvise(cursor->fd, cursor->read_offset,
+			      cursor->read_ahead, POSIX_FADV_WILLNEED);
+		cursor->advised_offset = cursor->read_offset +
+					 cursor->read_ahead;
+	}
+#endif /* HAVE_POSIX_FADVISE */
 	return ibuf_used(&cursor->rbuf) >= count ? 0: 1;
 }
 
@@ -1552,6 +1931,40 @@ xlog_tx_decode(const char *data, const char *data_end,
 	return 0;
 }
 
+int
+xlog_tx_decode_borrow(const char *data, const char *data_end,
+		      const char **rows, const char **rows_end)
+{
+	/* Decode fixheader */
+	struct xlog_fixheader fixheader;
+	if (xlog_fixheader_decode(&fixheader, &data, data_end) != 0)
+		return -1;
+
+	/* Check that buffer has enough bytes */
+	if (data + fixheader.len != data_end) {
+		tnt_error(XlogError, "invalid compressed length: "
+			  "expected %zd, got %u",
+			  data_end - data, fixheader.len);
+		return -1;
+	}
+
+	/* Compressed rows cannot be borrowed */
+	if (fixheader.magic != row_marker) {
+		assert(fixheader.magic == zrow_marker);
+		return 1;
+	}
+
+	/* Validate checksum */
+	if (crc32_calc(0, data, fixheader.len) != fixheader.crc32c) {
+		tnt_error(XlogError, "tx checksum mismatch");
+		return -1;
+	}
+
+	*rows = data;
+	*rows_end = data_end;
+	return 0;
+}
+
 /**
  * @retval -1 error
  * @retval 0 success
@@ -1580,6 +1993,8 @@ xlog_tx_cursor_create(struct xlog_tx_cursor *tx_cursor,
 	}
 	data_end = rpos + fixheader.len;
 
+	tx_cursor->crc32c = fixheader.crc32c;
+	tx_cursor->crc32p = fixheader.crc32p;
 	ibuf_create(&tx_cursor->rows, &cord()->slabc,
 		    XLOG_TX_AUTOCOMMIT_THRESHOLD);
 	if (fixheader.magic == row_marker) {
@@ -1645,14 +2060,208 @@ xlog_tx_cursor_destroy(struct xlog_tx_cursor *tx_cursor)
 	return 0;
 }
 
+ssize_t
+xlog_tx_raw_decode(const struct xlog_tx_raw *tx, char **rows,
+		   ZSTD_DStream *zdctx)
+{
+	/* Validate checksum */
+	if (crc32_calc(0, tx->data, tx->size) != tx->crc32c) {
+		tnt_error(XlogError, "tx checksum mismatch");
+		return -1;
+	}
+
+	/* Copy uncompressed rows */
+	if (tx->magic == row_marker) {
+		char *buf = (char *)malloc(tx->size);
+		if (buf == NULL) {
+			tnt_error(OutOfMemory, tx->size,
+				  "malloc", "xlog rows buffer");
+			return -1;
+		}
+		memcpy(buf, tx->data, tx->size);
+		*rows = buf;
+		return tx->size;
+	}
+
+	/* Decompress zstd rows into a growing malloced buffer */
+	assert(tx->magic == zrow_marker);
+	ZSTD_initDStream(zdctx);
+	size_t capacity = XLOG_TX_AUTOCOMMIT_THRESHOLD;
+	char *buf = (char *)malloc(capacity);
+	if (buf == NULL) {
+		tnt_error(OutOfMemory, capacity,
+			  "malloc", "xlog rows buffer");
+		return -1;
+	}
+	char *wpos = buf;
+	const char *data = tx->data;
+	const char *data_end = tx->data + tx->size;
+	int rc;
+	while ((rc = xlog_cursor_decompress(&wpos, buf + capacity, &data,
+					    data_end, zdctx)) == 1) {
+		size_t used = wpos - buf;
+		capacity += XLOG_TX_AUTOCOMMIT_THRESHOLD;
+		char *new_buf = (char *)realloc(buf, capacity);
+		if (new_buf == NULL) {
+			free(buf);
+			tnt_error(OutOfMemory, capacity,
+				  "realloc", "xlog rows buffer");
+			return -1;
+		}
+		buf = new_buf;
+		wpos = buf + used;
+	}
+	if (rc != 0) {
+		free(buf);
+		return -1;
+	}
+	assert(data == data_end);
+	*rows = buf;
+	return wpos - buf;
+}
+
+/* {{{ shared xlog tx cache */
+
+/*
+ * When several relay cords follow the same WAL - a star topology
+ * with many read-only followers - each of them reads, checksums
+ * and decompresses every tx of the same file privately,
+ * multiplying the read path by the number of followers. The
+ * cache below lets the first cursor to reach a tx publish the
+ * decoded rows, so same-position followers take them from
+ * memory. A cursor that falls behind what the cache still holds
+ * simply misses and goes to the file - the private read path is
+ * the straggler fallback.
+ *
+ * The cache is direct-mapped: an insert evicts whatever occupied
+ * the slot. It is shared by all cords and protected by a plain
+ * mutex; the critical sections only copy memory. A WAL is
+ * append-only, so a (file name, offset) pair identifies tx
+ * content for as long as the file exists; entries of removed
+ * files age out by eviction.
+ */
+
+enum {
+	/** The number of tx slots in the shared cache. */
+	XLOG_TX_CACHE_SLOTS = 256,
+	/** Do not cache decoded txs bigger than this. */
+	XLOG_TX_CACHE_TX_MAX = 512 * 1024,
+};
+
+struct xlog_tx_cache_entry {
+	/** The file the tx was read from. */
+	char *name;
+	/** File offset of the tx fixheader. */
+	off_t offset;
+	/** On-disk size of the tx, fixheader included. */
+	size_t consumed;
+	/** Decoded rows. */
+	char *rows;
+	/** Size of the decoded rows. */
+	size_t size;
+	/** Checksums for the cursor chain verification. */
+	uint32_t crc32c;
+	uint32_t crc32p;
+};
+
+static struct xlog_tx_cache_entry xlog_tx_cache[XLOG_TX_CACHE_SLOTS];
+static pthread_mutex_t xlog_tx_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline struct xlog_tx_cache_entry *
+xlog_tx_cache_slot(const char *name, off_t offset)
+{
+	uint32_t hash = 5381;
+	for (const char *p = name; *p != '\0'; p++)
+		hash = hash * 33 ^ (uint8_t)*p;
+	hash ^= (uint32_t)offset ^ (uint32_t)(offset >> 32);
+	return &xlog_tx_cache[hash % XLOG_TX_CACHE_SLOTS];
+}
+
+/**
+ * Look up the decoded tx of @a name at @a offset and, on a hit,
+ * set up @a tx_cursor with a copy of its rows.
+ *
+ * @retval 0 hit, @a consumed is set to the on-disk tx size
+ * @retval 1 miss
+ */
+static int
+xlog_tx_cache_get(const char *name, off_t offset,
+		  struct xlog_tx_cursor *tx_cursor, size_t *consumed)
+{
+	tt_pthread_mutex_lock(&xlog_tx_cache_mutex);
+	struct xlog_tx_cache_entry *e = xlog_tx_cache_slot(name, offset);
+	if (e->name == NULL || e->offset != offset ||
+	    strcmp(e->name, name) != 0) {
+		tt_pthread_mutex_unlock(&xlog_tx_cache_mutex);
+		return 1;
+	}
+	ibuf_create(&tx_cursor->rows, &cord()->slabc,
+		    XLOG_TX_AUTOCOMMIT_THRESHOLD);
+	void *dst = ibuf_alloc(&tx_cursor->rows, e->size);
+	if (dst == NULL) {
+		/* Out of memory - pretend it is a miss. */
+		ibuf_destroy(&tx_cursor->rows);
+		tt_pthread_mutex_unlock(&xlog_tx_cache_mutex);
+		return 1;
+	}
+	memcpy(dst, e->rows, e->size);
+	tx_cursor->crc32c = e->crc32c;
+	tx_cursor->crc32p = e->crc32p;
+	*consumed = e->consumed;
+	tt_pthread_mutex_unlock(&xlog_tx_cache_mutex);
+	return 0;
+}
+
+/**
+ * Publish a decoded tx. Failure to cache is not an error: if we
+ * are out of memory, simply live without the sharing.
+ */
+static void
+xlog_tx_cache_put(const char *name, off_t offset, size_t consumed,
+		  const struct xlog_tx_cursor *tx_cursor)
+{
+	size_t size = ibuf_used(&tx_cursor->rows);
+	if (size > XLOG_TX_CACHE_TX_MAX)
+		return;
+	char *rows = (char *)malloc(size);
+	char *name_copy = strdup(name);
+	if (rows == NULL || name_copy == NULL) {
+		free(rows);
+		free(name_copy);
+		return;
+	}
+	memcpy(rows, tx_cursor->rows.rpos, size);
+	tt_pthread_mutex_lock(&xlog_tx_cache_mutex);
+	struct xlog_tx_cache_entry *e = xlog_tx_cache_slot(name, offset);
+	free(e->name);
+	free(e->rows);
+	e->name = name_copy;
+	e->offset = offset;
+	e->consumed = consumed;
+	e->rows = rows;
+	e->size = size;
+	e->crc32c = tx_cursor->crc32c;
+	e->crc32p = tx_cursor->crc32p;
+	tt_pthread_mutex_unlock(&xlog_tx_cache_mutex);
+}
+
+/* }}} */
+
 /**
  * Find a next xlog tx magic
  */
 int
 xlog_cursor_find_tx_magic(struct xlog_cursor *i)
 {
-	log_magic_t magic;
-	do {
+	/*
+	 * The magic the scan resyncs on is not connected to the
+	 * previously read tx anymore, so the checksum chain is
+	 * broken from here on.
+	 */
+	i->crc32_chain_known = false;
+	/* Both markers start with the same byte, see row_marker. */
+	const char first_byte = *(const char *)&row_marker;
+	while (true) {
 		/*
 		 * Read one extra byte to start searching from the next
 		 * byte.
@@ -1663,12 +2272,33 @@ xlog_cursor_find_tx_magic(struct xlog_cursor *i)
 		if (rc == 1)
 			return 1;
 
-		++i->rbuf.rpos;
-		assert(i->rbuf.rpos + sizeof(log_magic_t) <= i->rbuf.wpos);
-		magic = load_u32(i->rbuf.rpos);
-	} while (magic != row_marker && magic != zrow_marker);
-
-	return 0;
+		/*
+		 * Scan the buffered window with memchr() rather
+		 * than stepping one byte at a time: after a
+		 * corrupted write the scan may have to cover
+		 * gigabytes of garbage.
+		 */
+		const char *pos = i->rbuf.rpos + 1;
+		const char *end = i->rbuf.wpos - sizeof(log_magic_t) + 1;
+		while (pos < end) {
+			pos = (const char *)memchr(pos, first_byte,
+						   end - pos);
+			if (pos == NULL)
+				break;
+			log_magic_t magic = load_u32(pos);
+			if (magic == row_marker || magic == zrow_marker) {
+				i->rbuf.rpos = (char *)pos;
+				return 0;
+			}
+			++pos;
+		}
+		/*
+		 * No magic in the window. Consume the scanned
+		 * bytes, keeping the tail which may turn out to
+		 * be a magic prefix, and load more.
+		 */
+		i->rbuf.rpos = i->rbuf.wpos - sizeof(log_magic_t);
+	}
 }
 
 int
@@ -1690,6 +2320,24 @@ xlog_cursor_next_tx(struct xlog_cursor *i)
 	}
 
 	ssize_t to_load;
+	off_t tx_offset = xlog_cursor_pos(i);
+	size_t consumed;
+	if (i->shared_cache &&
+	    xlog_tx_cache_get(i->name, tx_offset, &i->tx_cursor,
+			      &consumed) == 0) {
+		/*
+		 * Skip the on-disk bytes of the tx: drop what is
+		 * already buffered and push the read position past
+		 * the rest.
+		 */
+		if (consumed <= ibuf_used(&i->rbuf)) {
+			i->rbuf.rpos += consumed;
+		} else {
+			ibuf_reset(&i->rbuf);
+			i->read_offset = tx_offset + consumed;
+		}
+		goto chain;
+	}
 	while ((to_load = xlog_tx_cursor_create(&i->tx_cursor,
 						(const char **)&i->rbuf.rpos,
 						i->rbuf.wpos, i->zdctx)) > 0) {
@@ -1702,6 +2350,29 @@ xlog_cursor_next_tx(struct xlog_cursor *i)
 	}
 	if (to_load < 0)
 		return -1;
+	if (i->shared_cache) {
+		xlog_tx_cache_put(i->name, tx_offset,
+				  xlog_cursor_pos(i) - tx_offset,
+				  &i->tx_cursor);
+	}
+
+chain:
+	/*
+	 * Verify the checksum chain: each tx records the crc32
+	 * of its predecessor in the fixheader (older files store
+	 * 0 there, see xlog::crc32_prev). A mismatch means the
+	 * tx, although internally consistent, does not belong
+	 * after the previous one.
+	 */
+	if (i->crc32_chain_known && i->tx_cursor.crc32p != 0 &&
+	    i->tx_cursor.crc32p != i->crc32_chain) {
+		xlog_tx_cursor_destroy(&i->tx_cursor);
+		i->crc32_chain_known = false;
+		tnt_error(XlogError, "tx checksum chain mismatch");
+		return -1;
+	}
+	i->crc32_chain = i->tx_cursor.crc32c;
+	i->crc32_chain_known = true;
 
 	i->state = XLOG_CURSOR_TX;
 	return 0;
@@ -1725,6 +2396,96 @@ eof:
 	return 1;
 }
 
+int
+xlog_cursor_next_tx_raw(struct xlog_cursor *i, struct xlog_tx_raw *tx)
+{
+	int rc;
+	assert(i->state != XLOG_CURSOR_EOF);
+
+	/* load at least magic to check eof */
+	rc = xlog_cursor_ensure(i, sizeof(log_magic_t));
+	if (rc < 0)
+		return -1;
+	if (rc > 0)
+		return 1;
+	if (load_u32(i->rbuf.rpos) == eof_marker) {
+		/* eof marker found */
+		i->state = XLOG_CURSOR_EOF;
+		goto eof;
+	}
+
+	/*
+	 * Buffer the whole tx: the fixheader is decoded to learn
+	 * the payload size, the payload itself stays opaque.
+	 */
+	struct xlog_fixheader fixheader;
+	const char *rpos;
+	while (true) {
+		rpos = i->rbuf.rpos;
+		ssize_t to_load = xlog_fixheader_decode(&fixheader, &rpos,
+							i->rbuf.wpos);
+		if (to_load < 0)
+			return -1;
+		if (to_load == 0) {
+			if (i->rbuf.wpos - rpos >= (ptrdiff_t)fixheader.len)
+				break;
+			to_load = fixheader.len - (i->rbuf.wpos - rpos);
+		}
+		rc = xlog_cursor_ensure(i, ibuf_used(&i->rbuf) + to_load);
+		if (rc < 0)
+			return -1;
+		if (rc > 0)
+			goto eof;
+	}
+
+	tx->data = (char *)malloc(fixheader.len);
+	if (tx->data == NULL) {
+		tnt_error(OutOfMemory, fixheader.len,
+			  "malloc", "xlog tx payload");
+		return -1;
+	}
+	memcpy(tx->data, rpos, fixheader.len);
+	tx->size = fixheader.len;
+	tx->magic = fixheader.magic;
+	tx->crc32c = fixheader.crc32c;
+	i->rbuf.rpos = (char *)rpos + fixheader.len;
+
+	/*
+	 * Advance the checksum chain right away - both links are
+	 * in the fixheader, the payload is not needed. The
+	 * payload crc32 itself is checked by the decode.
+	 */
+	if (i->crc32_chain_known && fixheader.crc32p != 0 &&
+	    fixheader.crc32p != i->crc32_chain) {
+		free(tx->data);
+		tx->data = NULL;
+		i->crc32_chain_known = false;
+		tnt_error(XlogError, "tx checksum chain mismatch");
+		return -1;
+	}
+	i->crc32_chain = fixheader.crc32c;
+	i->crc32_chain_known = true;
+	return 0;
+eof:
+	if (i->state == XLOG_CURSOR_EOF) {
+		/*
+		 * A eof marker is read, check that there is no
+		 * more data in the file.
+		 */
+		rc = xlog_cursor_ensure(i, sizeof(log_magic_t) + sizeof(char));
+
+		if (rc < 0)
+			return -1;
+		if (rc == 0) {
+			tnt_error(XlogError, "%s: has some data after "
+				  "eof marker at %lld", i->name,
+				  xlog_cursor_pos(i));
+			return -1;
+		}
+	}
+	return 1;
+}
+
 int
 xlog_cursor_next_row(struct xlog_cursor *cursor, struct xrow_header *xrow)
 {
@@ -1776,9 +2537,14 @@ xlog_cursor_openfd(struct xlog_cursor *i, int fd, const char *name)
 {
 	memset(i, 0, sizeof(*i));
 	i->fd = fd;
+	i->read_ahead = XLOG_READ_AHEAD;
 	ibuf_create(&i->rbuf, &cord()->slabc,
 		    XLOG_TX_AUTOCOMMIT_THRESHOLD << 1);
 
+#ifdef HAVE_POSIX_FADVISE
+	/* The cursor walks the file strictly forward. */
+	posix_fadvise(i->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 	ssize_t rc;
 	/*
 	 * we can have eof here, but this is no error,
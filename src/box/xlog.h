@@ -62,6 +62,7 @@ enum xdir_type {
 	SNAP,		/* memtx snapshot */
 	XLOG,		/* write ahead log */
 	VYLOG,		/* vinyl metadata log */
+	DSNAP,		/* memtx delta snapshot */
 };
 
 /**
@@ -71,6 +72,15 @@ enum xdir_type {
  */
 enum log_suffix { NONE, INPROGRESS };
 
+enum {
+	/**
+	 * The maximal number of stripe directories of one log
+	 * directory, counting the primary one. See the stripes
+	 * member of struct xdir.
+	 */
+	XDIR_STRIPE_MAX = 8,
+};
+
 /**
  * A handle for a data directory with write ahead logs or snapshots.
  * Can be used to find the last log in the directory, scan
@@ -128,6 +138,25 @@ struct xdir {
 	 * Directory path.
 	 */
 	char dirname[PATH_MAX+1];
+	/**
+	 * Extra stripe directories. A directory path passed to
+	 * xdir_create() may name several ';'-separated directories,
+	 * typically on different devices: the first one becomes
+	 * dirname, the rest are stored here. All of them form one
+	 * logical log - the index spans all stripes and a file is
+	 * looked up by probing each directory - while every new
+	 * file is created in the next stripe in round-robin order,
+	 * so consecutive segments land on different devices and
+	 * the append load is spread across them.
+	 */
+	char stripes[XDIR_STRIPE_MAX - 1][PATH_MAX + 1];
+	/** The number of used entries in stripes[]. */
+	int stripe_count;
+	/**
+	 * Round-robin cursor of new file creation: 0 stands for
+	 * dirname, i > 0 for stripes[i - 1].
+	 */
+	int stripe_next;
 	/** Snapshots or xlogs */
 	enum xdir_type type;
 	/**
@@ -139,7 +168,8 @@ struct xdir {
 };
 
 /**
- * Initialize a log dir.
+ * Initialize a log dir. @a dirname may name several
+ * ';'-separated stripe directories, see struct xdir comments.
  */
 void
 xdir_create(struct xdir *dir, const char *dirname, enum xdir_type type,
@@ -174,6 +204,17 @@ char *
 xdir_format_filename(struct xdir *dir, int64_t signature,
 		     enum log_suffix suffix);
 
+/**
+ * Return the name of an existing file: probe each stripe
+ * directory for it and fall back to the primary directory name
+ * (i.e. what xdir_format_filename() returns) if not found
+ * anywhere. Use this instead of xdir_format_filename() to open,
+ * rename or unlink a file which may live in any stripe.
+ */
+char *
+xdir_resolve_filename(struct xdir *dir, int64_t signature,
+		      enum log_suffix suffix);
+
 /**
  * Remove files whose signature is less than specified.
  */
@@ -228,10 +269,42 @@ struct xlog_meta {
 	 * is vector clock *at the time the snapshot is taken.
 	 */
 	struct vclock vclock;
+	/**
+	 * Text file header: vector clock of the checkpoint
+	 * this file is chained to. Set only in memtx delta
+	 * snapshots, where it names the previous checkpoint
+	 * (a full snapshot or another delta) and is used by
+	 * recovery to detect a missing link in the chain.
+	 */
+	struct vclock prev_vclock;
+	/** True if prev_vclock above is set. */
+	bool has_prev_vclock;
 };
 
 /* }}} */
 
+/**
+ * A row body attached to the current write transaction by
+ * reference rather than by copy. The body is spliced into the
+ * output stream at @pos bytes from the beginning of the output
+ * buffer contents when the transaction is flushed to disk.
+ */
+struct xlog_ref {
+	/** Splice position in the output buffer. */
+	size_t pos;
+	/** The referenced memory. */
+	struct iovec iov;
+};
+
+enum {
+	/**
+	 * The maximal number of row bodies attached to a write
+	 * transaction by reference. Once the limit is reached,
+	 * further bodies are copied to the output buffer.
+	 */
+	XLOG_REF_MAX = 256,
+};
+
 /**
  * A single log file - a snapshot or a write ahead log.
  */
@@ -276,6 +349,13 @@ struct xlog {
 	bool is_autocommit;
 	/** The current offset in the log file, for writing. */
 	off_t offset;
+	/**
+	 * Size of disk space preallocated at @offset with
+	 * xlog_fallocate(). Preallocation saves the append
+	 * path from synchronous block allocation and the
+	 * filesystem metadata update it entails.
+	 */
+	size_t allocated;
 	/**
 	 * Output buffer, works as row accumulator for
 	 * compression.
@@ -287,6 +367,28 @@ struct xlog {
 	 * Compressed output buffer
 	 */
 	struct obuf zbuf;
+	/**
+	 * If true, write large row bodies by reference, straight
+	 * from the caller's buffers, with scatter/gather I/O,
+	 * instead of copying them to obuf. The caller must
+	 * guarantee the bodies stay valid until the enclosing
+	 * transaction is flushed to disk, as the WAL writer does
+	 * for journal entries.
+	 */
+	bool ref_bodies;
+	/** Bodies referenced into the current transaction. */
+	struct xlog_ref ref[XLOG_REF_MAX];
+	/** The number of used entries in @ref. */
+	int ref_count;
+	/** Total length of the referenced bodies, in bytes. */
+	size_t ref_size;
+	/**
+	 * ZSTD compression level for transactions that exceed
+	 * the compression threshold. Defaults to a fast level,
+	 * fit for the hot append path; the background WAL
+	 * recompressor raises it when rewriting sealed files.
+	 */
+	int zstd_level;
 	/**
 	 * Sync interval in bytes.
 	 * xlog file will be synced every sync_interval bytes,
@@ -308,8 +410,26 @@ struct xlog {
 	 * Write rate limit
 	 */
 	uint64_t rate_limit;
+	/**
+	 * An optional tee: a descriptor, usually a connected
+	 * socket, which receives a byte-exact copy of
+	 * everything written to the file - the meta header,
+	 * every tx and the EOF marker. -1 when unset. The
+	 * xlog owns the descriptor once attached and closes
+	 * it in xlog_close(). See xlog_sink_attach().
+	 */
+	int sink_fd;
 	/** Time when xlog wast synced last time */
 	double sync_time;
+	/**
+	 * crc32 of the last written tx. It is recorded in the
+	 * crc32p slot of the next tx fixheader, chaining the
+	 * txs together: a reader can then detect a tx which is
+	 * internally consistent but does not belong after its
+	 * predecessor. Files written by older versions store 0
+	 * in crc32p.
+	 */
+	uint32_t crc32_prev;
 };
 
 /**
@@ -335,13 +455,17 @@ xdir_touch_xlog(struct xdir *dir, const struct vclock *vclock);
  * @param instance uuid   the instance which created the file
  * @param vclock        the global state of replication (vector
  *			clock) at the moment the file is created.
+ * @param prev_vclock   the vclock of the checkpoint the file is
+ *			chained to, or NULL. Only set for memtx
+ *			delta snapshots.
  *
  * @retval 0 if OK
  * @retval -1 if error
  */
 int
 xdir_create_xlog(struct xdir *dir, struct xlog *xlog,
-		 const struct vclock *vclock);
+		 const struct vclock *vclock,
+		 const struct vclock *prev_vclock);
 
 /**
  * Create new xlog writer based on fd.
@@ -395,6 +519,39 @@ xlog_is_open(struct xlog *l)
 int
 xlog_rename(struct xlog *l);
 
+/**
+ * Attach a tee sink to an xlog writer: from here on every byte
+ * written to the file is also written to @a fd, so the peer
+ * receives a stream identical to the file contents. The meta
+ * header, already on disk by the time a freshly created xlog
+ * can be attached to, is replayed to the sink right away.
+ * Must be called before the first row is written. The xlog
+ * takes ownership of @a fd.
+ *
+ * A clean stream ends with the EOF marker; a peer that does not
+ * see one before the connection closes must discard the copy,
+ * exactly as recovery discards a snapshot without one.
+ *
+ * @retval 0 success
+ * @retval -1 error, check diag
+ */
+int
+xlog_sink_attach(struct xlog *log, int fd);
+
+/**
+ * Detach the sink, completing the copy. The EOF marker is the
+ * sink's equivalent of the .inprogress rename: write it with
+ * @a commit set once the file contents are final and flushed.
+ * xlog_close() on an xlog with a sink still attached closes the
+ * connection without a marker, aborting the copy - the right
+ * thing for every error path.
+ *
+ * @retval 0 success
+ * @retval -1 error, check diag
+ */
+int
+xlog_sink_detach(struct xlog *log, bool commit);
+
 /**
  * Write a row to xlog, 
  *
@@ -433,6 +590,22 @@ xlog_tx_rollback(struct xlog *log);
 ssize_t
 xlog_flush(struct xlog *log);
 
+/**
+ * Make sure that at least @size bytes of disk space are
+ * preallocated at the current write position, so that appends
+ * never allocate file blocks synchronously. Preallocated space
+ * is not accounted in the file size, hence an unfinished write
+ * does not leave trailing garbage behind the last commit.
+ *
+ * Does nothing if the underlying filesystem does not support
+ * preallocation.
+ *
+ * @retval 0 success
+ * @retval -1 error, check diag
+ */
+int
+xlog_fallocate(struct xlog *log, size_t size);
+
 
 /**
  * Sync a log file. The exact action is defined
@@ -469,6 +642,10 @@ struct xlog_tx_cursor
 {
 	/** rows buffer */
 	struct ibuf rows;
+	/** crc32 of the tx, to chain-check the next tx. */
+	uint32_t crc32c;
+	/** crc32 of the previous tx recorded in the tx fixheader. */
+	uint32_t crc32p;
 };
 
 /**
@@ -516,6 +693,59 @@ xlog_tx_decode(const char *data, const char *data_end,
 	       char *rows, char *rows_end,
 	       ZSTD_DStream *zdctx);
 
+/**
+ * Decode a raw tx buffer in place, without copying rows out.
+ * Decodes fixheader, checks crc32 and length and, if the tx is
+ * not compressed, returns a pointer to the rows right inside
+ * @a data. Compressed txs cannot be borrowed - fall back to
+ * xlog_tx_decode() for them.
+ *
+ * @param data a buffer with the raw tx data, including fixheader
+ * @param data_end the end of @a data buffer
+ * @param[out] rows on success, points at the rows inside @a data
+ * @param[out] rows_end the end of the rows
+ * @retval  0 success, rows are borrowed from @a data
+ * @retval  1 the tx is compressed and cannot be borrowed
+ * @retval -1 error, check diag
+ */
+int
+xlog_tx_decode_borrow(const char *data, const char *data_end,
+		      const char **rows, const char **rows_end);
+
+/**
+ * A tx taken off a cursor with its payload still compressed,
+ * see xlog_cursor_next_tx_raw().
+ */
+struct xlog_tx_raw {
+	/** Tx payload as stored on disk, malloced. */
+	char *data;
+	/** Payload size, bytes. */
+	size_t size;
+	/** Tx magic, row_marker or zrow_marker. */
+	uint32_t magic;
+	/** crc32 of the payload. */
+	uint32_t crc32c;
+};
+
+/**
+ * Decode a tx extracted with xlog_cursor_next_tx_raw(): check
+ * the payload crc32 and decompress the rows into a malloced
+ * buffer. Unlike the other decode helpers this one uses no
+ * cord-local state, so it may run on a coio thread, with errors
+ * travelling back to the caller the usual coio_call() way.
+ *
+ * @param tx raw tx
+ * @param[out] rows malloced buffer with the decoded rows,
+ *                  the caller frees it with free()
+ * @param zdctx decompression context, caller-owned; a context
+ *              may not be shared with a concurrent decode
+ * @retval >=0 size of the decoded rows, bytes
+ * @retval  -1 error, check diag
+ */
+ssize_t
+xlog_tx_raw_decode(const struct xlog_tx_raw *tx, char **rows,
+		   ZSTD_DStream *zdctx);
+
 /* }}} */
 
 /* {{{ xlog_cursor - read rows from a log file */
@@ -531,6 +761,14 @@ enum xlog_cursor_state {
 	XLOG_CURSOR_EOF = 3
 };
 
+enum {
+	/**
+	 * Cursor read-ahead (xlog_cursor::read_ahead) fit for
+	 * bulk sequential reads: recovery, join, recompression.
+	 */
+	XLOG_READ_AHEAD_BULK = 1 << 20,
+};
+
 /**
  * Xlog cursor, read rows from xlog
  */
@@ -547,10 +785,38 @@ struct xlog_cursor
 	struct ibuf rbuf;
 	/** file read position */
 	off_t read_offset;
+	/**
+	 * How many bytes to read from the file ahead of the
+	 * decode position. The default suits tail-following
+	 * readers like hot standby; recovery raises it, since
+	 * large sequential reads help most on cold storage.
+	 */
+	size_t read_ahead;
+	/**
+	 * End of the file region the kernel has been asked to
+	 * prefetch with posix_fadvise(WILLNEED).
+	 */
+	off_t advised_offset;
 	/** cursor for current tx */
 	struct xlog_tx_cursor tx_cursor;
 	/** ZSTD context for decompression */
 	ZSTD_DStream *zdctx;
+	/**
+	 * Share decoded txs with other cursors reading the same
+	 * file through the process-wide tx cache. Enabled by the
+	 * relay, where many followers replay the same WAL and a
+	 * private read path per follower multiplies the disk
+	 * reads, crc checks and decompression.
+	 */
+	bool shared_cache;
+	/** crc32 of the last sequentially read tx. */
+	uint32_t crc32_chain;
+	/**
+	 * True if crc32_chain is valid, i.e. the previous tx
+	 * was read in order. Reset when the cursor resyncs by
+	 * scanning for a magic after a corrupted region.
+	 */
+	bool crc32_chain_known;
 };
 
 /**
@@ -604,6 +870,27 @@ xlog_cursor_close(struct xlog_cursor *cursor, bool reuse_fd);
 int
 xlog_cursor_next_tx(struct xlog_cursor *cursor);
 
+/**
+ * Read the next tx without decoding it: only the fixheader is
+ * parsed, the payload is copied into a malloced buffer as is,
+ * and the checksum chain is advanced - both chain links live in
+ * the fixheader. The expensive part, the payload crc32 and
+ * decompression, is left to xlog_tx_raw_decode(), which the
+ * caller may run on another thread while consuming the previous
+ * tx. The raw path bypasses the shared tx cache and does not
+ * populate cursor->tx_cursor; mixing it with xlog_cursor_next_tx()
+ * on one cursor is not supported.
+ *
+ * @param cursor cursor
+ * @param[out] tx the extracted tx, tx->data is malloced and
+ *                freed by the caller
+ * @retval 0 success
+ * @retval 1 eof
+ * @retval -1 error, check diag
+ */
+int
+xlog_cursor_next_tx_raw(struct xlog_cursor *cursor, struct xlog_tx_raw *tx);
+
 /**
  * Fetch next xrow from current xlog tx
  *
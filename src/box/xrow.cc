@@ -48,51 +48,151 @@ enum { HEADER_LEN_MAX = 40, BODY_LEN_MAX = 128 };
  */
 struct tt_uuid INSTANCE_UUID;
 
+/**
+ * Read a single-byte \a key followed by an MP_UINT value,
+ * checking the buffer bounds as it goes.
+ *
+ * @retval true decoded, \a pos advanced past the value
+ * @retval false no such key here or truncated buffer, \a pos
+ *         unchanged
+ */
+static inline bool
+xrow_decode_key_uint(const char **pos, const char *end, uint8_t key,
+		     uint64_t *out)
+{
+	if (end - *pos < 2 || (uint8_t)**pos != key)
+		return false;
+	const char *p = *pos + 1;
+	if (mp_typeof(*p) != MP_UINT || mp_check_uint(p, end) > 0)
+		return false;
+	*out = mp_decode_uint(&p);
+	*pos = p;
+	return true;
+}
+
+/**
+ * Decode the two header layouts every tarantool peer actually
+ * emits with straight-line reads, skipping both the up-front
+ * mp_check() pass over the header and the per-key dispatch of
+ * the generic parser: a client request as encoded by net.box
+ * (sync, schema version, type) and a row as encoded by
+ * xrow_header_encode() (type, replica id, lsn, timestamp, each
+ * but the type optional, always in this order). Every field is
+ * bounds-checked as it is read, and nothing is written to
+ * \a header until the whole layout has matched.
+ *
+ * @retval true header decoded, \a pos advanced past it
+ * @retval false not a canonical layout or a corrupt packet,
+ *         \a pos unchanged - decode with the generic parser
+ */
+static bool
+xrow_header_decode_fast(struct xrow_header *header, const char **pos,
+			const char *end)
+{
+	const char *p = *pos;
+	if (end - p < 1 || mp_typeof(*p) != MP_MAP ||
+	    mp_check_map(p, end) > 0)
+		return false;
+	uint32_t size = mp_decode_map(&p);
+	uint64_t val;
+	if (size == 3 && p < end && (uint8_t)*p == IPROTO_SYNC) {
+		/* A net.box request. */
+		uint64_t sync, schema_version;
+		if (!xrow_decode_key_uint(&p, end, IPROTO_SYNC, &sync) ||
+		    !xrow_decode_key_uint(&p, end, IPROTO_SCHEMA_VERSION,
+					  &schema_version) ||
+		    !xrow_decode_key_uint(&p, end, IPROTO_REQUEST_TYPE, &val))
+			return false;
+		header->sync = sync;
+		header->schema_version = schema_version;
+		header->type = val;
+		*pos = p;
+		return true;
+	}
+	if (size >= 1 && size <= 4 && p < end &&
+	    (uint8_t)*p == IPROTO_REQUEST_TYPE) {
+		/* A WAL or replication row. */
+		struct xrow_header h = *header;
+		if (!xrow_decode_key_uint(&p, end, IPROTO_REQUEST_TYPE, &val))
+			return false;
+		h.type = val;
+		uint32_t left = size - 1;
+		if (left > 0 &&
+		    xrow_decode_key_uint(&p, end, IPROTO_REPLICA_ID, &val)) {
+			h.replica_id = val;
+			left--;
+		}
+		if (left > 0 &&
+		    xrow_decode_key_uint(&p, end, IPROTO_LSN, &val)) {
+			h.lsn = val;
+			left--;
+		}
+		if (left > 0 && end - p >= 2 &&
+		    (uint8_t)*p == IPROTO_TIMESTAMP) {
+			/* An encoded MP_DOUBLE is always 9 bytes. */
+			if (mp_typeof(p[1]) != MP_DOUBLE || end - p < 1 + 9)
+				return false;
+			p++;
+			h.tm = mp_decode_double(&p);
+			left--;
+		}
+		if (left != 0)
+			return false;
+		*header = h;
+		*pos = p;
+		return true;
+	}
+	return false;
+}
+
 int
 xrow_header_decode(struct xrow_header *header, const char **pos,
 		   const char *end)
 {
 	memset(header, 0, sizeof(struct xrow_header));
-	const char *tmp = *pos;
-	if (mp_check(&tmp, end) != 0) {
+	if (!xrow_header_decode_fast(header, pos, end)) {
+		const char *tmp = *pos;
+		if (mp_check(&tmp, end) != 0) {
 error:
-		diag_set(ClientError, ER_INVALID_MSGPACK, "packet header");
-		return -1;
-	}
-
-	if (mp_typeof(**pos) != MP_MAP)
-		goto error;
+			diag_set(ClientError, ER_INVALID_MSGPACK,
+				 "packet header");
+			return -1;
+		}
 
-	uint32_t size = mp_decode_map(pos);
-	for (uint32_t i = 0; i < size; i++) {
-		if (mp_typeof(**pos) != MP_UINT)
+		if (mp_typeof(**pos) != MP_MAP)
 			goto error;
-		uint64_t key = mp_decode_uint(pos);
-		if (key >= IPROTO_KEY_MAX ||
-		    iproto_key_type[key] != mp_typeof(**pos))
-			goto error;
-		switch (key) {
-		case IPROTO_REQUEST_TYPE:
-			header->type = mp_decode_uint(pos);
-			break;
-		case IPROTO_SYNC:
-			header->sync = mp_decode_uint(pos);
-			break;
-		case IPROTO_REPLICA_ID:
-			header->replica_id = mp_decode_uint(pos);
-			break;
-		case IPROTO_LSN:
-			header->lsn = mp_decode_uint(pos);
-			break;
-		case IPROTO_TIMESTAMP:
-			header->tm = mp_decode_double(pos);
-			break;
-		case IPROTO_SCHEMA_VERSION:
-			header->schema_version = mp_decode_uint(pos);
-			break;
-		default:
-			/* unknown header */
-			mp_next(pos);
+
+		uint32_t size = mp_decode_map(pos);
+		for (uint32_t i = 0; i < size; i++) {
+			if (mp_typeof(**pos) != MP_UINT)
+				goto error;
+			uint64_t key = mp_decode_uint(pos);
+			if (key >= IPROTO_KEY_MAX ||
+			    iproto_key_type[key] != mp_typeof(**pos))
+				goto error;
+			switch (key) {
+			case IPROTO_REQUEST_TYPE:
+				header->type = mp_decode_uint(pos);
+				break;
+			case IPROTO_SYNC:
+				header->sync = mp_decode_uint(pos);
+				break;
+			case IPROTO_REPLICA_ID:
+				header->replica_id = mp_decode_uint(pos);
+				break;
+			case IPROTO_LSN:
+				header->lsn = mp_decode_uint(pos);
+				break;
+			case IPROTO_TIMESTAMP:
+				header->tm = mp_decode_double(pos);
+				break;
+			case IPROTO_SCHEMA_VERSION:
+				header->schema_version = mp_decode_uint(pos);
+				break;
+			default:
+				/* unknown header */
+				mp_next(pos);
+			}
 		}
 	}
 	assert(*pos <= end);
@@ -436,7 +536,7 @@ void
 xrow_encode_subscribe(struct xrow_header *row,
 		      const struct tt_uuid *replicaset_uuid,
 		      const struct tt_uuid *instance_uuid,
-		      const struct vclock *vclock)
+		      const struct vclock *vclock, int zstd_level)
 {
 	memset(row, 0, sizeof(*row));
 	uint32_t replicaset_size = vclock_size(vclock);
@@ -444,11 +544,15 @@ xrow_encode_subscribe(struct xrow_header *row,
 		(mp_sizeof_uint(UINT32_MAX) + mp_sizeof_uint(UINT64_MAX));
 	char *buf = (char *) region_alloc_xc(&fiber()->gc, size);
 	char *data = buf;
-	data = mp_encode_map(data, 3);
+	data = mp_encode_map(data, zstd_level > 0 ? 4 : 3);
 	data = mp_encode_uint(data, IPROTO_CLUSTER_UUID);
 	data = xrow_encode_uuid(data, replicaset_uuid);
 	data = mp_encode_uint(data, IPROTO_INSTANCE_UUID);
 	data = xrow_encode_uuid(data, instance_uuid);
+	if (zstd_level > 0) {
+		data = mp_encode_uint(data, IPROTO_COMPRESSION_LEVEL);
+		data = mp_encode_uint(data, zstd_level);
+	}
 	data = mp_encode_uint(data, IPROTO_VCLOCK);
 	data = mp_encode_map(data, replicaset_size);
 	struct vclock_iterator it;
@@ -466,7 +570,8 @@ xrow_encode_subscribe(struct xrow_header *row,
 
 void
 xrow_decode_subscribe(struct xrow_header *row, struct tt_uuid *replicaset_uuid,
-		      struct tt_uuid *instance_uuid, struct vclock *vclock)
+		      struct tt_uuid *instance_uuid, struct vclock *vclock,
+		      int *zstd_level, int *snap_file)
 {
 	if (row->bodycnt == 0)
 		tnt_raise(ClientError, ER_INVALID_MSGPACK, "request body");
@@ -508,6 +613,24 @@ xrow_decode_subscribe(struct xrow_header *row, struct tt_uuid *replicaset_uuid,
 			lsnmap = d;
 			mp_next(&d);
 			break;
+		case IPROTO_COMPRESSION_LEVEL:
+			if (zstd_level == NULL)
+				goto skip;
+			if (mp_typeof(*d) != MP_UINT) {
+				tnt_raise(ClientError, ER_INVALID_MSGPACK,
+					  "invalid compression level");
+			}
+			*zstd_level = mp_decode_uint(&d);
+			break;
+		case IPROTO_SNAP_FILE:
+			if (snap_file == NULL)
+				goto skip;
+			if (mp_typeof(*d) != MP_UINT) {
+				tnt_raise(ClientError, ER_INVALID_MSGPACK,
+					  "invalid snap file flag");
+			}
+			*snap_file = mp_decode_uint(&d) != 0;
+			break;
 		default: skip:
 			mp_next(&d); /* value */
 		}
@@ -534,17 +657,23 @@ xrow_decode_subscribe(struct xrow_header *row, struct tt_uuid *replicaset_uuid,
 }
 
 void
-xrow_encode_join(struct xrow_header *row, const struct tt_uuid *instance_uuid)
+xrow_encode_join(struct xrow_header *row, const struct tt_uuid *instance_uuid,
+		 int snap_file)
 {
 	memset(row, 0, sizeof(*row));
 
 	size_t size = 64;
 	char *buf = (char *) region_alloc_xc(&fiber()->gc, size);
 	char *data = buf;
-	data = mp_encode_map(data, 1);
+	data = mp_encode_map(data, snap_file ? 2 : 1);
 	data = mp_encode_uint(data, IPROTO_INSTANCE_UUID);
 	/* Greet the remote replica with our replica UUID */
 	data = xrow_encode_uuid(data, instance_uuid);
+	if (snap_file) {
+		/* We can receive the initial data as a raw file. */
+		data = mp_encode_uint(data, IPROTO_SNAP_FILE);
+		data = mp_encode_uint(data, 1);
+	}
 	assert(data <= buf + size);
 
 	row->body[0].iov_base = buf;
@@ -558,10 +687,13 @@ xrow_encode_vclock(struct xrow_header *row, const struct vclock *vclock)
 {
 	memset(row, 0, sizeof(*row));
 
-	/* Add vclock to response body */
+	/*
+	 * Add vclock to response body. A replica id is below
+	 * VCLOCK_MAX and always fits in a one-byte fixuint.
+	 */
 	uint32_t replicaset_size = vclock_size(vclock);
 	size_t size = 8 + replicaset_size *
-		(mp_sizeof_uint(UINT32_MAX) + mp_sizeof_uint(UINT64_MAX));
+		(1 + mp_sizeof_uint(UINT64_MAX));
 	char *buf = (char *) region_alloc_xc(&fiber()->gc, size);
 	char *data = buf;
 	data = mp_encode_map(data, 1);
@@ -289,12 +289,13 @@ xrow_encode_auth(struct xrow_header *row, const char *salt, size_t salt_len,
  * \param replicaset_uuid replica set uuid
  * \param instance_uuid instance uuid
  * \param vclock replication clock
+ * \param zstd_level requested stream compression level, 0 - off
 */
 void
 xrow_encode_subscribe(struct xrow_header *row,
 		      const struct tt_uuid *replicaset_uuid,
 		      const struct tt_uuid *instance_uuid,
-		      const struct vclock *vclock);
+		      const struct vclock *vclock, int zstd_level);
 
 /**
  * \brief Decode SUBSCRIBE command
@@ -302,28 +303,36 @@ xrow_encode_subscribe(struct xrow_header *row,
  * \param[out] replicaset_uuid
  * \param[out] instance_uuid
  * \param[out] vclock
+ * \param[out] zstd_level stream compression level, if requested
+ * \param[out] snap_file 1 if the peer accepts raw snapshot files
 */
 void
 xrow_decode_subscribe(struct xrow_header *row, struct tt_uuid *replicaset_uuid,
-		      struct tt_uuid *instance_uuid, struct vclock *vclock);
+		      struct tt_uuid *instance_uuid, struct vclock *vclock,
+		      int *zstd_level, int *snap_file);
 
 /**
  * \brief Encode JOIN command
  * \param[out] row
  * \param instance_uuid
+ * \param snap_file 1 to advertise raw snapshot file transfer
 */
 void
-xrow_encode_join(struct xrow_header *row, const struct tt_uuid *instance_uuid);
+xrow_encode_join(struct xrow_header *row, const struct tt_uuid *instance_uuid,
+		 int snap_file);
 
 /**
  * \brief Decode JOIN command
  * \param row
  * \param[out] instance_uuid
+ * \param[out] snap_file 1 if the replica accepts raw snapshot files
 */
 static inline void
-xrow_decode_join(struct xrow_header *row, struct tt_uuid *instance_uuid)
+xrow_decode_join(struct xrow_header *row, struct tt_uuid *instance_uuid,
+		 int *snap_file)
 {
-	return xrow_decode_subscribe(row, NULL, instance_uuid, NULL);
+	return xrow_decode_subscribe(row, NULL, instance_uuid, NULL, NULL,
+				     snap_file);
 }
 
 /**
@@ -342,7 +351,7 @@ xrow_encode_vclock(struct xrow_header *row, const struct vclock *vclock);
 static inline void
 xrow_decode_vclock(struct xrow_header *row, struct vclock *vclock)
 {
-	return xrow_decode_subscribe(row, NULL, NULL, vclock);
+	return xrow_decode_subscribe(row, NULL, NULL, vclock, NULL, NULL);
 }
 
 #endif
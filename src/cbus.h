@@ -128,6 +128,30 @@ struct cpipe {
 	 * or when max_input is reached.
 	 */
 	struct ev_async flush_input;
+	/**
+	 * Wake the consumer up only when this many messages have
+	 * accumulated at the endpoint, or flush_delay has passed
+	 * since the first unannounced message. Retuned once a
+	 * second from the observed message rate: stays at 1 (wake
+	 * up immediately) on a quiet pipe, grows under load so
+	 * that one cross-thread wakeup delivers a batch.
+	 */
+	int flush_watermark;
+	/** Cap on how long a notify may be deferred, seconds. */
+	double flush_delay;
+	/** Fires when a deferred notify hits flush_delay. */
+	struct ev_timer flush_timer;
+	/** Messages flushed since the last watermark retune. */
+	int64_t flushed_count;
+	/** The time of the last watermark retune. */
+	double flushed_since;
+	/**
+	 * True if the pipe overflowed the endpoint's lock-free
+	 * ring into the mutex-protected queue and must stay on
+	 * the mutex path until the consumer drains the queue,
+	 * to not reorder its messages.
+	 */
+	bool in_overflow;
 	/** The event loop of the producer cord. */
 	struct ev_loop *producer;
 	/**
@@ -171,6 +195,20 @@ cpipe_set_max_input(struct cpipe *pipe, int max_input)
 	pipe->max_input = max_input;
 }
 
+/**
+ * Set the cap on how long a flushed message may sit at the
+ * endpoint unannounced while the pipe accumulates a batch worth
+ * a consumer wakeup. 0 disables batching: the consumer is woken
+ * up on the first message, as it used to be before watermarks.
+ */
+static inline void
+cpipe_set_flush_delay(struct cpipe *pipe, double delay)
+{
+	pipe->flush_delay = delay;
+	if (delay == 0)
+		pipe->flush_watermark = 1;
+}
+
 /**
  * Flush all staged messages into the pipe and eventually to the
  * consumer.
@@ -235,6 +273,8 @@ cpipe_push(struct cpipe *pipe, struct cmsg *msg)
 void
 cbus_init();
 
+struct cbus_ring;
+
 /**
  * cbus endpoint
  */
@@ -250,6 +290,21 @@ struct cbus_endpoint {
 	pthread_mutex_t mutex;
 	/** A queue with incoming messages. */
 	struct stailq output;
+	/** The number of messages in output. Updated under mutex. */
+	int n_output;
+	/**
+	 * True if the consumer has been sent an async it hasn't
+	 * served with a fetch yet. Accessed atomically: producers
+	 * raise it with an exchange, the consumer clears it
+	 * before draining.
+	 */
+	bool notified;
+	/**
+	 * A bounded lock-free ring for the hot path, bypassing
+	 * the mutex. NULL unless the consumer opted in with
+	 * cbus_endpoint_set_lockfree().
+	 */
+	struct cbus_ring *ring;
 	/** Consumer cord loop */
 	ev_loop *consumer;
 	/** Async to notify the consumer */
@@ -263,13 +318,19 @@ struct cbus_endpoint {
 /**
  * Fetch incomming messages to output
  */
-static inline void
-cbus_endpoint_fetch(struct cbus_endpoint *endpoint, struct stailq *output)
-{
-	tt_pthread_mutex_lock(&endpoint->mutex);
-	stailq_concat(output, &endpoint->output);
-	tt_pthread_mutex_unlock(&endpoint->mutex);
-}
+void
+cbus_endpoint_fetch(struct cbus_endpoint *endpoint, struct stailq *output);
+
+/**
+ * Give the endpoint a bounded lock-free multi-producer
+ * single-consumer ring for the hot message path; the mutex
+ * queue remains as an overflow and control path. Must be called
+ * by the consumer right after cbus_endpoint_create(), before
+ * any pipe connects. If the ring can not be allocated the
+ * endpoint simply stays on the mutex path.
+ */
+void
+cbus_endpoint_set_lockfree(struct cbus_endpoint *endpoint);
 
 /** Initialize the global singleton bus. */
 void
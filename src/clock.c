@@ -30,7 +30,10 @@
  */
 #include "clock.h"
 
+#include <stdbool.h>
+
 #include "trivia/util.h"
+#include "cpu_feature.h"
 double
 clock_realtime(void)
 {
@@ -108,3 +111,116 @@ clock_thread64(void)
 	return (uint64_t) clock() * 1000000000 / CLOCKS_PER_SEC;
 #endif
 }
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * The TSC-to-seconds mapping of clock_fast(). Calibration swaps
+ * in a fresh state atomically via the clock_fast_cur pointer, so
+ * readers in other threads never see a half-updated anchor.
+ */
+struct clock_fast_state {
+	/** TSC reading at the anchor point. */
+	uint64_t tsc;
+	/** clock_fast() seconds at the anchor point. */
+	double time;
+	/** Seconds per TSC tick; 0 until the first calibration. */
+	double period;
+};
+
+static struct clock_fast_state clock_fast_states[2];
+static struct clock_fast_state *volatile clock_fast_cur =
+	&clock_fast_states[0];
+/** Set when the CPU has an invariant TSC, see clock_fast_init(). */
+static bool clock_fast_enabled;
+
+static inline uint64_t
+clock_rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+double
+clock_fast(void)
+{
+	struct clock_fast_state *s = clock_fast_cur;
+	if (s->period == 0)
+		return clock_monotonic();
+	return s->time + (double)(clock_rdtsc() - s->tsc) * s->period;
+}
+
+void
+clock_fast_init(void)
+{
+	/*
+	 * A TSC which changes rate with frequency scaling or stops
+	 * in deep sleep cannot serve as a clock - stay on
+	 * clock_gettime() then.
+	 */
+	clock_fast_enabled = invariant_tsc_enabled_cpu();
+	if (!clock_fast_enabled)
+		return;
+	struct clock_fast_state *s = &clock_fast_states[0];
+	s->tsc = clock_rdtsc();
+	s->time = clock_monotonic();
+	s->period = 0;
+}
+
+void
+clock_fast_resync(void)
+{
+	if (!clock_fast_enabled)
+		return;
+	struct clock_fast_state *cur = clock_fast_cur;
+	struct clock_fast_state *next = cur == &clock_fast_states[0] ?
+		&clock_fast_states[1] : &clock_fast_states[0];
+	uint64_t tsc = clock_rdtsc();
+	double now = clock_monotonic();
+	/*
+	 * The rate is measured over the whole interval since the
+	 * previous anchor; too short a baseline gives a noisy
+	 * rate, and a TSC jumping backwards means unsynchronized
+	 * counters (e.g. a cross-socket migration) - better a
+	 * slow clock than a broken one.
+	 */
+	if (tsc <= cur->tsc || now - cur->time < 1.0)
+		return;
+	next->period = (now - cur->time) / (double)(tsc - cur->tsc);
+	if (cur->period != 0) {
+		/*
+		 * Never step backwards over a resync: if the old
+		 * scale ran ahead of CLOCK_MONOTONIC, anchor at
+		 * the extrapolated value and let the corrected
+		 * rate absorb the difference.
+		 */
+		double fast = cur->time +
+			(double)(tsc - cur->tsc) * cur->period;
+		if (fast > now)
+			now = fast;
+	}
+	next->tsc = tsc;
+	next->time = now;
+	clock_fast_cur = next;
+}
+
+#else /* !(defined(__x86_64__) || defined(__i386__)) */
+
+double
+clock_fast(void)
+{
+	return clock_monotonic();
+}
+
+void
+clock_fast_init(void)
+{
+}
+
+void
+clock_fast_resync(void)
+{
+}
+
+#endif
@@ -52,6 +52,33 @@ uint64_t clock_thread64(void);
 
 /** \endcond public */
 
+/**
+ * A cheap monotonic clock for hot-path timing: a calibrated TSC
+ * read, a couple of nanoseconds instead of a clock_gettime() call.
+ * Before the first calibration, on CPUs without an invariant TSC
+ * and on non-x86 platforms it transparently falls back to
+ * clock_monotonic(). The precision is what the calibration gives -
+ * microseconds, not nanoseconds - which is plenty for latency
+ * instrumentation, the intended use.
+ */
+double
+clock_fast(void);
+
+/**
+ * Record the calibration baseline. Call once at startup, before
+ * the first clock_fast_resync().
+ */
+void
+clock_fast_init(void);
+
+/**
+ * (Re)calibrate the TSC rate against CLOCK_MONOTONIC and
+ * re-anchor clock_fast() to compensate the accumulated drift.
+ * Called periodically from the main event loop.
+ */
+void
+clock_fast_resync(void);
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
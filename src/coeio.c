@@ -39,6 +39,8 @@
 #include <sys/socket.h>
 
 #include "fiber.h"
+#include "compute_pool.h"
+#include "say.h"
 #include "third_party/tarantool_ev.h"
 
 /*
@@ -74,6 +76,22 @@ struct coeio_manager {
 
 static __thread struct coeio_manager coeio_manager;
 
+/*
+ * The dedicated resolver lane.
+ *
+ * The eio pool is shared by every blocking task in the system,
+ * most of them disk reads and writes. A getaddrinfo() call
+ * submitted there has to wait out the disk backlog, so a replica
+ * reconnect storm can stall for seconds behind a snapshot read.
+ * The lane is a small compute pool reserved for resolves only:
+ * network control-plane latency no longer depends on the disk
+ * queue, and both lanes are sized independently - the eio pool
+ * with eio_set_max_parallel(), the lane at creation time.
+ */
+static struct compute_pool resolver_pool;
+/** The cord which owns the resolver lane, NULL if there is none. */
+static struct cord *resolver_owner;
+
 static void
 coeio_idle_cb(ev_loop *loop, struct ev_idle *w, int events)
 {
@@ -150,9 +168,31 @@ coeio_enable(void)
 	ev_async_start(loop(), &coeio_manager.coeio_async);
 }
 
+void
+coeio_set_resolver_lane(const char *caller_endpoint, int size)
+{
+	assert(resolver_owner == NULL);
+	if (compute_pool_create(&resolver_pool, "resolver", size,
+				caller_endpoint) != 0) {
+		/*
+		 * Not fatal: resolves simply keep going through
+		 * the shared eio pool, as before.
+		 */
+		say_warn("failed to start the resolver lane: %s",
+			 diag_last_error(diag_get())->errmsg);
+		diag_clear(diag_get());
+		return;
+	}
+	resolver_owner = cord();
+}
+
 void
 coeio_shutdown(void)
 {
+	if (resolver_owner == cord()) {
+		compute_pool_destroy(&resolver_pool);
+		resolver_owner = NULL;
+	}
 	eio_set_max_parallel(0);
 }
 
@@ -247,6 +287,19 @@ coio_task_post(struct coio_task *task, double timeout)
 	return 0;
 }
 
+void
+coio_task_post_detached(struct coio_task *task)
+{
+	assert(task->base.type == EIO_CUSTOM);
+	/*
+	 * Let coio_on_finish() know there is nobody to wake up:
+	 * the resources will be freed by coio_on_destroy(), as
+	 * for a task abandoned on timeout.
+	 */
+	task->fiber = NULL;
+	eio_submit(&task->base);
+}
+
 static void
 coio_on_call(eio_req *req)
 {
@@ -309,18 +362,12 @@ struct async_getaddrinfo_task {
 #define EAI_ADDRFAMILY EAI_BADFLAGS /* EAI_ADDRFAMILY is deprecated on BSD */
 #endif
 
-/*
- * Resolver function, run in separate thread by
- * coeio (libeio).
-*/
+/** The blocking resolver core, shared by the eio and lane paths. */
 static int
-getaddrinfo_cb(struct coio_task *ptr)
+getaddrinfo_run(const char *host, const char *port, struct addrinfo *hints,
+		struct addrinfo **res)
 {
-	struct async_getaddrinfo_task *task =
-		(struct async_getaddrinfo_task *) ptr;
-
-	task->rc = getaddrinfo(task->host, task->port, &task->hints,
-			     &task->result);
+	int rc = getaddrinfo(host, port, hints, res);
 
 	/* getaddrinfo can return EAI_ADDRFAMILY on attempt
 	 * to resolve ::1, if machine has no public ipv6 addresses
@@ -328,12 +375,26 @@ getaddrinfo_cb(struct coio_task *ptr)
 	 *
 	 * See for details: https://bugs.launchpad.net/tarantool/+bug/1160877
 	 */
-	if ((task->rc == EAI_BADFLAGS || task->rc == EAI_ADDRFAMILY) &&
-	    (task->hints.ai_flags & AI_ADDRCONFIG)) {
-		task->hints.ai_flags &= ~AI_ADDRCONFIG;
-		task->rc = getaddrinfo(task->host, task->port, &task->hints,
-			     &task->result);
+	if ((rc == EAI_BADFLAGS || rc == EAI_ADDRFAMILY) &&
+	    (hints->ai_flags & AI_ADDRCONFIG)) {
+		hints->ai_flags &= ~AI_ADDRCONFIG;
+		rc = getaddrinfo(host, port, hints, res);
 	}
+	return rc;
+}
+
+/*
+ * Resolver function, run in separate thread by
+ * coeio (libeio).
+*/
+static int
+getaddrinfo_cb(struct coio_task *ptr)
+{
+	struct async_getaddrinfo_task *task =
+		(struct async_getaddrinfo_task *) ptr;
+
+	task->rc = getaddrinfo_run(task->host, task->port, &task->hints,
+				   &task->result);
 	return 0;
 }
 
@@ -354,20 +415,101 @@ getaddrinfo_free_cb(struct coio_task *ptr)
 	return 0;
 }
 
-int
-coio_getaddrinfo(const char *host, const char *port,
-		 const struct addrinfo *hints, struct addrinfo **res,
-		 double timeout)
+/** A resolve travelling over the resolver lane. */
+struct resolver_task {
+	struct cbus_call_msg base;
+	struct addrinfo *result;
+	int rc;
+	char *host;
+	char *port;
+	struct addrinfo hints;
+};
+
+/** Runs in a resolver cord. */
+static int
+resolver_task_do(struct cbus_call_msg *msg)
 {
-	struct async_getaddrinfo_task *task =
-		(struct async_getaddrinfo_task *) calloc(1, sizeof(*task));
+	struct resolver_task *task = (struct resolver_task *) msg;
+	task->rc = getaddrinfo_run(task->host, task->port, &task->hints,
+				   &task->result);
+	return 0;
+}
+
+/*
+ * Invoked either directly by the caller, or, for a call
+ * abandoned on timeout, by cbus when the resolve finally
+ * completes - the lane slot is released the moment the
+ * blocking getaddrinfo() returns, not when the caller notices.
+ */
+static int
+resolver_task_free(struct cbus_call_msg *msg)
+{
+	struct resolver_task *task = (struct resolver_task *) msg;
+	free(task->host);
+	free(task->port);
+	if (task->result != NULL)
+		freeaddrinfo(task->result);
+	TRASH(task);
+	free(task);
+	return 0;
+}
+
+/** Resolve over the dedicated resolver lane. */
+static int
+coio_getaddrinfo_lane(const char *host, const char *port,
+		      const struct addrinfo *hints, struct addrinfo **res,
+		      double timeout)
+{
+	struct resolver_task *task =
+		(struct resolver_task *) calloc(1, sizeof(*task));
 	if (task == NULL) {
 		diag_set(OutOfMemory, sizeof(*task), "malloc", "getaddrinfo");
 		return -1;
 	}
+	/* Fill hinting information for use by connect(2) or bind(2). */
+	memcpy(&task->hints, hints, sizeof(task->hints));
+	/* make no difference between empty string and NULL for host */
+	if (host != NULL && *host) {
+		task->host = strdup(host);
+		if (task->host == NULL) {
+			diag_set(OutOfMemory, strlen(host), "malloc",
+				 "getaddrinfo");
+			resolver_task_free(&task->base);
+			return -1;
+		}
+	}
+	if (port != NULL) {
+		task->port = strdup(port);
+		if (task->port == NULL) {
+			diag_set(OutOfMemory, strlen(port), "malloc",
+				 "getaddrinfo");
+			resolver_task_free(&task->base);
+			return -1;
+		}
+	}
+	if (compute_pool_call(&resolver_pool, &task->base, resolver_task_do,
+			      resolver_task_free, timeout) != 0)
+		return -1; /* timed out or cancelled */
 
-	coio_task_create(&task->base, getaddrinfo_cb, getaddrinfo_free_cb);
+	if (task->rc != 0) {
+		/* getaddrinfo() failed */
+		errno = EIO;
+		diag_set(SystemError, "getaddrinfo: %s",
+			 gai_strerror(task->rc));
+		resolver_task_free(&task->base);
+		return -1;
+	}
+	*res = task->result;
+	task->result = NULL;
+	resolver_task_free(&task->base);
+	return 0;
+}
 
+int
+coio_getaddrinfo(const char *host, const char *port,
+		 const struct addrinfo *hints, struct addrinfo **res,
+		 double timeout)
+{
 	/*
 	 * getaddrinfo() on osx upto osx 10.8 crashes when AI_NUMERICSERV is
 	 * set and servername is either NULL or "0" ("00" works fine)
@@ -378,6 +520,23 @@ coio_getaddrinfo(const char *host, const char *port,
 	if (hints && (hints->ai_flags & AI_NUMERICSERV) &&
 	    (port == NULL || (port[0]=='0' && port[1]=='\0'))) port = "00";
 #endif
+	/*
+	 * Take the dedicated lane when the caller runs on the cord
+	 * which owns it: the resolve does not have to wait in the
+	 * shared eio queue behind disk tasks.
+	 */
+	if (resolver_owner == cord())
+		return coio_getaddrinfo_lane(host, port, hints, res, timeout);
+
+	struct async_getaddrinfo_task *task =
+		(struct async_getaddrinfo_task *) calloc(1, sizeof(*task));
+	if (task == NULL) {
+		diag_set(OutOfMemory, sizeof(*task), "malloc", "getaddrinfo");
+		return -1;
+	}
+
+	coio_task_create(&task->base, getaddrinfo_cb, getaddrinfo_free_cb);
+
 	/* Fill hinting information for use by connect(2) or bind(2). */
 	memcpy(&task->hints, hints, sizeof(task->hints));
 	/* make no difference between empty string and NULL for host */
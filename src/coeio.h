@@ -53,6 +53,16 @@ void coeio_init(void);
 void coeio_enable(void);
 void coeio_shutdown(void);
 
+/**
+ * Start a dedicated lane of @a size cords for coio_getaddrinfo()
+ * calls issued from the calling cord, so that resolves no longer
+ * queue in the shared eio pool behind disk tasks. The calling
+ * cord must already serve the @a caller_endpoint cbus endpoint.
+ * On failure logs a warning and leaves resolves on the eio pool.
+ * The lane is torn down by coeio_shutdown().
+ */
+void coeio_set_resolver_lane(const char *caller_endpoint, int size);
+
 struct coio_task;
 
 typedef ssize_t (*coio_call_cb)(va_list ap);
@@ -116,6 +126,16 @@ coio_task_destroy(struct coio_task *task);
 int
 coio_task_post(struct coio_task *task, double timeout);
 
+/**
+ * Post coio task to EIO thread pool without waiting for its
+ * completion. The submitting fiber does not yield. Once the task
+ * is finished, its resources are released by the on_timeout
+ * callback passed to coio_task_create(), just like for a task
+ * abandoned on timeout.
+ */
+void
+coio_task_post_detached(struct coio_task *task);
+
 /** \cond public */
 
 /**
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2010-2017, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "compute_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The helper cord main function: connect to the bus and serve
+ * messages until cbus_stop_loop() arrives over the pipe.
+ */
+static int
+compute_cord_f(va_list ap)
+{
+	struct compute_cord *cc = va_arg(ap, struct compute_cord *);
+	struct compute_pool *pool = cc->pool;
+	struct cbus_endpoint endpoint;
+	/* Create the "<name>I" endpoint. */
+	cbus_endpoint_create(&endpoint, cc->endpoint_name,
+			     fiber_schedule_cb, fiber());
+	/* Create a pipe for call replies to the owner cord. */
+	cpipe_create(&cc->caller_pipe, pool->caller_endpoint);
+	/* Process incoming calls. */
+	cbus_loop(&endpoint);
+
+	cpipe_destroy(&cc->caller_pipe);
+	cbus_endpoint_destroy(&endpoint, cbus_process);
+	return 0;
+}
+
+/** Stop the first @a count cords of the pool. */
+static void
+compute_pool_stop(struct compute_pool *pool, int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct compute_cord *cc = &pool->cords[i];
+		cbus_stop_loop(&cc->pipe);
+		cpipe_destroy(&cc->pipe);
+		cord_join(&cc->cord);
+	}
+}
+
+int
+compute_pool_create(struct compute_pool *pool, const char *name, int size,
+		    const char *caller_endpoint)
+{
+	assert(size > 0 && size <= COMPUTE_POOL_SIZE_MAX);
+	pool->size = size;
+	snprintf(pool->caller_endpoint, sizeof(pool->caller_endpoint),
+		 "%s", caller_endpoint);
+	pool->cords = (struct compute_cord *)
+		calloc(size, sizeof(*pool->cords));
+	if (pool->cords == NULL) {
+		diag_set(OutOfMemory, size * sizeof(*pool->cords),
+			 "calloc", "compute pool");
+		return -1;
+	}
+	for (int i = 0; i < size; i++) {
+		struct compute_cord *cc = &pool->cords[i];
+		cc->pool = pool;
+		snprintf(cc->endpoint_name, sizeof(cc->endpoint_name),
+			 "%s%d", name, i);
+		if (cord_costart(&cc->cord, cc->endpoint_name,
+				 compute_cord_f, cc) != 0) {
+			compute_pool_stop(pool, i);
+			free(pool->cords);
+			pool->cords = NULL;
+			return -1;
+		}
+		/* Blocks until the endpoint is registered. */
+		cpipe_create(&cc->pipe, cc->endpoint_name);
+	}
+	return 0;
+}
+
+int
+compute_pool_call(struct compute_pool *pool, struct cbus_call_msg *msg,
+		  cbus_call_f func, cbus_call_f free_cb, double timeout)
+{
+	/*
+	 * Pick the least loaded cord at dispatch time. Pipes
+	 * have a single producer each, so the cords can't steal
+	 * queued calls from each other afterwards, but with
+	 * long-running jobs the imbalance this may leave behind
+	 * is small.
+	 */
+	struct compute_cord *cc = &pool->cords[0];
+	for (int i = 1; i < pool->size; i++) {
+		if (pool->cords[i].load < cc->load)
+			cc = &pool->cords[i];
+	}
+	cc->load++;
+	int rc = cbus_call(&cc->pipe, &cc->caller_pipe, msg, func, free_cb,
+			   timeout);
+	/*
+	 * On timeout the job is still running, but there is no
+	 * completion to decrement the counter from, so count the
+	 * cord free anyway: the error is rare and the counter is
+	 * a load hint, not an invariant.
+	 */
+	cc->load--;
+	return rc;
+}
+
+void
+compute_pool_destroy(struct compute_pool *pool)
+{
+	compute_pool_stop(pool, pool->size);
+	free(pool->cords);
+	pool->cords = NULL;
+	pool->size = 0;
+}
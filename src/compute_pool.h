@@ -0,0 +1,123 @@
+#ifndef TARANTOOL_COMPUTE_POOL_H_INCLUDED
+#define TARANTOOL_COMPUTE_POOL_H_INCLUDED
+/*
+ * Copyright 2010-2017, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fiber.h"
+#include "cbus.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+enum {
+	/** Hard limit on the number of cords in a compute pool. */
+	COMPUTE_POOL_SIZE_MAX = 16,
+};
+
+struct compute_pool;
+
+/** One helper cord of a compute pool. */
+struct compute_cord {
+	/** The pool this cord belongs to. */
+	struct compute_pool *pool;
+	/** The thread running the message delivery loop. */
+	struct cord cord;
+	/** Name of the cbus endpoint served by this cord. */
+	char endpoint_name[FIBER_NAME_MAX];
+	/** Pipe from the owner cord into this cord. */
+	struct cpipe pipe;
+	/**
+	 * Pipe back to the owner cord. Created in this cord -
+	 * cbus pipes have a single producer, and the producer of
+	 * the reply hop is the helper thread.
+	 */
+	struct cpipe caller_pipe;
+	/** Calls dispatched to this cord and not yet complete. */
+	int load;
+};
+
+/**
+ * A pool of helper cords for CPU-bound jobs.
+ *
+ * The fiber scheduler is cooperative: a fiber which doesn't
+ * yield can not be preempted, so a long computation on the tx
+ * cord stalls every other request until it is done. A compute
+ * pool takes such jobs off the owner cord: compute_pool_call()
+ * ships a plain C function to the least loaded helper cord and
+ * blocks only the calling fiber until the result is back, while
+ * the owner cord keeps serving traffic.
+ *
+ * The job runs outside the owner cord, so it must not touch
+ * anything the owner cord owns - box, the Lua state, fiber
+ * regions. Collect the inputs into the message before the call
+ * and apply the results after it returns.
+ */
+struct compute_pool {
+	/** The helper cords. */
+	struct compute_cord *cords;
+	/** The number of helper cords. */
+	int size;
+	/** Name of the owner cord endpoint, e.g. "tx". */
+	char caller_endpoint[FIBER_NAME_MAX];
+};
+
+/**
+ * Start @a size helper cords named "<name>0".."<name>N-1".
+ * The calling cord must already serve the @a caller_endpoint
+ * cbus endpoint - call replies travel through it.
+ * @retval  0 success
+ * @retval -1 error, diag is set, no cords are left running
+ */
+int
+compute_pool_create(struct compute_pool *pool, const char *name, int size,
+		    const char *caller_endpoint);
+
+/**
+ * Execute func(msg) on the least loaded cord of the pool and
+ * block the calling fiber until it completes or @a timeout
+ * expires. A thin wrapper around cbus_call(): on timeout the
+ * job keeps running in the helper cord and free_cb releases
+ * its resources when it finally completes.
+ * @retval the return value of func, or -1 on timeout (diag set)
+ */
+int
+compute_pool_call(struct compute_pool *pool, struct cbus_call_msg *msg,
+		  cbus_call_f func, cbus_call_f free_cb, double timeout);
+
+/** Stop the helper cords and free the pool resources. */
+void
+compute_pool_destroy(struct compute_pool *pool);
+
+#if defined(__cplusplus)
+}
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_COMPUTE_POOL_H_INCLUDED */
@@ -31,10 +31,10 @@
 #include "coro.h"
 
 #include "trivia/config.h"
+#include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/mman.h>
-#include "small/slab_cache.h"
 #include "third_party/valgrind/memcheck.h"
 #include "diag.h"
 #include "tt_pthread.h"
@@ -43,22 +43,29 @@
 #endif
 
 /*
- * coro_stack_size, coro_stack_offset
- * coro_guard_size, coro_guard_offset
- *
- * Stack geometry: relative placement of stack section and guard
- * section, if any. Offsets are relative to the begining of an aligned
- * memory block to host both stack and guard side by side.
- *
- * Note: we assume that the memory comes from a slab allocator and
- * contains a slab header at the beginning we should not touch.
+ * Stack geometry: a dedicated anonymous mapping per coro, with
+ * one protected guard page at the deep end. The kernel
+ * populates the pages lazily on first touch, so the mapping can
+ * be generously sized: a fiber which never goes deeper than a
+ * few pages never pays for the rest in RSS.
  */
 static size_t coro_page_size;
 static size_t coro_stack_size;
 static int coro_stack_direction;
 
 enum {
-	CORO_STACK_PAGES = 16,
+	/**
+	 * The virtual size of a stack. Only the pages actually
+	 * touched are backed by memory.
+	 */
+	CORO_STACK_PAGES = 64,
+	/**
+	 * Pages spared at the live end of the stack when
+	 * trimming a recycled coro: enough to cover the
+	 * suspended frames of a dead fiber parked in the
+	 * scheduler.
+	 */
+	CORO_TRIM_KEEP_PAGES = 2,
 };
 
 static inline void *
@@ -90,44 +97,38 @@ tarantool_coro_init()
 
 int
 tarantool_coro_create(struct tarantool_coro *coro,
-		      struct slab_cache *slabc,
 		      void (*f) (void *), void *data)
 {
 	memset(coro, 0, sizeof(*coro));
 
-	coro->stack_slab = (char *) slab_get(slabc, coro_stack_size);
-
-	if (coro->stack_slab == NULL) {
-		diag_set(OutOfMemory, coro_stack_size,
-			 "runtime arena", "coro stack");
+	coro->mapping_size = coro_stack_size + coro_page_size;
+	coro->mapping = mmap(NULL, coro->mapping_size,
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (coro->mapping == MAP_FAILED) {
+		coro->mapping = NULL;
+		diag_set(OutOfMemory, coro->mapping_size,
+			 "mmap", "coro stack");
 		return -1;
 	}
 	void *guard;
-	/* Adjust begin and size for stack memory chunk. */
+	/* The guard page sits at the deep end of the stack. */
 	if (coro_stack_direction < 0) {
 		/*
-		 * A stack grows down. First page after begin of a
-		 * stack memory chunk should be protected and memory
-		 * after protected page until end of memory chunk can be
-		 * used for coro stack usage.
+		 * A stack grows down: protect the first page of
+		 * the mapping, the stack occupies the rest.
 		 */
-		guard = coro_page_align_up(coro->stack_slab + slab_sizeof());
-		coro->stack = guard + coro_page_size;
-		coro->stack_size = coro_stack_size -
-				   (coro->stack - coro->stack_slab);
-
+		guard = coro->mapping;
+		coro->stack = coro->mapping + coro_page_size;
 	} else {
 		/*
-		 * A stack grows up. Last page should be protected and
-		 * memory from begin of chunk until protected page can
-		 * be used for coro stack usage
+		 * A stack grows up: protect the last page of the
+		 * mapping, the stack starts at the beginning.
 		 */
-		guard = coro_page_align_down(coro->stack_slab +
-					     coro_stack_size) -
-			coro_page_size;
-		coro->stack = coro->stack_slab + slab_sizeof();
-		coro->stack_size = guard - coro->stack;
+		guard = coro->mapping + coro_stack_size;
+		coro->stack = coro->mapping;
 	}
+	coro->stack_size = coro_stack_size;
 
 	coro->stack_id = VALGRIND_STACK_REGISTER(coro->stack,
 						 (char *) coro->stack +
@@ -140,22 +141,50 @@ tarantool_coro_create(struct tarantool_coro *coro,
 }
 
 void
-tarantool_coro_destroy(struct tarantool_coro *coro, struct slab_cache *slabc)
+tarantool_coro_trim(struct tarantool_coro *coro)
+{
+	char *bottom, *limit;
+	char *frame = (char *) __builtin_frame_address(0);
+	bool own_stack = frame >= (char *) coro->stack &&
+			 frame < (char *) coro->stack + coro->stack_size;
+	if (coro_stack_direction < 0) {
+		bottom = (char *) coro->stack;
+		if (own_stack) {
+			/*
+			 * Everything deeper than the caller's
+			 * frame is dead; spare one more page to
+			 * not pull the rug from under the
+			 * madvise() call itself.
+			 */
+			limit = coro_page_align_down(frame) - coro_page_size;
+		} else {
+			limit = (char *) coro->stack + coro->stack_size -
+				CORO_TRIM_KEEP_PAGES * coro_page_size;
+		}
+		if (limit <= bottom)
+			return;
+		madvise(bottom, limit - bottom, MADV_DONTNEED);
+	} else {
+		char *top = (char *) coro->stack + coro->stack_size;
+		if (own_stack)
+			bottom = coro_page_align_up(frame) + coro_page_size;
+		else
+			bottom = (char *) coro->stack +
+				 CORO_TRIM_KEEP_PAGES * coro_page_size;
+		if (bottom >= top)
+			return;
+		madvise(bottom, top - bottom, MADV_DONTNEED);
+	}
+}
+
+void
+tarantool_coro_destroy(struct tarantool_coro *coro)
 {
-	if (coro->stack != NULL) {
+	if (coro->mapping != NULL) {
 		VALGRIND_STACK_DEREGISTER(coro->stack_id);
 #if ENABLE_ASAN
 		ASAN_UNPOISON_MEMORY_REGION(coro->stack, coro->stack_size);
 #endif
-		void *guard;
-		if (coro_stack_direction < 0)
-			guard = coro_page_align_up(coro->stack_slab + slab_sizeof());
-		else
-			guard = coro_page_align_down(coro->stack_slab +
-						     coro_stack_size) -
-				coro_page_size;
-
-		mprotect(guard, coro_page_size, PROT_READ | PROT_WRITE);
-		slab_put(slabc, coro->stack_slab);
+		munmap(coro->mapping, coro->mapping_size);
 	}
 }
@@ -40,8 +40,10 @@ extern "C" {
 
 struct tarantool_coro {
 	coro_context ctx;
-	/** Coro stack slab. */
-	void *stack_slab;
+	/** The anonymous mapping hosting the stack and the guard. */
+	void *mapping;
+	/** The size of the mapping, including the guard page. */
+	size_t mapping_size;
 	/** Coro stack addr. */
 	void *stack;
 	/** Coro stack size. */
@@ -50,18 +52,25 @@ struct tarantool_coro {
 	unsigned int stack_id;
 };
 
-struct slab_cache;
-
 void
 tarantool_coro_init();
 
 int
 tarantool_coro_create(struct tarantool_coro *ctx,
-		      struct slab_cache *cache,
 		      void (*f) (void *), void *data);
+
+/**
+ * Return the cold part of the stack to the kernel with
+ * madvise(MADV_DONTNEED): everything below the live frames of a
+ * recycled coro, or below the caller's own frame when a fiber
+ * trims the stack it is running on. The pages get repopulated
+ * lazily if the stack ever grows that deep again.
+ */
+void
+tarantool_coro_trim(struct tarantool_coro *ctx);
+
 void
-tarantool_coro_destroy(struct tarantool_coro *ctx,
-		       struct slab_cache *cache);
+tarantool_coro_destroy(struct tarantool_coro *ctx);
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
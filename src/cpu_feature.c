@@ -100,6 +100,123 @@ sse42_enabled_cpu()
 	return (cx & (1 << 20)) != 0;
 }
 
+bool
+invariant_tsc_enabled_cpu()
+{
+	unsigned int ax, bx, cx, dx;
+
+	if (__get_cpuid(0x80000007, &ax, &bx, &cx, &dx) == 0)
+		return false;
+
+	return (dx & (1 << 8)) != 0;
+}
+
+#if defined (__x86_64__)
+
+/* The Castagnoli polynomial, bit-reflected, as used by the CRC32
+ * instruction. */
+#define CRC32C_POLY	0x82f63b78
+
+enum {
+	/**
+	 * Bytes fed to each of the three instruction streams per
+	 * iteration of crc32c_hw_3way(). The CRC32 instruction
+	 * retires one quadword per cycle but has a 3 cycle
+	 * latency, so a single dependency chain runs at a third
+	 * of the achievable throughput. Lanes long enough to
+	 * amortize the fold, short enough to keep the minimum
+	 * buffer (3 lanes) common.
+	 */
+	CRC32C_LANE = 4096,
+};
+
+/*
+ * Multiply two polynomials modulo the CRC polynomial, in the
+ * bit-reflected representation the CRC32 instruction uses: bit 31
+ * is the coefficient of x^0. Carryless: additions are xor.
+ */
+static uint32_t
+crc32c_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31;
+	uint32_t p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+	}
+	return p;
+}
+
+/* x^(8n) modulo the CRC polynomial, by repeated squaring. */
+static uint32_t
+crc32c_x8nmodp(unsigned n)
+{
+	uint32_t p = (uint32_t)1 << 31;		/* x^0 */
+	uint32_t x = (uint32_t)1 << (31 - 8);	/* x^8 */
+	while (n) {
+		if (n & 1)
+			p = crc32c_multmodp(x, p);
+		x = crc32c_multmodp(x, x);
+		n >>= 1;
+	}
+	return p;
+}
+
+/*
+ * x^(8 * CRC32C_LANE) mod P: multiplying a lane CRC by it is
+ * equivalent to appending CRC32C_LANE zero bytes, which is what
+ * folding the CRC of a prefix over the following lane requires:
+ * crc(A || B) == crc(A) * x^(8 * len(B)) ^ crc(B).
+ */
+static uint32_t crc32c_lane_shift;
+
+void
+crc32c_hw_init(void)
+{
+	crc32c_lane_shift = crc32c_x8nmodp(CRC32C_LANE);
+}
+
+uint32_t
+crc32c_hw_3way(uint32_t crc, const char *buf, unsigned int len)
+{
+	while (len >= 3 * CRC32C_LANE) {
+		/*
+		 * Three independent dependency chains. Unlike
+		 * crc32c_hw() above, the mnemonic with flexible
+		 * register constraints is required here: the
+		 * fixed .byte encoding would force all three
+		 * chains into the same register and serialize
+		 * them.
+		 */
+		uint64_t c0 = crc, c1 = 0, c2 = 0;
+		const uint64_t *p0 = (const uint64_t *)buf;
+		const uint64_t *p1 = (const uint64_t *)(buf + CRC32C_LANE);
+		const uint64_t *p2 = (const uint64_t *)(buf + 2 * CRC32C_LANE);
+		for (unsigned i = 0; i < CRC32C_LANE / sizeof(uint64_t); i++) {
+			__asm__ __volatile__(
+				"crc32q %1, %0" : "+r"(c0) : "m"(p0[i]));
+			__asm__ __volatile__(
+				"crc32q %1, %0" : "+r"(c1) : "m"(p1[i]));
+			__asm__ __volatile__(
+				"crc32q %1, %0" : "+r"(c2) : "m"(p2[i]));
+		}
+		crc = crc32c_multmodp(crc32c_lane_shift,
+				      (uint32_t)c0) ^ (uint32_t)c1;
+		crc = crc32c_multmodp(crc32c_lane_shift,
+				      crc) ^ (uint32_t)c2;
+		buf += 3 * CRC32C_LANE;
+		len -= 3 * CRC32C_LANE;
+	}
+	return crc32c_hw(crc, buf, len);
+}
+
+#endif /* defined (__x86_64__) */
+
 #else /* !(defined (__x86_64__) || defined (__i386__)) */
 
 bool
@@ -108,4 +225,10 @@ sse42_enabled_cpu()
 	return false;
 }
 
+bool
+invariant_tsc_enabled_cpu()
+{
+	return false;
+}
+
 #endif
@@ -42,6 +42,14 @@
  */
 bool sse42_enabled_cpu();
 
+/* Check whether the TSC is invariant: runs at a constant rate and
+ * keeps counting in deep C-states, so it can be used as a wall
+ * clock source (needed by clock_fast()).
+ *
+ * @return	true if invariant, false if unavailable or variable.
+ */
+bool invariant_tsc_enabled_cpu();
+
 #if defined (__x86_64__) || defined (__i386__)
 /* Hardware-calculate CRC32 for the given data buffer.
  *
@@ -55,5 +63,31 @@ bool sse42_enabled_cpu();
 uint32_t crc32c_hw(uint32_t crc, const char *buf, unsigned int len);
 #endif
 
+#if defined (__x86_64__)
+/* One-time setup for crc32c_hw_3way(): precompute the carryless
+ * multiplication constant used to stitch the lane CRCs together.
+ *
+ * @pre		true == sse42_enabled_cpu()
+ */
+void crc32c_hw_init(void);
+
+/* Hardware-calculate CRC32 for the given data buffer, feeding
+ * three independent instruction streams. The CRC32 instruction
+ * has a 3 cycle latency but single cycle throughput, so a large
+ * buffer is split into three lanes processed in parallel and the
+ * lane CRCs are folded together with a carryless multiplication
+ * by x^(8 * lane size) mod P. Short buffers and tails fall back
+ * to crc32c_hw().
+ *
+ * @param	crc 		initial CRC
+ * @param	buf			data buffer
+ * @param	len			buffer length
+ *
+ * @pre 	crc32c_hw_init() has been called
+ * @return	CRC32 value
+ */
+uint32_t crc32c_hw_3way(uint32_t crc, const char *buf, unsigned int len);
+#endif
+
 #endif /* TARANTOOL_CPU_FEATURES_H */
 
@@ -40,7 +40,20 @@ crc32_func crc32_calc = NULL;
 void
 crc32_init()
 {
-#if defined(HAVE_CPUID) && (defined (__x86_64__) || defined (__i386__))
+#if defined(HAVE_CPUID) && defined (__x86_64__)
+	if (sse42_enabled_cpu()) {
+		/*
+		 * The 3-way variant feeds several instruction
+		 * streams in parallel on large buffers - xlog
+		 * transactions are checksummed as single spans
+		 * and recovery is bottlenecked on exactly this.
+		 */
+		crc32c_hw_init();
+		crc32_calc = &crc32c_hw_3way;
+	} else {
+		crc32_calc = &crc32c;
+	}
+#elif defined(HAVE_CPUID) && defined (__i386__)
 	crc32_calc = sse42_enabled_cpu() ? &crc32c_hw : &crc32c;
 #else
 	crc32_calc = &crc32c;
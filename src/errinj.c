@@ -66,3 +66,81 @@ int errinj_foreach(errinj_cb cb, void *cb_ctx) {
 	}
 	return 0;
 }
+
+#define FAULT_INJ_MEMBER(n) { /* .name = */ #n, 0, 0, 0, 0, 0, 0 },
+
+struct fault_inj fault_injs[fault_inj_id_MAX] = {
+	FAULT_INJ_LIST(FAULT_INJ_MEMBER)
+};
+
+uint32_t fault_inj_armed;
+
+struct fault_inj *
+fault_inj_by_name(const char *name)
+{
+	for (enum fault_inj_id i = 0; i < fault_inj_id_MAX; i++) {
+		if (strcmp(fault_injs[i].name, name) == 0)
+			return &fault_injs[i];
+	}
+	return NULL;
+}
+
+void
+fault_inj_set(struct fault_inj *inj, uint64_t period, double delay,
+	      uint32_t space_id, uint64_t session_id)
+{
+	bool was_armed = inj->period > 0;
+	inj->delay = delay;
+	inj->space_id = space_id;
+	inj->session_id = session_id;
+	inj->count = 0;
+	inj->hits = 0;
+	/*
+	 * Publish the period last: a checking thread which sees
+	 * it non-zero must also see the parameters above.
+	 */
+	__atomic_store_n(&inj->period, period, __ATOMIC_RELEASE);
+	if (period > 0 && !was_armed)
+		__atomic_add_fetch(&fault_inj_armed, 1, __ATOMIC_RELAXED);
+	else if (period == 0 && was_armed)
+		__atomic_sub_fetch(&fault_inj_armed, 1, __ATOMIC_RELAXED);
+	say_info("fault injection %s: period %llu, delay %.6f sec, "
+		 "space %u, session %llu", inj->name,
+		 (unsigned long long) period, delay, space_id,
+		 (unsigned long long) session_id);
+}
+
+int
+fault_inj_foreach(fault_inj_cb cb, void *cb_ctx)
+{
+	for (enum fault_inj_id i = 0; i < fault_inj_id_MAX; i++) {
+		int res = cb(&fault_injs[i], cb_ctx);
+		if (res != 0)
+			return res;
+	}
+	return 0;
+}
+
+bool
+fault_inj_hit(enum fault_inj_id id, uint32_t space_id, uint64_t session_id)
+{
+	struct fault_inj *inj = &fault_injs[id];
+	uint64_t period = __atomic_load_n(&inj->period, __ATOMIC_ACQUIRE);
+	if (period == 0)
+		return false;
+	if (inj->space_id != 0 && inj->space_id != space_id)
+		return false;
+	if (inj->session_id != 0 && inj->session_id != session_id)
+		return false;
+	uint64_t count = __atomic_add_fetch(&inj->count, 1, __ATOMIC_RELAXED);
+	if (count % period != 0)
+		return false;
+	__atomic_add_fetch(&inj->hits, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+double
+fault_inj_delay(enum fault_inj_id id)
+{
+	return fault_injs[id].delay;
+}
@@ -133,6 +133,95 @@ errinj_foreach(errinj_cb cb, void *cb_ctx);
 
 #define ERROR_INJECT_RETURN(ID) ERROR_INJECT(ID, return -1)
 
+/**
+ * Fault injections.
+ *
+ * Unlike the error injections above, which are compiled out of
+ * release builds, fault injections are always present: they exist
+ * to rehearse degraded scenarios - a slow disk, a lost message -
+ * on production canaries. A disarmed injection point costs one
+ * load of a global counter and a never-taken branch. Injections
+ * are typed (a delay plus a firing period) and can be scoped to
+ * one space or one session where the point provides them.
+ * Armed at runtime via box.error.injection.fault().
+ */
+#define FAULT_INJ_LIST(_) \
+	_(FAULT_INJ_WAL_SYNC_DELAY) \
+	_(FAULT_INJ_CBUS_DROP) \
+	_(FAULT_INJ_REQUEST_DELAY)
+
+ENUM0(fault_inj_id, FAULT_INJ_LIST);
+
+struct fault_inj {
+	/** Name, e.g. "FAULT_INJ_WAL_SYNC_DELAY". */
+	const char *name;
+	/**
+	 * Fire on every period-th pass through the injection
+	 * point: 0 - disarmed, 1 - every pass. The arming flag of
+	 * the injection, published last by fault_inj_set().
+	 */
+	uint64_t period;
+	/** Delay to inject when the point fires, seconds. */
+	double delay;
+	/** Fire only in this space, 0 - any. */
+	uint32_t space_id;
+	/** Fire only in this session, 0 - any. */
+	uint64_t session_id;
+	/** Passes through the point since arming. */
+	uint64_t count;
+	/** Times the point actually fired. */
+	uint64_t hits;
+};
+
+extern struct fault_inj fault_injs[];
+
+/**
+ * The number of currently armed fault injections. Non-zero only
+ * while a rehearsal is in progress, so the common-path cost of a
+ * FAULT_INJECT() check is a single well-predicted branch.
+ */
+extern uint32_t fault_inj_armed;
+
+struct fault_inj *
+fault_inj_by_name(const char *name);
+
+/**
+ * Arm (@a period > 0) or disarm (@a period == 0) an injection,
+ * resetting its counters and keeping fault_inj_armed in sync.
+ */
+void
+fault_inj_set(struct fault_inj *inj, uint64_t period, double delay,
+	      uint32_t space_id, uint64_t session_id);
+
+typedef int (*fault_inj_cb)(struct fault_inj *inj, void *cb_ctx);
+
+int
+fault_inj_foreach(fault_inj_cb cb, void *cb_ctx);
+
+/**
+ * The slow path of FAULT_INJECT(): account one pass through the
+ * point and decide whether it fires. Counters are atomic -
+ * injection points live in the tx, wal and net threads alike.
+ */
+bool
+fault_inj_hit(enum fault_inj_id id, uint32_t space_id, uint64_t session_id);
+
+/** The delay configured for an injection point, seconds. */
+double
+fault_inj_delay(enum fault_inj_id id);
+
+/**
+ * Check a fault injection point, compiled into release builds.
+ * @a space_id and @a session_id describe the current scope, 0
+ * where the point has none.
+ */
+#define FAULT_INJECT(ID, space_id, session_id, CODE) \
+	do { \
+		if (unlikely(fault_inj_armed > 0) && \
+		    fault_inj_hit(ID, space_id, session_id)) \
+			CODE; \
+	} while (0)
+
 #if defined(__cplusplus)
 } /* extern "C" */
 #endif /* defined(__cplusplus) */
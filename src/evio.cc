@@ -120,6 +120,26 @@ evio_setsockopt_client(int fd, int family, int type)
 	}
 }
 
+/**
+ * Set options for a socket returned by accept(). The same as for
+ * any client socket, except that sio_accept() may have already
+ * made the socket non-blocking via accept4(), in which case the
+ * fcntl(F_GETFL)/fcntl(F_SETFL) pair is redundant.
+ */
+static void
+evio_setsockopt_accepted(int fd, int family, int type)
+{
+	int on = 1;
+#if !defined(HAVE_ACCEPT4)
+	/* In case this throws, the socket is not leaked. */
+	sio_setfl(fd, O_NONBLOCK, on);
+#endif
+	if (type == SOCK_STREAM && family != AF_UNIX) {
+		evio_setsockopt_keepalive(fd);
+		sio_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+}
+
 /** Set options for server sockets. */
 static void
 evio_setsockopt_server(int fd, int family, int type)
@@ -173,8 +193,10 @@ evio_service_accept_cb(ev_loop * /* loop */, ev_io *watcher,
 
 			if (fd < 0) /* EAGAIN, EWOULDLOCK, EINTR */
 				return;
+			service->accepted++;
 			/* set common client socket options */
-			evio_setsockopt_client(fd, service->addr.sa_family, SOCK_STREAM);
+			evio_setsockopt_accepted(fd, service->addr.sa_family,
+						 SOCK_STREAM);
 			/*
 			 * Invoke the callback and pass it the accepted
 			 * socket.
@@ -238,6 +260,17 @@ evio_service_bind_addr(struct evio_service *service)
 
 	evio_setsockopt_server(fd, service->addr.sa_family, SOCK_STREAM);
 
+	if (service->reuseport && service->addr.sa_family != AF_UNIX) {
+#ifdef SO_REUSEPORT
+		int on = 1;
+		sio_setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+			       &on, sizeof(on));
+#else
+		tnt_raise(SocketError, fd,
+			  "SO_REUSEPORT is not supported on this platform");
+#endif
+	}
+
 	if (sio_bind(fd, &service->addr, service->addr_len)) {
 		assert(errno == EADDRINUSE);
 		if (!evio_service_reuse_addr(service) ||
@@ -360,7 +393,9 @@ evio_service_bind(struct evio_service *service, const char *uri)
 void
 evio_service_stop(struct evio_service *service)
 {
-	say_info("%s: stopped", evio_service_name(service));
+	say_info("%s: stopped, %llu connections accepted",
+		 evio_service_name(service),
+		 (unsigned long long) service->accepted);
 
 	if (ev_is_active(&service->ev)) {
 		ev_io_stop(service->loop, &service->ev);
@@ -35,6 +35,7 @@
  * Requires a running libev loop.
  */
 #include <stdbool.h>
+#include <stdint.h>
 #include "tarantool_ev.h"
 #include "sio.h"
 #include "uri.h"
@@ -87,6 +88,19 @@ struct evio_service
 			  struct sockaddr *, socklen_t);
 	void *on_accept_param;
 
+	/**
+	 * Bind with SO_REUSEPORT, so that several services - one
+	 * per thread, each with its own event loop - can share a
+	 * host:port and let the kernel shard incoming connections
+	 * between their independent accept queues. Set between
+	 * evio_service_init() and evio_service_bind(). Ignored
+	 * for AF_UNIX sockets, which have a single accept queue
+	 * by nature.
+	 */
+	bool reuseport;
+	/** Number of connections accepted by this listener. */
+	uint64_t accepted;
+
 	/** libev io object for the acceptor socket. */
 	struct ev_io ev;
 	ev_loop *loop;
@@ -36,6 +36,7 @@
 
 #include "fiber.h"
 #include "reflection.h"
+#include "small/mempool.h"
 
 extern "C" {
 
@@ -93,12 +94,91 @@ static const struct method exception_methods[] = {
 const struct type type_Exception = make_type("Exception", NULL,
 	exception_methods);
 
+enum {
+	/**
+	 * Object size of the per-cord exception pool: the largest
+	 * exception class in the tree plus struct exception_buf.
+	 * struct error alone is ~800 bytes, most of it the inline
+	 * file and errmsg buffers. Anything bigger falls back to
+	 * malloc().
+	 */
+	EXCEPTION_POOL_OBJSIZE = 1024,
+};
+
+struct exception_pool;
+
+/**
+ * A header prepended to every exception allocation. Tells
+ * operator delete where the buffer came from. Two pointers keep
+ * the payload aligned for any exception class.
+ */
+struct exception_buf {
+	/**
+	 * The pool of the allocating cord, NULL if the buffer was
+	 * taken straight from malloc().
+	 */
+	struct exception_pool *pool;
+	/** Link in exception_pool::remote_free. */
+	struct exception_buf *next;
+};
+
+/**
+ * A per-cord cache of exception buffers. Errors are a part of
+ * normal control flow (e.g. a duplicate key in a transaction
+ * retry loop), so creating one should not hit malloc on the hot
+ * path.
+ */
+struct exception_pool {
+	/** The pool proper, uses the owner cord slab cache. */
+	struct mempool pool;
+	/** The cord the pool was created on. */
+	struct cord *owner;
+	/**
+	 * Buffers freed from other cords: an error created in one
+	 * cord may be dropped in another, e.g. when a worker
+	 * thread passes its diag to tx. A mempool is single
+	 * threaded, so such buffers are pushed onto this lock-free
+	 * stack and recycled by the owner on its next allocation.
+	 */
+	struct exception_buf *remote_free;
+};
+
+static __thread struct exception_pool exception_pool;
+static __thread bool exception_pool_is_created;
+
 void *
 Exception::operator new(size_t size)
 {
-	void *buf = malloc(size);
-	if (buf != NULL)
-		return buf;
+	struct exception_buf *buf;
+	if (cord() != NULL &&
+	    size + sizeof(*buf) <= EXCEPTION_POOL_OBJSIZE) {
+		struct exception_pool *pool = &exception_pool;
+		if (!exception_pool_is_created) {
+			mempool_create(&pool->pool, &cord()->slabc,
+				       EXCEPTION_POOL_OBJSIZE);
+			pool->owner = cord();
+			pool->remote_free = NULL;
+			exception_pool_is_created = true;
+		}
+		struct exception_buf *remote = (struct exception_buf *)
+			__atomic_exchange_n(&pool->remote_free, NULL,
+					    __ATOMIC_ACQUIRE);
+		while (remote != NULL) {
+			struct exception_buf *next = remote->next;
+			mempool_free(&pool->pool, remote);
+			remote = next;
+		}
+		buf = (struct exception_buf *) mempool_alloc(&pool->pool);
+		if (buf != NULL) {
+			buf->pool = pool;
+			return buf + 1;
+		}
+	}
+	buf = (struct exception_buf *) malloc(size + sizeof(*buf));
+	if (buf != NULL) {
+		buf->pool = NULL;
+		return buf + 1;
+	}
 	diag_add_error(diag_get(), &out_of_memory);
 	throw &out_of_memory;
 }
@@ -106,7 +186,23 @@ Exception::operator new(size_t size)
 void
 Exception::operator delete(void *ptr)
 {
-	free(ptr);
+	struct exception_buf *buf = (struct exception_buf *) ptr - 1;
+	struct exception_pool *pool = buf->pool;
+	if (pool == NULL) {
+		free(buf);
+		return;
+	}
+	if (pool->owner == cord()) {
+		mempool_free(&pool->pool, buf);
+		return;
+	}
+	/* Hand the buffer back to the owner cord, lock-free. */
+	struct exception_buf *head = pool->remote_free;
+	do {
+		buf->next = head;
+	} while (!__atomic_compare_exchange_n(&pool->remote_free, &head, buf,
+					      false, __ATOMIC_RELEASE,
+					      __ATOMIC_ACQUIRE));
 }
 
 Exception::~Exception()
@@ -221,10 +317,17 @@ LuajitError::LuajitError(const char *file, unsigned line,
 	snprintf(errmsg, sizeof(errmsg), "%s", msg ? msg : "");
 }
 
+/*
+ * Allocate with Exception::operator new so that the buffer gets
+ * the pool header and operator delete can route it back.
+ */
 #define BuildAlloc(type)				\
-	void *p = malloc(sizeof(type));			\
-	if (p == NULL)					\
-		return &out_of_memory;
+	void *p;					\
+	try {						\
+		p = Exception::operator new(sizeof(type)); \
+	} catch (...) {					\
+		return &out_of_memory;			\
+	}
 
 static struct error *
 BuildOutOfMemory(const char *file, unsigned line,
@@ -29,12 +29,17 @@
  * SUCH DAMAGE.
  */
 #include "fiber.h"
+#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pmatomic.h>
 
+#include "clock.h"
+#include "histogram.h"
+
 #include "assoc.h"
 #include "memory.h"
 #include "trigger.h"
@@ -92,6 +97,35 @@ update_last_stack_frame(struct fiber *fiber)
 static void
 fiber_recycle(struct fiber *fiber);
 
+void
+fiber_destroy(struct cord *cord, struct fiber *f);
+
+enum {
+	/**
+	 * Watermark on the dead fiber cache. Below it recycled
+	 * fibers keep their stacks mapped and warm between
+	 * reuses; above it the coldest cached fiber is destroyed
+	 * and its stack unmapped.
+	 */
+	FIBER_CACHE_WATERMARK = 128,
+};
+
+/**
+ * The part of the dead fiber cache which keeps its stack pages
+ * populated. Recycling above this watermark returns the cold
+ * part of the stack to the kernel; below it madvise() - and the
+ * TLB shootdowns it costs - is skipped entirely, and the pages
+ * stay warm for the next fiber_new(). Tunable with
+ * fiber_cache_set_trim_watermark().
+ */
+static int fiber_cache_trim_watermark = 64;
+
+void
+fiber_cache_set_trim_watermark(int watermark)
+{
+	fiber_cache_trim_watermark = watermark;
+}
+
 /**
  * Transfer control to callee fiber.
  */
@@ -369,6 +403,186 @@ struct fiber_watcher_data {
 	bool timed_out;
 };
 
+/** The resolution of the fiber deadline timing wheel, seconds. */
+static const double FIBER_WHEEL_TICK = 0.001;
+
+/** A deadline parked in the wheel. Lives on the waiter's stack. */
+struct fiber_deadline {
+	/** Link in a wheel slot. */
+	struct rlist link;
+	/** The absolute deadline, in wheel ticks. */
+	int64_t tick;
+	/** The waiting fiber. */
+	struct fiber *fiber;
+	/** Set instead of removal when the deadline expires. */
+	bool timed_out;
+};
+
+static inline int64_t
+fiber_wheel_tick(double time)
+{
+	return (int64_t) (time / FIBER_WHEEL_TICK);
+}
+
+/**
+ * File the deadline into the slot matching its distance: the
+ * level is chosen by how far the deadline is, the slot within
+ * the level by the corresponding digit of the deadline itself,
+ * so cascading a higher level re-files its entries into lower
+ * ones until they expire from level 0 at the exact tick.
+ */
+static void
+fiber_wheel_insert(struct fiber_wheel *wheel, struct fiber_deadline *dl)
+{
+	if (dl->tick <= wheel->time) {
+		/* Never file into the past. */
+		dl->tick = wheel->time + 1;
+	}
+	int64_t delta = dl->tick - wheel->time;
+	int level = 0;
+	int64_t span = FIBER_WHEEL_SLOTS;
+	while (delta >= span && level < FIBER_WHEEL_LEVELS - 1) {
+		level++;
+		span *= FIBER_WHEEL_SLOTS;
+	}
+	int slot = (dl->tick >> (8 * level)) & (FIBER_WHEEL_SLOTS - 1);
+	rlist_add_tail_entry(&wheel->slots[level][slot], dl, link);
+}
+
+/** Advance the wheel to @a now_tick, expiring what is due. */
+static void
+fiber_wheel_advance(struct fiber_wheel *wheel, int64_t now_tick)
+{
+	if (wheel->count == 0) {
+		/* Nothing pending: just resync. */
+		wheel->time = now_tick;
+		return;
+	}
+	while (wheel->time < now_tick) {
+		int64_t t = ++wheel->time;
+		/* Cascade the levels whose digit rolled over. */
+		for (int level = 1; level < FIBER_WHEEL_LEVELS; level++) {
+			if ((t & (((int64_t) 1 << (8 * level)) - 1)) != 0)
+				break;
+			int slot = (t >> (8 * level)) &
+				   (FIBER_WHEEL_SLOTS - 1);
+			struct rlist *list = &wheel->slots[level][slot];
+			while (!rlist_empty(list)) {
+				struct fiber_deadline *dl =
+					rlist_shift_entry(list,
+							  struct fiber_deadline,
+							  link);
+				fiber_wheel_insert(wheel, dl);
+			}
+		}
+		struct rlist *due =
+			&wheel->slots[0][t & (FIBER_WHEEL_SLOTS - 1)];
+		while (!rlist_empty(due)) {
+			struct fiber_deadline *dl =
+				rlist_shift_entry(due, struct fiber_deadline,
+						  link);
+			dl->timed_out = true;
+			wheel->count--;
+			fiber_wakeup(dl->fiber);
+		}
+	}
+}
+
+/**
+ * Arm the driver timer for the nearest tick which may have
+ * work: the first pending slot of level 0, or the next cascade
+ * boundary when everything pending is further out.
+ */
+static void
+fiber_wheel_schedule(struct fiber_wheel *wheel, ev_loop *loop)
+{
+	if (wheel->count == 0) {
+		ev_timer_stop(loop, &wheel->driver);
+		wheel->next_tick = INT64_MAX;
+		return;
+	}
+	int64_t next = INT64_MAX;
+	for (int i = 1; i <= FIBER_WHEEL_SLOTS; i++) {
+		int64_t t = wheel->time + i;
+		if (!rlist_empty(&wheel->slots[0]
+				 [t & (FIBER_WHEEL_SLOTS - 1)])) {
+			next = t;
+			break;
+		}
+	}
+	if (next == INT64_MAX) {
+		next = (wheel->time / FIBER_WHEEL_SLOTS + 1) *
+			FIBER_WHEEL_SLOTS;
+	}
+	wheel->next_tick = next;
+	double delay = next * FIBER_WHEEL_TICK - ev_now(loop);
+	if (delay < 0)
+		delay = 0;
+	ev_timer_stop(loop, &wheel->driver);
+	ev_timer_set(&wheel->driver, delay, 0.);
+	ev_timer_start(loop, &wheel->driver);
+}
+
+static void
+fiber_wheel_cb(ev_loop *loop, ev_timer *watcher, int revents)
+{
+	(void) revents;
+	struct fiber_wheel *wheel = (struct fiber_wheel *) watcher->data;
+	fiber_wheel_advance(wheel, fiber_wheel_tick(ev_now(loop)));
+	fiber_wheel_schedule(wheel, loop);
+}
+
+/** Park the calling fiber's deadline in the wheel. O(1). */
+static void
+fiber_wheel_arm(struct fiber_wheel *wheel, struct fiber_deadline *dl,
+		double delay)
+{
+	double now = ev_now(loop());
+	if (wheel->count == 0) {
+		/* The wheel was idle and its time is stale. */
+		wheel->time = fiber_wheel_tick(now);
+	}
+	/* Round up: expiring early is worse than a tick late. */
+	dl->tick = fiber_wheel_tick(now + delay) + 1;
+	dl->fiber = fiber();
+	dl->timed_out = false;
+	fiber_wheel_insert(wheel, dl);
+	wheel->count++;
+	if (dl->tick < wheel->next_tick) {
+		wheel->next_tick = dl->tick;
+		double d = dl->tick * FIBER_WHEEL_TICK - now;
+		if (d < 0)
+			d = 0;
+		ev_timer_stop(loop(), &wheel->driver);
+		ev_timer_set(&wheel->driver, d, 0.);
+		ev_timer_start(loop(), &wheel->driver);
+	}
+}
+
+/** Remove a deadline which hasn't expired. O(1). */
+static void
+fiber_wheel_disarm(struct fiber_wheel *wheel, struct fiber_deadline *dl)
+{
+	if (dl->timed_out)
+		return;
+	rlist_del(&dl->link);
+	wheel->count--;
+}
+
+static void
+fiber_wheel_create(struct fiber_wheel *wheel)
+{
+	wheel->time = 0;
+	wheel->next_tick = INT64_MAX;
+	wheel->count = 0;
+	ev_timer_init(&wheel->driver, fiber_wheel_cb, 0., 0.);
+	wheel->driver.data = wheel;
+	for (int level = 0; level < FIBER_WHEEL_LEVELS; level++) {
+		for (int slot = 0; slot < FIBER_WHEEL_SLOTS; slot++)
+			rlist_create(&wheel->slots[level][slot]);
+	}
+}
+
 static void
 fiber_schedule_timeout(ev_loop *loop,
 		       ev_timer *watcher, int revents)
@@ -390,6 +604,21 @@ fiber_schedule_timeout(ev_loop *loop,
 bool
 fiber_yield_timeout(ev_tstamp delay)
 {
+	/*
+	 * Coarse deadlines go to the timing wheel - arm and
+	 * disarm are O(1) there no matter how many fibers wait.
+	 * Sub-tick timeouts need better than wheel resolution
+	 * and absurdly long ones would overflow its span, so
+	 * both keep the precise ev_timer path.
+	 */
+	if (delay >= FIBER_WHEEL_TICK &&
+	    delay < FIBER_WHEEL_TICK * ((int64_t) 1 << 31)) {
+		struct fiber_deadline dl;
+		fiber_wheel_arm(&cord()->wheel, &dl, delay);
+		fiber_yield();
+		fiber_wheel_disarm(&cord()->wheel, &dl);
+		return dl.timed_out;
+	}
 	struct ev_timer timer;
 	ev_timer_init(&timer, fiber_schedule_timeout, delay, 0);
 	struct fiber_watcher_data state = { fiber(), false };
@@ -427,6 +656,82 @@ fiber_sleep(double delay)
 	}
 }
 
+/**
+ * How many preemption points a fiber may pass without a context
+ * switch before one is forced on it. Set in the tx thread, read
+ * everywhere - a stale value only shifts the yield a little.
+ */
+static int fiber_preempt_budget = 10000;
+
+/** Stalls cut short by forced yields, per cord. */
+static __thread struct histogram *fiber_stall_hist;
+static __thread int64_t fiber_preempt_yields;
+
+void
+fiber_set_preempt_budget(int budget)
+{
+	fiber_preempt_budget = budget;
+}
+
+void
+fiber_preempt(void)
+{
+	struct fiber *f = fiber();
+	if (fiber_preempt_budget <= 0) {
+		/* Disabled: keep the fast path quiet for long. */
+		f->preempt_ticks = INT_MAX;
+		return;
+	}
+	if (f->csw != f->slice_csw) {
+		/*
+		 * The fiber yielded on its own since the slice
+		 * began - no stall, just open a new slice.
+		 */
+		f->preempt_ticks = fiber_preempt_budget;
+		f->slice_csw = f->csw;
+		f->slice_start = clock_fast();
+		return;
+	}
+	/*
+	 * The whole budget went by without a single context
+	 * switch: the fiber has been hogging the cord. Account
+	 * how long the cord was stalled and give it up for one
+	 * event loop iteration.
+	 */
+	if (fiber_stall_hist == NULL) {
+		enum { US = 1, MS = 1000 * US };
+		static int64_t stall_buckets[] = {
+			100 * US, 250 * US, 500 * US,
+			1 * MS, 2 * MS, 5 * MS, 10 * MS, 25 * MS, 50 * MS,
+			100 * MS, 250 * MS, 500 * MS, 1000 * MS,
+		};
+		/* If we are out of memory, live without the stats. */
+		fiber_stall_hist = histogram_new(stall_buckets,
+						 lengthof(stall_buckets));
+	}
+	if (fiber_stall_hist != NULL) {
+		double stall = clock_fast() - f->slice_start;
+		histogram_collect(fiber_stall_hist, stall * 1e6);
+	}
+	fiber_preempt_yields++;
+	fiber_sleep(0);
+	f->preempt_ticks = fiber_preempt_budget;
+	f->slice_csw = f->csw;
+	f->slice_start = clock_fast();
+}
+
+void
+fiber_preempt_stat(struct fiber_preempt_stat *stat)
+{
+	memset(stat, 0, sizeof(*stat));
+	stat->yields = fiber_preempt_yields;
+	if (fiber_stall_hist == NULL)
+		return;
+	stat->stall_p50 = histogram_percentile(fiber_stall_hist, 50);
+	stat->stall_p99 = histogram_percentile(fiber_stall_hist, 99);
+	stat->stall_max = fiber_stall_hist->max;
+}
+
 void
 fiber_schedule_cb(ev_loop *loop, ev_watcher *watcher, int revents)
 {
@@ -564,6 +869,13 @@ fiber_reset(struct fiber *fiber)
 	rlist_create(&fiber->on_yield);
 	rlist_create(&fiber->on_stop);
 	fiber->flags = FIBER_DEFAULT_FLAGS;
+	/*
+	 * Let the first preemption point fall through to the slow
+	 * path, which starts the first execution slice.
+	 */
+	fiber->preempt_ticks = 0;
+	fiber->slice_csw = -1;
+	fiber->slice_start = 0.;
 }
 
 /** Destroy an active fiber and prepare it for reuse. */
@@ -578,10 +890,35 @@ fiber_recycle(struct fiber *fiber)
 	fiber->gc.name[0] = '\0';
 	fiber->f = NULL;
 	memset(fiber->fls, 0, sizeof(fiber->fls));
+	memset(fiber->local_slots, 0, sizeof(fiber->local_slots));
 	unregister_fid(fiber);
 	fiber->fid = 0;
 	region_free(&fiber->gc);
-	rlist_move_entry(&cord()->dead, fiber, link);
+	struct cord *cord = cord();
+	if (cord->dead_count >= FIBER_CACHE_WATERMARK) {
+		/*
+		 * The cache is full: evict the coldest fiber.
+		 * It can't be the one being recycled - that one
+		 * is still on the alive list.
+		 */
+		struct fiber *victim = rlist_shift_tail_entry(&cord->dead,
+							      struct fiber,
+							      link);
+		cord->dead_count--;
+		fiber_destroy(cord, victim);
+		mempool_free(&cord->fiber_mempool, victim);
+	}
+	rlist_move_entry(&cord->dead, fiber, link);
+	cord->dead_count++;
+	if (cord->dead_count > fiber_cache_trim_watermark) {
+		/*
+		 * The warm part of the cache is full: give the
+		 * cold pages of this stack back to the kernel.
+		 * Runs on the stack being trimmed, which
+		 * tarantool_coro_trim() is prepared for.
+		 */
+		tarantool_coro_trim(&fiber->coro);
+	}
 }
 
 static void
@@ -655,6 +992,21 @@ fiber_set_key(struct fiber *fiber, enum fiber_key key, void *value);
 extern inline void *
 fiber_get_key(struct fiber *fiber, enum fiber_key key);
 
+double
+fiber_local_get(uint32_t slot)
+{
+	if (slot >= FIBER_LOCAL_SLOT_MAX)
+		return 0;
+	return fiber()->local_slots[slot];
+}
+
+void
+fiber_local_set(uint32_t slot, double value)
+{
+	if (slot < FIBER_LOCAL_SLOT_MAX)
+		fiber()->local_slots[slot] = value;
+}
+
 /**
  * Create a new fiber.
  *
@@ -676,6 +1028,8 @@ fiber_new(const char *name, fiber_func f)
 		fiber = rlist_first_entry(&cord->dead,
 					  struct fiber, link);
 		rlist_move_entry(&cord->alive, fiber, link);
+		cord->dead_count--;
+		cord->fiber_cache_hits++;
 	} else {
 		fiber = (struct fiber *)
 			mempool_alloc(&cord->fiber_mempool);
@@ -686,8 +1040,7 @@ fiber_new(const char *name, fiber_func f)
 		}
 		memset(fiber, 0, sizeof(struct fiber));
 
-		if (tarantool_coro_create(&fiber->coro, &cord->slabc,
-					  fiber_loop, NULL)) {
+		if (tarantool_coro_create(&fiber->coro, fiber_loop, NULL)) {
 			mempool_free(&cord->fiber_mempool, fiber);
 			return NULL;
 		}
@@ -700,6 +1053,7 @@ fiber_new(const char *name, fiber_func f)
 		fiber_reset(fiber);
 
 		rlist_add_entry(&cord->alive, fiber, link);
+		cord->fiber_cache_misses++;
 	}
 
 	fiber->f = f;
@@ -733,7 +1087,7 @@ fiber_destroy(struct cord *cord, struct fiber *f)
 	trigger_destroy(&f->on_stop);
 	rlist_del(&f->state);
 	region_destroy(&f->gc);
-	tarantool_coro_destroy(&f->coro, &cord->slabc);
+	tarantool_coro_destroy(&f->coro);
 	diag_destroy(&f->diag);
 }
 
@@ -747,6 +1101,170 @@ fiber_destroy_all(struct cord *cord)
 		fiber_destroy(cord, f);
 }
 
+/* {{{ cord CPU affinity */
+
+enum {
+	/** Max distinct cord names in an affinity spec. */
+	CORD_AFFINITY_MAX = 8,
+	/** Max length of one cpu list, e.g. "0-3,8". */
+	CORD_AFFINITY_CPUS_MAX = 64,
+};
+
+struct cord_affinity {
+	/**
+	 * Cord name or prefix: "iproto" matches "iproto0",
+	 * "iproto1" and so on.
+	 */
+	char name[FIBER_NAME_MAX];
+	/** The cpu list as configured, for reporting. */
+	char cpus[CORD_AFFINITY_CPUS_MAX];
+#if defined(__linux__)
+	cpu_set_t set;
+#endif
+};
+
+/**
+ * The affinity table. Written once at configuration time, before
+ * the worker cords are started; read by every starting cord.
+ */
+static struct cord_affinity cord_affinity_tab[CORD_AFFINITY_MAX];
+static int cord_affinity_count = 0;
+
+/** Parse a cpu list of the taskset kind: "0", "0-3", "0-3,8". */
+static int
+cord_affinity_parse_cpus(struct cord_affinity *af, const char *list,
+			 const char *end)
+{
+	if (end - list >= (ptrdiff_t) sizeof(af->cpus)) {
+		diag_set(SystemError, "cpu_affinity: cpu list is "
+			 "too long");
+		return -1;
+	}
+	memcpy(af->cpus, list, end - list);
+	af->cpus[end - list] = '\0';
+#if defined(__linux__)
+	CPU_ZERO(&af->set);
+#endif
+	const char *p = list;
+	while (p < end) {
+		char *num_end;
+		long first = strtol(p, &num_end, 10);
+		long last = first;
+		if (num_end == p || first < 0 || first >= CPU_SETSIZE)
+			goto error;
+		p = num_end;
+		if (p < end && *p == '-') {
+			last = strtol(p + 1, &num_end, 10);
+			if (num_end == p + 1 || last < first ||
+			    last >= CPU_SETSIZE)
+				goto error;
+			p = num_end;
+		}
+#if defined(__linux__)
+		for (long cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, &af->set);
+#endif
+		if (p == end)
+			return 0;
+		if (*p != ',')
+			goto error;
+		p++;
+	}
+error:
+	diag_set(SystemError, "cpu_affinity: expected a cpu list "
+		 "(e.g. \"0-3,8\"), got \"%s\"", af->cpus);
+	return -1;
+}
+
+/** Find the affinity entry matching a cord name, if any. */
+static struct cord_affinity *
+cord_affinity_find(const char *name)
+{
+	for (int i = 0; i < cord_affinity_count; i++) {
+		struct cord_affinity *af = &cord_affinity_tab[i];
+		size_t len = strlen(af->name);
+		if (strncmp(name, af->name, len) != 0)
+			continue;
+		/* Allow a numeric suffix: "iproto" ~ "iproto0". */
+		const char *tail = name + len;
+		while (isdigit(*tail))
+			tail++;
+		if (*tail == '\0')
+			return af;
+	}
+	return NULL;
+}
+
+/** Pin the calling thread if its cord name is in the table. */
+void
+cord_affinity_apply(void)
+{
+	struct cord_affinity *af = cord_affinity_find(cord()->name);
+	if (af == NULL)
+		return;
+#if defined(__linux__)
+	if (pthread_setaffinity_np(pthread_self(), sizeof(af->set),
+				   &af->set) != 0) {
+		say_syserror("failed to pin cord '%s' to cpus %s",
+			     cord()->name, af->cpus);
+		return;
+	}
+	say_info("pinned cord '%s' to cpus %s", cord()->name, af->cpus);
+#else
+	say_warn("cpu_affinity is not supported on this platform, "
+		 "cord '%s' is not pinned", cord()->name);
+#endif
+}
+
+int
+cord_affinity_cfg(const char *spec)
+{
+	cord_affinity_count = 0;
+	if (spec == NULL || *spec == '\0')
+		return 0;
+	const char *p = spec;
+	while (*p != '\0') {
+		if (cord_affinity_count == CORD_AFFINITY_MAX) {
+			diag_set(SystemError, "cpu_affinity: too many "
+				 "cord names");
+			return -1;
+		}
+		struct cord_affinity *af =
+			&cord_affinity_tab[cord_affinity_count];
+		const char *colon = strchr(p, ':');
+		if (colon == NULL || colon == p ||
+		    colon - p >= (ptrdiff_t) sizeof(af->name)) {
+			diag_set(SystemError, "cpu_affinity: expected "
+				 "\"cord:cpus[;cord:cpus]\"");
+			return -1;
+		}
+		memcpy(af->name, p, colon - p);
+		af->name[colon - p] = '\0';
+		const char *end = strchr(colon + 1, ';');
+		if (end == NULL)
+			end = colon + 1 + strlen(colon + 1);
+		if (cord_affinity_parse_cpus(af, colon + 1, end) != 0)
+			return -1;
+		cord_affinity_count++;
+		p = *end == ';' ? end + 1 : end;
+	}
+	return 0;
+}
+
+int
+cord_affinity_foreach(cord_affinity_cb cb, void *cb_ctx)
+{
+	for (int i = 0; i < cord_affinity_count; i++) {
+		struct cord_affinity *af = &cord_affinity_tab[i];
+		int rc = cb(af->name, af->cpus, cb_ctx);
+		if (rc != 0)
+			return rc;
+	}
+	return 0;
+}
+
+/* }}} cord CPU affinity */
+
 void
 cord_create(struct cord *cord, const char *name)
 {
@@ -761,6 +1279,9 @@ cord_create(struct cord *cord, const char *name)
 	rlist_create(&cord->alive);
 	rlist_create(&cord->ready);
 	rlist_create(&cord->dead);
+	cord->dead_count = 0;
+	cord->fiber_cache_hits = 0;
+	cord->fiber_cache_misses = 0;
 	cord->fiber_registry = mh_i32ptr_new();
 
 	/* sched fiber is not present in alive/ready/dead list. */
@@ -780,6 +1301,7 @@ cord_create(struct cord *cord, const char *name)
 	ev_async_init(&cord->wakeup_event, fiber_schedule_wakeup);
 
 	ev_idle_init(&cord->idle_event, fiber_schedule_idle);
+	fiber_wheel_create(&cord->wheel);
 	cord_set_name(name);
 
 #if ENABLE_ASAN
@@ -829,6 +1351,7 @@ void *cord_thread_func(void *p)
 	cord_create(ct_arg->cord, (ct_arg->name));
 	/** Can't possibly be the main thread */
 	assert(cord()->id != main_thread_id);
+	cord_affinity_apply();
 	tt_pthread_mutex_lock(&ct_arg->start_mutex);
 	void *(*f)(void *) = ct_arg->f;
 	void *arg = ct_arg->arg;
@@ -1115,3 +1638,11 @@ int fiber_stat(fiber_stat_cb cb, void *cb_ctx)
 	}
 	return 0;
 }
+
+void
+fiber_cache_stat(int64_t *hits, int64_t *misses)
+{
+	struct cord *cord = cord();
+	*hits = cord->fiber_cache_hits;
+	*misses = cord->fiber_cache_misses;
+}
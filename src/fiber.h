@@ -102,6 +102,9 @@ enum fiber_key {
 	FIBER_KEY_MAX = 4
 };
 
+/** Number of numeric fiber-local slots, \sa fiber_local_get(). */
+enum { FIBER_LOCAL_SLOT_MAX = 8 };
+
 /** \cond public */
 
 struct fiber;
@@ -268,6 +271,15 @@ struct fiber {
 	struct fiber *caller;
 	/** Number of context switches. */
 	int csw;
+	/**
+	 * Preemption points left in the current execution slice,
+	 * see fiber_preempt_point().
+	 */
+	int preempt_ticks;
+	/** The value of csw when the slice began. */
+	int slice_csw;
+	/** When the slice began, clock_fast() seconds. */
+	double slice_start;
 	/** Fiber id. */
 	uint32_t fid;
 	/** Fiber flags */
@@ -297,12 +309,49 @@ struct fiber {
 	int f_ret;
 	/** Fiber local storage */
 	void *fls[FIBER_KEY_MAX];
+	/**
+	 * Numeric fiber-local slots with O(1) access from both C
+	 * and jitted Lua: per-request context such as tracing ids
+	 * is read many times per request and does not justify a
+	 * table lookup chain per read. Cleared when the fiber is
+	 * recycled. \sa fiber_local_get().
+	 */
+	double local_slots[FIBER_LOCAL_SLOT_MAX];
 	/** Exception which caused this fiber's death. */
 	struct diag diag;
 };
 
 enum { FIBER_CALL_STACK = 16 };
 
+enum {
+	/** Levels of the fiber deadline timing wheel. */
+	FIBER_WHEEL_LEVELS = 4,
+	/** Slots per wheel level, a power of two. */
+	FIBER_WHEEL_SLOTS = 256,
+};
+
+/**
+ * A hierarchical timing wheel for fiber deadlines. Arming and
+ * disarming a deadline is an O(1) list insertion and removal,
+ * whereas an ev_timer costs a heap operation which gets
+ * noticeable with hundreds of thousands of waiting fibers. The
+ * wheel ticks at a millisecond, so it only serves coarse
+ * timeouts; sub-tick ones stay on ev_timer, see
+ * fiber_yield_timeout().
+ */
+struct fiber_wheel {
+	/** The tick the wheel has been advanced to. */
+	int64_t time;
+	/** The tick the driver timer is armed for. */
+	int64_t next_tick;
+	/** The number of pending deadlines. */
+	int64_t count;
+	/** Drives the wheel while it is non-empty. */
+	struct ev_timer driver;
+	/** Pending deadlines, by level and slot. */
+	struct rlist slots[FIBER_WHEEL_LEVELS][FIBER_WHEEL_SLOTS];
+};
+
 struct cord_on_exit;
 
 /**
@@ -329,6 +378,12 @@ struct cord {
 	struct rlist ready;
 	/** A cache of dead fibers for reuse */
 	struct rlist dead;
+	/** Number of fibers in the dead cache. */
+	int dead_count;
+	/** fiber_new() calls served from the dead cache. */
+	int64_t fiber_cache_hits;
+	/** fiber_new() calls which had to create a new stack. */
+	int64_t fiber_cache_misses;
 	/** A watcher to have a single async event for all ready fibers.
 	 * This technique is necessary to be able to suspend
 	 * a single fiber on a few watchers (for example,
@@ -344,6 +399,8 @@ struct cord {
 	 * is no 1 ms delay in case of zero sleep timeout.
 	 */
 	ev_idle idle_event;
+	/** Coarse-grained fiber deadlines of this cord. */
+	struct fiber_wheel wheel;
 	/** A memory cache for (struct fiber) */
 	struct mempool fiber_mempool;
 	/** A runtime slab cache for general use in this cord. */
@@ -359,6 +416,33 @@ extern __thread struct cord *cord_ptr;
 #define fiber() cord()->fiber
 #define loop() (cord()->loop)
 
+/**
+ * Configure cord CPU pinning from a spec of the form
+ * "cord:cpus[;cord:cpus]", e.g. "main:0-3;wal:4;iproto:5,6".
+ * A name matches the cord it names and any cord with a numeric
+ * suffix on top of it ("iproto" matches "iproto0"). The table is
+ * consulted by every cord started afterwards; the calling cord
+ * must apply it explicitly with cord_affinity_apply().
+ * @retval  0 success
+ * @retval -1 bad spec, diag is set
+ */
+int
+cord_affinity_cfg(const char *spec);
+
+/**
+ * Pin the calling thread to the configured CPU set, if its cord
+ * name is in the affinity table. A no-op otherwise.
+ */
+void
+cord_affinity_apply(void);
+
+typedef int (*cord_affinity_cb)(const char *name, const char *cpus,
+				void *cb_ctx);
+
+/** Iterate over the configured affinity entries. */
+int
+cord_affinity_foreach(cord_affinity_cb cb, void *cb_ctx);
+
 void
 cord_create(struct cord *cord, const char *name);
 
@@ -504,6 +588,21 @@ fiber_get_key(struct fiber *fiber, enum fiber_key key)
 	return fiber->fls[key];
 }
 
+/**
+ * \brief Read numeric fiber-local slot \a slot of the current
+ * fiber. Out-of-range slots read as 0. Exported for the FFI fast
+ * path of fiber.slot_get() in Lua.
+ */
+double
+fiber_local_get(uint32_t slot);
+
+/**
+ * \brief Store \a value into numeric fiber-local slot \a slot of
+ * the current fiber. Out-of-range slots are ignored.
+ */
+void
+fiber_local_set(uint32_t slot, double value);
+
 /**
  * Finalizer callback
  * \sa fiber_key_on_gc()
@@ -514,6 +613,74 @@ typedef int (*fiber_stat_cb)(struct fiber *f, void *ctx);
 int
 fiber_stat(fiber_stat_cb cb, void *cb_ctx);
 
+/**
+ * Fiber cache statistics of the calling cord: how many
+ * fiber_new() calls reused a fiber from the dead cache and
+ * how many had to create a fiber and a stack from scratch.
+ */
+void
+fiber_cache_stat(int64_t *hits, int64_t *misses);
+
+/**
+ * Set how many fibers of the calling cord's dead cache keep
+ * their stack pages populated between reuses. Stacks of fibers
+ * recycled above the watermark are trimmed back to the kernel.
+ */
+void
+fiber_cache_set_trim_watermark(int watermark);
+
+/**
+ * Set the preemption budget: how many preemption points a fiber
+ * may pass without a single context switch before
+ * fiber_preempt_point() forces a yield. 0 disables preemption.
+ */
+void
+fiber_set_preempt_budget(int budget);
+
+/**
+ * The slow path of fiber_preempt_point(): starts a new execution
+ * slice, and, if the budget ran out without a context switch,
+ * accounts the stall and yields.
+ */
+void
+fiber_preempt(void);
+
+/** Counters of forced yields, stall durations in microseconds. */
+struct fiber_preempt_stat {
+	int64_t yields;
+	int64_t stall_p50;
+	int64_t stall_p99;
+	int64_t stall_max;
+};
+
+void
+fiber_preempt_stat(struct fiber_preempt_stat *stat);
+
+/**
+ * A cooperative preemption point.
+ *
+ * The scheduler can not take the cord away from a fiber which
+ * does not yield, so a long computation - a big select, a huge
+ * tuple update - stalls every other fiber of the cord until it
+ * is done. Loops which are safe to yield in call this at the
+ * loop header: the cost is a decrement and a branch until the
+ * budget runs out, then the fiber gives up the cord for one
+ * event loop iteration.
+ *
+ * Only place a preemption point where a yield can not hurt:
+ * never inside a memtx transaction (a yield rolls it back) and
+ * never while an index iterator must stay valid across the body
+ * of the loop.
+ */
+static inline void
+fiber_preempt_point(void)
+{
+	struct fiber *f = fiber();
+	if (--f->preempt_ticks > 0)
+		return;
+	fiber_preempt();
+}
+
 /** Useful for C unit tests */
 static inline int
 fiber_c_invoke(fiber_func f, va_list ap)
@@ -576,5 +743,51 @@ region_aligned_alloc_cb(void *ctx, size_t size)
 	return ptr;
 }
 
+/**
+ * A lightweight checkpoint of a region allocator. Creating a
+ * savepoint is O(1) and allocates nothing: it only remembers the
+ * watermark of the region. Restoring it frees everything
+ * allocated after the savepoint was taken, leaving earlier
+ * allocations intact. This lets a callee use fiber()->gc for
+ * scratch memory and clean up after itself without clobbering
+ * allocations of its callers, which matters when box_process()
+ * re-enters itself through a stored procedure.
+ *
+ * A savepoint is invalidated by region_truncate() below its
+ * watermark, including a restore of an older savepoint.
+ */
+struct region_svp {
+	/** Region watermark at the time of the checkpoint. */
+	size_t used;
+};
+
+static inline void
+region_svp_create(struct region_svp *svp, struct region *region)
+{
+	svp->used = region_used(region);
+}
+
+static inline void
+region_svp_restore(struct region_svp *svp, struct region *region)
+{
+	region_truncate(region, svp->used);
+}
+
+/**
+ * Allocate an array of @a count objects of type @a T on the
+ * region, aligned for the type.
+ * @retval not NULL Success.
+ * @retval NULL Memory error, diag is set.
+ */
+#define region_alloc_array(region, T, count)				\
+	({								\
+		size_t _size = sizeof(T) * (count);			\
+		T *_ptr = (T *) region_aligned_alloc((region), _size,	\
+						     alignof(T));	\
+		if (_ptr == NULL)					\
+			diag_set(OutOfMemory, _size, "region",		\
+				 "region_alloc_array");			\
+		_ptr;							\
+	})
 
 #endif /* TARANTOOL_FIBER_H_INCLUDED */
@@ -150,6 +150,8 @@ fiber_pool_create(struct fiber_pool *pool, const char *name, int max_pool_size,
 	ipc_cond_create(&pool->worker_cond);
 	/* Join fiber pool to cbus */
 	cbus_endpoint_create(&pool->endpoint, name, fiber_pool_cb, pool);
+	/* Every net and wal message lands here - the hottest route. */
+	cbus_endpoint_set_lockfree(&pool->endpoint);
 }
 
 void
@@ -59,12 +59,56 @@ histogram_new(const int64_t *buckets, size_t n_buckets)
 	return hist;
 }
 
+struct histogram *
+histogram_new_log(int64_t min, int64_t max)
+{
+	assert(min > 0 && min < max);
+
+	size_t n_buckets = 1;
+	for (int64_t b = min; b < max; b *= 2)
+		n_buckets++;
+
+	int64_t *buckets = malloc(n_buckets * sizeof(*buckets));
+	if (buckets == NULL)
+		return NULL;
+	size_t i = 0;
+	for (int64_t b = min; b < max; b *= 2)
+		buckets[i++] = b;
+	buckets[i] = max;
+
+	struct histogram *hist = histogram_new(buckets, n_buckets);
+	free(buckets);
+	return hist;
+}
+
 void
 histogram_delete(struct histogram *hist)
 {
 	free(hist);
 }
 
+void
+histogram_merge(struct histogram *dst, const struct histogram *src)
+{
+	assert(dst->n_buckets == src->n_buckets);
+	for (size_t i = 0; i < dst->n_buckets; i++) {
+		assert(dst->buckets[i].max == src->buckets[i].max);
+		dst->buckets[i].count += src->buckets[i].count;
+	}
+	dst->total += src->total;
+	if (dst->max < src->max)
+		dst->max = src->max;
+}
+
+void
+histogram_reset(struct histogram *hist)
+{
+	for (size_t i = 0; i < hist->n_buckets; i++)
+		hist->buckets[i].count = 0;
+	hist->total = 0;
+	hist->max = hist->buckets[hist->n_buckets - 1].max;
+}
+
 static struct histogram_bucket *
 histogram_lookup_bucket(struct histogram *hist, int64_t val)
 {
@@ -124,13 +168,19 @@ histogram_discard(struct histogram *hist, int64_t val)
 
 int64_t
 histogram_percentile(struct histogram *hist, int pct)
+{
+	return histogram_percentile_permille(hist, pct * 10);
+}
+
+int64_t
+histogram_percentile_permille(struct histogram *hist, int permille)
 {
 	size_t count = 0;
 
 	for (size_t i = 0; i < hist->n_buckets; i++) {
 		struct histogram_bucket *bucket = &hist->buckets[i];
 		count += bucket->count;
-		if (count * 100 > hist->total * pct)
+		if (count * 1000 > hist->total * permille)
 			return bucket->max;
 	}
 	return hist->max;
@@ -58,6 +58,28 @@ struct histogram {
 struct histogram *
 histogram_new(const int64_t *buckets, size_t n_buckets);
 
+/**
+ * Create a histogram with logarithmically spaced buckets: the
+ * boundaries grow from @a min by a factor of two up to @a max,
+ * which caps the last bucket. Gives a fixed relative error over
+ * the whole range with a small, value-independent bucket count.
+ */
+struct histogram *
+histogram_new_log(int64_t min, int64_t max);
+
+/**
+ * Merge the observations of @a src into @a dst. The histograms
+ * must have identical bucket boundaries.
+ */
+void
+histogram_merge(struct histogram *dst, const struct histogram *src);
+
+/**
+ * Forget all observations.
+ */
+void
+histogram_reset(struct histogram *hist);
+
 /**
  * Destroy a histogram.
  */
@@ -83,6 +105,13 @@ histogram_discard(struct histogram *hist, int64_t val);
 int64_t
 histogram_percentile(struct histogram *hist, int pct);
 
+/**
+ * Like histogram_percentile(), but in permille (tenths of a
+ * percent), for tail percentiles such as p99.9.
+ */
+int64_t
+histogram_percentile_permille(struct histogram *hist, int permille);
+
 /**
  * Print string representation of a histogram.
  */
@@ -29,6 +29,8 @@
  * SUCH DAMAGE.
  */
 #include "iobuf.h"
+#include <string.h>
+#include <pmatomic.h>
 #include "fiber.h"
 
 __thread struct mempool iobuf_pool;
@@ -50,19 +52,100 @@ __thread struct mempool iobuf_pool;
  */
 static unsigned iobuf_readahead = 16320;
 
+/*
+ * A per-cord cache of idle buffers.
+ *
+ * Every cord allocates buffer memory from its own slab cache,
+ * but a slab cache miss goes to the shared arena, whose lock is
+ * taken by every allocating thread - wal, net, tx alike. The
+ * contention peaks exactly when it hurts: at buffer growth time,
+ * when a batch of new connections or appliers all size up their
+ * buffers at once. A parked buffer keeps its slab memory warm,
+ * so taking one from the cache reaches neither the slab cache
+ * nor the arena.
+ */
+struct iobuf_cache {
+	/** The parked buffers, coldest first. */
+	struct rlist list;
+	struct iobuf_cache_stats stats;
+};
+
+static __thread struct iobuf_cache iobuf_cache;
+
+/**
+ * Registry of every cord's cache, filled at iobuf_init() time,
+ * so that box.stat.net can sum the occupancy over the net
+ * threads. The counters are read without synchronization - a
+ * dirty read, the same discipline as the network rmeans.
+ */
+enum { IOBUF_CACHE_MAX_CORDS = 32 };
+static struct iobuf_cache *iobuf_cache_registry[IOBUF_CACHE_MAX_CORDS];
+static int iobuf_cache_registry_size;
+
+/**
+ * The cache size limit. Set in the tx thread, read by all -
+ * same relaxed discipline as iobuf_readahead above.
+ */
+static int iobuf_cache_size_max = 16;
+
 /**
  * How big is a buffer which needs to be shrunk before it is put
- * back into buffer cache.
+ * back into buffer cache, regardless of its demand history.
  */
 static unsigned iobuf_max_size()
 {
 	return 18 * iobuf_readahead;
 }
 
+/** Roll the demand estimate towards the latest cycle. */
+static inline size_t
+iobuf_hwm_update(size_t hwm, size_t peak)
+{
+	return (3 * hwm + peak) / 4;
+}
+
+/**
+ * True if an idle buffer keeps too much slack for its demand
+ * history and must return the memory to the slab cache. The
+ * demand estimate is rounded up to the readahead granularity
+ * and the capacity must overshoot the result twice over: the
+ * hysteresis saves a steadily loaded connection from a
+ * shrink-grow cycle on every reset. Without the decaying
+ * estimate a buffer would keep the capacity of the largest
+ * request the connection ever made - with tens of thousands of
+ * mostly idle connections that is gigabytes of dead memory.
+ */
+static bool
+iobuf_must_shrink(size_t capacity, size_t hwm)
+{
+	if (capacity >= iobuf_max_size())
+		return true;
+	size_t allowance = iobuf_readahead;
+	while (allowance < hwm)
+		allowance *= 2;
+	return capacity > 2 * allowance;
+}
+
+static inline size_t
+iobuf_capacity(struct iobuf *iobuf)
+{
+	return ibuf_capacity(&iobuf->in) + obuf_capacity(&iobuf->out);
+}
+
 /** Create an instance of input/output buffer or take one from cache. */
 struct iobuf *
 iobuf_new()
 {
+	struct iobuf_cache *cache = &iobuf_cache;
+	if (! rlist_empty(&cache->list)) {
+		struct iobuf *iobuf = rlist_shift_entry(&cache->list,
+							struct iobuf, in_cache);
+		cache->stats.count--;
+		cache->stats.used -= iobuf_capacity(iobuf);
+		cache->stats.hits++;
+		return iobuf;
+	}
+	cache->stats.misses++;
 	return iobuf_new_mt(&cord()->slabc);
 }
 
@@ -74,18 +157,54 @@ iobuf_new_mt(struct slab_cache *slabc_out)
 	/* Note: do not allocate memory upfront. */
 	ibuf_create(&iobuf->in, &cord()->slabc, iobuf_readahead);
 	obuf_create(&iobuf->out, slabc_out, iobuf_readahead);
+	iobuf->in_hwm = 0;
+	iobuf->out_hwm = 0;
 	return iobuf;
 }
 
-/** Destroy an instance and delete it. */
-void
-iobuf_delete(struct iobuf *iobuf)
+/** Free a buffer for real, bypassing the cache. */
+static void
+iobuf_delete_do(struct iobuf *iobuf)
 {
 	ibuf_destroy(&iobuf->in);
 	obuf_destroy(&iobuf->out);
 	mempool_free(&iobuf_pool, iobuf);
 }
 
+/** Destroy an instance and delete it or park it in the cache. */
+void
+iobuf_delete(struct iobuf *iobuf)
+{
+	struct iobuf_cache *cache = &iobuf_cache;
+	/*
+	 * Converge to the limit lazily: the tx thread may have
+	 * lowered it since this cord last parked a buffer.
+	 */
+	while (cache->stats.count >= iobuf_cache_size_max) {
+		struct iobuf *victim = rlist_shift_entry(&cache->list,
+							 struct iobuf,
+							 in_cache);
+		cache->stats.count--;
+		cache->stats.used -= iobuf_capacity(victim);
+		iobuf_delete_do(victim);
+	}
+	/*
+	 * An oversized buffer is not worth keeping warm - the
+	 * same reasoning as in iobuf_must_shrink().
+	 */
+	if (iobuf_cache_size_max == 0 ||
+	    iobuf_capacity(iobuf) >= iobuf_max_size()) {
+		iobuf_delete_do(iobuf);
+		return;
+	}
+	/* Discard the content, keep the capacity. */
+	ibuf_reset(&iobuf->in);
+	obuf_reset(&iobuf->out);
+	rlist_add_tail_entry(&cache->list, iobuf, in_cache);
+	cache->stats.count++;
+	cache->stats.used += iobuf_capacity(iobuf);
+}
+
 /** Second part of multi-threaded destroy. */
 void
 iobuf_delete_mt(struct iobuf *iobuf)
@@ -104,13 +223,19 @@ iobuf_reset(struct iobuf *iobuf)
 	 * move the pos to the start of the input buffer.
 	 */
 	if (ibuf_used(&iobuf->in) == 0) {
-		if (ibuf_capacity(&iobuf->in) < iobuf_max_size()) {
+		iobuf->in_hwm = iobuf_hwm_update(iobuf->in_hwm,
+					iobuf->in.wpos - iobuf->in.buf);
+		if (! iobuf_must_shrink(ibuf_capacity(&iobuf->in),
+					iobuf->in_hwm)) {
 			ibuf_reset(&iobuf->in);
 		} else {
 			ibuf_reinit(&iobuf->in);
 		}
 	}
-	if (obuf_capacity(&iobuf->out) < iobuf_max_size()) {
+	iobuf->out_hwm = iobuf_hwm_update(iobuf->out_hwm,
+					  obuf_size(&iobuf->out));
+	if (! iobuf_must_shrink(obuf_capacity(&iobuf->out),
+				iobuf->out_hwm)) {
 		/* Cheap to do even if already done. */
 		obuf_reset(&iobuf->out);
 	} else {
@@ -128,7 +253,10 @@ iobuf_reset_mt(struct iobuf *iobuf)
 	 * move the pos to the start of the input buffer.
 	 */
 	if (ibuf_used(&iobuf->in) == 0) {
-		if (ibuf_capacity(&iobuf->in) < iobuf_max_size()) {
+		iobuf->in_hwm = iobuf_hwm_update(iobuf->in_hwm,
+					iobuf->in.wpos - iobuf->in.buf);
+		if (! iobuf_must_shrink(ibuf_capacity(&iobuf->in),
+					iobuf->in_hwm)) {
 			ibuf_reset(&iobuf->in);
 		} else {
 			struct slab_cache *slabc = iobuf->in.slabc;
@@ -142,6 +270,8 @@ iobuf_reset_mt(struct iobuf *iobuf)
 	 * FIXME: send a message to tx thread to garbage-collect
 	 * the buffer when it's too big.
 	 */
+	iobuf->out_hwm = iobuf_hwm_update(iobuf->out_hwm,
+					  obuf_size(&iobuf->out));
 	obuf_reset(&iobuf->out);
 }
 
@@ -149,6 +279,11 @@ void
 iobuf_init()
 {
 	mempool_create(&iobuf_pool, &cord()->slabc, sizeof(struct iobuf));
+	rlist_create(&iobuf_cache.list);
+	memset(&iobuf_cache.stats, 0, sizeof(iobuf_cache.stats));
+	int i = pm_atomic_fetch_add(&iobuf_cache_registry_size, 1);
+	if (i < IOBUF_CACHE_MAX_CORDS)
+		iobuf_cache_registry[i] = &iobuf_cache;
 }
 
 void
@@ -156,3 +291,46 @@ iobuf_set_readahead(int readahead)
 {
 	iobuf_readahead =  readahead;
 }
+
+void
+iobuf_set_cache_size(int size)
+{
+	iobuf_cache_size_max = size;
+	/*
+	 * Trim the calling cord's cache right away; the other
+	 * cords catch up on their next iobuf_delete().
+	 */
+	struct iobuf_cache *cache = &iobuf_cache;
+	while (cache->stats.count > iobuf_cache_size_max) {
+		struct iobuf *victim = rlist_shift_entry(&cache->list,
+							 struct iobuf,
+							 in_cache);
+		cache->stats.count--;
+		cache->stats.used -= iobuf_capacity(victim);
+		iobuf_delete_do(victim);
+	}
+}
+
+void
+iobuf_cache_stats_get(struct iobuf_cache_stats *stats)
+{
+	*stats = iobuf_cache.stats;
+}
+
+void
+iobuf_cache_stats_get_all(struct iobuf_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	int size = iobuf_cache_registry_size;
+	if (size > IOBUF_CACHE_MAX_CORDS)
+		size = IOBUF_CACHE_MAX_CORDS;
+	for (int i = 0; i < size; i++) {
+		struct iobuf_cache *cache = iobuf_cache_registry[i];
+		if (cache == NULL)
+			continue;
+		stats->count += cache->stats.count;
+		stats->used += cache->stats.used;
+		stats->hits += cache->stats.hits;
+		stats->misses += cache->stats.misses;
+	}
+}
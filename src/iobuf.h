@@ -32,8 +32,10 @@
  */
 #include <sys/uio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "small/ibuf.h"
 #include "small/obuf.h"
+#include "small/rlist.h"
 
 struct iobuf
 {
@@ -41,6 +43,17 @@ struct iobuf
 	struct ibuf in;
 	/** Output buffer. */
 	struct obuf out;
+	/** Link in the per-cord cache of idle buffers. */
+	struct rlist in_cache;
+	/**
+	 * Rolling estimates of buffer demand: how many bytes of
+	 * input/output the owner accumulated between resets,
+	 * averaged over the past cycles. Used to decide how much
+	 * spare capacity an idle buffer is allowed to keep, see
+	 * iobuf_reset().
+	 */
+	size_t in_hwm;
+	size_t out_hwm;
 };
 
 /**
@@ -103,4 +116,34 @@ iobuf_init();
 void
 iobuf_set_readahead(int readahead);
 
+/**
+ * Set how many idle buffers a cord is allowed to keep parked
+ * with their slab memory warm. 0 disables the cache.
+ */
+void
+iobuf_set_cache_size(int size);
+
+/** Counters of the calling cord's idle buffer cache. */
+struct iobuf_cache_stats {
+	/** Buffers currently parked. */
+	int count;
+	/** Total capacity of the parked buffers, in bytes. */
+	size_t used;
+	/** Buffers taken from the cache instead of the slab cache. */
+	int64_t hits;
+	/** Buffers created anew because the cache was empty. */
+	int64_t misses;
+};
+
+void
+iobuf_cache_stats_get(struct iobuf_cache_stats *stats);
+
+/**
+ * Sum the idle buffer cache counters over every cord which has
+ * called iobuf_init(), for box.stat.net. Unsynchronized reads,
+ * like the rest of the network statistics.
+ */
+void
+iobuf_cache_stats_get_all(struct iobuf_cache_stats *stats);
+
 #endif /* TARANTOOL_IOBUF_H_INCLUDED */
@@ -36,6 +36,13 @@ enum ipc_wait_status {
 	IPC_WAIT_READER, /* A reader is waiting for writer */
 	IPC_WAIT_WRITER, /* A writer waiting for reader. */
 	IPC_WAIT_DONE, /* Wait is done, message sent/received. */
+	/*
+	 * Wait is done, but nothing was handed over directly:
+	 * the buffer state changed, re-check it. Used by the
+	 * SPSC protocol, where all transfer goes through the
+	 * ring buffer.
+	 */
+	IPC_WAIT_DATA,
 	IPC_WAIT_CLOSED /* Wait is aborted, the channel is closed. */
 };
 
@@ -54,6 +61,7 @@ ipc_channel_create(struct ipc_channel *ch, uint32_t size)
 	ch->size = size;
 	ch->count = 0;
 	ch->is_closed = false;
+	ch->is_spsc = false;
 	rlist_create(&ch->waiters);
 	if (ch->size) {
 		ch->buf = (struct ipc_msg **) (char *) &ch[1];
@@ -62,6 +70,14 @@ ipc_channel_create(struct ipc_channel *ch, uint32_t size)
 
 }
 
+void
+ipc_channel_create_spsc(struct ipc_channel *ch, uint32_t size)
+{
+	assert(size > 0);
+	ipc_channel_create(ch, size);
+	ch->is_spsc = true;
+}
+
 struct ipc_channel *
 ipc_channel_new(uint32_t size)
 {
@@ -76,6 +92,16 @@ ipc_channel_new(uint32_t size)
 	return res;
 }
 
+struct ipc_channel *
+ipc_channel_new_spsc(uint32_t size)
+{
+	assert(size > 0);
+	struct ipc_channel *res = ipc_channel_new(size);
+	if (res != NULL)
+		res->is_spsc = true;
+	return res;
+}
+
 bool
 ipc_channel_has_waiter(struct ipc_channel *ch, enum ipc_wait_status status)
 {
@@ -280,11 +306,128 @@ ipc_channel_get_timeout(struct ipc_channel *ch, void **data,
 	return rc;
 }
 
+/**
+ * Park the current fiber on the channel wait list with the
+ * given status and wait for a peer, a timeout, or close.
+ * A shared piece of the SPSC put and get slow paths.
+ *
+ * @retval IPC_WAIT_DATA	the buffer state changed, re-check.
+ * @retval IPC_WAIT_CLOSED	the channel is closed.
+ * @retval anything else	timed out, nobody came.
+ */
+static enum ipc_wait_status
+ipc_channel_spsc_wait(struct ipc_channel *ch, enum ipc_wait_status status,
+		      ev_tstamp timeout)
+{
+	struct fiber *f = fiber();
+	struct ipc_wait_pad pad;
+	pad.status = status;
+	pad.msg = NULL;
+	fiber_set_key(f, FIBER_KEY_MSG, &pad);
+	rlist_add_tail_entry(&ch->waiters, f, state);
+	fiber_yield_timeout(timeout);
+	rlist_del_entry(f, state);
+	fiber_set_key(f, FIBER_KEY_MSG, NULL);
+	return pad.status;
+}
+
+/**
+ * Release a producer parked on a full buffer, but only once the
+ * buffer has drained to half capacity. Waking it per freed slot
+ * would recreate the storm the SPSC mode exists to avoid; with
+ * the low-water mark the producer refills half a buffer per
+ * wakeup.
+ */
+static inline void
+ipc_channel_spsc_wake_writer(struct ipc_channel *ch)
+{
+	if (ch->count > ch->size / 2)
+		return;
+	if (! ipc_channel_has_writers(ch))
+		return;
+	struct fiber *f = rlist_first_entry(&ch->waiters, struct fiber, state);
+	ipc_channel_waiter_wakeup(f, IPC_WAIT_DATA);
+}
+
+static int
+ipc_channel_put_msg_spsc(struct ipc_channel *ch, struct ipc_msg *msg,
+			 ev_tstamp timeout)
+{
+	ev_tstamp start_time = ev_now(loop());
+
+	while (true) {
+		if (ch->is_closed) {
+			diag_set(ChannelIsClosed);
+			return -1;
+		}
+		if (ch->count < ch->size) {
+			ipc_channel_buffer_push(ch, msg);
+			/*
+			 * Edge-triggered wakeup: the consumer
+			 * parks only on an empty buffer, so a
+			 * parked consumer means this push is the
+			 * empty-to-non-empty transition. Pushes
+			 * into a non-empty buffer cost nothing.
+			 */
+			if (ipc_channel_has_readers(ch)) {
+				struct fiber *f =
+					rlist_first_entry(&ch->waiters,
+							  struct fiber, state);
+				ipc_channel_waiter_wakeup(f, IPC_WAIT_DATA);
+			}
+			return 0;
+		}
+		/*
+		 * The buffer is full: back off until the consumer
+		 * drains it to the low-water mark.
+		 */
+		if (ipc_channel_check_wait(ch, start_time, timeout))
+			return -1;
+		if (ipc_channel_spsc_wait(ch, IPC_WAIT_WRITER,
+					  timeout) == IPC_WAIT_CLOSED) {
+			diag_set(ChannelIsClosed);
+			return -1;
+		}
+		timeout -= ev_now(loop()) - start_time;
+	}
+}
+
+static int
+ipc_channel_get_msg_spsc(struct ipc_channel *ch, struct ipc_msg **msg,
+			 ev_tstamp timeout)
+{
+	ev_tstamp start_time = ev_now(loop());
+
+	while (true) {
+		if (ch->count > 0) {
+			/*
+			 * A closed channel has no buffered
+			 * messages - they are destroyed at close.
+			 */
+			assert(ch->is_closed == false);
+			*msg = ipc_channel_buffer_pop(ch);
+			ipc_channel_spsc_wake_writer(ch);
+			return 0;
+		}
+		if (ipc_channel_check_wait(ch, start_time, timeout))
+			return -1;
+		if (ipc_channel_spsc_wait(ch, IPC_WAIT_READER,
+					  timeout) == IPC_WAIT_CLOSED) {
+			diag_set(ChannelIsClosed);
+			return -1;
+		}
+		timeout -= ev_now(loop()) - start_time;
+	}
+}
+
 int
 ipc_channel_put_msg_timeout(struct ipc_channel *ch,
 			    struct ipc_msg *msg,
 			    ev_tstamp timeout)
 {
+	if (ch->is_spsc)
+		return ipc_channel_put_msg_spsc(ch, msg, timeout);
+
 	/** Ensure delivery fairness in case of prolonged wait. */
 	bool first_try = true;
 	ev_tstamp start_time = ev_now(loop());
@@ -388,6 +531,9 @@ ipc_channel_get_msg_timeout(struct ipc_channel *ch,
 			    struct ipc_msg **msg,
 			    ev_tstamp timeout)
 {
+	if (ch->is_spsc)
+		return ipc_channel_get_msg_spsc(ch, msg, timeout);
+
 	/** Ensure delivery fairness in case of prolonged wait. */
 	bool first_try = true;
 	ev_tstamp start_time = ev_now(loop());
@@ -483,6 +629,29 @@ ipc_channel_get_msg_timeout(struct ipc_channel *ch,
 	}
 }
 
+int
+ipc_channel_get_msg_batch(struct ipc_channel *ch,
+			  struct ipc_msg **msgs, uint32_t max,
+			  ev_tstamp timeout)
+{
+	assert(max > 0);
+	if (ipc_channel_get_msg_timeout(ch, &msgs[0], timeout) != 0)
+		return -1;
+	uint32_t n = 1;
+	/*
+	 * Drain whatever is already buffered without waiting
+	 * again. A get with a non-empty buffer never yields, so
+	 * a zero timeout is exact here; it also keeps the writer
+	 * refill and wakeup logic in one place.
+	 */
+	while (n < max && ch->count > 0) {
+		if (ipc_channel_get_msg_timeout(ch, &msgs[n], 0) != 0)
+			break;
+		n++;
+	}
+	return n;
+}
+
 void
 ipc_cond_create(struct ipc_cond *c)
 {
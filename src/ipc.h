@@ -114,6 +114,22 @@ ipc_value_new();
  * Sending a message to a closed channel, as well as reading
  * a message from such channel, always fails.
  *
+ * Single producer, single consumer mode
+ * -------------------------------------
+ * When exactly one fiber writes to a channel and exactly one
+ * reads from it, the generic rendezvous protocol is wasteful:
+ * whenever the consumer is parked, every put hands its message
+ * over directly and issues a wakeup, one per element. A channel
+ * created in SPSC mode (see ipc_channel_create_spsc()) instead
+ * always streams messages through the ring buffer and issues
+ * wakeups only on state edges: the consumer is woken when the
+ * buffer goes from empty to non-empty, the producer - when a
+ * full buffer drains back to half capacity. Between the edges
+ * both sides run at ring buffer cost. SPSC mode requires a
+ * non-zero buffer and delivers no fairness guarantees beyond
+ * FIFO message order: with multiple producers or consumers use
+ * the default mode.
+ *
  * Channel memory layout
  * ---------------------
  * Channel structure has a fixed size. If a channel is created
@@ -139,6 +155,12 @@ struct ipc_channel {
 	uint32_t beg;
 	/* True if the channel is closed. */
 	bool is_closed;
+	/**
+	 * True if the channel runs the single producer, single
+	 * consumer protocol: buffered transfer with edge-triggered
+	 * wakeups instead of per-message rendezvous.
+	 */
+	bool is_spsc;
 	/** Channel buffer, if any. */
 	struct ipc_msg **buf;
 };
@@ -160,6 +182,14 @@ ipc_channel_memsize(uint32_t size)
 void
 ipc_channel_create(struct ipc_channel *ch, uint32_t size);
 
+/**
+ * Initialize a channel in single producer, single consumer
+ * mode. The buffer size must be non-zero: SPSC transfer is
+ * always buffered.
+ */
+void
+ipc_channel_create_spsc(struct ipc_channel *ch, uint32_t size);
+
 /** Destroy a channel. Does not free allocated memory. */
 void
 ipc_channel_destroy(struct ipc_channel *ch);
@@ -178,6 +208,13 @@ ipc_channel_destroy(struct ipc_channel *ch);
 struct ipc_channel *
 ipc_channel_new(uint32_t size);
 
+/**
+ * Allocate and construct a channel in single producer, single
+ * consumer mode, @sa ipc_channel_create_spsc().
+ */
+struct ipc_channel *
+ipc_channel_new_spsc(uint32_t size);
+
 /**
  * Destroy and free an IPC channel.
  *
@@ -284,6 +321,23 @@ int
 ipc_channel_get_msg_timeout(struct ipc_channel *ch,
 			    struct ipc_msg **msg,
 			    ev_tstamp timeout);
+
+/**
+ * Get up to @a max messages from the channel in one call. Waits
+ * for the first message for at most @a timeout, then drains
+ * whatever else is already buffered without waiting again. Built
+ * for SPSC consumers which wake up on the empty-to-non-empty
+ * edge and want to take the whole burst, but works with any
+ * channel.
+ *
+ * @return the number of messages received (>= 1), or -1 on
+ *         timeout, close or cancellation.
+ */
+int
+ipc_channel_get_msg_batch(struct ipc_channel *ch,
+			  struct ipc_msg **msgs, uint32_t max,
+			  ev_tstamp timeout);
+
 /**
  * Get data from a channel within given time.
  *
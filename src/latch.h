@@ -51,12 +51,19 @@ struct latch
 	 * The queue of fibers waiting on the latch.
 	 */
 	struct rlist queue;
+	/**
+	 * How many times a fiber found the latch taken and had to
+	 * wait, over the latch lifetime. A cheap contention gauge:
+	 * compare with the acquisition rate to see whether the
+	 * critical section is worth splitting.
+	 */
+	uint64_t wait_count;
 };
 
 /**
  * latch initializer
  */
-#define LATCH_INITIALIZER(name) { 0, RLIST_HEAD_INITIALIZER(name.queue) }
+#define LATCH_INITIALIZER(name) { 0, RLIST_HEAD_INITIALIZER(name.queue), 0 }
 
 /**
  * Initialize the given latch.
@@ -68,6 +75,7 @@ latch_create(struct latch *l)
 {
 	l->owner = NULL;
 	rlist_create(&l->queue);
+	l->wait_count = 0;
 }
 
 /**
@@ -95,6 +103,18 @@ latch_owner(struct latch *l)
 	return l->owner;
 }
 
+/**
+ * Return the number of contended acquisitions over the latch
+ * lifetime, see latch::wait_count.
+ *
+ * @param l - latch to be checked.
+ */
+static inline uint64_t
+latch_wait_count(const struct latch *l)
+{
+	return l->wait_count;
+}
+
 /**
  * Lock a latch. If the latch is already locked by another fiber,
  * waits for timeout.
@@ -116,16 +136,21 @@ latch_lock_timeout(struct latch *l, ev_tstamp timeout)
 	if (timeout <= 0)
 		return 1;
 
+	l->wait_count++;
 	rlist_add_tail_entry(&l->queue, fiber(), state);
 	bool was_cancellable = fiber_set_cancellable(false);
 	ev_tstamp start = timeout;
 	int result = 0;
 	while (true) {
 		fiber_yield_timeout(timeout);
-		if (l->owner == NULL) {
-			l->owner = fiber();
+		/*
+		 * latch_unlock() hands the latch over to the first
+		 * waiter directly, so there is no window in which
+		 * a fiber that never queued could barge in between
+		 * the unlock and this fiber getting scheduled.
+		 */
+		if (l->owner == fiber())
 			break;
-		}
 		timeout -= ev_now(loop()) - start;
 		if (timeout <= 0) {
 			result = 1;
@@ -166,6 +191,15 @@ latch_unlock(struct latch *l)
 	if (!rlist_empty(&l->queue)) {
 		struct fiber *f = rlist_first_entry(&l->queue,
 						    struct fiber, state);
+		/*
+		 * FIFO handoff: make the first waiter the owner
+		 * right away instead of letting the woken fibers
+		 * race for the latch. Without this a fiber that
+		 * locks and unlocks in a loop re-acquires the
+		 * latch every time before the waiters get a chance
+		 * to run, and they starve.
+		 */
+		l->owner = f;
 		fiber_wakeup(f);
 	}
 }
@@ -76,9 +76,60 @@ bitset_test(struct bitset *bitset, size_t pos)
 
 	assert(page->first_pos <= pos && pos < page->first_pos +
 	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
+	if (bitset_page_is_sparse(page)) {
+		uint16_t off = pos - page->first_pos;
+		size_t i = bitset_page_sparse_search(page, off);
+		return i < page->cardinality &&
+		       bitset_page_sparse_data(page)[i] == off;
+	}
 	return bit_test(bitset_page_data(page), pos - page->first_pos);
 }
 
+/**
+ * Grow a full sparse page: double the offset array, or promote
+ * the page to the dense form once the array stops paying for
+ * itself. Reallocation moves the rb node other nodes point at,
+ * so the page is taken out of the pages tree for the duration.
+ *
+ * @retval the page to continue with (possibly moved)
+ * @retval NULL on memory error, the original page is intact
+ */
+static struct bitset_page *
+bitset_page_grow(struct bitset *bitset, struct bitset_page *page)
+{
+	assert(bitset_page_is_sparse(page));
+	assert(page->cardinality == page->sparse_capacity);
+
+	bitset_pages_remove(&bitset->pages, page);
+	if (page->cardinality < BITSET_PAGE_SPARSE_MAX_CARDINALITY) {
+		uint16_t capacity = page->sparse_capacity * 2;
+		if (capacity > BITSET_PAGE_SPARSE_MAX_CARDINALITY)
+			capacity = BITSET_PAGE_SPARSE_MAX_CARDINALITY;
+		struct bitset_page *grown = bitset->realloc(page,
+			bitset_page_sparse_alloc_size(capacity));
+		if (grown == NULL) {
+			bitset_pages_insert(&bitset->pages, page);
+			return NULL;
+		}
+		grown->sparse_capacity = capacity;
+		bitset_pages_insert(&bitset->pages, grown);
+		return grown;
+	}
+
+	size_t size = bitset_page_alloc_size(bitset->realloc);
+	struct bitset_page *dense = bitset->realloc(NULL, size);
+	if (dense == NULL) {
+		bitset_pages_insert(&bitset->pages, page);
+		return NULL;
+	}
+	bitset_page_create(dense);
+	bitset_page_expand(dense, page);
+	bitset_pages_insert(&bitset->pages, dense);
+	bitset_page_destroy(page);
+	bitset->realloc(page, 0);
+	return dense;
+}
+
 int
 bitset_set(struct bitset *bitset, size_t pos)
 {
@@ -88,13 +139,15 @@ bitset_set(struct bitset *bitset, size_t pos)
 	/* Find a page in pages tree */
 	struct bitset_page *page = bitset_pages_search(&bitset->pages, &key);
 	if (page == NULL) {
-		/* Allocate a new page */
-		size_t size = bitset_page_alloc_size(bitset->realloc);
+		/* Allocate a new page, in the sparse form */
+		size_t size = bitset_page_sparse_alloc_size(
+			BITSET_PAGE_SPARSE_MIN_CAPACITY);
 		page = bitset->realloc(NULL, size);
 		if (page == NULL)
 			return -1;
 
-		bitset_page_create(page);
+		bitset_page_sparse_create(page,
+					  BITSET_PAGE_SPARSE_MIN_CAPACITY);
 		page->first_pos = key.first_pos;
 
 		/* Insert the page into pages tree */
@@ -103,6 +156,30 @@ bitset_set(struct bitset *bitset, size_t pos)
 
 	assert(page->first_pos <= pos && pos < page->first_pos +
 	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
+	if (bitset_page_is_sparse(page)) {
+		uint16_t off = pos - page->first_pos;
+		size_t i = bitset_page_sparse_search(page, off);
+		uint16_t *offs = bitset_page_sparse_data(page);
+		if (i < page->cardinality && offs[i] == off) {
+			/* Value has not changed */
+			return 1;
+		}
+		if (page->cardinality == page->sparse_capacity) {
+			page = bitset_page_grow(bitset, page);
+			if (page == NULL)
+				return -1;
+		}
+		if (bitset_page_is_sparse(page)) {
+			offs = bitset_page_sparse_data(page);
+			memmove(offs + i + 1, offs + i,
+				(page->cardinality - i) * sizeof(*offs));
+			offs[i] = off;
+			bitset->cardinality++;
+			page->cardinality++;
+			return 0;
+		}
+		/* The page has been promoted, fall through */
+	}
 	bool prev = bit_set(bitset_page_data(page), pos - page->first_pos);
 	if (prev) {
 		/* Value has not changed */
@@ -128,9 +205,26 @@ bitset_clear(struct bitset *bitset, size_t pos)
 
 	assert(page->first_pos <= pos && pos < page->first_pos +
 	       BITSET_PAGE_DATA_SIZE * CHAR_BIT);
-	bool prev = bit_clear(bitset_page_data(page), pos - page->first_pos);
-	if (!prev) {
-		return 0;
+	if (bitset_page_is_sparse(page)) {
+		uint16_t off = pos - page->first_pos;
+		size_t i = bitset_page_sparse_search(page, off);
+		uint16_t *offs = bitset_page_sparse_data(page);
+		if (i == page->cardinality || offs[i] != off)
+			return 0;
+		memmove(offs + i, offs + i + 1,
+			(page->cardinality - i - 1) * sizeof(*offs));
+	} else {
+		/*
+		 * A dense page is not demoted back to the sparse
+		 * form when its cardinality drops: a page which
+		 * filled up once is likely to fill up again, and
+		 * an emptied page is freed below anyway.
+		 */
+		bool prev = bit_clear(bitset_page_data(page),
+				      pos - page->first_pos);
+		if (!prev) {
+			return 0;
+		}
 	}
 
 	assert(bitset->cardinality > 0);
@@ -164,6 +258,13 @@ bitset_info(struct bitset *bitset, struct bitset_info *info)
 	struct bitset_page *page = bitset_pages_first(&bitset->pages);
 	while (page != NULL) {
 		info->pages++;
+		if (bitset_page_is_sparse(page)) {
+			info->sparse_pages++;
+			info->mem_pages += bitset_page_sparse_alloc_size(
+				page->sparse_capacity);
+		} else {
+			info->mem_pages += info->page_total_size;
+		}
 		cardinality_check += page->cardinality;
 		page = bitset_pages_next(&bitset->pages, page);
 	}
@@ -204,8 +305,8 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 		fprintf(stream, "    "
 			"utilization = undefined\n");
 	}
-	size_t mem_data  = info.page_data_size * info.pages;
-	size_t mem_total = info.page_total_size * info.pages;
+	size_t mem_data  = info.page_data_size * (info.pages - info.sparse_pages);
+	size_t mem_total = info.mem_pages;
 
 	fprintf(stream, "    " "mem_data    = %zu bytes\n", mem_data);
 	fprintf(stream, "    " "mem_total   = %zu bytes "
@@ -246,12 +347,20 @@ bitset_dump(struct bitset *bitset, int verbose, FILE *stream)
 
 		fprintf(stream, "vals = {");
 
-		size_t pos = 0;
-		struct bit_iterator it;
-		bit_iterator_init(&it, bitset_page_data(page),
-			      BITSET_PAGE_DATA_SIZE, true);
-		while ( (pos = bit_iterator_next(&it)) != SIZE_MAX) {
-			fprintf(stream, "%zu, ", page->first_pos + pos);
+		if (bitset_page_is_sparse(page)) {
+			uint16_t *offs = bitset_page_sparse_data(page);
+			for (size_t i = 0; i < page->cardinality; i++) {
+				fprintf(stream, "%zu, ",
+					page->first_pos + offs[i]);
+			}
+		} else {
+			size_t pos = 0;
+			struct bit_iterator it;
+			bit_iterator_init(&it, bitset_page_data(page),
+				      BITSET_PAGE_DATA_SIZE, true);
+			while ( (pos = bit_iterator_next(&it)) != SIZE_MAX) {
+				fprintf(stream, "%zu, ", page->first_pos + pos);
+			}
 		}
 
 		fprintf(stream, "}\n");
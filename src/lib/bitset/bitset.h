@@ -70,6 +70,11 @@ struct bitset_page {
 	size_t first_pos;
 	rb_node(struct bitset_page) node;
 	size_t cardinality;
+	/**
+	 * Number of uint16 offset slots if this is a sparse
+	 * (array-container) page, 0 for a dense (bitmap) page.
+	 */
+	uint16_t sparse_capacity;
 	uint8_t data[0];
 };
 
@@ -151,10 +156,14 @@ bitset_cardinality(const struct bitset *bitset) {
 struct bitset_info {
 	/** Number of allocated pages */
 	size_t pages;
-	/** Data (payload) size of one page (in bytes) */
+	/** Number of pages in the sparse (array-container) form */
+	size_t sparse_pages;
+	/** Data (payload) size of one dense page (in bytes) */
 	size_t page_data_size;
-	/** Full size of one page (in bytes, including padding and tree data) */
+	/** Full size of one dense page (in bytes, including padding and tree data) */
 	size_t page_total_size;
+	/** Bytes allocated for all pages, sparse and dense */
+	size_t mem_pages;
 	/** A multiplier by which an address of page data is aligned **/
 	size_t page_data_alignment;
 };
@@ -45,6 +45,11 @@ struct bitset_iterator_conj {
 	struct bitset **bitsets;
 	bool *pre_nots;
 	struct bitset_page **pages;
+	/**
+	 * Dense pages, one per operand, into which sparse pages
+	 * are materialized before the combine kernel runs.
+	 */
+	struct bitset_page **scratch;
 };
 
 /**
@@ -68,13 +73,25 @@ bitset_iterator_create(struct bitset_iterator *it,
 void
 bitset_iterator_destroy(struct bitset_iterator *it)
 {
-	for (size_t c = 0; c < it->size; c++) {
+	/*
+	 * Walk the whole capacity, not just it->size: a previous
+	 * init could have used more conjunctions than the last one.
+	 */
+	for (size_t c = 0; c < it->capacity; c++) {
 		if (it->conjs[c].capacity == 0)
 			continue;
 
+		for (size_t b = 0; b < it->conjs[c].capacity; b++) {
+			if (it->conjs[c].scratch[b] == NULL)
+				continue;
+			bitset_page_destroy(it->conjs[c].scratch[b]);
+			it->realloc(it->conjs[c].scratch[b], 0);
+		}
+
 		it->realloc(it->conjs[c].bitsets, 0);
 		it->realloc(it->conjs[c].pre_nots, 0);
 		it->realloc(it->conjs[c].pages, 0);
+		it->realloc(it->conjs[c].scratch, 0);
 	}
 
 	if (it->capacity > 0) {
@@ -150,6 +167,10 @@ bitset_iterator_conj_reserve(struct bitset_iterator *it,
 					capacity * sizeof(*conj->pages));
 	if (pages == NULL)
 		goto error_3;
+	struct bitset_page **scratch = it->realloc(conj->scratch,
+					capacity * sizeof(*conj->scratch));
+	if (scratch == NULL)
+		goto error_4;
 
 	memset(bitsets + conj->capacity, 0,
 	       (capacity - conj->capacity) * sizeof(*conj->bitsets));
@@ -157,14 +178,19 @@ bitset_iterator_conj_reserve(struct bitset_iterator *it,
 	       (capacity - conj->capacity) * sizeof(*conj->pre_nots));
 	memset(pages + conj->capacity, 0,
 	       (capacity - conj->capacity) * sizeof(*conj->pages));
+	memset(scratch + conj->capacity, 0,
+	       (capacity - conj->capacity) * sizeof(*conj->scratch));
 
 	conj->bitsets = bitsets;
 	conj->pre_nots = pre_nots;
 	conj->pages = pages;
+	conj->scratch = scratch;
 	conj->capacity = capacity;
 
 	return 0;
 
+error_4:
+	it->realloc(pages, 0);
 error_3:
 	it->realloc(pre_nots, 0);
 error_2:
@@ -219,6 +245,18 @@ bitset_iterator_init(struct bitset_iterator *it, struct bitset_expr *expr,
 			itconj->bitsets[b] = p_bitsets[exconj->bitset_ids[b]];
 			itconj->pre_nots[b] = exconj->pre_nots[b];
 			itconj->pages[b] = NULL;
+			/*
+			 * Allocated up front so that iteration
+			 * itself never needs memory and cannot
+			 * fail half-way.
+			 */
+			if (itconj->scratch[b] == NULL) {
+				itconj->scratch[b] =
+					it->realloc(NULL, page_alloc_size);
+				if (itconj->scratch[b] == NULL)
+					return -1;
+				bitset_page_create(itconj->scratch[b]);
+			}
 		}
 
 		itconj->size = exconj->size;
@@ -305,28 +343,39 @@ bitset_iterator_conj_prepare_page(struct bitset_iterator_conj *conj,
 	assert(conj->size > 0);
 	assert(conj->page_first_pos != SIZE_MAX);
 
-	bitset_page_set_ones(dst);
 	for (size_t b = 0; b < conj->size; b++) {
 		if (!conj->pre_nots[b]) {
 			/* conj->pages[b] is rewinded to conj->page_first_pos */
 			assert(conj->pages[b]->first_pos == conj->page_first_pos);
-			bitset_page_and(dst, conj->pages[b]);
-		} else {
+		} else if (conj->pages[b] != NULL &&
+			   conj->pages[b]->first_pos != conj->page_first_pos) {
 			/*
 			 * If page is NULL or its position is not equal
 			 * to conj->page_first_pos then conj->bitset[b]
 			 * does not have page with the required position and
 			 * all bits in this page are considered to be zeros.
-			 * Since NAND(a, zeros) => a, we can simple skip this
-			 * bitset here.
+			 * Since NAND(a, zeros) => a, such operands can be
+			 * skipped. Drop the stale page pointer so that the
+			 * combine kernel sees the skip as a NULL; the next
+			 * rewind refreshes the array anyway.
 			 */
-			if (conj->pages[b] == NULL ||
-			    conj->pages[b]->first_pos != conj->page_first_pos)
-				continue;
-
-			bitset_page_nand(dst, conj->pages[b]);
+			conj->pages[b] = NULL;
+		}
+		if (conj->pages[b] != NULL &&
+		    bitset_page_is_sparse(conj->pages[b])) {
+			/*
+			 * The combine kernel below reads dense
+			 * words - materialize a sparse page into
+			 * this operand's scratch page. The next
+			 * rewind overwrites the pointer, so the
+			 * substitution is invisible outside.
+			 */
+			bitset_page_expand(conj->scratch[b], conj->pages[b]);
+			conj->pages[b] = conj->scratch[b];
 		}
 	}
+
+	bitset_page_and_nand_many(dst, conj->pages, conj->pre_nots, conj->size);
 }
 
 static void
@@ -425,3 +474,17 @@ bitset_iterator_next(struct bitset_iterator *it)
 		bitset_iterator_next_page(it);
 	}
 }
+
+size_t
+bitset_iterator_count(struct bitset_iterator *it)
+{
+	assert(it != NULL);
+
+	size_t count = 0;
+	while (it->page->first_pos != SIZE_MAX) {
+		count += bitset_page_cardinality(it->page);
+		bitset_iterator_next_page(it);
+	}
+
+	return count;
+}
@@ -135,6 +135,21 @@ bitset_iterator_rewind(struct bitset_iterator *it);
 size_t
 bitset_iterator_next(struct bitset_iterator *it);
 
+/**
+ * @brief Count the positions where the expression evaluates to true.
+ *
+ * Sums the cardinality of result pages using batched popcounts
+ * instead of walking the positions one by one. The \a it is
+ * consumed; call the method on a freshly initialized (or rewound)
+ * iterator to count the entire result set.
+ *
+ * @param it bitset iterator
+ * @return the number of positions in the result set
+ * @see @link bitset_iterator_init @endlink
+ */
+size_t
+bitset_iterator_count(struct bitset_iterator *it);
+
 #if defined(__cplusplus)
 }
 #endif /* defined(__cplusplus) */
@@ -53,6 +53,24 @@ bitset_page_set_zeros(struct bitset_page *page);
 extern inline void
 bitset_page_set_ones(struct bitset_page *page);
 
+extern inline bool
+bitset_page_is_sparse(const struct bitset_page *page);
+
+extern inline size_t
+bitset_page_sparse_alloc_size(size_t capacity);
+
+extern inline uint16_t *
+bitset_page_sparse_data(struct bitset_page *page);
+
+extern inline void
+bitset_page_sparse_create(struct bitset_page *page, uint16_t capacity);
+
+extern inline size_t
+bitset_page_sparse_search(struct bitset_page *page, uint16_t off);
+
+extern inline void
+bitset_page_expand(struct bitset_page *dst, struct bitset_page *src);
+
 extern inline void
 bitset_page_and(struct bitset_page *dst, struct bitset_page *src);
 
@@ -62,6 +80,16 @@ bitset_page_nand(struct bitset_page *dst, struct bitset_page *src);
 extern inline void
 bitset_page_or(struct bitset_page *dst, struct bitset_page *src);
 
+extern inline bitset_word_t
+bitset_word_ones(void);
+
+extern inline void
+bitset_page_and_nand_many(struct bitset_page *dst, struct bitset_page **srcs,
+			  const bool *pre_nots, size_t count);
+
+extern inline size_t
+bitset_page_cardinality(struct bitset_page *page);
+
 #if defined(DEBUG)
 void
 bitset_page_dump(struct bitset_page *page, FILE *stream)
@@ -55,13 +55,24 @@ extern "C" {
 
 enum {
 	/** How many bytes to store in one page */
-	BITSET_PAGE_DATA_SIZE = 160
+	BITSET_PAGE_DATA_SIZE = 160,
+	/** Offset slots in a freshly allocated sparse page */
+	BITSET_PAGE_SPARSE_MIN_CAPACITY = 8,
+	/**
+	 * A sparse page is promoted to the dense (bitmap) form
+	 * when its cardinality outgrows this. 64 slots take 128
+	 * bytes - past that the offset array no longer saves
+	 * memory over the 160 byte bitmap.
+	 */
+	BITSET_PAGE_SPARSE_MAX_CARDINALITY = 64
 };
 
 #if defined(ENABLE_AVX)
+#include <immintrin.h>
 typedef __m256i bitset_word_t;
 #define BITSET_PAGE_DATA_ALIGNMENT 32
 #elif defined(ENABLE_SSE2)
+#include <immintrin.h>
 typedef __m128i bitset_word_t;
 #define BITSET_PAGE_DATA_ALIGNMENT 16
 #elif defined(__x86_64__)
@@ -133,6 +144,36 @@ bitset_page_first_pos(size_t pos) {
 	return pos - (pos % (BITSET_PAGE_DATA_SIZE * CHAR_BIT));
 }
 
+inline bool
+bitset_page_is_sparse(const struct bitset_page *page)
+{
+	return page->sparse_capacity != 0;
+}
+
+inline size_t
+bitset_page_sparse_alloc_size(size_t capacity)
+{
+	return sizeof(struct bitset_page) + capacity * sizeof(uint16_t);
+}
+
+inline uint16_t *
+bitset_page_sparse_data(struct bitset_page *page)
+{
+	/*
+	 * Nothing vectorized ever touches the offset array, so
+	 * the alignment dance of bitset_page_data() is not
+	 * needed here.
+	 */
+	return (uint16_t *) page->data;
+}
+
+inline void
+bitset_page_sparse_create(struct bitset_page *page, uint16_t capacity)
+{
+	memset(page, 0, sizeof(*page));
+	page->sparse_capacity = capacity;
+}
+
 inline void
 bitset_page_set_zeros(struct bitset_page *page)
 {
@@ -147,6 +188,44 @@ bitset_page_set_ones(struct bitset_page *page)
 	memset(data, -1, BITSET_PAGE_DATA_SIZE);
 }
 
+/**
+ * @brief Find the slot of offset \a off in a sparse page, or the
+ * slot where it would be inserted to keep the array sorted.
+ */
+inline size_t
+bitset_page_sparse_search(struct bitset_page *page, uint16_t off)
+{
+	assert(bitset_page_is_sparse(page));
+	uint16_t *offs = bitset_page_sparse_data(page);
+	size_t begin = 0;
+	size_t end = page->cardinality;
+	while (begin != end) {
+		size_t mid = (begin + end) / 2;
+		if (offs[mid] < off)
+			begin = mid + 1;
+		else
+			end = mid;
+	}
+	return begin;
+}
+
+/**
+ * @brief Materialize the sparse page \a src into the dense page
+ * \a dst, which must have room for BITSET_PAGE_DATA_SIZE bytes.
+ */
+inline void
+bitset_page_expand(struct bitset_page *dst, struct bitset_page *src)
+{
+	assert(bitset_page_is_sparse(src));
+	assert(!bitset_page_is_sparse(dst));
+	bitset_page_set_zeros(dst);
+	dst->first_pos = src->first_pos;
+	dst->cardinality = src->cardinality;
+	uint16_t *offs = bitset_page_sparse_data(src);
+	for (size_t i = 0; i < src->cardinality; i++)
+		bit_set(bitset_page_data(dst), offs[i]);
+}
+
 inline void
 bitset_page_and(struct bitset_page *dst, struct bitset_page *src)
 {
@@ -186,6 +265,69 @@ bitset_page_or(struct bitset_page *dst, struct bitset_page *src)
 	}
 }
 
+/**
+ * @brief Return an all-ones word
+ */
+inline bitset_word_t
+bitset_word_ones(void)
+{
+#if defined(ENABLE_AVX)
+	return _mm256_set1_epi32(-1);
+#elif defined(ENABLE_SSE2)
+	return _mm_set1_epi32(-1);
+#else
+	return ~(bitset_word_t) 0;
+#endif
+}
+
+/**
+ * @brief Evaluate a conjunction of \a count operands in one pass:
+ * dst = AND of all non-negated pages AND-NOT of all negated ones.
+ *
+ * A NULL page in \a srcs stands for an all-zero page; since
+ * NAND(a, zeros) => a, such operands are skipped. The accumulator
+ * is kept in a register, so \a dst is written exactly once however
+ * many operands there are, instead of once per operand as with a
+ * chain of bitset_page_and() / bitset_page_nand() calls.
+ */
+inline void
+bitset_page_and_nand_many(struct bitset_page *dst, struct bitset_page **srcs,
+			  const bool *pre_nots, size_t count)
+{
+	bitset_word_t *d = (bitset_word_t *) bitset_page_data(dst);
+
+	assert(BITSET_PAGE_DATA_SIZE % sizeof(bitset_word_t) == 0);
+	int cnt = BITSET_PAGE_DATA_SIZE / sizeof(bitset_word_t);
+	for (int i = 0; i < cnt; i++) {
+		bitset_word_t w = bitset_word_ones();
+		for (size_t b = 0; b < count; b++) {
+			if (srcs[b] == NULL)
+				continue;
+			bitset_word_t *s = (bitset_word_t *)
+				bitset_page_data(srcs[b]);
+			w &= pre_nots[b] ? ~s[i] : s[i];
+		}
+		d[i] = w;
+	}
+}
+
+/**
+ * @brief Count bits set in \a page with batched popcounts
+ */
+inline size_t
+bitset_page_cardinality(struct bitset_page *page)
+{
+	uint64_t *d = (uint64_t *) bitset_page_data(page);
+
+	assert(BITSET_PAGE_DATA_SIZE % sizeof(uint64_t) == 0);
+	int cnt = BITSET_PAGE_DATA_SIZE / sizeof(uint64_t);
+	size_t card = 0;
+	for (int i = 0; i < cnt; i++) {
+		card += bit_count_u64(d[i]);
+	}
+	return card;
+}
+
 #if defined(DEBUG)
 void
 bitset_page_dump(struct bitset_page *page, FILE *stream);
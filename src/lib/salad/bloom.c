@@ -167,6 +167,92 @@ bloom_spectrum_destroy(struct bloom_spectrum *spectrum, struct quota *quota)
 	}
 }
 
+int
+bloom_count_create(struct bloom_count *bloom, uint32_t number_of_values,
+		   double false_positive_rate, struct quota *quota)
+{
+	/* Optimal hash_count and counter count calculation */
+	bloom->hash_count = (uint32_t)
+		(log(false_positive_rate) / log(0.5) + 0.99);
+	/* A counting filter needs as many counters as a plain
+	 * filter needs bits, and a counter takes a byte. */
+	uint64_t m = (uint64_t)
+		(number_of_values * bloom->hash_count / log(2) + 0.5);
+	/* mmap page size */
+	uint64_t page_size = sysconf(_SC_PAGE_SIZE);
+	/* number of pages, round up */
+	uint64_t p = (m + page_size - 1) / page_size;
+	/* counter array size in bytes */
+	size_t mmap_size = p * page_size;
+	bloom->table_size = p * page_size / sizeof(struct bloom_count_block);
+	if (quota_use(quota, mmap_size) < 0) {
+		bloom->table = NULL;
+		return -1;
+	}
+	bloom->table = (struct bloom_count_block *)
+		mmap(NULL, mmap_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bloom->table == MAP_FAILED) {
+		bloom->table = NULL;
+		quota_release(quota, mmap_size);
+		return -1;
+	}
+	return 0;
+}
+
+void
+bloom_count_destroy(struct bloom_count *bloom, struct quota *quota)
+{
+	size_t mmap_size = bloom->table_size * sizeof(struct bloom_count_block);
+	munmap(bloom->table, mmap_size);
+	quota_release(quota, mmap_size);
+}
+
+int
+bloom_scalable_create(struct bloom_scalable *scalable,
+		      uint32_t number_of_values, double false_positive_rate,
+		      struct quota *quota)
+{
+	/*
+	 * Each chained filter gets half of the remaining false
+	 * positive budget, so the sum over any chain length stays
+	 * under the requested rate.
+	 */
+	scalable->count = 1;
+	scalable->last_count = 0;
+	scalable->last_capacity = number_of_values;
+	scalable->false_positive_rate = false_positive_rate / 2;
+	if (bloom_create(&scalable->vector[0], number_of_values,
+			 scalable->false_positive_rate, quota) != 0)
+		return -1;
+	scalable->false_positive_rate /= 2;
+	return 0;
+}
+
+void
+bloom_scalable_destroy(struct bloom_scalable *scalable, struct quota *quota)
+{
+	for (uint32_t i = 0; i < scalable->count; i++)
+		bloom_destroy(&scalable->vector[i], quota);
+}
+
+int
+bloom_scalable_grow(struct bloom_scalable *scalable, struct quota *quota)
+{
+	assert(scalable->count > 0);
+	if (scalable->count == BLOOM_SCALABLE_MAX)
+		return -1;
+	uint32_t capacity = scalable->last_capacity * 2;
+	if (bloom_create(&scalable->vector[scalable->count], capacity,
+			 scalable->false_positive_rate, quota) != 0)
+		return -1;
+	scalable->count++;
+	scalable->last_count = 0;
+	scalable->last_capacity = capacity;
+	scalable->false_positive_rate /= 2;
+	return 0;
+}
+
 /* }}} API definition */
 
 
@@ -208,6 +208,164 @@ bloom_spectrum_choose(struct bloom_spectrum *spectrum, struct bloom *bloom);
 void
 bloom_spectrum_destroy(struct bloom_spectrum *spectrum, struct quota *quota);
 
+/**
+ * Cache-line-size block of a counting bloom filter: one 8-bit
+ * counter per position instead of one bit, so one query still
+ * touches a single cache line.
+ */
+struct bloom_count_block {
+	unsigned char counts[BLOOM_CACHE_LINE];
+};
+
+/**
+ * Counting bloom filter: same blocked layout and hashing as
+ * struct bloom, but every position is an 8-bit counter, which
+ * makes deletion possible. A counter that reaches UCHAR_MAX
+ * saturates and is never decremented again: an overflown
+ * position may yield false positives forever, but deletion can
+ * never produce a false negative.
+ */
+struct bloom_count {
+	/* Number of buckets (blocks) in the table */
+	uint32_t table_size;
+	/* Number of hash function per value */
+	uint16_t hash_count;
+	/* Counter table */
+	struct bloom_count_block *table;
+};
+
+/**
+ * Allocate and initialize an instance of counting bloom filter
+ *
+ * @param bloom - structure to initialize
+ * @param number_of_values - estimated number of values to be added
+ * @param false_positive_rate - desired false positive rate
+ * @param quota - quota for memory allocation
+ * @return 0 - OK, -1 - memory error
+ */
+int
+bloom_count_create(struct bloom_count *bloom, uint32_t number_of_values,
+		   double false_positive_rate, struct quota *quota);
+
+/**
+ * Free resources of the counting bloom filter
+ *
+ * @param bloom - the bloom filter
+ * @param quota - quota for memory deallocation
+ */
+void
+bloom_count_destroy(struct bloom_count *bloom, struct quota *quota);
+
+/**
+ * Add a value into the data set
+ * @param bloom - the bloom filter
+ * @param hash - hash of the value
+ */
+static void
+bloom_count_add(struct bloom_count *bloom, bloom_hash_t hash);
+
+/**
+ * Remove a previously added value from the data set.
+ * Removing a value that was not added puts the filter into an
+ * inconsistent state and may produce false negatives.
+ * @param bloom - the bloom filter
+ * @param hash - hash of the value
+ */
+static void
+bloom_count_remove(struct bloom_count *bloom, bloom_hash_t hash);
+
+/**
+ * Query for presence of a value in the data set
+ * @param bloom - the bloom filter
+ * @param hash - hash of the value
+ * @return true - the value could be in data set; false - the value is
+ *  definitively not in data set
+ */
+static bool
+bloom_count_possible_has(const struct bloom_count *bloom, bloom_hash_t hash);
+
+enum {
+	/*
+	 * Maximal length of a scalable bloom filter chain. Each
+	 * new filter doubles the capacity, so the limit is never
+	 * reached in practice.
+	 */
+	BLOOM_SCALABLE_MAX = 32,
+};
+
+/**
+ * Scalable bloom filter: a chain of ordinary bloom filters that
+ * grows as values are added, for the case when not even an upper
+ * bound of the number of elements is known in advance. When the
+ * newest filter is filled up to its capacity, a new one with
+ * twice the capacity and half the false positive rate is chained,
+ * so the total false positive rate of the chain stays under the
+ * requested one.
+ */
+struct bloom_scalable {
+	/** Number of filters in the chain. */
+	uint32_t count;
+	/** Number of values added to the newest filter. */
+	uint32_t last_count;
+	/** Capacity of the newest filter. */
+	uint32_t last_capacity;
+	/** False positive rate for the next chained filter. */
+	double false_positive_rate;
+	/** The chain. The newest filter is at count - 1. */
+	struct bloom vector[BLOOM_SCALABLE_MAX];
+};
+
+/**
+ * Create a scalable bloom filter
+ * @param scalable - structure to initialize
+ * @param number_of_values - capacity of the first filter in the chain
+ * @param false_positive_rate - desired total false positive rate
+ * @param quota - quota for memory allocation
+ * @return 0 - OK, -1 - memory error
+ */
+int
+bloom_scalable_create(struct bloom_scalable *scalable,
+		      uint32_t number_of_values, double false_positive_rate,
+		      struct quota *quota);
+
+/**
+ * Destroy the chain and free all filters
+ * @param scalable - the filter to destroy
+ * @param quota - quota for memory deallocation
+ */
+void
+bloom_scalable_destroy(struct bloom_scalable *scalable, struct quota *quota);
+
+/**
+ * Chain a new filter when the newest one is full. Used by
+ * bloom_scalable_add(), not meant to be called directly.
+ * @return 0 - OK, -1 - memory error
+ */
+int
+bloom_scalable_grow(struct bloom_scalable *scalable, struct quota *quota);
+
+/**
+ * Add a value into the data set, growing the chain if needed
+ * @param scalable - the filter to add to
+ * @param hash - hash of the value
+ * @param quota - quota for memory allocation on growth
+ * @return 0 - OK, -1 - memory error
+ */
+static int
+bloom_scalable_add(struct bloom_scalable *scalable, bloom_hash_t hash,
+		   struct quota *quota);
+
+/**
+ * Query for presence of a value in the data set
+ * @param scalable - the filter to query
+ * @param hash - hash of the value
+ * @return true - the value could be in data set; false - the value is
+ *  definitively not in data set
+ */
+static bool
+bloom_scalable_possible_has(const struct bloom_scalable *scalable,
+			    bloom_hash_t hash);
+
 /* }}} API declaration */
 
 /* {{{ API definition */
@@ -262,6 +420,84 @@ bloom_spectrum_add(struct bloom_spectrum *spectrum, bloom_hash_t hash)
 		bloom_add(&spectrum->vector[i], hash);
 }
 
+static inline void
+bloom_count_add(struct bloom_count *bloom, bloom_hash_t hash)
+{
+	/* Using lower part of the hash for finding a block */
+	bloom_hash_t pos = hash % bloom->table_size;
+	hash = hash / bloom->table_size;
+	/* counter_no in block is less than BLOOM_CACHE_LINE (64).
+	 * split the given hash into independent lower part and high part. */
+	bloom_hash_t hash2 = hash / BLOOM_CACHE_LINE + 1;
+	for (bloom_hash_t i = 0; i < bloom->hash_count; i++) {
+		bloom_hash_t counter_no = hash % BLOOM_CACHE_LINE;
+		unsigned char *count = &bloom->table[pos].counts[counter_no];
+		/* A saturated counter is sticky. */
+		if (*count < UCHAR_MAX)
+			(*count)++;
+		/* Combine two hashes to create required number of hashes */
+		/* Add i**2 for better distribution */
+		hash += hash2 + i * i;
+	}
+}
+
+static inline void
+bloom_count_remove(struct bloom_count *bloom, bloom_hash_t hash)
+{
+	/* Using lower part of the hash for finding a block */
+	bloom_hash_t pos = hash % bloom->table_size;
+	hash = hash / bloom->table_size;
+	bloom_hash_t hash2 = hash / BLOOM_CACHE_LINE + 1;
+	for (bloom_hash_t i = 0; i < bloom->hash_count; i++) {
+		bloom_hash_t counter_no = hash % BLOOM_CACHE_LINE;
+		unsigned char *count = &bloom->table[pos].counts[counter_no];
+		/* A saturated counter is sticky. */
+		if (*count < UCHAR_MAX)
+			(*count)--;
+		hash += hash2 + i * i;
+	}
+}
+
+static inline bool
+bloom_count_possible_has(const struct bloom_count *bloom, bloom_hash_t hash)
+{
+	/* Using lower part of the hash for finding a block */
+	bloom_hash_t pos = hash % bloom->table_size;
+	hash = hash / bloom->table_size;
+	bloom_hash_t hash2 = hash / BLOOM_CACHE_LINE + 1;
+	for (bloom_hash_t i = 0; i < bloom->hash_count; i++) {
+		bloom_hash_t counter_no = hash % BLOOM_CACHE_LINE;
+		if (bloom->table[pos].counts[counter_no] == 0)
+			return false;
+		hash += hash2 + i * i;
+	}
+	return true;
+}
+
+static inline int
+bloom_scalable_add(struct bloom_scalable *scalable, bloom_hash_t hash,
+		   struct quota *quota)
+{
+	if (scalable->last_count == scalable->last_capacity &&
+	    bloom_scalable_grow(scalable, quota) != 0)
+		return -1;
+	bloom_add(&scalable->vector[scalable->count - 1], hash);
+	scalable->last_count++;
+	return 0;
+}
+
+static inline bool
+bloom_scalable_possible_has(const struct bloom_scalable *scalable,
+			    bloom_hash_t hash)
+{
+	/* The newest filter is the most likely to hold the value. */
+	for (uint32_t i = scalable->count; i > 0; i--) {
+		if (bloom_possible_has(&scalable->vector[i - 1], hash))
+			return true;
+	}
+	return false;
+}
+
 /* }}} API definition */
 
 #if defined(__cplusplus)
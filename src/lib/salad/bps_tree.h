@@ -152,6 +152,8 @@
  * struct bps_tree_iterator bps_tree_iterator_first(tree);
  * struct bps_tree_iterator bps_tree_iterator_last(tree);
  * struct bps_tree_iterator bps_tree_lower_bound(tree, key, exact);
+ * struct bps_tree_leaf_hint bps_tree_invalid_leaf_hint();
+ * struct bps_tree_iterator bps_tree_lower_bound_hinted(tree, key, exact, hint);
  * struct bps_tree_iterator bps_tree_upper_bound(tree, key, exact);
  * size_t bps_tree_approxiamte_count(tree, key);
  * bps_tree_elem_t *bps_tree_iterator_get_elem(tree, itr);
@@ -184,9 +186,19 @@
  * (see below for the binary/linear search setting)
  * Example:
  * #define BPS_TREE_BLOCK_SIZE 512
+ *
+ * If left undefined, the block size is derived from the element
+ * size, scaling the 512-bytes-per-8-byte-element geometry above:
+ * a leaf keeps a fanout of several dozen elements whether the
+ * element is a bare pointer or a wider struct, instead of the
+ * fanout silently degrading as the element grows. The result is
+ * a compile-time constant of the instantiation, like an
+ * explicitly defined size.
  */
 #ifndef BPS_TREE_BLOCK_SIZE
-#error "BPS_TREE_BLOCK_SIZE must be defined"
+#define BPS_TREE_BLOCK_SIZE \
+	(sizeof(bps_tree_elem_t) <= 8 ? 512 : \
+	 sizeof(bps_tree_elem_t) <= 16 ? 1024 : 2048)
 #endif
 
 /**
@@ -356,6 +368,9 @@ typedef uint32_t bps_tree_block_id_t;
 #define bps_tree_iterator_first _api_name(iterator_first)
 #define bps_tree_iterator_last _api_name(iterator_last)
 #define bps_tree_lower_bound _api_name(lower_bound)
+#define bps_tree_leaf_hint _api_name(leaf_hint)
+#define bps_tree_invalid_leaf_hint _api_name(invalid_leaf_hint)
+#define bps_tree_lower_bound_hinted _api_name(lower_bound_hinted)
 #define bps_tree_upper_bound _api_name(upper_bound)
 #define bps_tree_approximate_count _api_name(approximate_count)
 #define bps_tree_iterator_get_elem _api_name(iterator_get_elem)
@@ -496,6 +511,12 @@ struct bps_tree {
 	size_t size;
 	/* Head of list of garbaged blocks */
 	bps_tree_block_id_t garbage_head_id;
+	/*
+	 * Modification counter, incremented on every insertion and
+	 * deletion. Used to check validity of leaf hints, see
+	 * struct bps_tree_leaf_hint.
+	 */
+	uint64_t version;
 	/* User-provided argument for comparator */
 	bps_tree_arg_t arg;
 	/* Copy of maximal element in tree. Used for beauty */
@@ -535,6 +556,21 @@ struct bps_tree_iterator {
 	struct matras_view view;
 };
 
+/**
+ * Opaque position token for resuming a search near a previous
+ * result. Filled by bps_tree_lower_bound_hinted; if the tree has
+ * not been modified since (checked by version), a following call
+ * can descend straight to the remembered leaf instead of starting
+ * from the root. Stale hints are detected and lead to a regular
+ * root descent, so a hint is never required to be fresh.
+ */
+struct bps_tree_leaf_hint {
+	/* ID of the leaf block the previous search ended in. -1 if unset */
+	bps_tree_block_id_t block_id;
+	/* Value of tree->version at the moment the hint was taken */
+	uint64_t version;
+};
+
 /**
  * Pointer to function that allocates extent of size BPS_TREE_EXTENT_SIZE
  * BPS-tree properly handles with NULL result but could leak memory
@@ -701,6 +737,31 @@ static inline struct bps_tree_iterator
 bps_tree_lower_bound(const struct bps_tree *tree, bps_tree_key_t key,
 		     bool *exact);
 
+/**
+ * @brief Get a leaf hint that does not point anywhere. A search with
+ *  such a hint degrades to a regular root descent.
+ * @return - Invalid leaf hint
+ */
+static inline struct bps_tree_leaf_hint
+bps_tree_invalid_leaf_hint();
+
+/**
+ * @brief Same as bps_tree_lower_bound, but tries to resume from the
+ *  leaf remembered in the hint before descending from the root.
+ *  The hint is updated to the leaf the search ended in, so a series
+ *  of searches for close keys pays for one descent only.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @param exact - pointer to a bool value, that will be set to true if
+ *  and element pointed by the iterator is equal to the key, false otherwise
+ *  Pass NULL if you don't need that info.
+ * @param hint - in/out position token, see struct bps_tree_leaf_hint
+ * @return - Lower-bound iterator. Invalid if all elements are less than key.
+ */
+static inline struct bps_tree_iterator
+bps_tree_lower_bound_hinted(const struct bps_tree *tree, bps_tree_key_t key,
+			    bool *exact, struct bps_tree_leaf_hint *hint);
+
 /**
  * @brief Get an iterator to the first element that is greater than key
  * @param tree - pointer to a tree
@@ -1013,6 +1074,7 @@ bps_tree_create(struct bps_tree *tree, bps_tree_arg_t arg,
 	tree->depth = 0;
 	tree->size = 0;
 	tree->garbage_head_id = (bps_tree_block_id_t)(-1);
+	tree->version = 0;
 	tree->arg = arg;
 	memset(&tree->max_elem, 0, sizeof(tree->max_elem));
 
@@ -1050,6 +1112,7 @@ bps_tree_build(struct bps_tree *tree, bps_tree_elem_t *sorted_array,
 	assert(tree->root_id == (bps_tree_block_id_t)(-1));
 	assert(tree->garbage_head_id == (bps_tree_block_id_t)(-1));
 	assert(tree->matras.head.block_count == 0);
+	tree->version++;
 	if (array_size == 0)
 		return 0;
 	bps_tree_block_id_t leaf_count = (array_size +
@@ -1608,6 +1671,71 @@ bps_tree_lower_bound(const struct bps_tree *tree, bps_tree_key_t key,
 	return res;
 }
 
+/**
+ * @brief Get a leaf hint that does not point anywhere. A search with
+ *  such a hint degrades to a regular root descent.
+ * @return - Invalid leaf hint
+ */
+static inline struct bps_tree_leaf_hint
+bps_tree_invalid_leaf_hint()
+{
+	struct bps_tree_leaf_hint hint;
+	hint.block_id = (bps_tree_block_id_t)(-1);
+	hint.version = 0;
+	return hint;
+}
+
+/**
+ * @brief Same as bps_tree_lower_bound, but tries to resume from the
+ *  leaf remembered in the hint before descending from the root.
+ *  The hint may be used only if the tree version has not changed
+ *  since it was taken and the key falls strictly inside the hinted
+ *  leaf: the first element of the leaf must be strictly less than
+ *  the key, otherwise the answer (the first of possibly several
+ *  equal elements) could live in a preceding leaf.
+ * @param tree - pointer to a tree
+ * @param key - key that will be compared with elements
+ * @param exact - pointer to a bool value, that will be set to true if
+ *  and element pointed by the iterator is equal to the key, false otherwise
+ *  Pass NULL if you don't need that info.
+ * @param hint - in/out position token, see struct bps_tree_leaf_hint
+ * @return - Lower-bound iterator. Invalid if all elements are less than key.
+ */
+static inline struct bps_tree_iterator
+bps_tree_lower_bound_hinted(const struct bps_tree *tree, bps_tree_key_t key,
+			    bool *exact, struct bps_tree_leaf_hint *hint)
+{
+	if (hint->block_id != (bps_tree_block_id_t)(-1) &&
+	    hint->version == tree->version) {
+		struct bps_block *block =
+			bps_tree_restore_block(tree, hint->block_id);
+		assert(block->type == BPS_TREE_BT_LEAF);
+		struct bps_leaf *leaf = (struct bps_leaf *)block;
+		if (leaf->header.size > 0 &&
+		    BPS_TREE_COMPARE_KEY(leaf->elems[0], key,
+					 tree->arg) < 0 &&
+		    BPS_TREE_COMPARE_KEY(leaf->elems[leaf->header.size - 1],
+					 key, tree->arg) >= 0) {
+			struct bps_tree_iterator res;
+			matras_head_read_view(&res.view);
+			bool local_result;
+			if (!exact)
+				exact = &local_result;
+			*exact = false;
+			res.block_id = hint->block_id;
+			res.pos = bps_tree_find_ins_point_key(tree,
+							      leaf->elems,
+							      leaf->header.size,
+							      key, exact);
+			return res;
+		}
+	}
+	struct bps_tree_iterator res = bps_tree_lower_bound(tree, key, exact);
+	hint->block_id = res.block_id;
+	hint->version = tree->version;
+	return res;
+}
+
 /**
  * @brief Get an iterator to the first element that is greater than key
  * @param tree - pointer to a tree
@@ -4155,6 +4283,7 @@ static inline int
 bps_tree_insert(struct bps_tree *tree, bps_tree_elem_t new_elem,
 			   bps_tree_elem_t *replaced)
 {
+	tree->version++;
 	if (tree->root_id == (bps_tree_block_id_t)(-1))
 		return bps_tree_insert_first_elem(tree, new_elem);
 
@@ -4191,6 +4320,7 @@ bps_tree_delete(struct bps_tree *tree, bps_tree_elem_t elem)
 	if (!exact)
 		return -1;
 
+	tree->version++;
 	bps_tree_process_delete_leaf(tree, &leaf_path_elem);
 	return 0;
 }
@@ -5721,6 +5851,9 @@ bps_tree_debug_check_internal_functions(bool assertme)
 #undef bps_tree_iterator_first
 #undef bps_tree_iterator_last
 #undef bps_tree_lower_bound
+#undef bps_tree_leaf_hint
+#undef bps_tree_invalid_leaf_hint
+#undef bps_tree_lower_bound_hinted
 #undef bps_tree_upper_bound
 #undef bps_tree_approximate_count
 #undef bps_tree_iterator_get_elem
@@ -0,0 +1,344 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "frozen_set.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bit/bit.h"
+
+enum {
+	/** One select sample per this many ones (or zeros). */
+	FROZEN_SET_SAMPLE_RATE = 64
+};
+
+/** The largest high bucket number present in the set. */
+static inline uint64_t
+frozen_set_max_high(const struct frozen_set *set)
+{
+	return set->high_bit_count - set->count - 1;
+}
+
+/** Extract the low bits of value number index. */
+static inline uint64_t
+frozen_set_low(const struct frozen_set *set, uint64_t index)
+{
+	uint32_t width = set->low_width;
+	if (width == 0)
+		return 0;
+	uint64_t bit = index * width;
+	uint64_t word = bit / 64;
+	uint32_t shift = bit % 64;
+	uint64_t res = set->lows[word] >> shift;
+	if (shift + width > 64)
+		res |= set->lows[word + 1] << (64 - shift);
+	return res & (((uint64_t) 1 << width) - 1);
+}
+
+/** Pack the low bits of value number index, zeroed beforehand. */
+static inline void
+frozen_set_low_set(struct frozen_set *set, uint64_t index, uint64_t low)
+{
+	uint32_t width = set->low_width;
+	if (width == 0)
+		return;
+	uint64_t bit = index * width;
+	uint64_t word = bit / 64;
+	uint32_t shift = bit % 64;
+	set->lows[word] |= low << shift;
+	if (shift + width > 64)
+		set->lows[word + 1] |= low >> (64 - shift);
+}
+
+/** Find the position of the r-th (from 0) one in a word. */
+static inline uint64_t
+frozen_set_word_select(uint64_t word, uint64_t r)
+{
+	while (r-- > 0)
+		word &= word - 1;
+	return bit_ctz_u64(word);
+}
+
+/** Bit position of the k-th (from 0) one in the high bit vector. */
+static inline uint64_t
+frozen_set_select_one(const struct frozen_set *set, uint64_t k)
+{
+	assert(k < set->count);
+	uint64_t p = set->one_samples[k / FROZEN_SET_SAMPLE_RATE];
+	uint64_t r = k % FROZEN_SET_SAMPLE_RATE;
+	uint64_t w = p / 64;
+	uint64_t word = set->highs[w] & (~(uint64_t) 0 << p % 64);
+	for (;;) {
+		uint64_t ones = bit_count_u64(word);
+		if (r < ones)
+			return w * 64 + frozen_set_word_select(word, r);
+		r -= ones;
+		word = set->highs[++w];
+	}
+}
+
+/** Bit position of the k-th (from 0) zero in the high bit vector. */
+static inline uint64_t
+frozen_set_select_zero(const struct frozen_set *set, uint64_t k)
+{
+	assert(k <= frozen_set_max_high(set));
+	uint64_t p = set->zero_samples[k / FROZEN_SET_SAMPLE_RATE];
+	uint64_t r = k % FROZEN_SET_SAMPLE_RATE;
+	uint64_t w = p / 64;
+	uint64_t word = ~set->highs[w] & (~(uint64_t) 0 << p % 64);
+	for (;;) {
+		uint64_t zeros = bit_count_u64(word);
+		if (r < zeros)
+			return w * 64 + frozen_set_word_select(word, r);
+		r -= zeros;
+		word = ~set->highs[++w];
+	}
+}
+
+/**
+ * Ranks of the first value in high bucket h and of the first
+ * value after it.
+ */
+static inline void
+frozen_set_bucket(const struct frozen_set *set, uint64_t h,
+		  uint64_t *start, uint64_t *end)
+{
+	*start = h == 0 ? 0 : frozen_set_select_zero(set, h - 1) - (h - 1);
+	*end = frozen_set_select_zero(set, h) - h;
+}
+
+/**
+ * Rank of the first value in bucket h whose low bits are >= low,
+ * a binary search in [start, end).
+ */
+static inline uint64_t
+frozen_set_bucket_lower_bound(const struct frozen_set *set, uint64_t start,
+			      uint64_t end, uint64_t low)
+{
+	while (start < end) {
+		uint64_t mid = start + (end - start) / 2;
+		if (frozen_set_low(set, mid) < low)
+			start = mid + 1;
+		else
+			end = mid;
+	}
+	return start;
+}
+
+int
+frozen_set_create(struct frozen_set *set, const uint64_t *values,
+		  uint64_t count)
+{
+	memset(set, 0, sizeof(*set));
+	set->count = count;
+	if (count == 0)
+		return 0;
+	uint64_t max = values[count - 1];
+	/*
+	 * The optimal number of explicitly stored low bits is
+	 * log2(universe / count) rounded down.
+	 */
+	uint32_t width = 0;
+	if (max / count >= 2)
+		width = 63 - bit_clz_u64(max / count);
+	set->low_width = width;
+	uint64_t max_high = max >> width;
+	set->high_bit_count = count + max_high + 1;
+
+	uint64_t low_words = width == 0 ? 0 : (count * width + 63) / 64 + 1;
+	uint64_t high_words = (set->high_bit_count + 63) / 64;
+	uint64_t one_samples = (count - 1) / FROZEN_SET_SAMPLE_RATE + 1;
+	uint64_t zero_samples = max_high / FROZEN_SET_SAMPLE_RATE + 1;
+	if (low_words != 0) {
+		set->lows = (uint64_t *) calloc(low_words, sizeof(uint64_t));
+		if (set->lows == NULL)
+			goto error;
+	}
+	set->highs = (uint64_t *) calloc(high_words, sizeof(uint64_t));
+	set->one_samples = (uint64_t *) malloc(one_samples *
+					       sizeof(uint64_t));
+	set->zero_samples = (uint64_t *) malloc(zero_samples *
+						sizeof(uint64_t));
+	if (set->highs == NULL || set->one_samples == NULL ||
+	    set->zero_samples == NULL)
+		goto error;
+
+	for (uint64_t i = 0; i < count; i++) {
+		assert(i == 0 || values[i - 1] < values[i]);
+		uint64_t pos = (values[i] >> width) + i;
+		set->highs[pos / 64] |= (uint64_t) 1 << pos % 64;
+		frozen_set_low_set(set, i,
+				   values[i] & (((uint64_t) 1 << width) - 1));
+	}
+	/*
+	 * Pad the last high word with ones so that the padding
+	 * is never taken for zeros by the zero select.
+	 */
+	for (uint64_t pos = set->high_bit_count; pos < high_words * 64; pos++)
+		set->highs[pos / 64] |= (uint64_t) 1 << pos % 64;
+
+	uint64_t n_ones = 0;
+	uint64_t n_zeros = 0;
+	for (uint64_t pos = 0; pos < set->high_bit_count; pos++) {
+		if (set->highs[pos / 64] & ((uint64_t) 1 << pos % 64)) {
+			if (n_ones % FROZEN_SET_SAMPLE_RATE == 0)
+				set->one_samples[n_ones /
+					FROZEN_SET_SAMPLE_RATE] = pos;
+			n_ones++;
+		} else {
+			if (n_zeros % FROZEN_SET_SAMPLE_RATE == 0)
+				set->zero_samples[n_zeros /
+					FROZEN_SET_SAMPLE_RATE] = pos;
+			n_zeros++;
+		}
+	}
+	assert(n_ones == count && n_zeros == max_high + 1);
+	return 0;
+error:
+	frozen_set_destroy(set);
+	return -1;
+}
+
+void
+frozen_set_destroy(struct frozen_set *set)
+{
+	free(set->lows);
+	free(set->highs);
+	free(set->one_samples);
+	free(set->zero_samples);
+	memset(set, 0, sizeof(*set));
+}
+
+bool
+frozen_set_contains(const struct frozen_set *set, uint64_t value)
+{
+	if (set->count == 0)
+		return false;
+	uint64_t high = value >> set->low_width;
+	if (high > frozen_set_max_high(set))
+		return false;
+	uint64_t low = value & (((uint64_t) 1 << set->low_width) - 1);
+	uint64_t start, end;
+	frozen_set_bucket(set, high, &start, &end);
+	uint64_t i = frozen_set_bucket_lower_bound(set, start, end, low);
+	return i < end && frozen_set_low(set, i) == low;
+}
+
+uint64_t
+frozen_set_get(const struct frozen_set *set, uint64_t index)
+{
+	assert(index < set->count);
+	uint64_t high = frozen_set_select_one(set, index) - index;
+	return (high << set->low_width) | frozen_set_low(set, index);
+}
+
+/**
+ * Rank of the smallest stored value >= the given one,
+ * or count if there is none.
+ */
+static uint64_t
+frozen_set_lower_bound(const struct frozen_set *set, uint64_t value)
+{
+	if (set->count == 0)
+		return 0;
+	uint64_t high = value >> set->low_width;
+	if (high > frozen_set_max_high(set))
+		return set->count;
+	uint64_t low = value & (((uint64_t) 1 << set->low_width) - 1);
+	uint64_t start, end;
+	frozen_set_bucket(set, high, &start, &end);
+	uint64_t i = frozen_set_bucket_lower_bound(set, start, end, low);
+	/*
+	 * Ranks are ordered by value, so when the bucket has no
+	 * low bits >= low, the answer is the first value of the
+	 * next non-empty bucket, which has the next rank.
+	 */
+	return i;
+}
+
+int
+frozen_set_next(const struct frozen_set *set, uint64_t value,
+		uint64_t *result)
+{
+	uint64_t i = frozen_set_lower_bound(set, value);
+	if (i == set->count)
+		return -1;
+	*result = frozen_set_get(set, i);
+	return 0;
+}
+
+size_t
+frozen_set_memsize(const struct frozen_set *set)
+{
+	if (set->count == 0)
+		return 0;
+	uint64_t count = set->count;
+	uint32_t width = set->low_width;
+	uint64_t low_words = width == 0 ? 0 : (count * width + 63) / 64 + 1;
+	uint64_t high_words = (set->high_bit_count + 63) / 64;
+	uint64_t one_samples = (count - 1) / FROZEN_SET_SAMPLE_RATE + 1;
+	uint64_t zero_samples = frozen_set_max_high(set) /
+				FROZEN_SET_SAMPLE_RATE + 1;
+	return (low_words + high_words + one_samples + zero_samples) *
+	       sizeof(uint64_t);
+}
+
+void
+frozen_set_iterator_init(const struct frozen_set *set,
+			 struct frozen_set_iterator *it,
+			 uint64_t first_value)
+{
+	it->set = set;
+	it->index = frozen_set_lower_bound(set, first_value);
+	it->high_pos = it->index < set->count ?
+		       frozen_set_select_one(set, it->index) : 0;
+}
+
+int
+frozen_set_iterator_next(struct frozen_set_iterator *it, uint64_t *value)
+{
+	const struct frozen_set *set = it->set;
+	if (it->index >= set->count)
+		return -1;
+	uint64_t high = it->high_pos - it->index;
+	*value = (high << set->low_width) | frozen_set_low(set, it->index);
+	it->index++;
+	if (it->index < set->count) {
+		/* Skip to the next one in the high bit vector. */
+		uint64_t p = it->high_pos + 1;
+		uint64_t w = p / 64;
+		uint64_t word = set->highs[w] & (~(uint64_t) 0 << p % 64);
+		while (word == 0)
+			word = set->highs[++w];
+		it->high_pos = w * 64 + bit_ctz_u64(word);
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef TARANTOOL_LIB_SALAD_FROZEN_SET_H_INCLUDED
+#define TARANTOOL_LIB_SALAD_FROZEN_SET_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * Frozen set - a static sorted set of 64 bit unsigned integers
+ * in Elias-Fano encoding.
+ *
+ * The set is built once from a sorted array of unique values and
+ * is immutable afterwards. Each value is split into low bits,
+ * stored verbatim in a packed array, and high bits, stored in
+ * unary code in a bit vector. With n values from a universe of
+ * size u the structure takes about n * (2 + log2(u / n)) bits
+ * plus a small select index - for dense sets of integer
+ * identifiers that is an order of magnitude less than a hash or
+ * a tree per-entry overhead.
+ *
+ * Supported queries: membership, access by rank, successor
+ * (the smallest stored value >= a given one) and ordered
+ * iteration from an arbitrary start value. Membership and
+ * successor cost a select on the high bit vector plus a binary
+ * search within one high bucket, O(1) on average.
+ */
+struct frozen_set {
+	/** Number of values in the set. */
+	uint64_t count;
+	/** Number of low bits stored in the packed array. */
+	uint32_t low_width;
+	/** Packed array of count * low_width low bits. */
+	uint64_t *lows;
+	/**
+	 * High bits in unary code: value number i sets bit
+	 * (highs(i) + i), so ones stand for values and the h-th
+	 * zero terminates high bucket h.
+	 */
+	uint64_t *highs;
+	/** Size of highs in bits. */
+	uint64_t high_bit_count;
+	/** Position of every FROZEN_SET_SAMPLE_RATE-th one. */
+	uint64_t *one_samples;
+	/** Position of every FROZEN_SET_SAMPLE_RATE-th zero. */
+	uint64_t *zero_samples;
+};
+
+/** An iterator over a frozen set, in ascending value order. */
+struct frozen_set_iterator {
+	/** The set this iterator is for. */
+	const struct frozen_set *set;
+	/** Rank of the next value to return. */
+	uint64_t index;
+	/** Bit position in highs of the next value. */
+	uint64_t high_pos;
+};
+
+/**
+ * Build a set from a sorted array of unique values.
+ * The source array is not referenced after return.
+ *
+ * @retval  0 success
+ * @retval -1 memory error
+ */
+int
+frozen_set_create(struct frozen_set *set, const uint64_t *values,
+		  uint64_t count);
+
+/**
+ * Free a set. A set is not usable after destruction.
+ */
+void
+frozen_set_destroy(struct frozen_set *set);
+
+/**
+ * Check if a value is in the set.
+ */
+bool
+frozen_set_contains(const struct frozen_set *set, uint64_t value);
+
+/**
+ * Get a value by its rank. The index must be less than count.
+ */
+uint64_t
+frozen_set_get(const struct frozen_set *set, uint64_t index);
+
+/**
+ * Find the smallest stored value which is >= the given one.
+ *
+ * @retval  0 found, *result is set
+ * @retval -1 no such value
+ */
+int
+frozen_set_next(const struct frozen_set *set, uint64_t value,
+		uint64_t *result);
+
+/**
+ * Memory taken by the set, not including struct frozen_set.
+ */
+size_t
+frozen_set_memsize(const struct frozen_set *set);
+
+/**
+ * Position an iterator on the smallest stored value >= first_value.
+ * Use first_value = 0 for a full scan.
+ */
+void
+frozen_set_iterator_init(const struct frozen_set *set,
+			 struct frozen_set_iterator *it,
+			 uint64_t first_value);
+
+/**
+ * Fetch the next value of an iterator.
+ *
+ * @retval  0 *value is set
+ * @retval -1 the iterator is exhausted
+ */
+int
+frozen_set_iterator_next(struct frozen_set_iterator *it, uint64_t *value);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_LIB_SALAD_FROZEN_SET_H_INCLUDED */
@@ -107,6 +107,17 @@
 
 /**
  * Struct for one record of the hash table
+ *
+ * Note on the layout: dropping the cached hash (e.g. for
+ * fixed-width integer keys whose hash is cheap to recompute) does
+ * not reduce the footprint of the table. Records are allocated
+ * from a matras, which requires a power-of-two block size, so a
+ * 12-byte {next, value} record would still occupy a 16-byte
+ * block. The 4 bytes of the hash are also reused as the 'prev'
+ * link of the doubly-linked list of empty records, which insert()
+ * needs for O(1) detachment of an arbitrary empty slot. A genuine
+ * reduction would require splitting the table into parallel
+ * next[]/value[] arrays, i.e. a different data structure.
  */
 struct LIGHT(record) {
 	/* hash of a value */
@@ -132,7 +143,8 @@ struct LIGHT(core) {
 	uint32_t table_size;
 	/*
 	 * cover is power of two;
-	 * if count is positive, then cover/2 < count <= cover
+	 * if count is positive and the table was never reserved
+	 * ahead of the inserts, then cover/2 < count <= cover
 	 * cover_mask is cover - 1
 	 */
 	uint32_t cover_mask;
@@ -216,6 +228,16 @@ LIGHT(find)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_DATA_TYPE data);
 uint32_t
 LIGHT(find_key)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_KEY_TYPE data);
 
+/**
+ * @brief Prefetch the head record of the collision chain of a hash.
+ * Useful before a batch of LIGHT(find_key) calls: issuing prefetches
+ * for all hashes first overlaps the cache misses of independent probes.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is about to be searched
+ */
+void
+LIGHT(prefetch)(const struct LIGHT(core) *ht, uint32_t hash);
+
 /**
  * @brief Insert a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -226,6 +248,22 @@ LIGHT(find_key)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_KEY_TYPE data
 uint32_t
 LIGHT(insert)(struct LIGHT(core) *ht, uint32_t hash, LIGHT_DATA_TYPE data);
 
+/**
+ * @brief Pre-size the table for an expected number of records.
+ * Runs the incremental growth steps upfront, so a bulk load of up
+ * to that many records never grows the table from insert() - the
+ * chain splitting work and its latency spike move here, where the
+ * caller expects them (index build, alter). Lookups are valid
+ * throughout: growth splits one chain at a time and probe
+ * sequences stay stable. Does nothing if the table is already
+ * large enough.
+ * @param ht - pointer to a hash table struct
+ * @param count - expected total number of records
+ * @return 0 on success, -1 on memory error
+ */
+int
+LIGHT(reserve)(struct LIGHT(core) *ht, uint32_t count);
+
 /**
  * @brief Replace a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -440,6 +478,22 @@ LIGHT(find_key)(const struct LIGHT(core) *ht, uint32_t hash, LIGHT_KEY_TYPE key)
 	return LIGHT(end);
 }
 
+/**
+ * @brief Prefetch the head record of the collision chain of a hash.
+ * Useful before a batch of LIGHT(find_key) calls: issuing prefetches
+ * for all hashes first overlaps the cache misses of independent probes.
+ * @param ht - pointer to a hash table struct
+ * @param hash - hash that is about to be searched
+ */
+inline void
+LIGHT(prefetch)(const struct LIGHT(core) *ht, uint32_t hash)
+{
+	if (ht->count == 0)
+		return;
+	uint32_t slot = LIGHT(slot)(ht, hash);
+	__builtin_prefetch(matras_get(&ht->mtable, slot), 0);
+}
+
 /**
  * @brief Replace a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -645,7 +699,12 @@ LIGHT(prepare_first_insert)(struct LIGHT(core) *ht)
 inline int
 LIGHT(grow)(struct LIGHT(core) *ht)
 {
-	assert(ht->empty_slot == LIGHT(end));
+	/*
+	 * insert() grows only when the empty list is exhausted,
+	 * but reserve() calls here while free slots remain - the
+	 * splitting below never looks at the empty list, it only
+	 * appends to it.
+	 */
 	uint32_t new_slot;
 	struct LIGHT(record) *new_record = (struct LIGHT(record) *)
 		matras_alloc_range(&ht->mtable, &new_slot, ht->GROW_INCREMENT);
@@ -739,6 +798,27 @@ LIGHT(grow)(struct LIGHT(core) *ht)
 	return 0;
 }
 
+/**
+ * @brief Pre-size the table for an expected number of records.
+ * See the declaration above for details.
+ * @param ht - pointer to a hash table struct
+ * @param count - expected total number of records
+ * @return 0 on success, -1 on memory error
+ */
+inline int
+LIGHT(reserve)(struct LIGHT(core) *ht, uint32_t count)
+{
+	if (count == 0)
+		return 0;
+	if (ht->table_size == 0 && LIGHT(prepare_first_insert)(ht))
+		return -1;
+	/* Every slot of the table can hold one record. */
+	while (ht->table_size < count)
+		if (LIGHT(grow)(ht))
+			return -1;
+	return 0;
+}
+
 /**
  * @brief Insert a record with given hash and value
  * @param ht - pointer to a hash table struct
@@ -0,0 +1,444 @@
+/*
+ * *No header guard*: the header is allowed to be included twice
+ * with different sets of defines.
+ */
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+/*
+ * An open addressing hash table with Robin Hood linear probing
+ * and backward-shift deletion. The macro protocol is the same as
+ * in salad/mhash.h (mh_name, mh_node_t, mh_hash, mh_cmp and,
+ * optionally, mh_key_t, mh_hash_key, mh_cmp_key), the API
+ * surface mirrors mhash as well, so a map can be moved from one
+ * implementation to the other with a search and replace.
+ *
+ * Compared to mhash:
+ * - probing is linear, but every displaced node is kept no
+ *   further from its home bucket than any node it displaced
+ *   (Robin Hood invariant), which keeps the probe sequences
+ *   short and lookups cache friendly even close to the maximal
+ *   load;
+ * - deletion shifts the following chain one slot back instead
+ *   of leaving a tombstone, so the table never degrades from
+ *   delete/insert churn and never needs a rehash to clean up;
+ * - the maximal load factor is configurable per instantiation
+ *   with mh_rh_density (a double in (0, 1), 0.85 by default);
+ * - there is no incremental resize: a full rehash is done when
+ *   the load factor is exceeded. Use it for metadata-sized maps
+ *   (schema, function caches), not for gigabyte data sets.
+ *
+ * A slot index returned by find()/get()/put() is invalidated by
+ * any following put() or del(): both insertion and deletion can
+ * move unrelated nodes around.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <trivia/util.h>
+
+#define mh_cat(a, b) mh##a##_##b
+#define mh_ecat(a, b) mh_cat(a, b)
+#define _mh(x) mh_ecat(mh_name, x)
+
+#define mh_unlikely(x)  __builtin_expect((x),0)
+
+#ifndef MH_TYPEDEFS
+#define MH_TYPEDEFS 1
+typedef uint32_t mh_int_t;
+#endif /* MH_TYPEDEFS */
+
+#ifndef mh_rh_density
+#define mh_rh_density 0.85
+#endif
+
+#ifndef MH_RH_HEADER
+#define MH_RH_HEADER
+
+struct _mh(t) {
+	/* Node table */
+	mh_node_t *p;
+	/* Cached node hashes */
+	mh_int_t *h;
+	/* Occupancy bitmap, one bit per bucket */
+	uint32_t *b;
+	/* Number of buckets, always a power of two */
+	mh_int_t n_buckets;
+	mh_int_t size;
+	mh_int_t upper_bound;
+	mh_int_t resize_cnt;
+};
+
+#define mh_rh_exist(h, i)	({ (h)->b[(i) >> 5] & (1u << ((i) % 32)); })
+#define mh_rh_setexist(h, i)	({ (h)->b[(i) >> 5] |= (1u << ((i) % 32)); })
+#define mh_rh_setfree(h, i)	({ (h)->b[(i) >> 5] &= ~(1u << ((i) % 32)); })
+
+#define mh_rh_node(h, i)	((const mh_node_t *) &((h)->p[(i)]))
+#define mh_rh_size(h)		({ (h)->size;		})
+#define mh_rh_capacity(h)	({ (h)->n_buckets;	})
+#define mh_rh_begin(h)		({ 0;			})
+#define mh_rh_end(h)		({ (h)->n_buckets;	})
+
+/* Distance of bucket i from the home bucket of hash k. */
+#define mh_rh_dist(i, k, mask)	(((i) - ((k) & (mask))) & (mask))
+
+#define mh_rh_first(h) ({					\
+	mh_int_t i;						\
+	for (i = 0; i < mh_rh_end(h); i++) {			\
+		if (mh_rh_exist(h, i))				\
+			break;					\
+	}							\
+	i;							\
+})
+
+#define mh_rh_next(h, i) ({					\
+	mh_int_t n = i;						\
+	if (n < mh_rh_end(h)) {					\
+		for (n = i + 1; n < mh_rh_end(h); n++) {	\
+			if (mh_rh_exist(h, n))			\
+				break;				\
+		}						\
+	}							\
+	n;							\
+})
+
+#define mh_rh_foreach(h, i) \
+	for (i = mh_rh_first(h); i < mh_rh_end(h); i = mh_rh_next(h, i))
+
+struct _mh(t) * _mh(new)();
+void _mh(clear)(struct _mh(t) *h);
+void _mh(delete)(struct _mh(t) *h);
+int _mh(rehash)(struct _mh(t) *h, mh_int_t buckets, mh_arg_t arg);
+int _mh(reserve)(struct _mh(t) *h, mh_int_t size, mh_arg_t arg);
+size_t _mh(memsize)(struct _mh(t) *h);
+
+static inline mh_node_t *
+_mh(node)(struct _mh(t) *h, mh_int_t x)
+{
+	return (mh_node_t *) &(h->p[x]);
+}
+
+#if defined(mh_hash_key) && defined(mh_cmp_key)
+/**
+ * If it is necessary to search by something different
+ * than a hash node, define mh_hash_key and mh_cmp_key
+ * and use mh_find().
+ */
+static inline mh_int_t
+_mh(find)(struct _mh(t) *h, mh_key_t key, mh_arg_t arg)
+{
+	(void) arg;
+
+	mh_int_t mask = h->n_buckets - 1;
+	mh_int_t k = mh_hash_key(key, arg);
+	mh_int_t i = k & mask;
+	mh_int_t dist = 0;
+	for (;;) {
+		if (!mh_rh_exist(h, i))
+			return h->n_buckets;
+		if (h->h[i] == k && !mh_cmp_key(key, mh_rh_node(h, i), arg))
+			return i;
+		/*
+		 * The resident is closer to its home bucket than
+		 * we are to ours: the Robin Hood invariant
+		 * guarantees the key is not in the table.
+		 */
+		if (mh_rh_dist(i, h->h[i], mask) < dist)
+			return h->n_buckets;
+		i = (i + 1) & mask;
+		dist++;
+	}
+}
+#endif
+
+static inline mh_int_t
+_mh(get)(struct _mh(t) *h, const mh_node_t *node, mh_arg_t arg)
+{
+	(void) arg;
+
+	mh_int_t mask = h->n_buckets - 1;
+	mh_int_t k = mh_hash(node, arg);
+	mh_int_t i = k & mask;
+	mh_int_t dist = 0;
+	for (;;) {
+		if (!mh_rh_exist(h, i))
+			return h->n_buckets;
+		if (h->h[i] == k && !mh_cmp(node, mh_rh_node(h, i), arg))
+			return i;
+		if (mh_rh_dist(i, h->h[i], mask) < dist)
+			return h->n_buckets;
+		i = (i + 1) & mask;
+		dist++;
+	}
+}
+
+static inline mh_int_t
+_mh(put_slot)(struct _mh(t) *h, const mh_node_t *node, int *exist,
+	      mh_arg_t arg)
+{
+	(void) arg;
+
+	mh_int_t mask = h->n_buckets - 1;
+	mh_int_t k = mh_hash(node, arg);
+	mh_node_t cur = *node;
+	mh_int_t cur_hash = k;
+	mh_int_t i = k & mask;
+	mh_int_t dist = 0;
+	/* Bucket where the new node has landed. */
+	mh_int_t res = h->n_buckets;
+
+	*exist = 0;
+	for (;;) {
+		if (!mh_rh_exist(h, i)) {
+			h->p[i] = cur;
+			h->h[i] = cur_hash;
+			mh_rh_setexist(h, i);
+			h->size++;
+			return res == h->n_buckets ? i : res;
+		}
+		/*
+		 * A duplicate, if any, shares the home bucket
+		 * with the new node and thus is met while we are
+		 * still carrying it, before any swap can happen.
+		 */
+		if (res == h->n_buckets && h->h[i] == k &&
+		    !mh_cmp(node, mh_rh_node(h, i), arg)) {
+			*exist = 1;
+			return i;
+		}
+		mh_int_t res_dist = mh_rh_dist(i, h->h[i], mask);
+		if (res_dist < dist) {
+			/*
+			 * Rob the rich: displace the resident
+			 * which is closer to its home bucket and
+			 * carry it further down instead.
+			 */
+			mh_node_t tmp_node = h->p[i];
+			mh_int_t tmp_hash = h->h[i];
+			h->p[i] = cur;
+			h->h[i] = cur_hash;
+			if (res == h->n_buckets)
+				res = i;
+			cur = tmp_node;
+			cur_hash = tmp_hash;
+			dist = res_dist;
+		}
+		i = (i + 1) & mask;
+		dist++;
+	}
+}
+
+/**
+ * Find a node in the hash and replace it with a new value.
+ * Save the old node in ret pointer, if it is provided.
+ * If the old node didn't exist, just insert the new node.
+ *
+ * @retval != mh_rh_end() pos of the new node, ret is either NULL
+ *                        or copy of the old node
+ * @retval mh_rh_end()    out of memory, ret is unchanged.
+ */
+static inline mh_int_t
+_mh(put)(struct _mh(t) *h, const mh_node_t *node, mh_node_t **ret,
+	 mh_arg_t arg)
+{
+	if (mh_unlikely(h->size >= h->upper_bound)) {
+		if (_mh(rehash)(h, h->n_buckets << 1, arg) != 0)
+			return mh_rh_end(h);
+	}
+	int exist;
+	mh_int_t x = _mh(put_slot)(h, node, &exist, arg);
+	if (ret) {
+		if (exist)
+			memcpy(*ret, &(h->p[x]), sizeof(mh_node_t));
+		else
+			*ret = NULL;
+	}
+	if (exist)
+		memcpy(&(h->p[x]), node, sizeof(mh_node_t));
+	return x;
+}
+
+static inline void
+_mh(del)(struct _mh(t) *h, mh_int_t x, mh_arg_t arg)
+{
+	(void) arg;
+
+	if (x == h->n_buckets || !mh_rh_exist(h, x))
+		return;
+	mh_int_t mask = h->n_buckets - 1;
+	mh_int_t i = x;
+	/*
+	 * Shift the following chain one bucket back until a hole
+	 * or a node sitting in its home bucket: no tombstones.
+	 */
+	for (;;) {
+		mh_int_t n = (i + 1) & mask;
+		if (!mh_rh_exist(h, n) || mh_rh_dist(n, h->h[n], mask) == 0)
+			break;
+		h->p[i] = h->p[n];
+		h->h[i] = h->h[n];
+		i = n;
+	}
+	mh_rh_setfree(h, i);
+	h->size--;
+}
+
+static inline void
+_mh(remove)(struct _mh(t) *h, const mh_node_t *node, mh_arg_t arg)
+{
+	mh_int_t k = _mh(get)(h, node, arg);
+	if (k != mh_rh_end(h))
+		_mh(del)(h, k, arg);
+}
+#endif
+
+#ifdef MH_SOURCE
+
+#ifndef MH_RH_INITIAL_BUCKETS
+#define MH_RH_INITIAL_BUCKETS 16
+#endif
+
+static int
+_mh(alloc)(struct _mh(t) *h, mh_int_t buckets)
+{
+	h->p = (mh_node_t *) malloc(buckets * sizeof(mh_node_t));
+	h->h = (mh_int_t *) malloc(buckets * sizeof(mh_int_t));
+	h->b = (uint32_t *) calloc(buckets / 32 + 1, sizeof(uint32_t));
+	if (h->p == NULL || h->h == NULL || h->b == NULL) {
+		free(h->p);
+		free(h->h);
+		free(h->b);
+		return -1;
+	}
+	h->n_buckets = buckets;
+	h->size = 0;
+	h->upper_bound = buckets * mh_rh_density;
+	return 0;
+}
+
+struct _mh(t) *
+_mh(new)()
+{
+	struct _mh(t) *h = (struct _mh(t) *) calloc(1, sizeof(*h));
+	if (h == NULL)
+		return NULL;
+	if (_mh(alloc)(h, MH_RH_INITIAL_BUCKETS) != 0) {
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+void
+_mh(clear)(struct _mh(t) *h)
+{
+	free(h->p);
+	free(h->h);
+	free(h->b);
+	_mh(alloc)(h, MH_RH_INITIAL_BUCKETS);
+}
+
+void
+_mh(delete)(struct _mh(t) *h)
+{
+	free(h->p);
+	free(h->h);
+	free(h->b);
+	free(h);
+}
+
+int
+_mh(rehash)(struct _mh(t) *h, mh_int_t buckets, mh_arg_t arg)
+{
+	struct _mh(t) old = *h;
+	if (buckets < MH_RH_INITIAL_BUCKETS)
+		buckets = MH_RH_INITIAL_BUCKETS;
+	if (_mh(alloc)(h, buckets) != 0) {
+		*h = old;
+		return -1;
+	}
+	int exist;
+	for (mh_int_t i = 0; i < old.n_buckets; i++) {
+		if (mh_rh_exist(&old, i))
+			_mh(put_slot)(h, mh_rh_node(&old, i), &exist, arg);
+	}
+	free(old.p);
+	free(old.h);
+	free(old.b);
+	h->resize_cnt = old.resize_cnt + 1;
+	return 0;
+}
+
+int
+_mh(reserve)(struct _mh(t) *h, mh_int_t size, mh_arg_t arg)
+{
+	mh_int_t buckets = MH_RH_INITIAL_BUCKETS;
+	while (buckets * mh_rh_density < size)
+		buckets <<= 1;
+	if (buckets <= h->n_buckets)
+		return 0;
+	return _mh(rehash)(h, buckets, arg);
+}
+
+/** Calculate hash size. */
+size_t
+_mh(memsize)(struct _mh(t) *h)
+{
+	return sizeof(struct _mh(t)) +
+	       h->n_buckets * sizeof(mh_node_t) +
+	       h->n_buckets * sizeof(mh_int_t) +
+	       (h->n_buckets / 32 + 1) * sizeof(uint32_t);
+}
+
+#endif
+
+#if defined(MH_SOURCE) || defined(MH_UNDEF)
+#undef MH_RH_HEADER
+#undef mh_node_t
+#undef mh_arg_t
+#undef mh_key_t
+#undef mh_name
+#undef mh_hash
+#undef mh_hash_key
+#undef mh_cmp
+#undef mh_cmp_key
+#undef mh_rh_node
+#undef mh_rh_setexist
+#undef mh_rh_setfree
+#undef mh_rh_dist
+#undef mh_unlikely
+#undef mh_rh_density
+#endif
+
+#undef mh_cat
+#undef mh_ecat
+#undef _mh
@@ -75,12 +75,16 @@ rope_relink(struct rope_node *node)
 static inline struct rope_node *
 rope_node_new(struct rope *rope, void *data, rope_size_t size)
 {
-	struct rope_node *node =
-		(struct rope_node *) rope->alloc(rope->alloc_ctx,
-						 sizeof(struct rope_node));
+	struct rope_node *node = rope->free_list;
 
-	if (node == NULL)
-		return NULL;
+	if (node != NULL) {
+		rope->free_list = node->link[0];
+	} else {
+		node = (struct rope_node *) rope->alloc(rope->alloc_ctx,
+							sizeof(struct rope_node));
+		if (node == NULL)
+			return NULL;
+	}
 
 	node->height = 1;
 	node->tree_size = node->leaf_size = size;
@@ -90,6 +94,18 @@ rope_node_new(struct rope *rope, void *data, rope_size_t size)
 	return node;
 }
 
+/**
+ * Return a deleted node to the node cache, where it can be
+ * picked up by the next rope_node_new(). Makes a delete + insert
+ * sequence of operations allocation-free.
+ */
+static inline void
+rope_node_recycle(struct rope *rope, struct rope_node *node)
+{
+	node->link[0] = rope->free_list;
+	rope->free_list = node;
+}
+
 void
 rope_clear(struct rope *rope)
 {
@@ -111,6 +127,12 @@ rope_clear(struct rope *rope)
 		it = save;
 	}
 	rope->root = NULL;
+	/* Return the cached nodes to the allocator as well. */
+	while (rope->free_list != NULL) {
+		save = rope->free_list;
+		rope->free_list = save->link[0];
+		rope->free(rope->alloc_ctx, save);
+	}
 }
 
 static struct rope_node *
@@ -502,7 +524,7 @@ rope_erase(struct rope *rope, rope_size_t offset)
 		direction = node->link[0] == NULL;
 	}
 	**p_end = node->link[direction];
-	rope->free(rope, node);
+	rope_node_recycle(rope, node);
 	avl_rebalance_after_delete(path, p_end);
 	return 0;
 }
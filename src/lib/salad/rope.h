@@ -63,6 +63,13 @@ struct rope_node {
 struct rope {
 	/** Top of the tree */
 	struct rope_node *root;
+	/**
+	 * A cache of freed nodes, linked through link[0]. Nodes
+	 * deleted by rope_erase() land here and are reused by the
+	 * next insertion or split instead of going back to the
+	 * allocator. Returned to the allocator by rope_clear().
+	 */
+	struct rope_node *free_list;
 	/** Memory management context. */
 	void *alloc_ctx;
 	/** Get a sequence tail, given offset. */
@@ -115,6 +122,7 @@ rope_create(struct rope *rope, rope_split_func split_func, void *split_ctx,
 	    void *alloc_ctx)
 {
 	rope->root = NULL;
+	rope->free_list = NULL;
 	rope->split = split_func;
 	rope->split_ctx = split_ctx;
 	rope->alloc = alloc_func;
@@ -32,9 +32,13 @@
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+#include <third_party/qsort_arg.h>
+
 /*------------------------------------------------------------------------- */
 /* R-tree internal structures definition */
 /*------------------------------------------------------------------------- */
@@ -1149,6 +1153,120 @@ rtree_number_of_records(const struct rtree *tree) {
 	return tree->n_records;
 }
 
+/*------------------------------------------------------------------------- */
+/* R-tree bulk loading (sort-tile-recursive) */
+/*------------------------------------------------------------------------- */
+
+size_t
+rtree_build_entry_size(const struct rtree *tree)
+{
+	return tree->page_branch_size;
+}
+
+void
+rtree_build_entry_set(const struct rtree *tree, void *entries, unsigned i,
+		      const struct rtree_rect *rect, record_t record)
+{
+	struct rtree_page_branch *b = (struct rtree_page_branch *)
+		((char *)entries + i * tree->page_branch_size);
+	b->data.record = record;
+	rtree_rect_copy(&b->rect, rect, tree->dimension);
+}
+
+/* Compare entries by the center of their rectangle along an axis.
+ * The argument carries the coordinate offset of the axis, the sum
+ * of the two bounds orders the same way the center does. */
+static int
+rtree_bulk_load_cmp(const void *p1, const void *p2, void *arg)
+{
+	unsigned c = (unsigned)(uintptr_t)arg;
+	const struct rtree_page_branch *b1 =
+		(const struct rtree_page_branch *)p1;
+	const struct rtree_page_branch *b2 =
+		(const struct rtree_page_branch *)p2;
+	coord_t c1 = b1->rect.coords[c] + b1->rect.coords[c + 1];
+	coord_t c2 = b2->rect.coords[c] + b2->rect.coords[c + 1];
+	return c1 < c2 ? -1 : c1 > c2;
+}
+
+/* Order a run of entries with sort-tile-recursive: sort the run
+ * along the axis, cut it into slabs holding a near-equal share of
+ * the pages, and recurse into every slab with the next axis. */
+static void
+rtree_bulk_load_order(struct rtree *tree, char *entries, unsigned n,
+		      unsigned axis)
+{
+	qsort_arg(entries, n, tree->page_branch_size, rtree_bulk_load_cmp,
+		  (void *)(uintptr_t)(2 * axis));
+	if (axis + 1 == tree->dimension)
+		return;
+	unsigned fanout = tree->page_max_fill;
+	unsigned pages = (n + fanout - 1) / fanout;
+	if (pages <= 1)
+		return;
+	/* Each slab takes pages^((r-1)/r) of the pages, where r is
+	 * the number of axes left to distribute over. */
+	unsigned r = tree->dimension - axis;
+	unsigned slab = fanout *
+		(unsigned)ceil(pow(pages, (double)(r - 1) / r));
+	for (unsigned i = 0; i < n; i += slab) {
+		unsigned m = n - i < slab ? n - i : slab;
+		rtree_bulk_load_order(tree, entries +
+				      (size_t)i * tree->page_branch_size,
+				      m, axis + 1);
+	}
+}
+
+/* Pack a level of ordered entries into pages and replace the
+ * prefix of the array with the (page, cover) entries of the level
+ * above. Returns the number of pages, 0 on allocation failure. */
+static unsigned
+rtree_bulk_load_pack(struct rtree *tree, char *entries, unsigned n)
+{
+	unsigned fanout = tree->page_max_fill;
+	unsigned npages = 0;
+	for (unsigned i = 0; i < n; i += fanout) {
+		unsigned m = n - i < fanout ? n - i : fanout;
+		struct rtree_page *page = rtree_page_alloc(tree);
+		if (page == NULL)
+			return 0;
+		tree->n_pages++;
+		page->n = m;
+		memcpy(page->data,
+		       entries + (size_t)i * tree->page_branch_size,
+		       (size_t)m * tree->page_branch_size);
+		struct rtree_page_branch *up = (struct rtree_page_branch *)
+			(entries + (size_t)npages * tree->page_branch_size);
+		rtree_page_cover(tree, page, &up->rect);
+		up->data.page = page;
+		npages++;
+	}
+	return npages;
+}
+
+int
+rtree_bulk_load(struct rtree *tree, void *entries, unsigned n)
+{
+	assert(tree->root == NULL && tree->height == 0);
+	if (n == 0)
+		return 0;
+	unsigned level_n = n;
+	unsigned height = 0;
+	do {
+		rtree_bulk_load_order(tree, (char *)entries, level_n, 0);
+		level_n = rtree_bulk_load_pack(tree, (char *)entries, level_n);
+		if (level_n == 0)
+			return -1;
+		height++;
+	} while (level_n > 1);
+	struct rtree_page_branch *b = (struct rtree_page_branch *)entries;
+	tree->root = b->data.page;
+	tree->height = height;
+	tree->n_records = n;
+	tree->version++;
+	return 0;
+}
+
 #if 0
 #include <stdio.h>
 void
@@ -285,6 +285,44 @@ rtree_insert(struct rtree *tree, struct rtree_rect *rect, record_t obj);
 bool
 rtree_remove(struct rtree *tree, const struct rtree_rect *rect, record_t obj);
 
+/**
+ * @brief Size of one entry of a bulk loading array for a tree
+ * @param tree - pointer to a tree
+ * @see rtree_bulk_load
+ **/
+size_t
+rtree_build_entry_size(const struct rtree *tree);
+
+/**
+ * @brief Fill entry number \a i of a bulk loading array
+ * @param tree - pointer to a tree
+ * @param entries - array of rtree_build_entry_size(tree) sized entries
+ * @param i - position of the entry to fill
+ * @param rect - rectangle of the record
+ * @param record - record to load
+ * @see rtree_bulk_load
+ **/
+void
+rtree_build_entry_set(const struct rtree *tree, void *entries, unsigned i,
+		      const struct rtree_rect *rect, record_t record);
+
+/**
+ * @brief Load \a n records into an empty tree at once
+ * Packs the records into pages with the sort-tile-recursive
+ * algorithm: much faster than inserting them one by one, and the
+ * resulting pages overlap little, which speeds up searches and
+ * neighbor iteration afterwards. The \a entries array is used as
+ * scratch space for building the upper levels of the tree and is
+ * clobbered.
+ * @param tree - pointer to an empty tree
+ * @param entries - array of entries filled with rtree_build_entry_set()
+ * @param n - number of entries
+ * @return 0 on success, -1 on memory allocation error; on error
+ *  the tree is left partially built and must be destroyed
+ **/
+int
+rtree_bulk_load(struct rtree *tree, void *entries, unsigned n);
+
 /**
  * @brief Size of memory used by tree
  * @param tree - pointer to a tree
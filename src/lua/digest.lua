@@ -1,15 +1,13 @@
 -- digest.lua (internal file)
 
 local ffi = require 'ffi'
+local buffer = require('buffer')
 local crypto = require('crypto')
 
 ffi.cdef[[
     /* internal implementation */
     unsigned char *SHA1internal(const unsigned char *d, size_t n, unsigned char *md);
 
-    /* from libc */
-    int snprintf(char *str, size_t size, const char *format, ...);
-
     typedef uint32_t (*crc32_func)(uint32_t crc,
         const unsigned char *buf, unsigned int len);
     extern int32_t guava(int64_t state, int32_t buckets);
@@ -40,15 +38,26 @@ local digest_shortcuts = {
 }
 
 local hexres = ffi.new('char[129]')
+local hex_chars = ffi.new('char[16]')
+ffi.copy(hex_chars, '0123456789abcdef', 16)
 
 local function str_to_hex(r)
     for i = 0, r:len() - 1 do
-        ffi.C.snprintf(hexres + i * 2, 3, "%02x",
-            ffi.cast('unsigned char', r:byte(i + 1)))
+        local b = r:byte(i + 1)
+        hexres[i * 2] = hex_chars[bit.rshift(b, 4)]
+        hexres[i * 2 + 1] = hex_chars[bit.band(b, 15)]
     end
     return ffi.string(hexres, r:len() * 2)
 end
 
+--
+-- Scratch buffer for base64 conversion. The converted data is
+-- copied out into a Lua string before returning, so one shared
+-- buffer serves all calls (the functions below do not yield) and
+-- a per-call ffi.new() allocation is avoided.
+--
+local conv_buf = buffer.ibuf()
+
 local PMurHash
 local PMurHash_methods = {
 
@@ -152,7 +161,8 @@ local m = {
         end
         local blen = #bin
         local slen = ffi.C.base64_bufsize(blen)
-        local str  = ffi.new('char[?]', slen)
+        conv_buf:reset()
+        local str  = conv_buf:reserve(slen)
         local len = ffi.C.base64_encode(bin, blen, str, slen)
         return ffi.string(str, len)
     end,
@@ -163,7 +173,8 @@ local m = {
         end
         local slen = #str
         local blen = math.ceil(slen * 3 / 4)
-        local bin  = ffi.new('char[?]', blen)
+        conv_buf:reset()
+        local bin  = conv_buf:reserve(blen)
         local len = ffi.C.base64_decode(str, slen, bin, blen)
         return ffi.string(bin, len)
     end,
@@ -219,6 +230,32 @@ for digest, name in pairs(digest_shortcuts) do
         end
         return str_to_hex(crypto.digest[digest](str))
     end
+    --
+    -- Batched one-shot hashing: takes an array of strings and
+    -- returns an array of binary digests. One EVP context is
+    -- created and reused for the whole batch, so hashing many
+    -- small strings pays the context setup once, not per string.
+    --
+    m[digest .. '_batch'] = function (strings)
+        if type(strings) ~= 'table' then
+            error('Usage: digest.'..digest..'_batch({string, ...})')
+        end
+        local ctx = crypto.digest[digest].new()
+        local res = {}
+        for i = 1, #strings do
+            if type(strings[i]) ~= 'string' then
+                ctx:free()
+                error('Usage: digest.'..digest..'_batch({string, ...})')
+            end
+            if i > 1 then
+                ctx:init()
+            end
+            ctx:update(strings[i])
+            res[i] = ctx:result()
+        end
+        ctx:free()
+        return res
+    end
 end
 
 m['aes256cbc'] = {
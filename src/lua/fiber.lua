@@ -7,6 +7,10 @@ double
 fiber_time(void);
 uint64_t
 fiber_time64(void);
+double
+fiber_local_get(uint32_t slot);
+void
+fiber_local_set(uint32_t slot, double value);
 ]]
 local C = ffi.C
 
@@ -18,6 +22,34 @@ local function fiber_time64()
     return C.fiber_time64()
 end
 
+-- Numeric fiber-local slots: unlike fiber.storage, which goes
+-- through a table lookup chain per access, a slot read compiles
+-- to a plain load from struct fiber. Intended for per-request
+-- context (tracing ids, tenant) read many times per request.
+-- Slots are numbered 0..SLOT_MAX - 1, hold doubles and read as 0
+-- until set; they are cleared when the fiber is recycled.
+local SLOT_MAX = 8
+
+local function fiber_slot_get(slot)
+    if type(slot) ~= 'number' or slot < 0 or slot >= SLOT_MAX then
+        error("Usage: fiber.slot_get(slot), slot in [0, " ..
+              (SLOT_MAX - 1) .. "]")
+    end
+    return C.fiber_local_get(slot)
+end
+
+local function fiber_slot_set(slot, value)
+    if type(slot) ~= 'number' or slot < 0 or slot >= SLOT_MAX or
+       type(value) ~= 'number' then
+        error("Usage: fiber.slot_set(slot, value), slot in [0, " ..
+              (SLOT_MAX - 1) .. "], numeric value")
+    end
+    C.fiber_local_set(slot, value)
+end
+
 fiber.time = fiber_time
 fiber.time64 = fiber_time64
+fiber.slot_get = fiber_slot_get
+fiber.slot_set = fiber_slot_set
+fiber.SLOT_MAX = SLOT_MAX
 return fiber
@@ -98,6 +98,7 @@ extern char strict_lua[],
 	dis_x64_lua[],
 	dump_lua[],
 	csv_lua[],
+	shdict_lua[],
 	v_lua[],
 	clock_lua[],
 	title_lua[],
@@ -126,6 +127,7 @@ static const char *lua_modules[] = {
 	"uri", uri_lua,
 	"fio", fio_lua,
 	"csv", csv_lua,
+	"shdict", shdict_lua,
 	"clock", clock_lua,
 	"socket", socket_lua,
 	"title", title_lua,
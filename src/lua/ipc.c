@@ -55,22 +55,39 @@ static int
 lbox_ipc_channel(struct lua_State *L)
 {
 	lua_Integer size = 0;
+	bool is_spsc = false;
 
 	if (lua_isnoneornil(L, 1)) {
 		size = 0;
 	} else if (lua_isnumber(L, 1)) {
-		size = lua_tointeger(L, -1);
+		size = lua_tointeger(L, 1);
 		if (size < 0)
 			luaL_error(L, "fiber.channel(size): negative size");
 	} else {
 		luaL_error(L, "fiber.channel(size): bad arguments");
 	}
 
+	/* Optional mode flag, e.g. fiber.channel(1024, 'spsc'). */
+	if (! lua_isnoneornil(L, 2)) {
+		const char *mode = lua_isstring(L, 2) ?
+			lua_tostring(L, 2) : "";
+		if (strcmp(mode, "spsc") != 0)
+			luaL_error(L, "fiber.channel(size, mode): "
+				   "unknown mode");
+		if (size == 0)
+			luaL_error(L, "fiber.channel(size, 'spsc'): "
+				   "size must be > 0");
+		is_spsc = true;
+	}
+
 	struct ipc_channel *ch = (struct ipc_channel *)
 		lua_newuserdata(L, ipc_channel_memsize(size));
 	if (ch == NULL)
 		luaL_error(L, "fiber.channel: not enough memory");
-	ipc_channel_create(ch, size);
+	if (is_spsc)
+		ipc_channel_create_spsc(ch, size);
+	else
+		ipc_channel_create(ch, size);
 
 	luaL_getmetatable(L, channel_typename);
 
@@ -36,6 +36,7 @@
 #include <lj_ctype.h>
 #endif /* defined(LUAJIT) */
 #include <lauxlib.h> /* struct luaL_error */
+#include <math.h> /* isfinite(), modf() */
 
 #include <msgpuck.h>
 #include <small/region.h>
@@ -241,6 +242,59 @@ luamp_set_decode_extension(luamp_decode_extension_f handler)
 	}
 }
 
+/**
+ * Encode a run of consecutive plain-number array elements,
+ * starting at zero-based element @a i, with one stream reserve
+ * per chunk instead of a luaL_tofield() dispatch and a
+ * reserve/advance pair per element. Only values which
+ * luaL_tofield() would classify as MP_UINT or MP_INT are taken;
+ * the first element of any other kind (hole, fractional or
+ * non-finite number, string, ...) ends the run and is left to
+ * the generic encoder. Arrays of integers - the time-series
+ * common case - are encoded entirely here.
+ *
+ * Returns the number of elements consumed.
+ */
+static uint32_t
+luamp_encode_num_run(struct lua_State *L, struct mpstream *stream,
+		     int idx, uint32_t i, uint32_t size)
+{
+	uint32_t done = 0;
+	while (i + done < size) {
+		uint32_t run = size - (i + done);
+		if (run > 64)
+			run = 64;
+		char *data = mpstream_reserve(stream, run * 9);
+		char *pos = data;
+		uint32_t n = 0;
+		while (n < run) {
+			lua_rawgeti(L, idx, i + done + n + 1);
+			if (lua_type(L, -1) != LUA_TNUMBER) {
+				lua_pop(L, 1);
+				break;
+			}
+			double num = lua_tonumber(L, -1);
+			lua_pop(L, 1);
+			double intpart;
+			/* Same classification as luaL_tofield(). */
+			if (isfinite(num) && modf(num, &intpart) != 0.0)
+				break;
+			if (num >= 0 && num <= UINT64_MAX)
+				pos = mp_encode_uint(pos, (uint64_t) num);
+			else if (num >= INT64_MIN && num <= INT64_MAX)
+				pos = mp_encode_int(pos, (int64_t) num);
+			else
+				break;
+			n++;
+		}
+		mpstream_advance(stream, pos - data);
+		done += n;
+		if (n < run)
+			break;
+	}
+	return done;
+}
+
 enum mp_type
 luamp_encode_r(struct lua_State *L, struct luaL_serializer *cfg,
 	       struct mpstream *stream, struct luaL_field *field,
@@ -305,6 +359,9 @@ restart: /* used by MP_EXT */
 		uint32_t size = field->size;
 		luamp_encode_array(cfg, stream, size);
 		for (uint32_t i = 0; i < size; i++) {
+			i += luamp_encode_num_run(L, stream, top, i, size);
+			if (i >= size)
+				break;
 			lua_rawgeti(L, top, i + 1);
 			luaL_tofield(L, cfg, top + 1, field);
 			luamp_encode_r(L, cfg, stream, field, level + 1);
@@ -399,6 +456,18 @@ luamp_decode(struct lua_State *L, struct luaL_serializer *cfg,
 		uint32_t size = mp_decode_array(data);
 		lua_createtable(L, size, 0);
 		for (uint32_t i = 0; i < size; i++) {
+			/*
+			 * Unroll runs of unsigned integers - the
+			 * common case for numeric arrays - without
+			 * a dispatch per element.
+			 */
+			while (i < size && mp_typeof(**data) == MP_UINT) {
+				luaL_pushuint64(L, mp_decode_uint(data));
+				lua_rawseti(L, -2, i + 1);
+				i++;
+			}
+			if (i >= size)
+				break;
 			luamp_decode(L, cfg, data);
 			lua_rawseti(L, -2, i + 1);
 		}
@@ -289,6 +289,94 @@ local function encode_ibuf(obj, ibuf)
     encode_r(ibuf, obj, 0)
 end
 
+--------------------------------------------------------------------------------
+-- Shape-hinted encoder
+--------------------------------------------------------------------------------
+
+-- Typed field encoders, resolved when a shape is compiled so that
+-- the per-value dispatch of encode_r happens once per shape, not
+-- once per field per record. Each checks the declared type with a
+-- single comparison and falls back to encode_r for anything else
+-- (nil, msgpack.NULL, cdata numbers); the server validates the
+-- record against the real space format anyway.
+local function encode_field_any(buf, val)
+    encode_r(buf, val, 1)
+end
+
+local function encode_field_integer(buf, val)
+    if type(val) == 'number' and val % 1 == 0 then
+        encode_int(buf, val)
+    else
+        encode_r(buf, val, 1)
+    end
+end
+
+local function encode_field_number(buf, val)
+    if type(val) == 'number' then
+        if val % 1 == 0 and val > -1e63 and val < 1e64 then
+            encode_int(buf, val)
+        else
+            encode_double(buf, val)
+        end
+    else
+        encode_r(buf, val, 1)
+    end
+end
+
+local function encode_field_string(buf, val)
+    if type(val) == 'string' then
+        encode_str(buf, val)
+    else
+        encode_r(buf, val, 1)
+    end
+end
+
+local function encode_field_boolean(buf, val)
+    if type(val) == 'boolean' then
+        encode_bool(buf, val)
+    else
+        encode_r(buf, val, 1)
+    end
+end
+
+local shape_field_encoders = {
+    unsigned = encode_field_integer;
+    integer  = encode_field_integer;
+    num      = encode_field_number; -- legacy name
+    number   = encode_field_number;
+    str      = encode_field_string; -- legacy name
+    string   = encode_field_string;
+    boolean  = encode_field_boolean;
+}
+
+-- Compile an encoder for a fixed-shape record. A shape is an
+-- array of field type names, or a space format - an array of
+-- {name = ..., type = ...} maps, see space:format(). The result
+-- is function(buf, record) appending record[1..#shape] to buf as
+-- a msgpack array: the arity and the field encoders are baked in
+-- at compile time, so encoding does no table walk and no per-key
+-- type dispatch.
+local function shape_encoder(shape)
+    if type(shape) ~= 'table' then
+        error("Usage: msgpackffi.shape_encoder({'unsigned', 'string', ...})")
+    end
+    local field_count = #shape
+    local encoders = {}
+    for i = 1, field_count do
+        local field_type = shape[i]
+        if type(field_type) == 'table' then
+            field_type = field_type.type or field_type[2]
+        end
+        encoders[i] = shape_field_encoders[field_type] or encode_field_any
+    end
+    return function(buf, record)
+        encode_array(buf, field_count)
+        for i = 1, field_count do
+            encoders[i](buf, record[i])
+        end
+    end
+end
+
 on_encode(ffi.typeof('uint8_t'), encode_int)
 on_encode(ffi.typeof('uint16_t'), encode_int)
 on_encode(ffi.typeof('uint32_t'), encode_int)
@@ -595,6 +683,7 @@ return {
     map_mt = msgpack.map_mt;
     encode = encode;
     on_encode = on_encode;
+    shape_encoder = shape_encoder;
     decode_unchecked = decode_unchecked;
     decode = decode_unchecked; -- just for tests
     internal = {
@@ -0,0 +1,249 @@
+-- shdict.lua (internal file)
+--
+-- Read-only shared data dictionaries.
+--
+-- A dictionary is built once (shdict.build) into a flat file:
+-- string keys mapped to msgpack-encoded values, with a sorted
+-- index in front of the data. shdict.open() maps the file with
+-- mmap(PROT_READ, MAP_SHARED), so opening is O(1) regardless of
+-- dictionary size, the kernel pages data in on demand, and all
+-- instances on one host share a single copy of the pages in the
+-- page cache. Lookups binary-search the index and decode the
+-- value in place - nothing is copied into the Lua heap until a
+-- value is actually read.
+
+local ffi = require('ffi')
+local fio = require('fio')
+local errno = require('errno')
+local msgpackffi = require('msgpackffi')
+
+ffi.cdef[[
+    struct shdict_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t count;
+    };
+    struct shdict_entry {
+        uint64_t key_offset;
+        uint64_t value_offset;
+        uint32_t key_len;
+        uint32_t value_len;
+    };
+
+    void *mmap(void *addr, size_t length, int prot, int flags,
+               int fd, long offset);
+    int munmap(void *addr, size_t length);
+    int memcmp(const void *s1, const void *s2, size_t n);
+    int rename(const char *oldpath, const char *newpath);
+]]
+
+local MAGIC = 'TSHDICT1'
+local VERSION = 1
+local HEADER_SIZE = ffi.sizeof('struct shdict_header')
+local ENTRY_SIZE = ffi.sizeof('struct shdict_entry')
+
+local PROT_READ = 1
+local MAP_SHARED = 1
+local MAP_FAILED = ffi.cast('void *', -1)
+
+local const_char_ptr_t = ffi.typeof('const char *')
+local entry_ptr_t = ffi.typeof('const struct shdict_entry *')
+
+-- Number of strings buffered before one write() in the builder.
+local BUILD_WRITE_BATCH = 1024
+
+local dict_methods = {}
+
+local function dict_check(self, method)
+    if self.map == nil then
+        error('shdict: attempt to use a closed dictionary, method ' ..
+              method .. '()')
+    end
+end
+
+dict_methods.get = function(self, key)
+    if type(key) ~= 'string' then
+        error('Usage: dict:get(string)')
+    end
+    dict_check(self, 'get')
+    local entries = self.entries
+    local data = self.data
+    local klen = #key
+    local lo = 0
+    local hi = self.count - 1
+    while lo <= hi do
+        local mid = math.floor((lo + hi) / 2)
+        local e = entries[mid]
+        local minlen = klen < e.key_len and klen or e.key_len
+        local rc = ffi.C.memcmp(key, data + e.key_offset, minlen)
+        if rc == 0 then
+            rc = klen - e.key_len
+        end
+        if rc == 0 then
+            return (msgpackffi.decode_unchecked(data + e.value_offset))
+        elseif rc < 0 then
+            hi = mid - 1
+        else
+            lo = mid + 1
+        end
+    end
+    return nil
+end
+
+dict_methods.pairs = function(self)
+    dict_check(self, 'pairs')
+    local entries = self.entries
+    local data = self.data
+    local count = self.count
+    local i = -1
+    return function()
+        i = i + 1
+        if i >= count then
+            return nil
+        end
+        local e = entries[i]
+        return ffi.string(data + e.key_offset, e.key_len),
+               (msgpackffi.decode_unchecked(data + e.value_offset))
+    end
+end
+
+dict_methods.close = function(self)
+    if self.map == nil then
+        return
+    end
+    ffi.gc(self.map, nil)
+    ffi.C.munmap(self.map, self.size)
+    self.map = nil
+    self.data = nil
+    self.entries = nil
+end
+
+local dict_mt = { __index = dict_methods }
+
+--
+-- Map an existing dictionary file read-only. The returned object
+-- supports dict:get(key), dict:pairs(), dict:close() and exposes
+-- dict.count. The mapping is released on close() or when the
+-- object is collected.
+--
+local function dict_open(path)
+    if type(path) ~= 'string' then
+        error('Usage: shdict.open(path)')
+    end
+    local fh = fio.open(path, {'O_RDONLY'})
+    if fh == nil then
+        error(string.format("shdict.open('%s'): %s", path,
+                            errno.strerror(errno())))
+    end
+    local size = fh:stat().size
+    local map = ffi.C.mmap(nil, size, PROT_READ, MAP_SHARED, fh.fh, 0)
+    fh:close()
+    if map == MAP_FAILED then
+        error(string.format("shdict.open('%s'): mmap: %s", path,
+                            errno.strerror(errno())))
+    end
+    map = ffi.cast('char *', map)
+    if size < HEADER_SIZE then
+        ffi.C.munmap(map, size)
+        error(string.format("shdict.open('%s'): file too short", path))
+    end
+    local header = ffi.cast('const struct shdict_header *', map)
+    if ffi.string(header.magic, 8) ~= MAGIC or
+       header.version ~= VERSION then
+        ffi.C.munmap(map, size)
+        error(string.format("shdict.open('%s'): not a shdict file", path))
+    end
+    local self = setmetatable({
+        path = path,
+        size = size,
+        count = header.count,
+        map = map,
+        entries = ffi.cast(entry_ptr_t, map + HEADER_SIZE),
+        data = ffi.cast(const_char_ptr_t, map),
+    }, dict_mt)
+    ffi.gc(map, function(p) ffi.C.munmap(p, size) end)
+    return self
+end
+
+--
+-- Build a dictionary file from a plain Lua table with string
+-- keys. The file is written to <path>.inprogress first and
+-- renamed into place, so readers never observe a partial
+-- dictionary and a live mapping of the old file stays valid.
+--
+local function dict_build(path, dict)
+    if type(path) ~= 'string' or type(dict) ~= 'table' then
+        error('Usage: shdict.build(path, table)')
+    end
+    local keys = {}
+    for k, _ in pairs(dict) do
+        if type(k) ~= 'string' then
+            error('shdict.build: keys must be strings')
+        end
+        table.insert(keys, k)
+    end
+    table.sort(keys)
+    local count = #keys
+    local values = {}
+    for i = 1, count do
+        values[i] = msgpackffi.encode(dict[keys[i]])
+    end
+
+    local header = ffi.new('struct shdict_header')
+    ffi.copy(header.magic, MAGIC, 8)
+    header.version = VERSION
+    header.count = count
+    local entries = ffi.new('struct shdict_entry[?]', count)
+    local offset = HEADER_SIZE + count * ENTRY_SIZE
+    for i = 1, count do
+        local e = entries[i - 1]
+        e.key_offset = offset
+        e.key_len = #keys[i]
+        offset = offset + e.key_len
+        e.value_offset = offset
+        e.value_len = #values[i]
+        offset = offset + e.value_len
+    end
+
+    local tmp = path .. '.inprogress'
+    local fh = fio.open(tmp, {'O_CREAT', 'O_WRONLY', 'O_TRUNC'},
+                        {'S_IRUSR', 'S_IWUSR', 'S_IRGRP', 'S_IROTH'})
+    if fh == nil then
+        error(string.format("shdict.build('%s'): %s", tmp,
+                            errno.strerror(errno())))
+    end
+    local function write(data)
+        if not fh:write(data) then
+            local err = errno.strerror(errno())
+            fh:close()
+            error(string.format("shdict.build('%s'): write: %s", tmp, err))
+        end
+    end
+    write(ffi.string(header, HEADER_SIZE))
+    if count > 0 then
+        write(ffi.string(entries, count * ENTRY_SIZE))
+    end
+    local batch = {}
+    for i = 1, count do
+        table.insert(batch, keys[i])
+        table.insert(batch, values[i])
+        if #batch >= BUILD_WRITE_BATCH then
+            write(table.concat(batch))
+            batch = {}
+        end
+    end
+    if #batch > 0 then
+        write(table.concat(batch))
+    end
+    fh:fsync()
+    fh:close()
+    if ffi.C.rename(tmp, path) ~= 0 then
+        error(string.format("shdict.build: rename to '%s': %s", path,
+                            errno.strerror(errno())))
+    end
+end
+
+return {
+    build = dict_build,
+    open = dict_open,
+}
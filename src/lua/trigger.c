@@ -56,33 +56,63 @@ lbox_trigger_destroy(struct trigger *ptr)
 	free(ptr);
 }
 
+/**
+ * A cached coro for trigger invocation, anchored in the registry
+ * forever. Allocating a new coro and registry slot on every
+ * invocation dominated the cost of cheap triggers; the cache
+ * brings an invocation down to a stack reset. A trigger may
+ * yield, and another fiber may fire a trigger meanwhile, so the
+ * coro is handed out to one invocation at a time and the
+ * concurrent ones fall back to a fresh coro.
+ */
+static struct lua_State *trigger_coro = NULL;
+static bool trigger_coro_busy = false;
+
 static void
 lbox_trigger_run(struct trigger *ptr, void *event)
 {
 	struct lbox_trigger *trigger = (struct lbox_trigger *) ptr;
-	/*
-	 * Create a new coro and reference it. Remove it
-	 * from tarantool_L stack, which is a) scarce
-	 * b) can be used by other triggers while this
-	 * trigger yields, so when it's time to clean
-	 * up the coro, we wouldn't know which stack position
-	 * it is on.
-	 *
-	 * XXX: lua_newthread() may throw if out of memory,
-	 * this needs to be wrapped with lua_pcall() as well.
-	 * Don't, since it's a stupid overhead on every trigger
-	 * invocation, and in future we plan to hack into Lua
-	 * C API to fix this.
-	 */
-	struct lua_State *L = lua_newthread(tarantool_L);
-	int coro_ref = luaL_ref(tarantool_L, LUA_REGISTRYINDEX);
+	struct lua_State *L;
+	int coro_ref = LUA_NOREF;
+	if (!trigger_coro_busy && trigger_coro != NULL) {
+		L = trigger_coro;
+		trigger_coro_busy = true;
+	} else if (!trigger_coro_busy && trigger_coro == NULL) {
+		/* Create and permanently anchor the cached coro. */
+		trigger_coro = lua_newthread(tarantool_L);
+		luaL_ref(tarantool_L, LUA_REGISTRYINDEX);
+		L = trigger_coro;
+		trigger_coro_busy = true;
+	} else {
+		/*
+		 * Create a new coro and reference it. Remove it
+		 * from tarantool_L stack, which is a) scarce
+		 * b) can be used by other triggers while this
+		 * trigger yields, so when it's time to clean
+		 * up the coro, we wouldn't know which stack
+		 * position it is on.
+		 *
+		 * XXX: lua_newthread() may throw if out of
+		 * memory, this needs to be wrapped with
+		 * lua_pcall() as well. Don't, since it's a
+		 * stupid overhead on every trigger invocation,
+		 * and in future we plan to hack into Lua C API
+		 * to fix this.
+		 */
+		L = lua_newthread(tarantool_L);
+		coro_ref = luaL_ref(tarantool_L, LUA_REGISTRYINDEX);
+	}
 	lua_rawgeti(L, LUA_REGISTRYINDEX, trigger->ref);
 	int top = trigger->push_event(L, event);
-	if (luaT_call(L, top, 0)) {
+	int rc = luaT_call(L, top, 0);
+	if (L == trigger_coro) {
+		lua_settop(L, 0);
+		trigger_coro_busy = false;
+	} else {
 		luaL_unref(tarantool_L, LUA_REGISTRYINDEX, coro_ref);
-		diag_raise();
 	}
-	luaL_unref(tarantool_L, LUA_REGISTRYINDEX, coro_ref);
+	if (rc != 0)
+		diag_raise();
 }
 
 static struct lbox_trigger *
@@ -53,6 +53,7 @@
 #include <cbus.h>
 #include <coeio.h>
 #include <crc32.h>
+#include <clock.h>
 #include "memory.h"
 #include <say.h>
 #include <rmean.h>
@@ -86,6 +87,8 @@ static int main_argc;
 /** Signals handled after start as part of the event loop. */
 static ev_signal ev_sigs[4];
 static const int ev_sig_count = sizeof(ev_sigs)/sizeof(*ev_sigs);
+/** Periodic recalibration of the TSC clock, see clock_fast(). */
+static ev_timer clock_fast_timer;
 
 extern const void *opt_def;
 
@@ -110,6 +113,13 @@ tarantool_uptime(void)
 	return ev_now(loop()) - start_time;
 }
 
+static void
+clock_fast_timer_cb(ev_loop * /* loop */, struct ev_timer * /* w */,
+		    int /* revents */)
+{
+	clock_fast_resync();
+}
+
 /**
 * Create snapshot from signal handler (SIGUSR1)
 */
@@ -440,6 +450,9 @@ load_cfg()
 			cfg_geti("log_level"),
 			cfg_geti("log_nonblock"),
 			background);
+	say_set_rate_limit(cfg_geti("log_rate_limit"));
+	if (cfg_geti("log_async"))
+		say_set_async(true);
 	systemd_init();
 
 	if (background)
@@ -486,6 +499,8 @@ tarantool_free(void)
 		say_syserror("failed to remove pid file '%s'", pid_file);
 	free(pid_file);
 	signal_free();
+	/* Flush whatever the logger thread has not written out yet. */
+	say_set_async(false);
 #ifdef ENABLE_GCOV
 	__gcov_flush();
 #endif
@@ -610,6 +625,7 @@ main(int argc, char **argv)
 	random_init();
 
 	crc32_init();
+	clock_fast_init();
 	memory_init();
 
 	main_argc = argc;
@@ -637,6 +653,13 @@ main(int argc, char **argv)
 		if (!loop())
 			panic("%s", "can't init event loop");
 
+		/*
+		 * Must be started before the ev_activecnt() baseline
+		 * below, or the start_loop heuristic would always fire.
+		 */
+		ev_timer_init(&clock_fast_timer, clock_fast_timer_cb, 10., 10.);
+		ev_timer_start(loop(), &clock_fast_timer);
+
 		int events = ev_activecnt(loop());
 		/*
 		 * Load user init script.  The script should have access
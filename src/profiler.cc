@@ -0,0 +1,163 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "profiler.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "backtrace.h"
+#include "fiber.h"
+#include "say.h"
+#include "trivia/config.h"
+
+static struct profiler {
+	/** The profiled (tx) thread. */
+	pthread_t thread;
+	/** Sample buffer, allocated on first start. */
+	struct profiler_sample *samples;
+	/** Number of collected samples, written by the handler. */
+	volatile int sample_count;
+	/** Ticks lost: buffer full or delivered off-thread. */
+	volatile uint64_t dropped;
+	bool is_running;
+} profiler;
+
+/**
+ * SIGPROF handler. ITIMER_PROF delivers to whichever thread was
+ * running when the CPU timer expired: only ticks landing on the
+ * tx thread can be attributed to a fiber, the rest are counted as
+ * dropped. The handler makes no calls beyond a stack walk and
+ * memcpy into preallocated memory.
+ */
+static void
+profiler_sig_cb(int signo)
+{
+	(void) signo;
+	if (!pthread_equal(pthread_self(), profiler.thread) ||
+	    profiler.sample_count >= PROFILER_SAMPLE_MAX) {
+		profiler.dropped++;
+		return;
+	}
+	struct profiler_sample *sample =
+		&profiler.samples[profiler.sample_count];
+	const char *name = fiber() != NULL ? fiber_name(fiber()) : "sched";
+	strncpy(sample->fiber_name, name, PROFILER_NAME_MAX - 1);
+	sample->fiber_name[PROFILER_NAME_MAX - 1] = '\0';
+#ifdef ENABLE_BACKTRACE
+	sample->n_frames = backtrace_collect(sample->frames,
+					     PROFILER_FRAME_MAX);
+#else
+	sample->n_frames = 0;
+#endif /* ENABLE_BACKTRACE */
+	profiler.sample_count++;
+}
+
+int
+profiler_start(int freq)
+{
+	if (profiler.is_running)
+		profiler_stop();
+	if (profiler.samples == NULL) {
+		profiler.samples = (struct profiler_sample *)
+			calloc(PROFILER_SAMPLE_MAX, sizeof(*profiler.samples));
+		if (profiler.samples == NULL) {
+			say_error("profiler: failed to allocate "
+				  "the sample buffer");
+			return -1;
+		}
+	}
+	profiler.thread = pthread_self();
+	profiler.sample_count = 0;
+	profiler.dropped = 0;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = profiler_sig_cb;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGPROF, &sa, NULL) != 0) {
+		say_syserror("profiler: sigaction");
+		return -1;
+	}
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / freq;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+		say_syserror("profiler: setitimer");
+		return -1;
+	}
+	profiler.is_running = true;
+	say_info("started CPU profiler at %d Hz", freq);
+	return 0;
+}
+
+void
+profiler_stop(void)
+{
+	if (!profiler.is_running)
+		return;
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN);
+	profiler.is_running = false;
+	say_info("stopped CPU profiler, %d samples, %llu dropped",
+		 profiler.sample_count,
+		 (unsigned long long) profiler.dropped);
+}
+
+bool
+profiler_is_running(void)
+{
+	return profiler.is_running;
+}
+
+int
+profiler_sample_count(void)
+{
+	return profiler.sample_count;
+}
+
+const struct profiler_sample *
+profiler_sample(int index)
+{
+	return &profiler.samples[index];
+}
+
+uint64_t
+profiler_dropped(void)
+{
+	return profiler.dropped;
+}
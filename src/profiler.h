@@ -0,0 +1,107 @@
+#ifndef TARANTOOL_PROFILER_H_INCLUDED
+#define TARANTOOL_PROFILER_H_INCLUDED
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/**
+ * On-demand sampling CPU profiler.
+ *
+ * SIGPROF fires at the configured frequency on whichever thread
+ * is burning CPU. Samples taken on the tx thread record the raw
+ * return addresses of the running fiber's call chain together
+ * with the fiber name; samples landing on other threads are
+ * counted but not attributed. The handler only copies words into
+ * a preallocated buffer, so the run-time overhead is a stack walk
+ * per tick. Symbolization is deferred to retrieval time, see
+ * box.stat.profile().
+ */
+
+enum {
+	/** Max return addresses recorded per sample. */
+	PROFILER_FRAME_MAX = 32,
+	/** Capacity of the preallocated sample buffer. */
+	PROFILER_SAMPLE_MAX = 16384,
+	/** Room for a truncated copy of the fiber name. */
+	PROFILER_NAME_MAX = 32,
+};
+
+struct profiler_sample {
+	/** Name of the fiber which owned the CPU. */
+	char fiber_name[PROFILER_NAME_MAX];
+	/** Number of collected return addresses. */
+	int n_frames;
+	/** Return addresses, leaf first. */
+	void *frames[PROFILER_FRAME_MAX];
+};
+
+/**
+ * Start sampling at @a freq ticks of consumed CPU time per
+ * second. Discards the samples of a previous run. Must be called
+ * from the tx thread - its fibers are the attribution targets.
+ * @retval 0  success.
+ * @retval -1 could not arm the timer, diagnostics logged.
+ */
+int
+profiler_start(int freq);
+
+/**
+ * Stop sampling. The collected samples are kept until the next
+ * profiler_start() so they can be retrieved at leisure.
+ */
+void
+profiler_stop(void);
+
+bool
+profiler_is_running(void);
+
+/** Number of samples collected so far. */
+int
+profiler_sample_count(void);
+
+/** The @a index-th collected sample. */
+const struct profiler_sample *
+profiler_sample(int index);
+
+/** Ticks lost: buffer full or delivered to a non-tx thread. */
+uint64_t
+profiler_dropped(void);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#endif /* TARANTOOL_PROFILER_H_INCLUDED */
@@ -41,6 +41,8 @@
 #include <sys/param.h>
 #endif
 #include <syslog.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "fiber.h"
 
@@ -116,6 +118,249 @@ say_set_log_level(int new_level)
 	log_level = new_level;
 }
 
+/*
+ * Asynchronous logging: each cord formats messages into its own
+ * fixed-size ring, a logger thread drains the rings and issues
+ * the blocking write() calls. The ring is single producer
+ * (the owning cord) single consumer (the logger thread), so the
+ * hot path is a format, a copy and two atomic operations.
+ */
+
+enum {
+	/** Capacity of a cord's log ring, must be a power of 2. */
+	SAY_RING_LEN = 256,
+	/** Rate limiter bucket count, must be a power of 2. */
+	SAY_RATE_BUCKETS = 64,
+};
+
+/** A preformatted log message, ready to be written out. */
+struct say_record {
+	/** Log level, to pick the syslog priority. */
+	int level;
+	/** Formatted length, without the trailing newline. */
+	int len;
+	char buf[PIPE_BUF];
+};
+
+struct say_ring {
+	/** Member of the say_rings list. */
+	struct say_ring *next;
+	/** Next slot to fill, written by the owning cord only. */
+	uint32_t head;
+	/** Next slot to drain, written by the logger thread only. */
+	uint32_t tail;
+	struct say_record rec[SAY_RING_LEN];
+};
+
+/**
+ * The list of all registered rings. Only ever prepended to:
+ * rings of exited cords are left behind, the handful of cords a
+ * server runs is small and stable.
+ */
+static struct say_ring *say_rings;
+static __thread struct say_ring *say_ring_tls;
+
+static volatile bool say_async;
+static volatile bool say_async_stop;
+static pthread_t say_async_thread;
+/** Messages lost to a full ring while the drainer fell behind. */
+static uint64_t say_overflow_drops;
+
+/** Per call site messages/second budget, 0 - unlimited. */
+static int say_rate_limit_msgs;
+/** Messages dropped by the rate limiter, all sources. */
+static uint64_t say_rate_drops;
+
+/**
+ * A rate limiter bucket tracks one say() call site for the
+ * current second. The table is small and not collision free:
+ * call sites mapping to the same bucket share a budget. Bucket
+ * updates from concurrent cords are deliberately not atomic -
+ * a lost increment skews the limit by a message, which is fine
+ * for its purpose.
+ */
+struct say_rate_bucket {
+	time_t second;
+	uint32_t count;
+	uint32_t suppressed;
+};
+
+static struct say_rate_bucket say_rate_table[SAY_RATE_BUCKETS];
+
+/** Write a formatted record to the log destination. */
+static void
+say_emit(int level, char *buf, size_t p, size_t len)
+{
+	if (logger_type != SAY_LOGGER_SYSLOG) {
+		if (p >= len - 1)
+			p = len - 1;
+		*(buf + p) = '\n';
+		int r = write(log_fd, buf, p + 1);
+		(void)r;
+	} else {
+		/*
+		 * Due to omitted timestamp we have a leading
+		 * white space, hence buf + 1.
+		 */
+		syslog(level_to_syslog_priority(level), "%s", buf + 1);
+	}
+
+	if (level == S_FATAL && log_fd != STDERR_FILENO) {
+		int r = write(STDERR_FILENO, buf, p + 1);
+		(void)r;
+	}
+}
+
+/**
+ * Queue a formatted message for the logger thread.
+ * @retval -1 the ring is full or cannot be allocated,
+ *            the message is lost.
+ */
+static int
+say_ring_push(int level, const char *buf, size_t p)
+{
+	struct say_ring *ring = say_ring_tls;
+	if (ring == NULL) {
+		ring = (struct say_ring *)calloc(1, sizeof(*ring));
+		if (ring == NULL)
+			return -1;
+		/* Publish the ring for the logger thread. */
+		ring->next = __atomic_load_n(&say_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&say_rings, &ring->next,
+						    ring, false,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+		say_ring_tls = ring;
+	}
+	uint32_t head = ring->head;
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= SAY_RING_LEN)
+		return -1;
+	struct say_record *rec = &ring->rec[head & (SAY_RING_LEN - 1)];
+	if (p > sizeof(rec->buf) - 1)
+		p = sizeof(rec->buf) - 1;
+	rec->level = level;
+	rec->len = p;
+	memcpy(rec->buf, buf, p);
+	rec->buf[p] = '\0';
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void
+say_ring_drain(struct say_ring *ring)
+{
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	while (ring->tail != head) {
+		struct say_record *rec =
+			&ring->rec[ring->tail & (SAY_RING_LEN - 1)];
+		say_emit(rec->level, rec->buf, rec->len, sizeof(rec->buf));
+		__atomic_store_n(&ring->tail, ring->tail + 1,
+				 __ATOMIC_RELEASE);
+	}
+}
+
+static void
+say_drain_all(void)
+{
+	struct say_ring *ring = __atomic_load_n(&say_rings, __ATOMIC_ACQUIRE);
+	for (; ring != NULL; ring = ring->next)
+		say_ring_drain(ring);
+}
+
+static void *
+say_async_f(void *arg)
+{
+	(void)arg;
+	uint64_t reported_drops = 0;
+	while (!say_async_stop) {
+		say_drain_all();
+		uint64_t drops = __atomic_load_n(&say_overflow_drops,
+						 __ATOMIC_RELAXED);
+		if (drops != reported_drops) {
+			say_warn("%llu log messages dropped: the logger "
+				 "thread fell behind", (unsigned long long)
+				 (drops - reported_drops));
+			reported_drops = drops;
+		}
+		struct timespec ts = { 0, 10000000 }; /* 10 ms */
+		nanosleep(&ts, NULL);
+	}
+	/* A final sweep, so turning async off acts as a flush. */
+	say_drain_all();
+	return NULL;
+}
+
+void
+say_set_async(bool async)
+{
+	if (async == say_async)
+		return;
+	if (async) {
+		say_async_stop = false;
+		if (pthread_create(&say_async_thread, NULL,
+				   say_async_f, NULL) != 0) {
+			say_syserror("failed to start the logger thread");
+			return;
+		}
+		say_async = true;
+	} else {
+		/* New messages go synchronously again. */
+		say_async = false;
+		say_async_stop = true;
+		pthread_join(say_async_thread, NULL);
+	}
+}
+
+void
+say_set_rate_limit(int rate)
+{
+	say_rate_limit_msgs = rate;
+}
+
+uint64_t
+say_rate_dropped(void)
+{
+	return __atomic_load_n(&say_rate_drops, __ATOMIC_RELAXED);
+}
+
+uint64_t
+say_async_dropped(void)
+{
+	return __atomic_load_n(&say_overflow_drops, __ATOMIC_RELAXED);
+}
+
+/**
+ * Charge a message against the budget of its call site.
+ * @retval -1 over budget, drop the message.
+ * @retval  0 pass; @a suppressed is set to the number of
+ *            messages dropped in the previous window, to be
+ *            reported along with this one.
+ */
+static int
+say_rate_limit_check(const char *filename, int line, uint32_t *suppressed)
+{
+	if (say_rate_limit_msgs <= 0)
+		return 0;
+	time_t now = time(NULL);
+	uint32_t i = ((uintptr_t)filename / sizeof(void *) + line) &
+		     (SAY_RATE_BUCKETS - 1);
+	struct say_rate_bucket *bucket = &say_rate_table[i];
+	if (bucket->second != now) {
+		*suppressed = bucket->suppressed;
+		bucket->suppressed = 0;
+		bucket->count = 0;
+		bucket->second = now;
+	}
+	if (++bucket->count > (uint32_t)say_rate_limit_msgs) {
+		bucket->suppressed++;
+		__atomic_add_fetch(&say_rate_drops, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	return 0;
+}
+
 /**
  * Initialize the logger pipe: a standalone
  * process which is fed all log messages.
@@ -348,6 +593,11 @@ vsay(int level, const char *filename, int line, const char *error,
 		return;
 	}
 
+	uint32_t suppressed = 0;
+	if (level != S_FATAL &&
+	    say_rate_limit_check(filename, line, &suppressed) != 0)
+		return;
+
 	for (f = filename; *f; f++)
 		if (*f == '/' && *(f + 1) != '\0')
 			filename = f + 1;
@@ -384,25 +634,19 @@ vsay(int level, const char *filename, int line, const char *error,
 	p += vsnprintf(buf + p, len - p, format, ap);
 	if (error && p < len - 1)
 		p += snprintf(buf + p, len - p, ": %s", error);
-
-	if (logger_type != SAY_LOGGER_SYSLOG) {
-		if (p >= len - 1)
-			p = len - 1;
-		*(buf + p) = '\n';
-		int r = write(log_fd, buf, p + 1);
-		(void)r;
-	} else {
-		/*
-		 * Due to omitted timestamp we have a leading
-		 * white space, hence buf + 1.
-		 */
-		syslog(level_to_syslog_priority(level), "%s", buf + 1);
+	if (suppressed > 0 && p < len - 1)
+		p += snprintf(buf + p, len - p,
+			      " [%u earlier messages suppressed]",
+			      (unsigned)suppressed);
+
+	if (say_async && level != S_FATAL) {
+		if (say_ring_push(level, buf, MIN(p, len - 1)) != 0)
+			__atomic_add_fetch(&say_overflow_drops, 1,
+					   __ATOMIC_RELAXED);
+		return;
 	}
 
-	if (level == S_FATAL && log_fd != STDERR_FILENO) {
-		int r = write(STDERR_FILENO, buf, p + 1);
-		(void)r;
-	}
+	say_emit(level, buf, p, len);
 }
 
 static void
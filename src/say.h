@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <errno.h>
 #include <sys/types.h> /* pid_t */
 
@@ -69,6 +70,39 @@ say_log_level_is_enabled(int level)
 void
 say_set_log_level(int new_level);
 
+/**
+ * Switch the logger between synchronous and asynchronous mode.
+ * In asynchronous mode say() only formats the message into a
+ * fixed-size per-cord ring and returns; a dedicated logger
+ * thread drains the rings and issues the write() calls, so the
+ * cost of logging on the hot path is bounded regardless of how
+ * slow the log destination is. When the ring of a cord is full
+ * the message is dropped and counted, see say_async_dropped().
+ * Turning the mode off joins the logger thread and flushes
+ * whatever is still queued. Fatal messages are always written
+ * synchronously.
+ */
+void
+say_set_async(bool async);
+
+/**
+ * Limit each say() call site to at most @a rate messages per
+ * second. Messages over the budget are dropped and counted; the
+ * first message of the next second reports how many were
+ * suppressed. 0 (the default) disables the limiter. Fatal
+ * messages are never limited.
+ */
+void
+say_set_rate_limit(int rate);
+
+/** The total number of messages dropped by the rate limiter. */
+uint64_t
+say_rate_dropped(void);
+
+/** The total number of messages dropped on async ring overflow. */
+uint64_t
+say_async_dropped(void);
+
 void
 say_logrotate(int /* signo */);
 
@@ -34,6 +34,7 @@
 #include <sys/uio.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
 #include <netinet/in.h> /* TCP_NODELAY */
 #include <netinet/tcp.h> /* TCP_NODELAY */
@@ -245,7 +246,16 @@ int
 sio_accept(int fd, struct sockaddr *addr, socklen_t *addrlen)
 {
 	/* Accept a connection. */
+#if defined(HAVE_ACCEPT4)
+	/*
+	 * The socket comes out of the kernel already non-blocking,
+	 * saving an fcntl(F_GETFL)/fcntl(F_SETFL) pair per accepted
+	 * connection, which adds up during an accept burst.
+	 */
+	int newfd = accept4(fd, addr, addrlen, SOCK_NONBLOCK);
+#else
 	int newfd = accept(fd, addr, addrlen);
+#endif
 	if (newfd < 0 &&
 	    (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
 		tnt_raise(SocketError, fd, "accept");
@@ -305,6 +315,22 @@ sio_writev(int fd, const struct iovec *iov, int iovcnt)
 	return n;
 }
 
+/** writev() with sendmsg() flags. */
+ssize_t
+sio_writev_flags(int fd, const struct iovec *iov, int iovcnt, int flags)
+{
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *) iov;
+	msg.msg_iovlen = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+	ssize_t n = sendmsg(fd, &msg, flags);
+	if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+	    errno != EINTR) {
+		tnt_raise(SocketError, fd, "sendmsg(%d)", iovcnt);
+	}
+	return n;
+}
+
 /** Blocking I/O writev */
 ssize_t
 sio_writev_all(int fd, struct iovec *iov, int iovcnt)
@@ -140,6 +140,26 @@ ssize_t sio_read(int fd, void *buf, size_t count);
 ssize_t sio_write(int fd, const void *buf, size_t count);
 ssize_t sio_writev(int fd, const struct iovec *iov, int iovcnt);
 
+/**
+ * A hint for sio_writev_flags() that more output for the same
+ * socket follows shortly: maps to MSG_MORE where the platform
+ * has it, telling the kernel to hold a short trailing segment
+ * until it can be coalesced with the next write. A no-op
+ * elsewhere.
+ */
+#if defined(MSG_MORE)
+enum { SIO_FLAG_MORE = MSG_MORE };
+#else
+enum { SIO_FLAG_MORE = 0 };
+#endif
+
+/**
+ * The same as sio_writev(), but takes sendmsg() flags,
+ * e.g. SIO_FLAG_MORE.
+ */
+ssize_t sio_writev_flags(int fd, const struct iovec *iov, int iovcnt,
+			 int flags);
+
 ssize_t sio_write_total(int fd, const void *buf, size_t count, size_t total);
 
 /**
@@ -72,6 +72,13 @@ trigger_create(struct trigger *trigger, trigger_f run, void *data,
 static inline void
 trigger_run(struct rlist *list, void *event)
 {
+	/*
+	 * The common case on hot paths (DML, fiber yield) is an
+	 * empty list: get it out of the way with one comparison
+	 * before setting up the loop.
+	 */
+	if (rlist_empty(list))
+		return;
 	struct trigger *trigger, *tmp;
 	rlist_foreach_entry_safe(trigger, list, link, tmp)
 		trigger->run(trigger, event);
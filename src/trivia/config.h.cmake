@@ -51,6 +51,12 @@
  * showing fiber call stack.
  */
 #cmakedefine ENABLE_BACKTRACE 1
+
+/*
+ * Defined if per-request-type allocation accounting
+ * (box.stat.alloc()) is compiled in.
+ */
+#cmakedefine ENABLE_ALLOC_STAT 1
 /*
  * Set if the system has bfd.h header and GNU bfd library.
  */
@@ -108,6 +114,10 @@
  * Defined if this platform has BSD specific sendfile(..).
  */
 #cmakedefine HAVE_SENDFILE_BSD 1
+/*
+ * Defined if this platform has accept4(..).
+ */
+#cmakedefine HAVE_ACCEPT4 1
 /*
  * Set if this is a GNU system and libc has __libc_stack_end.
  */
@@ -161,6 +171,7 @@
 #cmakedefine HAVE_PTHREAD_YIELD 1
 #cmakedefine HAVE_SCHED_YIELD 1
 #cmakedefine HAVE_POSIX_FADVISE 1
+#cmakedefine HAVE_FALLOCATE 1
 #cmakedefine HAVE_MREMAP 1
 
 #cmakedefine HAVE_PRCTL_H 1
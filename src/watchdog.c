@@ -0,0 +1,176 @@
+/*
+ * Copyright 2010-2016, Tarantool AUTHORS, please see AUTHORS file.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "watchdog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backtrace.h"
+#include "clock.h"
+#include "fiber.h"
+#include "say.h"
+#include "trivia/util.h"
+
+/**
+ * The signal used to interrupt the stalled thread. SIGURG is
+ * otherwise unused: the server never puts sockets into urgent
+ * mode, and the default disposition is to ignore it.
+ */
+#define WATCHDOG_SIGNAL SIGURG
+
+static struct watchdog {
+	/** The sampling thread. */
+	pthread_t thread;
+	/** The watched (tx) thread. */
+	pthread_t watched;
+	/** The watched thread's event loop. */
+	struct ev_loop *loop;
+	/**
+	 * Stall threshold, seconds. Read by the sampling thread
+	 * on every tick, so updates take effect without a
+	 * restart. Word-sized benign race.
+	 */
+	volatile double threshold;
+	/**
+	 * Duration of the stall being reported, seconds. Written
+	 * by the sampling thread right before the signal is sent,
+	 * read by the signal handler on the watched thread.
+	 */
+	volatile double stall;
+	/** Tells the sampling thread to exit. */
+	volatile bool stop;
+	/** True while the sampling thread exists. */
+	bool is_running;
+} watchdog;
+
+/**
+ * Runs on the watched thread in the middle of the stall. Only
+ * async-signal-unsafe calls already relied upon by the fatal
+ * signal handler (fdprintf(), the unwinder) are made here: the
+ * interrupted code is not crashing, merely not yielding, so the
+ * odds of catching it inside the allocator are the same as for
+ * any profiling signal.
+ */
+static void
+watchdog_sig_cb(int signo)
+{
+	(void) signo;
+	fdprintf(STDERR_FILENO,
+		 "W> event loop stalled for %.3f sec, current stack:\n",
+		 watchdog.stall);
+#ifdef ENABLE_BACKTRACE
+	print_backtrace();
+#endif /* ENABLE_BACKTRACE */
+}
+
+static void *
+watchdog_f(void *arg)
+{
+	(void) arg;
+	unsigned last_count = ev_iteration(watchdog.loop);
+	double last_progress = clock_monotonic();
+	double last_report = last_progress;
+	while (!watchdog.stop) {
+		double threshold = watchdog.threshold;
+		/*
+		 * Sample twice per threshold so a stall just above
+		 * it cannot slip between two ticks.
+		 */
+		double tick = threshold / 2;
+		struct timespec ts;
+		ts.tv_sec = (time_t) tick;
+		ts.tv_nsec = (long) ((tick - ts.tv_sec) * 1e9);
+		nanosleep(&ts, NULL);
+
+		double now = clock_monotonic();
+		unsigned count = ev_iteration(watchdog.loop);
+		if (count != last_count) {
+			last_count = count;
+			last_progress = now;
+			last_report = now;
+			continue;
+		}
+		/*
+		 * No progress. Report once the stall exceeds the
+		 * threshold, then once more per threshold while it
+		 * lasts, so a multi-second stall leaves several
+		 * samples of where the time went.
+		 */
+		if (now - last_progress < threshold ||
+		    now - last_report < threshold)
+			continue;
+		watchdog.stall = now - last_progress;
+		last_report = now;
+		pthread_kill(watchdog.watched, WATCHDOG_SIGNAL);
+	}
+	return NULL;
+}
+
+void
+watchdog_start(double threshold)
+{
+	watchdog.threshold = threshold;
+	if (watchdog.is_running)
+		return;
+	watchdog.watched = pthread_self();
+	watchdog.loop = loop();
+	watchdog.stop = false;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watchdog_sig_cb;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(WATCHDOG_SIGNAL, &sa, NULL) != 0) {
+		say_syserror("watchdog: sigaction");
+		return;
+	}
+	if (pthread_create(&watchdog.thread, NULL, watchdog_f, NULL) != 0) {
+		say_syserror("watchdog: thread start");
+		return;
+	}
+	watchdog.is_running = true;
+	say_info("started event loop watchdog, stall threshold %.3f sec",
+		 threshold);
+}
+
+void
+watchdog_stop(void)
+{
+	if (!watchdog.is_running)
+		return;
+	watchdog.stop = true;
+	pthread_join(watchdog.thread, NULL);
+	watchdog.is_running = false;
+	say_info("stopped event loop watchdog");
+}
@@ -0,0 +1,26 @@
+-- A consistent-hash router over three replica sets.
+r = box.router.new{ bucket_count = 16, replicasets = { 'host1:3301', 'host2:3301', 'host3:3301' } }
+r:bucket(1)
+r:bucket('abc')
+r:bucket({1, 'abc'})
+-- A scalar key is the same as a one-part key.
+r:bucket(1) == r:bucket({1})
+r:route(1).uri == 'host3:3301'
+info = r:info()
+info.bucket_count
+total = 0
+for _, rs in ipairs(info.replicasets) do total = total + rs.buckets end
+total
+-- Appending a replica set moves only a fraction of the buckets,
+-- and every moved bucket goes to the new member.
+old = {}
+for b = 1, 16 do old[b] = r:replicaset(b).uri end
+r:add_replicaset('host4:3301')
+moved = 0
+ok = true
+for b = 1, 16 do local uri = r:replicaset(b).uri if uri ~= old[b] then moved = moved + 1 ok = ok and uri == 'host4:3301' end end
+moved
+ok
+-- Errors.
+box.router.new{}
+r:replicaset(0)
@@ -245,3 +245,17 @@ i:select({0, 0, 0}, {iterator = 'neighbor'})
 i:select({1, 2, 3, 4, 5, 6}, {iterator = 'BITS_ALL_SET' } )
 
 s:drop()
+
+-- a 1-dimensional rtree is an interval index: intervals are
+-- stored as {from, to} arrays and queried with OVERLAPS / COVERS
+s = box.schema.space.create('intervals')
+_ = s:create_index('primary')
+_ = s:create_index('range', {type = 'rtree', unique = false, dimension = 1, parts = {2, 'array'}})
+s:insert{1, {1, 3}}
+s:insert{2, {2, 5}}
+s:insert{3, {7, 9}}
+-- intervals overlapping [4, 8]
+s.index.range:select({4, 8}, {iterator = 'OVERLAPS'})
+-- intervals covering point 2
+s.index.range:select({2}, {iterator = 'COVERS'})
+s:drop()
@@ -18,6 +18,10 @@ s.index.spatial:select({4,4,11,11}, {iterator = 'LT'})
 s.index.spatial:select({5,5}, {iterator = 'GE'})
 -- select records containing rectangle (1,1,2,2)
 s.index.spatial:select({1,1,2,2}, {iterator = 'GE'})
+-- select records covering point (5,5), same as GE
+s.index.spatial:select({5,5}, {iterator = 'COVERS'})
+-- select records covering rectangle (1,1,2,2)
+s.index.spatial:select({1,1,2,2}, {iterator = 'COVERS'})
 -- select records strict containing rectangle (0,0,5,5)
 s.index.spatial:select({0,0,5,5}, {iterator = 'GT'})
 -- select records overlapping rectangle (9,4,11,6)
@@ -18,6 +18,8 @@ cn.space.tweedledum:select() --small request
 
 box.stat.net.SENT.total > 0
 box.stat.net.RECEIVED.total > 0
+box.stat.net.FIBERS_CREATED.total > 0
+box.stat.net.FIBERS_REUSED.total >= 0
 -- box.stat.net.EVENTS.total > 0
 -- box.stat.net.LOCKS.total > 0
 
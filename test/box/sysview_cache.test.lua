@@ -0,0 +1,47 @@
+env = require('test_run').new()
+net_box = require('net.box')
+uri = require('uri')
+
+--
+-- Materialized sysviews: repeated full scans are cache hits, and
+-- the cache follows schema, user and privilege changes.
+--
+v1 = #box.space._vspace:select{}
+-- A repeated poll returns the same result.
+#box.space._vspace:select{} == v1
+s = box.schema.space.create('matview')
+#box.space._vspace:select{} == v1 + 1
+_ = s:create_index('pk')
+s:drop()
+#box.space._vspace:select{} == v1
+
+-- _vuser follows user creation and drop, no DDL involved.
+u1 = #box.space._vuser:select{}
+box.schema.user.create('transient')
+#box.space._vuser:select{} == u1 + 1
+box.schema.user.drop('transient')
+#box.space._vuser:select{} == u1
+
+-- _vfunc follows function registration.
+f1 = #box.space._vfunc:select{}
+box.schema.func.create('matfunc')
+#box.space._vfunc:select{} == f1 + 1
+box.schema.func.drop('matfunc')
+#box.space._vfunc:select{} == f1
+
+-- A restricted reader sees grants appear and disappear at once,
+-- and does not observe results cached for another user.
+box.schema.user.create('viewer', {password = 'v'})
+t = box.schema.space.create('secret')
+_ = t:create_index('pk')
+LISTEN = uri.parse(box.cfg.listen)
+conn = net_box.connect(LISTEN.host, LISTEN.service, { user = 'viewer', password = 'v' })
+n1 = #conn.space._vspace:select{}
+n1 < #box.space._vspace:select{}
+box.schema.user.grant('viewer', 'read', 'space', 'secret')
+#conn.space._vspace:select{} == n1 + 1
+box.schema.user.revoke('viewer', 'read', 'space', 'secret')
+#conn.space._vspace:select{} == n1
+conn:close()
+t:drop()
+box.schema.user.drop('viewer')
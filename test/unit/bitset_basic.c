@@ -52,6 +52,41 @@ void test_cardinality()
 	footer();
 }
 
+static
+void test_page_promotion()
+{
+	header();
+
+	struct bitset bm;
+	bitset_create(&bm, realloc);
+
+	/*
+	 * Fill a single page well past the sparse->dense
+	 * promotion threshold and check that every bit survives
+	 * the representation changes along the way.
+	 */
+	const size_t NUM_BITS = 512;
+	for (size_t i = 0; i < NUM_BITS; i++) {
+		fail_if(bitset_set(&bm, i * 2) < 0);
+		for (size_t j = 0; j <= i; j++)
+			fail_unless(bitset_test(&bm, j * 2));
+		fail_if(bitset_test(&bm, i * 2 + 1));
+	}
+
+	fail_unless(bitset_cardinality(&bm) == NUM_BITS);
+
+	for (size_t i = 0; i < NUM_BITS; i++) {
+		fail_unless(bitset_clear(&bm, i * 2) == 1);
+		fail_if(bitset_test(&bm, i * 2));
+	}
+
+	fail_unless(bitset_cardinality(&bm) == 0);
+
+	bitset_destroy(&bm);
+
+	footer();
+}
+
 static
 void shuffle(size_t *arr, size_t size)
 {
@@ -200,6 +235,7 @@ int main(int argc, char *argv[])
 	setbuf(stdout, NULL);
 	srand(time(NULL));
 	test_cardinality();
+	test_page_promotion();
 	test_get_set();
 
 	return 0;
@@ -165,10 +165,88 @@ spectrum_test()
 	cout << "memory after destruction = " << quota_used(&q) << endl << endl;
 }
 
+void
+counting_test()
+{
+	cout << "*** " << __func__ << " ***" << endl;
+	struct quota q;
+	quota_init(&q, 1005000);
+	double p = 0.01;
+	uint32_t count = 4000;
+	struct bloom_count bloom;
+	bloom_count_create(&bloom, count, p, &q);
+
+	for (uint32_t i = 0; i < count; i++)
+		bloom_count_add(&bloom, h(i));
+
+	uint64_t error_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!bloom_count_possible_has(&bloom, h(i)))
+			error_count++;
+	}
+
+	/* Remove the first half and check it is (mostly) gone. */
+	for (uint32_t i = 0; i < count / 2; i++)
+		bloom_count_remove(&bloom, h(i));
+
+	uint64_t removed_present = 0;
+	for (uint32_t i = 0; i < count / 2; i++) {
+		if (bloom_count_possible_has(&bloom, h(i)))
+			removed_present++;
+	}
+	/* The second half must not be affected by the removal. */
+	for (uint32_t i = count / 2; i < count; i++) {
+		if (!bloom_count_possible_has(&bloom, h(i)))
+			error_count++;
+	}
+	bool removed_rate_is_good = removed_present < 1.5 * p * (count / 2);
+	cout << "error_count = " << error_count << endl;
+	cout << "removed_rate_is_good = " << removed_rate_is_good << endl;
+	bloom_count_destroy(&bloom, &q);
+	cout << "memory after destruction = " << quota_used(&q) << endl << endl;
+}
+
+void
+scalable_test()
+{
+	cout << "*** " << __func__ << " ***" << endl;
+	struct quota q;
+	quota_init(&q, 1005000);
+	double p = 0.01;
+	uint32_t count = 10000;
+	struct bloom_scalable scalable;
+	/* Start with a capacity 10 times less than the data set. */
+	bloom_scalable_create(&scalable, count / 10, p, &q);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (bloom_scalable_add(&scalable, h(i), &q) != 0)
+			break;
+	}
+
+	uint64_t error_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!bloom_scalable_possible_has(&scalable, h(i)))
+			error_count++;
+	}
+	uint64_t false_positive = 0;
+	for (uint32_t i = count; i < 2 * count; i++) {
+		if (bloom_scalable_possible_has(&scalable, h(i)))
+			false_positive++;
+	}
+	bool fpr_rate_is_good = false_positive < 1.5 * p * count;
+	cout << "filter_count = " << scalable.count << endl;
+	cout << "error_count = " << error_count << endl;
+	cout << "fpr_rate_is_good = " << fpr_rate_is_good << endl;
+	bloom_scalable_destroy(&scalable, &q);
+	cout << "memory after destruction = " << quota_used(&q) << endl << endl;
+}
+
 int
 main(void)
 {
 	simple_test();
 	store_load_test();
 	spectrum_test();
+	counting_test();
+	scalable_test();
 }
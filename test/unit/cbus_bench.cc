@@ -0,0 +1,148 @@
+/*
+ * A micro-benchmark of cbus message delivery. Producer cords
+ * blast empty messages over cpipes into one consumer endpoint,
+ * first through the mutex-protected queue, then through the
+ * lock-free ring enabled with cbus_endpoint_set_lockfree(), so
+ * the two hot paths can be compared directly. The throughput of
+ * each run is reported on stderr.
+ *
+ * Knobs (environment):
+ *   CBUS_BENCH_PRODUCERS - producer cords, default 4
+ *   CBUS_BENCH_MESSAGES  - messages per producer, default 100000
+ */
+#include "memory.h"
+#include "fiber.h"
+#include "cbus.h"
+#include "clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+	DEFAULT_PRODUCERS = 4,
+	DEFAULT_MESSAGES = 100000,
+	/** Messages pushed between producer fiber yields. */
+	PUSH_BATCH = 64,
+};
+
+struct bench_producer {
+	struct cord cord;
+	/** The range of the message array this producer owns. */
+	int64_t first;
+	int64_t count;
+};
+
+static struct cmsg *msgs;
+static int64_t total;
+static int64_t delivered;
+static bool use_ring;
+
+static void
+bench_deliver(struct cmsg *msg)
+{
+	(void) msg;
+	delivered++;
+}
+
+static const struct cmsg_hop bench_route[] = {
+	{ bench_deliver, NULL },
+};
+
+static int
+env_int(const char *name, int def)
+{
+	const char *str = getenv(name);
+	return str != NULL ? atoi(str) : def;
+}
+
+static int
+producer_f(va_list ap)
+{
+	struct bench_producer *p = va_arg(ap, struct bench_producer *);
+	struct cpipe pipe;
+	cpipe_create(&pipe, "bench");
+	for (int64_t i = 0; i < p->count; i++) {
+		cmsg_init(&msgs[p->first + i], bench_route);
+		cpipe_push(&pipe, &msgs[p->first + i]);
+		/* Let the loop run so the staged input flushes. */
+		if (i % PUSH_BATCH == PUSH_BATCH - 1)
+			fiber_sleep(0);
+	}
+	cpipe_destroy(&pipe);
+	return 0;
+}
+
+static int
+consumer_f(va_list ap)
+{
+	(void) ap;
+	int producers = env_int("CBUS_BENCH_PRODUCERS", DEFAULT_PRODUCERS);
+	int64_t messages = env_int("CBUS_BENCH_MESSAGES", DEFAULT_MESSAGES);
+	total = producers * messages;
+	delivered = 0;
+
+	msgs = (struct cmsg *) calloc(total, sizeof(*msgs));
+	if (msgs == NULL)
+		panic("failed to allocate messages");
+
+	struct cbus_endpoint endpoint;
+	cbus_endpoint_create(&endpoint, "bench", fiber_schedule_cb, fiber());
+	if (use_ring)
+		cbus_endpoint_set_lockfree(&endpoint);
+
+	struct bench_producer *producers_arr = (struct bench_producer *)
+		calloc(producers, sizeof(*producers_arr));
+	if (producers_arr == NULL)
+		panic("failed to allocate producers");
+
+	double start = clock_monotonic();
+	for (int i = 0; i < producers; i++) {
+		struct bench_producer *p = &producers_arr[i];
+		p->first = i * messages;
+		p->count = messages;
+		if (cord_costart(&p->cord, "bench-producer",
+				 producer_f, p) != 0)
+			panic("failed to start a producer");
+	}
+	while (delivered < total) {
+		cbus_process(&endpoint);
+		if (delivered >= total)
+			break;
+		fiber_yield();
+	}
+	double elapsed = clock_monotonic() - start;
+
+	for (int i = 0; i < producers; i++)
+		cord_join(&producers_arr[i].cord);
+	cbus_endpoint_destroy(&endpoint, cbus_process);
+
+	fprintf(stderr, "%s: %d producers, %lld messages: %.0f msg/sec\n",
+		use_ring ? "lock-free ring" : "mutex queue",
+		producers, (long long) total, total / elapsed);
+
+	free(producers_arr);
+	free(msgs);
+	ev_break(loop(), EVBREAK_ALL);
+	return 0;
+}
+
+int
+main()
+{
+	memory_init();
+	fiber_init(fiber_cxx_invoke);
+	cbus_init();
+
+	use_ring = false;
+	fiber_wakeup(fiber_new_xc("bench-consumer", consumer_f));
+	ev_run(loop(), 0);
+
+	use_ring = true;
+	fiber_wakeup(fiber_new_xc("bench-consumer", consumer_f));
+	ev_run(loop(), 0);
+
+	cbus_free();
+	fiber_free();
+	memory_free();
+	return 0;
+}
@@ -0,0 +1,149 @@
+#include "salad/frozen_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "unit.h"
+
+static void
+simple_test(void)
+{
+	header();
+	const uint64_t values[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29 };
+	const uint64_t count = sizeof(values) / sizeof(values[0]);
+	struct frozen_set set;
+	fail_unless(frozen_set_create(&set, values, count) == 0);
+
+	int error_count = 0;
+	uint64_t i, j = 0;
+	for (i = 0; i <= 31; i++) {
+		bool has = j < count && values[j] == i;
+		if (has)
+			j++;
+		if (frozen_set_contains(&set, i) != has)
+			error_count++;
+	}
+	for (i = 0; i < count; i++) {
+		if (frozen_set_get(&set, i) != values[i])
+			error_count++;
+	}
+	j = 0;
+	for (i = 0; i <= 31; i++) {
+		uint64_t next;
+		int rc = frozen_set_next(&set, i, &next);
+		while (j < count && values[j] < i)
+			j++;
+		if (j == count) {
+			if (rc != -1)
+				error_count++;
+		} else if (rc != 0 || next != values[j]) {
+			error_count++;
+		}
+	}
+	printf("error_count = %d\n", error_count);
+	frozen_set_destroy(&set);
+
+	/* An empty set has nothing and iterates over nothing. */
+	fail_unless(frozen_set_create(&set, NULL, 0) == 0);
+	uint64_t next;
+	fail_unless(!frozen_set_contains(&set, 0));
+	fail_unless(frozen_set_next(&set, 0, &next) == -1);
+	struct frozen_set_iterator it;
+	frozen_set_iterator_init(&set, &it, 0);
+	fail_unless(frozen_set_iterator_next(&it, &next) == -1);
+	printf("empty set is empty\n");
+	frozen_set_destroy(&set);
+	footer();
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *) a;
+	uint64_t vb = *(const uint64_t *) b;
+	return va < vb ? -1 : va > vb;
+}
+
+static void
+stress_test(void)
+{
+	header();
+	srand(42);
+	int error_count = 0;
+	/* From nearly dense to very sparse universes. */
+	uint64_t spread;
+	for (spread = 2; spread <= 2000000; spread *= 100) {
+		enum { COUNT = 10000 };
+		static uint64_t values[COUNT];
+		uint64_t i, n = 0, prev = 0;
+		for (i = 0; i < COUNT; i++) {
+			prev += 1 + rand() % spread;
+			values[n++] = prev;
+		}
+		struct frozen_set set;
+		fail_unless(frozen_set_create(&set, values, n) == 0);
+
+		for (i = 0; i < n; i++) {
+			if (!frozen_set_contains(&set, values[i]))
+				error_count++;
+			if (frozen_set_get(&set, i) != values[i])
+				error_count++;
+		}
+		/* Probe random points, compare with a binary search. */
+		for (i = 0; i < 10000; i++) {
+			uint64_t v = rand() % (values[n - 1] + spread);
+			bool has = bsearch(&v, values, n, sizeof(v),
+					   compare_u64) != NULL;
+			if (frozen_set_contains(&set, v) != has)
+				error_count++;
+			uint64_t *up = values + n;
+			uint64_t lo = 0, hi = n;
+			while (lo < hi) {
+				uint64_t mid = (lo + hi) / 2;
+				if (values[mid] < v)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			up = values + lo;
+			uint64_t next;
+			int rc = frozen_set_next(&set, v, &next);
+			if (up == values + n) {
+				if (rc != -1)
+					error_count++;
+			} else if (rc != 0 || next != *up) {
+				error_count++;
+			}
+		}
+		/* Full scan and a scan from a middle point. */
+		struct frozen_set_iterator it;
+		uint64_t next;
+		frozen_set_iterator_init(&set, &it, 0);
+		for (i = 0; i < n; i++) {
+			if (frozen_set_iterator_next(&it, &next) != 0 ||
+			    next != values[i])
+				error_count++;
+		}
+		if (frozen_set_iterator_next(&it, &next) != -1)
+			error_count++;
+		frozen_set_iterator_init(&set, &it, values[n / 2]);
+		for (i = n / 2; i < n; i++) {
+			if (frozen_set_iterator_next(&it, &next) != 0 ||
+			    next != values[i])
+				error_count++;
+		}
+		bool compact = frozen_set_memsize(&set) <
+			       n * sizeof(uint64_t);
+		printf("spread %d: error_count = %d, "
+		       "smaller_than_plain_array = %d\n",
+		       (int) spread, error_count, (int) compact);
+		frozen_set_destroy(&set);
+	}
+	footer();
+}
+
+int
+main(void)
+{
+	simple_test();
+	stress_test();
+	return 0;
+}
@@ -78,12 +78,58 @@ ipc_get()
 	status = check_plan();
 }
 
+void
+ipc_spsc()
+{
+	header();
+	plan(9);
+
+	struct ipc_channel *channel = ipc_channel_new_spsc(4);
+	ok(channel != NULL, "ipc_channel_new_spsc()");
+
+	char one, two, three;
+	ok(ipc_channel_put_timeout(channel, &one, 0) == 0,
+	   "ipc_channel_put(spsc 1)");
+	ok(ipc_channel_put_timeout(channel, &two, 0) == 0,
+	   "ipc_channel_put(spsc 2)");
+	ok(ipc_channel_put_timeout(channel, &three, 0) == 0,
+	   "ipc_channel_put(spsc 3)");
+
+	struct ipc_msg *msgs[4];
+	int n = ipc_channel_get_msg_batch(channel, msgs, 4, 0);
+	ok(n == 3, "ipc_channel_get_msg_batch() count");
+	ok(((struct ipc_value *) msgs[0])->data == &one &&
+	   ((struct ipc_value *) msgs[1])->data == &two &&
+	   ((struct ipc_value *) msgs[2])->data == &three,
+	   "ipc_channel_get_msg_batch() order");
+	for (int i = 0; i < n; i++)
+		msgs[i]->destroy(msgs[i]);
+
+	char dummy;
+	for (int i = 0; i < 4; i++)
+		ipc_channel_put(channel, &dummy);
+	ok(ipc_channel_is_full(channel) == true, "ipc_channel_is_full(spsc)");
+	ok(ipc_channel_put_timeout(channel, &dummy, 0) == -1,
+	   "ipc_channel_put_timeout(spsc full)");
+
+	ipc_channel_close(channel);
+
+	void *ptr;
+	ok(ipc_channel_get(channel, &ptr) == -1, "ipc_channel_get(spsc closed)");
+
+	ipc_channel_delete(channel);
+
+	footer();
+	status = check_plan();
+}
+
 int
 main_f(va_list ap)
 {
 	(void) ap;
 	ipc_basic();
 	ipc_get();
+	ipc_spsc();
 	ev_break(loop(), EVBREAK_ALL);
 	return 0;
 }
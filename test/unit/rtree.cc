@@ -277,11 +277,82 @@ neighbor_test()
 }
 
 
+static void
+bulk_load_test()
+{
+	header();
+
+	const size_t test_count = 10000;
+	struct rtree tree;
+	rtree_init(&tree, 2, extent_size,
+		   extent_alloc, extent_free, &page_count,
+		   RTREE_EUCLID);
+
+	struct rtree_rect rect;
+	size_t entry_size = rtree_build_entry_size(&tree);
+	char *entries = (char *)malloc(entry_size * test_count);
+	if (entries == NULL) {
+		fail("entry array allocation", "failed");
+	}
+	for (size_t i = 0; i < test_count; i++) {
+		rtree_set2d(&rect, i % 100, i / 100,
+			    i % 100 + 0.5, i / 100 + 0.5);
+		rtree_build_entry_set(&tree, entries, i, &rect,
+				      (record_t)(i + 1));
+	}
+	if (rtree_bulk_load(&tree, entries, test_count) != 0) {
+		fail("bulk load", "failed");
+	}
+	free(entries);
+
+	if (rtree_number_of_records(&tree) != test_count) {
+		fail("Tree count mismatch", "true");
+	}
+
+	struct rtree_iterator iterator;
+	rtree_iterator_init(&iterator);
+	for (size_t i = 0; i < test_count; i++) {
+		record_t rec = (record_t)(i + 1);
+
+		rtree_set2d(&rect, i % 100, i / 100,
+			    i % 100 + 0.5, i / 100 + 0.5);
+
+		if (!rtree_search(&tree, &rect, SOP_EQUALS, &iterator)) {
+			fail("element in tree", "false");
+		}
+		if (rtree_iterator_next(&iterator) != rec) {
+			fail("right search result", "true");
+		}
+		if (rtree_iterator_next(&iterator)) {
+			fail("single search result", "true");
+		}
+	}
+
+	/* The loaded tree must stay fully operational */
+	rtree_set2d(&rect, 1000, 1000, 1000.5, 1000.5);
+	rtree_insert(&tree, &rect, (record_t)(test_count + 1));
+	if (!rtree_search(&tree, &rect, SOP_EQUALS, &iterator)) {
+		fail("inserted element in tree", "false");
+	}
+	if (!rtree_remove(&tree, &rect, (record_t)(test_count + 1))) {
+		fail("delete element in tree", "false");
+	}
+	if (rtree_number_of_records(&tree) != test_count) {
+		fail("Tree count mismatch after delete", "true");
+	}
+
+	rtree_iterator_destroy(&iterator);
+	rtree_destroy(&tree);
+
+	footer();
+}
+
 int
 main(void)
 {
 	simple_check();
 	neighbor_test();
+	bulk_load_test();
 	if (page_count != 0) {
 		fail("memory leak!", "true");
 	}
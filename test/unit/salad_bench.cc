@@ -0,0 +1,266 @@
+/*
+ * Micro-benchmarks of the core data structures on the request
+ * hot path: BPS tree insert and seek, light hash insert and
+ * probe, msgpack encode/decode and ibuf/obuf cycling. Each
+ * benchmark prints one JSON line on stderr, e.g.
+ *
+ *   {"bench": "bps_tree_insert", "items": 1000000, "ns_per_op": 85.2}
+ *
+ * so results of two builds can be diffed mechanically. stdout is
+ * left empty for the test harness.
+ *
+ * Knobs (environment):
+ *   SALAD_BENCH_ITEMS - operations per benchmark, default 1000000
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <sys/mman.h>
+
+#include "small/quota.h"
+#include "small/slab_arena.h"
+#include "small/slab_cache.h"
+#include "small/ibuf.h"
+#include "small/obuf.h"
+#include "msgpuck.h"
+
+enum {
+	DEFAULT_ITEMS = 1000000,
+	EXTENT_SIZE = 16 * 1024,
+};
+
+static int items;
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+report(const char *name, double start_ns, double ops)
+{
+	fprintf(stderr,
+		"{\"bench\": \"%s\", \"items\": %.0f, \"ns_per_op\": %.1f}\n",
+		name, ops, (now_ns() - start_ns) / ops);
+}
+
+/**
+ * Cheap deterministic pseudo-random stream (xorshift), so the
+ * key sequence is identical in every build being compared and
+ * can be replayed for the seek phase.
+ */
+static const uint64_t RNG_SEED = 88172645463325252ULL;
+static uint64_t rng_state = RNG_SEED;
+
+static inline uint64_t
+rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+/* {{{ BPS tree insert/seek */
+
+#define BPS_TREE_NAME bench
+#define BPS_TREE_BLOCK_SIZE 512
+#define BPS_TREE_EXTENT_SIZE EXTENT_SIZE
+#define BPS_TREE_COMPARE(a, b, arg) ((a) < (b) ? -1 : (a) > (b) ? 1 : 0)
+#define BPS_TREE_COMPARE_KEY(a, b, arg) ((a) < (b) ? -1 : (a) > (b) ? 1 : 0)
+#define bps_tree_elem_t int64_t
+#define bps_tree_key_t int64_t
+#define bps_tree_arg_t int
+#include "salad/bps_tree.h"
+
+static void *
+extent_alloc(void *ctx)
+{
+	(void)ctx;
+	return malloc(EXTENT_SIZE);
+}
+
+static void
+extent_free(void *ctx, void *extent)
+{
+	(void)ctx;
+	free(extent);
+}
+
+static void
+bench_bps_tree(void)
+{
+	bench tree;
+	bench_create(&tree, 0, extent_alloc, extent_free, NULL);
+
+	rng_state = RNG_SEED;
+	double start = now_ns();
+	for (int i = 0; i < items; i++)
+		bench_insert(&tree, (int64_t)rng_next(), 0);
+	report("bps_tree_insert", start, items);
+
+	/* Replay the same keys: every seek hits. */
+	rng_state = RNG_SEED;
+	size_t found = 0;
+	start = now_ns();
+	for (int i = 0; i < items; i++)
+		found += bench_find(&tree, (int64_t)rng_next()) != NULL;
+	report("bps_tree_seek", start, items);
+	if (found != tree.size)
+		fprintf(stderr, "{\"warning\": \"bps_tree_seek misses\"}\n");
+
+	bench_destroy(&tree);
+}
+
+/* }}} */
+
+/* {{{ Light hash insert/probe */
+
+#define LIGHT_NAME
+#define LIGHT_DATA_TYPE uint64_t
+#define LIGHT_KEY_TYPE uint64_t
+#define LIGHT_CMP_ARG_TYPE int
+#define LIGHT_EQUAL(a, b, arg) ((a) == (b))
+#define LIGHT_EQUAL_KEY(a, b, arg) ((a) == (b))
+#include "salad/light.h"
+
+static void
+bench_light(void)
+{
+	struct light_core ht;
+	light_create(&ht, EXTENT_SIZE, extent_alloc, extent_free, NULL, 0);
+
+	rng_state = RNG_SEED;
+	double start = now_ns();
+	for (int i = 0; i < items; i++) {
+		uint64_t v = rng_next();
+		light_insert(&ht, (uint32_t)v, v);
+	}
+	report("light_insert", start, items);
+
+	rng_state = RNG_SEED;
+	size_t found = 0;
+	start = now_ns();
+	for (int i = 0; i < items; i++) {
+		uint64_t v = rng_next();
+		found += light_find(&ht, (uint32_t)v, v) != light_end;
+	}
+	report("light_probe", start, items);
+	if (found != (size_t)items)
+		fprintf(stderr, "{\"warning\": \"light_probe misses\"}\n");
+
+	light_destroy(&ht);
+}
+
+/* }}} */
+
+/* {{{ msgpack codec */
+
+static void
+bench_mp_codec(void)
+{
+	/*
+	 * A typical small tuple: [unsigned, unsigned, string].
+	 * Encoded into one reused buffer, then decoded back.
+	 */
+	char buf[64];
+
+	rng_state = RNG_SEED;
+	double start = now_ns();
+	for (int i = 0; i < items; i++) {
+		char *d = buf;
+		d = mp_encode_array(d, 3);
+		d = mp_encode_uint(d, rng_next());
+		d = mp_encode_uint(d, (uint32_t)rng_next());
+		d = mp_encode_str(d, "benchmark", 9);
+		assert(d <= buf + sizeof(buf));
+	}
+	report("mp_encode", start, items);
+
+	uint64_t sink = 0;
+	start = now_ns();
+	for (int i = 0; i < items; i++) {
+		const char *d = buf;
+		uint32_t size = mp_decode_array(&d);
+		sink += size;
+		sink += mp_decode_uint(&d);
+		sink += mp_decode_uint(&d);
+		uint32_t len;
+		mp_decode_str(&d, &len);
+		sink += len;
+	}
+	report("mp_decode", start, items);
+	if (sink == 0)
+		fprintf(stderr, "{\"warning\": \"mp_decode sink is zero\"}\n");
+}
+
+/* }}} */
+
+/* {{{ ibuf/obuf cycling */
+
+static void
+bench_iobuf(struct slab_cache *slabc)
+{
+	/*
+	 * The request buffer pattern: reserve, fill a little,
+	 * reset - in a buffer that stays warm, as iobufs do on a
+	 * live connection.
+	 */
+	struct ibuf ibuf;
+	ibuf_create(&ibuf, slabc, EXTENT_SIZE);
+	double start = now_ns();
+	for (int i = 0; i < items; i++) {
+		char *p = (char *)ibuf_alloc(&ibuf, 128);
+		memset(p, i & 0xff, 128);
+		if (ibuf_used(&ibuf) >= EXTENT_SIZE / 2)
+			ibuf_reset(&ibuf);
+	}
+	report("ibuf_cycle", start, items);
+	ibuf_destroy(&ibuf);
+
+	struct obuf obuf;
+	obuf_create(&obuf, slabc, EXTENT_SIZE);
+	start = now_ns();
+	for (int i = 0; i < items; i++) {
+		char *p = (char *)obuf_alloc(&obuf, 128);
+		memset(p, i & 0xff, 128);
+		if (obuf_size(&obuf) >= EXTENT_SIZE / 2)
+			obuf_reset(&obuf);
+	}
+	report("obuf_cycle", start, items);
+	obuf_destroy(&obuf);
+}
+
+/* }}} */
+
+int
+main()
+{
+	const char *env = getenv("SALAD_BENCH_ITEMS");
+	items = env != NULL ? atoi(env) : DEFAULT_ITEMS;
+	if (items <= 0)
+		items = DEFAULT_ITEMS;
+
+	struct quota quota;
+	quota_init(&quota, QUOTA_MAX);
+	struct slab_arena arena;
+	slab_arena_create(&arena, &quota, 0, SLAB_MIN_SIZE, MAP_PRIVATE);
+	struct slab_cache slabc;
+	slab_cache_create(&slabc, &arena);
+
+	bench_bps_tree();
+	bench_light();
+	bench_mp_codec();
+	bench_iobuf(&slabc);
+
+	slab_cache_destroy(&slabc);
+	slab_arena_destroy(&arena);
+	return 0;
+}
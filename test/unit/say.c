@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "unit.h"
 #include "say.h"
 
@@ -42,11 +44,25 @@ parse_syslog_opts(const char *input)
 	return 0;
 }
 
+static int
+count_lines(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	int lines = 0, c;
+	while ((c = fgetc(f)) != EOF)
+		if (c == '\n')
+			lines++;
+	fclose(f);
+	return lines;
+}
+
 int main()
 {
 	say_logger_init("/dev/null", S_INFO, 0, 0);
 
-	plan(20);
+	plan(23);
 
 #define PARSE_LOGGER_TYPE(input, rc) \
 	ok(parse_logger_type(input) == rc, "%s", input)
@@ -76,5 +92,25 @@ int main()
 	PARSE_SYSLOG_OPTS("facility=local1,facility=local2", -1);
 	PARSE_SYSLOG_OPTS("identity=foo,identity=bar", -1);
 
+	char path[] = "/tmp/say_test.XXXXXX";
+	close(mkstemp(path));
+	say_logger_init(path, S_INFO, 0, 0);
+
+	say_set_rate_limit(5);
+	for (int i = 0; i < 20; i++)
+		say_info("rate limit test");
+	say_set_rate_limit(0);
+	ok(count_lines(path) + (int)say_rate_dropped() == 20,
+	   "rate limiter drops are accounted");
+	ok(say_rate_dropped() >= 10, "burst is throttled");
+
+	int base = count_lines(path);
+	say_set_async(true);
+	for (int i = 0; i < 10; i++)
+		say_info("async test %d", i);
+	say_set_async(false);
+	ok(count_lines(path) - base == 10, "async mode flushes on stop");
+
+	unlink(path);
 	return check_plan();
 }
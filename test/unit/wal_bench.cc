@@ -0,0 +1,216 @@
+/*
+ * A micro-benchmark of the WAL write path. Producer fibers
+ * submit synthetic journal entries to a writer fiber which
+ * drains its input in batches, exactly like wal_write() feeds
+ * wal_write_to_disk(): an entry arriving while the writer is
+ * busy piles up into the next batch. The benchmark reports
+ * rows-per-batch and fsync() latency histograms on stderr, so
+ * batching efficiency can be compared across concurrency levels.
+ *
+ * Knobs (environment):
+ *   WAL_BENCH_FIBERS   - producer concurrency, default 32
+ *   WAL_BENCH_ROWS     - total rows to write, default 100000
+ *   WAL_BENCH_ROW_SIZE - row body size in bytes, default 64
+ */
+#include "memory.h"
+#include "fiber.h"
+#include "say.h"
+#include "crc32.h"
+#include "random.h"
+#include "clock.h"
+#include "histogram.h"
+#include "tt_uuid.h"
+#include "salad/stailq.h"
+#include "box/xlog.h"
+#include "box/xrow.h"
+#include "box/iproto_constants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+enum {
+	DEFAULT_FIBERS = 32,
+	DEFAULT_ROWS = 100000,
+	DEFAULT_ROW_SIZE = 64,
+	MAX_ROW_SIZE = 16 * 1024,
+};
+
+/** A synthetic journal entry, one row. Lives on producer stack. */
+struct bench_entry {
+	struct stailq_entry fifo;
+	struct fiber *fiber;
+	bool done;
+};
+
+static struct stailq input;
+static struct fiber *writer_fiber;
+static struct xlog wal;
+/** Rows not yet submitted by producers. */
+static int rows_left;
+/** Rows already written out by the writer. */
+static int rows_written;
+static int total_rows;
+static int row_size;
+static int64_t lsn;
+static char payload[MAX_ROW_SIZE];
+
+static struct histogram *batch_rows_hist;
+static struct histogram *fsync_delay_hist;
+
+static int
+env_int(const char *name, int def)
+{
+	const char *str = getenv(name);
+	return str != NULL ? atoi(str) : def;
+}
+
+static int
+producer_f(va_list ap)
+{
+	(void) ap;
+	while (rows_left > 0) {
+		rows_left--;
+		struct bench_entry entry;
+		entry.fiber = fiber();
+		entry.done = false;
+		stailq_add_tail_entry(&input, &entry, fifo);
+		fiber_wakeup(writer_fiber);
+		while (!entry.done)
+			fiber_yield();
+	}
+	return 0;
+}
+
+static int
+writer_f(va_list ap)
+{
+	(void) ap;
+	while (rows_written < total_rows) {
+		if (stailq_empty(&input)) {
+			fiber_yield();
+			continue;
+		}
+		/* Steal everything queued so far - one batch. */
+		struct stailq batch;
+		stailq_create(&batch);
+		stailq_concat(&batch, &input);
+
+		int64_t batch_rows = 0;
+		struct bench_entry *entry;
+		stailq_foreach_entry(entry, &batch, fifo) {
+			struct xrow_header row;
+			memset(&row, 0, sizeof(row));
+			row.type = IPROTO_INSERT;
+			row.replica_id = 1;
+			row.lsn = ++lsn;
+			row.bodycnt = 1;
+			row.body[0].iov_base = payload;
+			row.body[0].iov_len = row_size;
+			xlog_tx_begin(&wal);
+			if (xlog_write_row(&wal, &row) < 0 ||
+			    xlog_tx_commit(&wal) < 0)
+				panic("failed to write row");
+			batch_rows++;
+		}
+		if (xlog_flush(&wal) < 0)
+			panic("failed to flush xlog");
+		double start = clock_monotonic();
+		if (xlog_sync(&wal) != 0)
+			panic("failed to sync xlog");
+		histogram_collect(fsync_delay_hist,
+				  (clock_monotonic() - start) * 1e6);
+		histogram_collect(batch_rows_hist, batch_rows);
+		rows_written += batch_rows;
+
+		struct bench_entry *next;
+		stailq_foreach_entry_safe(entry, next, &batch, fifo) {
+			entry->done = true;
+			fiber_wakeup(entry->fiber);
+		}
+	}
+	ev_break(loop(), EVBREAK_ALL);
+	return 0;
+}
+
+int
+main()
+{
+	memory_init();
+	fiber_init(fiber_cxx_invoke);
+	random_init();
+	crc32_init();
+
+	int fibers = env_int("WAL_BENCH_FIBERS", DEFAULT_FIBERS);
+	total_rows = env_int("WAL_BENCH_ROWS", DEFAULT_ROWS);
+	row_size = env_int("WAL_BENCH_ROW_SIZE", DEFAULT_ROW_SIZE);
+	if (row_size > MAX_ROW_SIZE)
+		row_size = MAX_ROW_SIZE;
+	rows_left = total_rows;
+	memset(payload, 'x', sizeof(payload));
+
+	static int64_t rows_buckets[] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 256, 512,
+		1024, 2048, 4096, 8192, 16384,
+	};
+	enum { US = 1, MS = 1000 * US };
+	static int64_t delay_buckets[] = {
+		10 * US, 50 * US, 100 * US, 250 * US, 500 * US,
+		1 * MS, 2 * MS, 5 * MS, 10 * MS, 25 * MS, 50 * MS,
+		100 * MS, 250 * MS, 500 * MS, 1000 * MS,
+	};
+	batch_rows_hist = histogram_new(rows_buckets, lengthof(rows_buckets));
+	fsync_delay_hist = histogram_new(delay_buckets,
+					 lengthof(delay_buckets));
+	if (batch_rows_hist == NULL || fsync_delay_hist == NULL)
+		panic("failed to allocate histograms");
+
+	char dirname[] = "/tmp/wal_bench.XXXXXX";
+	if (mkdtemp(dirname) == NULL)
+		panic_syserror("mkdtemp");
+
+	struct tt_uuid uuid;
+	tt_uuid_create(&uuid);
+	struct xdir dir;
+	xdir_create(&dir, dirname, XLOG, &uuid);
+	/* Benchmark a durable WAL: block on fsync() like
+	 * wal_mode = 'fsync' does. */
+	dir.sync_is_async = false;
+	struct vclock vclock;
+	vclock_create(&vclock);
+	if (xdir_create_xlog(&dir, &wal, &vclock, NULL) != 0)
+		panic("failed to create xlog");
+
+	stailq_create(&input);
+	writer_fiber = fiber_new_xc("wal-bench-writer", writer_f);
+	fiber_wakeup(writer_fiber);
+	for (int i = 0; i < fibers; i++)
+		fiber_wakeup(fiber_new_xc("wal-bench-producer", producer_f));
+
+	double start = clock_monotonic();
+	ev_run(loop(), 0);
+	double elapsed = clock_monotonic() - start;
+
+	char buf[1024];
+	fprintf(stderr, "%d fibers, %d rows of %d bytes: %.0f rows/sec, "
+		"%zu batches, %zu fsyncs\n", fibers, total_rows, row_size,
+		total_rows / elapsed, batch_rows_hist->total,
+		fsync_delay_hist->total);
+	histogram_snprint(buf, sizeof(buf), batch_rows_hist);
+	fprintf(stderr, "rows per batch: %s\n", buf);
+	histogram_snprint(buf, sizeof(buf), fsync_delay_hist);
+	fprintf(stderr, "fsync delay, us: %s\n", buf);
+
+	char filename[PATH_MAX];
+	snprintf(filename, sizeof(filename), "%s", wal.filename);
+	xlog_close(&wal, false);
+	unlink(filename);
+	rmdir(dirname);
+	xdir_destroy(&dir);
+	histogram_delete(batch_rows_hist);
+	histogram_delete(fsync_delay_hist);
+
+	fiber_free();
+	memory_free();
+	return 0;
+}
@@ -31,12 +31,15 @@
 extern "C" {
 #include "unit.h"
 } /* extern "C" */
+#include <msgpuck.h>
 #include "trivia/util.h"
 #include "box/xrow.h"
 #include "box/iproto_constants.h"
 #include "tt_uuid.h"
 #include "version.h"
 #include "random.h"
+#include "memory.h"
+#include "fiber.h"
 
 int
 test_greeting()
@@ -180,15 +183,93 @@ test_greeting()
 	return check_plan();
 }
 
+int
+test_xrow_header_codec()
+{
+	plan(17);
+
+	/*
+	 * Row layout round-trip: the encoder emits the canonical
+	 * key order, so this exercises the fast decode path.
+	 */
+	struct xrow_header header, decoded;
+	memset(&header, 0, sizeof(header));
+	header.type = IPROTO_INSERT;
+	header.replica_id = 3;
+	header.lsn = 100500;
+	header.tm = 12345.6;
+
+	struct iovec vec[XROW_IOVMAX];
+	is(xrow_header_encode(&header, vec, 0), 1, "encode");
+	const char *pos = (const char *) vec[0].iov_base;
+	const char *end = pos + vec[0].iov_len;
+	is(xrow_header_decode(&decoded, &pos, end), 0, "decode");
+	ok(pos == end, "decode.pos");
+	is(decoded.type, header.type, "decode.type");
+	is(decoded.replica_id, header.replica_id, "decode.replica_id");
+	is(decoded.lsn, header.lsn, "decode.lsn");
+	ok(decoded.tm == header.tm, "decode.tm");
+
+	/* A net.box-style request header. */
+	char buf[64];
+	char *d = mp_encode_map(buf, 3);
+	d = mp_encode_uint(d, IPROTO_SYNC);
+	d = mp_encode_uint(d, 0x123456789ULL);
+	d = mp_encode_uint(d, IPROTO_SCHEMA_VERSION);
+	d = mp_encode_uint(d, 42);
+	d = mp_encode_uint(d, IPROTO_REQUEST_TYPE);
+	d = mp_encode_uint(d, IPROTO_SELECT);
+	pos = buf;
+	is(xrow_header_decode(&decoded, &pos, d), 0, "request.decode");
+	is(decoded.sync, 0x123456789ULL, "request.sync");
+	is(decoded.schema_version, 42, "request.schema_version");
+	is(decoded.type, IPROTO_SELECT, "request.type");
+
+	/*
+	 * A non-canonical key order must take the generic path
+	 * and still decode every field.
+	 */
+	d = mp_encode_map(buf, 3);
+	d = mp_encode_uint(d, IPROTO_LSN);
+	d = mp_encode_uint(d, 777);
+	d = mp_encode_uint(d, IPROTO_REPLICA_ID);
+	d = mp_encode_uint(d, 2);
+	d = mp_encode_uint(d, IPROTO_REQUEST_TYPE);
+	d = mp_encode_uint(d, IPROTO_DELETE);
+	pos = buf;
+	is(xrow_header_decode(&decoded, &pos, d), 0, "unordered.decode");
+	is(decoded.lsn, 777, "unordered.lsn");
+	is(decoded.replica_id, 2, "unordered.replica_id");
+	is(decoded.type, IPROTO_DELETE, "unordered.type");
+
+	/* A truncated canonical header must not decode. */
+	d = mp_encode_map(buf, 2);
+	d = mp_encode_uint(d, IPROTO_REQUEST_TYPE);
+	d = mp_encode_uint(d, IPROTO_INSERT);
+	d = mp_encode_uint(d, IPROTO_LSN);
+	d = mp_encode_uint(d, 0x123456789ULL);
+	pos = buf;
+	isnt(xrow_header_decode(&decoded, &pos, d - 3), 0, "truncated");
+	ok(pos == buf, "truncated.pos");
+
+	fiber_gc();
+	return check_plan();
+}
+
 int
 main(void)
 {
-	plan(1);
+	plan(2);
 
 	random_init();
+	memory_init();
+	fiber_init(fiber_c_invoke);
 
 	test_greeting();
+	test_xrow_header_codec();
 
+	fiber_free();
+	memory_free();
 	random_free();
 
 	return check_plan();
@@ -131,6 +131,25 @@ s:drop() -- index is gone
 fiber.sleep(0.05)
 errinj.set("ERRINJ_VY_SQUASH_TIMEOUT", 0)
 
+--
+-- A read that replays a long upsert chain reschedules background
+-- squashing if the commit-time attempt was lost.
+--
+s = box.schema.space.create('test', {engine='vinyl'})
+_ = s:create_index('pk')
+s:insert{0, 0}
+box.snapshot()
+-- Fail the read made by the squash scheduled on the 128th upsert.
+errinj.set("ERRINJ_VY_READ_PAGE", true)
+for i=1,256 do s:upsert({0, 0}, {{'+', 2, 1}}) end
+fiber.sleep(0.05) -- let the squash fail
+errinj.set("ERRINJ_VY_READ_PAGE", false)
+old_squashed = box.info.vinyl().performance.upsert_squashed.total
+s:get{0} -- replays the chain and schedules squashing again
+while box.info.vinyl().performance.upsert_squashed.total == old_squashed do fiber.sleep(0.01) end
+s:get{0}
+s:drop()
+
 --https://github.com/tarantool/tarantool/issues/1842
 --test error injection
 s = box.schema.space.create('test', {engine='vinyl'})
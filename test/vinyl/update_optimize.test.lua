@@ -147,3 +147,41 @@ index2:select{}
 index3:select{}
 
 space:drop()
+
+-- optimize replaces
+
+space = box.schema.space.create('test', { engine = 'vinyl' })
+index = space:create_index('primary', { run_count_per_level = 20 })
+index2 = space:create_index('secondary', { parts = {5, 'unsigned'}, run_count_per_level = 20 })
+box.snapshot()
+index_run_count = index:info().run_count
+index2_run_count = index2:info().run_count
+old_stmt_count = box.info.vinyl().performance.dumped_statements
+space:replace({1, 2, 3, 4, 5})
+space:replace({2, 3, 4, 5, 6})
+box.snapshot()
+index_run_count = wait_for_dump(index, index_run_count)
+index2_run_count = wait_for_dump(index2, index2_run_count)
+new_stmt_count = box.info.vinyl().performance.dumped_statements
+new_stmt_count - old_stmt_count == 4
+old_stmt_count = new_stmt_count
+-- A replace that does not change the secondary key does not
+-- touch the secondary index at all.
+space:replace({1, 20, 30, 40, 5})
+box.snapshot()
+index_run_count = wait_for_dump(index, index_run_count)
+new_stmt_count = box.info.vinyl().performance.dumped_statements
+new_stmt_count - old_stmt_count == 1
+old_stmt_count = new_stmt_count
+-- A replace that moves the secondary key writes DELETE + REPLACE
+-- into the secondary index.
+space:replace({2, 3, 4, 5, 60})
+box.snapshot()
+index_run_count = wait_for_dump(index, index_run_count)
+index2_run_count = wait_for_dump(index2, index2_run_count)
+new_stmt_count = box.info.vinyl().performance.dumped_statements
+new_stmt_count - old_stmt_count == 3
+old_stmt_count = new_stmt_count
+space:select{}
+index2:select{}
+space:drop()
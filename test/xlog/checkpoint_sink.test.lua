@@ -0,0 +1,41 @@
+env = require('test_run').new()
+env:cmd('restart server default')
+fio = require('fio')
+fiber = require('fiber')
+socket = require('socket')
+
+_ = box.schema.space.create('sink'):create_index('pk')
+for i = 1, 100 do box.space.sink:replace({i, 'payload ' .. i}) end
+
+-- A sink server: collect everything the checkpoint streams to it.
+received = nil
+done = fiber.channel(1)
+env:cmd("setopt delimiter ';'")
+srv = socket.tcp_server('127.0.0.1', 0, function(s)
+    local chunks = {}
+    while true do
+        local data = s:read(16384)
+        if data == nil or #data == 0 then
+            break
+        end
+        table.insert(chunks, data)
+    end
+    received = table.concat(chunks)
+    done:put(true)
+end);
+env:cmd("setopt delimiter ''");
+box.cfg{checkpoint_sink = '127.0.0.1:' .. srv:name().port}
+box.snapshot()
+done:get(10)
+-- The sink got a byte-exact copy of the snapshot file.
+files = fio.glob(fio.pathjoin(box.cfg.memtx_dir, '*.snap'))
+table.sort(files)
+f = fio.open(files[#files], {'O_RDONLY'})
+ondisk = f:read(f:stat().size)
+f:close()
+#received > 0
+received == ondisk
+-- An empty string disables streaming again.
+box.cfg{checkpoint_sink = ''}
+srv:close()
+box.space.sink:drop()